@@ -24,6 +24,7 @@
 #define FLB_AWS_COMPRESS_NONE  0
 #define FLB_AWS_COMPRESS_GZIP  1
 #define FLB_AWS_COMPRESS_ARROW 2
+#define FLB_AWS_COMPRESS_ZSTD  3
 
 /*
  * Get compression type from compression keyword. The return value is used to identify
@@ -0,0 +1,94 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_ARENA_H
+#define FLB_ARENA_H
+
+#include <fluent-bit/flb_info.h>
+
+#include <stddef.h>
+
+/* Default size of the arena blocks */
+#define FLB_ARENA_BLOCK_SIZE   (64 * 1024)
+
+/* Alignment of the allocations */
+#define FLB_ARENA_ALIGN        16
+
+/*
+ * Arena (bump) allocator for temporary data: the allocations are never
+ * released one by one, the whole arena is reset once the caller is done,
+ * e.g: at the end of a filter callback or a flush.
+ *
+ * Blocks are requested with flb_malloc() (so they come from jemalloc when
+ * enabled) and kept across resets, a reset only rewinds the arena to the
+ * first block. Allocations larger than a quarter of the block size get
+ * their own block, released on reset.
+ */
+struct flb_arena_block {
+    size_t size;                       /* usable bytes              */
+    size_t offset;                     /* bytes in use              */
+    struct flb_arena_block *next;
+    char *data;
+};
+
+struct flb_arena {
+    size_t block_size;
+    struct flb_arena_block *head;      /* first block               */
+    struct flb_arena_block *current;   /* block serving allocations */
+    struct flb_arena_block *large;     /* dedicated blocks, LIFO    */
+    void *last;                        /* last allocation           */
+};
+
+/* Position saved by flb_arena_mark() */
+struct flb_arena_mark {
+    struct flb_arena_block *block;
+    size_t offset;
+    struct flb_arena_block *large;
+};
+
+/*
+ * Growable buffer backed by an arena, flb_arena_buf_write() can be used as
+ * the write callback of a msgpack_packer.
+ */
+struct flb_arena_buf {
+    char *data;
+    size_t size;
+    size_t alloc;
+    struct flb_arena *arena;
+};
+
+struct flb_arena *flb_arena_create(size_t block_size);
+void flb_arena_destroy(struct flb_arena *arena);
+void flb_arena_reset(struct flb_arena *arena);
+
+void *flb_arena_alloc(struct flb_arena *arena, size_t size);
+void *flb_arena_calloc(struct flb_arena *arena, size_t n, size_t size);
+void *flb_arena_realloc(struct flb_arena *arena, void *ptr,
+                        size_t old_size, size_t new_size);
+char *flb_arena_strndup(struct flb_arena *arena, const char *str, size_t len);
+
+void flb_arena_mark(struct flb_arena *arena, struct flb_arena_mark *mark);
+void flb_arena_rewind(struct flb_arena *arena, struct flb_arena_mark *mark);
+
+void flb_arena_buf_init(struct flb_arena_buf *buf, struct flb_arena *arena,
+                        size_t size);
+int flb_arena_buf_append(struct flb_arena_buf *buf, const char *str, size_t len);
+int flb_arena_buf_write(void *data, const char *str, size_t len);
+
+#endif
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_COMPRESSION_H
+#define FLB_COMPRESSION_H
+
+#include <fluent-bit/flb_info.h>
+#include <stdio.h>
+
+/*
+ * Generic access to the compression codecs. The algorithm names are the
+ * ones used on the wire by Forward ('compressed' option) and HTTP
+ * (Content-Encoding), and in the plugins configuration.
+ */
+#define FLB_COMPRESSION_ALGORITHM_NONE   0
+#define FLB_COMPRESSION_ALGORITHM_GZIP   1
+#define FLB_COMPRESSION_ALGORITHM_ZSTD   2
+
+/* Returns the algorithm for 'name', or -1 if it's unknown or not built in */
+int flb_compression_get_algorithm(const char *name);
+int flb_compression_get_algorithm_len(const char *name, size_t len);
+const char *flb_compression_get_name(int algorithm);
+
+int flb_compression_compress(int algorithm, void *in_data, size_t in_len,
+                             void **out_data, size_t *out_len);
+int flb_compression_uncompress(int algorithm, void *in_data, size_t in_len,
+                               void **out_data, size_t *out_len);
+
+#endif
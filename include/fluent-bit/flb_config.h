@@ -37,6 +37,7 @@
 #define HC_RETRY_FAILURE_COUNTS_DEFAULT 5
 #define HEALTH_CHECK_PERIOD 60
 #define FLB_CONFIG_DEFAULT_TAG  "fluent_bit"
+#define FLB_CONFIG_PARSERS_INDEX_SIZE 256
 
 /* Main struct to hold the configuration of the runtime service */
 struct flb_config {
@@ -114,9 +115,11 @@ struct flb_config {
 
     /* Parsers instances */
     struct mk_list parsers;
+    struct flb_hash_table *parsers_index;           /* parsers by name */
 
     /* Multiline core parser definitions */
     struct mk_list multiline_parsers;
+    struct flb_hash_table *multiline_parsers_index; /* by lowercase name */
 
     /* Outputs instances */
     struct mk_list outputs;             /* list of output plugins   */
@@ -214,6 +217,11 @@ struct flb_config {
     int   storage_checksum;         /* checksum enabled */
     int   storage_max_chunks_up;    /* max number of chunks 'up' in memory */
     char *storage_bl_mem_limit;     /* storage backlog memory limit */
+    int   storage_sync_window;      /* group commit window (ms), 0: off */
+    char *storage_prealloc_size;    /* file chunks growth step */
+    char *storage_compression;      /* compression of the chunks down */
+    char *storage_compression_dict; /* shared dictionary file */
+    void *storage_dict;             /* loaded dictionary */
     struct flb_storage_metrics *storage_metrics_ctx; /* storage metrics context */
 
     /* Embedded SQL Database support (SQLite3) */
@@ -265,6 +273,13 @@ struct flb_config {
     unsigned int sched_cap;
     unsigned int sched_base;
 
+    /* Buffers enqueued by the threaded inputs */
+    void *in_queue;              /* struct flb_mpsc_queue           */
+
+    /* Filter workers */
+    int filter_workers;          /* number of filter worker threads */
+    void *filter_worker_pool;    /* struct flb_filter_worker_pool   */
+
     struct flb_task_map tasks_map[2048];
 
     int dry_run;
@@ -335,6 +350,10 @@ enum conf_type {
 #define FLB_CONF_STORAGE_CHECKSUM      "storage.checksum"
 #define FLB_CONF_STORAGE_BL_MEM_LIMIT  "storage.backlog.mem_limit"
 #define FLB_CONF_STORAGE_MAX_CHUNKS_UP "storage.max_chunks_up"
+#define FLB_CONF_STORAGE_SYNC_WINDOW   "storage.sync_window"
+#define FLB_CONF_STORAGE_PREALLOC_SIZE "storage.prealloc_size"
+#define FLB_CONF_STORAGE_COMPRESSION   "storage.compression"
+#define FLB_CONF_STORAGE_COMPRESSION_DICT "storage.compression_dictionary"
 
 /* Coroutines */
 #define FLB_CONF_STR_CORO_STACK_SIZE "Coro_Stack_Size"
@@ -343,4 +362,7 @@ enum conf_type {
 #define FLB_CONF_STR_SCHED_CAP        "scheduler.cap"
 #define FLB_CONF_STR_SCHED_BASE       "scheduler.base"
 
+/* Filters */
+#define FLB_CONF_STR_FILTER_WORKERS   "filter.workers"
+
 #endif
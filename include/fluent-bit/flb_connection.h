@@ -58,6 +58,7 @@ struct flb_net_setup;
 struct flb_upstream;
 struct flb_downstream;
 struct flb_tls_session;
+struct flb_http2_session;
 
 /* Base network connection */
 struct flb_connection {
@@ -145,6 +146,9 @@ struct flb_connection {
 
     /* Each TCP connections using TLS needs a session */
     struct flb_tls_session *tls_session;
+
+    /* HTTP/2 session, the connection is shared by its streams */
+    struct flb_http2_session *http2_session;
 };
 
 int flb_connection_setup(struct flb_connection *connection,
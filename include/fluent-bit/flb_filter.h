@@ -33,6 +33,7 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_config_map.h>
 #include <fluent-bit/flb_input_chunk.h>
+#include <fluent-bit/flb_arena.h>
 #include <msgpack.h>
 
 #include <cmetrics/cmetrics.h>
@@ -41,11 +42,19 @@
 #define FLB_FILTER_MODIFIED 1
 #define FLB_FILTER_NOTOUCH  2
 
+/*
+ * Plugin flags
+ *
+ * FLB_FILTER_THREAD_SAFE: the filter callback only keeps per-call state (and
+ * the instance arena), filter workers can run it concurrently.
+ */
+#define FLB_FILTER_THREAD_SAFE  1
+
 struct flb_input_instance;
 struct flb_filter_instance;
 
 struct flb_filter_plugin {
-    int flags;             /* Flags (not available at the moment */
+    int flags;             /* Flags                        */
     char *name;            /* Filter short name            */
     char *description;     /* Description                  */
 
@@ -80,6 +89,15 @@ struct flb_filter_instance {
     struct mk_list properties;     /* config properties        */
     struct mk_list *config_map;    /* configuration map        */
 
+    /*
+     * serialize the callback of filters that are not thread safe when
+     * filter workers are enabled
+     */
+    pthread_mutex_t lock;
+
+    /* temporary data of the callback, see flb_filter_arena_get() */
+    struct flb_arena *arena;
+
     struct mk_list _head;          /* link to config->filters  */
 
     /*
@@ -118,9 +136,15 @@ void flb_filter_do(struct flb_input_chunk *ic,
                    const void *data, size_t bytes,
                    const char *tag, int tag_len,
                    struct flb_config *config);
+int flb_filter_run(struct flb_input_instance *i_ins,
+                   const char *tag, int tag_len,
+                   const void *data, size_t bytes, size_t records,
+                   void **out_buf, size_t *out_bytes,
+                   struct flb_config *config);
 const char *flb_filter_name(struct flb_filter_instance *ins);
 int flb_filter_init_all(struct flb_config *config);
 void flb_filter_set_context(struct flb_filter_instance *ins, void *context);
+struct flb_arena *flb_filter_arena_get(struct flb_filter_instance *ins);
 void flb_filter_instance_destroy(struct flb_filter_instance *ins);
 
 #endif
@@ -0,0 +1,112 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_FILTER_WORKER_H
+#define FLB_FILTER_WORKER_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_ring_buffer.h>
+#include <fluent-bit/flb_thread_pool.h>
+
+#include <monkey/mk_core.h>
+
+/* Return values of flb_filter_worker_dispatch() */
+#define FLB_FILTER_WORKER_QUEUED    0
+#define FLB_FILTER_WORKER_INLINE    1
+
+struct flb_arena;
+struct flb_input_instance;
+
+/*
+ * A unit of work exchanged between the engine and a filter worker: the
+ * records appended by an input instance. Once the filter chain has been
+ * applied 'filtered' is set and the (maybe modified) buffer goes back to
+ * the engine, which writes it to the input chunk. A filtered work with an
+ * empty buffer means all the records were dropped.
+ */
+struct flb_filter_work {
+    int event_type;
+    int filtered;
+    size_t records;
+    flb_sds_t tag;
+    void *buf_data;
+    size_t buf_size;
+    size_t in_size;          /* bytes accounted in ins->mem_filter_size */
+    struct flb_input_instance *ins;
+    struct mk_list _head;    /* link to a worker pending list           */
+};
+
+struct flb_filter_worker {
+    int id;
+    int stop;                          /* set by the engine to stop the worker */
+    int exited;                        /* set by the worker once it's done     */
+    struct mk_event event;             /* wake up channel event                */
+    struct mk_event_loop *evl;         /* worker event loop                    */
+    flb_pipefd_t ch_events[2];         /* wake up channel                      */
+
+    /*
+     * Each ring buffer has a single producer and a single consumer, the
+     * engine owns the write side of 'rb_in' and the read side of 'rb_out'.
+     */
+    struct flb_ring_buffer *rb_in;     /* engine -> worker */
+    struct flb_ring_buffer *rb_out;    /* worker -> engine */
+
+    /*
+     * Work that did not fit in a full ring buffer waits in these lists,
+     * in order, and goes to the ring buffer once it has room again. Each
+     * list is only used by the writer of its ring buffer.
+     */
+    struct mk_list in_pending;         /* engine side, waiting for rb_in  */
+    struct mk_list out_pending;        /* worker side, waiting for rb_out */
+    int out_blocked;                   /* worker waits for room in rb_out */
+
+    /* temporary data of the filter callbacks, see flb_filter_arena_get() */
+    struct flb_arena *arena;
+
+    struct flb_tp_thread *th;
+    struct flb_config *config;
+};
+
+struct flb_filter_worker_pool {
+    int size;
+    int stopping;
+    struct flb_tp *tp;
+    struct flb_filter_worker *workers;
+};
+
+int flb_filter_worker_pool_create(struct flb_config *config);
+void flb_filter_worker_pool_destroy(struct flb_config *config);
+
+int flb_filter_worker_dispatch(struct flb_input_instance *ins,
+                               size_t records,
+                               const char *tag, size_t tag_len,
+                               const void *buf, size_t buf_size);
+int flb_filter_worker_append(struct flb_filter_worker *worker,
+                             struct flb_input_instance *ins,
+                             int event_type, size_t records,
+                             const char *tag, size_t tag_len,
+                             const void *buf, size_t buf_size);
+void flb_filter_worker_collect(struct flb_config *config, void *data);
+
+struct flb_filter_worker *flb_filter_worker_get(struct flb_config *config);
+
+#endif
@@ -0,0 +1,77 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_HPACK_H
+#define FLB_HPACK_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+
+#include <stdint.h>
+
+/* Default size of the dynamic table (SETTINGS_HEADER_TABLE_SIZE) */
+#define FLB_HPACK_TABLE_SIZE          4096
+
+/* Number of entries of the static table */
+#define FLB_HPACK_STATIC_TABLE_LEN    61
+
+/*
+ * HPACK header compression for HTTP/2 (RFC 7541).
+ *
+ * The decoder keeps the dynamic table of the peer encoder. The encoder is
+ * stateless: headers are sent as static table references or as literals
+ * without indexing, so the peer table size is never a concern.
+ */
+struct flb_hpack_entry {
+    char *name;
+    size_t name_len;
+    char *value;
+    size_t value_len;
+};
+
+struct flb_hpack_table {
+    size_t size;                       /* size of the entries (RFC 7541 4.1) */
+    size_t max_size;                   /* current limit set by the encoder   */
+    size_t max_size_limit;             /* limit advertised to the encoder    */
+    int count;                         /* number of entries                  */
+    int alloc;                         /* allocated slots                    */
+    struct flb_hpack_entry *entries;   /* oldest entry first                 */
+};
+
+typedef int (*flb_hpack_header_cb)(void *data,
+                                   const char *name, size_t name_len,
+                                   const char *value, size_t value_len);
+
+struct flb_hpack_table *flb_hpack_table_create(size_t max_size);
+void flb_hpack_table_destroy(struct flb_hpack_table *table);
+
+int flb_hpack_decode(struct flb_hpack_table *table,
+                     const unsigned char *buf, size_t len,
+                     flb_hpack_header_cb cb, void *data);
+int flb_hpack_encode_header(flb_sds_t *buf,
+                            const char *name, size_t name_len,
+                            const char *value, size_t value_len);
+
+size_t flb_hpack_huffman_encoded_len(const unsigned char *buf, size_t len);
+int flb_hpack_huffman_encode(flb_sds_t *out,
+                             const unsigned char *buf, size_t len);
+int flb_hpack_huffman_decode(flb_sds_t *out,
+                             const unsigned char *buf, size_t len);
+
+#endif
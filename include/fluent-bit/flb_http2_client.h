@@ -0,0 +1,96 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_HTTP2_CLIENT_H
+#define FLB_HTTP2_CLIENT_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_hpack.h>
+#include <monkey/mk_core.h>
+
+#include <stdint.h>
+
+/* ALPN protocols offered on TLS connections (RFC 7301 wire format) */
+#define FLB_HTTP2_ALPN             "\x02h2\x08http/1.1"
+
+/* Session status */
+#define FLB_HTTP2_SESSION_ACTIVE   0   /* accepts new streams              */
+#define FLB_HTTP2_SESSION_GOAWAY   1   /* no new streams, finishing        */
+#define FLB_HTTP2_SESSION_ERROR    2   /* connection failed                */
+
+struct flb_connection;
+struct flb_http_client;
+
+/* A request, it belongs to the coroutine that issued it */
+struct flb_http2_stream {
+    uint32_t id;
+    int done;                      /* response complete or failed         */
+    int error;                     /* the stream failed                   */
+    int headers_done;              /* final response headers received     */
+    int truncated;                 /* response larger than the buffer     */
+    int64_t send_window;           /* flow control window to send DATA    */
+    uint32_t recv_unacked;         /* DATA received and not acknowledged  */
+    size_t body_off;               /* request body bytes already queued   */
+    struct flb_http_client *c;
+    struct flb_coro *coro;         /* coroutine waiting for the response  */
+    struct mk_list _head;          /* link to flb_http2_session->streams  */
+};
+
+/*
+ * HTTP/2 session of an upstream connection. The connection is shared by the
+ * callers that get it from the upstream ('users'), every request is a stream
+ * of the session. The socket I/O is done by a handler registered in the event
+ * loop, the coroutines only queue frames and wait for their response.
+ */
+struct flb_http2_session {
+    int status;
+    int users;                     /* callers holding the connection      */
+    int n_streams;                 /* open streams                        */
+    uint32_t next_stream_id;
+    uint32_t max_streams;          /* peer SETTINGS_MAX_CONCURRENT_STREAMS */
+    uint32_t max_frame_size;       /* peer SETTINGS_MAX_FRAME_SIZE        */
+    int64_t initial_window;        /* peer SETTINGS_INITIAL_WINDOW_SIZE   */
+    int64_t send_window;           /* connection window to send DATA      */
+    uint32_t recv_unacked;         /* DATA received and not acknowledged  */
+
+    /* header block being received, it can span CONTINUATION frames */
+    uint32_t cont_stream_id;
+    int cont_end_stream;
+    flb_sds_t hbuf;
+    flb_sds_t hlines;              /* decoded response headers            */
+    struct flb_hpack_table *hpack; /* decoder state of the peer encoder   */
+
+    flb_sds_t rbuf;                /* incoming bytes not processed yet    */
+    flb_sds_t wbuf;                /* outgoing frames                     */
+    size_t wbuf_off;               /* bytes of 'wbuf' already written     */
+
+    struct mk_list streams;
+    struct flb_connection *conn;
+};
+
+int flb_http2_client_enabled(struct flb_http_client *c);
+int flb_http2_client_do(struct flb_http_client *c, size_t *bytes);
+
+int flb_http2_session_acquire(struct flb_http2_session *session);
+int flb_http2_session_release(struct flb_http2_session *session);
+void flb_http2_session_destroy(struct flb_http2_session *session);
+
+#endif
@@ -219,6 +219,12 @@ struct flb_input_instance {
     size_t mem_chunks_size;
     size_t mp_total_buf_size; /* FIXME: to be deprecated */
 
+    /*
+     * Bytes handed over to the filter workers and not yet written back to
+     * a chunk, they count against 'mem_buf_limit' (engine thread only).
+     */
+    size_t mem_filter_size;
+
     /*
      * Buffer limit: optional limit set by configuration so this input instance
      * cannot exceed more than mp_buf_limit (bytes unit).
@@ -296,13 +302,6 @@ struct flb_input_instance {
     int is_threaded;
     struct flb_input_thread_instance *thi;
 
-    /*
-     * ring buffer: the ring buffer is used by the instance if is running
-     * in threaded mode; so when registering a msgpack buffer this happens
-     * in the ring buffer.
-     */
-    struct flb_ring_buffer *rb;
-
     /* List of upstreams */
     struct mk_list upstreams;
 
@@ -58,6 +58,9 @@
 /* Max length for Tag */
 #define FLB_INPUT_CHUNK_TAG_MAX        (65535 - FLB_INPUT_CHUNK_META_HEADER)
 
+/* Number of buffers the threaded inputs can enqueue for the engine */
+#define FLB_INPUT_CHUNK_QUEUE_SIZE     8192
+
 struct flb_input_chunk {
     int  event_type;                 /* chunk type: logs, metrics or traces */
     bool fs_counted;
@@ -96,6 +99,11 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
                                size_t records,
                                const char *tag, size_t tag_len,
                                const void *buf, size_t buf_size);
+int flb_input_chunk_append_filtered(struct flb_input_instance *in,
+                                    int event_type,
+                                    size_t records,
+                                    const char *tag, size_t tag_len,
+                                    const void *buf, size_t buf_size);
 
 const void *flb_input_chunk_flush(struct flb_input_chunk *ic, size_t *size);
 int flb_input_chunk_release_lock(struct flb_input_chunk *ic);
@@ -104,7 +112,9 @@ int flb_input_chunk_get_event_type(struct flb_input_chunk *ic);
 
 int flb_input_chunk_get_tag(struct flb_input_chunk *ic,
                             const char **tag_buf, int *tag_len);
-void flb_input_chunk_ring_buffer_collector(struct flb_config *ctx, void *data);
+int flb_input_chunk_queue_create(struct flb_config *ctx);
+void flb_input_chunk_queue_destroy(struct flb_config *ctx);
+void flb_input_chunk_queue_collector(struct flb_config *ctx, void *data);
 ssize_t flb_input_chunk_get_size(struct flb_input_chunk *ic);
 size_t flb_input_chunk_set_limits(struct flb_input_instance *in);
 size_t flb_input_chunk_total_size(struct flb_input_instance *in);
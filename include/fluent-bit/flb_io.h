@@ -39,6 +39,10 @@
 /* Other features */
 #define FLB_IO_IPV6       32  /* network I/O uses IPv6                  */
 
+/* Vectored writes */
+#define FLB_IO_IOV_STACK        8      /* iovec entries copied on the stack */
+#define FLB_IO_TLS_RECORD_SIZE  16384  /* max TLS record payload            */
+
 struct flb_connection;
 
 int flb_io_net_accept(struct flb_connection *connection,
@@ -52,8 +56,14 @@ int flb_io_net_write(struct flb_connection *connection, const void *data,
 
 ssize_t flb_io_net_read(struct flb_connection *connection, void *buf, size_t len);
 
+int flb_io_net_writev(struct flb_connection *connection,
+                      const struct mk_iovec *iov, int iovcnt, size_t *out_len);
+
 int flb_io_fd_write(int fd, const void *data, size_t len, size_t *out_len);
 
+int flb_io_fd_writev(int fd, const struct mk_iovec *iov, int iovcnt,
+                     size_t *out_len);
+
 ssize_t flb_io_fd_read(int fd, void *buf, size_t len);
 
 #endif
@@ -0,0 +1,79 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_LOG_EVENT_DECODER_H
+#define FLB_LOG_EVENT_DECODER_H
+
+#include <fluent-bit/flb_time.h>
+#include <msgpack.h>
+
+/* Return values of flb_log_event_decoder_next() */
+#define FLB_EVENT_DECODER_SUCCESS     0
+#define FLB_EVENT_DECODER_END         1
+#define FLB_EVENT_DECODER_ERROR      -1
+
+/*
+ * A view over one record of a log chunk. All the pointers reference the
+ * buffer given to the decoder, nothing is copied. Records in this version
+ * have the '[timestamp, {body}]' layout and carry no metadata.
+ */
+struct flb_log_event {
+    struct flb_time timestamp;
+
+    /* full record: '[timestamp, {body}]' */
+    const char *raw;
+    size_t raw_size;
+
+    /* the body map only */
+    const char *body_raw;
+    size_t body_raw_size;
+    size_t body_entries;
+
+    /* body unpacked on demand by flb_log_event_decoder_get_body() */
+    msgpack_object *body;
+};
+
+struct flb_log_event_decoder {
+    const char *buffer;
+    size_t length;
+    size_t offset;
+
+    /* objects skipped by flb_log_event_decoder_next() as not being records */
+    size_t skipped;
+
+    /* memory reused by the objects unpacked on demand */
+    msgpack_zone *zone;
+    msgpack_object body;
+    msgpack_object value;
+};
+
+int flb_log_event_decoder_init(struct flb_log_event_decoder *ctx,
+                               const char *buf, size_t size);
+void flb_log_event_decoder_destroy(struct flb_log_event_decoder *ctx);
+
+int flb_log_event_decoder_next(struct flb_log_event_decoder *ctx,
+                               struct flb_log_event *event);
+
+msgpack_object *flb_log_event_decoder_get_body(struct flb_log_event_decoder *ctx,
+                                               struct flb_log_event *event);
+msgpack_object *flb_log_event_decoder_get_value(struct flb_log_event_decoder *ctx,
+                                                struct flb_log_event *event,
+                                                const char *key, size_t key_len);
+
+#endif
@@ -0,0 +1,78 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_MPSC_QUEUE_H
+#define FLB_MPSC_QUEUE_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_pipe.h>
+
+#include <monkey/mk_core.h>
+
+#include <stdint.h>
+
+#define FLB_MPSC_QUEUE_CACHE_LINE 64
+
+/*
+ * Bounded lock-free queue of pointers, many threads can push while a single
+ * thread pops. Every cell carries a sequence number telling if it's free for
+ * the producer that reserved its position or ready for the consumer, so
+ * producers only contend on the head counter.
+ *
+ * When attached to an event loop, the consumer is woken up through an
+ * eventfd (a pipe where not available). Wakeups are coalesced: only the
+ * first push after the consumer reset the signal writes to the channel.
+ */
+struct flb_mpsc_queue_cell {
+    uint64_t seq;
+    void *data;
+};
+
+struct flb_mpsc_queue {
+    /* producers side */
+    uint64_t head;
+    char pad0[FLB_MPSC_QUEUE_CACHE_LINE - sizeof(uint64_t)];
+
+    /* consumer side */
+    uint64_t tail;
+    char pad1[FLB_MPSC_QUEUE_CACHE_LINE - sizeof(uint64_t)];
+
+    int signaled;                       /* a wakeup is pending     */
+    char pad2[FLB_MPSC_QUEUE_CACHE_LINE - sizeof(int)];
+
+    uint64_t mask;                      /* number of cells - 1     */
+    struct flb_mpsc_queue_cell *cells;
+
+    /* wakeup channel, both ends are the same fd with eventfd */
+    flb_pipefd_t signal_channels[2];
+    struct mk_event event;
+    void *event_loop;
+};
+
+struct flb_mpsc_queue *flb_mpsc_queue_create(uint64_t size);
+void flb_mpsc_queue_destroy(struct flb_mpsc_queue *q);
+
+int flb_mpsc_queue_add_event_loop(struct flb_mpsc_queue *q, void *evl,
+                                  int (*handler)(void *), void *data);
+void flb_mpsc_queue_signal_reset(struct flb_mpsc_queue *q);
+
+int flb_mpsc_queue_push(struct flb_mpsc_queue *q, void *data);
+int flb_mpsc_queue_pop(struct flb_mpsc_queue *q, void **data);
+
+#endif
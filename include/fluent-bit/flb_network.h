@@ -76,6 +76,9 @@ struct flb_net_setup {
 
     /* prioritize ipv4 results when trying to establish a connection*/
     int   dns_prefer_ipv4;
+
+    /* use HTTP/2 for HTTP requests when the server supports it */
+    int http2;
 };
 
 /* Defines a host service and it properties */
@@ -44,9 +44,11 @@
 #include <fluent-bit/flb_http_client.h>
 #include <fluent-bit/tls/flb_tls.h>
 #include <fluent-bit/flb_output_thread.h>
+#include <fluent-bit/flb_output_batch.h>
 #include <fluent-bit/flb_upstream.h>
 #include <fluent-bit/flb_upstream_ha.h>
 #include <fluent-bit/flb_event.h>
+#include <fluent-bit/flb_arena.h>
 
 #include <cmetrics/cmetrics.h>
 #include <cmetrics/cmt_counter.h>
@@ -371,8 +373,25 @@ struct flb_output_instance {
 
     /* Thread Pool: this is optional for the caller */
     int tp_workers;
+    int tp_dispatch;           /* FLB_OUTPUT_DISPATCH_* policy       */
+    int tp_steal;              /* idle workers steal pending tasks   */
     struct flb_tp *tp;
 
+    /*
+     * Batching: small chunks with the same tag are held in an open batch
+     * across dispatch rounds and delivered by a single flush. The target
+     * size of the batches is adjusted by the flush results (see
+     * flb_output_batch.h).
+     */
+    int batch;                 /* batching enabled                   */
+    size_t batch_min_size;     /* lower limit of the target size     */
+    size_t batch_max_size;     /* upper limit of the target size     */
+    int batch_latency_target;  /* slower responses shrink the target */
+    int batch_max_wait;        /* max time a batch stays open (ms),
+                                  0: one flush interval              */
+    size_t batch_target;       /* current target size (atomic)       */
+    struct mk_list batches;    /* open batches, engine thread only   */
+
     /* If the thread pool was created, this flag is turned on */
     int is_threaded;
 
@@ -419,9 +438,11 @@ struct flb_output_flush {
     int id;                            /* out-thread ID      */
     const void *buffer;                /* output buffer      */
     struct flb_task *task;             /* Parent flb_task    */
+    struct flb_output_batch *batch;    /* tasks batch or NULL */
     struct flb_config *config;         /* FLB context        */
     struct flb_output_instance *o_ins; /* output instance    */
     struct flb_coro *coro;             /* parent coro addr   */
+    struct flb_arena *arena;           /* temporary data, or NULL */
     struct mk_list _head;              /* Link to flb_task->threads */
 };
 
@@ -437,9 +458,30 @@ static FLB_INLINE void flb_output_flush_destroy(struct flb_output_flush *out_flu
 
     mk_list_del(&out_flush->_head);
     flb_coro_destroy(out_flush->coro);
+    if (out_flush->batch) {
+        flb_output_batch_destroy(out_flush->batch);
+    }
+    if (out_flush->arena) {
+        flb_arena_destroy(out_flush->arena);
+    }
     flb_free(out_flush);
 }
 
+/*
+ * Arena for the temporary data of a flush callback. Flushes of the same
+ * thread interleave as coroutines, so the arena belongs to the flush and it's
+ * released with it: the plugin must not keep references after it returns.
+ */
+static FLB_INLINE
+struct flb_arena *flb_output_flush_arena_get(struct flb_output_flush *out_flush)
+{
+    if (!out_flush->arena) {
+        out_flush->arena = flb_arena_create(FLB_ARENA_BLOCK_SIZE);
+    }
+
+    return out_flush->arena;
+}
+
 /*
  * libco do not support parameters in the entrypoint function due to the
  * complexity of implementation in terms of architecture and compiler, but
@@ -478,7 +520,12 @@ static FLB_INLINE void output_params_set(struct flb_output_flush *out_flush,
     }
 
     /* Callback parameters in order */
-    params->event_chunk = task->event_chunk;
+    if (out_flush->batch) {
+        params->event_chunk = out_flush->batch->event_chunk;
+    }
+    else {
+        params->event_chunk = task->event_chunk;
+    }
     params->out_flush   = out_flush;
     params->i_ins       = task->i_ins;
     params->out_context = out_context;
@@ -528,6 +575,7 @@ int flb_output_flush_id_get(struct flb_output_instance *ins);
 
 static FLB_INLINE
 struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
+                                                 struct flb_output_batch *batch,
                                                  struct flb_input_instance *i_ins,
                                                  struct flb_output_instance *o_ins,
                                                  struct flb_config *config)
@@ -558,7 +606,13 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
     out_flush->id     = flb_output_flush_id_get(o_ins);
     out_flush->o_ins  = o_ins;
     out_flush->task   = task;
-    out_flush->buffer = task->event_chunk->data;
+    out_flush->batch  = batch;
+    if (batch) {
+        out_flush->buffer = batch->event_chunk->data;
+    }
+    else {
+        out_flush->buffer = task->event_chunk->data;
+    }
     out_flush->config = config;
     out_flush->coro   = coro;
 
@@ -602,6 +656,7 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
  * a return value. The return value is either FLB_OK, FLB_RETRY or FLB_ERROR.
  */
 static inline void flb_output_return(int ret, struct flb_coro *co) {
+    int i;
     int n;
     int pipe_fd;
     uint32_t set;
@@ -613,20 +668,6 @@ static inline void flb_output_return(int ret, struct flb_coro *co) {
 
     out_flush = (struct flb_output_flush *) co->data;
     o_ins = out_flush->o_ins;
-    task = out_flush->task;
-
-    /*
-     * To compose the signal event the relevant info is:
-     *
-     * - Unique Task events id: 2 in this case
-     * - Return value: FLB_OK (0), FLB_ERROR (1) or FLB_RETRY (2)
-     * - Task ID
-     * - Output Instance ID (struct flb_output_instance)->id
-     *
-     * We put together the return value with the task_id on the 32 bits at right
-     */
-    set = FLB_TASK_SET(ret, task->id, o_ins->id);
-    val = FLB_BITS_U64_SET(2 /* FLB_ENGINE_TASK */, set);
 
     /*
      * Set the target pipe channel: if this return code is running inside a
@@ -643,12 +684,42 @@ static inline void flb_output_return(int ret, struct flb_coro *co) {
         pipe_fd = out_flush->o_ins->ch_events[1];
     }
 
-    /* Notify the event loop about our return status */
-    n = flb_pipe_w(pipe_fd, (void *) &val, sizeof(val));
-    if (n == -1) {
-        flb_errno();
+    /* Adjust the batch target size */
+    if (out_flush->batch) {
+        flb_output_batch_feedback(o_ins, out_flush->batch, ret);
     }
 
+    /*
+     * To compose the signal event the relevant info is:
+     *
+     * - Unique Task events id: 2 in this case
+     * - Return value: FLB_OK (0), FLB_ERROR (1) or FLB_RETRY (2)
+     * - Task ID
+     * - Output Instance ID (struct flb_output_instance)->id
+     *
+     * We put together the return value with the task_id on the 32 bits at right.
+     * A batch reports the same return value for every task it contains.
+     */
+    i = 0;
+    do {
+        if (out_flush->batch) {
+            task = out_flush->batch->tasks[i];
+        }
+        else {
+            task = out_flush->task;
+        }
+
+        set = FLB_TASK_SET(ret, task->id, o_ins->id);
+        val = FLB_BITS_U64_SET(2 /* FLB_ENGINE_TASK */, set);
+
+        /* Notify the event loop about our return status */
+        n = flb_pipe_w(pipe_fd, (void *) &val, sizeof(val));
+        if (n == -1) {
+            flb_errno();
+        }
+        i++;
+    } while (out_flush->batch && i < out_flush->batch->n_tasks);
+
     /*
      * Prepare the co-routine to be destroyed: real-destroy happens in the
      * event loop cleanup functions.
@@ -753,5 +824,9 @@ int flb_output_set_http_debug_callbacks(struct flb_output_instance *ins);
 int flb_output_task_flush(struct flb_task *task,
                           struct flb_output_instance *out_ins,
                           struct flb_config *config);
+int flb_output_flush_dispatch(struct flb_task *task,
+                              struct flb_output_batch *batch,
+                              struct flb_output_instance *out_ins,
+                              struct flb_config *config);
 
 #endif
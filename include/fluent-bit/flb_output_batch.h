@@ -0,0 +1,70 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_OUTPUT_BATCH_H
+#define FLB_OUTPUT_BATCH_H
+
+#include <fluent-bit/flb_info.h>
+#include <monkey/mk_core.h>
+
+#include <stdint.h>
+
+/* Default limits of the batch target size and the latency target */
+#define FLB_OUTPUT_BATCH_MIN_SIZE        (512 * 1024)
+#define FLB_OUTPUT_BATCH_MAX_SIZE        (8 * 1024 * 1024)
+#define FLB_OUTPUT_BATCH_LATENCY_TARGET  1000    /* milliseconds */
+#define FLB_OUTPUT_BATCH_MAX_WAIT        0       /* one flush interval */
+
+struct flb_task;
+struct flb_config;
+struct flb_event_chunk;
+struct flb_output_instance;
+
+/*
+ * A batch groups the tasks with the same tag that the engine dispatches to an
+ * output, they are delivered by a single invocation of the flush callback
+ * once the batch reaches the target size or after 'batch.max_wait' (one
+ * flush interval by default). Every task still gets its own return status.
+ *
+ * The size target of the batches adapts to the output response (AIMD): it
+ * grows by 'batch.min_size' after every full batch delivered under the
+ * latency target, and it's halved on errors, retries or slow responses.
+ */
+struct flb_output_batch {
+    int n_tasks;                          /* number of tasks               */
+    int n_alloc;                          /* allocated slots in 'tasks'    */
+    size_t size;                          /* total bytes of the tasks      */
+    uint64_t ts_open;                     /* creation time (nanoseconds)   */
+    uint64_t ts_start;                    /* dispatch time (nanoseconds)   */
+    struct flb_task **tasks;
+    char *buf;                            /* merged content of the tasks   */
+    struct flb_event_chunk *event_chunk;  /* event chunk wrapping 'buf'    */
+    struct mk_list _head;                 /* link to the open batches      */
+};
+
+int flb_output_batch_add(struct flb_task *task,
+                         struct flb_output_instance *ins,
+                         struct flb_config *config);
+void flb_output_batch_flush(struct flb_config *config, int force);
+void flb_output_batch_destroy_all(struct flb_output_instance *ins);
+void flb_output_batch_feedback(struct flb_output_instance *ins,
+                               struct flb_output_batch *batch, int ret);
+void flb_output_batch_destroy(struct flb_output_batch *batch);
+
+#endif
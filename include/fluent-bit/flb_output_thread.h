@@ -57,6 +57,17 @@ struct flb_out_thread_upstream {
     struct mk_list _head;
 };
 
+/* Dispatch policies: how the engine picks the worker that runs a task */
+#define FLB_OUTPUT_DISPATCH_ROUND_ROBIN   0
+#define FLB_OUTPUT_DISPATCH_LEAST_LOADED  1
+
+/* Task, or batch of tasks, assigned to a worker that did not start it yet */
+struct flb_out_thread_task {
+    struct flb_task *task;
+    struct flb_output_batch *batch;
+    struct mk_list _head;
+};
+
 struct flb_out_thread_instance {
     struct mk_event event;               /* event context to associate events */
     struct mk_event_loop *evl;           /* thread event loop context */
@@ -88,6 +99,17 @@ struct flb_out_thread_instance {
      */
      pthread_mutex_t flush_mutex;         /* mutex for 'flush_list' */
 
+    /*
+     * Tasks assigned by the engine are queued in 'pending' until the worker
+     * starts them, idle workers can steal them if enabled. The 'load' counts
+     * the tasks assigned to this worker that did not finish yet (pending and
+     * running), it's updated atomically and read by the engine to pick the
+     * least loaded worker.
+     */
+    int load;
+    struct mk_list pending;
+    pthread_mutex_t pending_mutex;
+
     /* List of mapped 'upstream' contexts */
     struct mk_list upstreams;
 };
@@ -98,6 +120,7 @@ int flb_output_thread_pool_coros_size(struct flb_output_instance *ins);
 void flb_output_thread_pool_destroy(struct flb_output_instance *ins);
 int flb_output_thread_pool_start(struct flb_output_instance *ins);
 int flb_output_thread_pool_flush(struct flb_task *task,
+                                 struct flb_output_batch *batch,
                                  struct flb_output_instance *out_ins,
                                  struct flb_config *config);
 
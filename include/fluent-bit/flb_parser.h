@@ -27,11 +27,53 @@
 #include <fluent-bit/flb_time.h>
 #include <msgpack.h>
 
+#include <pthread.h>
+
 #define FLB_PARSER_REGEX 1
 #define FLB_PARSER_JSON  2
 #define FLB_PARSER_LTSV  3
 #define FLB_PARSER_LOGFMT 4
 
+/* Operations of a compiled time format, see flb_parser_time_lookup() */
+enum {
+    FLB_PARSER_TIME_OP_END = 0,
+    FLB_PARSER_TIME_OP_LITERAL,    /* a character                */
+    FLB_PARSER_TIME_OP_SPACE,      /* any amount of white-space  */
+    FLB_PARSER_TIME_OP_YEAR,       /* %Y                         */
+    FLB_PARSER_TIME_OP_MONTH,      /* %m                         */
+    FLB_PARSER_TIME_OP_MONTH_NAME, /* %b, %B, %h                 */
+    FLB_PARSER_TIME_OP_DAY,        /* %d                         */
+    FLB_PARSER_TIME_OP_HOUR,       /* %H                         */
+    FLB_PARSER_TIME_OP_MINUTE,     /* %M                         */
+    FLB_PARSER_TIME_OP_SECOND,     /* %S                         */
+    FLB_PARSER_TIME_OP_TZ          /* %z                         */
+};
+
+struct flb_parser_time_op {
+    char type;
+    char c;
+};
+
+/*
+ * Last time string resolved by a parser: records coming from the same source
+ * usually share it (or everything but the fractional seconds), so the parsed
+ * time and its epoch are reused.
+ */
+struct flb_parser_time_cache {
+    int len;              /* length of 'str', zero if the cache is empty   */
+    int frac_key;         /* fractional seconds can be excluded of the key */
+    int frac_off;         /* offset of the fractional seconds, or -1       */
+    int frac_len;
+    int year;             /* defaults of formats without a year            */
+    int mon;
+    int mday;
+    double ns;
+    time_t utc;           /* epoch of 'tm' without the UTC offset          */
+    struct flb_tm tm;
+    char str[64];
+    pthread_mutex_t lock;
+};
+
 struct flb_parser_types {
     char *key;
     int  key_len;
@@ -61,7 +103,11 @@ struct flb_parser {
     int time_with_year;   /* do time_fmt consider a year (%Y) ? */
     char *time_fmt_year;
     int time_with_tz;     /* do time_fmt consider a timezone ?  */
+    struct flb_parser_time_op *time_ops;      /* compiled time_fmt       */
+    struct flb_parser_time_op *time_frac_ops; /* compiled time_frac_secs */
+    struct flb_parser_time_cache *time_cache;
     struct flb_regex *regex;
+    struct flb_config *config;
     struct mk_list _head;
 };
 
@@ -95,6 +141,7 @@ struct flb_parser *flb_parser_create(const char *name, const char *format,
                                      int types_len,
                                      struct mk_list *decoders,
                                      struct flb_config *config);
+int flb_parser_regex_engine(struct flb_parser *parser, const char *engine);
 int flb_parser_conf_file(const char *file, struct flb_config *config);
 void flb_parser_destroy(struct flb_parser *parser);
 struct flb_parser *flb_parser_get(const char *name, struct flb_config *config);
@@ -106,6 +153,9 @@ int flb_parser_tzone_offset(const char *str, int len, int *tmdiff);
 int flb_parser_time_lookup(const char *time, size_t tsize, time_t now,
                            struct flb_parser *parser,
                            struct flb_tm *tm, double *ns);
+int flb_parser_time_lookup_epoch(const char *time, size_t tsize, time_t now,
+                                 struct flb_parser *parser,
+                                 time_t *epoch, double *ns);
 int flb_parser_typecast(const char *key, int key_len,
                         const char *val, int val_len,
                         msgpack_packer *pck,
@@ -50,20 +50,18 @@ struct flb_ra_value {
     ra_val val;
 };
 
-struct flb_ra_value *flb_ra_key_to_value(flb_sds_t ckey,
-                                         msgpack_object map,
-                                         struct mk_list *subkeys);
+struct flb_ra_value *flb_ra_key_to_value(struct flb_ra_key *ckey,
+                                         msgpack_object map);
 void flb_ra_key_value_destroy(struct flb_ra_value *v);
 
-int flb_ra_key_value_get(flb_sds_t ckey, msgpack_object map,
-                         struct mk_list *subkeys,
+int flb_ra_key_value_get(struct flb_ra_key *ckey, msgpack_object map,
                          msgpack_object **start_key,
                          msgpack_object **out_key, msgpack_object **out_val);
 
-int flb_ra_key_strcmp(flb_sds_t ckey, msgpack_object map,
-                      struct mk_list *subkeys, char *str, int len);
-int flb_ra_key_regex_match(flb_sds_t ckey, msgpack_object map,
-                           struct mk_list *subkeys, struct flb_regex *regex,
+int flb_ra_key_strcmp(struct flb_ra_key *ckey, msgpack_object map,
+                      char *str, int len);
+int flb_ra_key_regex_match(struct flb_ra_key *ckey, msgpack_object map,
+                           struct flb_regex *regex,
                            struct flb_regex_search *result);
 int flb_ra_key_value_append(struct flb_ra_parser *rp, msgpack_object obj,
                             msgpack_object *in_val, msgpack_packer *mp_pck);
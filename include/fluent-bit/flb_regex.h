@@ -29,12 +29,16 @@
 #include <stdlib.h>
 #include <stddef.h>
 
+struct flb_regex_fast;
+
 struct flb_regex {
     void *regex;
+    struct flb_regex_fast *fast;   /* 'fast' engine program, optional */
 };
 
 struct flb_regex_search {
     int last_pos;
+    int fast;                      /* region comes from the 'fast' engine */
     void *region;
     const char *str;
     void (*cb_match) (const char *,          /* name  */
@@ -45,6 +49,7 @@ struct flb_regex_search {
 
 int flb_regex_init();
 struct flb_regex *flb_regex_create(const char *pattern);
+struct flb_regex *flb_regex_create_fast(const char *pattern);
 ssize_t flb_regex_do(struct flb_regex *r, const char *str, size_t slen,
                      struct flb_regex_search *result);
 
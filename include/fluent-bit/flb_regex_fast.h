@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_REGEX_FAST_H
+#define FLB_REGEX_FAST_H
+
+#include <fluent-bit/flb_info.h>
+
+#include <stddef.h>
+
+/* flb_regex_fast_search() return values */
+#define FLB_REGEX_FAST_MATCH      1
+#define FLB_REGEX_FAST_MISMATCH   0
+#define FLB_REGEX_FAST_ERROR     -1
+#define FLB_REGEX_FAST_FALLBACK  -2  /* subject not handled, use Onigmo */
+
+struct flb_regex_fast_inst;
+
+struct flb_regex_fast_name {
+    char *name;
+    int group;
+};
+
+/*
+ * Compiled program of the 'fast' regex engine: a backtracking matcher for
+ * the subset of the Onigmo Ruby syntax used by the usual log parsers
+ * (literals, classes, groups, alternations, greedy and lazy quantifiers and
+ * line anchors). It only handles ASCII subjects, so one byte is always one
+ * character; anything else is left to Onigmo.
+ *
+ * As in the Ruby syntax, only the named groups capture. Group 'i' of a
+ * match is stored in regs[i * 2] and regs[i * 2 + 1], -1 if it didn't
+ * participate.
+ */
+struct flb_regex_fast {
+    int num_groups;                       /* capturing groups, w/o group 0 */
+    struct flb_regex_fast_name *names;    /* in order of definition        */
+    int anchor;                           /* match at line starts only     */
+    int first_char;                       /* first byte of a match, or -1  */
+    int code_len;
+    struct flb_regex_fast_inst *code;
+    int num_sets;
+    unsigned char (*sets)[256];
+};
+
+struct flb_regex_fast *flb_regex_fast_create(const char *pattern, size_t len);
+void flb_regex_fast_destroy(struct flb_regex_fast *prog);
+int flb_regex_fast_search(struct flb_regex_fast *prog,
+                          const char *str, size_t len, ptrdiff_t *regs);
+
+#endif
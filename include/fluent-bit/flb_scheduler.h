@@ -28,13 +28,23 @@
 /* Sched contstants */
 #define FLB_SCHED_CAP            2000
 #define FLB_SCHED_BASE           5
-#define FLB_SCHED_REQUEST_FRAME  10
 
 /* Timer types */
-#define FLB_SCHED_TIMER_REQUEST     1  /* timerfd             */
-#define FLB_SCHED_TIMER_FRAME       2  /* timer frame checker */
-#define FLB_SCHED_TIMER_CB_ONESHOT  3  /* one-shot callback timer  */
-#define FLB_SCHED_TIMER_CB_PERM     4  /* permanent callback timer */
+#define FLB_SCHED_TIMER_REQUEST     1  /* retry request                */
+#define FLB_SCHED_TIMER_FRAME       2  /* timing wheel driver          */
+#define FLB_SCHED_TIMER_CB_ONESHOT  3  /* one-shot callback timer      */
+#define FLB_SCHED_TIMER_CB_PERM     4  /* permanent callback timer     */
+
+/*
+ * Timing wheel geometry: 6 levels of 64 slots with a resolution of one
+ * millisecond, level N holds the timers expiring within 64^(N + 1) ms.
+ */
+#define FLB_SCHED_WHEEL_BITS        6
+#define FLB_SCHED_WHEEL_SLOTS       (1 << FLB_SCHED_WHEEL_BITS)
+#define FLB_SCHED_WHEEL_MASK        (FLB_SCHED_WHEEL_SLOTS - 1)
+#define FLB_SCHED_WHEEL_LEVELS      6
+#define FLB_SCHED_WHEEL_MAX         ((UINT64_C(1) << (FLB_SCHED_WHEEL_BITS * \
+                                      FLB_SCHED_WHEEL_LEVELS)) - 1)
 
 struct flb_sched;
 
@@ -56,11 +66,20 @@ struct flb_sched_timer {
     /*
      * Custom timer specific data:
      *
-     * - timer_fd = timer file descriptor
      * - cb       = callback to be triggerd upon expiration
+     * - interval = period of permanent timers in milliseconds
      */
-    int timer_fd;
     void (*cb)(struct flb_config *, void *);
+    uint64_t interval;
+
+    /*
+     * Timing wheel: 'expires' is the expiration tick and 'wheel_list' the
+     * wheel list (slot or expired list) the timer is linked to, NULL when
+     * it's not scheduled.
+     */
+    uint64_t expires;
+    struct mk_list *wheel_list;
+    struct mk_list _wheel_head;
 
     /* Parent context */
     struct flb_config *config;
@@ -71,12 +90,19 @@ struct flb_sched_timer {
 
 /* Struct representing a FLB_SCHED_TIMER_REQUEST */
 struct flb_sched_request {
-    flb_pipefd_t fd;
     time_t created;
     time_t timeout;
     void *data;
     struct flb_sched_timer *timer; /* parent timer linked from */
-    struct mk_list _head;          /* link to flb_sched->[requests|wait] */
+    struct mk_list _head;          /* link to flb_sched->requests */
+};
+
+/* Hierarchical timing wheel */
+struct flb_sched_wheel {
+    uint64_t now;                                   /* current tick (ms)  */
+    uint64_t pending[FLB_SCHED_WHEEL_LEVELS];       /* non empty slots    */
+    struct mk_list slots[FLB_SCHED_WHEEL_LEVELS][FLB_SCHED_WHEEL_SLOTS];
+    struct mk_list expired;                         /* ready to run       */
 };
 
 /* Scheduler context */
@@ -88,20 +114,10 @@ struct flb_sched {
      * The scheduler is used to issue 'retries' of flush requests when these
      * cannot be processed and the output plugins ask for a retry.
      *
-     * If a retry have not reached a limit and is allowed, it needs to be
-     * queued:
-     *
-     *  - For retries that will happen within the next 60 seconds, they are
-     *    placed in the 'requests' list and a timeout is registered with
-     *    the operating system (timerfd).
-     *
-     *  - For retries that will happen 'after' 60 seconds, they are queued
-     *    into the requests_wait' list. They stay there until their
-     *    flush time happens within the next 60 seconds, so they are moved
-     *    to the sched_requests list and a further timeout is created.
+     * Every retry allowed is registered in the 'requests' list and its
+     * timer is placed in the timing wheel.
      */
     struct mk_list requests;
-    struct mk_list requests_wait;
 
     /* Timers: list of timers for different purposes */
     struct mk_list timers;
@@ -112,8 +128,14 @@ struct flb_sched {
      */
     struct mk_list timers_drop;
 
-    /* Frame timer context */
-    flb_pipefd_t frame_fd;
+    /*
+     * Timing wheel: callback timers and retry requests do not own an
+     * operating system timer, they are kept in the wheel and a single
+     * timer (the frame timer) is armed for the closest expiration.
+     */
+    struct flb_sched_wheel wheel;
+    struct flb_sched_timer *frame;
+    uint64_t frame_expires;        /* tick the frame timer is armed for */
 
     struct mk_event_loop *evl;
     struct flb_config *config;
@@ -0,0 +1,382 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_SIMD_H
+#define FLB_SIMD_H
+
+#include <fluent-bit/flb_info.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Small set of vector helpers used by the hot scanners (JSON packer, line
+ * splitters, key/value parsers). Only the instruction sets that are part of
+ * the base ABI of each architecture are used (SSE2 on x86_64 and NEON on
+ * aarch64), so no runtime CPU detection is needed. Any other target, or a
+ * build with FLB_SIMD=Off, uses a portable 64-bit SWAR implementation with
+ * the same interface.
+ */
+
+#ifdef FLB_HAVE_SIMD
+#if defined(__x86_64__) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FLB_SIMD_SSE2
+typedef __m128i flb_vector8;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FLB_SIMD_NEON
+typedef uint8x16_t flb_vector8;
+#else
+#define FLB_SIMD_NONE
+typedef uint64_t flb_vector8;
+#endif
+#else
+#define FLB_SIMD_NONE
+typedef uint64_t flb_vector8;
+#endif
+
+#define FLB_SIMD_VEC8_INST_LEN   (sizeof(flb_vector8))
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef FLB_SIMD_NONE
+#define FLB_SIMD_SWAR_ONES       UINT64_C(0x0101010101010101)
+#define FLB_SIMD_SWAR_HIGHS      UINT64_C(0x8080808080808080)
+#endif
+
+/* Number of trailing zero bits, 'x' must not be zero */
+static inline int flb_simd_ctz32(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+
+    _BitScanForward(&i, x);
+    return (int) i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+static inline int flb_simd_ctz64(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+
+    _BitScanForward64(&i, x);
+    return (int) i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+static inline void flb_vector8_load(flb_vector8 *v, const uint8_t *s)
+{
+#if defined(FLB_SIMD_SSE2)
+    *v = _mm_loadu_si128((const __m128i *) s);
+#elif defined(FLB_SIMD_NEON)
+    *v = vld1q_u8(s);
+#else
+    memcpy(v, s, sizeof(flb_vector8));
+#endif
+}
+
+static inline flb_vector8 flb_vector8_broadcast(const uint8_t c)
+{
+#if defined(FLB_SIMD_SSE2)
+    return _mm_set1_epi8((char) c);
+#elif defined(FLB_SIMD_NEON)
+    return vdupq_n_u8(c);
+#else
+    return FLB_SIMD_SWAR_ONES * c;
+#endif
+}
+
+static inline flb_vector8 flb_vector8_or(const flb_vector8 v1,
+                                         const flb_vector8 v2)
+{
+#if defined(FLB_SIMD_SSE2)
+    return _mm_or_si128(v1, v2);
+#elif defined(FLB_SIMD_NEON)
+    return vorrq_u8(v1, v2);
+#else
+    return v1 | v2;
+#endif
+}
+
+/*
+ * Compare each lane and return a vector with the high bit set on the lanes
+ * that are equal. The SWAR variant may flag extra lanes placed after a real
+ * match, callers only rely on it to know that 'some' lane matched.
+ */
+static inline flb_vector8 flb_vector8_eq(const flb_vector8 v1,
+                                         const flb_vector8 v2)
+{
+#if defined(FLB_SIMD_SSE2)
+    return _mm_cmpeq_epi8(v1, v2);
+#elif defined(FLB_SIMD_NEON)
+    return vceqq_u8(v1, v2);
+#else
+    uint64_t x = v1 ^ v2;
+
+    return (x - FLB_SIMD_SWAR_ONES) & ~x & FLB_SIMD_SWAR_HIGHS;
+#endif
+}
+
+/*
+ * Compare each lane as unsigned and return a vector with the high bit set on
+ * the lanes of 'v1' lower than or equal to the ones of 'v2'. The SWAR
+ * variant requires the lanes of 'v2' to be lower than 0x80 and, as
+ * flb_vector8_eq(), may flag extra lanes placed after a real match.
+ */
+static inline flb_vector8 flb_vector8_le(const flb_vector8 v1,
+                                         const flb_vector8 v2)
+{
+#if defined(FLB_SIMD_SSE2)
+    return _mm_cmpeq_epi8(_mm_min_epu8(v1, v2), v1);
+#elif defined(FLB_SIMD_NEON)
+    return vcleq_u8(v1, v2);
+#else
+    return (v1 - (v2 + FLB_SIMD_SWAR_ONES)) & ~v1 & FLB_SIMD_SWAR_HIGHS;
+#endif
+}
+
+/* Return non-zero if any lane of the vector has its high bit set */
+static inline int flb_vector8_is_highbit_set(const flb_vector8 v)
+{
+#if defined(FLB_SIMD_SSE2)
+    return _mm_movemask_epi8(v) != 0;
+#elif defined(FLB_SIMD_NEON)
+    return vmaxvq_u8(v) > 0x7F;
+#else
+    return (v & FLB_SIMD_SWAR_HIGHS) != 0;
+#endif
+}
+
+/* Return non-zero if any lane of the vector is equal to 'c' */
+static inline int flb_vector8_has(const flb_vector8 v, const uint8_t c)
+{
+    return flb_vector8_is_highbit_set(flb_vector8_eq(v,
+                                                     flb_vector8_broadcast(c)));
+}
+
+/*
+ * Return a pointer to the first byte in [p, p + len) equal to 'c1' or 'c2',
+ * or NULL if none of them is found. Same scan than flb_simd_find_any3().
+ */
+static inline const char *flb_simd_find_any2(const char *p, size_t len,
+                                             char c1, char c2)
+{
+    const char *end = p + len;
+    flb_vector8 chunk;
+    flb_vector8 v1;
+    flb_vector8 v2;
+    flb_vector8 m;
+
+    v1 = flb_vector8_broadcast((uint8_t) c1);
+    v2 = flb_vector8_broadcast((uint8_t) c2);
+
+    while ((size_t) (end - p) >= FLB_SIMD_VEC8_INST_LEN) {
+        flb_vector8_load(&chunk, (const uint8_t *) p);
+        m = flb_vector8_or(flb_vector8_eq(chunk, v1),
+                           flb_vector8_eq(chunk, v2));
+        if (flb_vector8_is_highbit_set(m)) {
+            break;
+        }
+        p += FLB_SIMD_VEC8_INST_LEN;
+    }
+
+    for (; p < end; p++) {
+        if (*p == c1 || *p == c2) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Return a pointer to the first byte in [p, p + len) equal to 'c1', 'c2' or
+ * 'c3', or NULL if none of them is found. Full vector blocks are checked at
+ * once and only the block holding a match is inspected byte by byte.
+ */
+static inline const char *flb_simd_find_any3(const char *p, size_t len,
+                                             char c1, char c2, char c3)
+{
+    const char *end = p + len;
+    flb_vector8 chunk;
+    flb_vector8 v1;
+    flb_vector8 v2;
+    flb_vector8 v3;
+    flb_vector8 m;
+
+    v1 = flb_vector8_broadcast((uint8_t) c1);
+    v2 = flb_vector8_broadcast((uint8_t) c2);
+    v3 = flb_vector8_broadcast((uint8_t) c3);
+
+    while ((size_t) (end - p) >= FLB_SIMD_VEC8_INST_LEN) {
+        flb_vector8_load(&chunk, (const uint8_t *) p);
+        m = flb_vector8_or(flb_vector8_eq(chunk, v1),
+                           flb_vector8_or(flb_vector8_eq(chunk, v2),
+                                          flb_vector8_eq(chunk, v3)));
+        if (flb_vector8_is_highbit_set(m)) {
+            break;
+        }
+        p += FLB_SIMD_VEC8_INST_LEN;
+    }
+
+    for (; p < end; p++) {
+        if (*p == c1 || *p == c2 || *p == c3) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Return a pointer to the first byte in [p, p + len) lower than or equal to
+ * 'le' (unsigned) or equal to 'c1' or 'c2', or NULL if there is none. It
+ * finds the end of the tokens of the key/value parsers, where 'le' covers
+ * the space and control bytes that delimit them; 'le' must be lower than
+ * 0x80. With vector support the offset of the match is taken from the bit
+ * mask of the block.
+ */
+static inline const char *flb_simd_find_delim(const char *p, size_t len,
+                                              uint8_t le, char c1, char c2)
+{
+    const char *end = p + len;
+    flb_vector8 chunk;
+    flb_vector8 vle;
+    flb_vector8 v1;
+    flb_vector8 v2;
+    flb_vector8 m;
+#if defined(FLB_SIMD_SSE2)
+    uint32_t mask;
+#elif defined(FLB_SIMD_NEON)
+    uint64_t mask;
+#endif
+
+    vle = flb_vector8_broadcast(le);
+    v1 = flb_vector8_broadcast((uint8_t) c1);
+    v2 = flb_vector8_broadcast((uint8_t) c2);
+
+    while ((size_t) (end - p) >= FLB_SIMD_VEC8_INST_LEN) {
+        flb_vector8_load(&chunk, (const uint8_t *) p);
+        m = flb_vector8_or(flb_vector8_le(chunk, vle),
+                           flb_vector8_or(flb_vector8_eq(chunk, v1),
+                                          flb_vector8_eq(chunk, v2)));
+#if defined(FLB_SIMD_SSE2)
+        mask = (uint32_t) _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return p + flb_simd_ctz32(mask);
+        }
+#elif defined(FLB_SIMD_NEON)
+        mask = vget_lane_u64(vreinterpret_u64_u8(
+                   vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        if (mask != 0) {
+            return p + (flb_simd_ctz64(mask) >> 2);
+        }
+#else
+        if (flb_vector8_is_highbit_set(m)) {
+            break;
+        }
+#endif
+        p += FLB_SIMD_VEC8_INST_LEN;
+    }
+
+    for (; p < end; p++) {
+        if ((uint8_t) *p <= le || *p == c1 || *p == c2) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Store in 'pos' the offsets of the bytes in [p, p + len) equal to 'c', up
+ * to 'max' of them. Returns the number of offsets stored; when it equals
+ * 'max' the caller must resume the scan after the last one. A full vector
+ * block is compared at once and the matches are taken from its bit mask.
+ */
+static inline size_t flb_simd_find_all(const char *p, size_t len, char c,
+                                       size_t *pos, size_t max)
+{
+    size_t i = 0;
+    size_t n = 0;
+    const char *m;
+#if defined(FLB_SIMD_SSE2)
+    uint32_t mask;
+    flb_vector8 chunk;
+    flb_vector8 v = flb_vector8_broadcast((uint8_t) c);
+
+    while (n < max && len - i >= FLB_SIMD_VEC8_INST_LEN) {
+        flb_vector8_load(&chunk, (const uint8_t *) p + i);
+        mask = (uint32_t) _mm_movemask_epi8(flb_vector8_eq(chunk, v));
+        while (mask != 0 && n < max) {
+            pos[n++] = i + flb_simd_ctz32(mask);
+            mask &= mask - 1;
+        }
+        if (mask != 0) {
+            return n;
+        }
+        i += FLB_SIMD_VEC8_INST_LEN;
+    }
+#elif defined(FLB_SIMD_NEON)
+    uint64_t mask;
+    flb_vector8 chunk;
+    flb_vector8 v = flb_vector8_broadcast((uint8_t) c);
+
+    while (n < max && len - i >= FLB_SIMD_VEC8_INST_LEN) {
+        flb_vector8_load(&chunk, (const uint8_t *) p + i);
+
+        /* narrow the compare result to 4 bits per lane */
+        mask = vget_lane_u64(vreinterpret_u64_u8(
+                   vshrn_n_u16(vreinterpretq_u16_u8(flb_vector8_eq(chunk, v)),
+                               4)), 0);
+        mask &= UINT64_C(0x8888888888888888);
+        while (mask != 0 && n < max) {
+            pos[n++] = i + (flb_simd_ctz64(mask) >> 2);
+            mask &= mask - 1;
+        }
+        if (mask != 0) {
+            return n;
+        }
+        i += FLB_SIMD_VEC8_INST_LEN;
+    }
+#endif
+
+    /* tail of the buffer, or the whole buffer without vector support */
+    while (n < max && i < len) {
+        m = memchr(p + i, c, len - i);
+        if (!m) {
+            break;
+        }
+        pos[n++] = m - p;
+        i = (m - p) + 1;
+    }
+
+    return n;
+}
+
+#endif
@@ -76,6 +76,7 @@ int flb_storage_create(struct flb_config *ctx);
 int flb_storage_input_create(struct cio_ctx *cio,
                              struct flb_input_instance *in);
 void flb_storage_destroy(struct flb_config *ctx);
+void flb_storage_sync_commit(struct flb_config *ctx, void *data);
 void flb_storage_input_destroy(struct flb_input_instance *in);
 
 struct flb_storage_metrics *flb_storage_metrics_create(struct flb_config *ctx);
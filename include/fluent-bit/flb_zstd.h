@@ -0,0 +1,64 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_ZSTD_H
+#define FLB_ZSTD_H
+
+#include <fluent-bit/flb_info.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define FLB_ZSTD_DEFAULT_LEVEL   3
+
+/*
+ * A dictionary primes the compressor with content that is common to the
+ * payloads (record keys, tags, metadata), which helps a lot when every
+ * payload is small. Both ends must load the same dictionary.
+ */
+struct flb_zstd_dict {
+    int level;
+    unsigned int id;      /* dictionary ID, 0 for raw content dictionaries */
+    void *cdict;          /* ZSTD_CDict */
+    void *ddict;          /* ZSTD_DDict */
+};
+
+int flb_zstd_compress(void *in_data, size_t in_len,
+                      void **out_data, size_t *out_len);
+int flb_zstd_uncompress(void *in_data, size_t in_len,
+                        void **out_data, size_t *out_len);
+
+struct flb_zstd_dict *flb_zstd_dict_create(void *buf, size_t size, int level);
+struct flb_zstd_dict *flb_zstd_dict_load(const char *path, int level);
+void flb_zstd_dict_destroy(struct flb_zstd_dict *dict);
+
+int flb_zstd_compress_dict(struct flb_zstd_dict *dict,
+                           void *in_data, size_t in_len,
+                           void **out_data, size_t *out_len);
+int flb_zstd_uncompress_dict(struct flb_zstd_dict *dict,
+                             void *in_data, size_t in_len,
+                             void **out_data, size_t *out_len);
+
+ssize_t flb_zstd_compress_buffer(struct flb_zstd_dict *dict,
+                                 const void *in_data, size_t in_len,
+                                 void *out_data, size_t out_size);
+ssize_t flb_zstd_uncompress_buffer(struct flb_zstd_dict *dict,
+                                   const void *in_data, size_t in_len,
+                                   void *out_data, size_t out_size);
+
+#endif
@@ -37,6 +37,7 @@ struct flb_ml_parser *flb_ml_parser_create(struct flb_config *ctx,
                                            struct flb_parser *parser_ctx,
                                            char *parser_name);
 int flb_ml_parser_destroy(struct flb_ml_parser *ml_parser);
+struct flb_ml_parser *flb_ml_parser_get(struct flb_config *ctx, char *name);
 void flb_ml_parser_destroy_all(struct mk_list *list);
 
 
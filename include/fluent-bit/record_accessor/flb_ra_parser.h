@@ -46,9 +46,26 @@ struct flb_ra_array {
     struct mk_list *subkeys;
 };
 
+/*
+ * Compiled subkey: the list of subkeys is flattened into an array when the
+ * pattern is parsed, so lookups do not walk the linked list nor compute
+ * lengths for every record.
+ */
+struct flb_ra_step {
+    int type;    /* FLB_RA_PARSER_STRING | FLB_RA_PARSER_ARRAY_ID */
+    int array_id;
+    int len;
+    char *str;   /* reference to the subentry string */
+};
+
 struct flb_ra_key {
     flb_sds_t name;
     struct mk_list *subkeys;
+
+    /* compiled subkeys */
+    int steps_size;
+    int steps_has_str;   /* FLB_TRUE if any subkey is a map key */
+    struct flb_ra_step *steps;
 };
 
 struct flb_ra_parser {
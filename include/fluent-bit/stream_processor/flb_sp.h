@@ -26,7 +26,6 @@
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_input.h>
 #include <monkey/mk_core.h>
-#include <rbtree.h>
 
 /* Aggregate num type */
 #define FLB_SP_NUM_I64       0
@@ -81,11 +80,21 @@ struct aggregate_node {
     /* Aggregate data */
     struct aggregate_data **aggregate_data;
 
+    /* Hash of the GROUP BY values, see flb_sp_groupby_hash() */
+    uint64_t hash;
+
     /* To keep track of the aggregation nodes */
-    struct rb_tree_node _rb_head;
+    struct mk_list _hash_head;
     struct mk_list _head;
 };
 
+/* Hash index of the aggregation nodes by their GROUP BY values */
+struct flb_sp_groupby_index {
+    int size;                  /* number of buckets, power of two */
+    int count;                 /* number of indexed nodes         */
+    struct mk_list *table;     /* buckets of aggregate_node->_hash_head */
+};
+
 struct flb_sp_window_data {
     char *buf_data;
     size_t buf_size;
@@ -93,7 +102,7 @@ struct flb_sp_window_data {
 };
 
 struct flb_sp_hopping_slot {
-    struct rb_tree aggregate_tree;
+    struct flb_sp_groupby_index aggregate_index;
     struct mk_list aggregate_list;
     int records;
     struct mk_list _head;
@@ -106,9 +115,12 @@ struct flb_sp_task_window {
     struct mk_event event;
     struct mk_event event_hop;
 
-    struct rb_tree aggregate_tree;
+    struct flb_sp_groupby_index aggregate_index;
     struct mk_list aggregate_list;
 
+    /* GROUP BY values of the record being processed */
+    struct aggregate_num *groupby_nums;
+
     /* Hopping window parameters */
     /*
      * first hopping window. Timer event is set to window size for the first,
@@ -119,6 +131,12 @@ struct flb_sp_task_window {
     int advance_by;
     struct mk_list hopping_slot;
 
+    /*
+     * Slot aggregating the records of the current hop, it's appended to
+     * the 'hopping_slot' list on every hop event.
+     */
+    struct flb_sp_hopping_slot *current_slot;
+
     int records;
 
     struct mk_list data;
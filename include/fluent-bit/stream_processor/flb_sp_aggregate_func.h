@@ -24,10 +24,10 @@
 typedef void (*aggregate_function_destroy)(struct aggregate_node *,
                                            int);
 
-typedef int (*aggregate_function_clone)(struct aggregate_node *,
-                                        struct aggregate_node *,
-                                        struct flb_sp_cmd_key *,
-                                        int);
+typedef int (*aggregate_function_slot_init)(struct aggregate_node *,
+                                            struct aggregate_node *,
+                                            struct flb_sp_cmd_key *,
+                                            int);
 
 typedef void (*aggregate_function_add)(struct aggregate_node *,
                                        struct flb_sp_cmd_key *,
@@ -46,7 +46,7 @@ typedef void (*aggregate_function_remove)(struct aggregate_node *,
 
 extern char aggregate_func_string[AGGREGATE_FUNCTIONS][sizeof("TIMESERIES_FORECAST") + 1];
 
-extern aggregate_function_clone aggregate_func_clone[AGGREGATE_FUNCTIONS];
+extern aggregate_function_slot_init aggregate_func_slot_init[AGGREGATE_FUNCTIONS];
 extern aggregate_function_add aggregate_func_add[AGGREGATE_FUNCTIONS];
 extern aggregate_function_calc aggregate_func_calc[AGGREGATE_FUNCTIONS];
 extern aggregate_function_remove aggregate_func_remove[AGGREGATE_FUNCTIONS];
@@ -23,6 +23,17 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
 
-int flb_sp_groupby_compare(const void *lhs, const void *rhs);
+uint64_t flb_sp_groupby_hash(struct aggregate_num *nums, int size);
+
+void flb_sp_groupby_index_init(struct flb_sp_groupby_index *index);
+void flb_sp_groupby_index_clear(struct flb_sp_groupby_index *index);
+void flb_sp_groupby_index_destroy(struct flb_sp_groupby_index *index);
+struct aggregate_node *flb_sp_groupby_index_get(struct flb_sp_groupby_index *index,
+                                                struct aggregate_num *nums,
+                                                int size, uint64_t hash);
+int flb_sp_groupby_index_add(struct flb_sp_groupby_index *index,
+                             struct aggregate_node *aggr_node);
+void flb_sp_groupby_index_del(struct flb_sp_groupby_index *index,
+                              struct aggregate_node *aggr_node);
 
 #endif
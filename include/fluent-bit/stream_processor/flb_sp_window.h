@@ -26,6 +26,9 @@
 #define FLB_SP_WINDOW_TUMBLING  1
 #define FLB_SP_WINDOW_HOPPING   2
 
+struct flb_sp_hopping_slot *flb_sp_hopping_slot_create();
+void flb_sp_hopping_slot_destroy(struct flb_sp_cmd *cmd,
+                                 struct flb_sp_hopping_slot *hs);
 void flb_sp_window_prune(struct flb_sp_task *task);
 int flb_sp_window_populate(struct flb_sp_task *task, const char *buf_data,
                            size_t buf_size);
@@ -75,6 +75,8 @@ struct flb_tls_backend {
     /* Session management */
     void *(*session_create) (struct flb_tls *, int);
     int (*session_destroy) (void *);
+    int (*session_alpn_set) (void *, const char *);
+    int (*session_alpn_get) (void *, char *, size_t);
 
     /* I/O */
     int (*net_read) (struct flb_tls_session *, void *, size_t);
@@ -116,6 +118,9 @@ int flb_tls_session_create(struct flb_tls *tls,
                            struct flb_connection *connection,
                            struct flb_coro *co);
 
+int flb_tls_session_alpn_get(struct flb_tls_session *session,
+                             char *buf, size_t size);
+
 int flb_tls_net_read(struct flb_tls_session *session, 
                      void *buf, 
                      size_t len);
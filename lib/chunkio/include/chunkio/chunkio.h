@@ -43,6 +43,7 @@
 #define CIO_OPEN_RD         2         /* open and read/mmap content if exists */
 #define CIO_CHECKSUM        4         /* enable checksum verification (crc32) */
 #define CIO_FULL_SYNC       8         /* force sync to fs through MAP_SYNC */
+#define CIO_GROUP_COMMIT   16         /* defer full syncs, see cio_sync_commit() */
 
 /* Return status */
 #define CIO_CORRUPTED      -3         /* Indicate that a chunk is corrupted */
@@ -54,8 +55,27 @@
 /* defaults */
 #define CIO_MAX_CHUNKS_UP  64   /* default limit for cio_ctx->max_chunks_up */
 
+/* limits for the file growth step (options.realloc_size_hint) */
+#define CIO_REALLOC_HINT_MIN   (cio_getpagesize() * 8)
+#define CIO_REALLOC_HINT_MAX   (8 * 1024 * 1024)
+
 struct cio_ctx;
 
+/*
+ * Compression of the file chunks content while they are 'down'. Both
+ * callbacks work on caller provided buffers: 'compress' returns the number
+ * of bytes written to 'dst', or 0 if the content does not fit in
+ * 'dst_size' bytes; 'uncompress' returns 0 when exactly 'dst_size' bytes
+ * were restored. 'type' identifies the algorithm and it's stored in the
+ * file header.
+ */
+typedef size_t (*cio_compress_cb)(void *data, int type,
+                                  const void *src, size_t src_size,
+                                  void *dst, size_t dst_size);
+typedef int (*cio_uncompress_cb)(void *data, int type,
+                                 const void *src, size_t src_size,
+                                 void *dst, size_t dst_size);
+
 struct cio_options {
     int flags;
     char *root_path;
@@ -67,6 +87,19 @@ struct cio_options {
     char *user;
     char *group;
     char *chmod;
+
+    /* bytes reserved every time a file chunk needs to grow (0: default) */
+    size_t realloc_size_hint;
+
+    /*
+     * Compression of locked chunks when they are set down, 'compress_type'
+     * zero disables it. 'uncompress' should be set whenever compressed
+     * files can be found in the root path.
+     */
+    int compress_type;
+    cio_compress_cb compress;
+    cio_uncompress_cb uncompress;
+    void *compress_data;
 };
 
 struct cio_ctx {
@@ -90,6 +123,16 @@ struct cio_ctx {
      */
     size_t max_chunks_up;
 
+    /* bytes reserved every time a file chunk needs to grow */
+    size_t realloc_size_hint;
+
+    /*
+     * Group commit: with CIO_FULL_SYNC | CIO_GROUP_COMMIT the file chunks
+     * synced are queued here and flushed to disk together by
+     * cio_sync_commit().
+     */
+    struct mk_list sync_queue;
+
     /* streams */
     struct mk_list streams;
 };
@@ -106,6 +149,7 @@ int cio_qsort(struct cio_ctx *ctx, int (*compar)(const void *, const void *));
 void cio_set_log_callback(struct cio_ctx *ctx, void (*log_cb));
 int cio_set_log_level(struct cio_ctx *ctx, int level);
 int cio_set_max_chunks_up(struct cio_ctx *ctx, int n);
+int cio_sync_commit(struct cio_ctx *ctx);
 
 int cio_meta_write(struct cio_chunk *ch, char *buf, size_t size);
 int cio_meta_cmp(struct cio_chunk *ch, char *meta_buf, int meta_len);
@@ -47,6 +47,16 @@ struct cio_file {
     char *st_content;
     crc_t crc_cur;            /* crc: current value calculated */
     int crc_reset;            /* crc: must recalculate from the beginning ? */
+
+    /* compression */
+    int compressed;           /* content compressed on disk ? */
+    size_t raw_size;          /* uncompressed file size */
+    int inflated;             /* map is an uncompressed copy in memory */
+
+    /* group commit */
+    int sync_queued;          /* waiting in cio_ctx->sync_queue ? */
+    struct cio_chunk *chunk;  /* parent chunk */
+    struct mk_list _sync_head;
 };
 
 size_t cio_file_real_size(struct cio_file *cf);
@@ -60,6 +70,7 @@ void cio_file_close(struct cio_chunk *ch, int delete);
 int cio_file_write(struct cio_chunk *ch, const void *buf, size_t count);
 int cio_file_write_metadata(struct cio_chunk *ch, char *buf, size_t size);
 int cio_file_sync(struct cio_chunk *ch);
+int cio_file_sync_commit(struct cio_ctx *ctx);
 int cio_file_resize(struct cio_file *cf, size_t new_size);
 char *cio_file_hash(struct cio_file *cf);
 void cio_file_hash_print(struct cio_file *cf);
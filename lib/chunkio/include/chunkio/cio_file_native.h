@@ -49,7 +49,10 @@ int cio_file_native_filename_check(char *name);
 int cio_file_native_open(struct cio_file *cf);
 int cio_file_native_close(struct cio_file *cf);
 int cio_file_native_delete(struct cio_file *cf);
+int cio_file_native_replace(struct cio_file *cf, char *tmp_path,
+                            const char *buf, size_t size, int sync_mode);
 int cio_file_native_sync(struct cio_file *cf, int sync_mode);
+int cio_file_native_sync_start(struct cio_file *cf);
 int cio_file_native_resize(struct cio_file *cf, size_t new_size);
 
 #endif
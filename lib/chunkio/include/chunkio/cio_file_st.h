@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 #include <inttypes.h>
+#include <string.h>
 
 /*
  * ChunkIO data file layout as of 2018/10/26
@@ -53,12 +54,21 @@
  *    |  |                         |  |
  *    |  +-------------------------+  |
  *    +-------------------------------+
+ *
+ * Compressed files (chunks set down with compression enabled) use 0x01 as
+ * the second byte, the CRC32 still refers to the uncompressed content and
+ * the padding holds the algorithm (1 byte) plus the size of the
+ * uncompressed user data (8 bytes, big endian). Metadata is not
+ * compressed, only the user data is.
  */
 
 #define CIO_FILE_ID_00          0xc1    /* header: first byte */
 #define CIO_FILE_ID_01          0x00    /* header: second byte */
+#define CIO_FILE_ID_01_Z        0x01    /* header: second byte, compressed */
 #define CIO_FILE_HEADER_MIN       24    /* 24 bytes for the header */
 #define CIO_FILE_CONTENT_OFFSET   22
+#define CIO_FILE_Z_TYPE_OFFSET     6    /* compressed: algorithm */
+#define CIO_FILE_Z_SIZE_OFFSET     7    /* compressed: user data size */
 
 /* Return pointer to hash position */
 static inline char *cio_file_st_get_hash(char *map)
@@ -112,4 +122,51 @@ static inline ssize_t cio_file_st_get_content_size(char *map, size_t size)
     return -1;
 }
 
+/* Check if the file content is compressed */
+static inline int cio_file_st_is_compressed(char *map)
+{
+    return ((uint8_t) map[0] == CIO_FILE_ID_00 &&
+            (uint8_t) map[1] == CIO_FILE_ID_01_Z);
+}
+
+/* Return the compression algorithm of a compressed file */
+static inline int cio_file_st_get_z_type(char *map)
+{
+    return (uint8_t) map[CIO_FILE_Z_TYPE_OFFSET];
+}
+
+/* Return the uncompressed user data size of a compressed file */
+static inline uint64_t cio_file_st_get_z_size(char *map)
+{
+    int i;
+    uint64_t size = 0;
+
+    for (i = 0; i < 8; i++) {
+        size = (size << 8) | (uint8_t) map[CIO_FILE_Z_SIZE_OFFSET + i];
+    }
+
+    return size;
+}
+
+/* Mark the file as compressed (type > 0) or uncompressed (type == 0) */
+static inline void cio_file_st_set_z(char *map, int type, uint64_t size)
+{
+    int i;
+
+    memset(map + CIO_FILE_Z_TYPE_OFFSET, 0,
+           CIO_FILE_CONTENT_OFFSET - CIO_FILE_Z_TYPE_OFFSET);
+
+    if (type == 0) {
+        map[1] = CIO_FILE_ID_01;
+        return;
+    }
+
+    map[1] = CIO_FILE_ID_01_Z;
+    map[CIO_FILE_Z_TYPE_OFFSET] = (char) type;
+    for (i = 7; i >= 0; i--) {
+        map[CIO_FILE_Z_SIZE_OFFSET + i] = (char) (size & 0xFF);
+        size >>= 8;
+    }
+}
+
 #endif
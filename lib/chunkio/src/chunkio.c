@@ -104,10 +104,28 @@ struct cio_ctx *cio_create(struct cio_options *options)
         return NULL;
     }
     mk_list_init(&ctx->streams);
+    mk_list_init(&ctx->sync_queue);
     ctx->page_size = cio_getpagesize();
     ctx->max_chunks_up = CIO_MAX_CHUNKS_UP;
     ctx->options.flags = options->flags;
 
+    /* File growth step, page aligned */
+    ctx->realloc_size_hint = options->realloc_size_hint;
+    if (ctx->realloc_size_hint < CIO_REALLOC_HINT_MIN) {
+        ctx->realloc_size_hint = CIO_REALLOC_HINT_MIN;
+    }
+    else if (ctx->realloc_size_hint > CIO_REALLOC_HINT_MAX) {
+        ctx->realloc_size_hint = CIO_REALLOC_HINT_MAX;
+    }
+    ctx->realloc_size_hint = ((ctx->realloc_size_hint + ctx->page_size - 1) /
+                              ctx->page_size) * ctx->page_size;
+
+    /* Compression of the chunks set down */
+    ctx->options.compress_type = options->compress_type;
+    ctx->options.compress = options->compress;
+    ctx->options.uncompress = options->uncompress;
+    ctx->options.compress_data = options->compress_data;
+
     if (options->user != NULL) {
         ctx->options.user = strdup(options->user);
     }
@@ -252,6 +270,8 @@ void cio_destroy(struct cio_ctx *ctx)
         return;
     }
 
+    /* flush the deferred syncs before closing the chunks */
+    cio_sync_commit(ctx);
     cio_stream_destroy_all(ctx);
 
     if (ctx->options.user != NULL) {
@@ -305,3 +325,18 @@ int cio_set_max_chunks_up(struct cio_ctx *ctx, int n)
     ctx->max_chunks_up = n;
     return 0;
 }
+
+/*
+ * Flush to disk the file chunks whose sync was deferred by the group commit
+ * mode. It's meant to be called periodically by the caller, the period is
+ * the maximum time a synced chunk can stay in the page cache only. Returns
+ * the number of committed chunks or -1 if any of them failed.
+ */
+int cio_sync_commit(struct cio_ctx *ctx)
+{
+    if (mk_list_is_empty(&ctx->sync_queue) == 0) {
+        return 0;
+    }
+
+    return cio_file_sync_commit(ctx);
+}
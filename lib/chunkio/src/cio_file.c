@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include <chunkio/chunkio.h>
 #include <chunkio/chunkio_compat.h>
@@ -59,6 +60,9 @@ char cio_file_init_bytes[] =   {
 
 #define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
 
+/* contents smaller than this are not worth compressing */
+#define CIO_FILE_COMPRESS_MIN   4096
+
 /* Get the number of bytes in the Content section */
 static size_t content_len(struct cio_file *cf)
 {
@@ -240,6 +244,375 @@ static int cio_file_format_check(struct cio_chunk *ch,
     return 0;
 }
 
+static int file_sync(struct cio_chunk *ch, int defer);
+static int mmap_file(struct cio_ctx *ctx, struct cio_chunk *ch, size_t size);
+
+/* Group commit enabled ? */
+static inline int is_group_commit(struct cio_ctx *ctx)
+{
+    return ((ctx->options.flags & CIO_FULL_SYNC) &&
+            (ctx->options.flags & CIO_GROUP_COMMIT));
+}
+
+static inline void sync_queue_add(struct cio_ctx *ctx, struct cio_file *cf)
+{
+    if (cf->sync_queued == CIO_FALSE) {
+        mk_list_add(&cf->_sync_head, &ctx->sync_queue);
+        cf->sync_queued = CIO_TRUE;
+    }
+}
+
+static inline void sync_queue_del(struct cio_file *cf)
+{
+    if (cf->sync_queued == CIO_TRUE) {
+        mk_list_del(&cf->_sync_head);
+        cf->sync_queued = CIO_FALSE;
+    }
+}
+
+/* Load the whole content of a file chunk which is not open */
+static char *file_load(struct cio_file *cf, size_t *size)
+{
+    long len;
+    char *buf;
+    FILE *fp;
+
+    fp = fopen(cf->path, "rb");
+    if (!fp) {
+        cio_errno();
+        return NULL;
+    }
+
+    if (fseek(fp, 0, SEEK_END) == -1 || (len = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET) == -1) {
+        cio_errno();
+        fclose(fp);
+        return NULL;
+    }
+
+    if (len < CIO_FILE_HEADER_MIN) {
+        fclose(fp);
+        return NULL;
+    }
+
+    buf = malloc(len);
+    if (!buf) {
+        cio_errno();
+        fclose(fp);
+        return NULL;
+    }
+
+    if (fread(buf, len, 1, fp) != 1) {
+        cio_errno();
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+
+    *size = len;
+    return buf;
+}
+
+/*
+ * Replace the content of a file chunk which is down. The new content goes
+ * to a hidden temporary file (skipped by the scanner) renamed over the
+ * chunk, so a crash leaves either the old or the new version.
+ */
+static int file_store(struct cio_chunk *ch, char *buf, size_t size)
+{
+    int ret;
+    size_t len;
+    char *tmp_name;
+    char *tmp_path;
+    struct cio_ctx *ctx = ch->ctx;
+    struct cio_file *cf = ch->backend;
+
+    len = strlen(ch->name) + 6;
+    tmp_name = malloc(len);
+    if (!tmp_name) {
+        cio_errno();
+        return CIO_ERROR;
+    }
+    snprintf(tmp_name, len, ".%s.tmp", ch->name);
+
+    tmp_path = cio_file_native_compose_path(ctx->options.root_path,
+                                            ch->st->name, tmp_name);
+    free(tmp_name);
+    if (!tmp_path) {
+        return CIO_ERROR;
+    }
+
+    ret = cio_file_native_replace(cf, tmp_path, buf, size,
+                                  ctx->options.flags);
+    free(tmp_path);
+    if (ret != CIO_OK) {
+        cio_log_error(ctx, "[cio file] cannot rewrite chunk %s/%s",
+                      ch->st->name, ch->name);
+        return ret;
+    }
+
+    return cio_file_native_apply_acl_and_settings(ctx, cf);
+}
+
+/* Is the content of this chunk compressed when it's set down ? */
+static inline int is_compressible(struct cio_chunk *ch, struct cio_file *cf)
+{
+    return (ch->ctx->options.compress_type > 0 &&
+            ch->ctx->options.compress != NULL &&
+            ch->lock == CIO_TRUE &&
+            (cf->flags & CIO_OPEN_RW));
+}
+
+/*
+ * Compress the user data of a locked chunk which has just been set down.
+ * The file is only replaced if the content shrinks by 1/8 at least.
+ */
+static int file_deflate(struct cio_chunk *ch)
+{
+    int ret;
+    int meta_len;
+    char *buf;
+    char *out;
+    size_t size;
+    size_t hdr_len;
+    size_t data_len;
+    size_t z_len;
+    struct cio_ctx *ctx = ch->ctx;
+    struct cio_file *cf = ch->backend;
+
+    buf = file_load(cf, &size);
+    if (!buf) {
+        return -1;
+    }
+
+    if ((uint8_t) buf[0] != CIO_FILE_ID_00 ||
+        (uint8_t) buf[1] != CIO_FILE_ID_01) {
+        free(buf);
+        return -1;
+    }
+
+    meta_len = cio_file_st_get_meta_len(buf);
+    hdr_len = CIO_FILE_HEADER_MIN + meta_len;
+    if (hdr_len > size || size - hdr_len < CIO_FILE_COMPRESS_MIN) {
+        free(buf);
+        return 0;
+    }
+    data_len = size - hdr_len;
+
+    out = malloc(size);
+    if (!out) {
+        cio_errno();
+        free(buf);
+        return -1;
+    }
+    memcpy(out, buf, hdr_len);
+
+    z_len = ctx->options.compress(ctx->options.compress_data,
+                                  ctx->options.compress_type,
+                                  buf + hdr_len, data_len,
+                                  out + hdr_len, data_len - (data_len >> 3));
+    free(buf);
+
+    if (z_len == 0) {
+        free(out);
+        return 0;
+    }
+
+    cio_file_st_set_z(out, ctx->options.compress_type, data_len);
+    ret = file_store(ch, out, hdr_len + z_len);
+    free(out);
+
+    if (ret != CIO_OK) {
+        return -1;
+    }
+
+    cf->compressed = CIO_TRUE;
+    cf->raw_size = size;
+    cf->fs_size = hdr_len + z_len;
+
+    cio_log_debug(ctx, "[cio file] %s/%s compressed %zu -> %zu bytes",
+                  ch->st->name, ch->name, size, cf->fs_size);
+
+    return 0;
+}
+
+/*
+ * Bring up a compressed chunk: the content is uncompressed in memory and the
+ * file is left untouched, a chunk that is only read has nothing to write
+ * back. Returns 0 once it's up, or if the file turned out not to be
+ * compressed (the caller opens it as usual).
+ */
+static int file_inflate(struct cio_chunk *ch)
+{
+    int ret;
+    int meta_len;
+    char *buf;
+    char *out;
+    size_t size;
+    size_t hdr_len;
+    uint64_t data_len;
+    struct cio_ctx *ctx = ch->ctx;
+    struct cio_file *cf = ch->backend;
+
+    buf = file_load(cf, &size);
+    if (!buf) {
+        return -1;
+    }
+
+    if (!cio_file_st_is_compressed(buf)) {
+        free(buf);
+        cf->compressed = CIO_FALSE;
+        cf->raw_size = 0;
+        return 0;
+    }
+
+    if (!ctx->options.uncompress) {
+        cio_log_error(ctx, "[cio file] cannot uncompress chunk %s/%s, "
+                      "no decompressor", ch->st->name, ch->name);
+        free(buf);
+        return -1;
+    }
+
+    meta_len = cio_file_st_get_meta_len(buf);
+    hdr_len = CIO_FILE_HEADER_MIN + meta_len;
+    data_len = cio_file_st_get_z_size(buf);
+    if (hdr_len > size || data_len == 0 || data_len > SIZE_MAX - hdr_len) {
+        cio_log_error(ctx, "[cio file] invalid compressed chunk %s/%s",
+                      ch->st->name, ch->name);
+        free(buf);
+        return -1;
+    }
+
+    out = malloc(hdr_len + data_len);
+    if (!out) {
+        cio_errno();
+        free(buf);
+        return -1;
+    }
+    memcpy(out, buf, hdr_len);
+    cio_file_st_set_z(out, 0, 0);
+
+    ret = ctx->options.uncompress(ctx->options.compress_data,
+                                  cio_file_st_get_z_type(buf),
+                                  buf + hdr_len, size - hdr_len,
+                                  out + hdr_len, data_len);
+    free(buf);
+
+    if (ret != 0) {
+        cio_log_error(ctx, "[cio file] cannot uncompress chunk %s/%s",
+                      ch->st->name, ch->name);
+        free(out);
+        return -1;
+    }
+
+    cf->map = out;
+    cf->inflated = CIO_TRUE;
+    cf->alloc_size = hdr_len + data_len;
+    cf->data_size = data_len;
+    cf->fs_size = size;
+    cf->synced = CIO_TRUE;
+
+    ret = cio_file_format_check(ch, cf, cf->flags);
+    if (ret != 0) {
+        cio_log_error(ctx, "format check failed: %s/%s",
+                      ch->st->name, ch->name);
+        free(out);
+        cf->map = NULL;
+        cf->inflated = CIO_FALSE;
+        cf->alloc_size = 0;
+        cf->data_size = 0;
+        return -1;
+    }
+
+    cf->st_content = cio_file_st_get_content(cf->map);
+    cio_chunk_counter_total_up_add(ctx);
+
+    cio_log_debug(ctx, "[cio file] %s/%s uncompressed in memory",
+                  ch->st->name, ch->name);
+
+    return 0;
+}
+
+/*
+ * A chunk served from memory is about to be written: store its uncompressed
+ * content and map the file as usual.
+ */
+static int file_expand(struct cio_chunk *ch)
+{
+    int ret;
+    char *buf;
+    size_t data_size;
+    struct cio_ctx *ctx = ch->ctx;
+    struct cio_file *cf = ch->backend;
+
+    if ((cf->flags & CIO_OPEN_RW) == 0) {
+        cio_error_set(ch, CIO_ERR_PERMISSION);
+        return -1;
+    }
+
+    /* cio_chunk_write_at() might have moved the end of the content */
+    data_size = cf->data_size;
+
+    /* the buffer is not a file mapping, keep file_store() away from it */
+    buf = cf->map;
+    cf->map = NULL;
+
+    ret = file_store(ch, buf, cf->alloc_size);
+    if (ret != CIO_OK) {
+        cf->map = buf;
+        return -1;
+    }
+    free(buf);
+
+    cf->inflated = CIO_FALSE;
+    cf->compressed = CIO_FALSE;
+    cf->raw_size = 0;
+    cf->alloc_size = 0;
+    cf->data_size = 0;
+    cio_chunk_counter_total_up_sub(ctx);
+
+    ret = cio_file_native_open(cf);
+    if (ret != CIO_OK) {
+        cio_log_error(ctx, "[cio file] cannot open chunk: %s/%s",
+                      ch->st->name, ch->name);
+        return -1;
+    }
+
+    ret = cio_file_update_size(cf);
+    if (ret == CIO_OK) {
+        ret = mmap_file(ctx, ch, cf->fs_size);
+    }
+    if (ret != CIO_OK) {
+        cio_file_native_close(cf);
+        return -1;
+    }
+    cf->data_size = data_size;
+
+    return 0;
+}
+
+/* Detect a compressed chunk left by a previous run */
+static void file_check_compressed(struct cio_file *cf)
+{
+    char header[CIO_FILE_HEADER_MIN];
+    FILE *fp;
+
+    fp = fopen(cf->path, "rb");
+    if (!fp) {
+        return;
+    }
+
+    if (fread(header, sizeof(header), 1, fp) == 1 &&
+        cio_file_st_is_compressed(header)) {
+        cf->compressed = CIO_TRUE;
+        cf->raw_size = CIO_FILE_HEADER_MIN +
+                       cio_file_st_get_meta_len(header) +
+                       cio_file_st_get_z_size(header);
+    }
+    fclose(fp);
+}
+
 /*
  * Unmap the memory for the opened file in question. It make sure
  * to sync changes to disk first.
@@ -260,9 +633,29 @@ static int munmap_file(struct cio_ctx *ctx, struct cio_chunk *ch)
         return -1;
     }
 
+    /* Uncompressed in memory, the file did not change */
+    if (cf->inflated == CIO_TRUE) {
+        free(cf->map);
+        cf->map = NULL;
+        cf->inflated = CIO_FALSE;
+        cf->data_size = 0;
+        cf->alloc_size = 0;
+        cio_chunk_counter_total_up_sub(ctx);
+        return 0;
+    }
+
+    /*
+     * A deferred sync (group commit) must reach the disk before the file is
+     * closed, do it now.
+     */
+    if (cf->sync_queued == CIO_TRUE) {
+        sync_queue_del(cf);
+        cf->synced = CIO_FALSE;
+    }
+
     /* Sync pending changes to disk */
     if (cf->synced == CIO_FALSE) {
-        ret = cio_file_sync(ch);
+        ret = file_sync(ch, CIO_FALSE);
         if (ret == -1) {
             cio_log_error(ch->ctx,
                           "[cio file] error syncing file at "
@@ -589,7 +982,8 @@ struct cio_file *cio_file_open(struct cio_ctx *ctx,
 
     cf->fd = -1;
     cf->flags = flags;
-    cf->realloc_size = cio_getpagesize() * 8;
+    cf->realloc_size = ctx->realloc_size_hint;
+    cf->chunk = ch;
     cf->st_content = NULL;
     cf->crc_cur = cio_crc32_init();
     cf->path = path;
@@ -605,6 +999,10 @@ struct cio_file *cio_file_open(struct cio_ctx *ctx,
     cf->allocate_strategy = CIO_FILE_LINUX_FALLOCATE;
 #endif
 
+    if (ctx->options.uncompress) {
+        file_check_compressed(cf);
+    }
+
     /* Should we open and put this file up ? */
     ret = open_and_up(ctx);
 
@@ -621,6 +1019,24 @@ struct cio_file *cio_file_open(struct cio_ctx *ctx,
         return cf;
     }
 
+    /* A compressed chunk is served from memory */
+    if (cf->compressed) {
+        if (file_inflate(ch) != 0) {
+            free(path);
+            free(cf);
+
+            *err = CIO_CORRUPTED;
+
+            return NULL;
+        }
+
+        if (cf->inflated) {
+            *err = CIO_OK;
+
+            return cf;
+        }
+    }
+
     /* Open the file */
     ret = cio_file_native_open(cf);
 
@@ -720,6 +1136,17 @@ static int _cio_file_up(struct cio_chunk *ch, int enforced)
         }
     }
 
+    /* A compressed chunk is served from memory */
+    if (cf->compressed) {
+        if (file_inflate(ch) != 0) {
+            return CIO_CORRUPTED;
+        }
+
+        if (cf->inflated) {
+            return CIO_OK;
+        }
+    }
+
     /* Open file */
     ret = cio_file_native_open(cf);
 
@@ -825,6 +1252,11 @@ int cio_file_down(struct cio_chunk *ch)
     /* Close file descriptor */
     cio_file_native_close(cf);
 
+    /* Compress the content of the chunks that will not be written anymore */
+    if (!cf->compressed && is_compressible(ch, cf)) {
+        file_deflate(ch);
+    }
+
     return 0;
 }
 
@@ -839,6 +1271,15 @@ void cio_file_close(struct cio_chunk *ch, int delete)
         return;
     }
 
+    /*
+     * In group commit mode the content of a file about to be deleted is not
+     * worth a trip to the disk.
+     */
+    if (delete == CIO_TRUE && is_group_commit(ch->ctx)) {
+        sync_queue_del(cf);
+        cf->synced = CIO_TRUE;
+    }
+
     /* Safe unmap of the file content */
     munmap_file(ch->ctx, ch);
 
@@ -868,6 +1309,7 @@ int cio_file_write(struct cio_chunk *ch, const void *buf, size_t count)
     size_t av_size;
     size_t old_size;
     size_t new_size;
+    size_t step;
     struct cio_file *cf;
 
     if (count == 0) {
@@ -887,6 +1329,10 @@ int cio_file_write(struct cio_chunk *ch, const void *buf, size_t count)
         return -1;
     }
 
+    if (cf->inflated && file_expand(ch) != 0) {
+        return -1;
+    }
+
     /* get available size */
     av_size = get_available_size(cf, &meta_len);
 
@@ -895,9 +1341,22 @@ int cio_file_write(struct cio_chunk *ch, const void *buf, size_t count)
         /* Set the pre-content size (chunk header + metadata) */
         pre_content = (CIO_FILE_HEADER_MIN + meta_len);
 
-        new_size = cf->alloc_size + cf->realloc_size;
+        /*
+         * Grow by the configured step or by half of the current size,
+         * whatever is bigger, so a chunk that keeps receiving data needs a
+         * logarithmic number of fallocate() and remap calls.
+         */
+        step = cf->realloc_size;
+        if (cf->alloc_size / 2 > step) {
+            step = cf->alloc_size / 2;
+        }
+        if (step > CIO_REALLOC_HINT_MAX) {
+            step = CIO_REALLOC_HINT_MAX;
+        }
+
+        new_size = cf->alloc_size + step;
         while (new_size < (pre_content + cf->data_size + count)) {
-            new_size += cf->realloc_size;
+            new_size += step;
         }
 
         old_size = cf->alloc_size;
@@ -946,6 +1405,10 @@ int cio_file_write_metadata(struct cio_chunk *ch, char *buf, size_t size)
         return -1;
     }
 
+    if (cf->inflated && file_expand(ch) != 0) {
+        return -1;
+    }
+
     /* Get metadata pointer */
     meta = cio_file_st_get_meta(cf->map);
 
@@ -1004,32 +1467,17 @@ int cio_file_write_metadata(struct cio_chunk *ch, char *buf, size_t size)
     return 0;
 }
 
-int cio_file_sync(struct cio_chunk *ch)
+/*
+ * Adjust the file size to the content and finalize the checksum, the file
+ * is ready to be flushed to disk.
+ */
+static int file_sync_prepare(struct cio_chunk *ch, struct cio_file *cf)
 {
     int ret;
     int meta_len;
     size_t desired_size;
     size_t file_size;
     size_t av_size;
-    struct cio_file *cf;
-
-    if (ch == NULL) {
-        return -1;
-    }
-
-    cf = (struct cio_file *) ch->backend;
-
-    if (cf == NULL) {
-        return -1;
-    }
-
-    if (cf->flags & CIO_OPEN_RD) {
-        return 0;
-    }
-
-    if (cf->synced == CIO_TRUE) {
-        return 0;
-    }
 
     ret = cio_file_native_get_size(cf, &file_size);
 
@@ -1069,13 +1517,51 @@ int cio_file_sync(struct cio_chunk *ch)
         finalize_checksum(cf);
     }
 
-    /* Commit changes to disk */
-    ret = cio_file_native_sync(cf, ch->ctx->options.flags);
+    return 0;
+}
 
-    if (ret != CIO_OK) {
+static int file_sync(struct cio_chunk *ch, int defer)
+{
+    int ret;
+    struct cio_file *cf;
+
+    if (ch == NULL) {
+        return -1;
+    }
+
+    cf = (struct cio_file *) ch->backend;
+
+    if (cf == NULL) {
         return -1;
     }
 
+    if (cf->flags & CIO_OPEN_RD) {
+        return 0;
+    }
+
+    if (cf->synced == CIO_TRUE) {
+        return 0;
+    }
+
+    ret = file_sync_prepare(ch, cf);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (defer == CIO_TRUE) {
+        /* the file will be flushed to disk by cio_file_sync_commit() */
+        sync_queue_add(ch->ctx, cf);
+    }
+    else {
+        /* Commit changes to disk */
+        ret = cio_file_native_sync(cf, ch->ctx->options.flags);
+
+        if (ret != CIO_OK) {
+            return -1;
+        }
+    }
+
     cf->synced = CIO_TRUE;
 
     ret = cio_file_update_size(cf);
@@ -1084,12 +1570,84 @@ int cio_file_sync(struct cio_chunk *ch)
         return -1;
     }
 
-    cio_log_debug(ch->ctx, "[cio file] synced at: %s/%s",
+    cio_log_debug(ch->ctx, "[cio file] %s at: %s/%s",
+                  defer == CIO_TRUE ? "sync queued" : "synced",
                   ch->st->name, ch->name);
 
     return 0;
 }
 
+int cio_file_sync(struct cio_chunk *ch)
+{
+    if (ch == NULL) {
+        return -1;
+    }
+
+    return file_sync(ch, is_group_commit(ch->ctx));
+}
+
+/*
+ * Flush the queued files to disk. The writeback of every file is started
+ * first so the I/O of all of them is in flight at the same time, then each
+ * one is waited for.
+ */
+int cio_file_sync_commit(struct cio_ctx *ctx)
+{
+    int ret;
+    int count = 0;
+    int errors = 0;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct cio_file *cf;
+    struct cio_chunk *ch;
+
+    mk_list_foreach(head, &ctx->sync_queue) {
+        cf = mk_list_entry(head, struct cio_file, _sync_head);
+        ch = cf->chunk;
+
+        /* new data was written after the sync was queued */
+        if (cf->synced == CIO_FALSE) {
+            ret = file_sync_prepare(ch, cf);
+            if (ret != 0) {
+                errors++;
+                continue;
+            }
+            cf->synced = CIO_TRUE;
+            cio_file_update_size(cf);
+        }
+
+        cio_file_native_sync_start(cf);
+    }
+
+    mk_list_foreach_safe(head, tmp, &ctx->sync_queue) {
+        cf = mk_list_entry(head, struct cio_file, _sync_head);
+        ch = cf->chunk;
+
+        ret = cio_file_native_sync(cf, ctx->options.flags);
+        if (ret != CIO_OK) {
+            cio_log_error(ctx, "[cio file] error syncing file at %s:%s",
+                          ch->st->name, ch->name);
+            errors++;
+
+            /* keep it queued, it will be retried */
+            continue;
+        }
+
+        sync_queue_del(cf);
+        count++;
+    }
+
+    if (count > 0) {
+        cio_log_debug(ctx, "[cio file] group commit: %i files synced", count);
+    }
+
+    if (errors > 0) {
+        return -1;
+    }
+
+    return count;
+}
+
 int cio_file_resize(struct cio_file *cf, size_t new_size)
 {
     int    inner_result;
@@ -1220,6 +1778,11 @@ int cio_file_is_up(struct cio_chunk *ch, struct cio_file *cf)
 {
     (void) ch;
 
+    /* uncompressed in memory, there is no file descriptor */
+    if (cf->inflated) {
+        return CIO_TRUE;
+    }
+
     if (cio_file_native_is_open(cf) &&
         cio_file_native_is_mapped(cf)) {
         return CIO_TRUE;
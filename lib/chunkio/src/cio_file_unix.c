@@ -458,6 +458,59 @@ int cio_file_native_delete(struct cio_file *cf)
     return CIO_OK;
 }
 
+/*
+ * Atomically replace the content of the file: the buffer is written to
+ * 'tmp_path' and renamed over the file, which must not be open.
+ */
+int cio_file_native_replace(struct cio_file *cf, char *tmp_path,
+                            const char *buf, size_t size, int sync_mode)
+{
+    int fd;
+    ssize_t bytes;
+    size_t written = 0;
+
+    if (cio_file_native_is_open(cf) ||
+        cio_file_native_is_mapped(cf)) {
+        return CIO_ERROR;
+    }
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, (mode_t) 0600);
+    if (fd == -1) {
+        cio_file_native_report_os_error();
+        return CIO_ERROR;
+    }
+
+    while (written < size) {
+        bytes = write(fd, buf + written, size - written);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cio_file_native_report_os_error();
+            close(fd);
+            unlink(tmp_path);
+            return CIO_ERROR;
+        }
+        written += bytes;
+    }
+
+    if ((sync_mode & CIO_FULL_SYNC) && fsync(fd) == -1) {
+        cio_file_native_report_os_error();
+        close(fd);
+        unlink(tmp_path);
+        return CIO_ERROR;
+    }
+    close(fd);
+
+    if (rename(tmp_path, cf->path) == -1) {
+        cio_file_native_report_os_error();
+        unlink(tmp_path);
+        return CIO_ERROR;
+    }
+
+    return CIO_OK;
+}
+
 int cio_file_native_sync(struct cio_file *cf, int sync_mode)
 {
     int result;
@@ -480,6 +533,29 @@ int cio_file_native_sync(struct cio_file *cf, int sync_mode)
     return CIO_OK;
 }
 
+/*
+ * Start the writeback of the dirty pages of the file without waiting for it,
+ * a later cio_file_native_sync() call finds most of the work already done.
+ */
+int cio_file_native_sync_start(struct cio_file *cf)
+{
+#if defined(CIO_HAVE_SYNC_FILE_RANGE)
+    int result;
+
+    result = sync_file_range(cf->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+
+    if (result == -1) {
+        cio_file_native_report_os_error();
+
+        return CIO_ERROR;
+    }
+#else
+    (void) cf;
+#endif
+
+    return CIO_OK;
+}
+
 int cio_file_native_resize(struct cio_file *cf, size_t new_size)
 {
     int result;
@@ -470,6 +470,59 @@ int cio_file_native_delete(struct cio_file *cf)
     return CIO_OK;
 }
 
+/*
+ * Atomically replace the content of the file: the buffer is written to
+ * 'tmp_path' and moved over the file, which must not be open.
+ */
+int cio_file_native_replace(struct cio_file *cf, char *tmp_path,
+                            const char *buf, size_t size, int sync_mode)
+{
+    HANDLE file;
+    DWORD bytes;
+    DWORD length;
+    size_t written = 0;
+
+    if (cio_file_native_is_open(cf) ||
+        cio_file_native_is_mapped(cf)) {
+        return CIO_ERROR;
+    }
+
+    file = CreateFileA(tmp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        cio_file_native_report_os_error();
+        return CIO_ERROR;
+    }
+
+    while (written < size) {
+        length = (DWORD) min(size - written, (size_t) MAXDWORD);
+        if (!WriteFile(file, buf + written, length, &bytes, NULL)) {
+            cio_file_native_report_os_error();
+            CloseHandle(file);
+            DeleteFileA(tmp_path);
+            return CIO_ERROR;
+        }
+        written += bytes;
+    }
+
+    if ((sync_mode & CIO_FULL_SYNC) && !FlushFileBuffers(file)) {
+        cio_file_native_report_os_error();
+        CloseHandle(file);
+        DeleteFileA(tmp_path);
+        return CIO_ERROR;
+    }
+    CloseHandle(file);
+
+    if (!MoveFileExA(tmp_path, cf->path,
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        cio_file_native_report_os_error();
+        DeleteFileA(tmp_path);
+        return CIO_ERROR;
+    }
+
+    return CIO_OK;
+}
+
 int cio_file_native_sync(struct cio_file *cf, int sync_mode)
 {
     int result;
@@ -495,6 +548,13 @@ int cio_file_native_sync(struct cio_file *cf, int sync_mode)
     return CIO_OK;
 }
 
+int cio_file_native_sync_start(struct cio_file *cf)
+{
+    (void) cf;
+
+    return CIO_OK;
+}
+
 int cio_file_native_resize(struct cio_file *cf, size_t new_size)
 {
     LARGE_INTEGER movement_distance;
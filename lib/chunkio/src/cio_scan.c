@@ -35,6 +35,46 @@
 #endif
 
 #ifdef CIO_HAVE_BACKEND_FILESYSTEM
+/* Temporary file of a chunk rewrite: '.<chunk name>.tmp' */
+static int is_stale_tmp(struct cio_ctx *ctx, const char *name)
+{
+    size_t len;
+
+    /* never touch the files of a read-only context */
+    if ((ctx->options.flags & CIO_OPEN_RW) == 0) {
+        return CIO_FALSE;
+    }
+
+    len = strlen(name);
+    if (name[0] != '.' || len <= 5 || strcmp(name + len - 4, ".tmp") != 0) {
+        return CIO_FALSE;
+    }
+
+    return CIO_TRUE;
+}
+
+static void remove_stale_tmp(struct cio_ctx *ctx, char *path, char *name)
+{
+    int len;
+    char *tmp_path;
+
+    len = strlen(path) + strlen(name) + 2;
+    tmp_path = malloc(len);
+    if (!tmp_path) {
+        cio_errno();
+        return;
+    }
+    snprintf(tmp_path, len, "%s/%s", path, name);
+
+    if (remove(tmp_path) == 0) {
+        cio_log_info(ctx, "[cio scan] removed stale file %s", tmp_path);
+    }
+    else {
+        cio_errno();
+    }
+    free(tmp_path);
+}
+
 static int cio_scan_stream_files(struct cio_ctx *ctx, struct cio_stream *st,
                                  char *chunk_extension)
 {
@@ -76,6 +116,12 @@ static int cio_scan_stream_files(struct cio_ctx *ctx, struct cio_stream *st,
 
     /* Iterate the root_path */
     while ((ent = readdir(dir)) != NULL) {
+        /* an interrupted chunk rewrite leaves its temporary file behind */
+        if (ent->d_type == DT_REG && is_stale_tmp(ctx, ent->d_name)) {
+            remove_stale_tmp(ctx, path, ent->d_name);
+            continue;
+        }
+
         if ((ent->d_name[0] == '.') || (strcmp(ent->d_name, "..") == 0)) {
             continue;
         }
@@ -849,6 +849,359 @@ static void test_deep_hierarchy()
     cio_destroy(ctx);
 }
 
+/*
+ * Group commit: chunk syncs are queued and flushed together by
+ * cio_sync_commit(), the content must be the same as with regular syncs.
+ */
+static void test_fs_group_commit()
+{
+    int i;
+    int ret;
+    int len;
+    int err;
+    char line[] = "this is a test line\n";
+    char name[32];
+    char *buf;
+    size_t size;
+    struct stat st;
+    struct cio_ctx *ctx;
+    struct cio_file *cf;
+    struct cio_chunk *chunk;
+    struct cio_chunk *chunks[10];
+    struct cio_stream *stream;
+    struct cio_options cio_opts;
+
+    /* cleanup environment */
+    cio_utils_recursive_delete(CIO_ENV);
+
+    memset(&cio_opts, 0, sizeof(cio_opts));
+
+    cio_opts.root_path = CIO_ENV;
+    cio_opts.log_cb = log_cb;
+    cio_opts.log_level = CIO_LOG_INFO;
+    cio_opts.flags = CIO_CHECKSUM | CIO_FULL_SYNC | CIO_GROUP_COMMIT;
+    cio_opts.realloc_size_hint = 64 * 1024;
+
+    ctx = cio_create(&cio_opts);
+    TEST_CHECK(ctx != NULL);
+    TEST_CHECK(ctx->realloc_size_hint == 64 * 1024);
+
+    stream = cio_stream_create(ctx, "test_group_commit", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    len = strlen(line);
+    for (i = 0; i < 10; i++) {
+        snprintf(name, sizeof(name) - 1, "test-%i", i);
+        chunks[i] = cio_chunk_open(ctx, stream, name, CIO_OPEN, 1000, &err);
+        TEST_CHECK(chunks[i] != NULL);
+        if (!chunks[i]) {
+            exit(1);
+        }
+
+        ret = cio_chunk_write(chunks[i], line, len);
+        TEST_CHECK(ret == CIO_OK);
+
+        /* the growth step follows the hint */
+        cf = (struct cio_file *) chunks[i]->backend;
+        TEST_CHECK(cf->realloc_size == 64 * 1024);
+
+        ret = cio_chunk_sync(chunks[i]);
+        TEST_CHECK(ret == CIO_OK);
+        TEST_CHECK(cf->sync_queued == CIO_TRUE);
+
+        /* the preallocated space is released when the sync is queued */
+        ret = stat(cf->path, &st);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(st.st_size == cio_file_real_size(cf));
+    }
+    TEST_CHECK(mk_list_size(&ctx->sync_queue) == 10);
+
+    /* write again on a queued chunk, the commit must pick up the new data */
+    ret = cio_chunk_write(chunks[0], line, len);
+    TEST_CHECK(ret == CIO_OK);
+
+    ret = cio_sync_commit(ctx);
+    TEST_CHECK(ret == 10);
+    TEST_CHECK(mk_list_size(&ctx->sync_queue) == 0);
+
+    /* putting a queued chunk down syncs it right away */
+    ret = cio_chunk_write(chunks[1], line, len);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_sync(chunks[1]);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(mk_list_size(&ctx->sync_queue) == 1);
+    ret = cio_chunk_down(chunks[1]);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(mk_list_size(&ctx->sync_queue) == 0);
+
+    /* a deleted chunk leaves the queue */
+    ret = cio_chunk_sync(chunks[2]);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_write(chunks[2], line, len);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_sync(chunks[2]);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(mk_list_size(&ctx->sync_queue) == 1);
+    cio_chunk_close(chunks[2], CIO_TRUE);
+    TEST_CHECK(mk_list_size(&ctx->sync_queue) == 0);
+
+    cio_destroy(ctx);
+
+    /* Load the chunks again and verify content and checksum */
+    cio_opts.flags = CIO_CHECKSUM;
+    ctx = cio_create(&cio_opts);
+    TEST_CHECK(ctx != NULL);
+
+    stream = cio_stream_create(ctx, "test_group_commit", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    for (i = 0; i < 10; i++) {
+        if (i == 2) {
+            continue;
+        }
+        snprintf(name, sizeof(name) - 1, "test-%i", i);
+        chunk = cio_chunk_open(ctx, stream, name, CIO_OPEN, 1000, &err);
+        TEST_CHECK(chunk != NULL);
+        if (!chunk) {
+            exit(1);
+        }
+
+        ret = cio_chunk_get_content(chunk, &buf, &size);
+        TEST_CHECK(ret == CIO_OK);
+        TEST_CHECK(size == len * ((i < 2) ? 2 : 1));
+        TEST_CHECK(memcmp(buf, line, len) == 0);
+    }
+
+    cio_destroy(ctx);
+}
+
+/* Run-length codec used to exercise the compression callbacks */
+static size_t rle_compress(void *data, int type, const void *src,
+                           size_t src_size, void *dst, size_t dst_size)
+{
+    size_t i = 0;
+    size_t o = 0;
+    size_t run;
+    const unsigned char *in = src;
+    unsigned char *out = dst;
+
+    (void) data;
+    TEST_CHECK(type == 1);
+
+    while (i < src_size) {
+        run = 1;
+        while (i + run < src_size && run < 255 && in[i + run] == in[i]) {
+            run++;
+        }
+        if (o + 2 > dst_size) {
+            return 0;
+        }
+        out[o++] = run;
+        out[o++] = in[i];
+        i += run;
+    }
+
+    return o;
+}
+
+static int rle_uncompress(void *data, int type, const void *src,
+                          size_t src_size, void *dst, size_t dst_size)
+{
+    size_t i;
+    size_t o = 0;
+    const unsigned char *in = src;
+    unsigned char *out = dst;
+
+    (void) data;
+    TEST_CHECK(type == 1);
+
+    for (i = 0; i + 1 < src_size; i += 2) {
+        if (o + in[i] > dst_size) {
+            return -1;
+        }
+        memset(out + o, in[i + 1], in[i]);
+        o += in[i];
+    }
+
+    return (o == dst_size) ? 0 : -1;
+}
+
+static int file_is_compressed(struct cio_chunk *ch)
+{
+    int fd;
+    unsigned char id[2];
+    struct cio_file *cf = ch->backend;
+
+    fd = open(cf->path, O_RDONLY);
+    TEST_CHECK(fd != -1);
+    TEST_CHECK(read(fd, id, 2) == 2);
+    close(fd);
+
+    return id[1] == 0x01;
+}
+
+/* Locked chunks are compressed while they are down */
+static void test_fs_compress()
+{
+    int i;
+    int ret;
+    int err;
+    char *buf;
+    char *data;
+    int fd;
+    char meta[] = "compressed-meta";
+    char tmp[PATH_MAX];
+    size_t size;
+    size_t data_size = 64 * 1024;
+    struct stat st;
+    struct cio_ctx *ctx;
+    struct cio_chunk *chunk;
+    struct cio_chunk *open_chunk;
+    struct cio_stream *stream;
+    struct cio_options cio_opts;
+    struct mk_list *head;
+
+    /* cleanup environment */
+    cio_utils_recursive_delete(CIO_ENV);
+
+    data = malloc(data_size);
+    TEST_CHECK(data != NULL);
+    for (i = 0; i < data_size; i++) {
+        data[i] = ((i % 100) == 99) ? '\n' : 'a' + ((i / 100) % 26);
+    }
+
+    memset(&cio_opts, 0, sizeof(cio_opts));
+
+    cio_opts.root_path = CIO_ENV;
+    cio_opts.log_cb = log_cb;
+    cio_opts.log_level = CIO_LOG_INFO;
+    cio_opts.flags = CIO_OPEN | CIO_CHECKSUM;
+    cio_opts.compress_type = 1;
+    cio_opts.compress = rle_compress;
+    cio_opts.uncompress = rle_uncompress;
+
+    ctx = cio_create(&cio_opts);
+    TEST_CHECK(ctx != NULL);
+
+    stream = cio_stream_create(ctx, "test_compress", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    chunk = cio_chunk_open(ctx, stream, "locked", CIO_OPEN, 1000, &err);
+    open_chunk = cio_chunk_open(ctx, stream, "open", CIO_OPEN, 1000, &err);
+    TEST_CHECK(chunk != NULL && open_chunk != NULL);
+    if (!chunk || !open_chunk) {
+        exit(1);
+    }
+
+    ret = cio_meta_write(chunk, meta, sizeof(meta) - 1);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_write(chunk, data, data_size);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_write(open_chunk, data, data_size);
+    TEST_CHECK(ret == CIO_OK);
+
+    /* the file is truncated to its content on sync */
+    ret = cio_chunk_sync(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    size = cio_chunk_get_real_size(chunk);
+
+    /* a chunk that can still be written is left as is */
+    ret = cio_chunk_down(open_chunk);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(file_is_compressed(open_chunk) == CIO_FALSE);
+
+    cio_chunk_lock(chunk);
+    ret = cio_chunk_down(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(file_is_compressed(chunk) == CIO_TRUE);
+
+    /* the file shrinks but the chunk reports its real size */
+    ret = stat(((struct cio_file *) chunk->backend)->path, &st);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(st.st_size < data_size / 10);
+    TEST_CHECK(cio_chunk_get_real_size(chunk) == size);
+
+    /* bring it up: the content is uncompressed in memory, not on disk */
+    ret = cio_chunk_up(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(cio_chunk_is_up(chunk) == CIO_TRUE);
+    TEST_CHECK(file_is_compressed(chunk) == CIO_TRUE);
+    TEST_CHECK(cio_chunk_get_real_size(chunk) == size);
+
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == data_size);
+    TEST_CHECK(memcmp(buf, data, data_size) == 0);
+
+    ret = cio_meta_cmp(chunk, meta, sizeof(meta) - 1);
+    TEST_CHECK(ret == 0);
+
+    /* nothing to write back */
+    ret = cio_chunk_down(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(file_is_compressed(chunk) == CIO_TRUE);
+
+    cio_destroy(ctx);
+
+    /* the temporary file of an interrupted rewrite */
+    snprintf(tmp, sizeof(tmp), "%s/test_compress/.locked.tmp", CIO_ENV);
+    fd = open(tmp, O_CREAT | O_WRONLY, 0600);
+    TEST_CHECK(fd != -1);
+    TEST_CHECK(write(fd, "partial", 7) == 7);
+    close(fd);
+
+    /* load the chunks again, the leftover is removed by the scan */
+    ctx = cio_create(&cio_opts);
+    TEST_CHECK(ctx != NULL);
+    ret = cio_load(ctx, NULL);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(access(tmp, F_OK) == -1);
+
+    stream = cio_stream_get(ctx, "test_compress");
+    TEST_CHECK(stream != NULL);
+    if (!stream) {
+        exit(1);
+    }
+
+    chunk = NULL;
+    mk_list_foreach(head, &stream->chunks) {
+        open_chunk = mk_list_entry(head, struct cio_chunk, _head);
+        if (strcmp(open_chunk->name, "locked") == 0) {
+            chunk = open_chunk;
+        }
+    }
+    TEST_CHECK(chunk != NULL);
+    if (!chunk) {
+        exit(1);
+    }
+    TEST_CHECK(cio_chunk_is_up(chunk) == CIO_TRUE);
+    TEST_CHECK(file_is_compressed(chunk) == CIO_TRUE);
+
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == data_size);
+    TEST_CHECK(memcmp(buf, data, data_size) == 0);
+
+    /* a write stores the uncompressed content first */
+    ret = cio_chunk_write(chunk, "tail", 4);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(file_is_compressed(chunk) == CIO_FALSE);
+    ret = cio_chunk_sync(chunk);
+    TEST_CHECK(ret == CIO_OK);
+
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == data_size + 4);
+    TEST_CHECK(memcmp(buf, data, data_size) == 0);
+    TEST_CHECK(memcmp(buf + data_size, "tail", 4) == 0);
+
+    ret = cio_meta_cmp(chunk, meta, sizeof(meta) - 1);
+    TEST_CHECK(ret == 0);
+
+    cio_destroy(ctx);
+    free(data);
+}
+
 TEST_LIST = {
     {"fs_write",   test_fs_write},
     {"fs_checksum",  test_fs_checksum},
@@ -859,5 +1212,7 @@ TEST_LIST = {
     {"issue_write_at", test_issue_write_at},
     {"fs_up_down_up_append", test_fs_up_down_up_append},
     {"fs_deep_hierachy", test_deep_hierarchy},
+    {"fs_group_commit", test_fs_group_commit},
+    {"fs_compress", test_fs_compress},
     { 0 }
 };
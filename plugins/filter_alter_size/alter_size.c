@@ -168,5 +168,5 @@ struct flb_filter_plugin filter_alter_size_plugin = {
     .cb_filter    = cb_alter_size_filter,
     .cb_exit      = cb_alter_size_exit,
     .config_map   = config_map,
-    .flags        = 0
+    .flags        = FLB_FILTER_THREAD_SAFE
 };
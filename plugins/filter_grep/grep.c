@@ -30,10 +30,33 @@
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_regex.h>
 #include <fluent-bit/flb_record_accessor.h>
+#include <fluent-bit/flb_log_event_decoder.h>
 #include <msgpack.h>
 
 #include "grep.h"
 
+static void delete_keys(struct grep_ctx *ctx)
+{
+    int i;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct grep_key *key;
+
+    mk_list_foreach_safe(head, tmp, &ctx->keys) {
+        key = mk_list_entry(head, struct grep_key, _head);
+        for (i = 0; i < key->literals; i++) {
+            flb_sds_destroy(key->literal[i]);
+        }
+        flb_free(key->literal);
+        grep_ac_destroy(key->ac);
+        flb_sds_destroy(key->field);
+        mk_list_del(&key->_head);
+        flb_free(key);
+    }
+    ctx->keys_count = 0;
+    ctx->literals_count = 0;
+}
+
 static void delete_rules(struct grep_ctx *ctx)
 {
     struct mk_list *tmp;
@@ -49,6 +72,98 @@ static void delete_rules(struct grep_ctx *ctx)
         mk_list_del(&rule->_head);
         flb_free(rule);
     }
+
+    delete_keys(ctx);
+}
+
+/*
+ * Group the rule with the other rules testing the same key and register
+ * the literal string its regular expression requires, if any.
+ */
+static int set_rule_key(struct grep_ctx *ctx, struct grep_rule *rule)
+{
+    int i;
+    flb_sds_t lit;
+    flb_sds_t *tmp;
+    struct mk_list *head;
+    struct grep_key *key = NULL;
+
+    mk_list_foreach(head, &ctx->keys) {
+        key = mk_list_entry(head, struct grep_key, _head);
+        if (strcmp(key->field, rule->field) == 0) {
+            break;
+        }
+        key = NULL;
+    }
+
+    if (!key) {
+        key = flb_calloc(1, sizeof(struct grep_key));
+        if (!key) {
+            flb_errno();
+            return -1;
+        }
+        key->field = flb_sds_create(rule->field);
+        if (!key->field) {
+            flb_errno();
+            flb_free(key);
+            return -1;
+        }
+        key->id = ctx->keys_count++;
+        key->ra = rule->ra;
+        mk_list_add(&key->_head, &ctx->keys);
+    }
+
+    rule->key = key;
+    rule->literal_id = -1;
+
+    lit = grep_prefilter_literal(rule->regex_pattern);
+    if (!lit) {
+        return 0;
+    }
+
+    for (i = 0; i < key->literals; i++) {
+        if (flb_sds_cmp(key->literal[i], lit, flb_sds_len(lit)) == 0) {
+            rule->literal_id = i;
+            flb_sds_destroy(lit);
+            return 0;
+        }
+    }
+
+    tmp = flb_realloc(key->literal, sizeof(flb_sds_t) * (key->literals + 1));
+    if (!tmp) {
+        flb_errno();
+        flb_sds_destroy(lit);
+        return -1;
+    }
+    key->literal = tmp;
+    key->literal[key->literals] = lit;
+    rule->literal_id = key->literals++;
+
+    flb_plg_debug(ctx->ins, "rule '%s %s' requires literal '%s'",
+                  rule->field, rule->regex_pattern, lit);
+    return 0;
+}
+
+/* Build the literals automaton of each key */
+static void set_keys_prefilter(struct grep_ctx *ctx)
+{
+    struct mk_list *head;
+    struct grep_key *key;
+
+    mk_list_foreach(head, &ctx->keys) {
+        key = mk_list_entry(head, struct grep_key, _head);
+        key->literal_base = ctx->literals_count;
+        ctx->literals_count += key->literals;
+
+        if (key->literals > 0) {
+            key->ac = grep_ac_create(key->literal, key->literals);
+            if (!key->ac) {
+                flb_plg_warn(ctx->ins, "could not create the prefilter of "
+                             "key '%s', rules will run without it",
+                             key->field);
+            }
+        }
+    }
 }
 
 static int set_rules(struct grep_ctx *ctx, struct flb_filter_instance *f_ins)
@@ -143,26 +258,95 @@ static int set_rules(struct grep_ctx *ctx, struct flb_filter_instance *f_ins)
             return -1;
         }
 
+        /* Group rules by key */
+        if (set_rule_key(ctx, rule) != 0) {
+            delete_rules(ctx);
+            flb_sds_destroy(rule->field);
+            flb_free(rule->regex_pattern);
+            flb_ra_destroy(rule->ra);
+            flb_regex_destroy(rule->regex);
+            flb_free(rule);
+            return -1;
+        }
+
         /* Link to parent list */
         mk_list_add(&rule->_head, &ctx->rules);
     }
 
+    set_keys_prefilter(ctx);
+
     return 0;
 }
 
+/* Check if the regular expression of the rule matches the record */
+static inline int grep_rule_match(struct grep_rule *rule, msgpack_object map,
+                                  struct grep_value *values, char *found)
+{
+    int ret;
+    char *key_found;
+    struct grep_key *key;
+    struct grep_value *v;
+    msgpack_object *start_key;
+    msgpack_object *out_key;
+    msgpack_object *out_val = NULL;
+
+    key = rule->key;
+    v = &values[key->id];
+
+    /* fetch the value once for all the rules of the key */
+    if (v->state == GREP_VALUE_UNSET) {
+        ret = flb_ra_get_kv_pair(key->ra, map, &start_key, &out_key, &out_val);
+        if (ret == 0 && out_val && out_val->type == MSGPACK_OBJECT_STR) {
+            v->state = GREP_VALUE_STR;
+            v->ptr = out_val->via.str.ptr;
+            v->len = out_val->via.str.size;
+        }
+        else {
+            v->state = GREP_VALUE_NONE;
+        }
+    }
+
+    if (v->state != GREP_VALUE_STR) {
+        return FLB_FALSE;
+    }
+
+    /* a value missing the literal required by the rule cannot match */
+    if (rule->literal_id >= 0 && key->ac) {
+        key_found = found + key->literal_base;
+        if (!v->scanned) {
+            memset(key_found, 0, key->literals);
+            grep_ac_scan(key->ac, v->ptr, v->len, key_found, key->literals);
+            v->scanned = FLB_TRUE;
+        }
+        if (!key_found[rule->literal_id]) {
+            return FLB_FALSE;
+        }
+    }
+
+    ret = flb_regex_match(rule->regex, (unsigned char *) v->ptr, v->len);
+    if (ret <= 0) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
+
 /* Given a msgpack record, do some filter action based on the defined rules */
-static inline int grep_filter_data(msgpack_object map, struct grep_ctx *ctx)
+static inline int grep_filter_data(msgpack_object map, struct grep_ctx *ctx,
+                                   struct grep_value *values, char *found)
 {
-    ssize_t ret;
+    int ret;
     struct mk_list *head;
     struct grep_rule *rule;
 
+    memset(values, 0, sizeof(struct grep_value) * ctx->keys_count);
+
     /* For each rule, validate against map fields */
     mk_list_foreach(head, &ctx->rules) {
         rule = mk_list_entry(head, struct grep_rule, _head);
 
-        ret = flb_ra_regex_match(rule->ra, map, rule->regex, NULL);
-        if (ret <= 0) { /* no match */
+        ret = grep_rule_match(rule, map, values, found);
+        if (ret == FLB_FALSE) { /* no match */
             if (rule->type == GREP_REGEX) {
                 return GREP_RET_EXCLUDE;
             }
@@ -200,6 +384,9 @@ static int cb_grep_init(struct flb_filter_instance *f_ins,
         return -1;
     }
     mk_list_init(&ctx->rules);
+    mk_list_init(&ctx->keys);
+    ctx->keys_count = 0;
+    ctx->literals_count = 0;
     ctx->ins = f_ins;
 
     /* Load rules */
@@ -225,43 +412,64 @@ static int cb_grep_filter(const void *data, size_t bytes,
     int ret;
     int old_size = 0;
     int new_size = 0;
-    msgpack_unpacked result;
-    msgpack_object map;
-    msgpack_object root;
-    size_t off = 0;
+    msgpack_object *map;
     (void) f_ins;
     (void) i_ins;
     (void) config;
     msgpack_sbuffer tmp_sbuf;
-    msgpack_packer tmp_pck;
+    char *found;
+    struct grep_value *values;
+    struct grep_ctx *ctx = context;
+    struct flb_log_event event;
+    struct flb_log_event_decoder decoder;
+
+    /* per record state, allocated once for the whole chunk */
+    values = flb_malloc(sizeof(struct grep_value) * (ctx->keys_count + 1));
+    if (!values) {
+        flb_errno();
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    found = flb_malloc(ctx->literals_count + 1);
+    if (!found) {
+        flb_errno();
+        flb_free(values);
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    ret = flb_log_event_decoder_init(&decoder, (char *) data, bytes);
+    if (ret != 0) {
+        flb_free(values);
+        flb_free(found);
+        return FLB_FILTER_NOTOUCH;
+    }
 
     /* Create temporary msgpack buffer */
     msgpack_sbuffer_init(&tmp_sbuf);
-    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
-
-    /* Iterate each item array and apply rules */
-    msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        root = result.data;
-        if (root.type != MSGPACK_OBJECT_ARRAY) {
-            continue;
-        }
 
+    /* Iterate each record and apply rules */
+    while (flb_log_event_decoder_next(&decoder, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
         old_size++;
 
-        /* get time and map */
-        map  = root.via.array.ptr[1];
+        map = flb_log_event_decoder_get_body(&decoder, &event);
+        if (!map) {
+            continue;
+        }
 
-        ret = grep_filter_data(map, context);
+        ret = grep_filter_data(*map, ctx, values, found);
         if (ret == GREP_RET_KEEP) {
-            msgpack_pack_object(&tmp_pck, root);
+            /* the record is kept as is, copy its raw bytes */
+            msgpack_sbuffer_write(&tmp_sbuf, event.raw, event.raw_size);
             new_size++;
         }
         else if (ret == GREP_RET_EXCLUDE) {
             /* Do nothing */
         }
     }
-    msgpack_unpacked_destroy(&result);
+    flb_log_event_decoder_destroy(&decoder);
+    flb_free(values);
+    flb_free(found);
 
     /* we keep everything ? */
     if (old_size == new_size) {
@@ -311,5 +519,5 @@ struct flb_filter_plugin filter_grep_plugin = {
     .cb_filter    = cb_grep_filter,
     .cb_exit      = cb_grep_exit,
     .config_map   = config_map,
-    .flags        = 0
+    .flags        = FLB_FILTER_THREAD_SAFE
 };
@@ -25,6 +25,8 @@
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_record_accessor.h>
 
+#include "grep_prefilter.h"
+
 /* rule types */
 #define GREP_REGEX    1
 #define GREP_EXCLUDE  2
@@ -34,16 +36,48 @@
 #define GREP_RET_EXCLUDE  1
 
 struct grep_ctx {
+    int keys_count;
+    int literals_count;
+    struct mk_list keys;
     struct mk_list rules;
     struct flb_filter_instance *ins;
 };
 
+/*
+ * Rules testing the same key: the value is looked up once per record and
+ * the literals required by the rules are searched in a single pass.
+ */
+struct grep_key {
+    int id;
+    flb_sds_t field;
+    struct flb_record_accessor *ra;  /* reference to the first rule 'ra' */
+    int literals;                    /* distinct literals of the rules */
+    int literal_base;                /* offset in the per record table */
+    flb_sds_t *literal;
+    struct grep_ac *ac;              /* NULL if there is no prefilter */
+    struct mk_list _head;
+};
+
+/* value of a key in the record being processed */
+#define GREP_VALUE_UNSET  0
+#define GREP_VALUE_STR    1
+#define GREP_VALUE_NONE   2
+
+struct grep_value {
+    int state;
+    int scanned;                     /* literals searched already */
+    const char *ptr;
+    size_t len;
+};
+
 struct grep_rule {
     int type;
     flb_sds_t field;
     char *regex_pattern;
     struct flb_regex *regex;
     struct flb_record_accessor *ra;
+    struct grep_key *key;
+    int literal_id;                  /* -1 if the rule has no literal */
     struct mk_list _head;
 };
 
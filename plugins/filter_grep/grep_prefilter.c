@@ -0,0 +1,430 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+
+#include <ctype.h>
+#include <string.h>
+
+#include "grep_prefilter.h"
+
+/*
+ * Escapes followed by arguments (hex, octal, unicode, control, properties,
+ * back references). Patterns using them are not inspected.
+ */
+#define ESCAPES_WITH_ARGS   "xuo01234567cCMpPkg"
+
+/* Inline options, '(?i)' changes how the rest of the pattern matches */
+#define INLINE_OPTIONS      "imxadlu-"
+
+/* Skip a character class, 'p' points to the opening bracket */
+static const char *skip_class(const char *p, const char *end)
+{
+    int depth = 0;
+
+    while (p < end) {
+        if (*p == '\\') {
+            p += 2;
+            continue;
+        }
+
+        if (*p == '[') {
+            depth++;
+            p++;
+            if (p < end && *p == '^') {
+                p++;
+            }
+            /* a leading ']' is ambiguous, do not try to guess it */
+            if (p < end && *p == ']') {
+                return NULL;
+            }
+            continue;
+        }
+
+        if (*p == ']') {
+            p++;
+            if (--depth == 0) {
+                return p;
+            }
+            continue;
+        }
+        p++;
+    }
+
+    return NULL;
+}
+
+/*
+ * Skip an interval quantifier, 'p' points to the opening brace. Anything
+ * that is not '{n}', '{n,}', '{,m}' or '{n,m}' is matched literally by the
+ * regex engine, it's reported as an error so the pattern is not inspected.
+ */
+static const char *skip_interval(const char *p, const char *end)
+{
+    int digits = 0;
+    int comma = FLB_FALSE;
+
+    for (p++; p < end && *p != '}'; p++) {
+        if (isdigit((unsigned char) *p)) {
+            digits++;
+        }
+        else if (*p == ',' && comma == FLB_FALSE) {
+            comma = FLB_TRUE;
+        }
+        else {
+            return NULL;
+        }
+    }
+
+    if (p == end || digits == 0) {
+        return NULL;
+    }
+
+    return p + 1;
+}
+
+/* Keep the current run of literal characters if it is the longest one */
+static inline void save_run(char *cur, size_t *cur_len,
+                            char *best, size_t *best_len)
+{
+    if (*cur_len > *best_len) {
+        memcpy(best, cur, *cur_len);
+        *best_len = *cur_len;
+    }
+    *cur_len = 0;
+}
+
+/*
+ * Return the longest string that any match of the regular expression must
+ * contain, or NULL if it cannot be determined. Only the top level of the
+ * pattern is inspected: groups, classes and optional or repeated atoms end
+ * the current run of literal characters, while alternations and inline
+ * options disable the extraction. The result is always safe to use as a
+ * prefilter: if the literal is missing, the pattern cannot match.
+ */
+flb_sds_t grep_prefilter_literal(const char *pattern)
+{
+    int depth = 0;
+    char c;
+    char *cur;
+    char *best;
+    size_t len;
+    size_t cur_len = 0;
+    size_t best_len = 0;
+    const char *p;
+    const char *q;
+    const char *end;
+    flb_sds_t lit = NULL;
+
+    len = strlen(pattern);
+    p = pattern;
+    end = pattern + len;
+
+    /* same handling of '/pattern/' than flb_regex_create() */
+    if (len >= 2 && pattern[0] == '/' && pattern[len - 1] == '/') {
+        p++;
+        end--;
+    }
+
+    cur = flb_malloc(len + 1);
+    if (!cur) {
+        flb_errno();
+        return NULL;
+    }
+
+    best = flb_malloc(len + 1);
+    if (!best) {
+        flb_errno();
+        flb_free(cur);
+        return NULL;
+    }
+
+    while (p < end) {
+        c = *p;
+
+        if (c == '\\') {
+            if (p + 1 >= end) {
+                goto none;
+            }
+            c = p[1];
+            if ((unsigned char) c >= 0x80 || strchr(ESCAPES_WITH_ARGS, c)) {
+                goto none;
+            }
+            p += 2;
+
+            if (depth > 0) {
+                continue;
+            }
+
+            /* character types and anchors: \d, \w, \s, \b, \A... */
+            if (isalnum((unsigned char) c)) {
+                save_run(cur, &cur_len, best, &best_len);
+                continue;
+            }
+            goto literal;
+        }
+
+        if (c == '[') {
+            save_run(cur, &cur_len, best, &best_len);
+            p = skip_class(p, end);
+            if (!p) {
+                goto none;
+            }
+            continue;
+        }
+
+        if (c == '(') {
+            if (depth == 0 && p + 1 < end && p[1] == '?') {
+                q = p + 2;
+                while (q < end && strchr(INLINE_OPTIONS, *q)) {
+                    q++;
+                }
+                if (q > p + 2 && q < end && *q == ')') {
+                    goto none;
+                }
+            }
+            save_run(cur, &cur_len, best, &best_len);
+            depth++;
+            p++;
+            continue;
+        }
+
+        if (c == ')') {
+            if (depth == 0) {
+                goto none;
+            }
+            depth--;
+            p++;
+            continue;
+        }
+
+        if (depth > 0) {
+            p++;
+            continue;
+        }
+
+        switch (c) {
+        case '|':
+            goto none;
+        case '{':
+            save_run(cur, &cur_len, best, &best_len);
+            p = skip_interval(p, end);
+            if (!p) {
+                goto none;
+            }
+            continue;
+        case '.': case '^': case '$': case '*': case '+': case '?':
+        case '}': case ']':
+            save_run(cur, &cur_len, best, &best_len);
+            p++;
+            continue;
+        }
+        p++;
+
+literal:
+        /* 'c' is a literal byte and 'p' points to the next token */
+        if (p < end && (*p == '*' || *p == '?' || *p == '{' ||
+                        (*p == '+' && p + 1 < end &&
+                         strchr("*?+{", p[1])))) {
+            /*
+             * the character is optional (or repeated and quantified again,
+             * which can make it optional too), drop all of its bytes
+             */
+            if (((unsigned char) c & 0xc0) == 0x80) {
+                while (cur_len > 0 &&
+                       ((unsigned char) cur[cur_len - 1] & 0xc0) == 0x80) {
+                    cur_len--;
+                }
+                if (cur_len > 0) {
+                    cur_len--;
+                }
+            }
+            save_run(cur, &cur_len, best, &best_len);
+
+            if (*p == '{') {
+                p = skip_interval(p, end);
+                if (!p) {
+                    goto none;
+                }
+            }
+            else {
+                p++;
+            }
+            continue;
+        }
+
+        cur[cur_len++] = c;
+
+        /* repeated: the character is required but ends the run */
+        if (p < end && *p == '+') {
+            save_run(cur, &cur_len, best, &best_len);
+            p++;
+        }
+    }
+
+    save_run(cur, &cur_len, best, &best_len);
+    if (best_len > 0) {
+        if (best_len > GREP_LITERAL_MAX) {
+            best_len = GREP_LITERAL_MAX;
+        }
+        lit = flb_sds_create_len(best, best_len);
+    }
+
+none:
+    flb_free(cur);
+    flb_free(best);
+    return lit;
+}
+
+/*
+ * Build a deterministic Aho-Corasick automaton: every state has a
+ * transition for each byte, so scanning costs one lookup per byte.
+ */
+struct grep_ac *grep_ac_create(flb_sds_t *literals, int count)
+{
+    int i;
+    int b;
+    int head = 0;
+    int tail = 0;
+    int f;
+    int s;
+    int t;
+    int states = 1;
+    size_t j;
+    size_t total = 1;
+    uint16_t *fail;
+    uint16_t *queue;
+    struct grep_ac *ac;
+
+    for (i = 0; i < count; i++) {
+        total += flb_sds_len(literals[i]);
+    }
+
+    if (total > UINT16_MAX || count > INT16_MAX) {
+        return NULL;
+    }
+
+    ac = flb_calloc(1, sizeof(struct grep_ac));
+    if (!ac) {
+        flb_errno();
+        return NULL;
+    }
+
+    /* state zero is the root, it is never the target of a trie edge */
+    ac->next = flb_calloc(total * 256, sizeof(uint16_t));
+    ac->out = flb_malloc(total * sizeof(int16_t));
+    ac->dict = flb_calloc(total, sizeof(uint16_t));
+    fail = flb_calloc(total, sizeof(uint16_t));
+    queue = flb_malloc(total * sizeof(uint16_t));
+    if (!ac->next || !ac->out || !ac->dict || !fail || !queue) {
+        flb_errno();
+        flb_free(fail);
+        flb_free(queue);
+        grep_ac_destroy(ac);
+        return NULL;
+    }
+
+    for (j = 0; j < total; j++) {
+        ac->out[j] = -1;
+    }
+
+    /* trie */
+    for (i = 0; i < count; i++) {
+        s = 0;
+        for (j = 0; j < flb_sds_len(literals[i]); j++) {
+            b = (unsigned char) literals[i][j];
+            if (ac->next[s * 256 + b] == 0) {
+                ac->next[s * 256 + b] = states++;
+            }
+            s = ac->next[s * 256 + b];
+        }
+        if (ac->out[s] == -1) {
+            ac->out[s] = i;
+        }
+    }
+
+    /* failure links, resolved into the transition table in BFS order */
+    for (b = 0; b < 256; b++) {
+        t = ac->next[b];
+        if (t != 0) {
+            queue[tail++] = t;
+        }
+    }
+
+    while (head < tail) {
+        s = queue[head++];
+        for (b = 0; b < 256; b++) {
+            t = ac->next[s * 256 + b];
+            f = ac->next[fail[s] * 256 + b];
+            if (t != 0) {
+                fail[t] = f;
+                ac->dict[t] = (ac->out[f] >= 0) ? f : ac->dict[f];
+                queue[tail++] = t;
+            }
+            else {
+                ac->next[s * 256 + b] = f;
+            }
+        }
+    }
+    ac->states = states;
+
+    flb_free(fail);
+    flb_free(queue);
+
+    return ac;
+}
+
+/* Set found[i] for every literal 'i' contained in the buffer */
+void grep_ac_scan(struct grep_ac *ac, const char *buf, size_t len,
+                  char *found, int count)
+{
+    int s = 0;
+    int t;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        s = ac->next[s * 256 + (unsigned char) buf[i]];
+
+        t = (ac->out[s] >= 0) ? s : ac->dict[s];
+        while (t != 0) {
+            if (!found[ac->out[t]]) {
+                found[ac->out[t]] = 1;
+                if (--count == 0) {
+                    return;
+                }
+            }
+            t = ac->dict[t];
+        }
+    }
+}
+
+void grep_ac_destroy(struct grep_ac *ac)
+{
+    if (!ac) {
+        return;
+    }
+
+    flb_free(ac->next);
+    flb_free(ac->out);
+    flb_free(ac->dict);
+    flb_free(ac);
+}
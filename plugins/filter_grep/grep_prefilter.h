@@ -0,0 +1,46 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_FILTER_GREP_PREFILTER_H
+#define FLB_FILTER_GREP_PREFILTER_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+
+#include <stdint.h>
+
+/* literals are truncated to this length, any prefix is still required */
+#define GREP_LITERAL_MAX     32
+
+/* Aho-Corasick automaton over the literals of the rules of one key */
+struct grep_ac {
+    int states;
+    uint16_t *next;        /* DFA transitions: states x 256 */
+    int16_t *out;          /* literal ending at the state or -1 */
+    uint16_t *dict;        /* next state with an output, 0 if none */
+};
+
+flb_sds_t grep_prefilter_literal(const char *pattern);
+
+struct grep_ac *grep_ac_create(flb_sds_t *literals, int count);
+void grep_ac_scan(struct grep_ac *ac, const char *buf, size_t len,
+                  char *found, int count);
+void grep_ac_destroy(struct grep_ac *ac);
+
+#endif
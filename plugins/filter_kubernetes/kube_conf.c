@@ -34,6 +34,7 @@
 
 #include "kube_meta.h"
 #include "kube_conf.h"
+#include "kube_watch.h"
 
 struct flb_kube *flb_kube_conf_create(struct flb_filter_instance *ins,
                                       struct flb_config *config)
@@ -53,6 +54,7 @@ struct flb_kube *flb_kube_conf_create(struct flb_filter_instance *ins,
     }
     ctx->config = config;
     ctx->ins = ins;
+    pthread_mutex_init(&ctx->token_lock, NULL);
 
     /* Set config_map properties in our local context */
     ret = flb_filter_config_map_set(ins, (void *) ctx);
@@ -158,6 +160,32 @@ struct flb_kube *flb_kube_conf_create(struct flb_filter_instance *ins,
         return NULL;
     }
 
+    /* Pods without metadata */
+    if (ctx->kube_meta_negative_cache_ttl > 0) {
+        ctx->negative_hash_table =
+            flb_hash_table_create_with_ttl(ctx->kube_meta_negative_cache_ttl,
+                                           FLB_HASH_TABLE_EVICT_OLDER,
+                                           FLB_HASH_TABLE_SIZE,
+                                           FLB_KUBE_NEGATIVE_CACHE_SIZE);
+        if (!ctx->negative_hash_table) {
+            flb_kube_conf_destroy(ctx);
+            return NULL;
+        }
+    }
+
+    /* The pods store is only fed by the API server */
+    if (ctx->kube_meta_watch == FLB_TRUE &&
+        (ctx->use_kubelet || ctx->use_tag_for_meta || ctx->dummy_meta)) {
+        flb_plg_warn(ctx->ins, "kube_meta_watch requires the API server, "
+                     "disabling it");
+        ctx->kube_meta_watch = FLB_FALSE;
+    }
+    if (ctx->kube_meta_watch == FLB_TRUE && ctx->kube_meta_watch_timeout <= 0) {
+        flb_plg_warn(ctx->ins, "invalid kube_meta_watch_timeout, using %is",
+                     FLB_KUBE_WATCH_TIMEOUT);
+        ctx->kube_meta_watch_timeout = FLB_KUBE_WATCH_TIMEOUT;
+    }
+
     /* Merge log buffer */
     if (ctx->merge_log == FLB_TRUE) {
         ctx->unesc_buf = flb_malloc(FLB_MERGE_BUF_SIZE);
@@ -199,10 +227,19 @@ void flb_kube_conf_destroy(struct flb_kube *ctx)
         return;
     }
 
+    /* stop the watch first, it might be refreshing the token */
+    if (ctx->watch) {
+        flb_kube_watch_destroy(ctx->watch);
+    }
+
     if (ctx->hash_table) {
         flb_hash_table_destroy(ctx->hash_table);
     }
 
+    if (ctx->negative_hash_table) {
+        flb_hash_table_destroy(ctx->negative_hash_table);
+    }
+
     if (ctx->merge_log == FLB_TRUE) {
         flb_free(ctx->unesc_buf);
     }
@@ -228,5 +265,6 @@ void flb_kube_conf_destroy(struct flb_kube *ctx)
     }
 #endif
 
+    pthread_mutex_destroy(&ctx->token_lock);
     flb_free(ctx);
 }
@@ -30,6 +30,8 @@
 #include <fluent-bit/flb_regex.h>
 #include <fluent-bit/flb_hash_table.h>
 
+#include <pthread.h>
+
 /*
  * Since this filter might get a high number of request per second,
  * we need to keep some cached data to perform filtering, e.g:
@@ -40,6 +42,9 @@
  */
 #define FLB_HASH_TABLE_SIZE 256
 
+/* Maximum number of pods remembered by the negative cache */
+#define FLB_KUBE_NEGATIVE_CACHE_SIZE 1024
+
 /*
  * When merging nested JSON strings from Docker logs, we need a temporary
  * buffer to perform the convertion. To optimize the process, we pre-allocate
@@ -66,6 +71,7 @@
 #endif
 
 struct kube_meta;
+struct flb_kube_watch;
 
 /* Filter context */
 struct flb_kube {
@@ -159,6 +165,20 @@ struct flb_kube {
 
     int kube_meta_cache_ttl;
 
+    /* Pods store fed by a list+watch of the API server */
+    int kube_meta_watch;
+    flb_sds_t kube_meta_watch_node_name;
+    int kube_meta_watch_timeout;
+    int kube_meta_watch_resync;
+    struct flb_kube_watch *watch;
+
+    /* Failed lookups are not retried until this TTL expires */
+    int kube_meta_negative_cache_ttl;
+    struct flb_hash_table *negative_hash_table;
+
+    /* The token is refreshed by the filter and the watch worker */
+    pthread_mutex_t token_lock;
+
     struct flb_tls *tls;
 
     struct flb_config *config;
@@ -37,6 +37,7 @@
 #include "kube_conf.h"
 #include "kube_meta.h"
 #include "kube_property.h"
+#include "kube_watch.h"
 
 #define FLB_KUBE_META_CONTAINER_STATUSES_KEY "containerStatuses"
 #define FLB_KUBE_META_CONTAINER_STATUSES_KEY_LEN \
@@ -46,6 +47,26 @@
     (sizeof(FLB_KUBE_META_INIT_CONTAINER_STATUSES_KEY) - 1)
 #define FLB_KUBE_TOKEN_BUF_SIZE 8192       /* 8KB */
 
+/* Length of the 'namespace:pod_name' prefix of the cache key */
+#define POD_KEY_LEN(meta) ((meta)->namespace_len + 1 + (meta)->podname_len)
+
+/*
+ * Header of the metadata cache entries. The entry holds the pod version
+ * (watch mode), the 'kubernetes' key followed by the metadata map, ready
+ * to be appended to the records as is, and the annotation properties.
+ */
+struct kube_meta_entry {
+    uint64_t version;
+    uint64_t fragment_size;
+};
+
+/* Pack the 'kubernetes' metadata key */
+static inline void pack_meta_key(msgpack_packer *mp_pck)
+{
+    msgpack_pack_str(mp_pck, 10);
+    msgpack_pack_str_body(mp_pck, "kubernetes", 10);
+}
+
 static int file_to_buffer(const char *path,
                           char **out_buf, size_t *out_size)
 {
@@ -224,6 +245,23 @@ static int refresh_token_if_needed(struct flb_kube *ctx)
     return 0;
 }
 
+/* Get a copy of the HTTP Auth Header, refreshing the token if needed */
+int flb_kube_meta_auth_get(struct flb_kube *ctx, flb_sds_t *auth)
+{
+    int ret;
+
+    *auth = NULL;
+
+    pthread_mutex_lock(&ctx->token_lock);
+    ret = refresh_token_if_needed(ctx);
+    if (ret == 0 && ctx->auth_len > 0) {
+        *auth = flb_sds_create_len(ctx->auth, ctx->auth_len);
+    }
+    pthread_mutex_unlock(&ctx->token_lock);
+
+    return ret;
+}
+
 static void expose_k8s_meta(struct flb_kube *ctx)
 {
     char *tmp;
@@ -369,8 +407,10 @@ static int get_meta_info_from_request(struct flb_kube *ctx,
         return -1;
     }
 
+    pthread_mutex_lock(&ctx->token_lock);
     ret = refresh_token_if_needed(ctx);
     if (ret == -1) {
+        pthread_mutex_unlock(&ctx->token_lock);
         flb_plg_error(ctx->ins, "failed to refresh token");
         return -1;
     }
@@ -386,6 +426,7 @@ static int get_meta_info_from_request(struct flb_kube *ctx,
     if (ctx->auth_len > 0) {
         flb_http_add_header(c, "Authorization", 13, ctx->auth, ctx->auth_len);
     }
+    pthread_mutex_unlock(&ctx->token_lock);
 
     ret = flb_http_do(c, &b_sent);
     flb_plg_debug(ctx->ins, "Request (ns=%s, pod=%s) http_do=%i, "
@@ -1329,23 +1370,58 @@ static inline int extract_meta(struct flb_kube *ctx,
  * and merge buffers.
  */
 static int get_and_merge_meta(struct flb_kube *ctx, struct flb_kube_meta *meta,
-                              char **out_buf, size_t *out_size)
+                              char **out_buf, size_t *out_size,
+                              uint64_t *version)
 {
     int ret;
     char *api_buf;
     size_t api_size;
+    void *tmp;
+    size_t tmp_size;
+
+    *version = 0;
 
     if (ctx->use_tag_for_meta) {
         ret = merge_meta_from_tag(ctx, meta, out_buf, out_size);
         return ret;
     }
-    else if (ctx->use_kubelet) {
-        ret = get_pods_from_kubelet(ctx, meta->namespace, meta->podname,
-                                    &api_buf, &api_size);
+
+    ret = -1;
+    if (ctx->watch && meta->cache_key &&
+        flb_kube_watch_is_synced(ctx->watch)) {
+        /* served from the pods store, no request is done */
+        ret = flb_kube_watch_pod_get(ctx->watch,
+                                     meta->cache_key, POD_KEY_LEN(meta),
+                                     &api_buf, &api_size, version);
+        if (ret == -1) {
+            /* the event is late or the stream lost it, ask for the pod */
+            flb_plg_debug(ctx->ins, "pod %s/%s is not in the store",
+                          meta->namespace, meta->podname);
+        }
     }
-    else {
-        ret = get_api_server_info(ctx, meta->namespace, meta->podname,
-                                  &api_buf, &api_size);
+
+    if (ret == -1) {
+        /* a recent request for this pod failed, don't retry it yet */
+        if (ctx->negative_hash_table && meta->cache_key &&
+            flb_hash_table_get(ctx->negative_hash_table,
+                               meta->cache_key, POD_KEY_LEN(meta),
+                               &tmp, &tmp_size) != -1) {
+            return -1;
+        }
+
+        if (ctx->use_kubelet) {
+            ret = get_pods_from_kubelet(ctx, meta->namespace, meta->podname,
+                                        &api_buf, &api_size);
+        }
+        else {
+            ret = get_api_server_info(ctx, meta->namespace, meta->podname,
+                                      &api_buf, &api_size);
+        }
+
+        if (ret == -1 && ctx->negative_hash_table && meta->cache_key) {
+            flb_hash_table_add(ctx->negative_hash_table,
+                               meta->cache_key, POD_KEY_LEN(meta), NULL, 0);
+        }
     }
     if (ret == -1) {
         return -1;
@@ -1450,6 +1526,15 @@ int flb_kube_meta_init(struct flb_kube *ctx, struct flb_config *config)
     /* Init network */
     flb_kube_network_init(ctx, config);
 
+    /* Keep the pods store updated in the background */
+    if (ctx->kube_meta_watch == FLB_TRUE) {
+        ctx->watch = flb_kube_watch_create(ctx, config);
+        if (!ctx->watch) {
+            flb_plg_warn(ctx->ins, "could not start the pods watch, "
+                         "metadata will be requested per pod");
+        }
+    }
+
     /* Gather local info */
     ret = get_local_pod_info(ctx);
     if (ret == FLB_TRUE && !ctx->use_tag_for_meta) {
@@ -1514,6 +1599,7 @@ int flb_kube_dummy_meta_get(char **out_buf, size_t *out_size)
     msgpack_sbuffer_init(&mp_sbuf);
     msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
 
+    pack_meta_key(&mp_pck);
     msgpack_pack_map(&mp_pck, 1);
     msgpack_pack_str(&mp_pck, 5 /* dummy */ );
     msgpack_pack_str_body(&mp_pck, "dummy", 5);
@@ -1535,11 +1621,16 @@ int flb_kube_meta_get(struct flb_kube *ctx,
 {
     int id;
     int ret;
+    uint64_t pod_version;
     const char *hash_meta_buf;
     char *tmp_hash_meta_buf;
     size_t off = 0;
+    size_t tmp_size;
     size_t hash_meta_size;
+    struct kube_meta_entry entry = {0};
     msgpack_unpacked result;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
 
     /* Get metadata from tag or record (cache key is the important one) */
     ret = extract_meta(ctx, tag, tag_len, data, data_size, meta);
@@ -1551,57 +1642,88 @@ int flb_kube_meta_get(struct flb_kube *ctx,
     ret = flb_hash_table_get(ctx->hash_table,
                              meta->cache_key, meta->cache_key_len,
                              (void *) &hash_meta_buf, &hash_meta_size);
+    if (ret != -1 && ctx->watch) {
+        /*
+         * Merge again if the pod changed since this entry was cached. Pods
+         * that left the store keep their last metadata.
+         */
+        memcpy(&entry, hash_meta_buf, sizeof(entry));
+        pod_version = flb_kube_watch_pod_version(ctx->watch, meta->cache_key,
+                                                 POD_KEY_LEN(meta));
+        if (pod_version != 0 && pod_version != entry.version) {
+            ret = -1;
+        }
+    }
+
     if (ret == -1) {
         /* Retrieve API server meta and merge with local meta */
         ret = get_and_merge_meta(ctx, meta,
-                                 &tmp_hash_meta_buf, &hash_meta_size);
+                                 &tmp_hash_meta_buf, &tmp_size,
+                                 &entry.version);
         if (ret == -1) {
             *out_buf = NULL;
             *out_size = 0;
             return 0;
         }
 
+        /* Size of the metadata map, the properties follow it */
+        msgpack_unpacked_init(&result);
+        msgpack_unpack_next(&result, tmp_hash_meta_buf, tmp_size, &off);
+        msgpack_unpacked_destroy(&result);
+
+        /* Compose the cache entry */
+        msgpack_sbuffer_init(&mp_sbuf);
+        msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+        entry.fragment_size = 0;
+        msgpack_sbuffer_write(&mp_sbuf, (char *) &entry, sizeof(entry));
+        pack_meta_key(&mp_pck);
+        msgpack_sbuffer_write(&mp_sbuf, tmp_hash_meta_buf, tmp_size);
+        flb_free(tmp_hash_meta_buf);
+
+        entry.fragment_size = mp_sbuf.size - sizeof(entry) - (tmp_size - off);
+        memcpy(mp_sbuf.data, &entry, sizeof(entry));
+
         id = flb_hash_table_add(ctx->hash_table,
                                 meta->cache_key, meta->cache_key_len,
-                                tmp_hash_meta_buf, hash_meta_size);
-        if (id >= 0) {
-            /*
-             * Release the original buffer created on extract_meta() as a new
-             * copy have been generated into the hash table, then re-set
-             * the outgoing buffer and size.
-             */
-            flb_free(tmp_hash_meta_buf);
-            flb_hash_table_get_by_id(ctx->hash_table, id, meta->cache_key,
-                                     &hash_meta_buf, &hash_meta_size);
+                                mp_sbuf.data, mp_sbuf.size);
+        if (id < 0) {
+            msgpack_sbuffer_destroy(&mp_sbuf);
+            *out_buf = NULL;
+            *out_size = 0;
+            return 0;
         }
+
+        /*
+         * Release the composed entry as a new copy have been generated into
+         * the hash table, then re-set the outgoing buffer and size.
+         */
+        msgpack_sbuffer_destroy(&mp_sbuf);
+        flb_hash_table_get_by_id(ctx->hash_table, id, meta->cache_key,
+                                 &hash_meta_buf, &hash_meta_size);
     }
 
+    memcpy(&entry, hash_meta_buf, sizeof(entry));
+    hash_meta_buf += sizeof(entry);
+    hash_meta_size -= sizeof(entry);
+
     /*
-     * The retrieved buffer may have two serialized items:
+     * The entry may have two serialized items:
      *
-     * [0] = kubernetes metadata (annotations, labels)
+     * [0] = 'kubernetes' key and metadata (annotations, labels)
      * [1] = Annotation properties
      *
      * note: annotation properties are optional.
      */
-    msgpack_unpacked_init(&result);
-
-    /* Unpack to get the offset/bytes of the first item */
-    msgpack_unpack_next(&result, hash_meta_buf, hash_meta_size, &off);
-
-    /* Set the pointer and proper size for the caller */
     *out_buf = hash_meta_buf;
-    *out_size = off;
+    *out_size = entry.fragment_size;
 
-    /* A new unpack_next() call will succeed If annotation properties exists */
-    ret = msgpack_unpack_next(&result, hash_meta_buf, hash_meta_size, &off);
-    if (ret == MSGPACK_UNPACK_SUCCESS) {
+    if (hash_meta_size > entry.fragment_size) {
         /* Unpack the remaining data into properties structure */
         flb_kube_prop_unpack(props,
-                             hash_meta_buf + *out_size,
-                             hash_meta_size - *out_size);
+                             hash_meta_buf + entry.fragment_size,
+                             hash_meta_size - entry.fragment_size);
     }
-    msgpack_unpacked_destroy(&result);
 
     return 0;
 }
@@ -20,6 +20,8 @@
 #ifndef FLB_FILTER_KUBE_META_H
 #define FLB_FILTER_KUBE_META_H
 
+#include <fluent-bit/flb_sds.h>
+
 #include "kube_props.h"
 
 struct flb_kube;
@@ -57,6 +59,10 @@ struct flb_kube_meta {
 
 int flb_kube_meta_init(struct flb_kube *ctx, struct flb_config *config);
 int flb_kube_meta_fetch(struct flb_kube *ctx);
+/*
+ * The metadata buffers returned by the getters hold the 'kubernetes' key
+ * followed by the metadata map, ready to be appended to a record map.
+ */
 int flb_kube_dummy_meta_get(char **out_buf, size_t *out_size);
 int flb_kube_meta_get(struct flb_kube *ctx,
                       const char *tag, int tag_len,
@@ -65,5 +71,6 @@ int flb_kube_meta_get(struct flb_kube *ctx,
                       struct flb_kube_meta *meta,
                       struct flb_kube_props *props);
 int flb_kube_meta_release(struct flb_kube_meta *meta);
+int flb_kube_meta_auth_get(struct flb_kube *ctx, flb_sds_t *auth);
 
 #endif
@@ -0,0 +1,896 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_filter_plugin.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_io.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_worker.h>
+#include <fluent-bit/flb_time.h>
+
+#include <msgpack.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+
+#include "kube_conf.h"
+#include "kube_meta.h"
+#include "kube_watch.h"
+
+/* State of the response of a watch request */
+struct watch_stream {
+    int headers;           /* the response headers were received */
+    int chunked;           /* chunked transfer encoding           */
+    size_t chunk_left;     /* bytes pending in the current chunk  */
+    int chunk_crlf;        /* CRLF after a chunk is pending       */
+    flb_sds_t raw;         /* data read from the connection       */
+    flb_sds_t body;        /* decoded body, one event per line    */
+};
+
+static int watch_is_running(struct flb_kube_watch *w)
+{
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    ret = w->running;
+    pthread_mutex_unlock(&w->lock);
+
+    return ret;
+}
+
+/* Wait before retrying, returns as soon as the worker is stopped */
+static void watch_wait(struct flb_kube_watch *w, int seconds)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += seconds;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->running) {
+        if (pthread_cond_timedwait(&w->cond, &w->lock, &ts) != 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+static msgpack_object *map_get(msgpack_object *map, const char *key)
+{
+    int i;
+    int len;
+    msgpack_object *k;
+
+    if (map->type != MSGPACK_OBJECT_MAP) {
+        return NULL;
+    }
+
+    len = strlen(key);
+    for (i = 0; i < map->via.map.size; i++) {
+        k = &map->via.map.ptr[i].key;
+        if (k->type == MSGPACK_OBJECT_STR && k->via.str.size == len &&
+            strncmp(k->via.str.ptr, key, len) == 0) {
+            return &map->via.map.ptr[i].val;
+        }
+    }
+
+    return NULL;
+}
+
+static flb_sds_t map_get_str(msgpack_object *map, const char *key)
+{
+    msgpack_object *v;
+
+    v = map_get(map, key);
+    if (!v || v->type != MSGPACK_OBJECT_STR) {
+        return NULL;
+    }
+
+    return flb_sds_create_len(v->via.str.ptr, v->via.str.size);
+}
+
+/* Compose the 'namespace:pod_name' store key of a Pod object */
+static flb_sds_t pod_key(msgpack_object *pod)
+{
+    msgpack_object *meta;
+    msgpack_object *name;
+    msgpack_object *ns;
+    flb_sds_t key;
+
+    meta = map_get(pod, "metadata");
+    if (!meta) {
+        return NULL;
+    }
+
+    name = map_get(meta, "name");
+    ns = map_get(meta, "namespace");
+    if (!name || !ns ||
+        name->type != MSGPACK_OBJECT_STR || ns->type != MSGPACK_OBJECT_STR) {
+        return NULL;
+    }
+
+    key = flb_sds_create_size(ns->via.str.size + name->via.str.size + 1);
+    if (!key) {
+        return NULL;
+    }
+    flb_sds_cat_safe(&key, ns->via.str.ptr, ns->via.str.size);
+    flb_sds_cat_safe(&key, ":", 1);
+    flb_sds_cat_safe(&key, name->via.str.ptr, name->via.str.size);
+
+    return key;
+}
+
+/* Store a Pod object, the caller holds the lock */
+static int pod_store(struct flb_kube_watch *w, struct flb_hash_table *table,
+                     msgpack_object *pod)
+{
+    int ret;
+    uint64_t version;
+    flb_sds_t key;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+
+    key = pod_key(pod);
+    if (!key) {
+        return -1;
+    }
+
+    version = ++w->version;
+
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+    msgpack_sbuffer_write(&sbuf, (const char *) &version, sizeof(version));
+    msgpack_pack_object(&pck, *pod);
+
+    ret = flb_hash_table_add(table, key, flb_sds_len(key),
+                             sbuf.data, sbuf.size);
+    msgpack_sbuffer_destroy(&sbuf);
+    flb_sds_destroy(key);
+
+    return (ret >= 0) ? 0 : -1;
+}
+
+static void pod_delete(struct flb_kube_watch *w, msgpack_object *pod)
+{
+    flb_sds_t key;
+
+    key = pod_key(pod);
+    if (!key) {
+        return;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    flb_hash_table_del(w->pods, key);
+    pthread_mutex_unlock(&w->lock);
+
+    flb_sds_destroy(key);
+}
+
+static void set_resource_version(struct flb_kube_watch *w, flb_sds_t rv)
+{
+    if (w->resource_version) {
+        flb_sds_destroy(w->resource_version);
+    }
+    w->resource_version = rv;
+}
+
+static int set_auth_header(struct flb_kube_watch *w, struct flb_http_client *c)
+{
+    int ret;
+    flb_sds_t auth = NULL;
+
+    ret = flb_kube_meta_auth_get(w->ctx, &auth);
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (auth) {
+        flb_http_add_header(c, "Authorization", 13, auth, flb_sds_len(auth));
+        flb_sds_destroy(auth);
+    }
+
+    return 0;
+}
+
+/*
+ * List the pods and replace the content of the store: the pods deleted
+ * while the watch was not running are dropped too.
+ */
+static int watch_list(struct flb_kube_watch *w)
+{
+    int i;
+    int ret;
+    int root_type;
+    size_t off = 0;
+    size_t size;
+    size_t b_sent;
+    char *buf;
+    flb_sds_t uri;
+    flb_sds_t rv = NULL;
+    msgpack_object *meta;
+    msgpack_object *items = NULL;
+    msgpack_unpacked result;
+    struct flb_hash_table *table;
+    struct flb_hash_table *old;
+    struct flb_connection *u_conn;
+    struct flb_http_client *c;
+    struct flb_kube *ctx = w->ctx;
+
+    uri = flb_sds_create(FLB_KUBE_WATCH_URI);
+    if (!uri) {
+        return -1;
+    }
+    if (w->selector) {
+        flb_sds_printf(&uri, "?fieldSelector=%s", w->selector);
+    }
+
+    u_conn = flb_upstream_conn_get(w->upstream);
+    if (!u_conn) {
+        flb_plg_error(ctx->ins, "watch: upstream connection error");
+        flb_sds_destroy(uri);
+        return -1;
+    }
+
+    c = flb_http_client(u_conn, FLB_HTTP_GET, uri, NULL, 0, NULL, 0, NULL, 0);
+    flb_sds_destroy(uri);
+    if (!c) {
+        flb_upstream_conn_release(u_conn);
+        return -1;
+    }
+
+    /* the list holds every pod of the node */
+    flb_http_buffer_size(c, 0);
+    flb_http_add_header(c, "User-Agent", 10, "Fluent-Bit", 10);
+    flb_http_add_header(c, "Connection", 10, "close", 5);
+    set_auth_header(w, c);
+
+    ret = flb_http_do(c, &b_sent);
+    if (ret != 0 || c->resp.status != 200) {
+        flb_plg_warn(ctx->ins, "watch: pods list failed, http_do=%i "
+                     "HTTP Status: %i", ret, c->resp.status);
+        flb_http_client_destroy(c);
+        flb_upstream_conn_release(u_conn);
+        return -1;
+    }
+
+    ret = flb_pack_json(c->resp.payload, c->resp.payload_size,
+                        &buf, &size, &root_type);
+    flb_http_client_destroy(c);
+    flb_upstream_conn_release(u_conn);
+    if (ret != 0) {
+        flb_plg_error(ctx->ins, "watch: invalid pods list");
+        return -1;
+    }
+
+    table = flb_hash_table_create(FLB_HASH_TABLE_EVICT_NONE,
+                                  FLB_KUBE_WATCH_TABLE_SIZE, 0);
+    if (!table) {
+        flb_free(buf);
+        return -1;
+    }
+
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, buf, size, &off);
+    if (ret == MSGPACK_UNPACK_SUCCESS) {
+        meta = map_get(&result.data, "metadata");
+        if (meta) {
+            rv = map_get_str(meta, "resourceVersion");
+        }
+        items = map_get(&result.data, "items");
+    }
+
+    if (ret != MSGPACK_UNPACK_SUCCESS || !rv ||
+        !items || items->type != MSGPACK_OBJECT_ARRAY) {
+        flb_plg_error(ctx->ins, "watch: invalid pods list");
+        msgpack_unpacked_destroy(&result);
+        flb_hash_table_destroy(table);
+        flb_sds_destroy(rv);
+        flb_free(buf);
+        return -1;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    for (i = 0; i < items->via.array.size; i++) {
+        pod_store(w, table, &items->via.array.ptr[i]);
+    }
+    old = w->pods;
+    w->pods = table;
+    w->synced = FLB_TRUE;
+    pthread_mutex_unlock(&w->lock);
+
+    w->list_time = time(NULL);
+
+    flb_plg_info(ctx->ins, "watch: %i pods loaded, resourceVersion=%s",
+                 table->total_count, rv);
+
+    set_resource_version(w, rv);
+    flb_hash_table_destroy(old);
+    msgpack_unpacked_destroy(&result);
+    flb_free(buf);
+
+    return 0;
+}
+
+/*
+ * Process one watch event:
+ *
+ *   {"type": "ADDED|MODIFIED|DELETED|BOOKMARK|ERROR", "object": {...}}
+ *
+ * Returns -1 if the watch must be restarted from a new list.
+ */
+static int watch_event(struct flb_kube_watch *w, char *json, size_t len)
+{
+    int ret;
+    int root_type;
+    size_t off = 0;
+    size_t size;
+    char *buf;
+    flb_sds_t type = NULL;
+    flb_sds_t rv = NULL;
+    msgpack_object *obj = NULL;
+    msgpack_object *meta;
+    msgpack_object *code;
+    msgpack_unpacked result;
+    struct flb_kube *ctx = w->ctx;
+
+    ret = flb_pack_json(json, len, &buf, &size, &root_type);
+    if (ret != 0) {
+        flb_plg_warn(ctx->ins, "watch: invalid event");
+        return 0;
+    }
+
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, buf, size, &off);
+    if (ret == MSGPACK_UNPACK_SUCCESS) {
+        type = map_get_str(&result.data, "type");
+        obj = map_get(&result.data, "object");
+    }
+
+    if (!type || !obj || obj->type != MSGPACK_OBJECT_MAP) {
+        flb_plg_warn(ctx->ins, "watch: invalid event");
+        ret = 0;
+        goto exit;
+    }
+
+    if (strcmp(type, "ERROR") == 0) {
+        /* 410 Gone: the resource version is too old */
+        code = map_get(obj, "code");
+        flb_plg_debug(ctx->ins, "watch: error event, code=%" PRIi64,
+                      (code && code->type == MSGPACK_OBJECT_POSITIVE_INTEGER) ?
+                      (int64_t) code->via.u64 : -1);
+        ret = -1;
+        goto exit;
+    }
+
+    meta = map_get(obj, "metadata");
+    if (meta) {
+        rv = map_get_str(meta, "resourceVersion");
+    }
+
+    if (strcmp(type, "ADDED") == 0 || strcmp(type, "MODIFIED") == 0) {
+        pthread_mutex_lock(&w->lock);
+        pod_store(w, w->pods, obj);
+        pthread_mutex_unlock(&w->lock);
+    }
+    else if (strcmp(type, "DELETED") == 0) {
+        pod_delete(w, obj);
+    }
+
+    if (rv) {
+        set_resource_version(w, rv);
+        rv = NULL;
+    }
+    ret = 0;
+
+exit:
+    if (type) {
+        flb_sds_destroy(type);
+    }
+    msgpack_unpacked_destroy(&result);
+    flb_free(buf);
+
+    return ret;
+}
+
+static void stream_consume(flb_sds_t buf, size_t bytes)
+{
+    size_t len = flb_sds_len(buf);
+
+    if (bytes < len) {
+        memmove(buf, buf + bytes, len - bytes);
+    }
+    flb_sds_len_set(buf, len - bytes);
+    buf[flb_sds_len(buf)] = '\0';
+}
+
+/* Parse the response headers, returns 1 once they are complete */
+static int stream_headers(struct flb_kube_watch *w, struct watch_stream *s)
+{
+    int status;
+    char *end;
+    char *p;
+    struct flb_kube *ctx = w->ctx;
+
+    end = strstr(s->raw, "\r\n\r\n");
+    if (!end) {
+        return 0;
+    }
+    *end = '\0';
+
+    if (sscanf(s->raw, "HTTP/1.%*c %i", &status) != 1) {
+        flb_plg_error(ctx->ins, "watch: invalid response");
+        return -1;
+    }
+    if (status != 200) {
+        flb_plg_warn(ctx->ins, "watch: HTTP Status: %i", status);
+        return (status == 410) ? -2 : -1;
+    }
+
+    for (p = s->raw; *p; p++) {
+        *p = tolower(*p);
+    }
+    if (strstr(s->raw, "\r\ntransfer-encoding: chunked")) {
+        s->chunked = FLB_TRUE;
+    }
+
+    stream_consume(s->raw, (end - s->raw) + 4);
+    s->headers = FLB_TRUE;
+
+    return 1;
+}
+
+/*
+ * Move the available content from the raw buffer to the body, removing
+ * the chunked encoding if any. Returns 1 at the end of the stream.
+ */
+static int stream_body(struct watch_stream *s)
+{
+    size_t n;
+    char *p;
+    char *end;
+    long size;
+
+    if (!s->chunked) {
+        flb_sds_cat_safe(&s->body, s->raw, flb_sds_len(s->raw));
+        stream_consume(s->raw, flb_sds_len(s->raw));
+        return 0;
+    }
+
+    while (1) {
+        if (s->chunk_left > 0) {
+            n = flb_sds_len(s->raw);
+            if (n > s->chunk_left) {
+                n = s->chunk_left;
+            }
+            flb_sds_cat_safe(&s->body, s->raw, n);
+            stream_consume(s->raw, n);
+            s->chunk_left -= n;
+            if (s->chunk_left > 0) {
+                return 0;
+            }
+            s->chunk_crlf = FLB_TRUE;
+        }
+
+        if (s->chunk_crlf) {
+            if (flb_sds_len(s->raw) < 2) {
+                return 0;
+            }
+            stream_consume(s->raw, 2);
+            s->chunk_crlf = FLB_FALSE;
+        }
+
+        p = strstr(s->raw, "\r\n");
+        if (!p) {
+            return 0;
+        }
+
+        size = strtol(s->raw, &end, 16);
+        if (end == s->raw || size < 0) {
+            return -1;
+        }
+        stream_consume(s->raw, (p - s->raw) + 2);
+
+        if (size == 0) {
+            return 1;
+        }
+        s->chunk_left = size;
+    }
+}
+
+/* Process the complete events (lines) of the body */
+static int stream_events(struct flb_kube_watch *w, struct watch_stream *s)
+{
+    int ret;
+    char *p;
+    size_t len;
+    struct flb_kube *ctx = w->ctx;
+
+    while ((p = memchr(s->body, '\n', flb_sds_len(s->body)))) {
+        len = p - s->body;
+        if (len > 0) {
+            ret = watch_event(w, s->body, len);
+            if (ret == -1) {
+                return -1;
+            }
+        }
+        stream_consume(s->body, len + 1);
+    }
+
+    if (ctx->buffer_size > 0 && flb_sds_len(s->body) > ctx->buffer_size) {
+        flb_plg_error(ctx->ins, "watch: event exceeds buffer_size (%zu bytes)",
+                      ctx->buffer_size);
+        return -1;
+    }
+
+    return 0;
+}
+
+static flb_sds_t watch_request(struct flb_kube_watch *w)
+{
+    flb_sds_t req;
+    flb_sds_t auth = NULL;
+    struct flb_kube *ctx = w->ctx;
+
+    if (flb_kube_meta_auth_get(ctx, &auth) == -1) {
+        auth = NULL;
+    }
+
+    req = flb_sds_create_size(512);
+    if (!req) {
+        flb_sds_destroy(auth);
+        return NULL;
+    }
+
+    flb_sds_printf(&req,
+                   "GET " FLB_KUBE_WATCH_URI "?watch=1&allowWatchBookmarks=true"
+                   "&timeoutSeconds=%i&resourceVersion=%s%s%s HTTP/1.1\r\n"
+                   "Host: %s:%i\r\n"
+                   "User-Agent: Fluent-Bit\r\n"
+                   "Accept: application/json\r\n"
+                   "Connection: close\r\n",
+                   ctx->kube_meta_watch_timeout, w->resource_version,
+                   w->selector ? "&fieldSelector=" : "",
+                   w->selector ? w->selector : "",
+                   ctx->api_host, ctx->api_port);
+    if (auth) {
+        flb_sds_printf(&req, "Authorization: %s\r\n", auth);
+        flb_sds_destroy(auth);
+    }
+    flb_sds_cat_safe(&req, "\r\n", 2);
+
+    return req;
+}
+
+/*
+ * Follow the changes from the last resource version until the server ends
+ * the stream. Returns 0 to watch again, -1 on error or -2 if a new list is
+ * required.
+ */
+static int watch_stream(struct flb_kube_watch *w)
+{
+    int ret;
+    ssize_t n;
+    size_t sent;
+    char tmp[4096];
+    flb_sds_t req;
+    struct watch_stream s = {0};
+    struct flb_connection *u_conn;
+    struct flb_kube *ctx = w->ctx;
+
+    req = watch_request(w);
+    if (!req) {
+        return -1;
+    }
+
+    u_conn = flb_upstream_conn_get(w->upstream);
+    if (!u_conn) {
+        flb_plg_error(ctx->ins, "watch: upstream connection error");
+        flb_sds_destroy(req);
+        return -1;
+    }
+
+    /* register the connection so it can be interrupted on exit */
+    pthread_mutex_lock(&w->lock);
+    if (!w->running) {
+        pthread_mutex_unlock(&w->lock);
+        flb_sds_destroy(req);
+        flb_upstream_conn_release(u_conn);
+        return 0;
+    }
+    w->conn = u_conn;
+    pthread_mutex_unlock(&w->lock);
+
+    ret = flb_io_net_write(u_conn, req, flb_sds_len(req), &sent);
+    flb_sds_destroy(req);
+
+    s.raw = flb_sds_create_size(sizeof(tmp));
+    s.body = flb_sds_create_size(sizeof(tmp));
+    if (ret == -1 || !s.raw || !s.body) {
+        ret = -1;
+        goto exit;
+    }
+
+    ret = -1;
+    while ((n = flb_io_net_read(u_conn, tmp, sizeof(tmp))) > 0) {
+        flb_sds_cat_safe(&s.raw, tmp, n);
+
+        if (!s.headers) {
+            ret = stream_headers(w, &s);
+            if (ret == 0) {
+                continue;
+            }
+            else if (ret < 0) {
+                break;
+            }
+        }
+
+        ret = stream_body(&s);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "watch: invalid chunked encoding");
+            break;
+        }
+        else if (ret == 1) {
+            /* clean end of the stream */
+            stream_events(w, &s);
+            ret = 0;
+            break;
+        }
+
+        ret = stream_events(w, &s);
+        if (ret == -1) {
+            ret = -2;
+            break;
+        }
+    }
+
+    /* the server closed a non chunked stream, or it stopped talking */
+    if (n <= 0 && s.headers) {
+        if (n == -1 && watch_is_running(w)) {
+            flb_plg_debug(ctx->ins, "watch: stream interrupted or silent "
+                          "for %i seconds, watching again",
+                          u_conn->net->io_timeout);
+        }
+        ret = 0;
+    }
+
+exit:
+    pthread_mutex_lock(&w->lock);
+    w->conn = NULL;
+    pthread_mutex_unlock(&w->lock);
+
+    flb_upstream_conn_release(u_conn);
+    flb_sds_destroy(s.raw);
+    flb_sds_destroy(s.body);
+
+    return ret;
+}
+
+static void watch_worker(void *data)
+{
+    int ret;
+    struct flb_kube_watch *w = data;
+    struct flb_kube *ctx = w->ctx;
+
+    while (watch_is_running(w)) {
+        /* do not trust the stream forever, load the whole list again */
+        if (w->resource_version && ctx->kube_meta_watch_resync > 0 &&
+            time(NULL) - w->list_time >= ctx->kube_meta_watch_resync) {
+            flb_plg_debug(ctx->ins, "watch: resync, listing the pods again");
+            set_resource_version(w, NULL);
+        }
+
+        if (!w->resource_version) {
+            ret = watch_list(w);
+            if (ret == -1) {
+                watch_wait(w, FLB_KUBE_WATCH_RETRY);
+                continue;
+            }
+        }
+
+        ret = watch_stream(w);
+        if (ret == -2) {
+            flb_plg_debug(ctx->ins, "watch: resource version %s is too old",
+                          w->resource_version);
+            set_resource_version(w, NULL);
+        }
+        else if (ret == -1 && watch_is_running(w)) {
+            watch_wait(w, FLB_KUBE_WATCH_RETRY);
+        }
+    }
+}
+
+struct flb_kube_watch *flb_kube_watch_create(struct flb_kube *ctx,
+                                             struct flb_config *config)
+{
+    int ret;
+    int io_type = FLB_IO_TCP;
+    struct flb_kube_watch *w;
+
+    w = flb_calloc(1, sizeof(struct flb_kube_watch));
+    if (!w) {
+        flb_errno();
+        return NULL;
+    }
+    w->ctx = ctx;
+    w->running = FLB_TRUE;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+
+    if (ctx->kube_meta_watch_node_name) {
+        w->selector = flb_sds_create("spec.nodeName%3D");
+        flb_sds_cat_safe(&w->selector, ctx->kube_meta_watch_node_name,
+                         flb_sds_len(ctx->kube_meta_watch_node_name));
+    }
+
+    w->pods = flb_hash_table_create(FLB_HASH_TABLE_EVICT_NONE,
+                                    FLB_KUBE_WATCH_TABLE_SIZE, 0);
+    if (!w->pods) {
+        flb_kube_watch_destroy(w);
+        return NULL;
+    }
+
+    /* The stream is long lived, it gets its own blocking upstream */
+    if (ctx->api_https == FLB_TRUE) {
+        io_type = FLB_IO_TLS;
+    }
+    w->upstream = flb_upstream_create(config, ctx->api_host, ctx->api_port,
+                                      io_type, ctx->tls);
+    if (!w->upstream) {
+        flb_kube_watch_destroy(w);
+        return NULL;
+    }
+    flb_stream_disable_async_mode(&w->upstream->base);
+    w->upstream->base.net.keepalive = FLB_FALSE;
+
+    /*
+     * The server ends every watch after kube_meta_watch_timeout seconds and
+     * sends bookmarks meanwhile: a read blocked for twice that long is on a
+     * half-open connection, drop it and watch again from the last version.
+     */
+    w->upstream->base.net.io_timeout = ctx->kube_meta_watch_timeout * 2;
+
+    /*
+     * Only the worker uses this upstream: unlink it from the engine list so
+     * the timeouts handler does not walk its queues from the engine thread.
+     * The io_timeout is enforced by the socket receive timeout instead.
+     */
+    flb_upstream_thread_safe(w->upstream);
+    mk_list_init(&w->upstream->base._head);
+
+    ret = flb_worker_create(watch_worker, w, &w->tid, config);
+    if (ret == -1) {
+        flb_plg_error(ctx->ins, "watch: could not start worker");
+        flb_kube_watch_destroy(w);
+        return NULL;
+    }
+    w->started = FLB_TRUE;
+
+    flb_plg_info(ctx->ins, "watching pods%s%s",
+                 ctx->kube_meta_watch_node_name ? " on node " : "",
+                 ctx->kube_meta_watch_node_name ?
+                 ctx->kube_meta_watch_node_name : "");
+
+    return w;
+}
+
+void flb_kube_watch_destroy(struct flb_kube_watch *w)
+{
+    if (!w) {
+        return;
+    }
+
+    /* stop the worker, interrupting the stream it might be reading */
+    if (w->started) {
+        pthread_mutex_lock(&w->lock);
+        w->running = FLB_FALSE;
+        if (w->conn) {
+            shutdown(w->conn->fd, SHUT_RDWR);
+        }
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+
+        pthread_join(w->tid, NULL);
+    }
+
+    if (w->upstream) {
+        flb_upstream_destroy(w->upstream);
+    }
+    if (w->pods) {
+        flb_hash_table_destroy(w->pods);
+    }
+    if (w->resource_version) {
+        flb_sds_destroy(w->resource_version);
+    }
+    if (w->selector) {
+        flb_sds_destroy(w->selector);
+    }
+
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    flb_free(w);
+}
+
+int flb_kube_watch_is_synced(struct flb_kube_watch *w)
+{
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    ret = w->synced;
+    pthread_mutex_unlock(&w->lock);
+
+    return ret;
+}
+
+/* Return the version of a pod, 0 if it's not in the store */
+uint64_t flb_kube_watch_pod_version(struct flb_kube_watch *w,
+                                    const char *key, int key_len)
+{
+    int ret;
+    void *buf;
+    size_t size;
+    uint64_t version = 0;
+
+    pthread_mutex_lock(&w->lock);
+    ret = flb_hash_table_get(w->pods, key, key_len, &buf, &size);
+    if (ret != -1 && size > sizeof(uint64_t)) {
+        memcpy(&version, buf, sizeof(uint64_t));
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return version;
+}
+
+/* Get a copy of the msgpack Pod object and its version */
+int flb_kube_watch_pod_get(struct flb_kube_watch *w,
+                           const char *key, int key_len,
+                           char **out_buf, size_t *out_size,
+                           uint64_t *version)
+{
+    int ret;
+    void *buf;
+    size_t size;
+    char *copy = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    ret = flb_hash_table_get(w->pods, key, key_len, &buf, &size);
+    if (ret != -1 && size > sizeof(uint64_t)) {
+        memcpy(version, buf, sizeof(uint64_t));
+        size -= sizeof(uint64_t);
+        copy = flb_malloc(size);
+        if (copy) {
+            memcpy(copy, (char *) buf + sizeof(uint64_t), size);
+        }
+        else {
+            flb_errno();
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (!copy) {
+        return -1;
+    }
+
+    *out_buf = copy;
+    *out_size = size;
+
+    return 0;
+}
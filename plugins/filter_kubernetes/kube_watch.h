@@ -0,0 +1,81 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_FILTER_KUBE_WATCH_H
+#define FLB_FILTER_KUBE_WATCH_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_hash_table.h>
+#include <fluent-bit/flb_sds.h>
+
+#include <pthread.h>
+#include <time.h>
+
+#define FLB_KUBE_WATCH_URI        "/api/v1/pods"
+#define FLB_KUBE_WATCH_TIMEOUT    60    /* server side timeout of a watch */
+#define FLB_KUBE_WATCH_RETRY      5     /* seconds to wait after an error */
+#define FLB_KUBE_WATCH_TABLE_SIZE 512
+
+struct flb_kube;
+
+/*
+ * Pod metadata store. A worker thread lists the pods of the node and then
+ * follows the changes through a watch stream, so the filter can serve the
+ * lookups without doing any request.
+ *
+ * Every pod is stored under the 'namespace:pod_name' key, the value is the
+ * msgpack Pod object prefixed by a 64 bits version number that changes
+ * every time the pod is updated.
+ *
+ * A stream that stays silent twice as long as the requested watch timeout
+ * is considered dead and restarted, and the whole list is loaded again
+ * every 'kube_meta_watch_resync' seconds.
+ */
+struct flb_kube_watch {
+    int started;                   /* the worker thread was created    */
+    int running;                   /* worker keeps running while true  */
+    int synced;                    /* the initial list was loaded      */
+    uint64_t version;              /* last version assigned            */
+    time_t list_time;              /* when the last list was loaded    */
+    flb_sds_t resource_version;    /* where the watch resumes from     */
+    flb_sds_t selector;            /* fieldSelector, if any            */
+    struct flb_hash_table *pods;   /* pods store                       */
+    struct flb_connection *conn;   /* active watch stream              */
+    struct flb_upstream *upstream;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct flb_kube *ctx;
+};
+
+struct flb_kube_watch *flb_kube_watch_create(struct flb_kube *ctx,
+                                             struct flb_config *config);
+void flb_kube_watch_destroy(struct flb_kube_watch *w);
+
+int flb_kube_watch_is_synced(struct flb_kube_watch *w);
+uint64_t flb_kube_watch_pod_version(struct flb_kube_watch *w,
+                                    const char *key, int key_len);
+int flb_kube_watch_pod_get(struct flb_kube_watch *w,
+                           const char *key, int key_len,
+                           char **out_buf, size_t *out_size,
+                           uint64_t *version);
+
+#endif
@@ -24,6 +24,7 @@
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_parser.h>
 #include <fluent-bit/flb_unescape.h>
+#include <fluent-bit/flb_log_event_decoder.h>
 
 #include "kube_conf.h"
 #include "kube_meta.h"
@@ -417,21 +418,53 @@ static int pack_map_content(msgpack_packer *pck, msgpack_sbuffer *sbuf,
         }
     }
 
-    /* Kubernetes */
+    /* Kubernetes: the key and metadata map are already serialized */
     if (kube_buf && kube_size > 0) {
-        msgpack_pack_str(pck, 10);
-        msgpack_pack_str_body(pck, "kubernetes", 10);
-
-        off = 0;
-        msgpack_unpacked_init(&result);
-        msgpack_unpack_next(&result, kube_buf, kube_size, &off);
-        msgpack_pack_object(pck, result.data);
-        msgpack_unpacked_destroy(&result);
+        msgpack_sbuffer_write(sbuf, kube_buf, kube_size);
     }
 
     return 0;
 }
 
+/*
+ * Append the metadata to a record that does not need any other change: the
+ * map header is patched with the new size and the original content is
+ * copied as is.
+ */
+static void pack_map_raw(msgpack_packer *pck, msgpack_sbuffer *sbuf,
+                         struct flb_log_event *event,
+                         const char *kube_buf, size_t kube_size)
+{
+    size_t hdr;
+    size_t entries;
+    unsigned char c;
+
+    c = (unsigned char) event->body_raw[0];
+    if (c == 0xde) {
+        hdr = 3;
+    }
+    else if (c == 0xdf) {
+        hdr = 5;
+    }
+    else {
+        hdr = 1;
+    }
+
+    entries = event->body_entries;
+    if (kube_buf && kube_size > 0) {
+        entries++;
+    }
+
+    flb_time_append_to_msgpack(&event->timestamp, pck, 0);
+    msgpack_pack_map(pck, entries);
+    msgpack_sbuffer_write(sbuf, event->body_raw + hdr,
+                          event->body_raw_size - hdr);
+
+    if (kube_buf && kube_size > 0) {
+        msgpack_sbuffer_write(sbuf, kube_buf, kube_size);
+    }
+}
+
 static int cb_kube_filter(const void *data, size_t bytes,
                           const char *tag, int tag_len,
                           void **out_buf, size_t *out_bytes,
@@ -441,22 +474,19 @@ static int cb_kube_filter(const void *data, size_t bytes,
                           struct flb_config *config)
 {
     int ret;
-    size_t pre = 0;
-    size_t off = 0;
+    int stream;
     char *dummy_cache_buf = NULL;
     const char *cache_buf = NULL;
     size_t cache_size = 0;
-    msgpack_unpacked result;
-    msgpack_object map;
-    msgpack_object root;
+    msgpack_object *map;
     msgpack_sbuffer tmp_sbuf;
     msgpack_packer tmp_pck;
-    msgpack_object *obj;
     struct flb_parser *parser = NULL;
     struct flb_kube *ctx = filter_context;
     struct flb_kube_meta meta = {0};
     struct flb_kube_props props = {0};
-    struct flb_time time_lookup;
+    struct flb_log_event event;
+    struct flb_log_event_decoder decoder;
     (void) f_ins;
     (void) i_ins;
     (void) config;
@@ -478,22 +508,23 @@ static int cb_kube_filter(const void *data, size_t bytes,
         }
     }
 
+    ret = flb_log_event_decoder_init(&decoder, (char *) data, bytes);
+    if (ret != 0) {
+        if (ctx->dummy_meta == FLB_TRUE) {
+            flb_free(dummy_cache_buf);
+        }
+        flb_kube_meta_release(&meta);
+        flb_kube_prop_destroy(&props);
+        return FLB_FILTER_NOTOUCH;
+    }
+
     /* Create temporary msgpack buffer */
     msgpack_sbuffer_init(&tmp_sbuf);
     msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
 
     /* Iterate each item array and append meta */
-    msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
-        root = result.data;
-
-        if (root.type != MSGPACK_OBJECT_ARRAY ||
-            root.via.array.size != 2 ||
-            root.via.array.ptr[1].type != MSGPACK_OBJECT_MAP) {
-            flb_plg_warn(ctx->ins, "unexpected record format");
-            continue;
-        }
-
+    while (flb_log_event_decoder_next(&decoder, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
         /*
          * Journal entries can be origined by different Pods, so we are forced
          * to parse and check it metadata.
@@ -504,18 +535,38 @@ static int cb_kube_filter(const void *data, size_t bytes,
         if (ctx->use_journal == FLB_TRUE && ctx->dummy_meta == FLB_FALSE) {
             ret = flb_kube_meta_get(ctx,
                                     tag, tag_len,
-                                    (char *) data + pre, off - pre,
+                                    event.raw, event.raw_size,
                                     &cache_buf, &cache_size, &meta, &props);
             if (ret == -1) {
                 continue;
             }
+        }
 
-            pre = off;
+        /*
+         * The record content is only required to merge the 'log' key or to
+         * apply the stream properties suggested by the Pod annotations.
+         */
+        map = NULL;
+        stream = FLB_KUBE_PROP_NO_STREAM;
+        if (ctx->merge_log == FLB_TRUE ||
+            props.stdout_parser || props.stderr_parser ||
+            props.stdout_exclude == FLB_TRUE ||
+            props.stderr_exclude == FLB_TRUE) {
+            map = flb_log_event_decoder_get_body(&decoder, &event);
+            if (!map) {
+                flb_plg_warn(ctx->ins, "unexpected record format");
+                if (ctx->use_journal == FLB_TRUE) {
+                    flb_kube_meta_release(&meta);
+                    flb_kube_prop_destroy(&props);
+                }
+                continue;
+            }
+            stream = get_stream(map->via.map);
         }
 
         parser = NULL;
 
-        switch (get_stream(root.via.array.ptr[1].via.map)) {
+        switch (stream) {
         case FLB_KUBE_PROP_STREAM_STDOUT:
             {
                 if (props.stdout_exclude == FLB_TRUE) {
@@ -560,33 +611,28 @@ static int cb_kube_filter(const void *data, size_t bytes,
             break;
         }
 
-        /*
-         * Temporal time lookup in case a parser comes up with a new
-         * timestamp for the record.
-         */
-        flb_time_pop_from_msgpack(&time_lookup, &result, &obj);
-
-        /* get records map */
-        map  = root.via.array.ptr[1];
-
         /* Compose the new array (0=timestamp, 1=record) */
         msgpack_pack_array(&tmp_pck, 2);
 
+        if (!map) {
+            pack_map_raw(&tmp_pck, &tmp_sbuf, &event, cache_buf, cache_size);
+        }
+        else {
+            ret = pack_map_content(&tmp_pck, &tmp_sbuf,
+                                   *map,
+                                   cache_buf, cache_size,
+                                   &meta, &event.timestamp, parser, ctx);
+            if (ret == -1) {
+                msgpack_sbuffer_destroy(&tmp_sbuf);
+                flb_log_event_decoder_destroy(&decoder);
+                if (ctx->dummy_meta == FLB_TRUE) {
+                    flb_free(dummy_cache_buf);
+                }
 
-        ret = pack_map_content(&tmp_pck, &tmp_sbuf,
-                               map,
-                               cache_buf, cache_size,
-                               &meta, &time_lookup, parser, ctx);
-        if (ret == -1) {
-            msgpack_sbuffer_destroy(&tmp_sbuf);
-            msgpack_unpacked_destroy(&result);
-            if (ctx->dummy_meta == FLB_TRUE) {
-                flb_free(dummy_cache_buf);
+                flb_kube_meta_release(&meta);
+                flb_kube_prop_destroy(&props);
+                return FLB_FILTER_NOTOUCH;
             }
-
-            flb_kube_meta_release(&meta);
-            flb_kube_prop_destroy(&props);
-            return FLB_FILTER_NOTOUCH;
         }
 
         if (ctx->use_journal == FLB_TRUE) {
@@ -594,7 +640,7 @@ static int cb_kube_filter(const void *data, size_t bytes,
             flb_kube_prop_destroy(&props);
         }
     }
-    msgpack_unpacked_destroy(&result);
+    flb_log_event_decoder_destroy(&decoder);
 
     /* Release meta fields */
     if (ctx->use_journal == FLB_FALSE) {
@@ -881,6 +927,41 @@ static struct flb_config_map config_map[] = {
      "For example, set this value to 60 or 60s and cache entries " 
      "which have been created more than 60s will be evicted"
     },
+    /*
+     * Keep a local store of the pods updated through a list+watch of the
+     * API server, lookups are served from it without doing requests.
+     */
+    {
+     FLB_CONFIG_MAP_BOOL, "kube_meta_watch", "false",
+     0, FLB_TRUE, offsetof(struct flb_kube, kube_meta_watch),
+     "watch the pods through the API server and serve the metadata from a "
+     "local store instead of requesting it for every new pod"
+    },
+    {
+     FLB_CONFIG_MAP_STR, "kube_meta_watch_node_name", NULL,
+     0, FLB_TRUE, offsetof(struct flb_kube, kube_meta_watch_node_name),
+     "only watch the pods scheduled on this node, e.g: ${NODE_NAME}. If it's "
+     "not set every pod of the cluster is watched"
+    },
+    {
+     FLB_CONFIG_MAP_TIME, "kube_meta_watch_timeout", "60s",
+     0, FLB_TRUE, offsetof(struct flb_kube, kube_meta_watch_timeout),
+     "server side timeout of every watch request. A watch stream that does "
+     "not receive any data for twice this time is considered dead and it's "
+     "restarted"
+    },
+    {
+     FLB_CONFIG_MAP_TIME, "kube_meta_watch_resync", "1h",
+     0, FLB_TRUE, offsetof(struct flb_kube, kube_meta_watch_resync),
+     "load the whole list of pods again at this interval, even if the watch "
+     "stream looks healthy. Set it to 0 to disable it"
+    },
+    {
+     FLB_CONFIG_MAP_TIME, "kube_meta_negative_cache_ttl", "10s",
+     0, FLB_TRUE, offsetof(struct flb_kube, kube_meta_negative_cache_ttl),
+     "time to wait before requesting again the metadata of a pod after a "
+     "failed request. Set it to 0 to disable the negative cache"
+    },
     /* EOF */
     {0}
 };
@@ -1283,7 +1283,9 @@ static inline int apply_modifying_rule(struct filter_modify_ctx *ctx,
 
 static inline int apply_modifying_rules(msgpack_packer *packer,
                                         msgpack_object *root,
-                                        struct filter_modify_ctx *ctx)
+                                        struct filter_modify_ctx *ctx,
+                                        struct flb_arena *arena,
+                                        msgpack_zone *zone)
 {
     msgpack_object ts = root->via.array.ptr[0];
     msgpack_object map = root->via.array.ptr[1];
@@ -1299,53 +1301,42 @@ static inline int apply_modifying_rules(msgpack_packer *packer,
 
     struct modify_rule *rule;
 
-    msgpack_sbuffer sbuffer;
+    size_t off;
+    msgpack_object obj;
     msgpack_packer in_packer;
-    msgpack_unpacker unpacker;
-    msgpack_unpacked unpacked;
+    struct flb_arena_buf buf;
 
-    int initial_buffer_size = 1024 * 8;
-    int new_buffer_size = 0;
+    int initial_buffer_size = 1024;
 
     struct mk_list *tmp;
     struct mk_list *head;
 
-    msgpack_sbuffer_init(&sbuffer);
-    msgpack_packer_init(&in_packer, &sbuffer, msgpack_sbuffer_write);
-    msgpack_unpacked_init(&unpacked);
-    if (!msgpack_unpacker_init(&unpacker, initial_buffer_size)) {
-        flb_plg_error(ctx->ins, "Unable to allocate memory for unpacker, aborting");
-        return -1;
-    }
-
     mk_list_foreach_safe(head, tmp, &ctx->rules) {
         rule = mk_list_entry(head, struct modify_rule, _head);
 
-        msgpack_sbuffer_clear(&sbuffer);
+        /*
+         * The map unpacked from the previous rule references its buffer, so
+         * every rule packs into a new one. All of them live in the filter
+         * arena and they are released after the record is done.
+         */
+        flb_arena_buf_init(&buf, arena, initial_buffer_size);
+        msgpack_packer_init(&in_packer, &buf, flb_arena_buf_write);
 
         if (apply_modifying_rule(ctx, &in_packer, &map, rule) !=
             FLB_FILTER_NOTOUCH) {
 
             has_modifications = true;
-            new_buffer_size = sbuffer.size * 2;
 
-            if (msgpack_unpacker_buffer_capacity(&unpacker) < new_buffer_size) {
-                if (!msgpack_unpacker_reserve_buffer
-                    (&unpacker, new_buffer_size)) {
-                    flb_plg_error(ctx->ins, "Unable to re-allocate memory for "
-                                  "unpacker, aborting");
-                    return -1;
-                }
+            if (buf.data == NULL) {
+                flb_plg_error(ctx->ins, "Unable to allocate memory for "
+                              "rule output, aborting");
+                return -1;
             }
 
-            memcpy(msgpack_unpacker_buffer(&unpacker), sbuffer.data,
-                   sbuffer.size);
-            msgpack_unpacker_buffer_consumed(&unpacker, sbuffer.size);
-
-            msgpack_unpacker_next(&unpacker, &unpacked);
-
-            if (unpacked.data.type == MSGPACK_OBJECT_MAP) {
-                map = unpacked.data;
+            off = 0;
+            if (msgpack_unpack(buf.data, buf.size, &off, zone, &obj) ==
+                MSGPACK_UNPACK_SUCCESS && obj.type == MSGPACK_OBJECT_MAP) {
+                map = obj;
             }
             else {
                 flb_plg_error(ctx->ins, "Expected MSGPACK_MAP, this is not a "
@@ -1368,10 +1359,6 @@ static inline int apply_modifying_rules(msgpack_packer *packer,
         msgpack_pack_object(packer, map);
     }
 
-    msgpack_unpacked_destroy(&unpacked);
-    msgpack_unpacker_destroy(&unpacker);
-    msgpack_sbuffer_destroy(&sbuffer);
-
     return has_modifications ? 1 : 0;
 
 }
@@ -1412,12 +1399,15 @@ static int cb_modify_filter(const void *data, size_t bytes,
 {
     msgpack_unpacked result;
     size_t off = 0;
-    (void) f_ins;
     (void) i_ins;
     (void) config;
 
     struct filter_modify_ctx *ctx = context;
 
+    struct flb_arena *arena;
+    struct flb_arena_mark mark;
+    msgpack_zone zone;
+
     int modifications = 0;
     int total_modifications = 0;
 
@@ -1435,11 +1425,24 @@ static int cb_modify_filter(const void *data, size_t bytes,
     // Example record,
     // [1123123, {"Mem.total"=>4050908, "Mem.used"=>476576, "Mem.free"=>3574332 } ]
 
+    // The intermediate maps of a record are released once it's packed:
+    // the buffers are taken from the filter arena and the unpacked objects
+    // from a zone that keeps its memory between records.
+    arena = flb_filter_arena_get(f_ins);
+    if (!arena || !msgpack_zone_init(&zone, MSGPACK_ZONE_CHUNK_SIZE)) {
+        msgpack_sbuffer_destroy(&buffer);
+        return FLB_FILTER_NOTOUCH;
+    }
+    flb_arena_mark(arena, &mark);
+
     msgpack_unpacked_init(&result);
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         if (result.data.type == MSGPACK_OBJECT_ARRAY) {
             modifications =
-                apply_modifying_rules(&packer, &result.data, ctx);
+                apply_modifying_rules(&packer, &result.data, ctx,
+                                      arena, &zone);
+            flb_arena_rewind(arena, &mark);
+            msgpack_zone_clear(&zone);
 
             if (modifications == 0) {
                 // not matched, so copy original event.
@@ -1452,6 +1455,7 @@ static int cb_modify_filter(const void *data, size_t bytes,
         }
     }
     msgpack_unpacked_destroy(&result);
+    msgpack_zone_destroy(&zone);
 
     if(total_modifications == 0) {
         msgpack_sbuffer_destroy(&buffer);
@@ -1552,5 +1556,5 @@ struct flb_filter_plugin filter_modify_plugin = {
     .cb_filter = cb_modify_filter,
     .cb_exit = cb_modify_exit,
     .config_map = config_map,
-    .flags = 0
+    .flags = FLB_FILTER_THREAD_SAFE
 };
@@ -337,7 +337,6 @@ static inline bool is_kv_to_lift(msgpack_object_kv * kv,
 {
 
     const char *key;
-    char *tmp;
     int klen;
     bool match;
 
@@ -360,17 +359,9 @@ static inline bool is_kv_to_lift(msgpack_object_kv * kv,
              (strncmp(key, ctx->key, klen) == 0));
 
     if (match && (kv->val.type != MSGPACK_OBJECT_MAP)) {
-        tmp = flb_malloc(klen + 1);
-        if (!tmp) {
-            flb_errno();
-            return false;
-        }
-        memcpy(tmp, key, klen);
-        tmp[klen] = '\0';
-        flb_plg_warn(ctx->ins, "Value of key '%s' is not a map. "
+        flb_plg_warn(ctx->ins, "Value of key '%.*s' is not a map. "
                      "Will not attempt to lift from here",
-                     tmp);
-        flb_free(tmp);
+                     klen, key);
         return false;
     }
     else {
@@ -680,5 +671,5 @@ struct flb_filter_plugin filter_nest_plugin = {
     .cb_filter = cb_nest_filter,
     .cb_exit = cb_nest_exit,
     .config_map = config_map,
-    .flags = 0
+    .flags = FLB_FILTER_THREAD_SAFE
 };
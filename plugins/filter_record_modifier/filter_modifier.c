@@ -292,10 +292,11 @@ static int cb_modifier_filter(const void *data, size_t bytes,
     int removed_map_num  = 0;
     int map_num          = 0;
     bool_map_t *bool_map = NULL;
-    (void) f_ins;
     (void) i_ins;
     (void) config;
     struct flb_time tm;
+    struct flb_arena *arena;
+    struct flb_arena_mark mark;
     struct modifier_record *mod_rec;
     msgpack_sbuffer tmp_sbuf;
     msgpack_packer tmp_pck;
@@ -305,6 +306,13 @@ static int cb_modifier_filter(const void *data, size_t bytes,
     struct mk_list *tmp;
     struct mk_list *head;
 
+    /* the maps of every record are allocated from the filter arena */
+    arena = flb_filter_arena_get(f_ins);
+    if (!arena) {
+        return FLB_FILTER_NOTOUCH;
+    }
+    flb_arena_mark(arena, &mark);
+
     /* Create temporary msgpack buffer */
     msgpack_sbuffer_init(&tmp_sbuf);
     msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
@@ -314,10 +322,8 @@ static int cb_modifier_filter(const void *data, size_t bytes,
     while (msgpack_unpack_next(&result, data, bytes, &off) == MSGPACK_UNPACK_SUCCESS) {
         map_num = 0;
         removed_map_num = 0;
-        if (bool_map != NULL) {
-            flb_free(bool_map);
-            bool_map = NULL;
-        }
+        flb_arena_rewind(arena, &mark);
+        bool_map = NULL;
 
         if (result.data.type != MSGPACK_OBJECT_ARRAY) {
             continue;
@@ -334,9 +340,8 @@ static int cb_modifier_filter(const void *data, size_t bytes,
                 return -1;
             }
             /* allocate map_num + guard byte */
-            bool_map = flb_calloc(map_num+1, sizeof(bool_map_t));
+            bool_map = flb_arena_calloc(arena, map_num+1, sizeof(bool_map_t));
             if (bool_map == NULL) {
-                flb_errno();
                 return -1;
             }
             removed_map_num = make_bool_map(ctx, obj,
@@ -366,8 +371,6 @@ static int cb_modifier_filter(const void *data, size_t bytes,
                 msgpack_pack_object(&tmp_pck, (kv+i)->val);
             }
         }
-        flb_free(bool_map);
-        bool_map = NULL;
 
         /* append record */
         if (ctx->records_num > 0) {
@@ -384,9 +387,6 @@ static int cb_modifier_filter(const void *data, size_t bytes,
         }
     }
     msgpack_unpacked_destroy(&result);
-    if (bool_map != NULL) {
-        flb_free(bool_map);
-    }
 
     if (is_modified != FLB_TRUE) {
         /* Destroy the buffer to avoid more overhead */
@@ -444,5 +444,5 @@ struct flb_filter_plugin filter_record_modifier_plugin = {
     .cb_filter    = cb_modifier_filter,
     .cb_exit      = cb_modifier_exit,
     .config_map   = config_map,
-    .flags        = 0
+    .flags        = FLB_FILTER_THREAD_SAFE
 };
@@ -23,7 +23,7 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_utils.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compression.h>
 
 #include <fluent-bit/flb_input_metric.h>
 #include <fluent-bit/flb_input_trace.h>
@@ -87,7 +87,11 @@ static int get_chunk_event_type(struct flb_input_instance *ins, msgpack_object o
     return type;
 }
 
-static int is_gzip_compressed(msgpack_object options)
+/*
+ * Get the compression algorithm from the 'compressed' option: 'text' or a
+ * supported algorithm name ('gzip', 'zstd'). Returns -1 on invalid options.
+ */
+static int get_compression_algorithm(msgpack_object options)
 {
     int i;
     msgpack_object k;
@@ -115,22 +119,17 @@ static int is_gzip_compressed(msgpack_object options)
                 return -1;
             }
 
-            if (v.via.str.size != 4) {
-                return -1;
-            }
-
-            if (strncmp(v.via.str.ptr, "gzip", 4) == 0) {
-                return FLB_TRUE;
-            }
-            else if (strncmp(v.via.str.ptr, "text", 4) == 0) {
-                return FLB_FALSE;
+            if (v.via.str.size == 4 &&
+                strncmp(v.via.str.ptr, "text", 4) == 0) {
+                return FLB_COMPRESSION_ALGORITHM_NONE;
             }
 
-            return -1;
+            return flb_compression_get_algorithm_len(v.via.str.ptr,
+                                                     v.via.str.size);
         }
     }
 
-    return FLB_FALSE;
+    return FLB_COMPRESSION_ALGORITHM_NONE;
 }
 
 static int send_ack(struct flb_input_instance *in, struct fw_conn *conn,
@@ -309,6 +308,7 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
     int stag_len;
     int c = 0;
     int event_type;
+    int compression;
     int contain_options = FLB_FALSE;
     size_t off = 0;
     size_t chunk_id = -1;
@@ -553,8 +553,8 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
                 }
 
                 if (data) {
-                    ret = is_gzip_compressed(root.via.array.ptr[2]);
-                    if (ret == -1) {
+                    compression = get_compression_algorithm(root.via.array.ptr[2]);
+                    if (compression == -1) {
                         flb_plg_error(ctx->ins, "invalid 'compressed' option");
                         msgpack_unpacked_destroy(&result);
                         msgpack_unpacker_free(unp);
@@ -562,11 +562,13 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
                         return -1;
                     }
 
-                    if (ret == FLB_TRUE) {
-                        ret = flb_gzip_uncompress((void *) data, len,
-                                                  &gz_data, &gz_size);
+                    if (compression != FLB_COMPRESSION_ALGORITHM_NONE) {
+                        ret = flb_compression_uncompress(compression,
+                                                         (void *) data, len,
+                                                         &gz_data, &gz_size);
                         if (ret == -1) {
-                            flb_plg_error(ctx->ins, "gzip uncompress failure");
+                            flb_plg_error(ctx->ins, "%s uncompress failure",
+                                          flb_compression_get_name(compression));
                             msgpack_unpacked_destroy(&result);
                             msgpack_unpacker_free(unp);
                             flb_sds_destroy(out_tag);
@@ -176,6 +176,13 @@ static struct flb_config_map config_map[] = {
      0, FLB_TRUE, offsetof(struct flb_http, successful_response_code),
      "Set successful response code. 200, 201 and 204 are supported."
     },
+#ifdef FLB_HAVE_ZSTD
+    {
+     FLB_CONFIG_MAP_STR, "zstd_dictionary", NULL,
+     0, FLB_TRUE, offsetof(struct flb_http, zstd_dictionary),
+     "Path to the zstd dictionary used by the clients to compress the payloads"
+    },
+#endif
 
 
     /* EOF */
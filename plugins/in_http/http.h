@@ -45,6 +45,11 @@ struct flb_http {
     struct mk_list connections;        /* linked list of connections */
     struct mk_event_loop *evl;         /* Event loop context */
 
+#ifdef FLB_HAVE_ZSTD
+    flb_sds_t zstd_dictionary;          /* dictionary of zstd payloads */
+    struct flb_zstd_dict *zstd_dict;
+#endif
+
     struct mk_server *server;
     struct flb_input_instance *ins;
 };
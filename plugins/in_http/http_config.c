@@ -18,6 +18,9 @@
  */
 
 #include <fluent-bit/flb_input_plugin.h>
+#ifdef FLB_HAVE_ZSTD
+#include <fluent-bit/flb_zstd.h>
+#endif
 
 #include "http.h"
 #include "http_conn.h"
@@ -43,6 +46,18 @@ struct flb_http *http_config_create(struct flb_input_instance *ins)
         return NULL;
     }
 
+#ifdef FLB_HAVE_ZSTD
+    if (ctx->zstd_dictionary) {
+        ctx->zstd_dict = flb_zstd_dict_load(ctx->zstd_dictionary, 0);
+        if (!ctx->zstd_dict) {
+            flb_plg_error(ins, "cannot load zstd dictionary %s",
+                          ctx->zstd_dictionary);
+            flb_free(ctx);
+            return NULL;
+        }
+    }
+#endif
+
     /* Listen interface (if not set, defaults to 0.0.0.0:9880) */
     flb_input_net_default_listener("0.0.0.0", 9880, ins);
 
@@ -79,6 +94,11 @@ int http_config_destroy(struct flb_http *ctx)
     if (ctx->server) {
         flb_free(ctx->server);
     }
+#ifdef FLB_HAVE_ZSTD
+    if (ctx->zstd_dict) {
+        flb_zstd_dict_destroy(ctx->zstd_dict);
+    }
+#endif
     flb_free(ctx->listen);
     flb_free(ctx->tcp_port);
     flb_free(ctx);
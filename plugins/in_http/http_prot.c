@@ -21,6 +21,10 @@
 #include <fluent-bit/flb_version.h>
 #include <fluent-bit/flb_error.h>
 #include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_compression.h>
+#ifdef FLB_HAVE_ZSTD
+#include <fluent-bit/flb_zstd.h>
+#endif
 
 #include <monkey/monkey.h>
 #include <monkey/mk_core.h>
@@ -289,12 +293,61 @@ static ssize_t parse_payload_json(struct flb_http *ctx, flb_sds_t tag,
     return 0;
 }
 
+/*
+ * Get the compression algorithm from the Content-Encoding header, it's not a
+ * known header for the parser so it's looked up in the extra headers.
+ */
+static int get_content_encoding(struct mk_http_session *session)
+{
+    int i;
+    struct mk_http_header *header;
+
+    for (i = 0; i < session->parser.headers_extra_count; i++) {
+        header = &session->parser.headers_extra[i];
+        if (header->key.len != 16 ||
+            strncmp(header->key.data, "content-encoding", 16) != 0) {
+            continue;
+        }
+
+        if (header->val.len == 8 &&
+            strncasecmp(header->val.data, "identity", 8) == 0) {
+            return FLB_COMPRESSION_ALGORITHM_NONE;
+        }
+
+        return flb_compression_get_algorithm_len(header->val.data,
+                                                 header->val.len);
+    }
+
+    return FLB_COMPRESSION_ALGORITHM_NONE;
+}
+
+static int uncompress_payload(struct flb_http *ctx, int algorithm,
+                              char *data, size_t size,
+                              void **out_buf, size_t *out_size)
+{
+#ifdef FLB_HAVE_ZSTD
+    if (algorithm == FLB_COMPRESSION_ALGORITHM_ZSTD && ctx->zstd_dict) {
+        return flb_zstd_uncompress_dict(ctx->zstd_dict, data, size,
+                                        out_buf, out_size);
+    }
+#endif
+
+    return flb_compression_uncompress(algorithm, data, size,
+                                      out_buf, out_size);
+}
+
 static int process_payload(struct flb_http *ctx, struct http_conn *conn,
                            flb_sds_t tag,
                            struct mk_http_session *session,
                            struct mk_http_request *request)
 {
+    int ret;
     int type = -1;
+    int encoding;
+    char *data;
+    size_t size;
+    void *out_buf = NULL;
+    size_t out_size;
     struct mk_http_header *header;
 
     header = &session->parser.headers[MK_HEADER_CONTENT_TYPE];
@@ -318,8 +371,32 @@ static int process_payload(struct flb_http *ctx, struct http_conn *conn,
         return -1;
     }
 
+    data = request->data.data;
+    size = request->data.len;
+
+    encoding = get_content_encoding(session);
+    if (encoding == -1) {
+        send_response(conn, 400, "error: unsupported 'Content-Encoding'\n");
+        return -1;
+    }
+
+    if (encoding != FLB_COMPRESSION_ALGORITHM_NONE) {
+        ret = uncompress_payload(ctx, encoding, data, size,
+                                 &out_buf, &out_size);
+        if (ret == -1) {
+            send_response(conn, 400, "error: invalid compressed payload\n");
+            return -1;
+        }
+        data = out_buf;
+        size = out_size;
+    }
+
     if (type == HTTP_CONTENT_JSON) {
-        parse_payload_json(ctx, tag, request->data.data, request->data.len);
+        parse_payload_json(ctx, tag, data, size);
+    }
+
+    if (out_buf) {
+        flb_free(out_buf);
     }
 
     return 0;
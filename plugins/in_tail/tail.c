@@ -42,6 +42,10 @@
 #include "tail_dockermode.h"
 #include "tail_multiline.h"
 
+#ifdef FLB_HAVE_IO_URING
+#include "tail_uring.h"
+#endif
+
 static inline int consume_byte(flb_pipefd_t fd)
 {
     int ret;
@@ -57,6 +61,159 @@ static inline int consume_byte(flb_pipefd_t fd)
     return 0;
 }
 
+#ifdef FLB_HAVE_IO_URING
+/*
+ * Complete the reads queued in the io_uring batch, returns the number of
+ * files that still have pending data.
+ */
+static int uring_complete_batch(struct flb_tail_config *ctx, int n,
+                                uint64_t *total_processed)
+{
+    int i;
+    int ret;
+    int active = 0;
+    uint64_t pre;
+    struct flb_tail_file *file;
+    struct flb_tail_uring_req *req;
+
+    flb_tail_uring_read(ctx->uring, n);
+
+    for (i = 0; i < n; i++) {
+        req = &ctx->uring->reqs[i];
+        file = req->data;
+
+        pre = file->offset;
+        if (req->res < 0) {
+            errno = -req->res;
+            ret = flb_tail_file_read_complete(file, -1);
+        }
+        else {
+            ret = flb_tail_file_read_complete(file, req->res);
+        }
+
+        if (file->offset > pre) {
+            *total_processed += (file->offset - pre);
+        }
+
+        switch (ret) {
+        case FLB_TAIL_ERROR:
+            /* Could not longer read the file */
+            flb_tail_file_remove(file);
+            break;
+        case FLB_TAIL_OK:
+        case FLB_TAIL_BUSY:
+            /* file->size was refreshed after the read (adjust_counters) */
+            if (file->offset < file->size) {
+                file->pending_bytes = (file->size - file->offset);
+                active++;
+            }
+            else {
+                file->pending_bytes = 0;
+            }
+            break;
+        }
+    }
+
+    return active;
+}
+
+/*
+ * io_uring variant of in_tail_collect_pending(): instead of one read(2)
+ * per file, the reads of all the files with pending data are queued and
+ * submitted together, then every file buffer is processed as usual.
+ */
+static int in_tail_collect_pending_uring(struct flb_tail_config *ctx)
+{
+    int n = 0;
+    int ret;
+    int active = 0;
+    size_t capacity;
+    uint64_t queued = 0;
+    uint64_t total_processed = 0;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tail_file *file;
+    struct flb_tail_uring_req *req;
+    struct stat st;
+
+    mk_list_foreach_safe(head, tmp, &ctx->files_event) {
+        file = mk_list_entry(head, struct flb_tail_file, _head);
+
+        if (file->watch_fd == -1) {
+            /* Gather current file size */
+            ret = fstat(file->fd, &st);
+            if (ret == -1) {
+                flb_errno();
+                flb_tail_file_remove(file);
+                continue;
+            }
+            file->size = st.st_size;
+            file->pending_bytes = (file->size - file->offset);
+        }
+
+        if (file->pending_bytes <= 0) {
+            continue;
+        }
+
+        /*
+         * The amount of processed bytes is only known once the batch
+         * completes, queued bytes are accounted against the limit.
+         */
+        if (ctx->event_batch_size > 0 &&
+            total_processed + queued >= ctx->event_batch_size) {
+            break;
+        }
+
+        ret = flb_tail_file_read_prepare(file, &capacity);
+        if (ret == FLB_TAIL_ERROR) {
+            flb_tail_file_remove(file);
+            continue;
+        }
+        else if (ret == FLB_TAIL_BUSY) {
+            /* paused: every other file would get the same answer */
+            active++;
+            break;
+        }
+
+        req = &ctx->uring->reqs[n++];
+        req->fd = file->fd;
+        req->buf = file->buf_data + file->buf_len;
+        req->len = capacity;
+        req->data = file;
+
+        if (file->pending_bytes < capacity) {
+            queued += file->pending_bytes;
+        }
+        else {
+            queued += capacity;
+        }
+
+        if (n == ctx->uring->entries) {
+            active += uring_complete_batch(ctx, n, &total_processed);
+            n = 0;
+            queued = 0;
+        }
+    }
+
+    if (n > 0) {
+        active += uring_complete_batch(ctx, n, &total_processed);
+    }
+
+    if (ctx->uring->failed == FLB_TRUE) {
+        flb_plg_warn(ctx->ins, "io_uring failed, falling back to read(2)");
+        flb_tail_uring_destroy(ctx->uring);
+        ctx->uring = NULL;
+    }
+
+    /* If no more active files, consume pending signal so we don't get called again. */
+    if (active == 0) {
+        tail_consume_pending(ctx);
+    }
+
+    return 0;
+}
+#endif
+
 /* cb_collect callback */
 static int in_tail_collect_pending(struct flb_input_instance *ins,
                                    struct flb_config *config, void *in_context)
@@ -71,6 +228,12 @@ static int in_tail_collect_pending(struct flb_input_instance *ins,
     uint64_t pre;
     uint64_t total_processed = 0;
 
+#ifdef FLB_HAVE_IO_URING
+    if (ctx->uring) {
+        return in_tail_collect_pending_uring(ctx);
+    }
+#endif
+
     /* Iterate promoted event files with pending bytes */
     mk_list_foreach_safe(head, tmp, &ctx->files_event) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
@@ -325,6 +488,21 @@ int in_tail_collect_event(void *file, struct flb_config *config)
         return 0;
     }
 
+#ifdef FLB_HAVE_IO_URING
+    /*
+     * Defer the read to the pending collector so it gets batched with the
+     * reads of the other files that changed.
+     */
+    if (f->config->uring) {
+        f->size = st.st_size;
+        if (f->offset < f->size) {
+            f->pending_bytes = (f->size - f->offset);
+            tail_signal_pending(f->config);
+        }
+        return 0;
+    }
+#endif
+
     ret = flb_tail_file_chunk(f);
     switch (ret) {
     case FLB_TAIL_ERROR:
@@ -672,6 +850,14 @@ static struct flb_config_map config_map[] = {
      "set to false to use file stat watcher instead of inotify."
     },
 #endif
+#ifdef FLB_HAVE_IO_URING
+    {
+     FLB_CONFIG_MAP_BOOL, "io_uring", "false",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, io_uring),
+     "use io_uring to batch the reads of the files with pending data. If the "
+     "kernel lacks support the regular read(2) path is used."
+    },
+#endif
 #ifdef FLB_HAVE_REGEX
     {
      FLB_CONFIG_MAP_STR, "parser", NULL,
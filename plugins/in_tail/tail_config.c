@@ -36,6 +36,10 @@
 #include "tail_multiline.h"
 #endif
 
+#ifdef FLB_HAVE_IO_URING
+#include "tail_uring.h"
+#endif
+
 static int multiline_load_parsers(struct flb_tail_config *ctx)
 {
     struct mk_list *head;
@@ -130,6 +134,20 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
         }
     }
 
+#ifdef FLB_HAVE_IO_URING
+    if (ctx->io_uring == FLB_TRUE) {
+        ctx->uring = flb_tail_uring_create(FLB_TAIL_URING_ENTRIES);
+        if (!ctx->uring) {
+            flb_plg_info(ctx->ins, "io_uring is not available, "
+                         "using read(2) instead");
+        }
+        else {
+            flb_plg_debug(ctx->ins, "io_uring enabled, %u entries",
+                          ctx->uring->entries);
+        }
+    }
+#endif
+
     /* Config: path/pattern to read files */
     if (!ctx->path_list || mk_list_size(ctx->path_list) == 0) {
         flb_plg_error(ctx->ins, "no input 'path' was given");
@@ -443,6 +461,12 @@ int flb_tail_config_destroy(struct flb_tail_config *config)
     flb_pipe_close(config->ch_pending[0]);
     flb_pipe_close(config->ch_pending[1]);
 
+#ifdef FLB_HAVE_IO_URING
+    if (config->uring) {
+        flb_tail_uring_destroy(config->uring);
+    }
+#endif
+
 #ifdef FLB_HAVE_REGEX
     if (config->tag_regex) {
         flb_regex_destroy(config->tag_regex);
@@ -94,6 +94,10 @@ struct flb_tail_config {
 
 #ifdef FLB_HAVE_INOTIFY
     int   inotify_watcher;     /* enable/disable inotify monitor */
+#endif
+#ifdef FLB_HAVE_IO_URING
+    int   io_uring;            /* enable/disable io_uring reads  */
+    struct flb_tail_uring *uring;
 #endif
     flb_sds_t offset_key;      /* key name of file offset      */
 
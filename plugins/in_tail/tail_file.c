@@ -30,6 +30,7 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input_plugin.h>
 #include <fluent-bit/flb_parser.h>
+#include <fluent-bit/flb_simd.h>
 #ifdef FLB_HAVE_REGEX
 #include <fluent-bit/flb_regex.h>
 #include <fluent-bit/flb_hash_table.h>
@@ -362,6 +363,93 @@ static int ml_stream_buffer_flush(struct flb_tail_config *ctx, struct flb_tail_f
     return 0;
 }
 
+/*
+ * Lines packed as-is share the same record layout, only the timestamp, the
+ * offset and the line itself change. The constant parts (map header, path
+ * key/value, offset key name and the name of the line key) are serialized
+ * once per read and copied for every line, instead of going through the
+ * packer for each one of them.
+ */
+struct tail_line_packer {
+    int ready;
+    msgpack_sbuffer head;      /* map header, path_key pair, offset_key name */
+    msgpack_sbuffer key;       /* key holding the line                       */
+};
+
+static void line_packer_init(struct tail_line_packer *lp,
+                             struct flb_tail_file *file)
+{
+    int map_num = 1;
+    msgpack_packer pck;
+    struct flb_tail_config *ctx = file->config;
+
+    msgpack_sbuffer_init(&lp->head);
+    msgpack_sbuffer_init(&lp->key);
+
+    if (ctx->path_key != NULL) {
+        map_num++;
+    }
+    if (ctx->offset_key != NULL) {
+        map_num++;
+    }
+
+    msgpack_packer_init(&pck, &lp->head, msgpack_sbuffer_write);
+    msgpack_pack_map(&pck, map_num);
+
+    if (ctx->path_key != NULL) {
+        msgpack_pack_str(&pck, flb_sds_len(ctx->path_key));
+        msgpack_pack_str_body(&pck, ctx->path_key, flb_sds_len(ctx->path_key));
+        msgpack_pack_str(&pck, file->name_len);
+        msgpack_pack_str_body(&pck, file->name, file->name_len);
+    }
+    if (ctx->offset_key != NULL) {
+        msgpack_pack_str(&pck, flb_sds_len(ctx->offset_key));
+        msgpack_pack_str_body(&pck, ctx->offset_key,
+                              flb_sds_len(ctx->offset_key));
+    }
+
+    msgpack_packer_init(&pck, &lp->key, msgpack_sbuffer_write);
+    msgpack_pack_str(&pck, flb_sds_len(ctx->key));
+    msgpack_pack_str_body(&pck, ctx->key, flb_sds_len(ctx->key));
+
+    lp->ready = FLB_TRUE;
+}
+
+static void line_packer_destroy(struct tail_line_packer *lp)
+{
+    if (lp->ready == FLB_TRUE) {
+        msgpack_sbuffer_destroy(&lp->head);
+        msgpack_sbuffer_destroy(&lp->key);
+        lp->ready = FLB_FALSE;
+    }
+}
+
+/* Same output than flb_tail_file_pack_line() */
+static inline void line_packer_pack(struct tail_line_packer *lp,
+                                    msgpack_sbuffer *mp_sbuf,
+                                    msgpack_packer *mp_pck,
+                                    struct flb_time *time,
+                                    char *data, size_t data_size,
+                                    struct flb_tail_file *file,
+                                    size_t processed_bytes)
+{
+    if (lp->ready == FLB_FALSE) {
+        line_packer_init(lp, file);
+    }
+
+    msgpack_pack_array(mp_pck, 2);
+    flb_time_append_to_msgpack(time, mp_pck, 0);
+    msgpack_sbuffer_write(mp_sbuf, lp->head.data, lp->head.size);
+
+    if (file->config->offset_key != NULL) {
+        msgpack_pack_uint64(mp_pck, file->offset + processed_bytes);
+    }
+
+    msgpack_sbuffer_write(mp_sbuf, lp->key.data, lp->key.size);
+    msgpack_pack_str(mp_pck, data_size);
+    msgpack_pack_str_body(mp_pck, data, data_size);
+}
+
 static int process_content(struct flb_tail_file *file, size_t *bytes)
 {
     size_t len;
@@ -371,6 +459,11 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
     char *data;
     char *end;
     char *p;
+    char *scan;
+    char *base = NULL;
+    size_t nl_pos[FLB_TAIL_NL_BATCH];
+    size_t nl_count = 0;
+    size_t nl_idx = 0;
     void *out_buf;
     size_t out_size;
     int crlf;
@@ -384,6 +477,7 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
     msgpack_packer mp_pck;
     msgpack_sbuffer *out_sbuf;
     msgpack_packer *out_pck;
+    struct tail_line_packer lp = {0};
     struct flb_tail_config *ctx = file->config;
 
     /* Create a temporary msgpack buffer */
@@ -405,7 +499,23 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
         processed_bytes++;
     }
 
-    while (data < end && (p = memchr(data, '\n', end - data))) {
+    /*
+     * Line ends are located in batches: a vector scan stores the offsets of
+     * the next FLB_TAIL_NL_BATCH new lines, then every line is processed.
+     */
+    scan = data;
+    while (data < end) {
+        if (nl_idx == nl_count) {
+            base = scan;
+            nl_count = flb_simd_find_all(base, end - base, '\n',
+                                         nl_pos, FLB_TAIL_NL_BATCH);
+            if (nl_count == 0) {
+                break;
+            }
+            nl_idx = 0;
+            scan = base + nl_pos[nl_count - 1] + 1;
+        }
+        p = base + nl_pos[nl_idx++];
         len = (p - data);
         crlf = 0;
         if (file->skip_next == FLB_TRUE) {
@@ -501,8 +611,8 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
             else {
                 /* Parser failed, pack raw text */
                 flb_time_get(&out_time);
-                flb_tail_file_pack_line(out_sbuf, out_pck, &out_time,
-                                        data, len, file, processed_bytes);
+                line_packer_pack(&lp, out_sbuf, out_pck, &out_time,
+                                 data, len, file, processed_bytes);
             }
         }
         else if (ctx->multiline == FLB_TRUE) {
@@ -516,8 +626,8 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
                 flb_tail_mult_flush(out_sbuf, out_pck, file, ctx);
 
                 flb_time_get(&out_time);
-                flb_tail_file_pack_line(out_sbuf, out_pck, &out_time,
-                                        line, line_len, file, processed_bytes);
+                line_packer_pack(&lp, out_sbuf, out_pck, &out_time,
+                                 line, line_len, file, processed_bytes);
             }
             else if (ret == FLB_TAIL_MULT_MORE) {
                 /* we need more data, do nothing */
@@ -529,13 +639,13 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
         }
         else {
             flb_time_get(&out_time);
-            flb_tail_file_pack_line(out_sbuf, out_pck, &out_time,
-                                    line, line_len, file, processed_bytes);
+            line_packer_pack(&lp, out_sbuf, out_pck, &out_time,
+                             line, line_len, file, processed_bytes);
         }
 #else
         flb_time_get(&out_time);
-        flb_tail_file_pack_line(out_sbuf, out_pck, &out_time,
-                                line, line_len, file, processed_bytes);
+        line_packer_pack(&lp, out_sbuf, out_pck, &out_time,
+                         line, line_len, file, processed_bytes);
 #endif
 
     go_next:
@@ -575,6 +685,7 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
         ml_stream_buffer_flush(ctx, file);
     }
 
+    line_packer_destroy(&lp);
     msgpack_sbuffer_destroy(out_sbuf);
     return lines;
 }
@@ -1284,15 +1395,15 @@ static int adjust_counters(struct flb_tail_config *ctx, struct flb_tail_file *fi
     return FLB_TAIL_OK;
 }
 
-int flb_tail_file_chunk(struct flb_tail_file *file)
+/*
+ * Make room in the file buffer for a new read. On success 'capacity' gets
+ * the number of bytes that can be read into file->buf_data + file->buf_len.
+ */
+int flb_tail_file_read_prepare(struct flb_tail_file *file, size_t *capacity)
 {
-    int ret;
     char *tmp;
     size_t size;
-    size_t capacity;
-    size_t processed_bytes;
-    ssize_t bytes;
-    struct stat st;
+    size_t avail;
     struct flb_tail_config *ctx;
 
     /* Check if we the engine issued a pause */
@@ -1301,8 +1412,8 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
         return FLB_TAIL_BUSY;
     }
 
-    capacity = (file->buf_size - file->buf_len) - 1;
-    if (capacity < 1) {
+    avail = (file->buf_size - file->buf_len) - 1;
+    if (avail < 1) {
         /*
          * If there is no more room for more data, try to increase the
          * buffer under the limit of buffer_max_size.
@@ -1348,11 +1459,39 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
                 return FLB_TAIL_ERROR;
             }
         }
-        capacity = (file->buf_size - file->buf_len) - 1;
+        avail = (file->buf_size - file->buf_len) - 1;
     }
 
-    bytes = read(file->fd, file->buf_data + file->buf_len, capacity);
+    *capacity = avail;
+    return FLB_TAIL_OK;
+}
+
+/*
+ * Process the result of a read issued after flb_tail_file_read_prepare():
+ * 'bytes' is the value returned by read(2), on error errno must be set.
+ */
+int flb_tail_file_read_complete(struct flb_tail_file *file, ssize_t bytes)
+{
+    int ret;
+    size_t processed_bytes;
+    struct flb_tail_config *ctx;
+
+    ctx = file->config;
+
     if (bytes > 0) {
+        /*
+         * Reads can be issued in batches, so a previous file of the same
+         * batch might have paused the input. Give the data back to the file
+         * so it's read again once the engine resumes the input.
+         */
+        if (flb_input_buf_paused(ctx->ins) == FLB_TRUE) {
+            if (lseek(file->fd, -bytes, SEEK_CUR) == -1) {
+                flb_errno();
+                return FLB_TAIL_ERROR;
+            }
+            return FLB_TAIL_BUSY;
+        }
+
         /* we read some data, let the content processor take care of it */
         file->buf_len += bytes;
         file->buf_data[file->buf_len] = '\0';
@@ -1383,15 +1522,9 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
         }
 #endif
 
-        ret = fstat(file->fd, &st);
-        if (ret == -1) {
-            flb_errno();
-            return FLB_TAIL_ERROR;
-        }
-        else {
-            /* adjust file counters, returns FLB_TAIL_OK or FLB_TAIL_ERROR */
-            ret = adjust_counters(ctx, file);
-        }
+        /* adjust file counters, returns FLB_TAIL_OK or FLB_TAIL_ERROR */
+        ret = adjust_counters(ctx, file);
+
         /* Data was consumed but likely some bytes still remain */
         return ret;
     }
@@ -1415,6 +1548,21 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
     return FLB_TAIL_ERROR;
 }
 
+int flb_tail_file_chunk(struct flb_tail_file *file)
+{
+    int ret;
+    size_t capacity;
+    ssize_t bytes;
+
+    ret = flb_tail_file_read_prepare(file, &capacity);
+    if (ret != FLB_TAIL_OK) {
+        return ret;
+    }
+
+    bytes = read(file->fd, file->buf_data + file->buf_len, capacity);
+    return flb_tail_file_read_complete(file, bytes);
+}
+
 /* Returns FLB_TRUE if a file has been rotated, otherwise FLB_FALSE */
 int flb_tail_file_is_rotated(struct flb_tail_config *ctx,
                              struct flb_tail_file *file)
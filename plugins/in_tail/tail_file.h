@@ -117,6 +117,8 @@ static inline int flb_tail_target_file_name_cmp(char *name,
 
 int flb_tail_file_name_dup(char *path, struct flb_tail_file *file);
 int flb_tail_file_to_event(struct flb_tail_file *file);
+int flb_tail_file_read_prepare(struct flb_tail_file *file, size_t *capacity);
+int flb_tail_file_read_complete(struct flb_tail_file *file, ssize_t bytes);
 int flb_tail_file_chunk(struct flb_tail_file *file);
 int flb_tail_file_append(char *path, struct stat *st, int mode,
                          struct flb_tail_config *ctx);
@@ -0,0 +1,332 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "tail_uring.h"
+
+/*
+ * Minimal io_uring client used to batch the read(2) calls of the files
+ * that have pending data: every read of a batch is queued in the
+ * submission ring and a single io_uring_enter(2) submits them and waits
+ * for the completions. There is no liburing dependency, the three system
+ * calls are invoked directly.
+ */
+
+#define URING_REQ_PENDING   (-ECANCELED - 4096)
+
+static int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned int to_submit,
+                       unsigned int min_complete, unsigned int flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned int opcode, void *arg,
+                          unsigned int nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Check that the running kernel knows about IORING_OP_READ */
+static int uring_probe_read(int fd)
+{
+    int ret;
+    size_t size;
+    struct io_uring_probe *probe;
+
+    size = sizeof(struct io_uring_probe) +
+           (256 * sizeof(struct io_uring_probe_op));
+    probe = flb_calloc(1, size);
+    if (!probe) {
+        flb_errno();
+        return FLB_FALSE;
+    }
+
+    ret = uring_register(fd, IORING_REGISTER_PROBE, probe, 256);
+    if (ret < 0 || probe->ops_len <= IORING_OP_READ ||
+        !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)) {
+        flb_free(probe);
+        return FLB_FALSE;
+    }
+
+    flb_free(probe);
+    return FLB_TRUE;
+}
+
+struct flb_tail_uring *flb_tail_uring_create(unsigned int entries)
+{
+    int fd;
+    struct io_uring_params p;
+    struct flb_tail_uring *ring;
+
+    memset(&p, 0, sizeof(p));
+    fd = uring_setup(entries, &p);
+    if (fd < 0) {
+        flb_debug("[in_tail] io_uring_setup() failed: %s", strerror(errno));
+        return NULL;
+    }
+
+    /*
+     * Reads are queued with offset -1 so they use and advance the file
+     * position just like read(2) does, that needs IORING_FEAT_RW_CUR_POS.
+     */
+    if (!(p.features & IORING_FEAT_RW_CUR_POS) || !uring_probe_read(fd)) {
+        flb_debug("[in_tail] io_uring lacks the required features");
+        close(fd);
+        return NULL;
+    }
+
+    ring = flb_calloc(1, sizeof(struct flb_tail_uring));
+    if (!ring) {
+        flb_errno();
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->entries = p.sq_entries;
+    ring->sq_ptr = MAP_FAILED;
+    ring->cq_ptr = MAP_FAILED;
+    ring->sqes = MAP_FAILED;
+
+    ring->sq_ring_size = p.sq_off.array + (p.sq_entries * sizeof(unsigned int));
+    ring->cq_ring_size = p.cq_off.cqes +
+                         (p.cq_entries * sizeof(struct io_uring_cqe));
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        flb_errno();
+        flb_tail_uring_destroy(ring);
+        return NULL;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    }
+    else {
+        ring->cq_ptr = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            flb_errno();
+            flb_tail_uring_destroy(ring);
+            return NULL;
+        }
+    }
+
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        flb_errno();
+        flb_tail_uring_destroy(ring);
+        return NULL;
+    }
+
+    ring->sq_head  = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail  = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask  = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *) ((char *) ring->sq_ptr + p.sq_off.array);
+
+    ring->cq_head  = (unsigned int *) ((char *) ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail  = (unsigned int *) ((char *) ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask  = (unsigned int *) ((char *) ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *) ((char *) ring->cq_ptr +
+                                              p.cq_off.cqes);
+
+    ring->reqs = flb_calloc(ring->entries, sizeof(struct flb_tail_uring_req));
+    if (!ring->reqs) {
+        flb_errno();
+        flb_tail_uring_destroy(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+void flb_tail_uring_destroy(struct flb_tail_uring *ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    if (ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_ring_size);
+    }
+    if (ring->sq_ptr != MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_ring_size);
+    }
+    close(ring->fd);
+
+    if (ring->reqs) {
+        flb_free(ring->reqs);
+    }
+    flb_free(ring);
+}
+
+/* Reap the available completions, returns the number of reaped entries */
+static int uring_reap(struct flb_tail_uring *ring)
+{
+    int count = 0;
+    unsigned int head;
+    unsigned int tail;
+    struct io_uring_cqe *cqe;
+
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        cqe = &ring->cqes[head & *ring->cq_mask];
+        if (cqe->user_data < ring->entries) {
+            ring->reqs[cqe->user_data].res = cqe->res;
+            count++;
+        }
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+/*
+ * Run the first 'n' requests of ring->reqs and wait for all of them. On
+ * return every request has its result set: requests that could not go
+ * through the ring are served with a plain read(2), so the caller never
+ * has to care about the backend. If the ring itself becomes unusable
+ * 'failed' is set so the caller can stop using it.
+ */
+int flb_tail_uring_read(struct flb_tail_uring *ring, int n)
+{
+    int i;
+    int ret;
+    int done = 0;
+    int reaped;
+    unsigned int tail;
+    unsigned int idx;
+    unsigned int submitted = 0;
+    struct io_uring_sqe *sqe;
+    struct flb_tail_uring_req *req;
+
+    if (n <= 0) {
+        return 0;
+    }
+    if ((unsigned int) n > ring->entries) {
+        n = ring->entries;
+    }
+
+    if (ring->failed == FLB_FALSE) {
+        tail = *ring->sq_tail;
+        for (i = 0; i < n; i++) {
+            req = &ring->reqs[i];
+            req->res = URING_REQ_PENDING;
+
+            idx = tail & *ring->sq_mask;
+            sqe = &ring->sqes[idx];
+            memset(sqe, 0, sizeof(struct io_uring_sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = req->fd;
+            sqe->addr = (uint64_t) (uintptr_t) req->buf;
+            sqe->len = (uint32_t) req->len;
+            sqe->off = (uint64_t) -1;
+            sqe->user_data = i;
+            ring->sq_array[idx] = idx;
+            tail++;
+        }
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        while (done < n) {
+            ret = uring_enter(ring->fd, n - submitted, n - done,
+                              IORING_ENTER_GETEVENTS);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                flb_errno();
+                ring->failed = FLB_TRUE;
+
+                /* take back what the kernel did not consume */
+                __atomic_store_n(ring->sq_tail, tail - (n - submitted),
+                                 __ATOMIC_RELEASE);
+                break;
+            }
+            submitted += ret;
+            done += uring_reap(ring);
+        }
+
+        /*
+         * Requests already owned by the kernel must complete before their
+         * buffers can be touched again, neither the fallback nor the caller
+         * can use them meanwhile. Completions are posted to the CQ even if
+         * io_uring_enter(2) keeps failing, so poll it with a short backoff.
+         */
+        while (done < submitted) {
+            ret = uring_enter(ring->fd, 0, submitted - done,
+                              IORING_ENTER_GETEVENTS);
+            ret = (ret < 0 && errno != EINTR) ? -1 : 0;
+
+            reaped = uring_reap(ring);
+            if (reaped == 0 && ret == -1) {
+                usleep(1000);
+            }
+            done += reaped;
+        }
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            ring->reqs[i].res = URING_REQ_PENDING;
+        }
+    }
+
+    /* Fallback */
+    for (i = 0; i < n; i++) {
+        req = &ring->reqs[i];
+        if (req->res != URING_REQ_PENDING) {
+            continue;
+        }
+        req->res = read(req->fd, req->buf, req->len);
+        if (req->res == -1) {
+            req->res = -errno;
+        }
+    }
+
+    return 0;
+}
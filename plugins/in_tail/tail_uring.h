@@ -0,0 +1,70 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_TAIL_URING_H
+#define FLB_TAIL_URING_H
+
+#include <fluent-bit/flb_info.h>
+
+#include <sys/types.h>
+
+/* Max number of reads submitted to the kernel at once */
+#define FLB_TAIL_URING_ENTRIES   256
+
+/* A read request, 'res' gets the read(2) like result or -errno */
+struct flb_tail_uring_req {
+    int fd;
+    void *buf;
+    size_t len;
+    ssize_t res;
+    void *data;
+};
+
+struct flb_tail_uring {
+    int fd;                              /* io_uring instance           */
+    unsigned int entries;                /* submission queue size       */
+    int failed;                          /* ring is no longer usable    */
+
+    /* submission queue */
+    void *sq_ptr;
+    size_t sq_ring_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    /* completion queue */
+    void *cq_ptr;
+    size_t cq_ring_size;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* requests of the current batch, 'entries' items */
+    struct flb_tail_uring_req *reqs;
+};
+
+struct flb_tail_uring *flb_tail_uring_create(unsigned int entries);
+void flb_tail_uring_destroy(struct flb_tail_uring *ring);
+int flb_tail_uring_read(struct flb_tail_uring *ring, int n);
+
+#endif
@@ -27,7 +27,7 @@
 #include <fluent-bit/flb_crypto.h>
 #include <fluent-bit/flb_config_map.h>
 #include <fluent-bit/flb_random.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compression.h>
 #include <msgpack.h>
 
 #include "forward.h"
@@ -48,6 +48,13 @@ static int io_net_write(struct flb_connection *conn, int unused_fd,
     return flb_io_net_write(conn, data, len, out_len);
 }
 
+static int io_net_writev(struct flb_connection *conn, int unused_fd,
+                         const struct mk_iovec *iov, int iovcnt,
+                         size_t *out_len)
+{
+    return flb_io_net_writev(conn, iov, iovcnt, out_len);
+}
+
 static int io_net_read(struct flb_connection *conn, int unused_fd,
                        void* buf, size_t len)
 {
@@ -538,8 +545,8 @@ static int forward_read_ack(struct flb_forward *ctx,
 static int forward_config_init(struct flb_forward_config *fc,
                                struct flb_forward *ctx)
 {
-    if (fc->io_read == NULL || fc->io_write == NULL) {
-        flb_plg_error(ctx->ins, "io_read/io_write is NULL");
+    if (fc->io_read == NULL || fc->io_write == NULL || fc->io_writev == NULL) {
+        flb_plg_error(ctx->ins, "io_read/io_write/io_writev is NULL");
         return -1;
     }
 
@@ -685,6 +692,12 @@ static int config_set_properties(struct flb_upstream_node *node,
             fc->compress = COMPRESS_GZIP;
             fc->send_options = FLB_TRUE;
         }
+#ifdef FLB_HAVE_ZSTD
+        else if (!strcasecmp(tmp, "zstd")) {
+            fc->compress = COMPRESS_ZSTD;
+            fc->send_options = FLB_TRUE;
+        }
+#endif
         else {
             flb_plg_error(ctx->ins, "invalid compress mode: %s", tmp);
             return -1;
@@ -758,6 +771,7 @@ static int forward_config_ha(const char *upstream_file,
         fc->unix_fd = -1;
         fc->secured = FLB_FALSE;
         fc->io_write = io_net_write;
+        fc->io_writev = io_net_writev;
         fc->io_read  = io_net_read;
 
         /* Is TLS enabled ? */
@@ -826,6 +840,13 @@ static int io_unix_write(struct flb_connection *unused, int fd, const void* data
     return flb_io_fd_write(fd, data, len, out_len);
 }
 
+static int io_unix_writev(struct flb_connection *unused, int fd,
+                          const struct mk_iovec *iov, int iovcnt,
+                          size_t *out_len)
+{
+    return flb_io_fd_writev(fd, iov, iovcnt, out_len);
+}
+
 static int io_unix_read(struct flb_connection *unused, int fd, void* buf,size_t len)
 {
     return flb_io_fd_read(fd, buf, len);
@@ -854,6 +875,7 @@ static int forward_config_simple(struct flb_forward *ctx,
     fc->unix_fd = -1;
     fc->secured = FLB_FALSE;
     fc->io_write = NULL;
+    fc->io_writev = NULL;
     fc->io_read  = NULL;
 
     /* Set default values */
@@ -888,6 +910,7 @@ static int forward_config_simple(struct flb_forward *ctx,
             return -1;
         }
         fc->io_write = io_unix_write;
+        fc->io_writev = io_unix_writev;
         fc->io_read  = io_unix_read;
 #else
         flb_plg_error(ctx->ins, "unix_path is not supported");
@@ -908,6 +931,7 @@ static int forward_config_simple(struct flb_forward *ctx,
             return -1;
         }
         fc->io_write = io_net_write;
+        fc->io_writev = io_net_writev;
         fc->io_read  = io_net_read;
         ctx->u = upstream;
         flb_output_upstream_set(ctx->u, ins);
@@ -1094,6 +1118,8 @@ static int flush_forward_mode(struct flb_forward *ctx,
     msgpack_packer mp_pck;
     void *final_data;
     size_t final_bytes;
+    int iovcnt;
+    struct mk_iovec iov[3];
 
     /* Pack message header */
     msgpack_sbuffer_init(&mp_sbuf);
@@ -1108,11 +1134,12 @@ static int flush_forward_mode(struct flb_forward *ctx,
     /* Tag */
     flb_forward_format_append_tag(ctx, fc, &mp_pck, NULL, tag, tag_len);
 
-    if (fc->compress == COMPRESS_GZIP) {
+    if (fc->compress != COMPRESS_NONE) {
         /* When compress is set, we switch from using Forward mode to using
          * CompressedPackedForward mode.
          */
-        ret = flb_gzip_compress((void *) data, bytes, &final_data, &final_bytes);
+        ret = flb_compression_compress(fc->compress, (void *) data, bytes,
+                                       &final_data, &final_bytes);
         if (ret == -1) {
             flb_plg_error(ctx->ins, "could not compress entries");
             msgpack_sbuffer_destroy(&mp_sbuf);
@@ -1141,39 +1168,31 @@ static int flush_forward_mode(struct flb_forward *ctx,
         }
     }
 
-    /* Write message header */
-    ret = fc->io_write(u_conn, fc->unix_fd, mp_sbuf.data, mp_sbuf.size, &bytes_sent);
-    if (ret == -1) {
-        flb_plg_error(ctx->ins, "could not write forward header");
-        msgpack_sbuffer_destroy(&mp_sbuf);
-        if (fc->compress == COMPRESS_GZIP) {
-            flb_free(final_data);
-        }
-        return FLB_RETRY;
-    }
-    msgpack_sbuffer_destroy(&mp_sbuf);
+    /*
+     * Message header, entries and options are sent with a single vectored
+     * write: the entries are taken straight from the chunk content.
+     */
+    iov[0].iov_base = mp_sbuf.data;
+    iov[0].iov_len = mp_sbuf.size;
+    iov[1].iov_base = final_data;
+    iov[1].iov_len = final_bytes;
+    iovcnt = 2;
 
-    /* Write msgpack content / entries */
-    ret = fc->io_write(u_conn, fc->unix_fd, final_data, final_bytes, &bytes_sent);
-    if (ret == -1) {
-        flb_plg_error(ctx->ins, "could not write forward entries");
-        if (fc->compress == COMPRESS_GZIP) {
-            flb_free(final_data);
-        }
-        return FLB_RETRY;
+    if (send_options == FLB_TRUE) {
+        iov[2].iov_base = opts_buf;
+        iov[2].iov_len = opts_size;
+        iovcnt++;
     }
 
-    if (fc->compress == COMPRESS_GZIP) {
+    ret = fc->io_writev(u_conn, fc->unix_fd, iov, iovcnt, &bytes_sent);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+    if (fc->compress != COMPRESS_NONE) {
         flb_free(final_data);
     }
 
-    /* Write options */
-    if (send_options == FLB_TRUE) {
-        ret = fc->io_write(u_conn, fc->unix_fd, opts_buf, opts_size, &bytes_sent);
-        if (ret == -1) {
-            flb_plg_error(ctx->ins, "could not write forward options");
-            return FLB_RETRY;
-        }
+    if (ret == -1) {
+        flb_plg_error(ctx->ins, "could not write forward entries");
+        return FLB_RETRY;
     }
 
     /* If the sender requires 'ack' from the remote end-point */
@@ -1488,7 +1507,7 @@ static struct flb_config_map config_map[] = {
     {
      FLB_CONFIG_MAP_STR, "compress", NULL,
      0, FLB_FALSE, 0,
-     "Compression mode"
+     "Compression mode: 'text' (default), 'gzip' or 'zstd'"
     },
     {
      FLB_CONFIG_MAP_BOOL, "fluentd_compat", "false",
@@ -25,6 +25,7 @@
 #include <fluent-bit/flb_upstream_ha.h>
 #include <fluent-bit/flb_record_accessor.h>
 #include <fluent-bit/flb_connection.h>
+#include <fluent-bit/flb_compression.h>
 
 /*
  * Forward modes
@@ -53,8 +54,9 @@
 #define MODE_FORWARD_COMPAT        3
 
 /* Compression options */
-#define COMPRESS_NONE              0
-#define COMPRESS_GZIP              1
+#define COMPRESS_NONE              FLB_COMPRESSION_ALGORITHM_NONE
+#define COMPRESS_GZIP              FLB_COMPRESSION_ALGORITHM_GZIP
+#define COMPRESS_ZSTD              FLB_COMPRESSION_ALGORITHM_ZSTD
 
 /*
  * Configuration: we put this separate from the main
@@ -94,6 +96,8 @@ struct flb_forward_config {
 #endif
     int (*io_write)(struct flb_connection* conn, int fd, const void* data,
                         size_t len, size_t *out_len);
+    int (*io_writev)(struct flb_connection* conn, int fd,
+                     const struct mk_iovec *iov, int iovcnt, size_t *out_len);
     int (*io_read)(struct flb_connection* conn, int fd, void* buf, size_t len);
     struct mk_list _head;     /* Link to list flb_forward->configs */
 };
@@ -88,6 +88,7 @@ static int append_options(struct flb_forward *ctx,
                           char *out_chunk)
 {
     char *chunk = NULL;
+    const char *compressed;
     uint8_t checksum[64];
     int     result;
     struct flb_mp_map_header mh;
@@ -131,16 +132,17 @@ static int append_options(struct flb_forward *ctx,
         msgpack_pack_int64(mp_pck, entries);
     }
 
-    /* "compressed": "gzip" */
+    /* "compressed": "gzip" or "zstd" */
     if (entries > 0 &&                      /* not message mode */
         fc->time_as_integer == FLB_FALSE && /* not compat mode */
-        fc->compress == COMPRESS_GZIP) {
+        fc->compress != COMPRESS_NONE) {
+        compressed = flb_compression_get_name(fc->compress);
 
         flb_mp_map_header_append(&mh);
         msgpack_pack_str(mp_pck, 10);
         msgpack_pack_str_body(mp_pck, "compressed", 10);
-        msgpack_pack_str(mp_pck, 4);
-        msgpack_pack_str_body(mp_pck, "gzip", 4);
+        msgpack_pack_str(mp_pck, strlen(compressed));
+        msgpack_pack_str_body(mp_pck, compressed, strlen(compressed));
     }
 
     /* event type (FLB_EVENT_TYPE_LOGS, FLB_EVENT_TYPE_METRICS, FLB_EVENT_TYPE_TRACES) */
@@ -26,8 +26,12 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_sds.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compression.h>
+#ifdef FLB_HAVE_ZSTD
+#include <fluent-bit/flb_zstd.h>
+#endif
 #include <fluent-bit/flb_record_accessor.h>
+#include <fluent-bit/flb_log_event_decoder.h>
 #include <msgpack.h>
 
 #ifdef FLB_HAVE_SIGNV4
@@ -138,12 +142,25 @@ static int http_post(struct flb_out_http *ctx,
     payload_size = body_len;
 
     /* Should we compress the payload ? */
-    if (ctx->compress_gzip == FLB_TRUE) {
-        ret = flb_gzip_compress((void *) body, body_len,
-                                &payload_buf, &payload_size);
+    if (ctx->compress != FLB_COMPRESSION_ALGORITHM_NONE) {
+#ifdef FLB_HAVE_ZSTD
+        if (ctx->zstd_dict) {
+            ret = flb_zstd_compress_dict(ctx->zstd_dict,
+                                         (void *) body, body_len,
+                                         &payload_buf, &payload_size);
+        }
+        else {
+            ret = flb_compression_compress(ctx->compress,
+                                           (void *) body, body_len,
+                                           &payload_buf, &payload_size);
+        }
+#else
+        ret = flb_compression_compress(ctx->compress, (void *) body, body_len,
+                                       &payload_buf, &payload_size);
+#endif
         if (ret == -1) {
             flb_plg_error(ctx->ins,
-                          "cannot gzip payload, disabling compression");
+                          "cannot compress payload, disabling compression");
         }
         else {
             compressed = FLB_TRUE;
@@ -200,9 +217,14 @@ static int http_post(struct flb_out_http *ctx,
                             tag, tag_len);
     }
 
-    /* Content Encoding: gzip */
+    /* Content Encoding: gzip or zstd */
     if (compressed == FLB_TRUE) {
-        flb_http_set_content_encoding_gzip(c);
+        if (ctx->compress == FLB_COMPRESSION_ALGORITHM_ZSTD) {
+            flb_http_set_content_encoding_zstd(c);
+        }
+        else {
+            flb_http_set_content_encoding_gzip(c);
+        }
     }
 
     /* Basic Auth headers */
@@ -313,15 +335,13 @@ static int compose_payload_gelf(struct flb_out_http *ctx,
                                 const char *data, uint64_t bytes,
                                 void **out_body, size_t *out_size)
 {
+    int ret;
     flb_sds_t s;
     flb_sds_t tmp = NULL;
-    msgpack_unpacked result;
-    size_t off = 0;
     size_t size = 0;
-    msgpack_object root;
-    msgpack_object map;
-    msgpack_object *obj;
-    struct flb_time tm;
+    msgpack_object *map;
+    struct flb_log_event event;
+    struct flb_log_event_decoder decoder;
 
     size = bytes * 1.5;
 
@@ -332,27 +352,25 @@ static int compose_payload_gelf(struct flb_out_http *ctx,
         return FLB_RETRY;
     }
 
-    msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) ==
-           MSGPACK_UNPACK_SUCCESS) {
-
-        if (result.data.type != MSGPACK_OBJECT_ARRAY) {
-            continue;
-        }
+    ret = flb_log_event_decoder_init(&decoder, (char *) data, bytes);
+    if (ret != 0) {
+        flb_sds_destroy(s);
+        return FLB_RETRY;
+    }
 
-        root = result.data;
-        if (root.via.array.size != 2) {
+    while (flb_log_event_decoder_next(&decoder, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        map = flb_log_event_decoder_get_body(&decoder, &event);
+        if (!map) {
             continue;
         }
 
-        flb_time_pop_from_msgpack(&tm, &result, &obj);
-        map = root.via.array.ptr[1];
-
-        tmp = flb_msgpack_to_gelf(&s, &map, &tm, &(ctx->gelf_fields));
+        tmp = flb_msgpack_to_gelf(&s, map, &event.timestamp,
+                                  &(ctx->gelf_fields));
         if (!tmp) {
             flb_plg_error(ctx->ins, "error encoding to GELF");
             flb_sds_destroy(s);
-            msgpack_unpacked_destroy(&result);
+            flb_log_event_decoder_destroy(&decoder);
             return FLB_ERROR;
         }
 
@@ -361,7 +379,7 @@ static int compose_payload_gelf(struct flb_out_http *ctx,
         if (!tmp) {
             flb_plg_error(ctx->ins, "error concatenating records");
             flb_sds_destroy(s);
-            msgpack_unpacked_destroy(&result);
+            flb_log_event_decoder_destroy(&decoder);
             return FLB_RETRY;
         }
         s = tmp;
@@ -369,7 +387,7 @@ static int compose_payload_gelf(struct flb_out_http *ctx,
     *out_body = s;
     *out_size = flb_sds_len(s);
 
-    msgpack_unpacked_destroy(&result);
+    flb_log_event_decoder_destroy(&decoder);
 
     return FLB_OK;
 }
@@ -472,11 +490,7 @@ static int post_all_requests(struct flb_out_http *ctx,
                              flb_sds_t headers_key,
                              struct flb_event_chunk *event_chunk)
 {
-    struct flb_time t;
-    msgpack_unpacked result;
-    msgpack_object root;
-    msgpack_object map;
-    msgpack_object *obj;
+    msgpack_object *map;
     msgpack_object *k;
     msgpack_object *v;
     msgpack_object *start_key;
@@ -485,37 +499,34 @@ static int post_all_requests(struct flb_out_http *ctx,
     bool body_found;
     bool headers_found;
     char **headers;
-    size_t off = 0;
     size_t record_count = 0;
     int ret = 0;
+    struct flb_log_event event;
+    struct flb_log_event_decoder decoder;
 
-    msgpack_unpacked_init(&result);
-
-    while (msgpack_unpack_next(&result, data, size, &off) == MSGPACK_UNPACK_SUCCESS) {
-        headers = NULL;
-        body_found = false;
-        headers_found = false;
-        root = result.data;
-
-        if (root.type != MSGPACK_OBJECT_ARRAY) {
-            ret = -1;
-            break;
-        }
+    ret = flb_log_event_decoder_init(&decoder, (char *) data, size);
+    if (ret != 0) {
+        return -1;
+    }
 
-        if (root.via.array.size != 2) {
-            ret = -1;
+    while (flb_log_event_decoder_next(&decoder, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        /* stop at the first malformed record, as with a plain unpack loop */
+        if (decoder.skipped > 0) {
             break;
         }
 
-        flb_time_pop_from_msgpack(&t, &result, &obj);
+        headers = NULL;
+        body_found = false;
+        headers_found = false;
 
-        map = root.via.array.ptr[1];
-        if (map.type != MSGPACK_OBJECT_MAP) {
+        map = flb_log_event_decoder_get_body(&decoder, &event);
+        if (!map) {
             ret = -1;
             break;
         }
 
-        if (!flb_ra_get_kv_pair(ctx->body_ra, map, &start_key, &k, &v)) {
+        if (!flb_ra_get_kv_pair(ctx->body_ra, *map, &start_key, &k, &v)) {
             if (v->type == MSGPACK_OBJECT_STR || v->type == MSGPACK_OBJECT_BIN) {
                 body = v->via.str.ptr;
                 body_size = v->via.str.size;
@@ -528,7 +539,7 @@ static int post_all_requests(struct flb_out_http *ctx,
             }
         }
 
-        if (!flb_ra_get_kv_pair(ctx->headers_ra, map, &start_key, &k, &v)) {
+        if (!flb_ra_get_kv_pair(ctx->headers_ra, *map, &start_key, &k, &v)) {
             headers = extract_headers(v);
             if (headers) {
                 headers_found = true;
@@ -556,7 +567,11 @@ static int post_all_requests(struct flb_out_http *ctx,
         flb_free(headers);
     }
 
-    msgpack_unpacked_destroy(&result);
+    if (decoder.skipped > 0) {
+        ret = -1;
+    }
+
+    flb_log_event_decoder_destroy(&decoder);
     return ret;
 }
 
@@ -679,8 +694,17 @@ static struct flb_config_map config_map[] = {
     {
      FLB_CONFIG_MAP_STR, "compress", NULL,
      0, FLB_FALSE, 0,
-     "Set payload compression mechanism. Option available is 'gzip'"
+     "Set payload compression mechanism. Options available are 'gzip' and "
+     "'zstd'"
+    },
+#ifdef FLB_HAVE_ZSTD
+    {
+     FLB_CONFIG_MAP_STR, "zstd_dictionary", NULL,
+     0, FLB_TRUE, offsetof(struct flb_out_http, zstd_dictionary),
+     "Path to a zstd dictionary used to compress the payloads, the receiver "
+     "must use the same dictionary"
     },
+#endif
     {
      FLB_CONFIG_MAP_SLIST_1, "header", NULL,
      FLB_CONFIG_MAP_MULT, FLB_TRUE, offsetof(struct flb_out_http, headers),
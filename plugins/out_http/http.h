@@ -81,8 +81,12 @@ struct flb_out_http {
     /* Include tag in header */
     flb_sds_t header_tag;
 
-    /* Compression mode (gzip) */
-    int compress_gzip;
+    /* Compression mode (gzip or zstd) */
+    int compress;
+#ifdef FLB_HAVE_ZSTD
+    flb_sds_t zstd_dictionary;
+    struct flb_zstd_dict *zstd_dict;
+#endif
 
     /* Allow duplicated headers */
     int allow_dup_headers;
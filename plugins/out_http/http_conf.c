@@ -23,6 +23,10 @@
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_record_accessor.h>
+#include <fluent-bit/flb_compression.h>
+#ifdef FLB_HAVE_ZSTD
+#include <fluent-bit/flb_zstd.h>
+#endif
 #ifdef FLB_HAVE_SIGNV4
 #ifdef FLB_HAVE_AWS
 #include <fluent-bit/flb_aws_credentials.h>
@@ -60,6 +64,19 @@ struct flb_out_http *flb_http_conf_create(struct flb_output_instance *ins,
         return NULL;
     }
 
+    /* Compress (gzip or zstd) */
+    tmp = flb_output_get_property("compress", ins);
+    ctx->compress = FLB_COMPRESSION_ALGORITHM_NONE;
+    if (tmp) {
+        ret = flb_compression_get_algorithm(tmp);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "unsupported 'compress' option: %s", tmp);
+            flb_free(ctx);
+            return NULL;
+        }
+        ctx->compress = ret;
+    }
+
     if (ctx->headers_key && !ctx->body_key) {
         flb_plg_error(ctx->ins, "when setting headers_key, body_key is also required");
         flb_free(ctx);
@@ -249,15 +266,6 @@ struct flb_out_http *flb_http_conf_create(struct flb_output_instance *ins,
         }
     }
 
-    /* Compress (gzip) */
-    tmp = flb_output_get_property("compress", ins);
-    ctx->compress_gzip = FLB_FALSE;
-    if (tmp) {
-        if (strcasecmp(tmp, "gzip") == 0) {
-            ctx->compress_gzip = FLB_TRUE;
-        }
-    }
-
     ctx->u = upstream;
     ctx->uri = uri;
     ctx->host = ins->host.name;
@@ -266,6 +274,25 @@ struct flb_out_http *flb_http_conf_create(struct flb_output_instance *ins,
     /* Set instance flags into upstream */
     flb_output_upstream_set(ctx->u, ins);
 
+#ifdef FLB_HAVE_ZSTD
+    /* Dictionary for small zstd payloads, the receiver must use the same */
+    if (ctx->zstd_dictionary) {
+        if (ctx->compress != FLB_COMPRESSION_ALGORITHM_ZSTD) {
+            flb_plg_error(ctx->ins, "'zstd_dictionary' requires 'compress zstd'");
+            flb_http_conf_destroy(ctx);
+            return NULL;
+        }
+        ctx->zstd_dict = flb_zstd_dict_load(ctx->zstd_dictionary,
+                                            FLB_ZSTD_DEFAULT_LEVEL);
+        if (!ctx->zstd_dict) {
+            flb_plg_error(ctx->ins, "cannot load zstd dictionary %s",
+                          ctx->zstd_dictionary);
+            flb_http_conf_destroy(ctx);
+            return NULL;
+        }
+    }
+#endif
+
     return ctx;
 }
 
@@ -292,6 +319,12 @@ void flb_http_conf_destroy(struct flb_out_http *ctx)
 #endif
 #endif
 
+#ifdef FLB_HAVE_ZSTD
+    if (ctx->zstd_dict) {
+        flb_zstd_dict_destroy(ctx->zstd_dict);
+    }
+#endif
+
     flb_free(ctx->proxy_host);
     flb_free(ctx->uri);
     flb_free(ctx);
@@ -972,7 +972,8 @@ static void pack_timestamp(msgpack_packer *mp_pck, struct flb_time *tms)
 }
 
 
-static void pack_format_line_value(flb_sds_t buf, msgpack_object *val)
+static void pack_format_line_value(struct flb_arena_buf *buf,
+                                   msgpack_object *val)
 {
     int i;
     int len;
@@ -981,28 +982,28 @@ static void pack_format_line_value(flb_sds_t buf, msgpack_object *val)
     msgpack_object v;
 
     if (val->type == MSGPACK_OBJECT_STR) {
-        safe_sds_cat(&buf, "\"", 1);
-        safe_sds_cat(&buf, val->via.str.ptr, val->via.str.size);
-        safe_sds_cat(&buf, "\"", 1);
+        flb_arena_buf_append(buf, "\"", 1);
+        flb_arena_buf_append(buf, val->via.str.ptr, val->via.str.size);
+        flb_arena_buf_append(buf, "\"", 1);
     }
     else if (val->type == MSGPACK_OBJECT_NIL) {
-        safe_sds_cat(&buf, "null", 4);
+        flb_arena_buf_append(buf, "null", 4);
     }
     else if (val->type == MSGPACK_OBJECT_BOOLEAN) {
         if (val->via.boolean) {
-            safe_sds_cat(&buf, "true", 4);
+            flb_arena_buf_append(buf, "true", 4);
         }
         else {
-            safe_sds_cat(&buf, "false", 5);
+            flb_arena_buf_append(buf, "false", 5);
         }
     }
     else if (val->type == MSGPACK_OBJECT_POSITIVE_INTEGER) {
         len = snprintf(temp, sizeof(temp)-1, "%"PRIu64, val->via.u64);
-        safe_sds_cat(&buf, temp, len);
+        flb_arena_buf_append(buf, temp, len);
     }
     else if (val->type == MSGPACK_OBJECT_NEGATIVE_INTEGER) {
         len = snprintf(temp, sizeof(temp)-1, "%"PRId64, val->via.i64);
-        safe_sds_cat(&buf, temp, len);
+        flb_arena_buf_append(buf, temp, len);
     }
     else if (val->type == MSGPACK_OBJECT_FLOAT32 ||
              val->type == MSGPACK_OBJECT_FLOAT64) {
@@ -1014,18 +1015,18 @@ static void pack_format_line_value(flb_sds_t buf, msgpack_object *val)
         }
     }
     else if (val->type == MSGPACK_OBJECT_ARRAY) {
-        safe_sds_cat(&buf, "\"[", 2);
+        flb_arena_buf_append(buf, "\"[", 2);
         for (i = 0; i < val->via.array.size; i++) {
             v = val->via.array.ptr[i];
             if (i > 0) {
-                safe_sds_cat(&buf, " ", 1);
+                flb_arena_buf_append(buf, " ", 1);
             }
             pack_format_line_value(buf, &v);
         }
-        safe_sds_cat(&buf, "]\"", 2);
+        flb_arena_buf_append(buf, "]\"", 2);
     }
     else if (val->type == MSGPACK_OBJECT_MAP) {
-        safe_sds_cat(&buf, "\"map[", 5);
+        flb_arena_buf_append(buf, "\"map[", 5);
 
         for (i = 0; i < val->via.map.size; i++) {
             k = val->via.map.ptr[i].key;
@@ -1036,14 +1037,14 @@ static void pack_format_line_value(flb_sds_t buf, msgpack_object *val)
             }
 
             if (i > 0) {
-                safe_sds_cat(&buf, " ", 1);
+                flb_arena_buf_append(buf, " ", 1);
             }
 
-            safe_sds_cat(&buf, k.via.str.ptr, k.via.str.size);
-            safe_sds_cat(&buf, ":", 1);
+            flb_arena_buf_append(buf, k.via.str.ptr, k.via.str.size);
+            flb_arena_buf_append(buf, ":", 1);
             pack_format_line_value(buf, &v);
         }
-        safe_sds_cat(&buf, "]\"", 2);
+        flb_arena_buf_append(buf, "]\"", 2);
     }
     else {
 
@@ -1103,7 +1104,7 @@ static int get_tenant_id_from_record(struct flb_loki *ctx, msgpack_object *map)
     return 0;
 }
 
-static int pack_record(struct flb_loki *ctx,
+static int pack_record(struct flb_loki *ctx, struct flb_arena *arena,
                        msgpack_packer *mp_pck, msgpack_object *rec)
 {
     int i;
@@ -1112,7 +1113,7 @@ static int pack_record(struct flb_loki *ctx,
     int ret;
     int size_hint = 1024;
     char *line;
-    flb_sds_t buf;
+    struct flb_arena_buf buf;
     msgpack_object key;
     msgpack_object val;
     char *tmp_sbuf_data = NULL;
@@ -1155,18 +1156,10 @@ static int pack_record(struct flb_loki *ctx,
                 msgpack_pack_str(mp_pck, val.via.str.size);
                 msgpack_pack_str_body(mp_pck, val.via.str.ptr, val.via.str.size);
             } else {
-                buf = flb_sds_create_size(size_hint);
-                if (!buf) {
-                    msgpack_unpacked_destroy(&mp_buffer);
-                    if (tmp_sbuf_data) {
-                        flb_free(tmp_sbuf_data);
-                    }
-                    return -1;
-                }
-                pack_format_line_value(buf, &val);
-                msgpack_pack_str(mp_pck, flb_sds_len(buf));
-                msgpack_pack_str_body(mp_pck, buf, flb_sds_len(buf));
-                flb_sds_destroy(buf);
+                flb_arena_buf_init(&buf, arena, size_hint);
+                pack_format_line_value(&buf, &val);
+                msgpack_pack_str(mp_pck, buf.size);
+                msgpack_pack_str_body(mp_pck, buf.data, buf.size);
             }
 
             msgpack_unpacked_destroy(&mp_buffer);
@@ -1201,14 +1194,8 @@ static int pack_record(struct flb_loki *ctx,
             return -1;
         }
 
-        buf = flb_sds_create_size(size_hint);
-        if (!buf) {
-            msgpack_unpacked_destroy(&mp_buffer);
-            if (tmp_sbuf_data) {
-                flb_free(tmp_sbuf_data);
-            }
-            return -1;
-        }
+        /* the line is composed in the flush arena */
+        flb_arena_buf_init(&buf, arena, size_hint);
 
         for (i = 0; i < rec->via.map.size; i++) {
             key = rec->via.map.ptr[i].key;
@@ -1220,17 +1207,16 @@ static int pack_record(struct flb_loki *ctx,
             }
 
             if (i > skip) {
-                safe_sds_cat(&buf, " ", 1);
+                flb_arena_buf_append(&buf, " ", 1);
             }
 
-            safe_sds_cat(&buf, key.via.str.ptr, key.via.str.size);
-            safe_sds_cat(&buf, "=", 1);
-            pack_format_line_value(buf, &val);
+            flb_arena_buf_append(&buf, key.via.str.ptr, key.via.str.size);
+            flb_arena_buf_append(&buf, "=", 1);
+            pack_format_line_value(&buf, &val);
         }
 
-        msgpack_pack_str(mp_pck, flb_sds_len(buf));
-        msgpack_pack_str_body(mp_pck, buf, flb_sds_len(buf));
-        flb_sds_destroy(buf);
+        msgpack_pack_str(mp_pck, buf.size);
+        msgpack_pack_str_body(mp_pck, buf.data, buf.size);
     }
 
     msgpack_unpacked_destroy(&mp_buffer);
@@ -1267,6 +1253,7 @@ static int cb_loki_init(struct flb_output_instance *ins,
 }
 
 static flb_sds_t loki_compose_payload(struct flb_loki *ctx,
+                                      struct flb_arena *arena,
                                       int total_records,
                                       char *tag, int tag_len,
                                       const void *data, size_t bytes)
@@ -1274,6 +1261,7 @@ static flb_sds_t loki_compose_payload(struct flb_loki *ctx,
     int mp_ok = MSGPACK_UNPACK_SUCCESS;
     size_t off = 0;
     flb_sds_t json;
+    struct flb_arena_mark mark;
     struct flb_time tms;
     msgpack_unpacked result;
     msgpack_packer mp_pck;
@@ -1299,6 +1287,9 @@ static flb_sds_t loki_compose_payload(struct flb_loki *ctx,
      * }
      */
 
+    /* the temporary data of a record is released once it's packed */
+    flb_arena_mark(arena, &mark);
+
     /* Initialize msgpack buffers */
     msgpack_unpacked_init(&result);
     msgpack_sbuffer_init(&mp_sbuf);
@@ -1343,7 +1334,8 @@ static flb_sds_t loki_compose_payload(struct flb_loki *ctx,
 
              /* Append the timestamp */
              pack_timestamp(&mp_pck, &tms);
-             pack_record(ctx, &mp_pck, obj);
+             pack_record(ctx, arena, &mp_pck, obj);
+             flb_arena_rewind(arena, &mark);
          }
     }
     else {
@@ -1378,7 +1370,8 @@ static flb_sds_t loki_compose_payload(struct flb_loki *ctx,
 
              /* Append the timestamp */
              pack_timestamp(&mp_pck, &tms);
-             pack_record(ctx, &mp_pck, obj);
+             pack_record(ctx, arena, &mp_pck, obj);
+             flb_arena_rewind(arena, &mark);
          }
     }
 
@@ -1403,9 +1396,15 @@ static void cb_loki_flush(struct flb_event_chunk *event_chunk,
     struct flb_loki *ctx = out_context;
     struct flb_connection *u_conn;
     struct flb_http_client *c;
+    struct flb_arena *arena;
+
+    arena = flb_output_flush_arena_get(out_flush);
+    if (!arena) {
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
 
     /* Format the data to the expected Newrelic Payload */
-    payload = loki_compose_payload(ctx,
+    payload = loki_compose_payload(ctx, arena,
                                    event_chunk->total_events,
                                    (char *) event_chunk->tag,
                                    flb_sds_len(event_chunk->tag),
@@ -1633,13 +1632,20 @@ static int cb_loki_format_test(struct flb_config *config,
 {
     int total_records;
     flb_sds_t payload = NULL;
+    struct flb_arena *arena;
     struct flb_loki *ctx = plugin_context;
 
     /* Count number of records */
     total_records = flb_mp_count(data, bytes);
 
-    payload = loki_compose_payload(ctx, total_records,
+    arena = flb_arena_create(FLB_ARENA_BLOCK_SIZE);
+    if (!arena) {
+        return -1;
+    }
+
+    payload = loki_compose_payload(ctx, arena, total_records,
                                    (char *) tag, tag_len, data, bytes);
+    flb_arena_destroy(arena);
     if (payload == NULL) {
         return -1;
     }
@@ -68,6 +68,13 @@ static struct flb_aws_header content_encoding_header = {
     .val_len = 4,
 };
 
+/* gzip and zstd objects are uploaded with their Content-Encoding */
+static int is_content_encoded(struct flb_s3 *ctx)
+{
+    return ctx->compression == FLB_AWS_COMPRESS_GZIP ||
+           ctx->compression == FLB_AWS_COMPRESS_ZSTD;
+}
+
 static struct flb_aws_header content_type_header = {
     .key = "Content-Type",
     .key_len = 12,
@@ -139,7 +146,7 @@ int create_headers(struct flb_s3 *ctx, char *body_md5,
     if (ctx->content_type != NULL) {
         headers_len++;
     }
-    if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+    if (is_content_encoded(ctx)) {
         headers_len++;
     }
     if (ctx->canned_acl != NULL) {
@@ -169,8 +176,11 @@ int create_headers(struct flb_s3 *ctx, char *body_md5,
         s3_headers[n].val_len = strlen(ctx->content_type);
         n++;
     }
-    if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+    if (is_content_encoded(ctx)) {
         s3_headers[n] = content_encoding_header;
+        if (ctx->compression == FLB_AWS_COMPRESS_ZSTD) {
+            s3_headers[n].val = "zstd";
+        }
         n++;
     }
     if (ctx->canned_acl != NULL) {
@@ -672,7 +682,7 @@ static int cb_s3_init(struct flb_output_instance *ins,
             flb_plg_error(ctx->ins, "upload_chunk_size must be at least 5,242,880 bytes");
             return -1;
         }
-        if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+        if (is_content_encoded(ctx)) {
             if(ctx->upload_chunk_size > MAX_CHUNKED_UPLOAD_COMPRESS_SIZE) {
                 flb_plg_error(ctx->ins, "upload_chunk_size in compressed multipart upload cannot exceed 5GB");
                 return -1;
@@ -992,7 +1002,7 @@ static int upload_data(struct flb_s3 *ctx, struct s3_file *chunk,
     size_t payload_size = 0;
     size_t preCompress_size = 0;
 
-    if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+    if (is_content_encoded(ctx)) {
         /* Map payload */
         ret = flb_aws_compression_compress(ctx->compression, body, body_size, &payload_buf, &payload_size);
         if (ret == -1) {
@@ -1035,7 +1045,7 @@ static int upload_data(struct flb_s3 *ctx, struct s3_file *chunk,
             goto multipart;
         }
         else {
-            if (ctx->use_put_object == FLB_FALSE && ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+            if (ctx->use_put_object == FLB_FALSE && is_content_encoded(ctx)) {
                 flb_plg_info(ctx->ins, "Pre-compression upload_chunk_size= %d, After compression, chunk is only %d bytes, "
                                        "the chunk was too small, using PutObject to upload", preCompress_size, body_size);
             }
@@ -1065,7 +1075,7 @@ put_object:
     }
 
     ret = s3_put_object(ctx, tag, create_time, body, body_size);
-    if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+    if (is_content_encoded(ctx)) {
         flb_free(payload_buf);
     }
     if (ret < 0) {
@@ -1092,7 +1102,7 @@ multipart:
             if (chunk) {
                 s3_store_file_unlock(chunk);
             }
-            if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+            if (is_content_encoded(ctx)) {
                 flb_free(payload_buf);
             }
             return FLB_RETRY;
@@ -1106,7 +1116,7 @@ multipart:
             if (chunk) {
                 s3_store_file_unlock(chunk);
             }
-            if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+            if (is_content_encoded(ctx)) {
                 flb_free(payload_buf);
             }
             return FLB_RETRY;
@@ -1116,7 +1126,7 @@ multipart:
 
     ret = upload_part(ctx, m_upload, body, body_size);
     if (ret < 0) {
-        if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+        if (is_content_encoded(ctx)) {
             flb_free(payload_buf);
         }
         m_upload->upload_errors += 1;
@@ -1142,7 +1152,7 @@ multipart:
         s3_store_file_delete(ctx, chunk);
         chunk = NULL;
     }
-    if (ctx->compression == FLB_AWS_COMPRESS_GZIP) {
+    if (is_content_encoded(ctx)) {
         flb_free(payload_buf);
     }
     if (m_upload->bytes >= ctx->file_size) {
@@ -2350,10 +2360,11 @@ static struct flb_config_map config_map[] = {
     {
      FLB_CONFIG_MAP_STR, "compression", NULL,
      0, FLB_FALSE, 0,
-    "Compression type for S3 objects. 'gzip' and 'arrow' are the supported values. "
-    "'arrow' is only an available if Apache Arrow was enabled at compile time. "
-    "Defaults to no compression. "
-    "If 'gzip' is selected, the Content-Encoding HTTP Header will be set to 'gzip'."
+    "Compression type for S3 objects. 'gzip', 'zstd' and 'arrow' are the supported "
+    "values. 'zstd' and 'arrow' are only available if they were enabled at compile "
+    "time. Defaults to no compression. "
+    "If 'gzip' or 'zstd' is selected, the Content-Encoding HTTP Header will be set "
+    "accordingly."
     },
     {
      FLB_CONFIG_MAP_STR, "content_type", NULL,
@@ -23,6 +23,9 @@
 
 #include <fluent-bit/aws/flb_aws_compress.h>
 #include <fluent-bit/flb_gzip.h>
+#ifdef FLB_HAVE_ZSTD
+#include <fluent-bit/flb_zstd.h>
+#endif
 
 #include <stdint.h>
 
@@ -48,6 +51,13 @@ static const struct compression_option compression_options[] = {
         "gzip",
         &flb_gzip_compress
     },
+#ifdef FLB_HAVE_ZSTD
+    {
+        FLB_AWS_COMPRESS_ZSTD,
+        "zstd",
+        &flb_zstd_compress
+    },
+#endif
 #ifdef FLB_HAVE_ARROW
     {
         FLB_AWS_COMPRESS_ARROW,
@@ -0,0 +1,298 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_arena.h>
+
+#include <string.h>
+
+#define ALIGN_UP(n)   (((n) + FLB_ARENA_ALIGN - 1) & ~((size_t) FLB_ARENA_ALIGN - 1))
+
+/* the block header is followed by its data, aligned */
+#define BLOCK_HEADER  ALIGN_UP(sizeof(struct flb_arena_block))
+
+static struct flb_arena_block *block_create(size_t size)
+{
+    struct flb_arena_block *block;
+
+    block = flb_malloc(BLOCK_HEADER + size);
+    if (!block) {
+        flb_errno();
+        return NULL;
+    }
+    block->size = size;
+    block->offset = 0;
+    block->next = NULL;
+    block->data = (char *) block + BLOCK_HEADER;
+
+    return block;
+}
+
+struct flb_arena *flb_arena_create(size_t block_size)
+{
+    struct flb_arena *arena;
+
+    arena = flb_calloc(1, sizeof(struct flb_arena));
+    if (!arena) {
+        flb_errno();
+        return NULL;
+    }
+
+    if (block_size == 0) {
+        block_size = FLB_ARENA_BLOCK_SIZE;
+    }
+    arena->block_size = ALIGN_UP(block_size);
+
+    /* the first block is allocated on the first request */
+    return arena;
+}
+
+static void large_release(struct flb_arena *arena, struct flb_arena_block *until)
+{
+    struct flb_arena_block *block;
+
+    while (arena->large != NULL && arena->large != until) {
+        block = arena->large;
+        arena->large = block->next;
+        flb_free(block);
+    }
+}
+
+void flb_arena_destroy(struct flb_arena *arena)
+{
+    struct flb_arena_block *next;
+    struct flb_arena_block *block;
+
+    if (!arena) {
+        return;
+    }
+
+    large_release(arena, NULL);
+
+    block = arena->head;
+    while (block) {
+        next = block->next;
+        flb_free(block);
+        block = next;
+    }
+    flb_free(arena);
+}
+
+/* Release all the allocations, the blocks are kept for the next round */
+void flb_arena_reset(struct flb_arena *arena)
+{
+    large_release(arena, NULL);
+
+    /* the next blocks get their offset reset when they are reached */
+    if (arena->head) {
+        arena->head->offset = 0;
+    }
+    arena->current = arena->head;
+    arena->last = NULL;
+}
+
+void *flb_arena_alloc(struct flb_arena *arena, size_t size)
+{
+    void *ptr;
+    struct flb_arena_block *block;
+
+    size = ALIGN_UP(size);
+    if (size == 0) {
+        size = FLB_ARENA_ALIGN;
+    }
+
+    if (size > arena->block_size / 4) {
+        block = block_create(size);
+        if (!block) {
+            return NULL;
+        }
+        block->next = arena->large;
+        arena->large = block;
+        arena->last = NULL;
+        return block->data;
+    }
+
+    block = arena->current;
+    if (block == NULL) {
+        if (arena->head == NULL) {
+            arena->head = block_create(arena->block_size);
+            if (!arena->head) {
+                return NULL;
+            }
+        }
+        block = arena->head;
+        block->offset = 0;
+        arena->current = block;
+    }
+
+    if (block->size - block->offset < size) {
+        if (block->next == NULL) {
+            block->next = block_create(arena->block_size);
+            if (!block->next) {
+                return NULL;
+            }
+        }
+        block = block->next;
+        block->offset = 0;
+        arena->current = block;
+    }
+
+    ptr = block->data + block->offset;
+    block->offset += size;
+    arena->last = ptr;
+
+    return ptr;
+}
+
+void *flb_arena_calloc(struct flb_arena *arena, size_t n, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && n > ((size_t) -1) / size) {
+        return NULL;
+    }
+
+    ptr = flb_arena_alloc(arena, n * size);
+    if (ptr) {
+        memset(ptr, 0, n * size);
+    }
+
+    return ptr;
+}
+
+/* Grow an allocation, in place when it's the last one of the block */
+void *flb_arena_realloc(struct flb_arena *arena, void *ptr,
+                        size_t old_size, size_t new_size)
+{
+    void *tmp;
+    size_t old_aligned;
+    size_t new_aligned;
+    struct flb_arena_block *block = arena->current;
+
+    if (ptr == NULL) {
+        return flb_arena_alloc(arena, new_size);
+    }
+
+    if (new_size <= old_size) {
+        return ptr;
+    }
+
+    old_aligned = ALIGN_UP(old_size);
+    new_aligned = ALIGN_UP(new_size);
+    if (ptr == arena->last && block != NULL &&
+        new_aligned <= arena->block_size / 4 &&
+        block->offset - old_aligned + new_aligned <= block->size) {
+        block->offset += new_aligned - old_aligned;
+        return ptr;
+    }
+
+    tmp = flb_arena_alloc(arena, new_size);
+    if (!tmp) {
+        return NULL;
+    }
+    memcpy(tmp, ptr, old_size);
+
+    return tmp;
+}
+
+char *flb_arena_strndup(struct flb_arena *arena, const char *str, size_t len)
+{
+    char *buf;
+
+    buf = flb_arena_alloc(arena, len + 1);
+    if (!buf) {
+        return NULL;
+    }
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+
+    return buf;
+}
+
+/*
+ * Save the current position, flb_arena_rewind() releases everything that
+ * was allocated after it. Useful for scratch data needed per record.
+ */
+void flb_arena_mark(struct flb_arena *arena, struct flb_arena_mark *mark)
+{
+    mark->block = arena->current;
+    mark->offset = arena->current ? arena->current->offset : 0;
+    mark->large = arena->large;
+}
+
+void flb_arena_rewind(struct flb_arena *arena, struct flb_arena_mark *mark)
+{
+    large_release(arena, mark->large);
+
+    arena->current = mark->block;
+    if (mark->block) {
+        mark->block->offset = mark->offset;
+    }
+    arena->last = NULL;
+}
+
+/*
+ * Initialize a buffer, 'size' is the size of the first allocation that is
+ * done on the first append.
+ */
+void flb_arena_buf_init(struct flb_arena_buf *buf, struct flb_arena *arena,
+                        size_t size)
+{
+    buf->data = NULL;
+    buf->size = 0;
+    buf->alloc = size;
+    buf->arena = arena;
+}
+
+int flb_arena_buf_append(struct flb_arena_buf *buf, const char *str, size_t len)
+{
+    char *tmp;
+    size_t old_size = 0;
+    size_t new_size;
+
+    if (buf->data) {
+        old_size = buf->alloc;
+    }
+
+    if (buf->data == NULL || buf->size + len > buf->alloc) {
+        new_size = buf->alloc ? buf->alloc : FLB_ARENA_ALIGN;
+        while (buf->size + len > new_size) {
+            new_size *= 2;
+        }
+        tmp = flb_arena_realloc(buf->arena, buf->data, old_size, new_size);
+        if (!tmp) {
+            return -1;
+        }
+        buf->data = tmp;
+        buf->alloc = new_size;
+    }
+
+    memcpy(buf->data + buf->size, str, len);
+    buf->size += len;
+
+    return 0;
+}
+
+/* msgpack_packer write callback */
+int flb_arena_buf_write(void *data, const char *str, size_t len)
+{
+    return flb_arena_buf_append((struct flb_arena_buf *) data, str, len);
+}
@@ -0,0 +1,136 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_compression.h>
+#include <fluent-bit/flb_gzip.h>
+
+#ifdef FLB_HAVE_ZSTD
+#include <fluent-bit/flb_zstd.h>
+#endif
+
+#include <string.h>
+
+struct compression_algorithm {
+    int algorithm;
+    char *name;
+    int (*compress)(void *in_data, size_t in_len,
+                    void **out_data, size_t *out_len);
+    int (*uncompress)(void *in_data, size_t in_len,
+                      void **out_data, size_t *out_len);
+};
+
+static const struct compression_algorithm algorithms[] = {
+    {
+        FLB_COMPRESSION_ALGORITHM_GZIP,
+        "gzip",
+        flb_gzip_compress,
+        flb_gzip_uncompress
+    },
+#ifdef FLB_HAVE_ZSTD
+    {
+        FLB_COMPRESSION_ALGORITHM_ZSTD,
+        "zstd",
+        flb_zstd_compress,
+        flb_zstd_uncompress
+    },
+#endif
+    { 0 }
+};
+
+static const struct compression_algorithm *get_algorithm(int algorithm)
+{
+    const struct compression_algorithm *a;
+
+    for (a = algorithms; a->name != NULL; a++) {
+        if (a->algorithm == algorithm) {
+            return a;
+        }
+    }
+
+    return NULL;
+}
+
+int flb_compression_get_algorithm_len(const char *name, size_t len)
+{
+    const struct compression_algorithm *a;
+
+    if (len == 4 && strncasecmp(name, "none", 4) == 0) {
+        return FLB_COMPRESSION_ALGORITHM_NONE;
+    }
+
+    for (a = algorithms; a->name != NULL; a++) {
+        if (strlen(a->name) == len && strncasecmp(a->name, name, len) == 0) {
+            return a->algorithm;
+        }
+    }
+
+    return -1;
+}
+
+int flb_compression_get_algorithm(const char *name)
+{
+    return flb_compression_get_algorithm_len(name, strlen(name));
+}
+
+const char *flb_compression_get_name(int algorithm)
+{
+    const struct compression_algorithm *a;
+
+    if (algorithm == FLB_COMPRESSION_ALGORITHM_NONE) {
+        return "none";
+    }
+
+    a = get_algorithm(algorithm);
+    if (!a) {
+        return NULL;
+    }
+
+    return a->name;
+}
+
+int flb_compression_compress(int algorithm, void *in_data, size_t in_len,
+                             void **out_data, size_t *out_len)
+{
+    const struct compression_algorithm *a;
+
+    a = get_algorithm(algorithm);
+    if (!a) {
+        flb_error("[compression] invalid algorithm: %i", algorithm);
+        return -1;
+    }
+
+    return a->compress(in_data, in_len, out_data, out_len);
+}
+
+int flb_compression_uncompress(int algorithm, void *in_data, size_t in_len,
+                               void **out_data, size_t *out_len)
+{
+    const struct compression_algorithm *a;
+
+    a = get_algorithm(algorithm);
+    if (!a) {
+        flb_error("[compression] invalid algorithm: %i", algorithm);
+        return -1;
+    }
+
+    return a->uncompress(in_data, in_len, out_data, out_len);
+}
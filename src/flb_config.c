@@ -42,6 +42,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_config_format.h>
 #include <fluent-bit/multiline/flb_ml.h>
+#include <fluent-bit/flb_hash_table.h>
 #include <fluent-bit/flb_bucket_queue.h>
 
 const char *FLB_CONF_ENV_LOGLEVEL = "FLB_LOG_LEVEL";
@@ -143,6 +144,18 @@ struct flb_service_config service_configs[] = {
     {FLB_CONF_STORAGE_MAX_CHUNKS_UP,
      FLB_CONF_TYPE_INT,
      offsetof(struct flb_config, storage_max_chunks_up)},
+    {FLB_CONF_STORAGE_SYNC_WINDOW,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, storage_sync_window)},
+    {FLB_CONF_STORAGE_PREALLOC_SIZE,
+     FLB_CONF_TYPE_STR,
+     offsetof(struct flb_config, storage_prealloc_size)},
+    {FLB_CONF_STORAGE_COMPRESSION,
+     FLB_CONF_TYPE_STR,
+     offsetof(struct flb_config, storage_compression)},
+    {FLB_CONF_STORAGE_COMPRESSION_DICT,
+     FLB_CONF_TYPE_STR,
+     offsetof(struct flb_config, storage_compression_dict)},
 
     /* Coroutines */
     {FLB_CONF_STR_CORO_STACK_SIZE,
@@ -157,6 +170,11 @@ struct flb_service_config service_configs[] = {
      FLB_CONF_TYPE_INT,
      offsetof(struct flb_config, sched_base)},
 
+    /* Filters */
+    {FLB_CONF_STR_FILTER_WORKERS,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, filter_workers)},
+
 #ifdef FLB_HAVE_STREAM_PROCESSOR
     {FLB_CONF_STR_STREAMS_FILE,
      FLB_CONF_TYPE_STR,
@@ -258,6 +276,9 @@ struct flb_config *flb_config_init()
     config->sched_cap  = FLB_SCHED_CAP;
     config->sched_base = FLB_SCHED_BASE;
 
+    config->filter_workers = 0;
+    config->filter_worker_pool = NULL;
+
 #ifdef FLB_HAVE_SQLDB
     mk_list_init(&config->sqldb_list);
 #endif
@@ -307,6 +328,21 @@ struct flb_config *flb_config_init()
 
     /* Multiline core */
     mk_list_init(&config->multiline_parsers);
+
+    /* Parsers lookup by name */
+    config->parsers_index = flb_hash_table_create(FLB_HASH_TABLE_EVICT_NONE,
+                                                  FLB_CONFIG_PARSERS_INDEX_SIZE,
+                                                  0);
+    config->multiline_parsers_index =
+        flb_hash_table_create(FLB_HASH_TABLE_EVICT_NONE,
+                              FLB_CONFIG_PARSERS_INDEX_SIZE, 0);
+    if (!config->parsers_index || !config->multiline_parsers_index) {
+        flb_error("[config] could not create the parsers index");
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    /* Multiline built-in parsers */
     flb_ml_init(config);
 
     /* Register static plugins */
@@ -439,6 +475,13 @@ void flb_config_exit(struct flb_config *config)
     flb_parser_exit(config);
 #endif
 
+    if (config->parsers_index) {
+        flb_hash_table_destroy(config->parsers_index);
+    }
+    if (config->multiline_parsers_index) {
+        flb_hash_table_destroy(config->multiline_parsers_index);
+    }
+
     if (config->dns_mode) {
         flb_free(config->dns_mode);
     }
@@ -455,6 +498,15 @@ void flb_config_exit(struct flb_config *config)
     if (config->storage_bl_mem_limit) {
         flb_free(config->storage_bl_mem_limit);
     }
+    if (config->storage_prealloc_size) {
+        flb_free(config->storage_prealloc_size);
+    }
+    if (config->storage_compression) {
+        flb_free(config->storage_compression);
+    }
+    if (config->storage_compression_dict) {
+        flb_free(config->storage_compression_dict);
+    }
 
 #ifdef FLB_HAVE_STREAM_PROCESSOR
     if (config->stream_processor_file) {
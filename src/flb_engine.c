@@ -52,6 +52,7 @@
 #include <fluent-bit/flb_upstream.h>
 #include <fluent-bit/flb_downstream.h>
 #include <fluent-bit/flb_ring_buffer.h>
+#include <fluent-bit/flb_filter_worker.h>
 
 #ifdef FLB_HAVE_METRICS
 #include <fluent-bit/flb_metrics_exporter.h>
@@ -157,6 +158,12 @@ int flb_engine_flush(struct flb_config *config,
         flb_engine_dispatch(0, in, config);
     }
 
+    /*
+     * Deliver the batches that did not reach the target size in time, all of
+     * them once the engine is shutting down.
+     */
+    flb_output_batch_flush(config, config->is_shutting_down);
+
     return 0;
 }
 
@@ -444,6 +451,7 @@ static inline int flb_engine_manager(flb_pipefd_t fd, struct flb_config *config)
         if (key == FLB_ENGINE_STOP) {
             flb_trace("[engine] flush enqueued data");
             flb_engine_flush(config, NULL);
+            flb_output_batch_flush(config, FLB_TRUE);
             return FLB_ENGINE_STOP;
         }
     }
@@ -706,6 +714,13 @@ int flb_engine_start(struct flb_config *config)
     flb_sched_ctx_init();
     flb_sched_ctx_set(sched);
 
+    /* Queue for the records ingested by the threaded inputs */
+    ret = flb_input_chunk_queue_create(config);
+    if (ret == -1) {
+        flb_error("[engine] could not create the input queue");
+        return -1;
+    }
+
     /* Initialize input plugins */
     ret = flb_input_init_all(config);
     if (ret == -1) {
@@ -720,6 +735,13 @@ int flb_engine_start(struct flb_config *config)
         return -1;
     }
 
+    /* Start the filter workers (if enabled) */
+    ret = flb_filter_worker_pool_create(config);
+    if (ret == -1) {
+        flb_error("[engine] filter workers initialization failed");
+        return -1;
+    }
+
     /* Inputs pre-run */
     flb_input_pre_run_all(config);
 
@@ -817,14 +839,30 @@ int flb_engine_start(struct flb_config *config)
         rb_ms = atoi(rb_env);
     }
 
-    /* Input instance / Ring buffer collector */
-    ret = flb_sched_timer_cb_create(config->sched,
-                                    FLB_SCHED_TIMER_CB_PERM,
-                                    rb_ms, flb_input_chunk_ring_buffer_collector,
-                                    config, NULL);
-    if (ret == -1) {
-        flb_error("[engine] could not schedule permanent callback");
-        return -1;
+    /* Filter workers results collector */
+    if (config->filter_worker_pool) {
+        ret = flb_sched_timer_cb_create(config->sched,
+                                        FLB_SCHED_TIMER_CB_PERM,
+                                        rb_ms, flb_filter_worker_collect,
+                                        config, NULL);
+        if (ret == -1) {
+            flb_error("[engine] could not schedule permanent callback");
+            return -1;
+        }
+    }
+
+    /* Storage group commit */
+    if (config->cio &&
+        (((struct cio_ctx *) config->cio)->options.flags & CIO_GROUP_COMMIT)) {
+        ret = flb_sched_timer_cb_create(config->sched,
+                                        FLB_SCHED_TIMER_CB_PERM,
+                                        config->storage_sync_window,
+                                        flb_storage_sync_commit,
+                                        NULL, NULL);
+        if (ret == -1) {
+            flb_error("[engine] could not schedule permanent callback");
+            return -1;
+        }
     }
 
     /* Signal that we have started */
@@ -982,7 +1020,7 @@ int flb_engine_start(struct flb_config *config)
         }
 
         if (rb_flush_flag) {
-            flb_input_chunk_ring_buffer_collector(config, NULL);
+            flb_filter_worker_collect(config, NULL);
         }
 
         /* Cleanup functions associated to events and timers */
@@ -1012,6 +1050,12 @@ int flb_engine_shutdown(struct flb_config *config)
     config->is_running = FLB_FALSE;
     flb_input_pause_all(config);
 
+    /* ingest the records enqueued by the threaded inputs */
+    flb_input_chunk_queue_collector(config, NULL);
+
+    /* ingest the records pending in the filter workers */
+    flb_filter_worker_pool_destroy(config);
+
 #ifdef FLB_HAVE_STREAM_PROCESSOR
     if (config->stream_processor_ctx) {
         flb_sp_destroy(config->stream_processor_ctx);
@@ -1023,6 +1067,7 @@ int flb_engine_shutdown(struct flb_config *config)
 
     /* cleanup plugins */
     flb_input_exit_all(config);
+    flb_input_chunk_queue_destroy(config);
     flb_filter_exit(config);
     flb_output_exit(config);
     flb_custom_exit(config);
@@ -185,9 +185,15 @@ static int tasks_start(struct flb_input_instance *in,
 
             /*
              * We have the Task and the Route, created a thread context for the
-             * data handling.
+             * data handling. If the output batches the tasks, the task joins
+             * the open batch for its tag.
              */
-            flb_output_task_flush(task, route->out, config);
+            if (out->batch == FLB_TRUE) {
+                flb_output_batch_add(task, route->out, config);
+            }
+            else {
+                flb_output_task_flush(task, route->out, config);
+            }
 
             /*
             th = flb_output_thread(task,
@@ -26,6 +26,7 @@
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_metrics.h>
+#include <fluent-bit/flb_filter_worker.h>
 #include <chunkio/chunkio.h>
 
 #ifdef FLB_HAVE_CHUNK_TRACE
@@ -57,12 +58,44 @@ static inline int prop_key_check(const char *key, const char *kv, int k_len)
     return -1;
 }
 
+/*
+ * With filter workers the same instance runs in several threads: the
+ * callback of a filter that is not flagged as thread safe is serialized.
+ */
+static inline int filter_lock_required(struct flb_filter_instance *f_ins,
+                                       struct flb_config *config)
+{
+    if (!config->filter_worker_pool) {
+        return FLB_FALSE;
+    }
+
+    return !(f_ins->p->flags & FLB_FILTER_THREAD_SAFE);
+}
+
+#ifdef FLB_HAVE_METRICS
+/* the legacy metrics are plain counters, serialize them across workers */
+static inline void filter_metrics_sum(struct flb_filter_instance *f_ins,
+                                      int id, size_t val,
+                                      struct flb_config *config)
+{
+    if (!config->filter_worker_pool) {
+        flb_metrics_sum(id, val, f_ins->metrics);
+        return;
+    }
+
+    pthread_mutex_lock(&f_ins->lock);
+    flb_metrics_sum(id, val, f_ins->metrics);
+    pthread_mutex_unlock(&f_ins->lock);
+}
+#endif
+
 void flb_filter_do(struct flb_input_chunk *ic,
                    const void *data, size_t bytes,
                    const char *tag, int tag_len,
                    struct flb_config *config)
 {
     int ret;
+    int locked;
 #ifdef FLB_HAVE_METRICS
     int in_records = 0;
     int out_records = 0;
@@ -135,6 +168,10 @@ void flb_filter_do(struct flb_input_chunk *ic,
             }
 #endif /* FLB_HAVE_CHUNK_TRACE */
             /* Invoke the filter callback */
+            locked = filter_lock_required(f_ins, config);
+            if (locked) {
+                pthread_mutex_lock(&f_ins->lock);
+            }
             ret = f_ins->p->cb_filter(work_data,      /* msgpack buffer   */
                                       work_size,      /* msgpack size     */
                                       ntag, tag_len,  /* input tag        */
@@ -144,6 +181,12 @@ void flb_filter_do(struct flb_input_chunk *ic,
                                       i_ins,          /* input instance   */
                                       f_ins->context, /* filter priv data */
                                       config);
+            if (f_ins->arena) {
+                flb_arena_reset(f_ins->arena);
+            }
+            if (locked) {
+                pthread_mutex_unlock(&f_ins->lock);
+            }
 #ifdef FLB_HAVE_CHUNK_TRACE
             if (ic->trace) {
                 flb_time_get(&tm_finish);
@@ -158,8 +201,10 @@ void flb_filter_do(struct flb_input_chunk *ic,
             cmt_counter_add(f_ins->cmt_bytes, ts, content_size,
                     1, (char *[]) {name});
 
-            flb_metrics_sum(FLB_METRIC_N_RECORDS, in_records, f_ins->metrics);
-            flb_metrics_sum(FLB_METRIC_N_BYTES, content_size, f_ins->metrics);
+            filter_metrics_sum(f_ins, FLB_METRIC_N_RECORDS,
+                               in_records, config);
+            filter_metrics_sum(f_ins, FLB_METRIC_N_BYTES,
+                               content_size, config);
 #endif
 
             /* Override buffer just if it was modified */
@@ -183,8 +228,8 @@ void flb_filter_do(struct flb_input_chunk *ic,
                                     1, (char *[]) {name});
 
                     /* [OLD] Summarize all records removed */
-                    flb_metrics_sum(FLB_METRIC_N_DROPPED,
-                                    in_records, f_ins->metrics);
+                    filter_metrics_sum(f_ins, FLB_METRIC_N_DROPPED,
+                                       in_records, config);
 #endif
                     break;
                 }
@@ -199,8 +244,8 @@ void flb_filter_do(struct flb_input_chunk *ic,
                                     1, (char *[]) {name});
 
                         /* [OLD] Summarize new records */
-                        flb_metrics_sum(FLB_METRIC_N_ADDED,
-                                        diff, f_ins->metrics);
+                        filter_metrics_sum(f_ins, FLB_METRIC_N_ADDED,
+                                           diff, config);
                     }
                     else if (out_records < in_records) {
                         diff = (in_records - out_records);
@@ -210,8 +255,8 @@ void flb_filter_do(struct flb_input_chunk *ic,
                                     1, (char *[]) {name});
 
                         /* [OLD] Summarize dropped records */
-                        flb_metrics_sum(FLB_METRIC_N_DROPPED,
-                                        diff, f_ins->metrics);
+                        filter_metrics_sum(f_ins, FLB_METRIC_N_DROPPED,
+                                           diff, config);
                     }
 
                     /* set number of records in new chunk */
@@ -252,6 +297,148 @@ void flb_filter_do(struct flb_input_chunk *ic,
     flb_free(ntag);
 }
 
+/*
+ * Apply the filter chain to a buffer that is not linked to an input chunk,
+ * used by the filter workers. If any filter modified the records, the new
+ * buffer is returned in 'out_buf' (the caller must release it) and the
+ * function returns FLB_FILTER_MODIFIED. An empty output buffer means that
+ * all the records were dropped.
+ *
+ * Different workers can run the same filter instance: the callbacks of the
+ * filters that are not thread safe are serialized through the instance lock
+ * (flb_filter_do() takes it too), each worker has its own arena.
+ */
+int flb_filter_run(struct flb_input_instance *i_ins,
+                   const char *tag, int tag_len,
+                   const void *data, size_t bytes, size_t records,
+                   void **out_buf, size_t *out_bytes,
+                   struct flb_config *config)
+{
+    int ret;
+    int locked;
+    int modified = FLB_FALSE;
+#ifdef FLB_HAVE_METRICS
+    int in_records;
+    int out_records;
+    int diff;
+    uint64_t ts;
+    char *name;
+#endif
+    const char *work_data;
+    size_t work_size;
+    void *cur_buf = NULL;
+    void *f_buf;
+    size_t f_size;
+    struct mk_list *head;
+    struct flb_filter_instance *f_ins;
+    struct flb_filter_worker *worker;
+
+    work_data = (const char *) data;
+    work_size = bytes;
+    worker = flb_filter_worker_get(config);
+
+#ifdef FLB_HAVE_METRICS
+    ts = cfl_time_now();
+    in_records = records;
+#endif
+
+    mk_list_foreach(head, &config->filters) {
+        f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
+        if (!flb_router_match(tag, tag_len, f_ins->match
+#ifdef FLB_HAVE_REGEX
+        , f_ins->match_regex
+#else
+        , NULL
+#endif
+           )) {
+            continue;
+        }
+
+        f_buf = NULL;
+        f_size = 0;
+
+        locked = filter_lock_required(f_ins, config);
+        if (locked) {
+            pthread_mutex_lock(&f_ins->lock);
+        }
+        ret = f_ins->p->cb_filter(work_data, work_size,
+                                  tag, tag_len,
+                                  &f_buf, &f_size,
+                                  f_ins, i_ins,
+                                  f_ins->context, config);
+        if (worker && worker->arena) {
+            flb_arena_reset(worker->arena);
+        }
+        if (locked) {
+            pthread_mutex_unlock(&f_ins->lock);
+        }
+
+#ifdef FLB_HAVE_METRICS
+        name = (char *) flb_filter_name(f_ins);
+
+        cmt_counter_add(f_ins->cmt_records, ts, in_records,
+                        1, (char *[]) {name});
+        cmt_counter_add(f_ins->cmt_bytes, ts, work_size,
+                        1, (char *[]) {name});
+
+        filter_metrics_sum(f_ins, FLB_METRIC_N_RECORDS,
+                           in_records, config);
+        filter_metrics_sum(f_ins, FLB_METRIC_N_BYTES,
+                           work_size, config);
+#endif
+
+        if (ret != FLB_FILTER_MODIFIED) {
+            continue;
+        }
+
+        /* the previous output is not longer referenced by the chain */
+        if (cur_buf) {
+            flb_free(cur_buf);
+        }
+        cur_buf = f_buf;
+        work_data = f_buf;
+        work_size = f_size;
+        modified = FLB_TRUE;
+
+#ifdef FLB_HAVE_METRICS
+        out_records = (f_size > 0) ? flb_mp_count(f_buf, f_size) : 0;
+        if (out_records > in_records) {
+            diff = out_records - in_records;
+            cmt_counter_add(f_ins->cmt_add_records, ts, diff,
+                            1, (char *[]) {name});
+            filter_metrics_sum(f_ins, FLB_METRIC_N_ADDED, diff, config);
+        }
+        else if (out_records < in_records) {
+            diff = in_records - out_records;
+            cmt_counter_add(f_ins->cmt_drop_records, ts, diff,
+                            1, (char *[]) {name});
+            filter_metrics_sum(f_ins, FLB_METRIC_N_DROPPED, diff, config);
+        }
+        in_records = out_records;
+#endif
+
+        /* all records removed, no data to continue processing */
+        if (f_size == 0) {
+            break;
+        }
+    }
+
+    if (modified == FLB_FALSE) {
+        *out_buf = NULL;
+        *out_bytes = 0;
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    if (work_size == 0 && cur_buf) {
+        flb_free(cur_buf);
+        cur_buf = NULL;
+    }
+
+    *out_buf = cur_buf;
+    *out_bytes = work_size;
+    return FLB_FILTER_MODIFIED;
+}
+
 int flb_filter_set_property(struct flb_filter_instance *ins,
                             const char *k, const char *v)
 {
@@ -389,6 +576,7 @@ struct flb_filter_instance *flb_filter_new(struct flb_config *config,
     instance->match_regex = NULL;
 #endif
     instance->log_level = -1;
+    pthread_mutex_init(&instance->lock, NULL);
 
     mk_list_init(&instance->properties);
     mk_list_add(&instance->_head, &config->filters);
@@ -584,6 +772,11 @@ void flb_filter_instance_destroy(struct flb_filter_instance *ins)
         flb_sds_destroy(ins->alias);
     }
 
+    if (ins->arena) {
+        flb_arena_destroy(ins->arena);
+    }
+
+    pthread_mutex_destroy(&ins->lock);
     mk_list_del(&ins->_head);
     flb_free(ins);
 }
@@ -592,3 +785,28 @@ void flb_filter_set_context(struct flb_filter_instance *ins, void *context)
 {
     ins->context = context;
 }
+
+/*
+ * Arena for the temporary data of the filter callback: it must only be used
+ * from cb_filter(), everything allocated from it is released once the
+ * callback returns (the buffer returned to the engine must not use it).
+ */
+struct flb_arena *flb_filter_arena_get(struct flb_filter_instance *ins)
+{
+    struct flb_filter_worker *worker;
+
+    /* filter workers run the callbacks concurrently, use their own arena */
+    worker = flb_filter_worker_get(ins->config);
+    if (worker) {
+        if (!worker->arena) {
+            worker->arena = flb_arena_create(FLB_ARENA_BLOCK_SIZE);
+        }
+        return worker->arena;
+    }
+
+    if (!ins->arena) {
+        ins->arena = flb_arena_create(FLB_ARENA_BLOCK_SIZE);
+    }
+
+    return ins->arena;
+}
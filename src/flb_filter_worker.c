@@ -0,0 +1,688 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Filter workers
+ * ==============
+ *
+ * By default the filter chain runs on the engine thread at the moment an
+ * input instance appends records. When 'filter.workers' is set in the
+ * service section, the records are handed over to a pool of threads that
+ * run the chain and give the result back to the engine, which writes it to
+ * the input chunk.
+ *
+ * Records are assigned to a worker by hashing their Tag, so all the records
+ * of the same stream are processed by the same worker and written back in
+ * the same order they were ingested. Communication uses a pair of ring
+ * buffers per worker (the same mechanism used by threaded inputs). When a
+ * ring buffer is full the work waits in a pending list behind the entries
+ * already queued, neither side blocks and the order is kept.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_mp.h>
+#include <fluent-bit/flb_arena.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_plugin.h>
+#include <fluent-bit/flb_input_chunk.h>
+#include <fluent-bit/flb_filter.h>
+#include <fluent-bit/flb_router.h>
+#include <fluent-bit/flb_engine_macros.h>
+#include <fluent-bit/flb_thread_storage.h>
+#include <fluent-bit/flb_filter_worker.h>
+
+#include <cfl/cfl.h>
+
+#define FLB_FILTER_WORKER_RING_SIZE    (sizeof(void *) * 1024)
+#define FLB_FILTER_WORKER_RING_WINDOW  (1)
+
+/* Max time a worker sleeps without checking its ring buffer */
+#define FLB_FILTER_WORKER_WAIT_MS      250
+
+static pthread_once_t local_worker_init = PTHREAD_ONCE_INIT;
+FLB_TLS_DEFINE(struct flb_filter_worker, flb_filter_worker_ctx);
+
+static void filter_worker_tls_init()
+{
+    FLB_TLS_INIT(flb_filter_worker_ctx);
+}
+
+static void work_destroy(struct flb_filter_work *work)
+{
+    if (work->tag) {
+        flb_sds_destroy(work->tag);
+    }
+    if (work->buf_data) {
+        flb_free(work->buf_data);
+    }
+    flb_free(work);
+}
+
+static struct flb_filter_work *work_create(struct flb_input_instance *ins,
+                                           int event_type, size_t records,
+                                           const char *tag, size_t tag_len,
+                                           const void *buf, size_t buf_size)
+{
+    struct flb_filter_work *work;
+
+    work = flb_calloc(1, sizeof(struct flb_filter_work));
+    if (!work) {
+        flb_errno();
+        return NULL;
+    }
+    work->ins = ins;
+    work->event_type = event_type;
+    work->records = records;
+    work->filtered = FLB_FALSE;
+
+    if (tag && tag_len > 0) {
+        work->tag = flb_sds_create_len(tag, tag_len);
+        if (!work->tag) {
+            flb_free(work);
+            return NULL;
+        }
+    }
+
+    work->buf_data = flb_malloc(buf_size);
+    if (!work->buf_data) {
+        flb_errno();
+        work_destroy(work);
+        return NULL;
+    }
+    memcpy(work->buf_data, buf, buf_size);
+    work->buf_size = buf_size;
+
+    return work;
+}
+
+/*
+ * Move the pending work of a list into a ring buffer, oldest first. Returns
+ * FLB_TRUE if the list was emptied.
+ */
+static int pending_flush(struct mk_list *list, struct flb_ring_buffer *rb)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_filter_work *work;
+
+    mk_list_foreach_safe(head, tmp, list) {
+        work = mk_list_entry(head, struct flb_filter_work, _head);
+        if (flb_ring_buffer_write(rb, (void *) &work, sizeof(work)) != 0) {
+            return FLB_FALSE;
+        }
+        mk_list_del(&work->_head);
+    }
+
+    return FLB_TRUE;
+}
+
+/*
+ * Give the pending results of the worker to the engine. If the output ring
+ * buffer is still full, flag it so the engine wakes us up once it consumed
+ * some entries.
+ */
+static int worker_flush_pending(struct flb_filter_worker *worker)
+{
+    if (mk_list_is_empty(&worker->out_pending) == 0) {
+        return FLB_TRUE;
+    }
+
+    __atomic_store_n(&worker->out_blocked, FLB_TRUE, __ATOMIC_SEQ_CST);
+    if (pending_flush(&worker->out_pending, worker->rb_out) == FLB_TRUE) {
+        __atomic_store_n(&worker->out_blocked, FLB_FALSE, __ATOMIC_SEQ_CST);
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+/*
+ * Enqueue the work into the worker output ring buffer, or behind the
+ * results that are already waiting for the engine to catch up.
+ */
+static void worker_emit(struct flb_filter_worker *worker,
+                        struct flb_filter_work *work)
+{
+    if (mk_list_is_empty(&worker->out_pending) == 0 &&
+        flb_ring_buffer_write(worker->rb_out,
+                              (void *) &work, sizeof(work)) == 0) {
+        return;
+    }
+
+    mk_list_add(&work->_head, &worker->out_pending);
+    worker_flush_pending(worker);
+}
+
+/* Run the filter chain over the records of a unit of work */
+static void worker_process(struct flb_filter_worker *worker,
+                           struct flb_filter_work *work)
+{
+    int ret;
+    void *out_buf;
+    size_t out_size;
+
+    ret = flb_filter_run(work->ins,
+                         work->tag, flb_sds_len(work->tag),
+                         work->buf_data, work->buf_size, work->records,
+                         &out_buf, &out_size, worker->config);
+    if (ret == FLB_FILTER_MODIFIED) {
+        flb_free(work->buf_data);
+        work->buf_data = out_buf;
+        work->buf_size = out_size;
+
+        /*
+         * All records were dropped: the work still goes back so the engine
+         * releases the bytes it accounted for the input instance.
+         */
+        work->records = (out_size > 0) ? flb_mp_count(out_buf, out_size) : 0;
+    }
+
+    work->filtered = FLB_TRUE;
+    worker_emit(worker, work);
+}
+
+/*
+ * Process the queued work. While the engine does not keep up with the
+ * results the input is left in the ring buffer, unless 'all' is set.
+ */
+static void worker_drain(struct flb_filter_worker *worker, int all)
+{
+    struct flb_filter_work *work;
+
+    /*
+     * Reset the flag before reading: a write that happens while we drain
+     * the buffer will signal us again instead of being missed.
+     */
+    worker->rb_in->flush_pending = FLB_FALSE;
+
+    while (worker_flush_pending(worker) == FLB_TRUE || all == FLB_TRUE) {
+        if (flb_ring_buffer_read(worker->rb_in,
+                                 (void *) &work, sizeof(work)) != 0) {
+            break;
+        }
+        worker_process(worker, work);
+    }
+}
+
+static void filter_worker(void *data)
+{
+    char tmp[64];
+    uint64_t val;
+    struct mk_event *event;
+    struct flb_filter_worker *worker = data;
+
+    FLB_TLS_SET(flb_filter_worker_ctx, worker);
+
+    snprintf(tmp, sizeof(tmp) - 1, "flb-filter-w%i", worker->id);
+    mk_utils_worker_rename(tmp);
+
+    flb_debug("[filter] worker #%i started", worker->id);
+
+    while (!__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE)) {
+        mk_event_wait_2(worker->evl, FLB_FILTER_WORKER_WAIT_MS);
+        mk_event_foreach(event, worker->evl) {
+            if (event->type == FLB_ENGINE_EV_THREAD_INPUT ||
+                event == &worker->event) {
+                flb_pipe_r(event->fd, &val, sizeof(val));
+            }
+        }
+        worker_drain(worker, FLB_FALSE);
+    }
+
+    /*
+     * Process anything enqueued before the stop request, the results that
+     * do not fit in the ring buffer are taken by the engine after join.
+     */
+    worker_drain(worker, FLB_TRUE);
+
+    flb_debug("[filter] worker #%i stopped", worker->id);
+    __atomic_store_n(&worker->exited, FLB_TRUE, __ATOMIC_RELEASE);
+}
+
+static int worker_init(struct flb_filter_worker *worker, int id,
+                       struct flb_config *config)
+{
+    int ret;
+
+    worker->id = id;
+    worker->config = config;
+    mk_list_init(&worker->in_pending);
+    mk_list_init(&worker->out_pending);
+
+    worker->evl = mk_event_loop_create(8);
+    if (!worker->evl) {
+        return -1;
+    }
+
+    ret = mk_event_channel_create(worker->evl,
+                                  &worker->ch_events[0],
+                                  &worker->ch_events[1],
+                                  &worker->event);
+    if (ret == -1) {
+        return -1;
+    }
+
+    worker->rb_in = flb_ring_buffer_create(FLB_FILTER_WORKER_RING_SIZE);
+    worker->rb_out = flb_ring_buffer_create(FLB_FILTER_WORKER_RING_SIZE);
+    if (!worker->rb_in || !worker->rb_out) {
+        return -1;
+    }
+
+    ret = flb_ring_buffer_add_event_loop(worker->rb_in, worker->evl,
+                                         FLB_FILTER_WORKER_RING_WINDOW);
+    if (ret != 0) {
+        return -1;
+    }
+
+    ret = flb_ring_buffer_add_event_loop(worker->rb_out, config->evl,
+                                         FLB_FILTER_WORKER_RING_WINDOW);
+    if (ret != 0) {
+        return -1;
+    }
+
+    /*
+     * Wake up the reader as soon as there is pending work: records are not
+     * batched here, each entry already holds a full buffer of records.
+     */
+    worker->rb_in->data_window = 1;
+    worker->rb_out->data_window = 1;
+
+    return 0;
+}
+
+static void pending_destroy(struct mk_list *list)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_filter_work *work;
+
+    mk_list_foreach_safe(head, tmp, list) {
+        work = mk_list_entry(head, struct flb_filter_work, _head);
+        mk_list_del(&work->_head);
+        work_destroy(work);
+    }
+}
+
+static void worker_exit(struct flb_filter_worker *worker)
+{
+    struct flb_filter_work *work;
+
+    pending_destroy(&worker->in_pending);
+    pending_destroy(&worker->out_pending);
+
+    if (worker->rb_in) {
+        while (flb_ring_buffer_read(worker->rb_in,
+                                    (void *) &work, sizeof(work)) == 0) {
+            work_destroy(work);
+        }
+        flb_ring_buffer_destroy(worker->rb_in);
+    }
+
+    if (worker->rb_out) {
+        while (flb_ring_buffer_read(worker->rb_out,
+                                    (void *) &work, sizeof(work)) == 0) {
+            work_destroy(work);
+        }
+        flb_ring_buffer_destroy(worker->rb_out);
+    }
+
+    if (worker->arena) {
+        flb_arena_destroy(worker->arena);
+    }
+
+    if (worker->evl) {
+        if (worker->ch_events[0] > 0) {
+            mk_event_channel_destroy(worker->evl,
+                                     worker->ch_events[0],
+                                     worker->ch_events[1],
+                                     &worker->event);
+        }
+        mk_event_loop_destroy(worker->evl);
+    }
+}
+
+/* Write a unit of work to its input chunk, it runs in the engine thread */
+static void work_ingest(struct flb_filter_work *work)
+{
+    size_t tag_len;
+
+    tag_len = work->tag ? flb_sds_len(work->tag) : 0;
+
+    /* the records are not in flight anymore */
+    work->ins->mem_filter_size -= work->in_size;
+
+    if (work->filtered == FLB_TRUE && work->buf_size == 0) {
+        /* all records were dropped, resume the input if possible */
+        flb_input_chunk_set_limits(work->ins);
+    }
+    else if (work->filtered == FLB_TRUE) {
+        flb_input_chunk_append_filtered(work->ins, work->event_type,
+                                        work->records,
+                                        work->tag, tag_len,
+                                        work->buf_data, work->buf_size);
+    }
+    else {
+        flb_input_chunk_append_raw(work->ins, work->event_type,
+                                   work->records,
+                                   work->tag, tag_len,
+                                   work->buf_data, work->buf_size);
+    }
+    work_destroy(work);
+}
+
+static void pending_ingest(struct mk_list *list)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_filter_work *work;
+
+    mk_list_foreach_safe(head, tmp, list) {
+        work = mk_list_entry(head, struct flb_filter_work, _head);
+        mk_list_del(&work->_head);
+        work_ingest(work);
+    }
+}
+
+/* Ingest the results of a worker, it runs in the engine thread */
+static void collect_worker(struct flb_config *config,
+                           struct flb_filter_worker *worker)
+{
+    int count = 0;
+    uint64_t val = 1;
+    struct flb_filter_work *work;
+
+    worker->rb_out->flush_pending = FLB_FALSE;
+
+    while (flb_ring_buffer_read(worker->rb_out,
+                                (void *) &work, sizeof(work)) == 0) {
+        work_ingest(work);
+        count++;
+    }
+
+    /* there is room for the results the worker kept aside */
+    if (count > 0 &&
+        __atomic_exchange_n(&worker->out_blocked, FLB_FALSE,
+                            __ATOMIC_SEQ_CST) == FLB_TRUE) {
+        flb_pipe_w(worker->ch_events[1], &val, sizeof(val));
+    }
+}
+
+void flb_filter_worker_collect(struct flb_config *config, void *data)
+{
+    int i;
+    struct flb_filter_worker *worker;
+    struct flb_filter_worker_pool *pool;
+
+    (void) data;
+
+    pool = config->filter_worker_pool;
+    if (!pool) {
+        return;
+    }
+
+    for (i = 0; i < pool->size; i++) {
+        worker = &pool->workers[i];
+        collect_worker(config, worker);
+
+        /* the worker made progress, feed it with the work held back */
+        pending_flush(&worker->in_pending, worker->rb_in);
+    }
+}
+
+int flb_filter_worker_pool_create(struct flb_config *config)
+{
+    int i;
+    int ret;
+    struct flb_tp_thread *th;
+    struct flb_filter_worker *worker;
+    struct flb_filter_worker_pool *pool;
+
+    if (config->filter_workers <= 0 || mk_list_size(&config->filters) == 0) {
+        return 0;
+    }
+
+    pthread_once(&local_worker_init, filter_worker_tls_init);
+
+    pool = flb_calloc(1, sizeof(struct flb_filter_worker_pool));
+    if (!pool) {
+        flb_errno();
+        return -1;
+    }
+
+    pool->workers = flb_calloc(config->filter_workers,
+                               sizeof(struct flb_filter_worker));
+    if (!pool->workers) {
+        flb_errno();
+        flb_free(pool);
+        return -1;
+    }
+
+    pool->tp = flb_tp_create(config);
+    if (!pool->tp) {
+        flb_free(pool->workers);
+        flb_free(pool);
+        return -1;
+    }
+
+    for (i = 0; i < config->filter_workers; i++) {
+        worker = &pool->workers[i];
+
+        ret = worker_init(worker, i, config);
+        if (ret == -1) {
+            flb_error("[filter] could not initialize worker #%i", i);
+            worker_exit(worker);
+            break;
+        }
+
+        th = flb_tp_thread_create(pool->tp, filter_worker, worker, config);
+        if (!th) {
+            flb_error("[filter] could not register worker #%i", i);
+            worker_exit(worker);
+            break;
+        }
+        worker->th = th;
+        pool->size++;
+    }
+
+    if (pool->size == 0) {
+        flb_tp_destroy(pool->tp);
+        flb_free(pool->workers);
+        flb_free(pool);
+        return -1;
+    }
+
+    flb_tp_thread_start_all(pool->tp);
+    config->filter_worker_pool = pool;
+
+    flb_info("[filter] started %i filter workers", pool->size);
+    return 0;
+}
+
+void flb_filter_worker_pool_destroy(struct flb_config *config)
+{
+    int i;
+    uint64_t val = 1;
+    struct flb_filter_worker *worker;
+    struct flb_filter_worker_pool *pool;
+
+    pool = config->filter_worker_pool;
+    if (!pool) {
+        return;
+    }
+
+    /* records ingested from now on are filtered inline */
+    pool->stopping = FLB_TRUE;
+
+    for (i = 0; i < pool->size; i++) {
+        worker = &pool->workers[i];
+        __atomic_store_n(&worker->stop, FLB_TRUE, __ATOMIC_RELEASE);
+        flb_pipe_w(worker->ch_events[1], &val, sizeof(val));
+    }
+
+    /* the workers never wait for the engine, they finish their queue */
+    for (i = 0; i < pool->size; i++) {
+        worker = &pool->workers[i];
+        pthread_join(worker->th->tid, NULL);
+    }
+
+    config->filter_worker_pool = NULL;
+
+    /*
+     * Ingest the results in the order they were queued: the ring buffer,
+     * the results kept aside by the worker and finally the records that
+     * never reached it, those are filtered inline now.
+     */
+    for (i = 0; i < pool->size; i++) {
+        worker = &pool->workers[i];
+        collect_worker(config, worker);
+        pending_ingest(&worker->out_pending);
+        pending_ingest(&worker->in_pending);
+        worker_exit(worker);
+    }
+
+    flb_tp_destroy(pool->tp);
+    flb_free(pool->workers);
+    flb_free(pool);
+}
+
+/* Return the worker context if the caller runs in a filter worker thread */
+struct flb_filter_worker *flb_filter_worker_get(struct flb_config *config)
+{
+    if (!config->filter_worker_pool) {
+        return NULL;
+    }
+
+    return FLB_TLS_GET(flb_filter_worker_ctx);
+}
+
+static int filter_match_any(struct flb_config *config,
+                            const char *tag, int tag_len)
+{
+    struct mk_list *head;
+    struct flb_filter_instance *f_ins;
+
+    mk_list_foreach(head, &config->filters) {
+        f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
+        if (flb_router_match(tag, tag_len, f_ins->match
+#ifdef FLB_HAVE_REGEX
+        , f_ins->match_regex
+#else
+        , NULL
+#endif
+           )) {
+            return FLB_TRUE;
+        }
+    }
+
+    return FLB_FALSE;
+}
+
+/*
+ * Hand over the records to the worker that owns the Tag. Returns
+ * FLB_FILTER_WORKER_INLINE if the caller must apply the filters by itself,
+ * FLB_FILTER_WORKER_QUEUED if the records were enqueued or -1 on error.
+ *
+ * Records are never dropped nor reordered because a worker is saturated:
+ * they wait behind the queued ones until the worker catches up (the input
+ * gets paused by its memory limit meanwhile).
+ */
+int flb_filter_worker_dispatch(struct flb_input_instance *ins,
+                               size_t records,
+                               const char *tag, size_t tag_len,
+                               const void *buf, size_t buf_size)
+{
+    uint64_t hash;
+    struct flb_config *config = ins->config;
+    struct flb_filter_work *work;
+    struct flb_filter_worker *worker;
+    struct flb_filter_worker_pool *pool;
+
+    pool = config->filter_worker_pool;
+    if (!pool || pool->stopping) {
+        return FLB_FILTER_WORKER_INLINE;
+    }
+
+#ifdef FLB_HAVE_CHUNK_TRACE
+    /* traces are attached to the input chunk, keep them inline */
+    if (ins->chunk_trace_ctxt) {
+        return FLB_FILTER_WORKER_INLINE;
+    }
+#endif
+
+    if (filter_match_any(config, tag, tag_len) == FLB_FALSE) {
+        return FLB_FILTER_WORKER_INLINE;
+    }
+
+    work = work_create(ins, FLB_INPUT_LOGS, records, tag, tag_len,
+                       buf, buf_size);
+    if (!work) {
+        return -1;
+    }
+
+    hash = cfl_hash_64bits(tag, tag_len);
+    worker = &pool->workers[hash % pool->size];
+
+    work->in_size = buf_size;
+
+    /*
+     * Once the worker is saturated, the records wait behind the ones that
+     * are already held back. They are moved to the ring buffer when the
+     * results of the worker are collected.
+     */
+    if (mk_list_is_empty(&worker->in_pending) == 0 &&
+        flb_ring_buffer_write(worker->rb_in,
+                              (void *) &work, sizeof(work)) == 0) {
+        return FLB_FILTER_WORKER_QUEUED;
+    }
+
+    if (mk_list_is_empty(&worker->in_pending) == 0) {
+        flb_plg_debug(ins, "filter worker #%i is saturated, holding records",
+                      worker->id);
+    }
+    mk_list_add(&work->_head, &worker->in_pending);
+
+    return FLB_FILTER_WORKER_QUEUED;
+}
+
+/*
+ * Records appended while running a filter from a worker thread (e.g: the
+ * emitter used by rewrite_tag) go back to the engine through the worker
+ * output ring buffer, the engine ingests them as any other input.
+ */
+int flb_filter_worker_append(struct flb_filter_worker *worker,
+                             struct flb_input_instance *ins,
+                             int event_type, size_t records,
+                             const char *tag, size_t tag_len,
+                             const void *buf, size_t buf_size)
+{
+    struct flb_filter_work *work;
+
+    work = work_create(ins, event_type, records, tag, tag_len,
+                       buf, buf_size);
+    if (!work) {
+        return -1;
+    }
+
+    worker_emit(worker, work);
+    return 0;
+}
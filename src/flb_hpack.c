@@ -0,0 +1,770 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_hpack.h>
+
+#include <string.h>
+
+/* Size overhead of every entry of the dynamic table (RFC 7541 4.1) */
+#define ENTRY_OVERHEAD     32
+
+/* Longest Huffman code and the EOS symbol */
+#define HUFFMAN_MAX_BITS   30
+#define HUFFMAN_EOS        256
+
+struct static_entry {
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+};
+
+struct huffman_code {
+    uint32_t code;
+    uint8_t bits;
+};
+
+struct huffman_length {
+    uint32_t first;                   /* first code of this length      */
+    uint16_t offset;                  /* index in 'huffman_symbols'     */
+    uint16_t count;                   /* number of codes of this length */
+};
+
+#define STATIC_ENTRY(n, v)   {n, sizeof(n) - 1, v, sizeof(v) - 1}
+
+/* Static table (RFC 7541 Appendix A) */
+static const struct static_entry static_table[FLB_HPACK_STATIC_TABLE_LEN] = {
+    STATIC_ENTRY(":authority", ""),
+    STATIC_ENTRY(":method", "GET"),
+    STATIC_ENTRY(":method", "POST"),
+    STATIC_ENTRY(":path", "/"),
+    STATIC_ENTRY(":path", "/index.html"),
+    STATIC_ENTRY(":scheme", "http"),
+    STATIC_ENTRY(":scheme", "https"),
+    STATIC_ENTRY(":status", "200"),
+    STATIC_ENTRY(":status", "204"),
+    STATIC_ENTRY(":status", "206"),
+    STATIC_ENTRY(":status", "304"),
+    STATIC_ENTRY(":status", "400"),
+    STATIC_ENTRY(":status", "404"),
+    STATIC_ENTRY(":status", "500"),
+    STATIC_ENTRY("accept-charset", ""),
+    STATIC_ENTRY("accept-encoding", "gzip, deflate"),
+    STATIC_ENTRY("accept-language", ""),
+    STATIC_ENTRY("accept-ranges", ""),
+    STATIC_ENTRY("accept", ""),
+    STATIC_ENTRY("access-control-allow-origin", ""),
+    STATIC_ENTRY("age", ""),
+    STATIC_ENTRY("allow", ""),
+    STATIC_ENTRY("authorization", ""),
+    STATIC_ENTRY("cache-control", ""),
+    STATIC_ENTRY("content-disposition", ""),
+    STATIC_ENTRY("content-encoding", ""),
+    STATIC_ENTRY("content-language", ""),
+    STATIC_ENTRY("content-length", ""),
+    STATIC_ENTRY("content-location", ""),
+    STATIC_ENTRY("content-range", ""),
+    STATIC_ENTRY("content-type", ""),
+    STATIC_ENTRY("cookie", ""),
+    STATIC_ENTRY("date", ""),
+    STATIC_ENTRY("etag", ""),
+    STATIC_ENTRY("expect", ""),
+    STATIC_ENTRY("expires", ""),
+    STATIC_ENTRY("from", ""),
+    STATIC_ENTRY("host", ""),
+    STATIC_ENTRY("if-match", ""),
+    STATIC_ENTRY("if-modified-since", ""),
+    STATIC_ENTRY("if-none-match", ""),
+    STATIC_ENTRY("if-range", ""),
+    STATIC_ENTRY("if-unmodified-since", ""),
+    STATIC_ENTRY("last-modified", ""),
+    STATIC_ENTRY("link", ""),
+    STATIC_ENTRY("location", ""),
+    STATIC_ENTRY("max-forwards", ""),
+    STATIC_ENTRY("proxy-authenticate", ""),
+    STATIC_ENTRY("proxy-authorization", ""),
+    STATIC_ENTRY("range", ""),
+    STATIC_ENTRY("referer", ""),
+    STATIC_ENTRY("refresh", ""),
+    STATIC_ENTRY("retry-after", ""),
+    STATIC_ENTRY("server", ""),
+    STATIC_ENTRY("set-cookie", ""),
+    STATIC_ENTRY("strict-transport-security", ""),
+    STATIC_ENTRY("transfer-encoding", ""),
+    STATIC_ENTRY("user-agent", ""),
+    STATIC_ENTRY("vary", ""),
+    STATIC_ENTRY("via", ""),
+    STATIC_ENTRY("www-authenticate", ""),
+};
+
+/* Huffman code of every symbol, the last one is EOS (RFC 7541 Appendix B) */
+static const struct huffman_code huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+/*
+ * The Huffman code is canonical: the codes of a given length are consecutive
+ * values. Symbols sorted by code, and the range of codes for every length.
+ */
+static const uint16_t huffman_symbols[257] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37,
+    45, 46, 47, 51, 52, 53, 54, 55, 56, 57, 61, 65,
+    95, 98, 100, 102, 103, 104, 108, 109, 110, 112, 114, 117,
+    58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+    77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89,
+    106, 107, 113, 118, 119, 120, 121, 122, 38, 42, 44, 59,
+    88, 90, 33, 34, 40, 41, 63, 39, 43, 124, 35, 62,
+    0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161,
+    167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+    132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170,
+    173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+    151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182,
+    183, 188, 191, 197, 231, 239, 9, 142, 144, 145, 148, 159,
+    171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243,
+    255, 203, 204, 211, 212, 214, 221, 222, 223, 241, 244, 245,
+    246, 247, 248, 250, 251, 252, 253, 254, 2, 3, 4, 5,
+    6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+    21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220,
+    249, 10, 13, 22, 256,
+};
+
+static const struct huffman_length huffman_lengths[31] = {
+    {0, 0, 0},  /* 0 */
+    {0, 0, 0},  /* 1 */
+    {0, 0, 0},  /* 2 */
+    {0, 0, 0},  /* 3 */
+    {0, 0, 0},  /* 4 */
+    {0x0, 0, 10},  /* 5 */
+    {0x14, 10, 26},  /* 6 */
+    {0x5c, 36, 32},  /* 7 */
+    {0xf8, 68, 6},  /* 8 */
+    {0, 0, 0},  /* 9 */
+    {0x3f8, 74, 5},  /* 10 */
+    {0x7fa, 79, 3},  /* 11 */
+    {0xffa, 82, 2},  /* 12 */
+    {0x1ff8, 84, 6},  /* 13 */
+    {0x3ffc, 90, 2},  /* 14 */
+    {0x7ffc, 92, 3},  /* 15 */
+    {0, 0, 0},  /* 16 */
+    {0, 0, 0},  /* 17 */
+    {0, 0, 0},  /* 18 */
+    {0x7fff0, 95, 3},  /* 19 */
+    {0xfffe6, 98, 8},  /* 20 */
+    {0x1fffdc, 106, 13},  /* 21 */
+    {0x3fffd2, 119, 26},  /* 22 */
+    {0x7fffd8, 145, 29},  /* 23 */
+    {0xffffea, 174, 12},  /* 24 */
+    {0x1ffffec, 186, 4},  /* 25 */
+    {0x3ffffe0, 190, 15},  /* 26 */
+    {0x7ffffde, 205, 19},  /* 27 */
+    {0xfffffe2, 224, 29},  /* 28 */
+    {0, 0, 0},  /* 29 */
+    {0x3ffffffc, 253, 4},  /* 30 */
+};
+
+struct flb_hpack_table *flb_hpack_table_create(size_t max_size)
+{
+    struct flb_hpack_table *table;
+
+    table = flb_calloc(1, sizeof(struct flb_hpack_table));
+    if (!table) {
+        flb_errno();
+        return NULL;
+    }
+    table->max_size = max_size;
+    table->max_size_limit = max_size;
+
+    return table;
+}
+
+void flb_hpack_table_destroy(struct flb_hpack_table *table)
+{
+    int i;
+
+    for (i = 0; i < table->count; i++) {
+        flb_free(table->entries[i].name);
+    }
+    flb_free(table->entries);
+    flb_free(table);
+}
+
+/* Drop the oldest entries until 'size' more bytes fit in the table */
+static void table_evict(struct flb_hpack_table *table, size_t size)
+{
+    int n = 0;
+    struct flb_hpack_entry *e;
+
+    while (n < table->count && table->size + size > table->max_size) {
+        e = &table->entries[n];
+        table->size -= e->name_len + e->value_len + ENTRY_OVERHEAD;
+        flb_free(e->name);
+        n++;
+    }
+
+    if (n > 0) {
+        memmove(table->entries, table->entries + n,
+                sizeof(struct flb_hpack_entry) * (table->count - n));
+        table->count -= n;
+    }
+}
+
+static int table_add(struct flb_hpack_table *table,
+                     const char *name, size_t name_len,
+                     const char *value, size_t value_len)
+{
+    int n;
+    size_t size;
+    struct flb_hpack_entry *e;
+    struct flb_hpack_entry *tmp;
+
+    size = name_len + value_len + ENTRY_OVERHEAD;
+    table_evict(table, size);
+
+    /* an entry larger than the table just empties it (RFC 7541 4.4) */
+    if (size > table->max_size) {
+        return 0;
+    }
+
+    if (table->count == table->alloc) {
+        n = table->alloc > 0 ? table->alloc * 2 : 16;
+        tmp = flb_realloc(table->entries, sizeof(struct flb_hpack_entry) * n);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        table->entries = tmp;
+        table->alloc = n;
+    }
+
+    e = &table->entries[table->count];
+    e->name = flb_malloc(name_len + value_len + 1);
+    if (!e->name) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(e->name, name, name_len);
+    e->name_len = name_len;
+    e->value = e->name + name_len;
+    memcpy(e->value, value, value_len);
+    e->value_len = value_len;
+
+    table->count++;
+    table->size += size;
+
+    return 0;
+}
+
+/* Lookup an index of the static table or the dynamic table */
+static int table_get(struct flb_hpack_table *table, uint32_t index,
+                     const char **name, size_t *name_len,
+                     const char **value, size_t *value_len)
+{
+    const struct static_entry *s;
+    struct flb_hpack_entry *e;
+
+    if (index == 0) {
+        return -1;
+    }
+
+    if (index <= FLB_HPACK_STATIC_TABLE_LEN) {
+        s = &static_table[index - 1];
+        *name = s->name;
+        *name_len = s->name_len;
+        *value = s->value;
+        *value_len = s->value_len;
+        return 0;
+    }
+
+    /* the newest entry of the dynamic table has the lowest index */
+    index -= FLB_HPACK_STATIC_TABLE_LEN;
+    if (index > table->count) {
+        return -1;
+    }
+
+    e = &table->entries[table->count - index];
+    *name = e->name;
+    *name_len = e->name_len;
+    *value = e->value;
+    *value_len = e->value_len;
+
+    return 0;
+}
+
+/* Integer representation with a N-bit prefix (RFC 7541 5.1) */
+static int int_decode(const unsigned char **p, const unsigned char *end,
+                      int prefix, uint32_t *out)
+{
+    int shift = 0;
+    uint32_t mask;
+    uint64_t val;
+    unsigned char b;
+
+    if (*p >= end) {
+        return -1;
+    }
+
+    mask = (1 << prefix) - 1;
+    val = **p & mask;
+    (*p)++;
+
+    if (val < mask) {
+        *out = val;
+        return 0;
+    }
+
+    while (*p < end && shift <= 28) {
+        b = **p;
+        (*p)++;
+
+        val += (uint64_t) (b & 0x7f) << shift;
+        if (val > UINT32_MAX) {
+            return -1;
+        }
+        if ((b & 0x80) == 0) {
+            *out = val;
+            return 0;
+        }
+        shift += 7;
+    }
+
+    return -1;
+}
+
+static int int_encode(flb_sds_t *buf, unsigned char first, int prefix,
+                      uint32_t val)
+{
+    int n = 0;
+    uint32_t mask;
+    unsigned char tmp[8];
+
+    mask = (1 << prefix) - 1;
+    if (val < mask) {
+        tmp[n++] = first | val;
+    }
+    else {
+        tmp[n++] = first | mask;
+        val -= mask;
+        while (val >= 128) {
+            tmp[n++] = (val & 0x7f) | 0x80;
+            val >>= 7;
+        }
+        tmp[n++] = val;
+    }
+
+    return flb_sds_cat_safe(buf, (char *) tmp, n);
+}
+
+size_t flb_hpack_huffman_encoded_len(const unsigned char *buf, size_t len)
+{
+    size_t i;
+    size_t bits = 0;
+
+    for (i = 0; i < len; i++) {
+        bits += huffman_codes[buf[i]].bits;
+    }
+
+    return (bits + 7) / 8;
+}
+
+int flb_hpack_huffman_encode(flb_sds_t *out,
+                             const unsigned char *buf, size_t len)
+{
+    int n_bits = 0;
+    size_t i;
+    size_t size;
+    uint64_t bits = 0;
+    unsigned char *p;
+    flb_sds_t tmp;
+    const struct huffman_code *hc;
+
+    size = flb_hpack_huffman_encoded_len(buf, len);
+    if (flb_sds_avail(*out) < size) {
+        tmp = flb_sds_increase(*out, size);
+        if (!tmp) {
+            return -1;
+        }
+        *out = tmp;
+    }
+    p = (unsigned char *) *out + flb_sds_len(*out);
+
+    for (i = 0; i < len; i++) {
+        hc = &huffman_codes[buf[i]];
+        bits = (bits << hc->bits) | hc->code;
+        n_bits += hc->bits;
+
+        while (n_bits >= 8) {
+            n_bits -= 8;
+            *p++ = bits >> n_bits;
+        }
+    }
+
+    /* pad with the most significant bits of EOS */
+    if (n_bits > 0) {
+        *p++ = (bits << (8 - n_bits)) | (0xff >> n_bits);
+    }
+    *p = '\0';
+    flb_sds_len_set(*out, flb_sds_len(*out) + size);
+
+    return 0;
+}
+
+int flb_hpack_huffman_decode(flb_sds_t *out,
+                             const unsigned char *buf, size_t len)
+{
+    int b;
+    int bits = 0;
+    size_t i;
+    size_t size;
+    uint16_t sym;
+    uint32_t code = 0;
+    char *p;
+    char *start;
+    flb_sds_t tmp;
+    const struct huffman_length *hl;
+
+    /* the shortest code has 5 bits */
+    size = (len * 8) / 5;
+    if (flb_sds_avail(*out) < size) {
+        tmp = flb_sds_increase(*out, size);
+        if (!tmp) {
+            return -1;
+        }
+        *out = tmp;
+    }
+    start = p = *out + flb_sds_len(*out);
+
+    for (i = 0; i < len; i++) {
+        for (b = 7; b >= 0; b--) {
+            code = (code << 1) | ((buf[i] >> b) & 1);
+            bits++;
+
+            hl = &huffman_lengths[bits];
+            if (hl->count > 0 && code >= hl->first &&
+                code - hl->first < hl->count) {
+                sym = huffman_symbols[hl->offset + code - hl->first];
+                if (sym == HUFFMAN_EOS) {
+                    return -1;
+                }
+                *p++ = sym;
+                code = 0;
+                bits = 0;
+            }
+            else if (bits == HUFFMAN_MAX_BITS) {
+                return -1;
+            }
+        }
+    }
+
+    /* the padding must be shorter than 8 bits and all ones */
+    if (bits > 7 || code != (1U << bits) - 1) {
+        return -1;
+    }
+    *p = '\0';
+    flb_sds_len_set(*out, flb_sds_len(*out) + (p - start));
+
+    return 0;
+}
+
+/* String literal, optionally Huffman encoded (RFC 7541 5.2) */
+static int string_decode(const unsigned char **p, const unsigned char *end,
+                         flb_sds_t *out)
+{
+    int ret;
+    int huffman;
+    uint32_t len;
+
+    if (*p >= end) {
+        return -1;
+    }
+    huffman = **p & 0x80;
+
+    ret = int_decode(p, end, 7, &len);
+    if (ret == -1 || len > end - *p) {
+        return -1;
+    }
+
+    flb_sds_len_set(*out, 0);
+    if (huffman) {
+        ret = flb_hpack_huffman_decode(out, *p, len);
+    }
+    else {
+        ret = flb_sds_cat_safe(out, (const char *) *p, len);
+    }
+    *p += len;
+
+    return ret;
+}
+
+static int string_encode(flb_sds_t *buf, const char *str, size_t len)
+{
+    int ret;
+    size_t size;
+
+    size = flb_hpack_huffman_encoded_len((const unsigned char *) str, len);
+    if (size < len) {
+        ret = int_encode(buf, 0x80, 7, size);
+        if (ret == 0) {
+            ret = flb_hpack_huffman_encode(buf, (const unsigned char *) str,
+                                           len);
+        }
+    }
+    else {
+        ret = int_encode(buf, 0x00, 7, len);
+        if (ret == 0) {
+            ret = flb_sds_cat_safe(buf, str, len);
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * Decode a complete header block, 'cb' is invoked for every header field in
+ * order. Returns -1 on a decoding error, which is a connection error for
+ * HTTP/2 since the dynamic table can't be trusted anymore.
+ */
+int flb_hpack_decode(struct flb_hpack_table *table,
+                     const unsigned char *buf, size_t len,
+                     flb_hpack_header_cb cb, void *data)
+{
+    int ret = 0;
+    int prefix;
+    int indexing;
+    uint32_t index;
+    size_t name_len;
+    size_t value_len;
+    const char *name;
+    const char *value;
+    const unsigned char *p = buf;
+    const unsigned char *end = buf + len;
+    flb_sds_t name_buf;
+    flb_sds_t value_buf;
+
+    name_buf = flb_sds_create_size(64);
+    if (!name_buf) {
+        return -1;
+    }
+    value_buf = flb_sds_create_size(256);
+    if (!value_buf) {
+        flb_sds_destroy(name_buf);
+        return -1;
+    }
+
+    while (p < end && ret == 0) {
+        if (*p & 0x80) {
+            /* indexed header field */
+            ret = int_decode(&p, end, 7, &index);
+            if (ret == 0) {
+                ret = table_get(table, index, &name, &name_len,
+                                &value, &value_len);
+            }
+            if (ret == 0) {
+                ret = cb(data, name, name_len, value, value_len);
+            }
+            continue;
+        }
+
+        if ((*p & 0xe0) == 0x20) {
+            /* dynamic table size update */
+            ret = int_decode(&p, end, 5, &index);
+            if (ret == 0) {
+                if (index > table->max_size_limit) {
+                    ret = -1;
+                }
+                else {
+                    table->max_size = index;
+                    table_evict(table, 0);
+                }
+            }
+            continue;
+        }
+
+        /* literal header field, with incremental indexing or not */
+        if ((*p & 0xc0) == 0x40) {
+            prefix = 6;
+            indexing = FLB_TRUE;
+        }
+        else {
+            prefix = 4;
+            indexing = FLB_FALSE;
+        }
+
+        ret = int_decode(&p, end, prefix, &index);
+        if (ret == -1) {
+            break;
+        }
+
+        if (index == 0) {
+            ret = string_decode(&p, end, &name_buf);
+        }
+        else {
+            ret = table_get(table, index, &name, &name_len,
+                            &value, &value_len);
+            if (ret == 0) {
+                flb_sds_len_set(name_buf, 0);
+                ret = flb_sds_cat_safe(&name_buf, name, name_len);
+            }
+        }
+        if (ret == 0) {
+            ret = string_decode(&p, end, &value_buf);
+        }
+        if (ret == 0 && indexing) {
+            ret = table_add(table,
+                            name_buf, flb_sds_len(name_buf),
+                            value_buf, flb_sds_len(value_buf));
+        }
+        if (ret == 0) {
+            ret = cb(data,
+                     name_buf, flb_sds_len(name_buf),
+                     value_buf, flb_sds_len(value_buf));
+        }
+    }
+
+    flb_sds_destroy(name_buf);
+    flb_sds_destroy(value_buf);
+
+    return ret;
+}
+
+static int is_sensitive(const char *name, size_t len)
+{
+    if ((len == 13 && memcmp(name, "authorization", 13) == 0) ||
+        (len == 19 && memcmp(name, "proxy-authorization", 19) == 0) ||
+        (len == 6 && memcmp(name, "cookie", 6) == 0)) {
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+/*
+ * Append the representation of a header field to 'buf'. The name must be
+ * lowercase. Full matches of the static table are sent as an index, the rest
+ * as literals that the peer must not add to its dynamic table.
+ */
+int flb_hpack_encode_header(flb_sds_t *buf,
+                            const char *name, size_t name_len,
+                            const char *value, size_t value_len)
+{
+    int i;
+    int ret;
+    uint32_t index = 0;
+    unsigned char first = 0x00;
+    const struct static_entry *s;
+
+    for (i = 0; i < FLB_HPACK_STATIC_TABLE_LEN; i++) {
+        s = &static_table[i];
+        if (s->name_len != name_len || memcmp(s->name, name, name_len) != 0) {
+            continue;
+        }
+        if (s->value_len == value_len &&
+            memcmp(s->value, value, value_len) == 0) {
+            return int_encode(buf, 0x80, 7, i + 1);
+        }
+        if (index == 0) {
+            index = i + 1;
+        }
+    }
+
+    /* credentials are sent as 'never indexed' literals */
+    if (is_sensitive(name, name_len)) {
+        first = 0x10;
+    }
+
+    ret = int_encode(buf, first, 4, index);
+    if (ret == 0 && index == 0) {
+        ret = string_encode(buf, name, name_len);
+    }
+    if (ret == 0) {
+        ret = string_encode(buf, value, value_len);
+    }
+
+    return ret;
+}
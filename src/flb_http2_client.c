@@ -0,0 +1,1509 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * HTTP/2 client (RFC 7540) for the requests of flb_http_client: h2 over TLS
+ * negotiated with ALPN, or h2c with prior knowledge on plain connections.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_connection.h>
+#include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_http2_client.h>
+#include <fluent-bit/flb_hpack.h>
+#include <fluent-bit/tls/flb_tls.h>
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#define PREFACE             "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+#define FRAME_HEADER_SIZE   9
+#define DEFAULT_FRAME_SIZE  16384
+#define DEFAULT_WINDOW_SIZE 65535
+#define MAX_WINDOW_SIZE     0x7fffffff
+#define MAX_STREAM_ID       0x7fffffff
+
+/* Streams allowed until the peer tells its limit */
+#define DEFAULT_MAX_STREAMS 100
+
+/* Receive window of the connection and the streams */
+#define LOCAL_WINDOW_SIZE   (16 * 1024 * 1024)
+
+/*
+ * Largest header block accepted from the peer, advertised as our
+ * SETTINGS_MAX_HEADER_LIST_SIZE. It bounds both the encoded block and the
+ * decoded header list.
+ */
+#define LOCAL_MAX_HEADER_LIST   (64 * 1024)
+
+/* Pending output that stops queueing more DATA frames */
+#define WBUF_HIGH_WATER     (256 * 1024)
+
+/* Frame types */
+#define FRAME_DATA          0x0
+#define FRAME_HEADERS       0x1
+#define FRAME_PRIORITY      0x2
+#define FRAME_RST_STREAM    0x3
+#define FRAME_SETTINGS      0x4
+#define FRAME_PUSH_PROMISE  0x5
+#define FRAME_PING          0x6
+#define FRAME_GOAWAY        0x7
+#define FRAME_WINDOW_UPDATE 0x8
+#define FRAME_CONTINUATION  0x9
+
+/* Frame flags */
+#define FLAG_END_STREAM     0x1
+#define FLAG_ACK            0x1
+#define FLAG_END_HEADERS    0x4
+#define FLAG_PADDED         0x8
+#define FLAG_PRIORITY       0x20
+
+/* Settings */
+#define SETTINGS_HEADER_TABLE_SIZE       0x1
+#define SETTINGS_ENABLE_PUSH             0x2
+#define SETTINGS_MAX_CONCURRENT_STREAMS  0x3
+#define SETTINGS_INITIAL_WINDOW_SIZE     0x4
+#define SETTINGS_MAX_FRAME_SIZE          0x5
+#define SETTINGS_MAX_HEADER_LIST_SIZE    0x6
+
+/* Error codes */
+#define ERROR_NO_ERROR          0x0
+#define ERROR_PROTOCOL          0x1
+#define ERROR_FLOW_CONTROL      0x3
+#define ERROR_FRAME_SIZE        0x6
+#define ERROR_COMPRESSION       0x9
+#define ERROR_ENHANCE_YOUR_CALM 0xb
+
+/* Connection specific headers are not allowed in HTTP/2 (RFC 7540 8.1.2.2) */
+static const char *skip_headers[] = {
+    "connection", "keep-alive", "proxy-connection", "transfer-encoding",
+    "upgrade", "host", "te", NULL
+};
+
+struct header_ctx {
+    int status;
+    size_t list_size;       /* RFC 7540 6.5.2 size of the decoded headers */
+    struct flb_http2_stream *stream;
+    struct flb_http2_session *session;
+};
+
+static int cb_session_event(void *data);
+
+static inline uint32_t get_u32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+           ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline void put_u32(unsigned char *p, uint32_t val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static int frame_write(struct flb_http2_session *session,
+                       int type, int flags, uint32_t stream_id,
+                       const void *payload, size_t len)
+{
+    int ret;
+    unsigned char h[FRAME_HEADER_SIZE];
+
+    h[0] = len >> 16;
+    h[1] = len >> 8;
+    h[2] = len;
+    h[3] = type;
+    h[4] = flags;
+    put_u32(h + 5, stream_id & MAX_STREAM_ID);
+
+    ret = flb_sds_cat_safe(&session->wbuf, (char *) h, sizeof(h));
+    if (ret == 0 && len > 0) {
+        ret = flb_sds_cat_safe(&session->wbuf, payload, len);
+    }
+
+    return ret;
+}
+
+static int frame_window_update(struct flb_http2_session *session,
+                               uint32_t stream_id, uint32_t increment)
+{
+    unsigned char buf[4];
+
+    put_u32(buf, increment);
+    return frame_write(session, FRAME_WINDOW_UPDATE, 0, stream_id, buf, 4);
+}
+
+static int frame_rst_stream(struct flb_http2_session *session,
+                            uint32_t stream_id, uint32_t error)
+{
+    unsigned char buf[4];
+
+    put_u32(buf, error);
+    return frame_write(session, FRAME_RST_STREAM, 0, stream_id, buf, 4);
+}
+
+static int frame_goaway(struct flb_http2_session *session, uint32_t error)
+{
+    unsigned char buf[8];
+
+    /* no server initiated streams are accepted */
+    put_u32(buf, 0);
+    put_u32(buf + 4, error);
+    return frame_write(session, FRAME_GOAWAY, 0, 0, buf, 8);
+}
+
+/*
+ * Raw I/O on the non-blocking socket. Returns the number of bytes, 0 if the
+ * operation would block or -1 on errors and end of stream.
+ */
+static ssize_t conn_read(struct flb_connection *conn, void *buf, size_t len)
+{
+    ssize_t ret;
+
+#ifdef FLB_HAVE_TLS
+    if (conn->tls_session != NULL) {
+        ret = conn->tls_session->tls->api->net_read(conn->tls_session,
+                                                   buf, len);
+        if (ret == FLB_TLS_WANT_READ || ret == FLB_TLS_WANT_WRITE) {
+            return 0;
+        }
+        return ret > 0 ? ret : -1;
+    }
+#endif
+
+    ret = recv(conn->fd, buf, len, 0);
+    if (ret == -1 && FLB_WOULDBLOCK()) {
+        return 0;
+    }
+
+    return ret > 0 ? ret : -1;
+}
+
+static ssize_t conn_write(struct flb_connection *conn,
+                          const void *buf, size_t len)
+{
+    ssize_t ret;
+
+#ifdef FLB_HAVE_TLS
+    if (conn->tls_session != NULL) {
+        ret = conn->tls_session->tls->api->net_write(conn->tls_session,
+                                                    buf, len);
+        if (ret == FLB_TLS_WANT_READ || ret == FLB_TLS_WANT_WRITE) {
+            return 0;
+        }
+        return ret > 0 ? ret : -1;
+    }
+#endif
+
+    ret = send(conn->fd, buf, len, 0);
+    if (ret == -1 && FLB_WOULDBLOCK()) {
+        return 0;
+    }
+
+    return ret;
+}
+
+static struct flb_http2_session *session_create(struct flb_connection *conn)
+{
+    int ret;
+    unsigned char settings[18];
+    struct flb_http2_session *session;
+
+    session = flb_calloc(1, sizeof(struct flb_http2_session));
+    if (!session) {
+        flb_errno();
+        return NULL;
+    }
+    session->status = FLB_HTTP2_SESSION_ACTIVE;
+    session->next_stream_id = 1;
+    session->max_streams = DEFAULT_MAX_STREAMS;
+    session->max_frame_size = DEFAULT_FRAME_SIZE;
+    session->initial_window = DEFAULT_WINDOW_SIZE;
+    session->send_window = DEFAULT_WINDOW_SIZE;
+    session->conn = conn;
+    mk_list_init(&session->streams);
+
+    session->hpack = flb_hpack_table_create(FLB_HPACK_TABLE_SIZE);
+    session->hbuf = flb_sds_create_size(1024);
+    session->hlines = flb_sds_create_size(1024);
+    session->rbuf = flb_sds_create_size(FRAME_HEADER_SIZE + DEFAULT_FRAME_SIZE);
+    session->wbuf = flb_sds_create_size(1024);
+    if (!session->hpack || !session->hbuf || !session->hlines ||
+        !session->rbuf || !session->wbuf) {
+        flb_http2_session_destroy(session);
+        return NULL;
+    }
+
+    /*
+     * connection preface: no server push, a large receive window and a
+     * bounded header list
+     */
+    settings[0] = 0;
+    settings[1] = SETTINGS_ENABLE_PUSH;
+    put_u32(settings + 2, 0);
+    settings[6] = 0;
+    settings[7] = SETTINGS_INITIAL_WINDOW_SIZE;
+    put_u32(settings + 8, LOCAL_WINDOW_SIZE);
+    settings[12] = 0;
+    settings[13] = SETTINGS_MAX_HEADER_LIST_SIZE;
+    put_u32(settings + 14, LOCAL_MAX_HEADER_LIST);
+
+    ret = flb_sds_cat_safe(&session->wbuf, PREFACE, sizeof(PREFACE) - 1);
+    if (ret == 0) {
+        ret = frame_write(session, FRAME_SETTINGS, 0, 0,
+                          settings, sizeof(settings));
+    }
+    if (ret == 0) {
+        ret = frame_window_update(session, 0,
+                                  LOCAL_WINDOW_SIZE - DEFAULT_WINDOW_SIZE);
+    }
+    if (ret == -1) {
+        flb_http2_session_destroy(session);
+        return NULL;
+    }
+
+    return session;
+}
+
+void flb_http2_session_destroy(struct flb_http2_session *session)
+{
+    if (session->hpack) {
+        flb_hpack_table_destroy(session->hpack);
+    }
+    flb_sds_destroy(session->hbuf);
+    flb_sds_destroy(session->hlines);
+    flb_sds_destroy(session->rbuf);
+    flb_sds_destroy(session->wbuf);
+    flb_free(session);
+}
+
+/* Returns 0 if the session can take one more user */
+int flb_http2_session_acquire(struct flb_http2_session *session)
+{
+    if (session->status != FLB_HTTP2_SESSION_ACTIVE ||
+        session->conn->fd == -1 ||
+        session->users >= session->max_streams) {
+        return -1;
+    }
+
+    session->users++;
+    session->conn->busy_flag = FLB_TRUE;
+
+    return 0;
+}
+
+/*
+ * Returns the number of remaining users, the upstream releases the
+ * connection once the last one is gone.
+ */
+int flb_http2_session_release(struct flb_http2_session *session)
+{
+    if (session->users > 0) {
+        session->users--;
+    }
+
+    if (session->users == 0) {
+        session->conn->busy_flag = FLB_FALSE;
+        if (session->status != FLB_HTTP2_SESSION_ACTIVE) {
+            session->conn->recycle = FLB_FALSE;
+        }
+    }
+
+    return session->users;
+}
+
+static struct flb_http2_stream *stream_get(struct flb_http2_session *session,
+                                           uint32_t id)
+{
+    struct mk_list *head;
+    struct flb_http2_stream *stream;
+
+    mk_list_foreach(head, &session->streams) {
+        stream = mk_list_entry(head, struct flb_http2_stream, _head);
+        if (stream->id == id) {
+            return stream->done ? NULL : stream;
+        }
+    }
+
+    return NULL;
+}
+
+static void stream_fail(struct flb_http2_stream *stream)
+{
+    stream->done = FLB_TRUE;
+    stream->error = FLB_TRUE;
+}
+
+static void session_fail(struct flb_http2_session *session, const char *reason)
+{
+    struct mk_list *head;
+    struct flb_http2_stream *stream;
+    struct flb_connection *conn = session->conn;
+
+    if (session->status != FLB_HTTP2_SESSION_ERROR) {
+        flb_debug("[http2] connection #%i to %s: %s",
+                  conn->fd, flb_connection_get_remote_address(conn), reason);
+    }
+    session->status = FLB_HTTP2_SESSION_ERROR;
+    conn->recycle = FLB_FALSE;
+
+    mk_list_foreach(head, &session->streams) {
+        stream = mk_list_entry(head, struct flb_http2_stream, _head);
+        if (!stream->done) {
+            stream_fail(stream);
+        }
+    }
+
+    if (conn->event.status & MK_EVENT_REGISTERED) {
+        mk_event_del(conn->evl, &conn->event);
+    }
+}
+
+/* Connection error: notify the peer with GOAWAY and fail the session */
+static int session_error(struct flb_http2_session *session, uint32_t error,
+                         const char *reason)
+{
+    flb_sds_len_set(session->wbuf, 0);
+    session->wbuf_off = 0;
+
+    if (frame_goaway(session, error) == 0) {
+        conn_write(session->conn, session->wbuf, flb_sds_len(session->wbuf));
+    }
+    session_fail(session, reason);
+
+    return -1;
+}
+
+/* Append data to the response buffer of the client */
+static int response_append(struct flb_http_client *c,
+                           const char *buf, size_t len)
+{
+    int ret;
+    size_t size;
+    size_t out_size;
+
+    while (flb_http_buffer_available(c) < len + 1) {
+        size = len + 1 - flb_http_buffer_available(c);
+        if (size < FLB_HTTP_DATA_CHUNK) {
+            size = FLB_HTTP_DATA_CHUNK;
+        }
+        ret = flb_http_buffer_increase(c, size, &out_size);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    memcpy(c->resp.data + c->resp.data_len, buf, len);
+    c->resp.data_len += len;
+    c->resp.data[c->resp.data_len] = '\0';
+
+    return 0;
+}
+
+static void stream_body_append(struct flb_http2_stream *stream,
+                               const char *buf, size_t len)
+{
+    int ret;
+    struct flb_http_client *c = stream->c;
+
+    if (stream->truncated || len == 0) {
+        return;
+    }
+
+    ret = response_append(c, buf, len);
+    if (ret == -1) {
+        flb_warn("[http_client] cannot increase buffer: current=%zu "
+                 "requested=%zu max=%zu", c->resp.data_size,
+                 c->resp.data_len + len + 1, c->resp.data_size_max);
+        stream->truncated = FLB_TRUE;
+        return;
+    }
+
+    c->resp.payload = c->resp.headers_end;
+    c->resp.payload_size += len;
+}
+
+/*
+ * Compose the response headers as an HTTP/1.1 message, so the response
+ * helpers and the callers parse it as usual.
+ */
+static int stream_headers_set(struct flb_http2_stream *stream, int status,
+                              flb_sds_t lines)
+{
+    int ret;
+    int len;
+    char tmp[32];
+    struct flb_http_client *c = stream->c;
+
+    c->resp.status = status;
+    c->resp.data_len = 0;
+
+    len = snprintf(tmp, sizeof(tmp), "HTTP/2 %i\r\n", status);
+    ret = response_append(c, tmp, len);
+    if (ret == 0) {
+        ret = response_append(c, lines, flb_sds_len(lines));
+    }
+    if (ret == 0) {
+        ret = response_append(c, "\r\n", 2);
+    }
+    if (ret == -1) {
+        return -1;
+    }
+
+    c->resp.headers_end = c->resp.data + c->resp.data_len;
+    c->resp.payload = c->resp.headers_end;
+    c->resp.payload_size = 0;
+
+    return 0;
+}
+
+static int cb_header(void *data, const char *name, size_t name_len,
+                     const char *value, size_t value_len)
+{
+    int ret;
+    char tmp[16];
+    struct header_ctx *ctx = data;
+
+    /* a small block can expand a lot through the dynamic table */
+    ctx->list_size += name_len + value_len + 32;
+    if (ctx->list_size > LOCAL_MAX_HEADER_LIST) {
+        return -1;
+    }
+
+    if (ctx->stream == NULL) {
+        return 0;
+    }
+
+    if (name_len > 0 && name[0] == ':') {
+        if (name_len == 7 && strncmp(name, ":status", 7) == 0 &&
+            value_len == 3) {
+            memcpy(tmp, value, 3);
+            tmp[3] = '\0';
+            ctx->status = atoi(tmp);
+        }
+        return 0;
+    }
+
+    if (name_len == 14 && strncmp(name, "content-length", 14) == 0 &&
+        value_len < sizeof(tmp)) {
+        memcpy(tmp, value, value_len);
+        tmp[value_len] = '\0';
+        ctx->stream->c->resp.content_length = atoi(tmp);
+    }
+
+    ret = flb_sds_cat_safe(&ctx->session->hlines, name, name_len);
+    if (ret == 0) {
+        ret = flb_sds_cat_safe(&ctx->session->hlines, ": ", 2);
+    }
+    if (ret == 0) {
+        ret = flb_sds_cat_safe(&ctx->session->hlines, value, value_len);
+    }
+    if (ret == 0) {
+        ret = flb_sds_cat_safe(&ctx->session->hlines, "\r\n", 2);
+    }
+
+    return ret;
+}
+
+/* A header block is complete: decode it even if the stream is gone */
+static int headers_complete(struct flb_http2_session *session)
+{
+    int ret;
+    int end_stream;
+    struct header_ctx ctx;
+    struct flb_http2_stream *stream;
+
+    end_stream = session->cont_end_stream;
+    stream = stream_get(session, session->cont_stream_id);
+    session->cont_stream_id = 0;
+
+    ctx.status = 0;
+    ctx.list_size = 0;
+    ctx.session = session;
+    ctx.stream = NULL;
+    if (stream && !stream->headers_done) {
+        ctx.stream = stream;
+    }
+    flb_sds_len_set(session->hlines, 0);
+
+    ret = flb_hpack_decode(session->hpack,
+                           (unsigned char *) session->hbuf,
+                           flb_sds_len(session->hbuf),
+                           cb_header, &ctx);
+    if (ret == -1 && ctx.list_size > LOCAL_MAX_HEADER_LIST) {
+        return session_error(session, ERROR_ENHANCE_YOUR_CALM,
+                             "header list too large");
+    }
+    else if (ret == -1) {
+        return session_error(session, ERROR_COMPRESSION,
+                             "invalid header block");
+    }
+
+    if (stream == NULL) {
+        return 0;
+    }
+
+    if (!stream->headers_done) {
+        if (ctx.status < 100) {
+            frame_rst_stream(session, stream->id, ERROR_PROTOCOL);
+            stream_fail(stream);
+            return 0;
+        }
+
+        /* interim response, the final one comes next */
+        if (ctx.status < 200) {
+            return 0;
+        }
+
+        ret = stream_headers_set(stream, ctx.status, session->hlines);
+        if (ret == -1) {
+            frame_rst_stream(session, stream->id, ERROR_NO_ERROR);
+            stream_fail(stream);
+            return 0;
+        }
+        stream->headers_done = FLB_TRUE;
+    }
+
+    /* trailers are ignored */
+    if (end_stream) {
+        stream->done = FLB_TRUE;
+    }
+
+    return 0;
+}
+
+static int frame_data(struct flb_http2_session *session, int flags,
+                      uint32_t stream_id, const unsigned char *p, size_t len)
+{
+    int ret;
+    size_t pad = 0;
+    struct flb_http2_stream *stream;
+
+    if (stream_id == 0) {
+        return session_error(session, ERROR_PROTOCOL, "DATA on stream 0");
+    }
+
+    if (flags & FLAG_PADDED) {
+        if (len == 0 || p[0] >= len) {
+            return session_error(session, ERROR_PROTOCOL, "invalid padding");
+        }
+        pad = p[0] + 1;
+    }
+
+    /* the flow control counts the whole payload */
+    session->recv_unacked += len;
+    if (session->recv_unacked >= LOCAL_WINDOW_SIZE / 2) {
+        ret = frame_window_update(session, 0, session->recv_unacked);
+        if (ret == -1) {
+            return -1;
+        }
+        session->recv_unacked = 0;
+    }
+
+    stream = stream_get(session, stream_id);
+    if (stream == NULL) {
+        return 0;
+    }
+
+    if (!stream->headers_done) {
+        frame_rst_stream(session, stream_id, ERROR_PROTOCOL);
+        stream_fail(stream);
+        return 0;
+    }
+
+    stream_body_append(stream, (const char *) p + (pad ? 1 : 0),
+                       len - pad);
+
+    if (flags & FLAG_END_STREAM) {
+        stream->done = FLB_TRUE;
+        return 0;
+    }
+
+    stream->recv_unacked += len;
+    if (stream->recv_unacked >= LOCAL_WINDOW_SIZE / 2) {
+        ret = frame_window_update(session, stream_id, stream->recv_unacked);
+        if (ret == -1) {
+            return -1;
+        }
+        stream->recv_unacked = 0;
+    }
+
+    return 0;
+}
+
+static int frame_headers(struct flb_http2_session *session, int type,
+                         int flags, uint32_t stream_id,
+                         const unsigned char *p, size_t len)
+{
+    int ret;
+    size_t pad = 0;
+
+    if (type == FRAME_HEADERS) {
+        if (stream_id == 0) {
+            return session_error(session, ERROR_PROTOCOL,
+                                 "HEADERS on stream 0");
+        }
+
+        if (flags & FLAG_PADDED) {
+            if (len == 0) {
+                return session_error(session, ERROR_PROTOCOL,
+                                     "invalid padding");
+            }
+            pad = p[0];
+            p++;
+            len--;
+        }
+        if (flags & FLAG_PRIORITY) {
+            if (len < 5) {
+                return session_error(session, ERROR_FRAME_SIZE,
+                                     "invalid HEADERS frame");
+            }
+            p += 5;
+            len -= 5;
+        }
+        if (pad > len) {
+            return session_error(session, ERROR_PROTOCOL, "invalid padding");
+        }
+        len -= pad;
+
+        session->cont_stream_id = stream_id;
+        session->cont_end_stream = flags & FLAG_END_STREAM;
+        flb_sds_len_set(session->hbuf, 0);
+    }
+    else if (session->cont_stream_id == 0 ||
+             session->cont_stream_id != stream_id) {
+        return session_error(session, ERROR_PROTOCOL,
+                             "unexpected CONTINUATION frame");
+    }
+
+    /* do not buffer an endless sequence of CONTINUATION frames */
+    if (flb_sds_len(session->hbuf) + len > LOCAL_MAX_HEADER_LIST) {
+        return session_error(session, ERROR_ENHANCE_YOUR_CALM,
+                             "header block too large");
+    }
+
+    ret = flb_sds_cat_safe(&session->hbuf, (const char *) p, len);
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (flags & FLAG_END_HEADERS) {
+        return headers_complete(session);
+    }
+
+    return 0;
+}
+
+static int frame_settings(struct flb_http2_session *session, int flags,
+                          uint32_t stream_id, const unsigned char *p,
+                          size_t len)
+{
+    size_t i;
+    uint16_t id;
+    uint32_t val;
+    int64_t delta;
+    struct mk_list *head;
+    struct flb_http2_stream *stream;
+
+    if (stream_id != 0 || len % 6 != 0 || ((flags & FLAG_ACK) && len > 0)) {
+        return session_error(session, ERROR_PROTOCOL,
+                             "invalid SETTINGS frame");
+    }
+
+    if (flags & FLAG_ACK) {
+        return 0;
+    }
+
+    for (i = 0; i < len; i += 6) {
+        id = (p[i] << 8) | p[i + 1];
+        val = get_u32(p + i + 2);
+
+        switch (id) {
+        case SETTINGS_MAX_CONCURRENT_STREAMS:
+            session->max_streams = val;
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+            if (val > MAX_WINDOW_SIZE) {
+                return session_error(session, ERROR_FLOW_CONTROL,
+                                     "invalid initial window size");
+            }
+            /* the change applies to the open streams (RFC 7540 6.9.2) */
+            delta = (int64_t) val - session->initial_window;
+            mk_list_foreach(head, &session->streams) {
+                stream = mk_list_entry(head, struct flb_http2_stream, _head);
+                stream->send_window += delta;
+            }
+            session->initial_window = val;
+            break;
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (val < DEFAULT_FRAME_SIZE || val > 0xffffff) {
+                return session_error(session, ERROR_PROTOCOL,
+                                     "invalid max frame size");
+            }
+            session->max_frame_size = val;
+            break;
+        default:
+            /*
+             * The header table size only matters for an encoder using the
+             * dynamic table, ours doesn't.
+             */
+            break;
+        }
+    }
+
+    return frame_write(session, FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+}
+
+static int frame_goaway_recv(struct flb_http2_session *session,
+                             const unsigned char *p, size_t len)
+{
+    uint32_t error;
+    uint32_t last_id;
+    struct mk_list *head;
+    struct flb_http2_stream *stream;
+
+    if (len < 8) {
+        return session_error(session, ERROR_FRAME_SIZE,
+                             "invalid GOAWAY frame");
+    }
+
+    last_id = get_u32(p) & MAX_STREAM_ID;
+    error = get_u32(p + 4);
+
+    if (error != ERROR_NO_ERROR) {
+        flb_warn("[http2] connection #%i to %s: GOAWAY with error %u",
+                 session->conn->fd,
+                 flb_connection_get_remote_address(session->conn), error);
+    }
+
+    if (session->status == FLB_HTTP2_SESSION_ACTIVE) {
+        session->status = FLB_HTTP2_SESSION_GOAWAY;
+    }
+
+    /* the streams above the last one were not processed, they can retry */
+    mk_list_foreach(head, &session->streams) {
+        stream = mk_list_entry(head, struct flb_http2_stream, _head);
+        if (stream->id > last_id && !stream->done) {
+            stream_fail(stream);
+        }
+    }
+
+    return 0;
+}
+
+static int frame_process(struct flb_http2_session *session, int type,
+                         int flags, uint32_t stream_id,
+                         const unsigned char *p, size_t len)
+{
+    int64_t inc;
+    struct flb_http2_stream *stream;
+
+    /* a header block can't be interleaved with other frames */
+    if (session->cont_stream_id != 0 && type != FRAME_CONTINUATION) {
+        return session_error(session, ERROR_PROTOCOL,
+                             "header block interrupted");
+    }
+
+    switch (type) {
+    case FRAME_DATA:
+        return frame_data(session, flags, stream_id, p, len);
+    case FRAME_HEADERS:
+    case FRAME_CONTINUATION:
+        return frame_headers(session, type, flags, stream_id, p, len);
+    case FRAME_RST_STREAM:
+        if (stream_id == 0 || len != 4) {
+            return session_error(session, ERROR_PROTOCOL,
+                                 "invalid RST_STREAM frame");
+        }
+        stream = stream_get(session, stream_id);
+        if (stream) {
+            flb_debug("[http2] stream %u reset by the peer, error %u",
+                      stream_id, get_u32(p));
+            stream_fail(stream);
+        }
+        return 0;
+    case FRAME_SETTINGS:
+        return frame_settings(session, flags, stream_id, p, len);
+    case FRAME_PUSH_PROMISE:
+        return session_error(session, ERROR_PROTOCOL,
+                             "server push is disabled");
+    case FRAME_PING:
+        if (stream_id != 0 || len != 8) {
+            return session_error(session, ERROR_PROTOCOL,
+                                 "invalid PING frame");
+        }
+        if (flags & FLAG_ACK) {
+            return 0;
+        }
+        return frame_write(session, FRAME_PING, FLAG_ACK, 0, p, 8);
+    case FRAME_GOAWAY:
+        return frame_goaway_recv(session, p, len);
+    case FRAME_WINDOW_UPDATE:
+        if (len != 4) {
+            return session_error(session, ERROR_FRAME_SIZE,
+                                 "invalid WINDOW_UPDATE frame");
+        }
+        inc = get_u32(p) & MAX_WINDOW_SIZE;
+        if (stream_id == 0) {
+            session->send_window += inc;
+            if (inc == 0 || session->send_window > MAX_WINDOW_SIZE) {
+                return session_error(session, ERROR_FLOW_CONTROL,
+                                     "invalid window update");
+            }
+            return 0;
+        }
+        stream = stream_get(session, stream_id);
+        if (stream) {
+            stream->send_window += inc;
+            if (inc == 0 || stream->send_window > MAX_WINDOW_SIZE) {
+                frame_rst_stream(session, stream_id, ERROR_FLOW_CONTROL);
+                stream_fail(stream);
+            }
+        }
+        return 0;
+    default:
+        /* PRIORITY and unknown frames are ignored */
+        return 0;
+    }
+}
+
+/* Process the complete frames received */
+static int session_process(struct flb_http2_session *session)
+{
+    int ret;
+    size_t off = 0;
+    size_t len;
+    uint32_t flen;
+    unsigned char *p;
+
+    len = flb_sds_len(session->rbuf);
+    while (len - off >= FRAME_HEADER_SIZE &&
+           session->status != FLB_HTTP2_SESSION_ERROR) {
+        p = (unsigned char *) session->rbuf + off;
+        flen = (p[0] << 16) | (p[1] << 8) | p[2];
+
+        /* our SETTINGS_MAX_FRAME_SIZE is the default */
+        if (flen > DEFAULT_FRAME_SIZE) {
+            return session_error(session, ERROR_FRAME_SIZE,
+                                 "frame too large");
+        }
+        if (len - off < FRAME_HEADER_SIZE + flen) {
+            break;
+        }
+
+        ret = frame_process(session, p[3], p[4], get_u32(p + 5) & MAX_STREAM_ID,
+                            p + FRAME_HEADER_SIZE, flen);
+        if (ret == -1) {
+            return -1;
+        }
+        off += FRAME_HEADER_SIZE + flen;
+    }
+
+    if (off > 0) {
+        memmove(session->rbuf, session->rbuf + off, len - off);
+        flb_sds_len_set(session->rbuf, len - off);
+    }
+
+    return 0;
+}
+
+static int session_read(struct flb_http2_session *session)
+{
+    int ret;
+    size_t size;
+    ssize_t bytes;
+    flb_sds_t tmp;
+
+    while (session->status != FLB_HTTP2_SESSION_ERROR) {
+        size = FRAME_HEADER_SIZE + DEFAULT_FRAME_SIZE;
+        if (flb_sds_avail(session->rbuf) < size) {
+            tmp = flb_sds_increase(session->rbuf, size);
+            if (!tmp) {
+                return -1;
+            }
+            session->rbuf = tmp;
+        }
+
+        bytes = conn_read(session->conn,
+                          session->rbuf + flb_sds_len(session->rbuf),
+                          flb_sds_avail(session->rbuf));
+        if (bytes == 0) {
+            break;
+        }
+        else if (bytes < 0) {
+            session_fail(session, "connection closed by the peer");
+            return -1;
+        }
+
+        flb_sds_len_set(session->rbuf, flb_sds_len(session->rbuf) + bytes);
+        flb_connection_reset_io_timeout(session->conn);
+
+        ret = session_process(session);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Queue DATA frames of the request bodies within the flow control windows */
+static int session_pump(struct flb_http2_session *session)
+{
+    int ret;
+    int flags;
+    int progress;
+    int64_t len;
+    struct mk_list *head;
+    struct flb_http2_stream *stream;
+
+    do {
+        progress = FLB_FALSE;
+
+        /* one frame per stream and round, so large bodies don't starve */
+        mk_list_foreach(head, &session->streams) {
+            if (flb_sds_len(session->wbuf) - session->wbuf_off >=
+                WBUF_HIGH_WATER) {
+                return 0;
+            }
+
+            stream = mk_list_entry(head, struct flb_http2_stream, _head);
+            if (stream->done || stream->body_off >= stream->c->body_len) {
+                continue;
+            }
+
+            len = stream->c->body_len - stream->body_off;
+            if (len > session->max_frame_size) {
+                len = session->max_frame_size;
+            }
+            if (len > session->send_window) {
+                len = session->send_window;
+            }
+            if (len > stream->send_window) {
+                len = stream->send_window;
+            }
+            if (len <= 0) {
+                continue;
+            }
+
+            flags = 0;
+            if (stream->body_off + len == stream->c->body_len) {
+                flags = FLAG_END_STREAM;
+            }
+
+            ret = frame_write(session, FRAME_DATA, flags, stream->id,
+                              stream->c->body_buf + stream->body_off, len);
+            if (ret == -1) {
+                return -1;
+            }
+
+            stream->body_off += len;
+            stream->send_window -= len;
+            session->send_window -= len;
+            progress = FLB_TRUE;
+        }
+    } while (progress);
+
+    return 0;
+}
+
+static int session_write(struct flb_http2_session *session)
+{
+    size_t len;
+    ssize_t bytes;
+
+    len = flb_sds_len(session->wbuf);
+    while (session->wbuf_off < len) {
+        bytes = conn_write(session->conn, session->wbuf + session->wbuf_off,
+                           len - session->wbuf_off);
+        if (bytes == 0) {
+            break;
+        }
+        else if (bytes < 0) {
+            session_fail(session, "write error");
+            return -1;
+        }
+        session->wbuf_off += bytes;
+        flb_connection_reset_io_timeout(session->conn);
+    }
+
+    if (session->wbuf_off == len) {
+        flb_sds_len_set(session->wbuf, 0);
+        session->wbuf_off = 0;
+    }
+    else if (session->wbuf_off >= WBUF_HIGH_WATER) {
+        memmove(session->wbuf, session->wbuf + session->wbuf_off,
+                len - session->wbuf_off);
+        flb_sds_len_set(session->wbuf, len - session->wbuf_off);
+        session->wbuf_off = 0;
+    }
+
+    return 0;
+}
+
+/* Register the event handler, it waits for output space if there is any */
+static int session_event_update(struct flb_http2_session *session)
+{
+    int ret;
+    int mask = MK_EVENT_READ;
+    struct flb_connection *conn = session->conn;
+
+    if (session->wbuf_off < flb_sds_len(session->wbuf)) {
+        mask |= MK_EVENT_WRITE;
+    }
+
+    if ((conn->event.status & MK_EVENT_REGISTERED) &&
+        conn->event.type == FLB_ENGINE_EV_CUSTOM &&
+        conn->event.handler == cb_session_event &&
+        conn->event.mask == mask) {
+        return 0;
+    }
+
+    conn->event.handler = cb_session_event;
+    ret = mk_event_add(conn->evl, conn->fd, FLB_ENGINE_EV_CUSTOM, mask,
+                       &conn->event);
+    conn->event.priority = FLB_ENGINE_PRIORITY_SEND_RECV;
+
+    return ret;
+}
+
+/*
+ * Resume the coroutines of the finished streams. It can run from a request
+ * coroutine too, the current coroutine is restored once they yield back.
+ */
+static void session_wakeup(struct flb_http2_session *session)
+{
+    int found;
+    struct mk_list *head;
+    struct flb_coro *coro;
+    struct flb_coro *self;
+    struct flb_http2_stream *stream;
+
+    self = flb_coro_get();
+
+    /*
+     * A resumed coroutine can release its stream or queue a new request,
+     * the list is scanned again after each one.
+     */
+    do {
+        found = FLB_FALSE;
+        mk_list_foreach(head, &session->streams) {
+            stream = mk_list_entry(head, struct flb_http2_stream, _head);
+            if (stream->done && stream->coro) {
+                coro = stream->coro;
+                stream->coro = NULL;
+                found = FLB_TRUE;
+                flb_coro_resume(coro);
+                break;
+            }
+        }
+    } while (found);
+
+    flb_coro_set(self);
+}
+
+static int cb_session_event(void *data)
+{
+    int ret;
+    struct flb_connection *conn = data;
+    struct flb_http2_session *session = conn->http2_session;
+
+    if (session == NULL) {
+        return 0;
+    }
+
+    if (session->status != FLB_HTTP2_SESSION_ERROR) {
+        if (conn->fd == -1 || conn->net_error == ETIMEDOUT) {
+            session_fail(session, "connection timed out");
+        }
+        else {
+            ret = session_read(session);
+            if (ret == 0) {
+                ret = session_pump(session);
+            }
+            if (ret == 0) {
+                ret = session_write(session);
+            }
+            if (ret == 0) {
+                ret = session_event_update(session);
+            }
+            if (ret == -1) {
+                session_fail(session, "I/O error");
+            }
+        }
+    }
+
+    session_wakeup(session);
+
+    return 0;
+}
+
+/*
+ * Check if the request goes through HTTP/2, the session is created on the
+ * first request of the connection. Returns FLB_TRUE, FLB_FALSE or -1 on
+ * errors.
+ */
+int flb_http2_client_enabled(struct flb_http_client *c)
+{
+    struct flb_connection *conn = c->u_conn;
+    struct flb_http2_session *session;
+#ifdef FLB_HAVE_TLS
+    int ret;
+    char proto[16];
+#endif
+
+    if (conn->http2_session != NULL) {
+        return FLB_TRUE;
+    }
+
+    if (conn->type != FLB_UPSTREAM_CONNECTION || !conn->net->http2 ||
+        !flb_stream_is_async(conn->stream) || flb_coro_get() == NULL ||
+        c->proxy.host != NULL) {
+        return FLB_FALSE;
+    }
+
+#ifdef FLB_HAVE_TLS
+    if (conn->tls_session != NULL) {
+        ret = flb_tls_session_alpn_get(conn->tls_session,
+                                       proto, sizeof(proto));
+        if (ret != 0 || strcmp(proto, "h2") != 0) {
+            return FLB_FALSE;
+        }
+    }
+    else
+#endif
+    /* plain connections: prior knowledge, on new connections only */
+    if (conn->upstream->proxied_host != NULL || conn->ka_count > 0) {
+        return FLB_FALSE;
+    }
+
+    session = session_create(conn);
+    if (!session) {
+        return -1;
+    }
+    session->users = 1;
+    conn->http2_session = session;
+    conn->busy_flag = FLB_TRUE;
+
+    flb_debug("[http2] connection #%i to %s uses HTTP/2",
+              conn->fd, flb_connection_get_remote_address(conn));
+
+    return FLB_TRUE;
+}
+
+static int header_skip(const char *name, size_t len)
+{
+    int i;
+
+    for (i = 0; skip_headers[i] != NULL; i++) {
+        if (strlen(skip_headers[i]) == len &&
+            strncasecmp(skip_headers[i], name, len) == 0) {
+            return FLB_TRUE;
+        }
+    }
+
+    return FLB_FALSE;
+}
+
+/* Split a header line in name and value */
+static int header_line(const char *line, const char *eol,
+                       const char **name, size_t *name_len,
+                       const char **value, size_t *value_len)
+{
+    const char *p;
+    const char *end = eol;
+
+    p = memchr(line, ':', eol - line);
+    if (!p) {
+        return -1;
+    }
+    *name = line;
+    *name_len = p - line;
+
+    p++;
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) {
+        end--;
+    }
+    *value = p;
+    *value_len = end - p;
+
+    return 0;
+}
+
+/*
+ * Encode the request headers composed by flb_http_client in the HTTP/1.1
+ * format: the request line and the Host header become pseudo-headers.
+ */
+static int request_headers_encode(struct flb_http_client *c, int tls,
+                                  flb_sds_t *block)
+{
+    int ret;
+    size_t i;
+    size_t name_len;
+    size_t value_len;
+    const char *p;
+    const char *sp;
+    const char *eol;
+    const char *end;
+    const char *name;
+    const char *value;
+    const char *path;
+    size_t path_len;
+    const char *authority = NULL;
+    size_t authority_len = 0;
+    flb_sds_t lname;
+
+    p = c->header_buf;
+    end = c->header_buf + c->header_len;
+
+    /* request line: METHOD SP URI SP VERSION */
+    eol = memmem(p, end - p, "\r\n", 2);
+    if (!eol) {
+        return -1;
+    }
+    sp = memchr(p, ' ', eol - p);
+    if (!sp) {
+        return -1;
+    }
+    path = sp + 1;
+    for (path_len = eol - path; path_len > 0; path_len--) {
+        if (path[path_len - 1] == ' ') {
+            path_len--;
+            break;
+        }
+    }
+    if (path_len == 0) {
+        path = "/";
+        path_len = 1;
+    }
+
+    ret = flb_hpack_encode_header(block, ":method", 7, p, sp - p);
+    if (ret == 0) {
+        ret = flb_hpack_encode_header(block, ":scheme", 7,
+                                      tls ? "https" : "http", tls ? 5 : 4);
+    }
+    if (ret == 0) {
+        ret = flb_hpack_encode_header(block, ":path", 5, path, path_len);
+    }
+    if (ret == -1) {
+        return -1;
+    }
+
+    lname = flb_sds_create_size(64);
+    if (!lname) {
+        return -1;
+    }
+
+    /* the :authority must precede the regular headers */
+    for (p = eol + 2; p < end; p = eol + 2) {
+        eol = memmem(p, end - p, "\r\n", 2);
+        if (!eol || eol == p) {
+            break;
+        }
+        if (header_line(p, eol, &name, &name_len, &value, &value_len) == 0 &&
+            name_len == 4 && strncasecmp(name, "host", 4) == 0) {
+            authority = value;
+            authority_len = value_len;
+        }
+    }
+    if (authority) {
+        ret = flb_hpack_encode_header(block, ":authority", 10,
+                                      authority, authority_len);
+    }
+
+    p = memmem(c->header_buf, end - c->header_buf, "\r\n", 2) + 2;
+    for (; p < end && ret == 0; p = eol + 2) {
+        eol = memmem(p, end - p, "\r\n", 2);
+        if (!eol || eol == p) {
+            break;
+        }
+        if (header_line(p, eol, &name, &name_len, &value, &value_len) != 0 ||
+            header_skip(name, name_len)) {
+            continue;
+        }
+
+        /* header names are lowercase in HTTP/2 */
+        flb_sds_len_set(lname, 0);
+        ret = flb_sds_cat_safe(&lname, name, name_len);
+        if (ret == -1) {
+            break;
+        }
+        for (i = 0; i < name_len; i++) {
+            lname[i] = tolower((unsigned char) lname[i]);
+        }
+
+        ret = flb_hpack_encode_header(block, lname, name_len,
+                                      value, value_len);
+    }
+    flb_sds_destroy(lname);
+
+    return ret;
+}
+
+/* Queue the HEADERS frame of the request, and CONTINUATION frames if needed */
+static int stream_submit(struct flb_http2_session *session,
+                         struct flb_http2_stream *stream, size_t *bytes)
+{
+    int ret;
+    int type;
+    int flags;
+    size_t n;
+    size_t off = 0;
+    size_t len;
+    flb_sds_t block;
+    struct flb_http_client *c = stream->c;
+
+    block = flb_sds_create_size(512);
+    if (!block) {
+        return -1;
+    }
+
+    ret = request_headers_encode(c, session->conn->tls_session != NULL,
+                                 &block);
+    if (ret == -1) {
+        flb_error("[http2] cannot encode the request headers");
+        flb_sds_destroy(block);
+        return -1;
+    }
+
+    len = flb_sds_len(block);
+    type = FRAME_HEADERS;
+    do {
+        n = len - off;
+        if (n > session->max_frame_size) {
+            n = session->max_frame_size;
+        }
+
+        flags = 0;
+        if (off + n == len) {
+            flags |= FLAG_END_HEADERS;
+        }
+        if (type == FRAME_HEADERS && c->body_len == 0) {
+            flags |= FLAG_END_STREAM;
+        }
+
+        ret = frame_write(session, type, flags, stream->id, block + off, n);
+        if (ret == -1) {
+            break;
+        }
+
+        off += n;
+        type = FRAME_CONTINUATION;
+    } while (off < len);
+
+    flb_sds_destroy(block);
+    *bytes = len + c->body_len;
+
+    return ret;
+}
+
+/*
+ * Send the request as a new stream of the connection session and wait for
+ * its response. The response is exposed in 'c->resp' as usual.
+ */
+int flb_http2_client_do(struct flb_http_client *c, size_t *bytes)
+{
+    int ret;
+    struct flb_coro *coro;
+    struct flb_http2_stream *stream;
+    struct flb_http2_session *session = c->u_conn->http2_session;
+
+    coro = flb_coro_get();
+    if (coro == NULL) {
+        flb_error("[http2] requests must run in a coroutine");
+        return -1;
+    }
+
+    if (session->status != FLB_HTTP2_SESSION_ACTIVE ||
+        session->next_stream_id > MAX_STREAM_ID) {
+        c->u_conn->recycle = FLB_FALSE;
+        return -1;
+    }
+
+    stream = flb_calloc(1, sizeof(struct flb_http2_stream));
+    if (!stream) {
+        flb_errno();
+        return -1;
+    }
+    stream->id = session->next_stream_id;
+    stream->send_window = session->initial_window;
+    stream->c = c;
+    session->next_stream_id += 2;
+
+    c->resp.data_len = 0;
+    c->resp.headers_end = NULL;
+    c->resp.payload = NULL;
+    c->resp.payload_size = 0;
+
+    ret = stream_submit(session, stream, bytes);
+    if (ret == -1) {
+        flb_free(stream);
+        session_fail(session, "cannot queue the request");
+
+        /* the handler is gone, nothing else resumes the other streams */
+        session_wakeup(session);
+        return -1;
+    }
+    mk_list_add(&stream->_head, &session->streams);
+    session->n_streams++;
+
+    ret = session_pump(session);
+    if (ret == 0) {
+        ret = session_event_update(session);
+    }
+    if (ret == -1) {
+        session_fail(session, "cannot register the connection");
+        session_wakeup(session);
+    }
+
+    /* the session handler resumes the coroutine once the stream is done */
+    while (!stream->done) {
+        stream->coro = coro;
+        flb_coro_yield(coro, FLB_FALSE);
+    }
+    stream->coro = NULL;
+
+    ret = stream->error ? -1 : 0;
+    if (stream->truncated) {
+        c->u_conn->recycle = FLB_FALSE;
+    }
+
+    mk_list_del(&stream->_head);
+    session->n_streams--;
+    flb_free(stream);
+
+    if (session->status != FLB_HTTP2_SESSION_ACTIVE) {
+        c->u_conn->recycle = FLB_FALSE;
+    }
+
+    return ret;
+}
@@ -39,6 +39,7 @@
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_http_client.h>
 #include <fluent-bit/flb_http_client_debug.h>
+#include <fluent-bit/flb_http2_client.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_base64.h>
 
@@ -1054,6 +1055,17 @@ int flb_http_set_content_encoding_gzip(struct flb_http_client *c)
     return ret;
 }
 
+int flb_http_set_content_encoding_zstd(struct flb_http_client *c)
+{
+    int ret;
+
+    ret = flb_http_add_header(c,
+                              FLB_HTTP_HEADER_CONTENT_ENCODING,
+                              sizeof(FLB_HTTP_HEADER_CONTENT_ENCODING) - 1,
+                              "zstd", 4);
+    return ret;
+}
+
 int flb_http_set_callback_context(struct flb_http_client *c,
                                   struct flb_callback *cb_ctx)
 {
@@ -1181,6 +1193,22 @@ int flb_http_do(struct flb_http_client *c, size_t *bytes)
     }
 #endif
 
+    /* HTTP/2 connection: the request is sent as a stream of the session */
+    ret = flb_http2_client_enabled(c);
+    if (ret == -1) {
+        return -1;
+    }
+    else if (ret == FLB_TRUE) {
+        ret = flb_http2_client_do(c, bytes);
+        if (ret == -1) {
+            flb_error("[http_client] HTTP/2 request to %s:%i failed",
+                      c->u_conn->upstream->tcp_host,
+                      c->u_conn->upstream->tcp_port);
+            return -1;
+        }
+        goto response;
+    }
+
     /* Write the header */
     ret = flb_io_net_write(c->u_conn,
                            c->header_buf, c->header_len,
@@ -1288,6 +1316,7 @@ int flb_http_do(struct flb_http_client *c, size_t *bytes)
         }
     }
 
+ response:
 #ifdef FLB_HAVE_HTTP_CLIENT_DEBUG
     flb_http_client_debug_cb(c, "_debug.http.response_headers");
     if (c->resp.payload_size > 0) {
@@ -38,7 +38,6 @@
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_hash_table.h>
 #include <fluent-bit/flb_scheduler.h>
-#include <fluent-bit/flb_ring_buffer.h>
 
 /* input plugin macro helpers */
 #include <fluent-bit/flb_input_plugin.h>
@@ -51,20 +50,6 @@ struct flb_libco_in_params libco_in_param;
 
 #define protcmp(a, b)  strncasecmp(a, b, strlen(a))
 
-/*
- * Ring buffer size: we make space for 512 entries that each input instance can
- * use to enqueue data. Note that this value is fixed and only affect input plugins
- * which runs in threaded mode (separate thread)
- *
- * Ring buffer window: the current window size is set to 5% which means that the
- * ring buffer will emit a flush request whenever there are 51 records or more
- * awaiting to be consumed.
- */
-
-#define FLB_INPUT_RING_BUFFER_SIZE   (sizeof(void *) * 1024)
-#define FLB_INPUT_RING_BUFFER_WINDOW (5)
-
-
 static int check_protocol(const char *prot, const char *output)
 {
     int len;
@@ -322,18 +307,10 @@ struct flb_input_instance *flb_input_new(struct flb_config *config,
 
         }
 
-        /* allocate a ring buffer */
-        instance->rb = flb_ring_buffer_create(FLB_INPUT_RING_BUFFER_SIZE);
-        if (!instance->rb) {
-            flb_error("instance %s could not initialize ring buffer",
-                      flb_input_name(instance));
-            flb_free(instance);
-            return NULL;
-        }
-
         instance->mem_buf_status = FLB_INPUT_RUNNING;
         instance->mem_buf_limit = 0;
         instance->mem_chunks_size = 0;
+        instance->mem_filter_size = 0;
         instance->storage_buf_status = FLB_INPUT_RUNNING;
         mk_list_add(&instance->_head, &config->inputs);
     }
@@ -779,10 +756,6 @@ void flb_input_instance_destroy(struct flb_input_instance *ins)
     flb_storage_input_destroy(ins);
 
     mk_list_del(&ins->_head);
-
-    if (ins->rb) {
-        flb_ring_buffer_destroy(ins->rb);
-    }
     flb_free(ins);
 }
 
@@ -1142,15 +1115,6 @@ int flb_input_instance_init(struct flb_input_instance *ins,
                 flb_input_instance_destroy(ins);
                 return -1;
             }
-
-            /* register the ring buffer */
-            ret = flb_ring_buffer_add_event_loop(ins->rb, config->evl, FLB_INPUT_RING_BUFFER_WINDOW);
-            if (ret) {
-                flb_error("failed while registering ring buffer events on input %s",
-                          ins->name);
-                flb_input_instance_destroy(ins);
-                return -1;
-            }
         }
         else {
             /* initialize channel events */
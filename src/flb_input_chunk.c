@@ -35,7 +35,8 @@
 #include <fluent-bit/flb_routes_mask.h>
 #include <fluent-bit/flb_metrics.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
-#include <fluent-bit/flb_ring_buffer.h>
+#include <fluent-bit/flb_mpsc_queue.h>
+#include <fluent-bit/flb_filter_worker.h>
 #include <chunkio/chunkio.h>
 #include <monkey/mk_core.h>
 
@@ -1211,7 +1212,7 @@ static inline int flb_input_chunk_is_mem_overlimit(struct flb_input_instance *i)
         return FLB_FALSE;
     }
 
-    if (i->mem_chunks_size >= i->mem_buf_limit) {
+    if (i->mem_chunks_size + i->mem_filter_size >= i->mem_buf_limit) {
         return FLB_TRUE;
     }
 
@@ -1459,12 +1460,41 @@ static int memrb_input_chunk_release_space(struct flb_input_instance *ins,
     return -1;
 }
 
-/* Append a RAW MessagPack buffer to the input instance */
+#ifdef FLB_HAVE_METRICS
+/* Update the 'input' metrics with the ingested records */
+static void input_chunk_metrics_add(struct flb_input_instance *in,
+                                    size_t records, size_t bytes)
+{
+    uint64_t ts;
+
+    /* timestamp */
+    ts = cfl_time_now();
+
+    /* fluentbit_input_records_total */
+    cmt_counter_add(in->cmt_records, ts, records,
+                    1, (char *[]) {(char *) flb_input_name(in)});
+
+    /* fluentbit_input_bytes_total */
+    cmt_counter_add(in->cmt_bytes, ts, bytes,
+                    1, (char *[]) {(char *) flb_input_name(in)});
+
+    /* OLD api */
+    flb_metrics_sum(FLB_METRIC_N_RECORDS, records, in->metrics);
+    flb_metrics_sum(FLB_METRIC_N_BYTES, bytes, in->metrics);
+}
+#endif
+
+/*
+ * Append a RAW MessagPack buffer to the input instance. If 'filtered' is
+ * set, the records already went through the filter chain in a filter
+ * worker and were accounted by the input metrics.
+ */
 static int input_chunk_append_raw(struct flb_input_instance *in,
                                   int event_type,
                                   size_t n_records,
                                   const char *tag, size_t tag_len,
-                                  const void *buf, size_t buf_size)
+                                  const void *buf, size_t buf_size,
+                                  int filtered)
 {
     int ret;
     int set_down = FLB_FALSE;
@@ -1515,8 +1545,11 @@ static int input_chunk_append_raw(struct flb_input_instance *in,
         }
     }
 
-    /* Check if the input plugin has been paused */
-    if (flb_input_buf_paused(in) == FLB_TRUE) {
+    /*
+     * Check if the input plugin has been paused. Filtered records were
+     * accepted before: while in a worker they counted against the limit.
+     */
+    if (filtered == FLB_FALSE && flb_input_buf_paused(in) == FLB_TRUE) {
         flb_debug("[input chunk] %s is paused, cannot append records",
                   in->name);
         return -1;
@@ -1542,6 +1575,26 @@ static int input_chunk_append_raw(struct flb_input_instance *in,
         }
     }
 
+    /* Hand over the records to the filter workers, if any */
+    if (event_type == FLB_INPUT_LOGS && filtered == FLB_FALSE) {
+        ret = flb_filter_worker_dispatch(in, n_records, tag, tag_len,
+                                         buf, buf_size);
+        if (ret == FLB_FILTER_WORKER_QUEUED) {
+#ifdef FLB_HAVE_METRICS
+            if (n_records > 0) {
+                input_chunk_metrics_add(in, n_records, buf_size);
+            }
+#endif
+            /* released by flb_filter_worker_collect() */
+            in->mem_filter_size += buf_size;
+            flb_input_chunk_protect(in);
+            return 0;
+        }
+        else if (ret == -1) {
+            return -1;
+        }
+    }
+
     /*
      * Get a target input chunk, can be one with remaining space available
      * or a new one.
@@ -1601,26 +1654,13 @@ static int input_chunk_append_raw(struct flb_input_instance *in,
         ic->total_records += n_records;
     }
 
-    if (ic->total_records > 0) {
-        /* timestamp */
-        ts = cfl_time_now();
-
-        /* fluentbit_input_records_total */
-        cmt_counter_add(in->cmt_records, ts, ic->added_records,
-                        1, (char *[]) {(char *) flb_input_name(in)});
-
-        /* fluentbit_input_bytes_total */
-        cmt_counter_add(in->cmt_bytes, ts, buf_size,
-                        1, (char *[]) {(char *) flb_input_name(in)});
-
-        /* OLD api */
-        flb_metrics_sum(FLB_METRIC_N_RECORDS, ic->added_records, in->metrics);
-        flb_metrics_sum(FLB_METRIC_N_BYTES, buf_size, in->metrics);
+    if (ic->total_records > 0 && filtered == FLB_FALSE) {
+        input_chunk_metrics_add(in, ic->added_records, buf_size);
     }
 #endif
 
     /* Apply filters */
-    if (event_type == FLB_INPUT_LOGS) {
+    if (event_type == FLB_INPUT_LOGS && filtered == FLB_FALSE) {
         flb_filter_do(ic,
                       buf, buf_size,
                       tag, tag_len, in->config);
@@ -1746,19 +1786,20 @@ static void destroy_chunk_raw(struct input_chunk_raw *cr)
     flb_free(cr);
 }
 
-static int append_to_ring_buffer(struct flb_input_instance *ins,
-                                 int event_type,
-                                 size_t records,
-                                 const char *tag,
-                                 size_t tag_len,
-                                 const void *buf,
-                                 size_t buf_size)
+static int append_to_queue(struct flb_input_instance *ins,
+                           int event_type,
+                           size_t records,
+                           const char *tag,
+                           size_t tag_len,
+                           const void *buf,
+                           size_t buf_size)
 
 {
     int ret;
     int retries = 0;
-    int retry_limit = 10;
+    int retry_limit = 1000;
     struct input_chunk_raw *cr;
+    struct flb_mpsc_queue *queue = ins->config->in_queue;
 
     cr = flb_calloc(1, sizeof(struct input_chunk_raw));
     if (!cr) {
@@ -1796,68 +1837,111 @@ static int append_to_ring_buffer(struct flb_input_instance *ins,
     memcpy(cr->buf_data, buf, buf_size);
     cr->buf_size = buf_size;
 
-
-
-retry:
     /*
-     * There is a little chance that the ring buffer is full or due to saturation
-     * from the main thread the data is not being consumed. On this scenario we
-     * retry up to 'retry_limit' times with a little wait time.
+     * The queue is shared by all the threaded inputs and it's only full if
+     * the engine thread is saturated. On this scenario we retry up to
+     * 'retry_limit' times with a little wait time.
      */
-    if (retries >= retry_limit) {
-        flb_plg_error(ins, "could not enqueue records into the ring buffer");
-        destroy_chunk_raw(cr);
-        return -1;
+    while ((ret = flb_mpsc_queue_push(queue, cr)) == -1) {
+        if (retries == 0) {
+            flb_plg_debug(ins, "input queue is full, waiting");
+        }
+
+        if (++retries >= retry_limit) {
+            flb_plg_error(ins, "could not enqueue records into the input queue");
+            destroy_chunk_raw(cr);
+            return -1;
+        }
+
+        /* sleep for 1000 microseconds (1 millisecond) */
+        usleep(1000);
     }
 
-    /* append chunk raw context to the ring buffer */
-    ret = flb_ring_buffer_write(ins->rb, (void *) &cr, sizeof(cr));
-    if (ret == -1) {
-        printf("[%s] failed buffer write, retries=%i\n",
-               flb_input_name(ins), retries); fflush(stdout);
+    return 0;
+}
+
+/* Ingest the records enqueued by the threaded input instances */
+void flb_input_chunk_queue_collector(struct flb_config *ctx, void *data)
+{
+    int tag_len;
+    void *ptr;
+    struct input_chunk_raw *cr;
+
+    if (!ctx->in_queue) {
+        return;
+    }
+
+    while (flb_mpsc_queue_pop(ctx->in_queue, &ptr) == 0) {
+        cr = ptr;
+        if (cr->tag) {
+            tag_len = flb_sds_len(cr->tag);
+        }
+        else {
+            tag_len = 0;
+        }
 
-        /* sleep for 100000 microseconds (100 milliseconds) */
-        usleep(100000);
-        retries++;
-        goto retry;
+        input_chunk_append_raw(cr->ins, cr->event_type, cr->records,
+                               cr->tag, tag_len,
+                               cr->buf_data, cr->buf_size,
+                               FLB_FALSE);
+        destroy_chunk_raw(cr);
     }
+}
+
+/* Event loop handler: a threaded input enqueued records */
+static int input_queue_event(void *data)
+{
+    struct mk_event *event = data;
+    struct flb_config *ctx = event->data;
+
+    flb_mpsc_queue_signal_reset(ctx->in_queue);
+    flb_input_chunk_queue_collector(ctx, NULL);
 
     return 0;
 }
 
-void flb_input_chunk_ring_buffer_collector(struct flb_config *ctx, void *data)
+int flb_input_chunk_queue_create(struct flb_config *ctx)
 {
     int ret;
-    int tag_len = 0;
-    struct mk_list *head;
-    struct flb_input_instance *ins;
-    struct input_chunk_raw *cr;
 
-    mk_list_foreach(head, &ctx->inputs) {
-        ins = mk_list_entry(head, struct flb_input_instance, _head);
-        cr = NULL;
+    ctx->in_queue = flb_mpsc_queue_create(FLB_INPUT_CHUNK_QUEUE_SIZE);
+    if (!ctx->in_queue) {
+        return -1;
+    }
+
+    ret = flb_mpsc_queue_add_event_loop(ctx->in_queue, ctx->evl,
+                                        input_queue_event, ctx);
+    if (ret != 0) {
+        flb_error("[input chunk] could not register the input queue events");
+        flb_mpsc_queue_destroy(ctx->in_queue);
+        ctx->in_queue = NULL;
+        return -1;
+    }
 
-        while ((ret = flb_ring_buffer_read(ins->rb,
-                                           (void *) &cr,
-                                           sizeof(cr))) == 0) {
-            if (cr) {
-                if (cr->tag) {
-                    tag_len = flb_sds_len(cr->tag);
-                }
-                else {
-                    tag_len = 0;
-                }
+    return 0;
+}
 
-                input_chunk_append_raw(cr->ins, cr->event_type, cr->records,
-                                       cr->tag, tag_len,
-                                       cr->buf_data, cr->buf_size);
-                destroy_chunk_raw(cr);
-            }
-            cr = NULL;
-        }
+/* Release the queue, the input threads must be stopped already */
+void flb_input_chunk_queue_destroy(struct flb_config *ctx)
+{
+    int n = 0;
+    void *ptr;
+
+    if (!ctx->in_queue) {
+        return;
+    }
 
-        ins->rb->flush_pending = FLB_FALSE;
+    while (flb_mpsc_queue_pop(ctx->in_queue, &ptr) == 0) {
+        destroy_chunk_raw(ptr);
+        n++;
     }
+    if (n > 0) {
+        flb_warn("[input chunk] %i pending buffers dropped from the input queue",
+                 n);
+    }
+
+    flb_mpsc_queue_destroy(ctx->in_queue);
+    ctx->in_queue = NULL;
 }
 
 int flb_input_chunk_append_raw(struct flb_input_instance *in,
@@ -1867,24 +1951,46 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
                                const void *buf, size_t buf_size)
 {
     int ret;
+    struct flb_filter_worker *worker;
 
     /*
      * If the plugin instance registering the data runs in a separate thread, we must
-     * add the data reference to the ring buffer.
+     * add the data reference to the input queue.
      */
     if (flb_input_is_threaded(in)) {
-        ret = append_to_ring_buffer(in, event_type, records,
-                                    tag, tag_len,
-                                    buf, buf_size);
+        ret = append_to_queue(in, event_type, records,
+                              tag, tag_len,
+                              buf, buf_size);
+    }
+    else if ((worker = flb_filter_worker_get(in->config)) != NULL) {
+        /* records emitted by a filter running in a filter worker */
+        ret = flb_filter_worker_append(worker, in, event_type, records,
+                                       tag, tag_len, buf, buf_size);
     }
     else {
         ret = input_chunk_append_raw(in, event_type, records,
-                                     tag, tag_len, buf, buf_size);
+                                     tag, tag_len, buf, buf_size,
+                                     FLB_FALSE);
     }
 
     return ret;
 }
 
+/*
+ * Append records that were already processed by the filter chain in a
+ * filter worker, it must be called from the engine thread.
+ */
+int flb_input_chunk_append_filtered(struct flb_input_instance *in,
+                                    int event_type,
+                                    size_t records,
+                                    const char *tag, size_t tag_len,
+                                    const void *buf, size_t buf_size)
+{
+    return input_chunk_append_raw(in, event_type, records,
+                                  tag, tag_len, buf, buf_size,
+                                  FLB_TRUE);
+}
+
 /* Retrieve a raw buffer from a dyntag node */
 const void *flb_input_chunk_flush(struct flb_input_chunk *ic, size_t *size)
 {
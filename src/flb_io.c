@@ -63,6 +63,10 @@
 #include <fluent-bit/flb_coro.h>
 #include <fluent-bit/flb_http_client.h>
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 int flb_io_net_accept(struct flb_connection *connection,
                        struct flb_coro *coro)
 {
@@ -584,6 +588,437 @@ int flb_io_net_write(struct flb_connection *connection, const void *data,
     return ret;
 }
 
+/*
+ * Vectored writes: the caller passes the protocol framing and the payload as
+ * separate fragments, the payload can point directly to the chunk content.
+ */
+
+/* Skip the fragments already written, returns the remaining count */
+static int iov_consume(struct mk_iovec *iov, int iovcnt, int *index,
+                       size_t bytes)
+{
+    while (*index < iovcnt && bytes > 0) {
+        if (bytes < iov[*index].iov_len) {
+            iov[*index].iov_base = (char *) iov[*index].iov_base + bytes;
+            iov[*index].iov_len -= bytes;
+            bytes = 0;
+            break;
+        }
+        bytes -= iov[*index].iov_len;
+        (*index)++;
+    }
+
+    /* skip empty fragments */
+    while (*index < iovcnt && iov[*index].iov_len == 0) {
+        (*index)++;
+    }
+
+    return iovcnt - *index;
+}
+
+#ifdef FLB_SYSTEM_WINDOWS
+/*
+ * Windows has no writev(2) nor sendmsg(2): a stream socket gets one fragment
+ * per call, the caller loops until the vector is consumed. A datagram must go
+ * out at once, so its fragments are gathered first.
+ */
+static ssize_t fd_io_writev_raw(int fd, struct sockaddr_storage *address,
+                                struct mk_iovec *iov, int iovcnt)
+{
+    int i;
+    char *buf;
+    size_t len = 0;
+    ssize_t ret;
+
+    if (address == NULL) {
+        return send(fd, (char *) iov[0].iov_base, (int) iov[0].iov_len, 0);
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
+    buf = flb_malloc(len);
+    if (!buf) {
+        flb_errno();
+        return -1;
+    }
+
+    len = 0;
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(buf + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+
+    ret = sendto(fd, buf, (int) len, 0, (struct sockaddr *) address,
+                 flb_network_address_size(address));
+    flb_free(buf);
+
+    return ret;
+}
+#else
+static ssize_t fd_io_writev_raw(int fd, struct sockaddr_storage *address,
+                                struct mk_iovec *iov, int iovcnt)
+{
+    struct msghdr msg;
+
+    if (iovcnt > IOV_MAX) {
+        iovcnt = IOV_MAX;
+    }
+
+    if (address == NULL) {
+        return writev(fd, iov, iovcnt);
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = address;
+    msg.msg_namelen = flb_network_address_size(address);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    return sendmsg(fd, &msg, 0);
+}
+#endif
+
+static int fd_io_writev(int fd, struct sockaddr_storage *address,
+                        struct mk_iovec *iov, int iovcnt, size_t *out_len)
+{
+    int index = 0;
+    int tries = 0;
+    ssize_t ret;
+    size_t total = 0;
+
+    while (iov_consume(iov, iovcnt, &index, 0) > 0) {
+        ret = fd_io_writev_raw(fd, address, iov + index, iovcnt - index);
+        if (ret == -1) {
+            if (FLB_WOULDBLOCK()) {
+                /* same lazy strategy than fd_io_write() */
+                sleep(1);
+                tries++;
+
+                if (tries == 30) {
+                    *out_len = total;
+                    return -1;
+                }
+                continue;
+            }
+
+            *out_len = total;
+            return -1;
+        }
+
+        tries = 0;
+        total += ret;
+        iov_consume(iov, iovcnt, &index, ret);
+    }
+
+    *out_len = total;
+
+    return total;
+}
+
+/* Wait in the event loop until the socket is writable */
+static int net_io_write_wait(struct flb_coro *co,
+                             struct flb_connection *connection)
+{
+    int ret;
+    int error;
+    char so_error_buf[256];
+
+    ret = mk_event_add(connection->evl,
+                       connection->fd,
+                       FLB_ENGINE_EV_THREAD,
+                       MK_EVENT_WRITE,
+                       &connection->event);
+
+    connection->event.priority = FLB_ENGINE_PRIORITY_SEND_RECV;
+
+    if (ret == -1) {
+        return -1;
+    }
+
+    connection->coroutine = co;
+
+    flb_coro_yield(co, FLB_FALSE);
+
+    connection->coroutine = NULL;
+
+    /* the connection might have been dropped meanwhile (e.g: timeout) */
+    ret = mk_event_del(connection->evl, &connection->event);
+    if (ret == -1) {
+        return -1;
+    }
+
+    error = flb_socket_error(connection->fd);
+    if (error != 0) {
+        strerror_r(error, so_error_buf, sizeof(so_error_buf) - 1);
+
+        flb_error("[io fd=%i] error sending data to: %s (%s)",
+                  connection->fd,
+                  flb_connection_get_remote_address(connection),
+                  so_error_buf);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int net_io_writev_async(struct flb_coro *co,
+                               struct flb_connection *connection,
+                               struct mk_iovec *iov, int iovcnt,
+                               size_t *out_len)
+{
+    int ret;
+    int index = 0;
+    ssize_t bytes;
+    size_t total = 0;
+
+    while (iov_consume(iov, iovcnt, &index, 0) > 0) {
+        bytes = fd_io_writev_raw(connection->fd, NULL,
+                                 iov + index, iovcnt - index);
+
+        flb_trace("[io coro=%p] [fd %i] writev_async(2)=%zd (%zu)",
+                  co, connection->fd, bytes, total);
+
+        if (bytes == -1) {
+            if (!FLB_WOULDBLOCK()) {
+                *out_len = total;
+                return -1;
+            }
+
+            ret = net_io_write_wait(co, connection);
+            if (ret == -1) {
+                *out_len = total;
+                return -1;
+            }
+            continue;
+        }
+
+        total += bytes;
+        iov_consume(iov, iovcnt, &index, bytes);
+    }
+
+    *out_len = total;
+
+    return total;
+}
+
+#ifdef FLB_HAVE_TLS
+/*
+ * TLS has no vectored write: every write produces at least one record. Small
+ * fragments are gathered in a record sized buffer so the framing travels in
+ * the same record than the beginning of the payload, large fragments are
+ * handed to the TLS library as they are, without copies.
+ */
+static int net_io_tls_write(struct flb_coro *co, struct flb_connection *connection,
+                            int flags, const void *data, size_t len)
+{
+    int ret;
+    size_t out_len;
+
+    if (flags & FLB_IO_ASYNC) {
+        ret = flb_tls_net_write_async(co, connection->tls_session,
+                                      data, len, &out_len);
+    }
+    else {
+        ret = flb_tls_net_write(connection->tls_session, data, len, &out_len);
+    }
+
+    return ret == -1 ? -1 : 0;
+}
+
+static int net_io_tls_writev(struct flb_coro *co,
+                             struct flb_connection *connection, int flags,
+                             struct mk_iovec *iov, int iovcnt, size_t *out_len)
+{
+    int i;
+    int ret;
+    char *p;
+    char *buf = NULL;
+    size_t len;
+    size_t size;
+    size_t buf_len = 0;
+    size_t total = 0;
+
+    for (i = 0; i < iovcnt; i++) {
+        p = iov[i].iov_base;
+        len = iov[i].iov_len;
+
+        while (len > 0) {
+            /* nothing gathered: large fragments go straight through */
+            if (buf_len == 0 && len >= FLB_IO_TLS_RECORD_SIZE) {
+                ret = net_io_tls_write(co, connection, flags, p, len);
+                if (ret == -1) {
+                    goto error;
+                }
+                total += len;
+                break;
+            }
+
+            if (buf == NULL) {
+                buf = flb_malloc(FLB_IO_TLS_RECORD_SIZE);
+                if (!buf) {
+                    flb_errno();
+                    goto error;
+                }
+            }
+
+            size = FLB_IO_TLS_RECORD_SIZE - buf_len;
+            if (size > len) {
+                size = len;
+            }
+            memcpy(buf + buf_len, p, size);
+            buf_len += size;
+            p += size;
+            len -= size;
+
+            if (buf_len == FLB_IO_TLS_RECORD_SIZE) {
+                ret = net_io_tls_write(co, connection, flags, buf, buf_len);
+                if (ret == -1) {
+                    goto error;
+                }
+                total += buf_len;
+                buf_len = 0;
+            }
+        }
+    }
+
+    if (buf_len > 0) {
+        ret = net_io_tls_write(co, connection, flags, buf, buf_len);
+        if (ret == -1) {
+            goto error;
+        }
+        total += buf_len;
+    }
+
+    flb_free(buf);
+    *out_len = total;
+
+    return total;
+
+ error:
+    flb_free(buf);
+    *out_len = total;
+
+    return -1;
+}
+#endif
+
+/*
+ * Write a list of buffers to a connection, same semantics than
+ * flb_io_net_write(). The iovec content is not modified.
+ */
+int flb_io_net_writev(struct flb_connection *connection,
+                      const struct mk_iovec *iov, int iovcnt, size_t *out_len)
+{
+    int i;
+    int ret;
+    int flags;
+    size_t len = 0;
+    struct flb_coro *coro;
+    struct mk_iovec stack_iov[FLB_IO_IOV_STACK];
+    struct mk_iovec *vec = stack_iov;
+    struct sockaddr_storage *address;
+
+    ret = -1;
+    *out_len = 0;
+    coro = flb_coro_get();
+    flags = flb_connection_get_flags(connection);
+
+    for (i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
+    flb_trace("[io coro=%p] [net_writev] trying %zu bytes in %i buffers",
+              coro, len, iovcnt);
+
+    if (len == 0) {
+        return 0;
+    }
+
+    /* the writes consume the vector, work on a copy */
+    if (iovcnt > FLB_IO_IOV_STACK) {
+        vec = flb_malloc(sizeof(struct mk_iovec) * iovcnt);
+        if (!vec) {
+            flb_errno();
+            return -1;
+        }
+    }
+    memcpy(vec, iov, sizeof(struct mk_iovec) * iovcnt);
+
+    if (connection->tls_session == NULL) {
+        if (connection->fd <= 0 && connection->type == FLB_UPSTREAM_CONNECTION) {
+            ret = flb_io_net_connect(connection, coro);
+        }
+        else {
+            ret = 0;
+        }
+
+        if (ret == -1) {
+            /* failed connection attempt */
+        }
+        else if (flags & FLB_IO_ASYNC) {
+            ret = net_io_writev_async(coro, connection, vec, iovcnt, out_len);
+        }
+        else {
+            address = NULL;
+
+            if (connection->type == FLB_DOWNSTREAM_CONNECTION &&
+                (connection->stream->transport == FLB_TRANSPORT_UDP ||
+                 connection->stream->transport == FLB_TRANSPORT_UNIX_DGRAM)) {
+                address = &connection->raw_remote_host;
+            }
+
+            ret = fd_io_writev(connection->fd, address, vec, iovcnt, out_len);
+        }
+    }
+#ifdef FLB_HAVE_TLS
+    else if (flags & FLB_IO_TLS) {
+        ret = net_io_tls_writev(coro, connection, flags, vec, iovcnt, out_len);
+    }
+#endif
+
+    if (vec != stack_iov) {
+        flb_free(vec);
+    }
+
+    if (ret > 0) {
+        flb_connection_reset_io_timeout(connection);
+    }
+
+    flb_trace("[io coro=%p] [net_writev] ret=%i total=%zu/%zu",
+              coro, ret, *out_len, len);
+
+    return ret;
+}
+
+/* Vectored write to fd. For unix socket. */
+int flb_io_fd_writev(int fd, const struct mk_iovec *iov, int iovcnt,
+                     size_t *out_len)
+{
+    int ret;
+    struct mk_iovec stack_iov[FLB_IO_IOV_STACK];
+    struct mk_iovec *vec = stack_iov;
+
+    if (iovcnt > FLB_IO_IOV_STACK) {
+        vec = flb_malloc(sizeof(struct mk_iovec) * iovcnt);
+        if (!vec) {
+            flb_errno();
+            return -1;
+        }
+    }
+    memcpy(vec, iov, sizeof(struct mk_iovec) * iovcnt);
+
+    ret = fd_io_writev(fd, NULL, vec, iovcnt, out_len);
+
+    if (vec != stack_iov) {
+        flb_free(vec);
+    }
+
+    return ret;
+}
+
 ssize_t flb_io_fd_read(int fd, void *buf, size_t len)
 {
     /* TODO: support async mode */
@@ -0,0 +1,478 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Log event decoder
+ * -----------------
+ * Iterate the records of a log chunk without unpacking them. Every call to
+ * flb_log_event_decoder_next() only locates the record boundaries and
+ * decodes the timestamp; the body is exposed as a raw msgpack map. Callers
+ * that need the record contents can unpack the whole body or a single key,
+ * the resulting objects live in a zone owned by the decoder that is reused
+ * for every record, so iterating a chunk does not allocate per record.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_log_event_decoder.h>
+
+#include <msgpack.h>
+#include <mpack/mpack.h>
+
+static inline uint32_t read_be32(const char *p)
+{
+    const unsigned char *u = (const unsigned char *) p;
+
+    return ((uint32_t) u[0] << 24) | ((uint32_t) u[1] << 16) |
+           ((uint32_t) u[2] << 8)  |  (uint32_t) u[3];
+}
+
+static inline uint32_t read_be16(const char *p)
+{
+    const unsigned char *u = (const unsigned char *) p;
+
+    return ((uint32_t) u[0] << 8) | (uint32_t) u[1];
+}
+
+/*
+ * Return the end of the msgpack object starting at 'p', or NULL if it is
+ * truncated or invalid. Containers are not walked recursively, only the
+ * number of pending objects is tracked, so finding the record boundaries
+ * costs a single pass over the headers and no decoding.
+ */
+static const char *skip_object(const char *p, const char *end)
+{
+    uint64_t pending = 1;
+    size_t hdr;
+    size_t len;
+    unsigned char c;
+
+    while (pending > 0) {
+        if (p >= end) {
+            return NULL;
+        }
+
+        c = (unsigned char) *p++;
+        pending--;
+
+        /* fixint, negative fixint */
+        if (c <= 0x7f || c >= 0xe0) {
+            continue;
+        }
+        /* fixmap */
+        else if (c <= 0x8f) {
+            pending += (uint64_t) (c & 0x0f) * 2;
+            continue;
+        }
+        /* fixarray */
+        else if (c <= 0x9f) {
+            pending += c & 0x0f;
+            continue;
+        }
+        /* fixstr */
+        else if (c <= 0xbf) {
+            len = c & 0x1f;
+            goto skip;
+        }
+
+        /* size of the length field that follows the type byte */
+        switch (c) {
+        case 0xc4: case 0xc7: case 0xd9:
+            hdr = 1;
+            break;
+        case 0xc5: case 0xc8: case 0xda: case 0xdc: case 0xde:
+            hdr = 2;
+            break;
+        case 0xc6: case 0xc9: case 0xdb: case 0xdd: case 0xdf:
+            hdr = 4;
+            break;
+        default:
+            hdr = 0;
+        }
+
+        if ((size_t) (end - p) < hdr) {
+            return NULL;
+        }
+
+        switch (c) {
+        case 0xc0: case 0xc2: case 0xc3:                /* nil, bool */
+            continue;
+        case 0xc4: case 0xd9:                           /* bin8, str8 */
+            len = (unsigned char) *p;
+            break;
+        case 0xc5: case 0xda:                           /* bin16, str16 */
+            len = read_be16(p);
+            break;
+        case 0xc6: case 0xdb:                           /* bin32, str32 */
+            len = read_be32(p);
+            break;
+        case 0xc7:                                      /* ext8 */
+            len = (size_t) (unsigned char) *p + 1;
+            break;
+        case 0xc8:                                      /* ext16 */
+            len = (size_t) read_be16(p) + 1;
+            break;
+        case 0xc9:                                      /* ext32 */
+            len = (size_t) read_be32(p) + 1;
+            break;
+        case 0xcc: case 0xd0:                           /* uint8, int8 */
+            len = 1;
+            break;
+        case 0xcd: case 0xd1:                           /* uint16, int16 */
+            len = 2;
+            break;
+        case 0xca: case 0xce: case 0xd2:                /* float, (u)int32 */
+            len = 4;
+            break;
+        case 0xcb: case 0xcf: case 0xd3:                /* double, (u)int64 */
+            len = 8;
+            break;
+        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+            len = (1 << (c - 0xd4)) + 1;                /* fixext */
+            break;
+        case 0xdc:                                      /* array16 */
+            pending += read_be16(p);
+            p += hdr;
+            continue;
+        case 0xdd:                                      /* array32 */
+            pending += read_be32(p);
+            p += hdr;
+            continue;
+        case 0xde:                                      /* map16 */
+            pending += (uint64_t) read_be16(p) * 2;
+            p += hdr;
+            continue;
+        case 0xdf:                                      /* map32 */
+            pending += (uint64_t) read_be32(p) * 2;
+            p += hdr;
+            continue;
+        default:                                        /* 0xc1 */
+            return NULL;
+        }
+        p += hdr;
+
+skip:
+        if ((size_t) (end - p) < len) {
+            return NULL;
+        }
+        p += len;
+    }
+
+    return p;
+}
+
+static int decode_timestamp(mpack_reader_t *reader, struct flb_time *tm)
+{
+    double d;
+    int64_t i;
+    const char *ext;
+    mpack_tag_t tag;
+
+    tag = mpack_read_tag(reader);
+    if (mpack_reader_error(reader) != mpack_ok) {
+        return -1;
+    }
+
+    switch (mpack_tag_type(&tag)) {
+    case mpack_type_uint:
+        tm->tm.tv_sec  = mpack_tag_uint_value(&tag);
+        tm->tm.tv_nsec = 0;
+        break;
+    case mpack_type_int:
+        i = mpack_tag_int_value(&tag);
+        if (i < 0) {
+            return -1;
+        }
+        tm->tm.tv_sec  = i;
+        tm->tm.tv_nsec = 0;
+        break;
+    case mpack_type_float:
+    case mpack_type_double:
+        if (mpack_tag_type(&tag) == mpack_type_float) {
+            d = mpack_tag_float_value(&tag);
+        }
+        else {
+            d = mpack_tag_double_value(&tag);
+        }
+        flb_time_from_double(tm, d);
+        break;
+    case mpack_type_ext:
+        /* EventTime: 32 bits seconds + 32 bits nanoseconds, big endian */
+        if (mpack_tag_ext_exttype(&tag) != 0 ||
+            mpack_tag_ext_length(&tag) != 8) {
+            return -1;
+        }
+        ext = mpack_read_bytes_inplace(reader, 8);
+        if (mpack_reader_error(reader) != mpack_ok) {
+            return -1;
+        }
+        tm->tm.tv_sec  = read_be32(ext);
+        tm->tm.tv_nsec = read_be32(ext + 4);
+        break;
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Decode the record in [buf, buf + size), which is known to be complete */
+static int decode_record(const char *buf, size_t size,
+                         struct flb_log_event *event)
+{
+    mpack_tag_t tag;
+    mpack_reader_t reader;
+
+    mpack_reader_init_data(&reader, buf, size);
+
+    tag = mpack_read_tag(&reader);
+    if (mpack_reader_error(&reader) != mpack_ok ||
+        mpack_tag_type(&tag) != mpack_type_array ||
+        mpack_tag_array_count(&tag) != 2) {
+        return -1;
+    }
+
+    if (decode_timestamp(&reader, &event->timestamp) != 0) {
+        return -1;
+    }
+
+    tag = mpack_peek_tag(&reader);
+    if (mpack_reader_error(&reader) != mpack_ok ||
+        mpack_tag_type(&tag) != mpack_type_map) {
+        return -1;
+    }
+
+    event->raw = buf;
+    event->raw_size = size;
+    event->body_raw = reader.data;
+    event->body_raw_size = (buf + size) - reader.data;
+    event->body_entries = mpack_tag_map_count(&tag);
+    event->body = NULL;
+
+    return 0;
+}
+
+int flb_log_event_decoder_init(struct flb_log_event_decoder *ctx,
+                               const char *buf, size_t size)
+{
+    ctx->buffer = buf;
+    ctx->length = size;
+    ctx->offset = 0;
+    ctx->skipped = 0;
+
+    ctx->zone = msgpack_zone_new(MSGPACK_ZONE_CHUNK_SIZE);
+    if (!ctx->zone) {
+        flb_errno();
+        return -1;
+    }
+
+    return 0;
+}
+
+void flb_log_event_decoder_destroy(struct flb_log_event_decoder *ctx)
+{
+    if (ctx->zone) {
+        msgpack_zone_free(ctx->zone);
+        ctx->zone = NULL;
+    }
+}
+
+/*
+ * Move to the next record. Objects that are not '[timestamp, {map}]' records
+ * are skipped, as the per plugin unpack loops used to do, and counted in
+ * ctx->skipped for the callers that must reject them instead. It returns
+ * FLB_EVENT_DECODER_END once the buffer is consumed and
+ * FLB_EVENT_DECODER_ERROR if the remaining data is truncated or corrupted.
+ */
+int flb_log_event_decoder_next(struct flb_log_event_decoder *ctx,
+                               struct flb_log_event *event)
+{
+    const char *end;
+    const char *start;
+
+    while (ctx->offset < ctx->length) {
+        start = ctx->buffer + ctx->offset;
+
+        /* find the end of the record without decoding its content */
+        end = skip_object(start, ctx->buffer + ctx->length);
+        if (!end) {
+            return FLB_EVENT_DECODER_ERROR;
+        }
+        ctx->offset = end - ctx->buffer;
+
+        if (decode_record(start, end - start, event) == 0) {
+            return FLB_EVENT_DECODER_SUCCESS;
+        }
+        ctx->skipped++;
+    }
+
+    return FLB_EVENT_DECODER_END;
+}
+
+/*
+ * Unpack the record body. The returned object is valid until the next call
+ * to flb_log_event_decoder_get_body() or flb_log_event_decoder_get_value().
+ */
+msgpack_object *flb_log_event_decoder_get_body(struct flb_log_event_decoder *ctx,
+                                               struct flb_log_event *event)
+{
+    int ret;
+    size_t off = 0;
+
+    if (event->body) {
+        return event->body;
+    }
+
+    msgpack_zone_clear(ctx->zone);
+    ret = msgpack_unpack(event->body_raw, event->body_raw_size, &off,
+                         ctx->zone, &ctx->body);
+    if (ret != MSGPACK_UNPACK_SUCCESS) {
+        return NULL;
+    }
+
+    event->body = &ctx->body;
+    return event->body;
+}
+
+/* Return the string at 'p', or NULL if the object is not a string */
+static const char *read_str(const char *p, const char *end, size_t *len)
+{
+    unsigned char c;
+
+    if (p >= end) {
+        return NULL;
+    }
+
+    c = (unsigned char) *p;
+    if (c >= 0xa0 && c <= 0xbf) {
+        *len = c & 0x1f;
+        p += 1;
+    }
+    else if (c == 0xd9 && end - p >= 2) {
+        *len = (unsigned char) p[1];
+        p += 2;
+    }
+    else if (c == 0xda && end - p >= 3) {
+        *len = read_be16(p + 1);
+        p += 3;
+    }
+    else if (c == 0xdb && end - p >= 5) {
+        *len = read_be32(p + 1);
+        p += 5;
+    }
+    else {
+        return NULL;
+    }
+
+    if ((size_t) (end - p) < *len) {
+        return NULL;
+    }
+
+    return p;
+}
+
+/*
+ * Lookup a top level key of the record body and unpack only its value, the
+ * other entries are skipped in place. If the body has been unpacked already
+ * the lookup is done over it. When a key is repeated the last entry wins, as
+ * with the record accessor. The returned object follows the same lifetime
+ * rules than flb_log_event_decoder_get_body().
+ */
+msgpack_object *flb_log_event_decoder_get_value(struct flb_log_event_decoder *ctx,
+                                                struct flb_log_event *event,
+                                                const char *key, size_t key_len)
+{
+    int ret;
+    size_t i;
+    size_t len;
+    size_t off = 0;
+    const char *p;
+    const char *end;
+    const char *str;
+    const char *val;
+    const char *found = NULL;
+    const char *found_end = NULL;
+    unsigned char c;
+    msgpack_object_kv *kv;
+
+    if (event->body) {
+        for (i = event->body->via.map.size; i > 0; i--) {
+            kv = &event->body->via.map.ptr[i - 1];
+            if (kv->key.type == MSGPACK_OBJECT_STR &&
+                kv->key.via.str.size == key_len &&
+                memcmp(kv->key.via.str.ptr, key, key_len) == 0) {
+                return &kv->val;
+            }
+        }
+        return NULL;
+    }
+
+    p = event->body_raw;
+    end = p + event->body_raw_size;
+
+    /* skip the map header, its size is already known */
+    c = (unsigned char) *p;
+    if (c == 0xde) {
+        p += 3;
+    }
+    else if (c == 0xdf) {
+        p += 5;
+    }
+    else {
+        p += 1;
+    }
+
+    for (i = 0; i < event->body_entries; i++) {
+        str = read_str(p, end, &len);
+        if (str) {
+            val = str + len;
+        }
+        else {
+            val = skip_object(p, end);
+            if (!val) {
+                return NULL;
+            }
+        }
+
+        p = skip_object(val, end);
+        if (!p) {
+            return NULL;
+        }
+
+        if (str && len == key_len && memcmp(str, key, key_len) == 0) {
+            found = val;
+            found_end = p;
+        }
+    }
+
+    if (!found) {
+        return NULL;
+    }
+
+    msgpack_zone_clear(ctx->zone);
+    ret = msgpack_unpack(found, found_end - found, &off, ctx->zone,
+                         &ctx->value);
+    if (ret != MSGPACK_UNPACK_SUCCESS) {
+        return NULL;
+    }
+
+    return &ctx->value;
+}
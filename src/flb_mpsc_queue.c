@@ -0,0 +1,257 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Bounded MPSC queue based on the array queue described by Dmitry Vyukov:
+ *
+ *  - https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ *
+ * with a single consumer, so the tail is a plain counter.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_engine_macros.h>
+#include <fluent-bit/flb_mpsc_queue.h>
+
+#include <monkey/mk_core.h>
+
+#ifdef FLB_HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+static void flb_mpsc_queue_remove_event_loop(struct flb_mpsc_queue *q);
+
+struct flb_mpsc_queue *flb_mpsc_queue_create(uint64_t size)
+{
+    uint64_t i;
+    uint64_t cells = 2;
+    struct flb_mpsc_queue *q;
+
+    /* the number of cells must be a power of two */
+    while (cells < size) {
+        cells <<= 1;
+    }
+
+    q = flb_calloc(1, sizeof(struct flb_mpsc_queue));
+    if (!q) {
+        flb_errno();
+        return NULL;
+    }
+    q->signal_channels[0] = -1;
+    q->signal_channels[1] = -1;
+
+    q->cells = flb_malloc(sizeof(struct flb_mpsc_queue_cell) * cells);
+    if (!q->cells) {
+        flb_errno();
+        flb_free(q);
+        return NULL;
+    }
+
+    for (i = 0; i < cells; i++) {
+        q->cells[i].seq = i;
+        q->cells[i].data = NULL;
+    }
+    q->mask = cells - 1;
+
+    return q;
+}
+
+void flb_mpsc_queue_destroy(struct flb_mpsc_queue *q)
+{
+    flb_mpsc_queue_remove_event_loop(q);
+
+    flb_free(q->cells);
+    flb_free(q);
+}
+
+int flb_mpsc_queue_add_event_loop(struct flb_mpsc_queue *q, void *evl,
+                                  int (*handler)(void *), void *data)
+{
+    int ret;
+
+#ifdef FLB_HAVE_EVENTFD
+    q->signal_channels[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (q->signal_channels[0] == -1) {
+        flb_errno();
+        return -2;
+    }
+    q->signal_channels[1] = q->signal_channels[0];
+#else
+    ret = flb_pipe_create(q->signal_channels);
+    if (ret == -1) {
+        return -2;
+    }
+
+    flb_pipe_set_nonblocking(q->signal_channels[0]);
+    flb_pipe_set_nonblocking(q->signal_channels[1]);
+#endif
+
+    MK_EVENT_INIT(&q->event, q->signal_channels[0], data, handler);
+
+    ret = mk_event_add(evl,
+                       q->signal_channels[0],
+                       FLB_ENGINE_EV_CUSTOM,
+                       MK_EVENT_READ,
+                       &q->event);
+    if (ret == -1) {
+#ifdef FLB_HAVE_EVENTFD
+        close(q->signal_channels[0]);
+#else
+        flb_pipe_destroy(q->signal_channels);
+#endif
+        q->signal_channels[0] = -1;
+        q->signal_channels[1] = -1;
+        return -3;
+    }
+    q->event.type = FLB_ENGINE_EV_CUSTOM;
+    q->event_loop = evl;
+
+    return 0;
+}
+
+static void flb_mpsc_queue_remove_event_loop(struct flb_mpsc_queue *q)
+{
+    if (q->event_loop == NULL) {
+        return;
+    }
+
+    mk_event_del(q->event_loop, &q->event);
+#ifdef FLB_HAVE_EVENTFD
+    close(q->signal_channels[0]);
+#else
+    flb_pipe_destroy(q->signal_channels);
+#endif
+    q->signal_channels[0] = -1;
+    q->signal_channels[1] = -1;
+    q->event_loop = NULL;
+}
+
+/*
+ * Consume the pending wakeup. It must be called by the consumer before it
+ * drains the queue: any element pushed after the reset signals again.
+ */
+void flb_mpsc_queue_signal_reset(struct flb_mpsc_queue *q)
+{
+    char buf[64];
+
+#ifdef FLB_HAVE_EVENTFD
+    uint64_t val;
+
+    (void) buf;
+    if (read(q->signal_channels[0], &val, sizeof(val)) == -1) {
+        /* nothing to read */
+    }
+#else
+    while (flb_pipe_r(q->signal_channels[0], buf, sizeof(buf)) > 0);
+#endif
+
+    /*
+     * The exchange pairs with the one done by the producers, the elements
+     * they pushed before the signal are visible after this point.
+     */
+    __atomic_exchange_n(&q->signaled, FLB_FALSE, __ATOMIC_ACQ_REL);
+}
+
+static inline void queue_signal(struct flb_mpsc_queue *q)
+{
+#ifdef FLB_HAVE_EVENTFD
+    uint64_t val = 1;
+#else
+    char val = '.';
+#endif
+
+    if (q->event_loop == NULL) {
+        return;
+    }
+
+    /* only the first producer after a reset wakes up the consumer */
+    if (__atomic_exchange_n(&q->signaled, FLB_TRUE, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    if (flb_pipe_w(q->signal_channels[1], &val, sizeof(val)) == -1) {
+        /* the channel is full, a wakeup is already pending */
+    }
+}
+
+/* Push a pointer, returns -1 if the queue is full */
+int flb_mpsc_queue_push(struct flb_mpsc_queue *q, void *data)
+{
+    int64_t dif;
+    uint64_t seq;
+    uint64_t pos;
+    struct flb_mpsc_queue_cell *cell;
+
+    pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    while (1) {
+        cell = &q->cells[pos & q->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        dif = (int64_t) seq - (int64_t) pos;
+
+        if (dif == 0) {
+            /* the cell is free, try to reserve the position */
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, FLB_TRUE,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            /* the consumer did not release this cell yet */
+            return -1;
+        }
+        else {
+            /* another producer took the position */
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data = data;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+    queue_signal(q);
+
+    return 0;
+}
+
+/* Pop a pointer, returns -1 if the queue is empty. Single consumer only. */
+int flb_mpsc_queue_pop(struct flb_mpsc_queue *q, void **data)
+{
+    uint64_t seq;
+    uint64_t pos;
+    struct flb_mpsc_queue_cell *cell;
+
+    pos = q->tail;
+    cell = &q->cells[pos & q->mask];
+    seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+
+    /* empty, or the producer that reserved the cell is still writing it */
+    if (seq != pos + 1) {
+        return -1;
+    }
+
+    *data = cell->data;
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    q->tail = pos + 1;
+
+    return 0;
+}
@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_mem.h>
@@ -174,42 +176,56 @@ void flb_output_coro_add(struct flb_output_instance *ins, struct flb_coro *coro)
 }
 
 /*
- * Flush a task through the output plugin, either using a worker thread + coroutine
- * or a simple co-routine in the current thread.
+ * Flush a task, or a batch of tasks led by 'task', through the output plugin,
+ * either using a worker thread + coroutine or a simple co-routine in the
+ * current thread. The caller accounts the task users.
  */
-int flb_output_task_flush(struct flb_task *task,
-                          struct flb_output_instance *out_ins,
-                          struct flb_config *config)
+int flb_output_flush_dispatch(struct flb_task *task,
+                              struct flb_output_batch *batch,
+                              struct flb_output_instance *out_ins,
+                              struct flb_config *config)
 {
     int ret;
     struct flb_output_flush *out_flush;
 
     if (flb_output_is_threaded(out_ins) == FLB_TRUE) {
-        flb_task_users_inc(task);
-
         /* Dispatch the task to the thread pool */
-        ret = flb_output_thread_pool_flush(task, out_ins, config);
-        if (ret == -1) {
-            flb_task_users_dec(task, FLB_FALSE);
-        }
+        return flb_output_thread_pool_flush(task, batch, out_ins, config);
     }
-    else {
-        /* Queue co-routine handling */
-        out_flush = flb_output_flush_create(task,
-                                           task->i_ins,
-                                           out_ins,
-                                           config);
-        if (!out_flush) {
-            return -1;
-        }
 
-        flb_task_users_inc(task);
-        ret = flb_pipe_w(config->ch_self_events[1], &out_flush,
-                        sizeof(struct flb_output_flush*));
-        if (ret == -1) {
-            flb_errno();
-            return -1;
-        }
+    /* Queue co-routine handling */
+    out_flush = flb_output_flush_create(task,
+                                        batch,
+                                        task->i_ins,
+                                        out_ins,
+                                        config);
+    if (!out_flush) {
+        return -1;
+    }
+
+    ret = flb_pipe_w(config->ch_self_events[1], &out_flush,
+                     sizeof(struct flb_output_flush*));
+    if (ret == -1) {
+        flb_errno();
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Flush a single task through the output plugin */
+int flb_output_task_flush(struct flb_task *task,
+                          struct flb_output_instance *out_ins,
+                          struct flb_config *config)
+{
+    int ret;
+
+    flb_task_users_inc(task);
+
+    ret = flb_output_flush_dispatch(task, NULL, out_ins, config);
+    if (ret == -1) {
+        flb_task_users_dec(task, FLB_FALSE);
+        return -1;
     }
 
     return 0;
@@ -260,6 +276,9 @@ int flb_output_instance_destroy(struct flb_output_instance *ins)
     }
 #endif
 
+    /* open batches, their tasks are released with the inputs */
+    flb_output_batch_destroy_all(ins);
+
     /* destroy callback context */
     if (ins->callback) {
         flb_callback_destroy(ins->callback);
@@ -451,6 +470,11 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
     instance->test_mode = FLB_FALSE;
     instance->is_threaded = FLB_FALSE;
     instance->tp_workers = plugin->workers;
+    instance->batch = FLB_FALSE;
+    instance->batch_min_size = FLB_OUTPUT_BATCH_MIN_SIZE;
+    instance->batch_max_size = FLB_OUTPUT_BATCH_MAX_SIZE;
+    instance->batch_latency_target = FLB_OUTPUT_BATCH_LATENCY_TARGET;
+    instance->batch_max_wait = FLB_OUTPUT_BATCH_MAX_WAIT;
 
     /* Retrieve an instance id for the output instance */
     instance->id = instance_id(config);
@@ -537,6 +561,7 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
     mk_list_init(&instance->upstreams);
     mk_list_init(&instance->flush_list);
     mk_list_init(&instance->flush_list_destroy);
+    mk_list_init(&instance->batches);
 
     mk_list_add(&instance->_head, &config->outputs);
 
@@ -558,6 +583,42 @@ static inline int prop_key_check(const char *key, const char *kv, int k_len)
     return -1;
 }
 
+/*
+ * Convert a batching time to milliseconds, a plain number is in milliseconds
+ * and the 'ms', 's' and 'm' suffixes are accepted. Returns -1 on invalid or
+ * non positive values.
+ */
+static int batch_time_to_ms(const char *str)
+{
+    long val;
+    char *end;
+
+    errno = 0;
+    val = strtol(str, &end, 10);
+    if (errno != 0 || end == str || val <= 0) {
+        return -1;
+    }
+
+    if (*end == '\0' || strcasecmp(end, "ms") == 0) {
+        /* already in milliseconds */
+    }
+    else if (strcasecmp(end, "s") == 0) {
+        val *= 1000;
+    }
+    else if (strcasecmp(end, "m") == 0) {
+        val *= 60000;
+    }
+    else {
+        return -1;
+    }
+
+    if (val > INT_MAX) {
+        return -1;
+    }
+
+    return (int) val;
+}
+
 /* Override a configuration property for the given input_instance plugin */
 int flb_output_set_property(struct flb_output_instance *ins,
                             const char *k, const char *v)
@@ -741,6 +802,70 @@ int flb_output_set_property(struct flb_output_instance *ins,
         flb_sds_destroy(tmp);
         ins->total_limit_size = (size_t) limit;
     }
+    else if (prop_key_check("workers.dispatch", k, len) == 0 && tmp) {
+        /* Set how the tasks are distributed across the workers */
+        if (strcasecmp(tmp, "round_robin") == 0) {
+            ins->tp_dispatch = FLB_OUTPUT_DISPATCH_ROUND_ROBIN;
+        }
+        else if (strcasecmp(tmp, "least_loaded") == 0) {
+            ins->tp_dispatch = FLB_OUTPUT_DISPATCH_LEAST_LOADED;
+        }
+        else {
+            flb_error("[config] invalid workers.dispatch '%s' for %s plugin",
+                      tmp, ins->name);
+            flb_sds_destroy(tmp);
+            return -1;
+        }
+        flb_sds_destroy(tmp);
+    }
+    else if (prop_key_check("workers.steal", k, len) == 0 && tmp) {
+        ret = flb_utils_bool(tmp);
+        flb_sds_destroy(tmp);
+        if (ret == -1) {
+            return -1;
+        }
+        ins->tp_steal = ret;
+    }
+    else if (prop_key_check("batch", k, len) == 0 && tmp) {
+        ret = flb_utils_bool(tmp);
+        flb_sds_destroy(tmp);
+        if (ret == -1) {
+            return -1;
+        }
+        ins->batch = ret;
+    }
+    else if ((prop_key_check("batch.min_size", k, len) == 0 ||
+              prop_key_check("batch.max_size", k, len) == 0) && tmp) {
+        limit = flb_utils_size_to_bytes(tmp);
+        flb_sds_destroy(tmp);
+        if (limit <= 0) {
+            flb_error("[config] invalid %s for %s plugin", k, ins->name);
+            return -1;
+        }
+
+        if (strcasecmp(k, "batch.min_size") == 0) {
+            ins->batch_min_size = (size_t) limit;
+        }
+        else {
+            ins->batch_max_size = (size_t) limit;
+        }
+    }
+    else if ((prop_key_check("batch.latency_target", k, len) == 0 ||
+              prop_key_check("batch.max_wait", k, len) == 0) && tmp) {
+        ret = batch_time_to_ms(tmp);
+        flb_sds_destroy(tmp);
+        if (ret == -1) {
+            flb_error("[config] invalid %s for %s plugin", k, ins->name);
+            return -1;
+        }
+
+        if (strcasecmp(k, "batch.latency_target") == 0) {
+            ins->batch_latency_target = ret;
+        }
+        else {
+            ins->batch_max_wait = ret;
+        }
+    }
     else if (prop_key_check("workers", k, len) == 0 && tmp) {
         /* Set the number of workers */
         ins->tp_workers = atoi(tmp);
@@ -858,6 +983,12 @@ int flb_output_init_all(struct flb_config *config)
          */
         ins->event.type = FLB_ENGINE_EV_OUTPUT;
 
+        /* Batching starts with the smallest target size */
+        if (ins->batch_max_size < ins->batch_min_size) {
+            ins->batch_max_size = ins->batch_min_size;
+        }
+        ins->batch_target = ins->batch_min_size;
+
         /* Metrics */
 #ifdef FLB_HAVE_METRICS
         /* Get name or alias for the instance */
@@ -0,0 +1,333 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_task.h>
+#include <fluent-bit/flb_event.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_output_plugin.h>
+#include <fluent-bit/flb_output_batch.h>
+
+#include <cfl/cfl.h>
+
+#include <inttypes.h>
+
+static struct flb_output_batch *batch_create(struct flb_output_instance *ins)
+{
+    struct flb_output_batch *batch;
+
+    batch = flb_calloc(1, sizeof(struct flb_output_batch));
+    if (!batch) {
+        flb_errno();
+        return NULL;
+    }
+
+    batch->n_alloc = 8;
+    batch->tasks = flb_malloc(sizeof(struct flb_task *) * batch->n_alloc);
+    if (!batch->tasks) {
+        flb_errno();
+        flb_free(batch);
+        return NULL;
+    }
+    batch->ts_open = cfl_time_now();
+    mk_list_add(&batch->_head, &ins->batches);
+
+    return batch;
+}
+
+void flb_output_batch_destroy(struct flb_output_batch *batch)
+{
+    if (batch->event_chunk) {
+        flb_event_chunk_destroy(batch->event_chunk);
+    }
+    if (batch->buf) {
+        flb_free(batch->buf);
+    }
+    flb_free(batch->tasks);
+    flb_free(batch);
+}
+
+static int batch_append(struct flb_output_batch *batch, struct flb_task *task)
+{
+    int n;
+    struct flb_task **tmp;
+
+    if (batch->n_tasks == batch->n_alloc) {
+        n = batch->n_alloc * 2;
+        tmp = flb_realloc(batch->tasks, sizeof(struct flb_task *) * n);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        batch->tasks = tmp;
+        batch->n_alloc = n;
+    }
+
+    batch->tasks[batch->n_tasks++] = task;
+    batch->size += task->event_chunk->size;
+
+    return 0;
+}
+
+/* Compose the content of the batch, the tasks records are concatenated */
+static int batch_compose(struct flb_output_batch *batch)
+{
+    int i;
+    size_t off = 0;
+    size_t total_events = 0;
+    struct flb_task *task;
+    struct flb_event_chunk *evc;
+
+    batch->buf = flb_malloc(batch->size);
+    if (!batch->buf) {
+        flb_errno();
+        return -1;
+    }
+
+    for (i = 0; i < batch->n_tasks; i++) {
+        evc = batch->tasks[i]->event_chunk;
+        memcpy(batch->buf + off, evc->data, evc->size);
+        off += evc->size;
+        total_events += evc->total_events;
+    }
+
+    task = batch->tasks[0];
+    batch->event_chunk = flb_event_chunk_create(task->event_chunk->type,
+                                                total_events,
+                                                task->event_chunk->tag,
+                                                flb_sds_len(task->event_chunk->tag),
+                                                batch->buf, batch->size);
+    if (!batch->event_chunk) {
+        flb_free(batch->buf);
+        batch->buf = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Deliver a batch, it's removed from the list of open batches */
+static void batch_commit(struct flb_output_batch *batch,
+                         struct flb_output_instance *ins,
+                         struct flb_config *config)
+{
+    int i;
+    int ret;
+    struct flb_task *task;
+
+    mk_list_del(&batch->_head);
+
+    /* a single task does not need a copy of its content */
+    if (batch->n_tasks == 1) {
+        task = batch->tasks[0];
+        flb_output_batch_destroy(batch);
+
+        ret = flb_output_flush_dispatch(task, NULL, ins, config);
+        if (ret == -1) {
+            flb_task_users_dec(task, FLB_FALSE);
+        }
+        return;
+    }
+
+    ret = batch_compose(batch);
+    if (ret == 0) {
+        batch->ts_start = cfl_time_now();
+        flb_plg_debug(ins, "batch of %i tasks, %zu bytes",
+                      batch->n_tasks, batch->size);
+
+        ret = flb_output_flush_dispatch(batch->tasks[0], batch, ins, config);
+        if (ret == 0) {
+            return;
+        }
+    }
+
+    /* the tasks were not dispatched, they will be picked up again later */
+    for (i = 0; i < batch->n_tasks; i++) {
+        flb_task_users_dec(batch->tasks[i], FLB_FALSE);
+    }
+    flb_output_batch_destroy(batch);
+}
+
+/*
+ * Queue the task in the open batch for its tag, the batch is delivered once
+ * it reaches the target size or by flb_output_batch_flush() when it's due.
+ */
+int flb_output_batch_add(struct flb_task *task,
+                         struct flb_output_instance *ins,
+                         struct flb_config *config)
+{
+    int ret;
+    size_t target;
+    struct mk_list *head;
+    struct flb_event_chunk *evc;
+    struct flb_output_batch *tmp;
+    struct flb_output_batch *batch = NULL;
+
+    evc = task->event_chunk;
+    target = __atomic_load_n(&ins->batch_target, __ATOMIC_RELAXED);
+
+    /* only logs can be merged, big chunks are delivered as they are */
+    if (evc->type != FLB_EVENT_TYPE_LOGS || evc->size >= target) {
+        return flb_output_task_flush(task, ins, config);
+    }
+
+    mk_list_foreach(head, &ins->batches) {
+        tmp = mk_list_entry(head, struct flb_output_batch, _head);
+        if (tmp->tasks[0]->i_ins == task->i_ins &&
+            flb_sds_cmp(tmp->tasks[0]->event_chunk->tag,
+                        evc->tag, flb_sds_len(evc->tag)) == 0) {
+            batch = tmp;
+            break;
+        }
+    }
+
+    if (batch && batch->size + evc->size > target) {
+        batch_commit(batch, ins, config);
+        batch = NULL;
+    }
+
+    if (!batch) {
+        batch = batch_create(ins);
+        if (!batch) {
+            return flb_output_task_flush(task, ins, config);
+        }
+    }
+
+    ret = batch_append(batch, task);
+    if (ret == -1) {
+        if (batch->n_tasks == 0) {
+            mk_list_del(&batch->_head);
+            flb_output_batch_destroy(batch);
+        }
+        return flb_output_task_flush(task, ins, config);
+    }
+    flb_task_users_inc(task);
+
+    if (batch->size >= target) {
+        batch_commit(batch, ins, config);
+    }
+
+    return 0;
+}
+
+/*
+ * Deliver the open batches that are due, called by the engine after every
+ * dispatch round. Batches stay open across rounds so the tasks of the next
+ * rounds can join them: a batch is due when waiting for the next round would
+ * exceed 'batch.max_wait'. If 'force' is set every open batch is delivered.
+ *
+ * The age of a batch is counted in rounds, rounded to the nearest one, so a
+ * timer that fires a bit early or late does not change the outcome.
+ */
+void flb_output_batch_flush(struct flb_config *config, int force)
+{
+    uint64_t now;
+    uint64_t rounds;
+    uint64_t interval;
+    uint64_t max_wait;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct mk_list *b_head;
+    struct flb_output_batch *batch;
+    struct flb_output_instance *ins;
+
+    now = cfl_time_now();
+    interval = (uint64_t) (config->flush * 1000000000.0);
+
+    mk_list_foreach(head, &config->outputs) {
+        ins = mk_list_entry(head, struct flb_output_instance, _head);
+        if (ins->batch == FLB_FALSE) {
+            continue;
+        }
+
+        max_wait = (uint64_t) ins->batch_max_wait * 1000000;
+        if (max_wait == 0) {
+            max_wait = interval;
+        }
+
+        mk_list_foreach_safe(b_head, tmp, &ins->batches) {
+            batch = mk_list_entry(b_head, struct flb_output_batch, _head);
+            if (force == FLB_FALSE && interval > 0) {
+                rounds = (now - batch->ts_open + interval / 2) / interval;
+                if ((rounds + 1) * interval <= max_wait) {
+                    continue;
+                }
+            }
+            batch_commit(batch, ins, config);
+        }
+    }
+}
+
+/* Release the open batches of an instance without delivering them */
+void flb_output_batch_destroy_all(struct flb_output_instance *ins)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_output_batch *batch;
+
+    mk_list_foreach_safe(head, tmp, &ins->batches) {
+        batch = mk_list_entry(head, struct flb_output_batch, _head);
+        mk_list_del(&batch->_head);
+        flb_output_batch_destroy(batch);
+    }
+}
+
+/*
+ * Update the batch target size from the result of a delivered batch. It runs
+ * in the context of the flush, which can be an output worker thread.
+ */
+void flb_output_batch_feedback(struct flb_output_instance *ins,
+                               struct flb_output_batch *batch, int ret)
+{
+    size_t old;
+    size_t target;
+    uint64_t latency;
+
+    latency = (cfl_time_now() - batch->ts_start) / 1000000;
+    old = __atomic_load_n(&ins->batch_target, __ATOMIC_RELAXED);
+
+    if (ret == FLB_OK && latency <= ins->batch_latency_target) {
+        /* additive increase, only when the batch used the target */
+        if (batch->size < old / 2) {
+            return;
+        }
+        target = old + ins->batch_min_size;
+        if (target > ins->batch_max_size) {
+            target = ins->batch_max_size;
+        }
+    }
+    else {
+        /* multiplicative decrease */
+        target = old / 2;
+        if (target < ins->batch_min_size) {
+            target = ins->batch_min_size;
+        }
+    }
+
+    if (target == old) {
+        return;
+    }
+
+    __atomic_store_n(&ins->batch_target, target, __ATOMIC_RELAXED);
+    flb_plg_debug(ins, "batch target %zu -> %zu bytes (ret=%i, "
+                  "latency=%" PRIu64 "ms)", old, target, ret, latency);
+}
@@ -29,6 +29,8 @@
 static pthread_once_t local_thread_instance_init = PTHREAD_ONCE_INIT;
 FLB_TLS_DEFINE(struct flb_out_thread_instance, local_thread_instance);
 
+static void thread_steal(struct flb_out_thread_instance *th_ins);
+
 void flb_output_thread_instance_init()
 {
     FLB_TLS_INIT(local_thread_instance);
@@ -56,9 +58,15 @@ static void cb_thread_sched_timer(struct flb_config *ctx, void *data)
     /* Upstream connections timeouts handling */
     ins = (struct flb_output_instance *) data;
     flb_upstream_conn_timeouts(&ins->upstreams);
+
+    /* Idle workers look for queued tasks in the other workers */
+    if (ins->tp_steal) {
+        thread_steal(flb_output_thread_instance_get());
+    }
 }
 
-static inline int handle_output_event(struct flb_config *config,
+static inline int handle_output_event(struct flb_out_thread_instance *th_ins,
+                                      struct flb_config *config,
                                       int ch_parent, flb_pipefd_t fd)
 {
     int ret;
@@ -89,6 +97,7 @@ static inline int handle_output_event(struct flb_config *config,
 
     /* Destroy the output co-routine context */
     flb_output_flush_finished(config, out_id);
+    __atomic_sub_fetch(&th_ins->load, 1, __ATOMIC_RELAXED);
 
     /*
      * Notify the parent event loop the return status, just forward the same
@@ -145,6 +154,140 @@ int count_upstream_busy_connections(struct flb_out_thread_instance *th_ins)
     return c;
 }
 
+/* Number of tasks delivered by a flush, every one reports its status */
+static inline int thread_task_weight(struct flb_out_thread_task *th_task)
+{
+    if (th_task->batch) {
+        return th_task->batch->n_tasks;
+    }
+    return 1;
+}
+
+/* Start the flush co-routine of a task assigned to this worker */
+static void thread_task_start(struct flb_out_thread_instance *th_ins,
+                              struct flb_out_thread_task *th_task)
+{
+    struct flb_output_flush *out_flush;
+
+    out_flush = flb_output_flush_create(th_task->task,
+                                        th_task->batch,
+                                        th_task->task->i_ins,
+                                        th_ins->ins,
+                                        th_ins->config);
+    if (!out_flush) {
+        __atomic_sub_fetch(&th_ins->load, thread_task_weight(th_task),
+                           __ATOMIC_RELAXED);
+        if (th_task->batch) {
+            flb_output_batch_destroy(th_task->batch);
+        }
+        return;
+    }
+    flb_coro_resume(out_flush->coro);
+}
+
+/* Start the tasks queued in the list, the list is consumed */
+static void thread_tasks_start(struct flb_out_thread_instance *th_ins,
+                               struct mk_list *list)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_out_thread_task *th_task;
+
+    mk_list_foreach_safe(head, tmp, list) {
+        th_task = mk_list_entry(head, struct flb_out_thread_task, _head);
+        mk_list_del(&th_task->_head);
+
+        thread_task_start(th_ins, th_task);
+        flb_free(th_task);
+    }
+}
+
+/* Start all the tasks the engine assigned to this worker */
+static void thread_pending_start(struct flb_out_thread_instance *th_ins)
+{
+    struct mk_list list;
+
+    mk_list_init(&list);
+
+    pthread_mutex_lock(&th_ins->pending_mutex);
+    if (mk_list_is_empty(&th_ins->pending) != 0) {
+        mk_list_cat(&th_ins->pending, &list);
+        mk_list_init(&th_ins->pending);
+    }
+    pthread_mutex_unlock(&th_ins->pending_mutex);
+
+    thread_tasks_start(th_ins, &list);
+}
+
+/*
+ * An idle worker takes half of the tasks that the most loaded worker did not
+ * start yet. The tasks are taken from the tail of its queue, so the oldest
+ * ones keep being started by their owner.
+ */
+static void thread_steal(struct flb_out_thread_instance *th_ins)
+{
+    int i;
+    int n;
+    int load;
+    int weight = 0;
+    int max = 0;
+    struct mk_list list;
+    struct mk_list *head;
+    struct flb_tp_thread *th;
+    struct flb_out_thread_task *th_task;
+    struct flb_out_thread_instance *victim = NULL;
+    struct flb_out_thread_instance *peer;
+
+    if (__atomic_load_n(&th_ins->load, __ATOMIC_RELAXED) > 0) {
+        return;
+    }
+
+    mk_list_foreach(head, &th_ins->ins->tp->list_threads) {
+        th = mk_list_entry(head, struct flb_tp_thread, _head);
+        peer = th->params.data;
+        if (peer == th_ins || th->status != FLB_THREAD_POOL_RUNNING) {
+            continue;
+        }
+
+        load = __atomic_load_n(&peer->load, __ATOMIC_RELAXED);
+        if (load > max) {
+            max = load;
+            victim = peer;
+        }
+    }
+
+    if (!victim || max < 2) {
+        return;
+    }
+
+    mk_list_init(&list);
+
+    pthread_mutex_lock(&victim->pending_mutex);
+    n = mk_list_size(&victim->pending) / 2;
+    if (n == 0 && mk_list_is_empty(&victim->pending) != 0) {
+        n = 1;
+    }
+    for (i = 0; i < n; i++) {
+        th_task = mk_list_entry_last(&victim->pending,
+                                     struct flb_out_thread_task, _head);
+        mk_list_del(&th_task->_head);
+        mk_list_add(&th_task->_head, &list);
+        weight += thread_task_weight(th_task);
+    }
+    __atomic_sub_fetch(&victim->load, weight, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&victim->pending_mutex);
+
+    if (n == 0) {
+        return;
+    }
+
+    __atomic_add_fetch(&th_ins->load, weight, __ATOMIC_RELAXED);
+    flb_plg_debug(th_ins->ins, "worker #%i stole %i task(s) from worker #%i",
+                  th_ins->th->id, n, victim->th->id);
+
+    thread_tasks_start(th_ins, &list);
+}
+
 static void upstream_thread_destroy(struct flb_out_thread_instance *th_ins)
 {
     struct mk_list *tmp;
@@ -178,7 +321,6 @@ static void output_thread(void *data)
     struct flb_task *task;
     struct flb_connection *u_conn;
     struct flb_output_instance *ins;
-    struct flb_output_flush *out_flush;
     struct flb_out_thread_instance *th_ins = data;
     struct flb_out_flush_params *params;
     struct flb_net_dns dns_ctx;
@@ -284,15 +426,12 @@ static void output_thread(void *data)
                     continue;
                 }
 
-                /* Start the co-routine with the flush callback */
-                out_flush = flb_output_flush_create(task,
-                                                    task->i_ins,
-                                                    th_ins->ins,
-                                                    th_ins->config);
-                if (!out_flush) {
-                    continue;
-                }
-                flb_coro_resume(out_flush->coro);
+                /*
+                 * Any other value is just a wakeup, the tasks assigned by
+                 * the engine are waiting in the pending queue. Start the
+                 * co-routines with the flush callback.
+                 */
+                thread_pending_start(th_ins);
             }
             else if (event->type == FLB_ENGINE_EV_CUSTOM) {
                 event->handler(event);
@@ -317,7 +456,11 @@ static void output_thread(void *data)
                  * the return message to the parent event loop so the Task
                  * can be updated.
                  */
-                handle_output_event(th_ins->config, ins->ch_events[1], event->fd);
+                handle_output_event(th_ins, th_ins->config, ins->ch_events[1],
+                                    event->fd);
+                if (ins->tp_steal) {
+                    thread_steal(th_ins);
+                }
             }
             else {
                 flb_plg_warn(ins, "unhandled event type => %i\n", event->type);
@@ -331,7 +474,8 @@ static void output_thread(void *data)
         flb_sched_timer_cleanup(sched);
 
         /* Check if we should stop the event loop */
-        if (stopping == FLB_TRUE && mk_list_size(&th_ins->flush_list) == 0) {
+        if (stopping == FLB_TRUE && mk_list_size(&th_ins->flush_list) == 0 &&
+            __atomic_load_n(&th_ins->load, __ATOMIC_RELAXED) == 0) {
             /*
              * If there are no busy network connections (and no coroutines) its
              * safe to stop it.
@@ -367,29 +511,112 @@ static void output_thread(void *data)
     flb_plg_info(ins, "thread worker #%i stopped", thread_id);
 }
 
+/*
+ * Pick the worker with less tasks in progress. The scan starts from the next
+ * worker in round-robin order so idle workers share the load evenly.
+ */
+static struct flb_tp_thread *thread_get_least_loaded(struct flb_tp *tp)
+{
+    int i;
+    int n;
+    int load;
+    int min = -1;
+    struct flb_tp_thread *th;
+    struct flb_tp_thread *best = NULL;
+    struct flb_out_thread_instance *th_ins;
+
+    th = flb_tp_thread_get_rr(tp);
+    if (!th) {
+        return NULL;
+    }
+
+    n = mk_list_size(&tp->list_threads);
+    for (i = 0; i < n; i++) {
+        if (th->status == FLB_THREAD_POOL_RUNNING) {
+            th_ins = th->params.data;
+            load = __atomic_load_n(&th_ins->load, __ATOMIC_RELAXED);
+            if (min == -1 || load < min) {
+                min = load;
+                best = th;
+                if (load == 0) {
+                    break;
+                }
+            }
+        }
+        th = mk_list_entry_next(&th->_head, struct flb_tp_thread, _head,
+                                &tp->list_threads);
+    }
+
+    if (!best) {
+        return NULL;
+    }
+
+    tp->thread_cur = &best->_head;
+    return best;
+}
+
 int flb_output_thread_pool_flush(struct flb_task *task,
+                                 struct flb_output_batch *batch,
                                  struct flb_output_instance *out_ins,
                                  struct flb_config *config)
 {
     int n;
+    int wakeup;
+    int weight;
+    struct flb_task *signal = NULL;
     struct flb_tp_thread *th;
+    struct flb_out_thread_task *th_task;
     struct flb_out_thread_instance *th_ins;
 
-    /* Choose the worker that will handle the Task (round-robin) */
-    th = flb_tp_thread_get_rr(out_ins->tp);
+    /* Choose the worker that will handle the Task */
+    if (out_ins->tp_dispatch == FLB_OUTPUT_DISPATCH_LEAST_LOADED) {
+        th = thread_get_least_loaded(out_ins->tp);
+    }
+    else {
+        th = flb_tp_thread_get_rr(out_ins->tp);
+    }
     if (!th) {
         return -1;
     }
 
     th_ins = th->params.data;
 
+    th_task = flb_malloc(sizeof(struct flb_out_thread_task));
+    if (!th_task) {
+        flb_errno();
+        return -1;
+    }
+    th_task->task = task;
+    th_task->batch = batch;
+    weight = thread_task_weight(th_task);
+
     flb_plg_debug(out_ins, "task_id=%i assigned to thread #%i",
                   task->id, th->id);
 
-    n = flb_pipe_w(th_ins->ch_parent_events[1], &task, sizeof(struct flb_task*));
+    /*
+     * Queue the task and wake up the worker. If the queue was not empty the
+     * worker has a wakeup pending already and will take this task with the
+     * others.
+     */
+    pthread_mutex_lock(&th_ins->pending_mutex);
+    wakeup = mk_list_is_empty(&th_ins->pending) == 0;
+    mk_list_add(&th_task->_head, &th_ins->pending);
+    __atomic_add_fetch(&th_ins->load, weight, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&th_ins->pending_mutex);
+
+    if (!wakeup) {
+        return 0;
+    }
 
+    n = flb_pipe_w(th_ins->ch_parent_events[1], &signal, sizeof(signal));
     if (n == -1) {
         flb_errno();
+
+        pthread_mutex_lock(&th_ins->pending_mutex);
+        mk_list_del(&th_task->_head);
+        __atomic_sub_fetch(&th_ins->load, weight, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&th_ins->pending_mutex);
+        flb_free(th_task);
         return -1;
     }
 
@@ -436,6 +663,8 @@ int flb_output_thread_pool_create(struct flb_config *config,
         mk_list_init(&th_ins->flush_list);
         mk_list_init(&th_ins->flush_list_destroy);
         pthread_mutex_init(&th_ins->flush_mutex, NULL);
+        mk_list_init(&th_ins->pending);
+        pthread_mutex_init(&th_ins->pending_mutex, NULL);
         mk_list_init(&th_ins->upstreams);
 
         upstream_thread_create(th_ins, ins);
@@ -516,6 +745,13 @@ int flb_output_thread_pool_coros_size(struct flb_output_instance *ins)
         pthread_mutex_unlock(&th_ins->flush_mutex);
 
         size += n;
+
+        /* tasks assigned to the worker that did not start yet */
+        pthread_mutex_lock(&th_ins->pending_mutex);
+        n = mk_list_size(&th_ins->pending);
+        pthread_mutex_unlock(&th_ins->pending_mutex);
+
+        size += n;
     }
 
     return size;
@@ -546,10 +782,22 @@ void flb_output_thread_pool_destroy(struct flb_output_instance *ins)
         if (n < 0) {
             flb_errno();
             flb_plg_error(th_ins->ins, "could not signal worker thread");
-            flb_free(th_ins);
             continue;
         }
         pthread_join(th->tid, NULL);
+    }
+
+    /*
+     * Release the workers contexts once all of them stopped, a worker looking
+     * for tasks to steal might access the context of the others.
+     */
+    mk_list_foreach(head, &tp->list_threads) {
+        th = mk_list_entry(head, struct flb_tp_thread, _head);
+        th_ins = th->params.data;
+        if (!th_ins) {
+            continue;
+        }
+        pthread_mutex_destroy(&th_ins->pending_mutex);
         flb_free(th_ins);
     }
 
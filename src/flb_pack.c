@@ -29,6 +29,7 @@
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_unescape.h>
+#include <fluent-bit/flb_simd.h>
 
 /* cmetrics */
 #include <cmetrics/cmetrics.h>
@@ -39,8 +40,6 @@
 #include <math.h>
 #include <jsmn/jsmn.h>
 
-#define try_to_write_str  flb_utils_write_str
-
 static int convert_nan_to_null = FLB_FALSE;
 
 static int flb_pack_set_null_as_nan(int b) {
@@ -230,6 +229,414 @@ static char *tokens_to_msgpack(struct flb_pack_state *state,
     return buf;
 }
 
+/*
+ * Direct JSON to MessagePack packer
+ * ---------------------------------
+ * The following routines convert a JSON buffer to msgpack in a single pass
+ * without building the intermediate jsmn tokens array. String bodies are
+ * located with vector compares (see flb_simd.h) and strings without escape
+ * sequences are copied as-is, skipping the unescape routine.
+ *
+ * Container sizes are not known until the closing bracket is found, so a
+ * one-byte fixmap/fixarray header is reserved and, for containers with 16 or
+ * more entries, the content is shifted to make room for the wider header.
+ * The output is byte-identical to tokens_to_msgpack().
+ *
+ * The packer only handles well-formed input whose root values are maps or
+ * arrays. Anything else (invalid JSON, top level primitives, incomplete
+ * messages without a complete record, too deep nesting) is reported back so
+ * the caller can use the jsmn path, which keeps the historical behavior for
+ * non-conforming payloads.
+ */
+
+#define PACK_DIRECT_OK           0
+#define PACK_DIRECT_PART        -1
+#define PACK_DIRECT_INVAL       -2
+#define PACK_DIRECT_NOMEM       -3
+
+#define PACK_DIRECT_MAX_DEPTH   64
+
+struct pack_direct {
+    const char *js;               /* JSON buffer                   */
+    const char *end;              /* end of JSON buffer            */
+    const char *p;                /* current position              */
+    struct flb_pack_state *state; /* unescape buffer               */
+    msgpack_sbuffer sbuf;         /* msgpack output                */
+    msgpack_packer pck;
+};
+
+static inline int pack_direct_is_space(char c)
+{
+    return (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+}
+
+static inline void pack_direct_skip_spaces(struct pack_direct *ctx)
+{
+    while (ctx->p < ctx->end && pack_direct_is_space(*ctx->p)) {
+        ctx->p++;
+    }
+}
+
+static inline int is_hex_char(char c)
+{
+    return ((c >= '0' && c <= '9') ||
+            (c >= 'A' && c <= 'F') ||
+            (c >= 'a' && c <= 'f'));
+}
+
+static int pack_direct_string(struct pack_direct *ctx)
+{
+    int i;
+    int escaped = FLB_FALSE;
+    int len;
+    const char *start;
+    const char *p;
+
+    /* skip opening quote */
+    start = ++ctx->p;
+    p = start;
+
+    while (1) {
+        p = flb_simd_find_any3(p, ctx->end - p, '"', '\\', '\0');
+        if (!p || *p == '\0') {
+            return PACK_DIRECT_PART;
+        }
+
+        if (*p == '"') {
+            break;
+        }
+
+        /* backslash: validate the escape sequence like jsmn does */
+        escaped = FLB_TRUE;
+        p++;
+        if (p >= ctx->end) {
+            return PACK_DIRECT_PART;
+        }
+
+        switch (*p) {
+        case '"':
+        case '/':
+        case '\\':
+        case 'b':
+        case 'f':
+        case 'r':
+        case 'n':
+        case 't':
+            p++;
+            break;
+        case 'u':
+            p++;
+            for (i = 0; i < 4; i++, p++) {
+                if (p >= ctx->end) {
+                    return PACK_DIRECT_PART;
+                }
+                if (!is_hex_char(*p)) {
+                    return PACK_DIRECT_INVAL;
+                }
+            }
+            break;
+        case '\0':
+            return PACK_DIRECT_PART;
+        default:
+            return PACK_DIRECT_INVAL;
+        }
+    }
+
+    len = p - start;
+    ctx->p = p + 1;
+
+    if (escaped == FLB_FALSE) {
+        msgpack_pack_str(&ctx->pck, len);
+        msgpack_pack_str_body(&ctx->pck, start, len);
+        return PACK_DIRECT_OK;
+    }
+
+    if (pack_string_token(ctx->state, start, len, &ctx->pck) < 0) {
+        return PACK_DIRECT_NOMEM;
+    }
+
+    return PACK_DIRECT_OK;
+}
+
+static int pack_direct_primitive(struct pack_direct *ctx)
+{
+    int len;
+    char c;
+    const char *start;
+    const char *p;
+
+    start = ctx->p;
+    c = *start;
+    if (c != '-' && c != 't' && c != 'f' && c != 'n' &&
+        (c < '0' || c > '9')) {
+        return PACK_DIRECT_INVAL;
+    }
+
+    for (p = start; p < ctx->end; p++) {
+        c = *p;
+        if (c == ',' || c == ']' || c == '}' || pack_direct_is_space(c)) {
+            break;
+        }
+        if (c == '\0') {
+            return PACK_DIRECT_PART;
+        }
+        if (c < 32 || c >= 127) {
+            return PACK_DIRECT_INVAL;
+        }
+    }
+
+    if (p >= ctx->end) {
+        return PACK_DIRECT_PART;
+    }
+
+    len = p - start;
+    ctx->p = p;
+
+    if (*start == 'f') {
+        msgpack_pack_false(&ctx->pck);
+    }
+    else if (*start == 't') {
+        msgpack_pack_true(&ctx->pck);
+    }
+    else if (*start == 'n') {
+        msgpack_pack_nil(&ctx->pck);
+    }
+    else if (is_float(start, len)) {
+        msgpack_pack_double(&ctx->pck, atof(start));
+    }
+    else {
+        msgpack_pack_int64(&ctx->pck, atoll(start));
+    }
+
+    return PACK_DIRECT_OK;
+}
+
+/*
+ * Write the final header of a map or array whose content starts right after
+ * the one byte placeholder found at 'offset'.
+ */
+static int pack_direct_set_header(struct pack_direct *ctx, size_t offset,
+                                  int is_map, uint32_t count)
+{
+    int extra;
+    size_t content;
+    unsigned char *h;
+    char pad[4] = {0};
+
+    if (count < 16) {
+        ctx->sbuf.data[offset] = (is_map ? 0x80 : 0x90) | count;
+        return 0;
+    }
+
+    extra = (count < 65536) ? 2 : 4;
+    content = ctx->sbuf.size - offset - 1;
+
+    /* grow the buffer through the sbuffer API, then shift the content */
+    if (msgpack_sbuffer_write(&ctx->sbuf, pad, extra) != 0) {
+        return -1;
+    }
+    memmove(ctx->sbuf.data + offset + 1 + extra,
+            ctx->sbuf.data + offset + 1, content);
+
+    h = (unsigned char *) ctx->sbuf.data + offset;
+    if (extra == 2) {
+        h[0] = is_map ? 0xde : 0xdc;
+        h[1] = (count >> 8) & 0xff;
+        h[2] = count & 0xff;
+    }
+    else {
+        h[0] = is_map ? 0xdf : 0xdd;
+        h[1] = (count >> 24) & 0xff;
+        h[2] = (count >> 16) & 0xff;
+        h[3] = (count >> 8) & 0xff;
+        h[4] = count & 0xff;
+    }
+
+    return 0;
+}
+
+static int pack_direct_value(struct pack_direct *ctx, int depth);
+
+static int pack_direct_container(struct pack_direct *ctx, int depth)
+{
+    int ret;
+    int is_map;
+    char close;
+    size_t offset;
+    uint32_t count = 0;
+
+    if (depth >= PACK_DIRECT_MAX_DEPTH) {
+        return PACK_DIRECT_INVAL;
+    }
+
+    is_map = (*ctx->p == '{');
+    close = is_map ? '}' : ']';
+    ctx->p++;
+
+    /* placeholder for the header */
+    offset = ctx->sbuf.size;
+    if (msgpack_sbuffer_write(&ctx->sbuf, "\0", 1) != 0) {
+        return PACK_DIRECT_NOMEM;
+    }
+
+    pack_direct_skip_spaces(ctx);
+    if (ctx->p >= ctx->end || *ctx->p == '\0') {
+        return PACK_DIRECT_PART;
+    }
+
+    if (*ctx->p == close) {
+        ctx->p++;
+        pack_direct_set_header(ctx, offset, is_map, 0);
+        return PACK_DIRECT_OK;
+    }
+
+    while (1) {
+        if (is_map) {
+            /* key: must be a string */
+            if (*ctx->p != '"') {
+                return PACK_DIRECT_INVAL;
+            }
+            ret = pack_direct_string(ctx);
+            if (ret != PACK_DIRECT_OK) {
+                return ret;
+            }
+
+            pack_direct_skip_spaces(ctx);
+            if (ctx->p >= ctx->end || *ctx->p == '\0') {
+                return PACK_DIRECT_PART;
+            }
+            if (*ctx->p != ':') {
+                return PACK_DIRECT_INVAL;
+            }
+            ctx->p++;
+            pack_direct_skip_spaces(ctx);
+            if (ctx->p >= ctx->end || *ctx->p == '\0') {
+                return PACK_DIRECT_PART;
+            }
+        }
+
+        ret = pack_direct_value(ctx, depth + 1);
+        if (ret != PACK_DIRECT_OK) {
+            return ret;
+        }
+        count++;
+
+        pack_direct_skip_spaces(ctx);
+        if (ctx->p >= ctx->end || *ctx->p == '\0') {
+            return PACK_DIRECT_PART;
+        }
+
+        if (*ctx->p == ',') {
+            ctx->p++;
+            pack_direct_skip_spaces(ctx);
+            if (ctx->p >= ctx->end || *ctx->p == '\0') {
+                return PACK_DIRECT_PART;
+            }
+            continue;
+        }
+        else if (*ctx->p == close) {
+            ctx->p++;
+            break;
+        }
+
+        return PACK_DIRECT_INVAL;
+    }
+
+    if (pack_direct_set_header(ctx, offset, is_map, count) != 0) {
+        return PACK_DIRECT_NOMEM;
+    }
+
+    return PACK_DIRECT_OK;
+}
+
+static int pack_direct_value(struct pack_direct *ctx, int depth)
+{
+    switch (*ctx->p) {
+    case '{':
+    case '[':
+        return pack_direct_container(ctx, depth);
+    case '"':
+        return pack_direct_string(ctx);
+    default:
+        return pack_direct_primitive(ctx);
+    }
+}
+
+/*
+ * Pack all the complete root maps/arrays found in the JSON buffer. On
+ * success the msgpack buffer is returned in 'out_buf' and 'last_byte' holds
+ * the offset right after the last complete record. If the buffer ends in the
+ * middle of a record, the records found before it are returned and
+ * 'partial' is set.
+ */
+static int pack_json_direct(const char *js, size_t len,
+                            struct flb_pack_state *state,
+                            char **out_buf, size_t *out_size,
+                            int *root_type, int *last_byte,
+                            int *out_records, int *partial)
+{
+    int ret;
+    int records = 0;
+    size_t last_size = 0;
+    const char *last = js;
+    struct pack_direct ctx;
+
+    ctx.js = js;
+    ctx.end = js + len;
+    ctx.p = js;
+    ctx.state = state;
+
+    msgpack_sbuffer_init(&ctx.sbuf);
+    msgpack_packer_init(&ctx.pck, &ctx.sbuf, msgpack_sbuffer_write);
+
+    *partial = FLB_FALSE;
+
+    while (1) {
+        pack_direct_skip_spaces(&ctx);
+        if (ctx.p >= ctx.end || *ctx.p == '\0') {
+            break;
+        }
+
+        if (*ctx.p != '{' && *ctx.p != '[') {
+            msgpack_sbuffer_destroy(&ctx.sbuf);
+            return PACK_DIRECT_INVAL;
+        }
+
+        if (records == 0) {
+            *root_type = (*ctx.p == '{') ? FLB_PACK_JSON_OBJECT :
+                                           FLB_PACK_JSON_ARRAY;
+        }
+
+        ret = pack_direct_container(&ctx, 0);
+        if (ret == PACK_DIRECT_PART && records > 0) {
+            /* discard the incomplete record */
+            ctx.sbuf.size = last_size;
+            *partial = FLB_TRUE;
+            break;
+        }
+        else if (ret != PACK_DIRECT_OK) {
+            msgpack_sbuffer_destroy(&ctx.sbuf);
+            return ret;
+        }
+
+        records++;
+        last = ctx.p;
+        last_size = ctx.sbuf.size;
+    }
+
+    if (records == 0) {
+        msgpack_sbuffer_destroy(&ctx.sbuf);
+        return PACK_DIRECT_INVAL;
+    }
+
+    *out_buf = ctx.sbuf.data;
+    *out_size = ctx.sbuf.size;
+    *last_byte = last - js;
+    *out_records = records;
+
+    return PACK_DIRECT_OK;
+}
+
 /*
  * It parse a JSON string and convert it to MessagePack format, this packer is
  * useful when a complete JSON message exists, otherwise it will fail until
@@ -245,9 +652,32 @@ static int pack_json_to_msgpack(const char *js, size_t len, char **buffer,
     int n_records;
     int out;
     int last;
+    int partial;
     char *buf = NULL;
+    size_t buf_size;
     struct flb_pack_state state;
 
+    /*
+     * Try the direct packer first, it only needs the temporary buffer used
+     * to unescape strings.
+     */
+    memset(&state, '\0', sizeof(state));
+    ret = pack_json_direct(js, len, &state, &buf, &buf_size, root_type,
+                           &last, &n_records, &partial);
+    flb_free(state.buf_data);
+
+    if (ret == PACK_DIRECT_OK && partial == FLB_FALSE) {
+        *size = buf_size;
+        *buffer = buf;
+        *records = n_records;
+        return 0;
+    }
+    else if (ret == PACK_DIRECT_OK) {
+        /* incomplete message, let the tokenizer report it */
+        flb_free(buf);
+    }
+    buf = NULL;
+
     ret = flb_pack_state_init(&state);
     if (ret != 0) {
         return -1;
@@ -359,9 +789,34 @@ int flb_pack_json_state(const char *js, size_t len,
     int delim = 0;
     int last =  0;
     int records;
+    int partial;
+    int root_type;
     char *buf;
+    size_t buf_size;
     jsmntok_t *t;
 
+    /*
+     * On a fresh state use the direct packer. When it cannot complete a
+     * single record (or the payload is not valid) the tokenizer takes over,
+     * so incomplete messages are resumed incrementally by jsmn on the next
+     * calls.
+     */
+    if (state->parser.pos == 0 && state->parser.toknext == 0 &&
+        state->tokens_count == 0) {
+        ret = pack_json_direct(js, len, state, &buf, &buf_size, &root_type,
+                               &last, &records, &partial);
+        if (ret == PACK_DIRECT_OK) {
+            state->multiple = FLB_TRUE;
+            state->last_byte = last;
+            *size = buf_size;
+            *buffer = buf;
+            return 0;
+        }
+        else if (ret == PACK_DIRECT_NOMEM) {
+            return -1;
+        }
+    }
+
     ret = flb_json_tokenise(js, len, state);
     state->multiple = FLB_TRUE;
     if (ret == FLB_ERR_JSON_PART && state->multiple == FLB_TRUE) {
@@ -501,20 +956,86 @@ void flb_pack_print_metrics(const char *data, size_t bytes)
     cmt_encode_text_destroy(text);
 }
 
-static inline int try_to_write(char *buf, int *off, size_t left,
+/*
+ * Output buffer for msgpack2json(). A fixed buffer fails as soon as the
+ * content does not fit, while a growable one (a flb_sds_t) is increased in
+ * place so the conversion never needs to restart.
+ */
+struct json_buf {
+    char *data;      /* destination buffer                   */
+    int off;         /* bytes written                        */
+    size_t left;     /* usable size of the buffer            */
+    int growable;    /* 'data' is a flb_sds_t that can grow  */
+};
+
+static int json_buf_grow(struct json_buf *jb, size_t bytes)
+{
+    size_t size;
+    flb_sds_t tmp;
+
+    if (jb->growable == FLB_FALSE) {
+        return FLB_FALSE;
+    }
+
+    /* double the buffer, or more if the pending write requires it */
+    size = jb->left;
+    if (size < jb->off + bytes + 1) {
+        size = jb->off + bytes + 1;
+    }
+
+    tmp = flb_sds_increase(jb->data, size);
+    if (!tmp) {
+        flb_errno();
+        return FLB_FALSE;
+    }
+    jb->data = tmp;
+    jb->left = flb_sds_alloc(tmp);
+
+    return FLB_TRUE;
+}
+
+/* Make sure the buffer can take 'bytes' more without growing */
+static inline int json_buf_reserve(struct json_buf *jb, size_t bytes)
+{
+    if (jb->left > jb->off + bytes) {
+        return FLB_TRUE;
+    }
+
+    return json_buf_grow(jb, bytes);
+}
+
+static inline int try_to_write(struct json_buf *jb,
                                const char *str, size_t str_len)
 {
     if (str_len <= 0){
         str_len = strlen(str);
     }
-    if (left <= *off+str_len) {
+    if (jb->left <= jb->off + str_len && !json_buf_grow(jb, str_len)) {
         return FLB_FALSE;
     }
-    memcpy(buf+*off, str, str_len);
-    *off += str_len;
+    memcpy(jb->data + jb->off, str, str_len);
+    jb->off += str_len;
     return FLB_TRUE;
 }
 
+static inline int try_to_write_str(struct json_buf *jb,
+                                   const char *str, size_t str_len)
+{
+    int ret;
+
+    ret = flb_utils_write_str(jb->data, &jb->off, jb->left, str, str_len);
+    if (ret == FLB_FALSE && jb->growable == FLB_TRUE) {
+        /* worst case: every byte becomes a six bytes \uXXXX sequence */
+        if (!json_buf_grow(jb, str_len * 6)) {
+            return FLB_FALSE;
+        }
+        ret = flb_utils_write_str(jb->data, &jb->off, jb->left,
+                                  str, str_len);
+    }
+
+    return ret;
+}
+
 
 /*
  * Check if a key exists in the map using the 'offset' as an index to define
@@ -547,8 +1068,7 @@ static inline int key_exists_in_map(msgpack_object key, msgpack_object map, int
     return FLB_FALSE;
 }
 
-static int msgpack2json(char *buf, int *off, size_t left,
-                        const msgpack_object *o)
+static int msgpack2json(struct json_buf *jb, const msgpack_object *o)
 {
     int i;
     int dup;
@@ -558,11 +1078,11 @@ static int msgpack2json(char *buf, int *off, size_t left,
 
     switch(o->type) {
     case MSGPACK_OBJECT_NIL:
-        ret = try_to_write(buf, off, left, "null", 4);
+        ret = try_to_write(jb, "null", 4);
         break;
 
     case MSGPACK_OBJECT_BOOLEAN:
-        ret = try_to_write(buf, off, left,
+        ret = try_to_write(jb,
                            (o->via.boolean ? "true":"false"),0);
 
         break;
@@ -571,7 +1091,7 @@ static int msgpack2json(char *buf, int *off, size_t left,
         {
             char temp[32] = {0};
             i = snprintf(temp, sizeof(temp)-1, "%"PRIu64, o->via.u64);
-            ret = try_to_write(buf, off, left, temp, i);
+            ret = try_to_write(jb, temp, i);
         }
         break;
 
@@ -579,7 +1099,7 @@ static int msgpack2json(char *buf, int *off, size_t left,
         {
             char temp[32] = {0};
             i = snprintf(temp, sizeof(temp)-1, "%"PRId64, o->via.i64);
-            ret = try_to_write(buf, off, left, temp, i);
+            ret = try_to_write(jb, temp, i);
         }
         break;
     case MSGPACK_OBJECT_FLOAT32:
@@ -595,32 +1115,32 @@ static int msgpack2json(char *buf, int *off, size_t left,
             else {
                 i = snprintf(temp, sizeof(temp)-1, "%.16g", o->via.f64);
             }
-            ret = try_to_write(buf, off, left, temp, i);
+            ret = try_to_write(jb, temp, i);
         }
         break;
 
     case MSGPACK_OBJECT_STR:
-        if (try_to_write(buf, off, left, "\"", 1) &&
+        if (try_to_write(jb, "\"", 1) &&
             (o->via.str.size > 0 ?
-             try_to_write_str(buf, off, left, o->via.str.ptr, o->via.str.size)
+             try_to_write_str(jb, o->via.str.ptr, o->via.str.size)
              : 1/* nothing to do */) &&
-            try_to_write(buf, off, left, "\"", 1)) {
+            try_to_write(jb, "\"", 1)) {
             ret = FLB_TRUE;
         }
         break;
 
     case MSGPACK_OBJECT_BIN:
-        if (try_to_write(buf, off, left, "\"", 1) &&
+        if (try_to_write(jb, "\"", 1) &&
             (o->via.bin.size > 0 ?
-             try_to_write_str(buf, off, left, o->via.bin.ptr, o->via.bin.size)
+             try_to_write_str(jb, o->via.bin.ptr, o->via.bin.size)
               : 1 /* nothing to do */) &&
-            try_to_write(buf, off, left, "\"", 1)) {
+            try_to_write(jb, "\"", 1)) {
             ret = FLB_TRUE;
         }
         break;
 
     case MSGPACK_OBJECT_EXT:
-        if (!try_to_write(buf, off, left, "\"", 1)) {
+        if (!try_to_write(jb, "\"", 1)) {
             goto msg2json_end;
         }
         /* ext body. fortmat is similar to printf(1) */
@@ -630,12 +1150,12 @@ static int msgpack2json(char *buf, int *off, size_t left,
             loop = o->via.ext.size;
             for(i=0; i<loop; i++) {
                 len = snprintf(temp, sizeof(temp)-1, "\\x%02x", (char)o->via.ext.ptr[i]);
-                if (!try_to_write(buf, off, left, temp, len)) {
+                if (!try_to_write(jb, temp, len)) {
                     goto msg2json_end;
                 }
             }
         }
-        if (!try_to_write(buf, off, left, "\"", 1)) {
+        if (!try_to_write(jb, "\"", 1)) {
             goto msg2json_end;
         }
         ret = FLB_TRUE;
@@ -644,28 +1164,28 @@ static int msgpack2json(char *buf, int *off, size_t left,
     case MSGPACK_OBJECT_ARRAY:
         loop = o->via.array.size;
 
-        if (!try_to_write(buf, off, left, "[", 1)) {
+        if (!try_to_write(jb, "[", 1)) {
             goto msg2json_end;
         }
         if (loop != 0) {
             msgpack_object* p = o->via.array.ptr;
-            if (!msgpack2json(buf, off, left, p)) {
+            if (!msgpack2json(jb, p)) {
                 goto msg2json_end;
             }
             for (i=1; i<loop; i++) {
-                if (!try_to_write(buf, off, left, ",", 1) ||
-                    !msgpack2json(buf, off, left, p+i)) {
+                if (!try_to_write(jb, ",", 1) ||
+                    !msgpack2json(jb, p+i)) {
                     goto msg2json_end;
                 }
             }
         }
 
-        ret = try_to_write(buf, off, left, "]", 1);
+        ret = try_to_write(jb, "]", 1);
         break;
 
     case MSGPACK_OBJECT_MAP:
         loop = o->via.map.size;
-        if (!try_to_write(buf, off, left, "{", 1)) {
+        if (!try_to_write(jb, "{", 1)) {
             goto msg2json_end;
         }
         if (loop != 0) {
@@ -684,22 +1204,22 @@ static int msgpack2json(char *buf, int *off, size_t left,
                 }
 
                 if (packed > 0) {
-                    if (!try_to_write(buf, off, left, ",", 1)) {
+                    if (!try_to_write(jb, ",", 1)) {
                         goto msg2json_end;
                     }
                 }
 
                 if (
-                    !msgpack2json(buf, off, left, &(p+i)->key) ||
-                    !try_to_write(buf, off, left, ":", 1)  ||
-                    !msgpack2json(buf, off, left, &(p+i)->val) ) {
+                    !msgpack2json(jb, &(p+i)->key) ||
+                    !try_to_write(jb, ":", 1)  ||
+                    !msgpack2json(jb, &(p+i)->val) ) {
                     goto msg2json_end;
                 }
                 packed++;
             }
         }
 
-        ret = try_to_write(buf, off, left, "}", 1);
+        ret = try_to_write(jb, "}", 1);
         break;
 
     default:
@@ -723,15 +1243,45 @@ int flb_msgpack_to_json(char *json_str, size_t json_size,
                         const msgpack_object *obj)
 {
     int ret = -1;
-    int off = 0;
+    struct json_buf jb;
 
     if (json_str == NULL || obj == NULL) {
         return -1;
     }
 
-    ret = msgpack2json(json_str, &off, json_size - 1, obj);
-    json_str[off] = '\0';
-    return ret ? off: ret;
+    jb.data = json_str;
+    jb.off = 0;
+    jb.left = json_size - 1;
+    jb.growable = FLB_FALSE;
+
+    ret = msgpack2json(&jb, obj);
+    json_str[jb.off] = '\0';
+    return ret ? jb.off: ret;
+}
+
+/*
+ * Append the JSON representation of 'obj' to the 'buf' sds buffer, the
+ * buffer is increased as needed while encoding.
+ */
+static int msgpack_to_json_sds(flb_sds_t *buf, const msgpack_object *obj)
+{
+    int ret;
+    struct json_buf jb;
+
+    jb.data = *buf;
+    jb.off = flb_sds_len(*buf);
+    jb.left = flb_sds_alloc(*buf);
+    jb.growable = FLB_TRUE;
+
+    ret = msgpack2json(&jb, obj);
+
+    *buf = jb.data;
+    if (ret) {
+        flb_sds_len_set(jb.data, jb.off);
+    }
+    jb.data[flb_sds_len(jb.data)] = '\0';
+
+    return ret ? 0 : -1;
 }
 
 flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size)
@@ -739,18 +1289,14 @@ flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size)
     int ret;
     size_t off = 0;
     size_t out_size;
-    size_t realloc_size;
-
     msgpack_unpacked result;
     msgpack_object *root;
     flb_sds_t out_buf;
-    flb_sds_t tmp_buf;
 
-    /* buffer size strategy */
+    /* initial size estimate, the buffer grows while encoding if needed */
     out_size = in_size * FLB_MSGPACK_TO_JSON_INIT_BUFFER_SIZE;
-    realloc_size = in_size * FLB_MSGPACK_TO_JSON_REALLOC_BUFFER_SIZE;
-    if (realloc_size < 256) {
-        realloc_size = 256;
+    if (out_size < 256) {
+        out_size = 256;
     }
 
     out_buf = flb_sds_create_size(out_size);
@@ -768,28 +1314,13 @@ flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size)
     }
 
     root = &result.data;
-    while (1) {
-        ret = flb_msgpack_to_json(out_buf, out_size, root);
-        if (ret <= 0) {
-            tmp_buf = flb_sds_increase(out_buf, realloc_size);
-            if (tmp_buf) {
-                out_buf = tmp_buf;
-                out_size += realloc_size;
-            }
-            else {
-                flb_errno();
-                flb_sds_destroy(out_buf);
-                msgpack_unpacked_destroy(&result);
-                return NULL;
-            }
-        }
-        else {
-            break;
-        }
-    }
-
+    ret = msgpack_to_json_sds(&out_buf, root);
     msgpack_unpacked_destroy(&result);
-    flb_sds_len_set(out_buf, ret);
+
+    if (ret != 0 || flb_sds_len(out_buf) == 0) {
+        flb_sds_destroy(out_buf);
+        return NULL;
+    }
 
     return out_buf;
 }
@@ -842,10 +1373,10 @@ int flb_pack_to_json_date_type(const char *str)
 }
 
 
-static int msgpack_pack_formatted_datetime(flb_sds_t out_buf, char time_formatted[], int max_len,
-                                           msgpack_packer* tmp_pck, struct flb_time* tms,
-                                           const char *date_format,
-                                           const char *time_format)
+static int format_datetime(char time_formatted[], int max_len,
+                           struct flb_time *tms,
+                           const char *date_format,
+                           const char *time_format)
 {
     int len;
     size_t s;
@@ -857,7 +1388,7 @@ static int msgpack_pack_formatted_datetime(flb_sds_t out_buf, char time_formatte
                  date_format, &tm);
     if (!s) {
         flb_debug("strftime failed in flb_pack_msgpack_to_json_format");
-        return 1;
+        return -1;
     }
 
     /* Format the time, use microsecond precision not nanoseconds */
@@ -868,72 +1399,69 @@ static int msgpack_pack_formatted_datetime(flb_sds_t out_buf, char time_formatte
                     (uint64_t) tms->tm.tv_nsec / 1000);
     if (len >= max_len) {
         flb_debug("snprintf: %d >= %d in flb_pack_msgpack_to_json_format", len, max_len);
-        return 2;
+        return -1;
     }
     s += len;
-    msgpack_pack_str(tmp_pck, s);
-    msgpack_pack_str_body(tmp_pck, time_formatted, s);
-    return 0;
+
+    return s;
 }
 
 flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
                                           int json_format, int date_format,
                                           flb_sds_t date_key)
 {
-    int i;
-    int ok = MSGPACK_UNPACK_SUCCESS;
+    int ret;
+    int len;
     int records = 0;
     int map_size;
+    int kv_size = 0;
     size_t off = 0;
+    size_t prev_off = 0;
     char time_formatted[38];
-    flb_sds_t out_tmp;
-    flb_sds_t out_js;
     flb_sds_t out_buf = NULL;
     msgpack_unpacked result;
     msgpack_object root;
     msgpack_object map;
-    msgpack_sbuffer tmp_sbuf;
-    msgpack_packer tmp_pck;
+    msgpack_object record;
     msgpack_object *obj;
-    msgpack_object *k;
-    msgpack_object *v;
+    msgpack_object_kv *kv = NULL;
+    msgpack_object_kv *tmp;
     struct flb_time tms;
+    struct json_buf jb;
 
-    /* For json lines and streams mode we need a pre-allocated buffer */
-    if (json_format == FLB_PACK_JSON_FORMAT_LINES ||
-        json_format == FLB_PACK_JSON_FORMAT_STREAM) {
-        out_buf = flb_sds_create_size(bytes + bytes / 4);
-        if (!out_buf) {
-            flb_errno();
-            return NULL;
-        }
+    /*
+     * The JSON output is written in a single pass into one buffer. The
+     * initial size is an estimate based on the msgpack payload; before
+     * encoding each record the buffer is grown to fit an upper bound of it,
+     * so big batches are not re-encoded when the estimate falls short.
+     */
+    out_buf = flb_sds_create_size(bytes + bytes / 4 + 2);
+    if (!out_buf) {
+        flb_errno();
+        return NULL;
     }
 
-    /* Create temporary msgpack buffer */
-    msgpack_sbuffer_init(&tmp_sbuf);
-    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
-
     /*
-     * If the format is the original msgpack style of one big array,
-     * registrate the array, otherwise is not necessary. FYI, original format:
+     * If the format is the original msgpack style of one big array, wrap
+     * the records in a JSON array:
      *
      * [
-     *   [timestamp, map],
-     *   [timestamp, map],
-     *   [T, M]...
+     *   {record},
+     *   {record},
+     *   {R}...
      * ]
      */
     if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-        records = flb_mp_count(data, bytes);
-        if (records <= 0) {
-            msgpack_sbuffer_destroy(&tmp_sbuf);
-            return NULL;
-        }
-        msgpack_pack_array(&tmp_pck, records);
+        out_buf[0] = '[';
+        flb_sds_len_set(out_buf, 1);
     }
 
     msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) == ok) {
+    while (msgpack_unpack_next(&result, data, bytes, &off) ==
+           MSGPACK_UNPACK_SUCCESS) {
+        len = off - prev_off;
+        prev_off = off;
+
         /* Each array must have two entries: time and record */
         root = result.data;
         if (root.type != MSGPACK_OBJECT_ARRAY) {
@@ -952,69 +1480,103 @@ flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
             continue;
         }
         map_size = map.via.map.size;
+        record = map;
 
         if (date_key != NULL) {
-            msgpack_pack_map(&tmp_pck, map_size + 1);
-        }
-        else {
-            msgpack_pack_map(&tmp_pck, map_size);
-        }
+            /*
+             * Compose a record with the date key prepended, the entries of
+             * the original map are referenced, not copied.
+             */
+            if (kv_size < map_size + 1) {
+                tmp = flb_realloc(kv, sizeof(msgpack_object_kv) * (map_size + 1));
+                if (!tmp) {
+                    flb_errno();
+                    goto error;
+                }
+                kv = tmp;
+                kv_size = map_size + 1;
+            }
 
-        if (date_key != NULL) {
-            /* Append date key */
-            msgpack_pack_str(&tmp_pck, flb_sds_len(date_key));
-            msgpack_pack_str_body(&tmp_pck, date_key, flb_sds_len(date_key));
+            kv[0].key.type = MSGPACK_OBJECT_STR;
+            kv[0].key.via.str.ptr = date_key;
+            kv[0].key.via.str.size = flb_sds_len(date_key);
 
             /* Append date value */
             switch (date_format) {
             case FLB_PACK_JSON_DATE_DOUBLE:
-                msgpack_pack_double(&tmp_pck, flb_time_to_double(&tms));
+                kv[0].val.type = MSGPACK_OBJECT_FLOAT64;
+                kv[0].val.via.f64 = flb_time_to_double(&tms);
                 break;
             case FLB_PACK_JSON_DATE_JAVA_SQL_TIMESTAMP:
-                if (msgpack_pack_formatted_datetime(out_buf, time_formatted, sizeof(time_formatted), &tmp_pck, &tms,
-                                                    FLB_PACK_JSON_DATE_JAVA_SQL_TIMESTAMP_FMT, ".%06" PRIu64)) {
-                    flb_sds_destroy(out_buf);
-                    msgpack_sbuffer_destroy(&tmp_sbuf);
-                    msgpack_unpacked_destroy(&result);
-                    return NULL;
+                ret = format_datetime(time_formatted, sizeof(time_formatted), &tms,
+                                      FLB_PACK_JSON_DATE_JAVA_SQL_TIMESTAMP_FMT,
+                                      ".%06" PRIu64);
+                if (ret < 0) {
+                    goto error;
                 }
+                kv[0].val.type = MSGPACK_OBJECT_STR;
+                kv[0].val.via.str.ptr = time_formatted;
+                kv[0].val.via.str.size = ret;
                 break;
             case FLB_PACK_JSON_DATE_ISO8601:
-                if (msgpack_pack_formatted_datetime(out_buf, time_formatted, sizeof(time_formatted), &tmp_pck, &tms,
-                                                    FLB_PACK_JSON_DATE_ISO8601_FMT, ".%06" PRIu64 "Z")) {
-                    flb_sds_destroy(out_buf);
-                    msgpack_sbuffer_destroy(&tmp_sbuf);
-                    msgpack_unpacked_destroy(&result);
-                    return NULL;
+                ret = format_datetime(time_formatted, sizeof(time_formatted), &tms,
+                                      FLB_PACK_JSON_DATE_ISO8601_FMT,
+                                      ".%06" PRIu64 "Z");
+                if (ret < 0) {
+                    goto error;
                 }
+                kv[0].val.type = MSGPACK_OBJECT_STR;
+                kv[0].val.via.str.ptr = time_formatted;
+                kv[0].val.via.str.size = ret;
                 break;
             case FLB_PACK_JSON_DATE_EPOCH:
-                msgpack_pack_uint64(&tmp_pck, (long long unsigned)(tms.tm.tv_sec));
+                kv[0].val.type = MSGPACK_OBJECT_POSITIVE_INTEGER;
+                kv[0].val.via.u64 = (long long unsigned)(tms.tm.tv_sec);
                 break;
             case FLB_PACK_JSON_DATE_EPOCH_MS:
-                msgpack_pack_uint64(&tmp_pck, flb_time_to_millisec(&tms));
+                kv[0].val.type = MSGPACK_OBJECT_POSITIVE_INTEGER;
+                kv[0].val.via.u64 = flb_time_to_millisec(&tms);
+                break;
+            default:
+                kv[0].val.type = MSGPACK_OBJECT_NIL;
                 break;
             }
-        }
 
-        /* Append remaining keys/values */
-        for (i = 0; i < map_size; i++) {
-            k = &map.via.map.ptr[i].key;
-            v = &map.via.map.ptr[i].val;
-            msgpack_pack_object(&tmp_pck, *k);
-            msgpack_pack_object(&tmp_pck, *v);
+            /* Append remaining keys/values */
+            if (map_size > 0) {
+                memcpy(&kv[1], map.via.map.ptr,
+                       sizeof(msgpack_object_kv) * map_size);
+            }
+            record.via.map.ptr = kv;
+            record.via.map.size = map_size + 1;
         }
 
         /*
-         * If the format is the original msgpack style, just continue since
-         * we don't care about separator or JSON convertion at this point.
+         * Upper bound for the common case: escaping and number formatting
+         * rarely expand a record more than 2x its msgpack size. Strings
+         * that need more are handled by the encoder itself.
          */
-        if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-            continue;
+        jb.data = out_buf;
+        jb.off = flb_sds_len(out_buf);
+        jb.left = flb_sds_alloc(out_buf);
+        jb.growable = FLB_TRUE;
+
+        if (!json_buf_reserve(&jb, (len * 2) + sizeof(time_formatted) + 64)) {
+            out_buf = jb.data;
+            goto error;
+        }
+        out_buf = jb.data;
+
+        /* Record separator for the array format */
+        if (json_format == FLB_PACK_JSON_FORMAT_JSON && records > 0) {
+            out_buf[flb_sds_len(out_buf)] = ',';
+            flb_sds_len_set(out_buf, flb_sds_len(out_buf) + 1);
         }
 
         /*
-         * Here we handle two types of records concatenation:
+         * Here we handle three types of records concatenation:
+         *
+         * FLB_PACK_JSON_FORMAT_JSON: comma separated inside a JSON array
          *
          * FLB_PACK_JSON_FORMAT_LINES: add  breakline (\n) after each record
          *
@@ -1027,78 +1589,45 @@ flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
          *
          *     {'ts':abc,'k1':1}{'ts':abc,'k1':2}{N}
          */
-        if (json_format == FLB_PACK_JSON_FORMAT_LINES ||
-            json_format == FLB_PACK_JSON_FORMAT_STREAM) {
-
-            /* Encode current record into JSON in a temporary variable */
-            out_js = flb_msgpack_raw_to_json_sds(tmp_sbuf.data, tmp_sbuf.size);
-            if (!out_js) {
-                flb_sds_destroy(out_buf);
-                msgpack_sbuffer_destroy(&tmp_sbuf);
-                msgpack_unpacked_destroy(&result);
-                return NULL;
-            }
-
-            /*
-             * One map record has been converted, now append it to the
-             * outgoing out_buf sds variable.
-             */
-            out_tmp = flb_sds_cat(out_buf, out_js, flb_sds_len(out_js));
-            if (!out_tmp) {
-                flb_sds_destroy(out_js);
-                flb_sds_destroy(out_buf);
-                msgpack_sbuffer_destroy(&tmp_sbuf);
-                msgpack_unpacked_destroy(&result);
-                return NULL;
-            }
-
-            /* Release temporary json sds buffer */
-            flb_sds_destroy(out_js);
-
-            /* If a realloc happened, check the returned address */
-            if (out_tmp != out_buf) {
-                out_buf = out_tmp;
-            }
+        ret = msgpack_to_json_sds(&out_buf, &record);
+        if (ret != 0) {
+            goto error;
+        }
 
-            /* Append the breakline only for json lines mode */
-            if (json_format == FLB_PACK_JSON_FORMAT_LINES) {
-                out_tmp = flb_sds_cat(out_buf, "\n", 1);
-                if (!out_tmp) {
-                    flb_sds_destroy(out_buf);
-                    msgpack_sbuffer_destroy(&tmp_sbuf);
-                    msgpack_unpacked_destroy(&result);
-                    return NULL;
-                }
-                if (out_tmp != out_buf) {
-                    out_buf = out_tmp;
-                }
+        /* Append the breakline only for json lines mode */
+        if (json_format == FLB_PACK_JSON_FORMAT_LINES) {
+            ret = flb_sds_cat_safe(&out_buf, "\n", 1);
+            if (ret != 0) {
+                goto error;
             }
-            msgpack_sbuffer_clear(&tmp_sbuf);
         }
+        records++;
     }
 
     /* Release the unpacker */
     msgpack_unpacked_destroy(&result);
+    flb_free(kv);
 
-    /* Format to JSON */
-    if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-        out_buf = flb_msgpack_raw_to_json_sds(tmp_sbuf.data, tmp_sbuf.size);
-        msgpack_sbuffer_destroy(&tmp_sbuf);
+    if (records == 0) {
+        flb_sds_destroy(out_buf);
+        return NULL;
+    }
 
-        if (!out_buf) {
+    if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
+        ret = flb_sds_cat_safe(&out_buf, "]", 1);
+        if (ret != 0) {
+            flb_sds_destroy(out_buf);
             return NULL;
         }
     }
-    else {
-        msgpack_sbuffer_destroy(&tmp_sbuf);
-    }
-
-    if (out_buf && flb_sds_len(out_buf) == 0) {
-        flb_sds_destroy(out_buf);
-        return NULL;
-    }
 
     return out_buf;
+
+ error:
+    msgpack_unpacked_destroy(&result);
+    flb_free(kv);
+    flb_sds_destroy(out_buf);
+    return NULL;
 }
 
 /**
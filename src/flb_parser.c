@@ -32,6 +32,7 @@
 #include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_config_format.h>
+#include <fluent-bit/flb_hash_table.h>
 #include <fluent-bit/multiline/flb_ml.h>
 #include <fluent-bit/multiline/flb_ml_parser.h>
 #include <fluent-bit/multiline/flb_ml_rule.h>
@@ -43,6 +44,7 @@
 #include <sys/stat.h>
 #include <limits.h>
 #include <string.h>
+#include <ctype.h>
 
 static inline uint32_t digits10(uint64_t v) {
     if (v < 10) return 1;
@@ -112,6 +114,101 @@ int flb_parser_logfmt_do(struct flb_parser *parser,
                          void **out_buf, size_t *out_size,
                          struct flb_time *out_time);
 
+/*
+ * Compile a time format into a list of operations, the fast path of
+ * flb_parser_time_lookup(). Only the conversions used by the common formats
+ * are supported, for anything else NULL is returned and the time is parsed
+ * by flb_strptime().
+ */
+static struct flb_parser_time_op *time_ops_compile(const char *fmt)
+{
+    int n = 0;
+    struct flb_parser_time_op *ops;
+
+    ops = flb_calloc(strlen(fmt) + 1, sizeof(struct flb_parser_time_op));
+    if (!ops) {
+        flb_errno();
+        return NULL;
+    }
+
+    while (*fmt) {
+        if (isspace((unsigned char) *fmt)) {
+            ops[n++].type = FLB_PARSER_TIME_OP_SPACE;
+            fmt++;
+            continue;
+        }
+
+        if (*fmt != '%') {
+            ops[n].type = FLB_PARSER_TIME_OP_LITERAL;
+            ops[n++].c = *fmt++;
+            continue;
+        }
+
+        fmt++;
+        switch (*fmt) {
+        case 'Y':
+            ops[n++].type = FLB_PARSER_TIME_OP_YEAR;
+            break;
+        case 'm':
+            ops[n++].type = FLB_PARSER_TIME_OP_MONTH;
+            break;
+        case 'b':
+        case 'B':
+        case 'h':
+            ops[n++].type = FLB_PARSER_TIME_OP_MONTH_NAME;
+            break;
+        case 'd':
+            ops[n++].type = FLB_PARSER_TIME_OP_DAY;
+            break;
+        case 'H':
+            ops[n++].type = FLB_PARSER_TIME_OP_HOUR;
+            break;
+        case 'M':
+            ops[n++].type = FLB_PARSER_TIME_OP_MINUTE;
+            break;
+        case 'S':
+            ops[n++].type = FLB_PARSER_TIME_OP_SECOND;
+            break;
+        case 'z':
+            ops[n++].type = FLB_PARSER_TIME_OP_TZ;
+            break;
+        case '%':
+            ops[n].type = FLB_PARSER_TIME_OP_LITERAL;
+            ops[n++].c = '%';
+            break;
+        default:
+            flb_free(ops);
+            return NULL;
+        }
+        fmt++;
+    }
+    ops[n].type = FLB_PARSER_TIME_OP_END;
+
+    return ops;
+}
+
+static void parser_time_destroy(struct flb_parser *parser)
+{
+    if (parser->time_ops) {
+        flb_free(parser->time_ops);
+    }
+    if (parser->time_frac_ops) {
+        flb_free(parser->time_frac_ops);
+    }
+    if (parser->time_cache) {
+        pthread_mutex_destroy(&parser->time_cache->lock);
+        flb_free(parser->time_cache);
+    }
+}
+
+/* Unlink a parser from config->parsers_index */
+static void parser_index_del(struct flb_parser *parser)
+{
+    if (parser->config && parser->name) {
+        flb_hash_table_del(parser->config->parsers_index, parser->name);
+    }
+}
+
 /*
  * This function is used to free all aspects of a parser
  * which is provided by the caller of flb_create_parser.
@@ -122,6 +219,8 @@ int flb_parser_logfmt_do(struct flb_parser *parser,
  */
 static void flb_interim_parser_destroy(struct flb_parser *parser)
 {
+    parser_index_del(parser);
+
     if (parser->type == FLB_PARSER_REGEX) {
         flb_regex_destroy(parser->regex);
         flb_free(parser->p_regex);
@@ -138,6 +237,7 @@ static void flb_interim_parser_destroy(struct flb_parser *parser)
     if (parser->time_key) {
         flb_free(parser->time_key);
     }
+    parser_time_destroy(parser);
 
     mk_list_del(&parser->_head);
     flb_free(parser);
@@ -162,18 +262,14 @@ struct flb_parser *flb_parser_create(const char *name, const char *format,
     int is_epoch = FLB_FALSE;
     char *tmp;
     char *timeptr;
-    struct mk_list *head;
     struct flb_parser *p;
     struct flb_regex *regex;
 
-    /* Iterate current parsers and make sure the new one don't exists */
-    mk_list_foreach(head, &config->parsers) {
-        p = mk_list_entry(head, struct flb_parser, _head);
-        if (p->name && strcmp(p->name, name) == 0) {
-            flb_error("[parser] parser named '%s' already exists, skip.",
-                      name);
-            return NULL;
-        }
+    /* Make sure the new parser don't exists */
+    if (flb_parser_get(name, config)) {
+        flb_error("[parser] parser named '%s' already exists, skip.",
+                  name);
+        return NULL;
     }
 
     /* Allocate context */
@@ -226,6 +322,19 @@ struct flb_parser *flb_parser_create(const char *name, const char *format,
     }
 
     p->name = flb_strdup(name);
+    if (!p->name) {
+        flb_interim_parser_destroy(p);
+        return NULL;
+    }
+
+    /* Register the name for lookups */
+    ret = flb_hash_table_add(config->parsers_index, name, strlen(name), p, 0);
+    if (ret == -1) {
+        flb_error("[parser:%s] cannot register parser", name);
+        flb_interim_parser_destroy(p);
+        return NULL;
+    }
+    p->config = config;
 
     if (time_fmt) {
         p->time_fmt_full = flb_strdup(time_fmt);
@@ -299,6 +408,30 @@ struct flb_parser *flb_parser_create(const char *name, const char *format,
             p->time_frac_secs = (tmp + 2);
         }
 
+        /* Fast path and cache of the time lookup */
+        p->time_ops = time_ops_compile(timeptr);
+        if (p->time_frac_secs) {
+            p->time_frac_ops = time_ops_compile(p->time_frac_secs);
+        }
+
+        p->time_cache = flb_calloc(1, sizeof(struct flb_parser_time_cache));
+        if (!p->time_cache) {
+            flb_errno();
+            flb_interim_parser_destroy(p);
+            return NULL;
+        }
+        pthread_mutex_init(&p->time_cache->lock, NULL);
+
+        /*
+         * The fractional seconds are left out of the cache key only when
+         * they follow a literal (e.g: '%S.%L'), otherwise the digits could
+         * change how the previous conversion is parsed.
+         */
+        if (tmp && tmp - timeptr >= 2 && tmp[-2] != '%' &&
+            !isspace((unsigned char) tmp[-1])) {
+            p->time_cache->frac_key = FLB_TRUE;
+        }
+
         /* Optional fixed timezone offset */
         if (time_offset) {
             diff = 0;
@@ -323,10 +456,57 @@ struct flb_parser *flb_parser_create(const char *name, const char *format,
     return p;
 }
 
+/*
+ * Select the regex engine of a parser: 'onigmo' (default) or 'fast'. Onigmo
+ * is kept when the pattern is not supported by the 'fast' engine.
+ */
+int flb_parser_regex_engine(struct flb_parser *parser, const char *engine)
+{
+    int fast;
+    struct flb_regex *regex;
+
+    if (strcasecmp(engine, "onigmo") == 0) {
+        fast = FLB_FALSE;
+    }
+    else if (strcasecmp(engine, "fast") == 0) {
+        fast = FLB_TRUE;
+    }
+    else {
+        flb_error("[parser:%s] invalid regex engine '%s'", parser->name, engine);
+        return -1;
+    }
+
+    if (parser->type != FLB_PARSER_REGEX) {
+        return 0;
+    }
+
+    if (fast) {
+        regex = flb_regex_create_fast(parser->p_regex);
+    }
+    else {
+        regex = flb_regex_create(parser->p_regex);
+    }
+    if (!regex) {
+        return -1;
+    }
+
+    if (fast && !regex->fast) {
+        flb_warn("[parser:%s] regex not supported by the 'fast' engine, "
+                 "using onigmo", parser->name);
+    }
+
+    flb_regex_destroy(parser->regex);
+    parser->regex = regex;
+
+    return 0;
+}
+
 void flb_parser_destroy(struct flb_parser *parser)
 {
     int i = 0;
 
+    parser_index_del(parser);
+
     if (parser->type == FLB_PARSER_REGEX) {
         flb_regex_destroy(parser->regex);
         flb_free(parser->p_regex);
@@ -343,6 +523,7 @@ void flb_parser_destroy(struct flb_parser *parser)
     if (parser->time_key) {
         flb_free(parser->time_key);
     }
+    parser_time_destroy(parser);
     if (parser->types_len != 0) {
         for (i=0; i<parser->types_len; i++){
             flb_free(parser->types[i].key);
@@ -465,6 +646,7 @@ static int parser_conf_file(const char *cfg, struct flb_cf *cf,
     flb_sds_t name;
     flb_sds_t format;
     flb_sds_t regex;
+    flb_sds_t regex_engine;
     flb_sds_t time_fmt;
     flb_sds_t time_key;
     flb_sds_t time_offset;
@@ -477,6 +659,7 @@ static int parser_conf_file(const char *cfg, struct flb_cf *cf,
     struct mk_list *head;
     struct mk_list *decoders = NULL;
     struct flb_cf_section *s;
+    struct flb_parser *p;
     struct flb_parser_types *types = NULL;
 
     /* Read all 'parser' sections */
@@ -484,6 +667,7 @@ static int parser_conf_file(const char *cfg, struct flb_cf *cf,
         name = NULL;
         format = NULL;
         regex = NULL;
+        regex_engine = NULL;
         time_fmt = NULL;
         time_key = NULL;
         time_offset = NULL;
@@ -515,7 +699,10 @@ static int parser_conf_file(const char *cfg, struct flb_cf *cf,
                       name, cfg);
             goto fconf_early_error;
         }
-        
+
+        /* regex_engine */
+        regex_engine = get_parser_key(config, cf, s, "regex_engine");
+
         /* skip_empty_values */
         skip_empty = FLB_TRUE;
         tmp_str = get_parser_key(config, cf, s, "skip_empty_values");
@@ -562,12 +749,21 @@ static int parser_conf_file(const char *cfg, struct flb_cf *cf,
         decoders = flb_parser_decoder_list_create(s);
 
         /* Create the parser context */
-        if (!flb_parser_create(name, format, regex, skip_empty,
-                               time_fmt, time_key, time_offset, time_keep, time_strict,
-                               types, types_len, decoders, config)) {
+        p = flb_parser_create(name, format, regex, skip_empty,
+                              time_fmt, time_key, time_offset, time_keep, time_strict,
+                              types, types_len, decoders, config);
+        if (!p) {
             goto fconf_error;
         }
 
+        if (regex_engine) {
+            if (flb_parser_regex_engine(p, regex_engine) == -1) {
+                flb_interim_parser_destroy(p);
+                goto fconf_error;
+            }
+            flb_sds_destroy(regex_engine);
+        }
+
         flb_debug("[parser] new parser registered: %s", name);
 
         flb_sds_destroy(name);
@@ -612,6 +808,9 @@ static int parser_conf_file(const char *cfg, struct flb_cf *cf,
     if (regex) {
         flb_sds_destroy(regex);
     }
+    if (regex_engine) {
+        flb_sds_destroy(regex_engine);
+    }
     if (time_fmt) {
         flb_sds_destroy(time_fmt);
     }
@@ -907,24 +1106,11 @@ int flb_parser_conf_file(const char *file, struct flb_config *config)
 
 struct flb_parser *flb_parser_get(const char *name, struct flb_config *config)
 {
-    struct mk_list *head;
-    struct flb_parser *parser;
-
-    if (config == NULL || mk_list_size(&config->parsers) <= 0) {
+    if (config == NULL || name == NULL) {
         return NULL;
     }
 
-    mk_list_foreach(head, &config->parsers) {
-        parser = mk_list_entry(head, struct flb_parser, _head);
-        if (parser == NULL || parser->name == NULL) {
-            continue;
-        }
-        if (strcmp(parser->name, name) == 0) {
-            return parser;
-        }
-    }
-
-    return NULL;
+    return flb_hash_table_get_ptr(config->parsers_index, name, strlen(name));
 }
 
 int flb_parser_do(struct flb_parser *parser, const char *buf, size_t length,
@@ -1031,19 +1217,313 @@ static int parse_subseconds(char *str, int len, double *subsec)
     return consumed;
 }
 
-int flb_parser_time_lookup(const char *time_str, size_t tsize,
-                           time_t now,
-                           struct flb_parser *parser,
-                           struct flb_tm *tm, double *ns)
+static const char *time_months[] = {
+    "January", "February", "March", "April", "May", "June",
+    "July", "August", "September", "October", "November", "December"
+};
+
+/* Same conversion than _conv_num() of flb_strptime(), bounded by 'end' */
+static inline int time_conv_num(const char **buf, const char *end,
+                                int *dest, int llim, int ulim)
+{
+    int result = 0;
+    int rulim = ulim;
+    const char *p = *buf;
+
+    if (p >= end || *p < '0' || *p > '9') {
+        return -1;
+    }
+
+    do {
+        result *= 10;
+        result += *p++ - '0';
+        rulim /= 10;
+    } while ((result * 10 <= ulim) && rulim && p < end &&
+             *p >= '0' && *p <= '9');
+
+    if (result < llim || result > ulim) {
+        return -1;
+    }
+
+    *dest = result;
+    *buf = p;
+    return 0;
+}
+
+static inline int time_conv_month_name(const char **buf, const char *end,
+                                       int *dest)
+{
+    int i;
+    size_t len;
+    size_t avail = end - *buf;
+
+    for (i = 0; i < 12; i++) {
+        /* full name */
+        len = strlen(time_months[i]);
+        if (len <= avail && strncasecmp(time_months[i], *buf, len) == 0) {
+            break;
+        }
+
+        /* abbreviated name */
+        len = 3;
+        if (len <= avail && strncasecmp(time_months[i], *buf, len) == 0) {
+            break;
+        }
+    }
+
+    if (i == 12) {
+        return -1;
+    }
+
+    *dest = i;
+    *buf += len;
+    return 0;
+}
+
+static inline int time_conv_tz(const char **buf, const char *end, long *dest)
+{
+    int neg;
+    long offs;
+    const char *p = *buf;
+
+    while (p < end && isspace((unsigned char) *p)) {
+        p++;
+    }
+
+    if (p >= end) {
+        return -1;
+    }
+
+    if (*p == 'Z') {
+        *dest = 0;
+        *buf = p + 1;
+        return 0;
+    }
+    else if (*p == '+') {
+        neg = FLB_FALSE;
+    }
+    else if (*p == '-') {
+        neg = FLB_TRUE;
+    }
+    else {
+        /* time zone names are left to flb_strptime() */
+        return -1;
+    }
+    p++;
+
+    if (end - p < 2 || !isdigit((unsigned char) p[0]) ||
+        !isdigit((unsigned char) p[1])) {
+        return -1;
+    }
+    offs = ((p[0] - '0') * 10 + (p[1] - '0')) * 3600;
+    p += 2;
+
+    if (p < end && *p == ':') {
+        p++;
+    }
+    if (p < end && isdigit((unsigned char) *p)) {
+        if (end - p < 2 || !isdigit((unsigned char) p[1])) {
+            return -1;
+        }
+        offs += ((p[0] - '0') * 10 + (p[1] - '0')) * 60;
+        p += 2;
+    }
+
+    *dest = neg ? -offs : offs;
+    *buf = p;
+    return 0;
+}
+
+/*
+ * Run a compiled time format. It behaves like flb_strptime() for the
+ * supported conversions, NULL is returned if the string does not match.
+ */
+static const char *time_ops_parse(struct flb_parser_time_op *op,
+                                  const char *p, const char *end,
+                                  struct flb_tm *tm)
+{
+    int ret = 0;
+    int val;
+    long offs;
+
+    for (; op->type != FLB_PARSER_TIME_OP_END; op++) {
+        if (op->type == FLB_PARSER_TIME_OP_SPACE) {
+            while (p < end && isspace((unsigned char) *p)) {
+                p++;
+            }
+            continue;
+        }
+
+        if (p >= end) {
+            return NULL;
+        }
+
+        switch (op->type) {
+        case FLB_PARSER_TIME_OP_LITERAL:
+            if (*p++ != op->c) {
+                return NULL;
+            }
+            break;
+        case FLB_PARSER_TIME_OP_YEAR:
+            ret = time_conv_num(&p, end, &val, 0, 9999);
+            tm->tm.tm_year = val - 1900;
+            break;
+        case FLB_PARSER_TIME_OP_MONTH:
+            ret = time_conv_num(&p, end, &val, 1, 12);
+            tm->tm.tm_mon = val - 1;
+            break;
+        case FLB_PARSER_TIME_OP_MONTH_NAME:
+            ret = time_conv_month_name(&p, end, &tm->tm.tm_mon);
+            break;
+        case FLB_PARSER_TIME_OP_DAY:
+            ret = time_conv_num(&p, end, &tm->tm.tm_mday, 1, 31);
+            break;
+        case FLB_PARSER_TIME_OP_HOUR:
+            ret = time_conv_num(&p, end, &tm->tm.tm_hour, 0, 23);
+            break;
+        case FLB_PARSER_TIME_OP_MINUTE:
+            ret = time_conv_num(&p, end, &tm->tm.tm_min, 0, 59);
+            break;
+        case FLB_PARSER_TIME_OP_SECOND:
+            ret = time_conv_num(&p, end, &tm->tm.tm_sec, 0, 60);
+            break;
+        case FLB_PARSER_TIME_OP_TZ:
+            ret = time_conv_tz(&p, end, &offs);
+            if (ret == 0) {
+                tm->tm.tm_isdst = 0;
+                flb_tm_gmtoff(tm) = offs;
+            }
+            break;
+        }
+
+        if (ret == -1) {
+            return NULL;
+        }
+    }
+
+    return p;
+}
+
+/*
+ * Parse a null terminated time string, the compiled format is tried first
+ * and flb_strptime() handles everything else.
+ */
+static char *time_parse(struct flb_parser_time_op *ops,
+                        const char *str, size_t len, const char *fmt,
+                        struct flb_tm *tm)
+{
+    const char *p;
+    struct flb_tm tmp;
+
+    if (ops) {
+        tmp = *tm;
+        p = time_ops_parse(ops, str, str + len, &tmp);
+        if (p) {
+            *tm = tmp;
+            return (char *) p;
+        }
+    }
+
+    return flb_strptime(str, fmt, tm);
+}
+
+static int time_cache_get(struct flb_parser_time_cache *cache,
+                          const char *str, int len,
+                          int year, int mon, int mday,
+                          struct flb_tm *tm, time_t *utc, double *ns)
+{
+    int ret;
+    int off;
+    int rest;
+    double frac;
+
+    if (cache->len == 0 || cache->year != year ||
+        cache->mon != mon || cache->mday != mday) {
+        return -1;
+    }
+
+    if (cache->frac_off == -1) {
+        if (len != cache->len || memcmp(str, cache->str, len) != 0) {
+            return -1;
+        }
+        frac = cache->ns;
+    }
+    else {
+        /* same time up to the seconds, only the fraction is parsed */
+        off = cache->frac_off;
+        if (len <= off || memcmp(str, cache->str, off) != 0) {
+            return -1;
+        }
+
+        ret = parse_subseconds((char *) str + off, len - off, &frac);
+        if (ret < 0) {
+            return -1;
+        }
+
+        rest = cache->len - off - cache->frac_len;
+        if (len - off - ret != rest ||
+            memcmp(str + off + ret,
+                   cache->str + off + cache->frac_len, rest) != 0) {
+            return -1;
+        }
+    }
+
+    *tm = cache->tm;
+    *utc = cache->utc;
+    *ns = frac;
+
+    return 0;
+}
+
+static void time_cache_set(struct flb_parser_time_cache *cache,
+                           const char *str, int len,
+                           int frac_off, int frac_len,
+                           int year, int mon, int mday,
+                           struct flb_tm *tm, time_t utc, double ns)
+{
+    if (len > sizeof(cache->str)) {
+        return;
+    }
+
+    memcpy(cache->str, str, len);
+    cache->len = len;
+    if (cache->frac_key == FLB_TRUE) {
+        cache->frac_off = frac_off;
+        cache->frac_len = frac_len;
+    }
+    else {
+        cache->frac_off = -1;
+        cache->frac_len = 0;
+    }
+    cache->year = year;
+    cache->mon = mon;
+    cache->mday = mday;
+    cache->tm = *tm;
+    cache->utc = utc;
+    cache->ns = ns;
+}
+
+static int time_lookup(const char *time_str, size_t tsize,
+                       time_t now,
+                       struct flb_parser *parser,
+                       struct flb_tm *tm, time_t *epoch, double *ns)
 {
     int ret;
+    int year = -1;
+    int mon = -1;
+    int mday = -1;
+    int frac_off = -1;
+    int frac_len = 0;
+    time_t utc;
     time_t time_now;
     char *p = NULL;
     char *fmt;
     int time_len = tsize;
+    int prefix_len = 0;
     const char *time_ptr = time_str;
     char tmp[64];
     struct tm tmy;
+    struct flb_parser_time_cache *cache = parser->time_cache;
 
     *ns = 0;
 
@@ -1075,7 +1555,22 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
         }
 
         gmtime_r(&time_now, &tmy);
+        year = tmy.tm_year;
+        mon = tmy.tm_mon;
+        mday = tmy.tm_mday;
+    }
+
+    /* Consecutive records usually share the time, try the last one */
+    if (cache && pthread_mutex_trylock(&cache->lock) == 0) {
+        ret = time_cache_get(cache, time_str, tsize, year, mon, mday,
+                             tm, &utc, ns);
+        pthread_mutex_unlock(&cache->lock);
+        if (ret == 0) {
+            goto done;
+        }
+    }
 
+    if (parser->time_with_year == FLB_FALSE) {
         /* Make the timestamp default to today */
         tm->tm.tm_mon = tmy.tm_mon;
         tm->tm.tm_mday = tmy.tm_mday;
@@ -1093,7 +1588,9 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
 
         time_ptr = tmp;
         time_len = strlen(tmp);
-        p = flb_strptime(time_ptr, parser->time_fmt_year, tm);
+        prefix_len = time_len - tsize;
+        p = time_parse(parser->time_ops, time_ptr, time_len,
+                       parser->time_fmt_year, tm);
     }
     else {
         /*
@@ -1109,7 +1606,8 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
         time_ptr = tmp;
         time_len = strlen(tmp);
 
-        p = flb_strptime(time_ptr, parser->time_fmt, tm);
+        p = time_parse(parser->time_ops, time_ptr, time_len,
+                       parser->time_fmt, tm);
     }
 
     if (p == NULL) {
@@ -1118,10 +1616,11 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
             return -1;
         }
         flb_debug("[parser] non-exact match '%.*s'", tsize, time_str);
-        return 0;
+        goto partial;
     }
 
     if (parser->time_frac_secs) {
+        frac_off = (p - time_ptr) - prefix_len;
         ret = parse_subseconds(p, time_len - (p - time_ptr), ns);
         if (ret < 0) {
             if (parser->time_strict) {
@@ -1129,27 +1628,72 @@ int flb_parser_time_lookup(const char *time_str, size_t tsize,
                 return -1;
             }
             flb_debug("[parser] non-exact match on %%L '%.*s'", tsize, time_str);
-            return 0;
+            goto partial;
         }
+        frac_len = ret;
         p += ret;
 
         /* Parse the remaining part after %L */
-        p = flb_strptime(p, parser->time_frac_secs, tm);
+        p = time_parse(parser->time_frac_ops, p, time_len - (p - time_ptr),
+                       parser->time_frac_secs, tm);
         if (p == NULL) {
             if (parser->time_strict) {
                 flb_error("[parser] cannot parse '%.*s' after %%L", tsize, time_str);
                 return -1;
             }
             flb_debug("[parser] non-exact match after %%L '%.*s'", tsize, time_str);
-            return 0;
+            goto partial;
         }
     }
 
+    tmy = tm->tm;
+    utc = timegm(&tmy);
+
+    if (cache && pthread_mutex_trylock(&cache->lock) == 0) {
+        time_cache_set(cache, time_str, tsize, frac_off, frac_len,
+                       year, mon, mday, tm, utc, *ns);
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+ done:
     if (parser->time_with_tz == FLB_FALSE) {
         flb_tm_gmtoff(tm) = parser->time_offset;
     }
 
+    if (epoch) {
+        *epoch = utc - flb_tm_gmtoff(tm);
+    }
+
     return 0;
+
+ partial:
+    if (epoch) {
+        *epoch = flb_parser_tm2time(tm);
+    }
+
+    return 0;
+}
+
+int flb_parser_time_lookup(const char *time_str, size_t tsize,
+                           time_t now,
+                           struct flb_parser *parser,
+                           struct flb_tm *tm, double *ns)
+{
+    return time_lookup(time_str, tsize, now, parser, tm, NULL, ns);
+}
+
+/*
+ * Same as flb_parser_time_lookup() but it returns the epoch, when the
+ * time comes from the cache it's not computed again.
+ */
+int flb_parser_time_lookup_epoch(const char *time_str, size_t tsize,
+                                 time_t now,
+                                 struct flb_parser *parser,
+                                 time_t *epoch, double *ns)
+{
+    struct flb_tm tm = {0};
+
+    return time_lookup(time_str, tsize, now, parser, &tm, epoch, ns);
 }
 
 int flb_parser_typecast(const char *key, int key_len,
@@ -53,7 +53,6 @@ int flb_parser_json_do(struct flb_parser *parser,
     msgpack_object *k = NULL;
     msgpack_object *v = NULL;
     time_t time_lookup;
-    struct flb_tm tm = {0};
     struct flb_time *t;
 
     /* Convert incoming in_buf JSON message to message pack format */
@@ -181,8 +180,8 @@ int flb_parser_json_do(struct flb_parser *parser,
     }
 
     /* Lookup time */
-    ret = flb_parser_time_lookup(v->via.str.ptr, v->via.str.size,
-                                 0, parser, &tm, &tmfrac);
+    ret = flb_parser_time_lookup_epoch(v->via.str.ptr, v->via.str.size,
+                                       0, parser, &time_lookup, &tmfrac);
     if (ret == -1) {
         len = v->via.str.size;
         if (len > sizeof(tmp) - 1) {
@@ -194,9 +193,6 @@ int flb_parser_json_do(struct flb_parser *parser,
                  parser->name, parser->time_fmt_full, tmp);
         time_lookup = 0;
     }
-    else {
-        time_lookup = flb_parser_tm2time(&tm);
-    }
 
     /* Compose a new map without the time_key field */
     msgpack_sbuffer_init(&mp_sbuf);
@@ -25,7 +25,7 @@
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_parser_decoder.h>
 #include <fluent-bit/flb_unescape.h>
-#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_simd.h>
 
 /*
  * https://brandur.org/logfmt
@@ -60,30 +60,88 @@ static char ident_byte[256] = {
     1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
 };
 
-static int logfmt_parser(struct flb_parser *parser,
-                         const char *in_buf, size_t in_size,
-                         msgpack_packer *tmp_pck,
-                         char *time_key, size_t time_key_len,
-                         time_t *time_lookup, double *tmfrac,
-                         size_t *map_size)
+/*
+ * Return the end of the ident starting at 'c'. The ident bytes are the ones
+ * greater than ' ' except '=' and '"' (see ident_byte[]), so the delimiters
+ * of a whole vector block are found at once.
+ */
+static inline const unsigned char *ident_end(const unsigned char *c,
+                                             const unsigned char *end)
 {
-    int ret;
-    struct flb_tm tm = {0};
+    const char *p;
+
+    p = flb_simd_find_delim((const char *) c, end - c, ' ', '=', '"');
+    if (!p) {
+        return end;
+    }
+    return (const unsigned char *) p;
+}
+
+/*
+ * Return the closing quote of the string value starting at 'c', or 'end' if
+ * it's not terminated. 'escape' is set if a backslash is found.
+ */
+static inline const unsigned char *string_end(const unsigned char *c,
+                                              const unsigned char *end,
+                                              int *escape)
+{
+    const char *p;
+
+    while (c < end) {
+        p = flb_simd_find_any2((const char *) c, end - c, '"', '\\');
+        if (!p) {
+            return end;
+        }
+        c = (const unsigned char *) p;
+        if (*c == '"') {
+            return c;
+        }
+
+        /* skip the escaped byte */
+        *escape = FLB_TRUE;
+        if (end - c < 2) {
+            return end;
+        }
+        c += 2;
+    }
+
+    return end;
+}
+
+/* Key/value pair located by logfmt_scan() */
+struct logfmt_pair {
+    const unsigned char *key;
+    size_t key_len;
+    const unsigned char *value;
+    size_t value_len;
+    int value_str;
+    int value_escape;
+    int time_found;
+};
+
+/* pairs located on the stack, longer messages are scanned again */
+#define LOGFMT_STACK_PAIRS   32
+
+/*
+ * Locate the key/value pairs of the message up to the first end of line.
+ * The first 'size' pairs are stored in 'pairs'; the return value is the
+ * number of pairs found, which can be greater than 'size'. 'last_byte' is
+ * set to the offset after the message.
+ */
+static int logfmt_scan(const char *in_buf, size_t in_size,
+                       struct logfmt_pair *pairs, int size,
+                       int *last_byte)
+{
+    int count = 0;
     const unsigned char *key = NULL;
     size_t key_len = 0;
     const unsigned char *value = NULL;
     size_t value_len = 0;
     const unsigned char *c = (const unsigned char *)in_buf;
     const unsigned char *end = c + in_size;
-    int last_byte;
-    int do_pack = FLB_TRUE;
     int value_str = FLB_FALSE;
     int value_escape = FLB_FALSE;
-
-    /* if map_size is 0 only count the number of k:v */
-    if (*map_size == 0) {
-        do_pack = FLB_FALSE;
-    }
+    struct logfmt_pair *pair;
 
     while (c < end) {
         /* garbage */
@@ -95,9 +153,7 @@ static int logfmt_parser(struct flb_parser *parser,
         }
         /* key */
         key = c;
-        while ((c < end) && ident_byte[*c]) {
-            c++;
-        }
+        c = ident_end(c, end);
 
         key_len = c - key;
         /* value */
@@ -112,22 +168,7 @@ static int logfmt_parser(struct flb_parser *parser,
                     c++;
                     value = c;
                     value_str = FLB_TRUE;
-                    while (c < end) {
-                        if (*c != '\\' && *c!= '"') {
-                            c++;
-                        }
-                        else if (*c == '\\') {
-                            value_escape =  FLB_TRUE;
-                            c++;
-                            if (c == end) {
-                                break;
-                            }
-                            c++;
-                        }
-                        else {
-                            break;
-                        }
-                    }
+                    c = string_end(c, end, &value_escape);
                     value_len = c - value;
                     if (c < end && *c == '\"') {
                         c++;
@@ -135,89 +176,23 @@ static int logfmt_parser(struct flb_parser *parser,
                 }
                 else {
                    value = c;
-                   while ((c < end) && ident_byte[*c]) {
-                      c++;
-                   }
+                   c = ident_end(c, end);
                    value_len = c - value;
                 }
             }
         }
 
         if (key_len > 0) {
-            int time_found = FLB_FALSE;
-
-            if (parser->time_fmt && key_len == time_key_len &&
-                value_len > 0 &&
-                !strncmp((const char *)key, time_key, key_len)) {
-                if (do_pack) {
-                    ret = flb_parser_time_lookup((const char *) value, value_len,
-                                                  0, parser, &tm, tmfrac);
-                    if (ret == -1) {
-                        flb_error("[parser:%s] Invalid time format %s",
-                                  parser->name, parser->time_fmt_full);
-                        return -1;
-                    }
-                    *time_lookup = flb_parser_tm2time(&tm);
-                }
-                time_found = FLB_TRUE;
-            }
-
-            if (time_found == FLB_FALSE || parser->time_keep == FLB_TRUE) {
-                if (do_pack) {
-                    if (parser->types_len != 0) {
-                        flb_parser_typecast((const char*) key, key_len,
-                                            (const char*) value, value_len,
-                                            tmp_pck,
-                                            parser->types,
-                                            parser->types_len);
-                    }
-                    else {
-                        msgpack_pack_str(tmp_pck, key_len);
-                        msgpack_pack_str_body(tmp_pck, (const char *)key, key_len);
-                        if (value_len == 0) {
-                            if (value_str == FLB_TRUE) {
-                                msgpack_pack_str(tmp_pck, 0);
-                            }
-                            else {
-                                msgpack_pack_true(tmp_pck);
-                            }
-                        }
-                        else {
-                            if (value_escape == FLB_TRUE) {
-                                int out_len;
-                                char *out_str;
-
-                                out_str = flb_malloc(value_len + 1);
-                                if (out_str == NULL) {
-                                    flb_errno();
-                                    return -1;
-                                }
-                                out_str[0] = 0;
-                                flb_unescape_string_utf8((const char *)value,
-                                                          value_len,
-                                                          out_str);
-                                out_len = strlen(out_str);
-
-                                msgpack_pack_str(tmp_pck, out_len);
-                                msgpack_pack_str_body(tmp_pck,
-                                                      out_str,
-                                                      out_len);
-
-                                flb_free(out_str);
-                            }
-                            else {
-                                msgpack_pack_str(tmp_pck, value_len);
-                                msgpack_pack_str_body(tmp_pck,
-                                                      (const char *)value,
-                                                      value_len);
-                            }
-                        }
-                    }
-                }
-                else {
-                    (*map_size)++;
-                }
+            if (count < size) {
+                pair = &pairs[count];
+                pair->key = key;
+                pair->key_len = key_len;
+                pair->value = value;
+                pair->value_len = value_len;
+                pair->value_str = value_str;
+                pair->value_escape = value_escape;
             }
+            count++;
         }
 
         if (c == end) {
@@ -239,9 +214,119 @@ static int logfmt_parser(struct flb_parser *parser,
             break;
         }
     }
-    last_byte = (const char *)c - in_buf;
+    *last_byte = (const char *)c - in_buf;
 
-    return last_byte;
+    return count;
+}
+
+static int logfmt_pack_value(struct logfmt_pair *pair,
+                             msgpack_packer *tmp_pck)
+{
+    int out_len;
+    char *out_str;
+
+    if (pair->value_len == 0) {
+        if (pair->value_str == FLB_TRUE) {
+            msgpack_pack_str(tmp_pck, 0);
+        }
+        else {
+            msgpack_pack_true(tmp_pck);
+        }
+    }
+    else if (pair->value_escape == FLB_TRUE) {
+        out_str = flb_malloc(pair->value_len + 1);
+        if (out_str == NULL) {
+            flb_errno();
+            return -1;
+        }
+        out_str[0] = 0;
+        flb_unescape_string_utf8((const char *) pair->value,
+                                 pair->value_len,
+                                 out_str);
+        out_len = strlen(out_str);
+
+        msgpack_pack_str(tmp_pck, out_len);
+        msgpack_pack_str_body(tmp_pck, out_str, out_len);
+
+        flb_free(out_str);
+    }
+    else {
+        msgpack_pack_str(tmp_pck, pair->value_len);
+        msgpack_pack_str_body(tmp_pck, (const char *) pair->value,
+                              pair->value_len);
+    }
+
+    return 0;
+}
+
+static int logfmt_parser(struct flb_parser *parser,
+                         struct logfmt_pair *pairs, int count,
+                         msgpack_packer *tmp_pck,
+                         char *time_key, size_t time_key_len,
+                         time_t *time_lookup, double *tmfrac)
+{
+    int i;
+    int ret;
+    size_t map_size = 0;
+    struct logfmt_pair *pair;
+
+    /* count the pairs to pack, the time key is not unless time_keep is set */
+    for (i = 0; i < count; i++) {
+        pair = &pairs[i];
+        pair->time_found = FLB_FALSE;
+
+        if (parser->time_fmt && pair->key_len == time_key_len &&
+            pair->value_len > 0 &&
+            !strncmp((const char *) pair->key, time_key, pair->key_len)) {
+            pair->time_found = FLB_TRUE;
+        }
+
+        if (pair->time_found == FLB_FALSE || parser->time_keep == FLB_TRUE) {
+            map_size++;
+        }
+    }
+    if (map_size == 0) {
+        return -1;
+    }
+
+    msgpack_pack_map(tmp_pck, map_size);
+
+    for (i = 0; i < count; i++) {
+        pair = &pairs[i];
+
+        if (pair->time_found == FLB_TRUE) {
+            ret = flb_parser_time_lookup_epoch((const char *) pair->value,
+                                               pair->value_len, 0, parser,
+                                               time_lookup, tmfrac);
+            if (ret == -1) {
+                flb_error("[parser:%s] Invalid time format %s",
+                          parser->name, parser->time_fmt_full);
+                return -1;
+            }
+            if (parser->time_keep == FLB_FALSE) {
+                continue;
+            }
+        }
+
+        if (parser->types_len != 0) {
+            flb_parser_typecast((const char*) pair->key, pair->key_len,
+                                (const char*) pair->value, pair->value_len,
+                                tmp_pck,
+                                parser->types,
+                                parser->types_len);
+        }
+        else {
+            msgpack_pack_str(tmp_pck, pair->key_len);
+            msgpack_pack_str_body(tmp_pck, (const char *) pair->key,
+                                  pair->key_len);
+            ret = logfmt_pack_value(pair, tmp_pck);
+            if (ret == -1) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
 }
 
 int flb_parser_logfmt_do(struct flb_parser *parser,
@@ -257,10 +342,12 @@ int flb_parser_logfmt_do(struct flb_parser *parser,
     msgpack_packer tmp_pck;
     char *dec_out_buf;
     size_t dec_out_size;
-    size_t map_size;
     char *time_key;
     size_t time_key_len;
     int last_byte;
+    int count;
+    struct logfmt_pair *pairs;
+    struct logfmt_pair stack_pairs[LOGFMT_STACK_PAIRS];
 
     if (parser->time_key) {
         time_key = parser->time_key;
@@ -271,26 +358,35 @@ int flb_parser_logfmt_do(struct flb_parser *parser,
     time_key_len = strlen(time_key);
     time_lookup = 0;
 
-    /* count the number of key value pairs */
-    map_size = 0;
-    logfmt_parser(parser, in_buf, in_size, NULL,
-                  time_key, time_key_len,
-                  &time_lookup, &tmfrac, &map_size);
-    if (map_size == 0) {
+    /* locate the key value pairs */
+    pairs = stack_pairs;
+    count = logfmt_scan(in_buf, in_size, pairs, LOGFMT_STACK_PAIRS,
+                        &last_byte);
+    if (count == 0) {
         return -1;
     }
+    else if (count > LOGFMT_STACK_PAIRS) {
+        pairs = flb_malloc(sizeof(struct logfmt_pair) * count);
+        if (!pairs) {
+            flb_errno();
+            return -1;
+        }
+        logfmt_scan(in_buf, in_size, pairs, count, &last_byte);
+    }
 
     /* Prepare new outgoing buffer */
     msgpack_sbuffer_init(&tmp_sbuf);
     msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
-    msgpack_pack_map(&tmp_pck, map_size);
 
-    last_byte = logfmt_parser(parser, in_buf, in_size, &tmp_pck,
-                              time_key, time_key_len,
-                              &time_lookup, &tmfrac, &map_size);
-    if (last_byte < 0) {
+    ret = logfmt_parser(parser, pairs, count, &tmp_pck,
+                        time_key, time_key_len,
+                        &time_lookup, &tmfrac);
+    if (pairs != stack_pairs) {
+        flb_free(pairs);
+    }
+    if (ret == -1) {
         msgpack_sbuffer_destroy(&tmp_sbuf);
-        return last_byte;
+        return -1;
     }
 
     /* Export results */
@@ -24,6 +24,7 @@
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_parser_decoder.h>
+#include <fluent-bit/flb_simd.h>
 
 /*
  *  http://ltsv.org
@@ -78,29 +79,61 @@ static char ltvs_field[256] = {
     1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
 };
 
+/*
+ * Return the end of the field value starting at 'c'. Every byte that is not
+ * a fbyte is lower than or equal to '\r', so those are located with vector
+ * compares and then checked against ltvs_field[].
+ */
+static inline const unsigned char *field_end(const unsigned char *c,
+                                             const unsigned char *end)
+{
+    const char *p;
 
-static int ltsv_parser(struct flb_parser *parser,
-                       const char *in_buf, size_t in_size,
-                       msgpack_packer *tmp_pck,
-                       char *time_key, size_t time_key_len,
-                       time_t *time_lookup, double *tmfrac,
-                       size_t *map_size)
+    while (c < end) {
+        p = flb_simd_find_delim((const char *) c, end - c, '\r', '\t', '\n');
+        if (!p) {
+            return end;
+        }
+        c = (const unsigned char *) p;
+        if (!ltvs_field[*c]) {
+            return c;
+        }
+        c++;
+    }
+
+    return end;
+}
+
+/* Label/field pair located by ltsv_scan() */
+struct ltsv_pair {
+    const unsigned char *label;
+    size_t label_len;
+    const unsigned char *field;
+    size_t field_len;
+    int time_found;
+};
+
+/* pairs located on the stack, longer records are scanned again */
+#define LTSV_STACK_PAIRS   32
+
+/*
+ * Locate the label/field pairs of the record up to the first end of line.
+ * The first 'size' pairs are stored in 'pairs'; the return value is the
+ * number of pairs found, which can be greater than 'size'. 'last_byte' is
+ * set to the offset after the record.
+ */
+static int ltsv_scan(const char *in_buf, size_t in_size,
+                     struct ltsv_pair *pairs, int size,
+                     int *last_byte)
 {
-    int ret;
-    struct flb_tm tm = {0};
+    int count = 0;
     const unsigned char *label = NULL;
     size_t label_len = 0;
     const unsigned char *field = NULL;
     size_t field_len = 0;
     const unsigned char *c = (const unsigned char *)in_buf;
     const unsigned char *end = c + in_size;
-    int last_byte;
-    int do_pack = FLB_TRUE;
-
-    /* if map_size is 0 only count the number of k:v */
-    if (*map_size == 0) {
-        do_pack = FLB_FALSE;
-    }
+    struct ltsv_pair *pair;
 
     while (c < end) {
         label = c;
@@ -118,52 +151,18 @@ static int ltsv_parser(struct flb_parser *parser,
         c++;
 
         field = c;
-        if (c != end) {
-            while ((c < end) && ltvs_field[*c]) {
-                c++;
-            }
-        }
+        c = field_end(c, end);
         field_len = c - field;
 
         if (label_len > 0) {
-            int time_found = FLB_FALSE;
-
-            if (parser->time_fmt && label_len == time_key_len &&
-                field_len > 0 &&
-                !strncmp((const char *)label, time_key, label_len)) {
-                if (do_pack) {
-                    ret = flb_parser_time_lookup((const char *) field, field_len,
-                                                  0, parser, &tm, tmfrac);
-                    if (ret == -1) {
-                       flb_error("[parser:%s] Invalid time format %s",
-                                 parser->name, parser->time_fmt_full);
-                       return -1;
-                    }
-                    *time_lookup = flb_parser_tm2time(&tm);
-                }
-                time_found = FLB_TRUE;
-            }
-
-            if (time_found == FLB_FALSE || parser->time_keep == FLB_TRUE) {
-                if (do_pack) {
-                    if (parser->types_len != 0) {
-                        flb_parser_typecast((const char*) label, label_len,
-                                            (const char*) field, field_len,
-                                            tmp_pck,
-                                            parser->types,
-                                            parser->types_len);
-                    }
-                    else {
-                        msgpack_pack_str(tmp_pck, label_len);
-                        msgpack_pack_str_body(tmp_pck, (const char *)label, label_len);
-                        msgpack_pack_str(tmp_pck, field_len);
-                        msgpack_pack_str_body(tmp_pck, (const char *)field, field_len);
-                    }
-                }
-                else {
-                    (*map_size)++;
-                }
+            if (count < size) {
+                pair = &pairs[count];
+                pair->label = label;
+                pair->label_len = label_len;
+                pair->field = field;
+                pair->field_len = field_len;
             }
+            count++;
         }
 
         if (c == end) {
@@ -191,9 +190,78 @@ static int ltsv_parser(struct flb_parser *parser,
             break;
         }
     }
-    last_byte = (const char *)c - in_buf;
+    *last_byte = (const char *)c - in_buf;
 
-    return last_byte;
+    return count;
+}
+
+static int ltsv_parser(struct flb_parser *parser,
+                       struct ltsv_pair *pairs, int count,
+                       msgpack_packer *tmp_pck,
+                       char *time_key, size_t time_key_len,
+                       time_t *time_lookup, double *tmfrac)
+{
+    int i;
+    int ret;
+    size_t map_size = 0;
+    struct ltsv_pair *pair;
+
+    /* count the pairs to pack, the time key is not unless time_keep is set */
+    for (i = 0; i < count; i++) {
+        pair = &pairs[i];
+        pair->time_found = FLB_FALSE;
+
+        if (parser->time_fmt && pair->label_len == time_key_len &&
+            pair->field_len > 0 &&
+            !strncmp((const char *) pair->label, time_key, pair->label_len)) {
+            pair->time_found = FLB_TRUE;
+        }
+
+        if (pair->time_found == FLB_FALSE || parser->time_keep == FLB_TRUE) {
+            map_size++;
+        }
+    }
+    if (map_size == 0) {
+        return -1;
+    }
+
+    msgpack_pack_map(tmp_pck, map_size);
+
+    for (i = 0; i < count; i++) {
+        pair = &pairs[i];
+
+        if (pair->time_found == FLB_TRUE) {
+            ret = flb_parser_time_lookup_epoch((const char *) pair->field,
+                                               pair->field_len, 0, parser,
+                                               time_lookup, tmfrac);
+            if (ret == -1) {
+               flb_error("[parser:%s] Invalid time format %s",
+                         parser->name, parser->time_fmt_full);
+               return -1;
+            }
+            if (parser->time_keep == FLB_FALSE) {
+                continue;
+            }
+        }
+
+        if (parser->types_len != 0) {
+            flb_parser_typecast((const char*) pair->label, pair->label_len,
+                                (const char*) pair->field, pair->field_len,
+                                tmp_pck,
+                                parser->types,
+                                parser->types_len);
+        }
+        else {
+            msgpack_pack_str(tmp_pck, pair->label_len);
+            msgpack_pack_str_body(tmp_pck, (const char *) pair->label,
+                                  pair->label_len);
+            msgpack_pack_str(tmp_pck, pair->field_len);
+            msgpack_pack_str_body(tmp_pck, (const char *) pair->field,
+                                  pair->field_len);
+        }
+    }
+
+    return 0;
 }
 
 int flb_parser_ltsv_do(struct flb_parser *parser,
@@ -209,10 +277,12 @@ int flb_parser_ltsv_do(struct flb_parser *parser,
     msgpack_packer tmp_pck;
     char *dec_out_buf;
     size_t dec_out_size;
-    size_t map_size;
     char *time_key;
     size_t time_key_len;
     int last_byte;
+    int count;
+    struct ltsv_pair *pairs;
+    struct ltsv_pair stack_pairs[LTSV_STACK_PAIRS];
 
     if (parser->time_key) {
         time_key = parser->time_key;
@@ -223,26 +293,34 @@ int flb_parser_ltsv_do(struct flb_parser *parser,
     time_key_len = strlen(time_key);
     time_lookup = 0;
 
-    /* count the number of key value pairs */
-    map_size = 0;
-    ltsv_parser(parser, in_buf, in_size, NULL,
-                time_key, time_key_len,
-                &time_lookup, &tmfrac, &map_size);
-    if (map_size == 0) {
+    /* locate the label field pairs */
+    pairs = stack_pairs;
+    count = ltsv_scan(in_buf, in_size, pairs, LTSV_STACK_PAIRS, &last_byte);
+    if (count == 0) {
         return -1;
     }
+    else if (count > LTSV_STACK_PAIRS) {
+        pairs = flb_malloc(sizeof(struct ltsv_pair) * count);
+        if (!pairs) {
+            flb_errno();
+            return -1;
+        }
+        ltsv_scan(in_buf, in_size, pairs, count, &last_byte);
+    }
 
     /* Prepare new outgoing buffer */
     msgpack_sbuffer_init(&tmp_sbuf);
     msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
-    msgpack_pack_map(&tmp_pck, map_size);
 
-    last_byte = ltsv_parser(parser, in_buf, in_size, &tmp_pck,
-                            time_key, time_key_len,
-                            &time_lookup, &tmfrac, &map_size);
-    if (last_byte < 0) {
+    ret = ltsv_parser(parser, pairs, count, &tmp_pck,
+                      time_key, time_key_len,
+                      &time_lookup, &tmfrac);
+    if (pairs != stack_pairs) {
+        flb_free(pairs);
+    }
+    if (ret == -1) {
         msgpack_sbuffer_destroy(&tmp_sbuf);
-        return last_byte;
+        return -1;
     }
 
     /* Export results */
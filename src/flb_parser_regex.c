@@ -51,7 +51,7 @@ static void cb_results(const char *name, const char *value,
     char tmp[255];
     struct regex_cb_ctx *pcb = data;
     struct flb_parser *parser = pcb->parser;
-    struct flb_tm tm = {0};
+    time_t time_lookup;
     (void) data;
 
     if (vlen == 0 && parser->skip_empty) {
@@ -72,8 +72,9 @@ static void cb_results(const char *name, const char *value,
 
         if (strcmp(name, time_key) == 0) {
             /* Lookup time */
-            ret = flb_parser_time_lookup(value, vlen,
-                                         pcb->time_now, parser, &tm, &frac);
+            ret = flb_parser_time_lookup_epoch(value, vlen,
+                                               pcb->time_now, parser,
+                                               &time_lookup, &frac);
             if (ret == -1) {
                 if (vlen > sizeof(tmp) - 1) {
                     vlen = sizeof(tmp) - 1;
@@ -87,7 +88,7 @@ static void cb_results(const char *name, const char *value,
             }
 
             pcb->time_frac = frac;
-            pcb->time_lookup = flb_parser_tm2time(&tm);
+            pcb->time_lookup = time_lookup;
 
             if (parser->time_keep == FLB_FALSE) {
                 pcb->num_skipped++;
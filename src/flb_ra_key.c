@@ -76,36 +76,38 @@ static int msgpack_object_to_ra_value(msgpack_object o,
     return -1;
 }
 
-/* Return the entry position of key/val in the map */
-static int ra_key_val_id(flb_sds_t ckey, msgpack_object map)
+/* Return the entry position of the last key named 'str' in the map */
+static inline int ra_key_id(const char *str, int len, msgpack_object *map)
 {
     int i;
-    int map_size;
-    msgpack_object key;
+    msgpack_object *key;
 
-    if (map.type != MSGPACK_OBJECT_MAP) {
+    if (map->type != MSGPACK_OBJECT_MAP) {
         return -1;
     }
 
-    map_size = map.via.map.size;
-    for (i = map_size - 1; i >= 0; i--) {
-        key = map.via.map.ptr[i].key;
+    for (i = map->via.map.size - 1; i >= 0; i--) {
+        key = &map->via.map.ptr[i].key;
 
-        if (key.type != MSGPACK_OBJECT_STR) {
+        /* Compare by length first, most keys are discarded here */
+        if (key->type != MSGPACK_OBJECT_STR || key->via.str.size != len) {
             continue;
         }
 
-        /* Compare by length and by key name */
-        if (flb_sds_cmp(ckey, key.via.str.ptr, key.via.str.size) != 0) {
-            continue;
+        if (memcmp(key->via.str.ptr, str, len) == 0) {
+            return i;
         }
-
-        return i;
     }
 
     return -1;
 }
 
+/* Return the entry position of key/val in the map */
+static int ra_key_val_id(flb_sds_t ckey, msgpack_object map)
+{
+    return ra_key_id(ckey, flb_sds_len(ckey), &map);
+}
+
 static int msgpack_object_strcmp(msgpack_object o, char *str, int len)
 {
     if (o.type != MSGPACK_OBJECT_STR) {
@@ -119,277 +121,178 @@ static int msgpack_object_strcmp(msgpack_object o, char *str, int len)
     return strncmp(o.via.str.ptr, str, len);
 }
 
-/* Lookup perfect match of sub-keys and map content */
-static int subkey_to_object(msgpack_object *map, struct mk_list *subkeys,
+/* Lookup perfect match of the compiled sub-keys and map content */
+static int subkey_to_object(msgpack_object *map, struct flb_ra_key *ckey,
                             msgpack_object **out_key, msgpack_object **out_val)
 {
-    int i = 0;
-    int levels;
-    int matched = 0;
-    msgpack_object *found = NULL;
+    int i;
+    int n;
     msgpack_object *key = NULL;
     msgpack_object *val = NULL;
-    msgpack_object cur;
-    struct mk_list *head;
-    struct flb_ra_subentry *entry;
+    msgpack_object *cur;
+    struct flb_ra_step *step;
 
-    /* Expected number of map levels in the map */
-    levels = mk_list_size(subkeys);
-
-    cur = *map;
+    /* a match requires at least one map key in the path */
+    if (!ckey->steps_has_str) {
+        return -1;
+    }
 
-    mk_list_foreach(head, subkeys) {
-        /* expected entry */
-        entry = mk_list_entry(head, struct flb_ra_subentry, _head);
+    cur = map;
+    for (n = 0; n < ckey->steps_size; n++) {
+        step = &ckey->steps[n];
 
         /* Array Handling */
-        if (entry->type == FLB_RA_PARSER_ARRAY_ID) {
+        if (step->type == FLB_RA_PARSER_ARRAY_ID) {
             /* check the current msgpack object is an array */
-            if (cur.type != MSGPACK_OBJECT_ARRAY) {
+            if (cur->type != MSGPACK_OBJECT_ARRAY) {
                 return -1;
             }
 
             /* Index limit and ensure no overflow */
-            if (entry->array_id == INT_MAX ||
-                cur.via.array.size < entry->array_id + 1) {
+            if (step->array_id == INT_MAX ||
+                cur->via.array.size < step->array_id + 1) {
                 return -1;
             }
 
-            val = &cur.via.array.ptr[entry->array_id];
-            cur = *val;
             key = NULL; /* fill NULL since the type is array. */
-            goto next;
-        }
-
-        if (cur.type != MSGPACK_OBJECT_MAP) {
-            break;
+            val = &cur->via.array.ptr[step->array_id];
+            cur = val;
+            continue;
         }
 
-        i = ra_key_val_id(entry->str, cur);
+        i = ra_key_id(step->str, step->len, cur);
         if (i == -1) {
-            found = NULL;
-            continue;
+            return -1;
         }
 
-        key = &cur.via.map.ptr[i].key;
-        val = &cur.via.map.ptr[i].val;
+        key = &cur->via.map.ptr[i].key;
+        val = &cur->via.map.ptr[i].val;
+        cur = val;
+    }
 
-        /* A bit obvious, but it's better to validate data type */
-        if (key->type != MSGPACK_OBJECT_STR) {
-            found = NULL;
-            continue;
-        }
+    *out_key = key;
+    *out_val = val;
 
-        found = key;
-        cur = cur.via.map.ptr[i].val;
+    return 0;
+}
 
-    next:
-        matched++;
+/*
+ * Run the compiled lookup of 'ckey' over the map. If the key has no subkeys,
+ * or the value found is not a container, the top level entry is returned.
+ */
+static int ra_key_lookup(struct flb_ra_key *ckey, msgpack_object *map,
+                         msgpack_object **start_key,
+                         msgpack_object **out_key, msgpack_object **out_val)
+{
+    int i;
+    msgpack_object *val;
 
-        if (levels == matched) {
-            break;
-        }
+    /* Get the key position in the map */
+    i = ra_key_id(ckey->name, flb_sds_len(ckey->name), map);
+    if (i == -1) {
+        return -1;
     }
 
-    /* No matches */
-    if (!found || (matched > 0 && levels != matched)) {
-        return -1;
+    *start_key = &map->via.map.ptr[i].key;
+    val = &map->via.map.ptr[i].val;
+
+    if ((val->type == MSGPACK_OBJECT_MAP || val->type == MSGPACK_OBJECT_ARRAY)
+        && ckey->steps_size > 0) {
+        return subkey_to_object(val, ckey, out_key, out_val);
     }
 
-    *out_key = (msgpack_object *) key;
-    *out_val = (msgpack_object *) val;
+    *out_key = *start_key;
+    *out_val = val;
 
     return 0;
 }
 
-struct flb_ra_value *flb_ra_key_to_value(flb_sds_t ckey,
-                                         msgpack_object map,
-                                         struct mk_list *subkeys)
+struct flb_ra_value *flb_ra_key_to_value(struct flb_ra_key *ckey,
+                                         msgpack_object map)
 {
-    int i;
     int ret;
-    msgpack_object val;
+    msgpack_object *start_key;
     msgpack_object *out_key;
     msgpack_object *out_val;
     struct flb_ra_value *result;
 
-    /* Get the key position in the map */
-    i = ra_key_val_id(ckey, map);
-    if (i == -1) {
+    ret = ra_key_lookup(ckey, &map, &start_key, &out_key, &out_val);
+    if (ret == -1) {
         return NULL;
     }
 
-    /* Reference entries */
-    val = map.via.map.ptr[i].val;
-
     /* Create the result context */
     result = flb_calloc(1, sizeof(struct flb_ra_value));
     if (!result) {
         flb_errno();
         return NULL;
     }
-    result->o = val;
 
-    if ((val.type == MSGPACK_OBJECT_MAP || val.type == MSGPACK_OBJECT_ARRAY)
-        && subkeys != NULL && mk_list_size(subkeys) > 0) {
-
-        ret = subkey_to_object(&val, subkeys, &out_key, &out_val);
-        if (ret == 0) {
-            ret = msgpack_object_to_ra_value(*out_val, result);
-            if (ret == -1) {
-                flb_free(result);
-                return NULL;
-            }
-            return result;
-        }
-        else {
-            flb_free(result);
-            return NULL;
-        }
-    }
-    else {
-        ret = msgpack_object_to_ra_value(val, result);
-        if (ret == -1) {
+    ret = msgpack_object_to_ra_value(*out_val, result);
+    if (ret == -1) {
+        if (out_key == start_key) {
             flb_error("[ra key] cannot process key value");
-            flb_free(result);
-            return NULL;
         }
+        flb_free(result);
+        return NULL;
     }
 
     return result;
 }
 
-int flb_ra_key_value_get(flb_sds_t ckey, msgpack_object map,
-                         struct mk_list *subkeys,
+int flb_ra_key_value_get(struct flb_ra_key *ckey, msgpack_object map,
                          msgpack_object **start_key,
                          msgpack_object **out_key, msgpack_object **out_val)
 {
-    int i;
-    int ret;
-    msgpack_object val;
-    msgpack_object *o_key;
-    msgpack_object *o_val;
-
-    /* Get the key position in the map */
-    i = ra_key_val_id(ckey, map);
-    if (i == -1) {
-        return -1;
-    }
-
-    /* Reference entries */
-    *start_key = &map.via.map.ptr[i].key;
-    val = map.via.map.ptr[i].val;
-
-    if ((val.type == MSGPACK_OBJECT_MAP || val.type == MSGPACK_OBJECT_ARRAY)
-        && subkeys != NULL && mk_list_size(subkeys) > 0) {
-        ret = subkey_to_object(&val, subkeys, &o_key, &o_val);
-        if (ret == 0) {
-            *out_key = o_key;
-            *out_val = o_val;
-            return 0;
-        }
-    }
-    else {
-        *out_key = &map.via.map.ptr[i].key;
-        *out_val = &map.via.map.ptr[i].val;
-        return 0;
-    }
-
-    return -1;
+    return ra_key_lookup(ckey, &map, start_key, out_key, out_val);
 }
 
-int flb_ra_key_strcmp(flb_sds_t ckey, msgpack_object map,
-                      struct mk_list *subkeys, char *str, int len)
+int flb_ra_key_strcmp(struct flb_ra_key *ckey, msgpack_object map,
+                      char *str, int len)
 {
-    int i;
     int ret;
-    msgpack_object val;
+    msgpack_object *start_key;
     msgpack_object *out_key;
     msgpack_object *out_val;
 
-    /* Get the key position in the map */
-    i = ra_key_val_id(ckey, map);
-    if (i == -1) {
+    ret = ra_key_lookup(ckey, &map, &start_key, &out_key, &out_val);
+    if (ret == -1) {
         return -1;
     }
 
-    /* Reference map value */
-    val = map.via.map.ptr[i].val;
-
-    if ((val.type == MSGPACK_OBJECT_MAP || val.type == MSGPACK_OBJECT_ARRAY)
-        && subkeys != NULL && mk_list_size(subkeys) > 0) {
-        ret = subkey_to_object(&val, subkeys, &out_key, &out_val);
-        if (ret == 0) {
-            return msgpack_object_strcmp(*out_val, str, len);
-        }
-        else {
-            return -1;
-        }
-    }
-
-    return msgpack_object_strcmp(val, str, len);
+    return msgpack_object_strcmp(*out_val, str, len);
 }
 
-int flb_ra_key_regex_match(flb_sds_t ckey, msgpack_object map,
-                           struct mk_list *subkeys, struct flb_regex *regex,
+int flb_ra_key_regex_match(struct flb_ra_key *ckey, msgpack_object map,
+                           struct flb_regex *regex,
                            struct flb_regex_search *result)
 {
-    int i;
     int ret;
-    msgpack_object val;
+    msgpack_object *start_key;
     msgpack_object *out_key;
     msgpack_object *out_val;
 
-    /* Get the key position in the map */
-    i = ra_key_val_id(ckey, map);
-    if (i == -1) {
-        return -1;
-    }
-
-    /* Reference map value */
-    val = map.via.map.ptr[i].val;
-
-    if ((val.type == MSGPACK_OBJECT_MAP || val.type == MSGPACK_OBJECT_ARRAY)
-        && subkeys != NULL && mk_list_size(subkeys) > 0) {
-        ret = subkey_to_object(&val, subkeys, &out_key, &out_val);
-        if (ret == 0) {
-            if (out_val->type != MSGPACK_OBJECT_STR) {
-                return -1;
-            }
-
-            if (result) {
-                /* Regex + capture mode */
-                return flb_regex_do(regex,
-                                    (char *) out_val->via.str.ptr,
-                                    out_val->via.str.size,
-                                    result);
-            }
-            else {
-                /* No capture */
-                return flb_regex_match(regex,
-                                       (unsigned char *) out_val->via.str.ptr,
-                                       out_val->via.str.size);
-            }
-        }
+    ret = ra_key_lookup(ckey, &map, &start_key, &out_key, &out_val);
+    if (ret == -1) {
         return -1;
     }
 
-    if (val.type != MSGPACK_OBJECT_STR) {
+    if (out_val->type != MSGPACK_OBJECT_STR) {
         return -1;
     }
 
     if (result) {
         /* Regex + capture mode */
-        return flb_regex_do(regex, (char *) val.via.str.ptr, val.via.str.size,
+        return flb_regex_do(regex,
+                            (char *) out_val->via.str.ptr,
+                            out_val->via.str.size,
                             result);
     }
-    else {
-        /* No capture */
-        return flb_regex_match(regex, (unsigned char *) val.via.str.ptr,
-                               val.via.str.size);
-    }
 
-    return -1;
+    /* No capture */
+    return flb_regex_match(regex,
+                           (unsigned char *) out_val->via.str.ptr,
+                           out_val->via.str.size);
 }
 
 static int update_subkey(msgpack_object *obj, struct mk_list *subkeys,
@@ -500,11 +500,14 @@ static flb_sds_t ra_translate_string(struct flb_ra_parser *rp, flb_sds_t buf)
 static flb_sds_t ra_translate_keymap(struct flb_ra_parser *rp, flb_sds_t buf,
                                      msgpack_object map, int *found)
 {
+    int ret;
     int len;
     char *js;
     char str[32];
     flb_sds_t tmp = NULL;
-    struct flb_ra_value *v;
+    msgpack_object *start_key;
+    msgpack_object *key;
+    msgpack_object *val;
 
     /* Lookup key or subkey value */
     if (rp->key == NULL) {
@@ -512,57 +515,66 @@ static flb_sds_t ra_translate_keymap(struct flb_ra_parser *rp, flb_sds_t buf,
       return buf;
     }
 
-    v = flb_ra_key_to_value(rp->key->name, map, rp->key->subkeys);
-    if (!v) {
+    ret = flb_ra_key_value_get(rp->key, map, &start_key, &key, &val);
+    if (ret != 0) {
         *found = FLB_FALSE;
         return buf;
     }
-    else {
-        *found = FLB_TRUE;
-    }
 
-    /* Based on data type, convert to it string representation */
-    if (v->type == FLB_RA_BOOL) {
-        /* Check if is a map or a real bool */
-        if (v->o.type == MSGPACK_OBJECT_MAP) {
-            /* Convert msgpack map to JSON string */
-            js = flb_msgpack_to_json_str(1024, &v->o);
-            if (js) {
-                len = strlen(js);
-                tmp = flb_sds_cat(buf, js, len);
-                flb_free(js);
-            }
+    /*
+     * Based on data type, convert to it string representation. The value is
+     * formatted straight from the msgpack object, there is no need to build
+     * an intermediate flb_ra_value for every record.
+     */
+    switch (val->type) {
+    case MSGPACK_OBJECT_MAP:
+        /* Convert msgpack map to JSON string */
+        js = flb_msgpack_to_json_str(1024, val);
+        if (js) {
+            len = strlen(js);
+            tmp = flb_sds_cat(buf, js, len);
+            flb_free(js);
+        }
+        break;
+    case MSGPACK_OBJECT_BOOLEAN:
+        if (val->via.boolean) {
+            tmp = flb_sds_cat(buf, "true", 4);
         }
-        else if (v->o.type == MSGPACK_OBJECT_BOOLEAN) {
-            if (v->val.boolean) {
-                tmp = flb_sds_cat(buf, "true", 4);
-            }
-            else {
-                tmp = flb_sds_cat(buf, "false", 5);
-            }
+        else {
+            tmp = flb_sds_cat(buf, "false", 5);
         }
-    }
-    else if (v->type == FLB_RA_INT) {
-        len = snprintf(str, sizeof(str) - 1, "%" PRId64, v->val.i64);
+        break;
+    case MSGPACK_OBJECT_POSITIVE_INTEGER:
+    case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+        len = snprintf(str, sizeof(str) - 1, "%" PRId64, val->via.i64);
         tmp = flb_sds_cat(buf, str, len);
-    }
-    else if (v->type == FLB_RA_FLOAT) {
-        len = snprintf(str, sizeof(str) - 1, "%f", v->val.f64);
+        break;
+    case MSGPACK_OBJECT_FLOAT32:
+    case MSGPACK_OBJECT_FLOAT:
+        len = snprintf(str, sizeof(str) - 1, "%f", val->via.f64);
         if (len >= sizeof(str)) {
             tmp = flb_sds_cat(buf, str, sizeof(str)-1);
         }
         else {
             tmp = flb_sds_cat(buf, str, len);
         }
-    }
-    else if (v->type == FLB_RA_STRING) {
-        tmp = flb_sds_cat(buf, v->val.string, flb_sds_len(v->val.string));
-    }
-    else if (v->type == FLB_RA_NULL) {
+        break;
+    case MSGPACK_OBJECT_STR:
+        tmp = flb_sds_cat(buf, val->via.str.ptr, val->via.str.size);
+        break;
+    case MSGPACK_OBJECT_NIL:
         tmp = flb_sds_cat(buf, "null", 4);
+        break;
+    default:
+        /* arrays, binary and extension types have no representation */
+        if (start_key == key) {
+            flb_error("[ra key] cannot process key value");
+        }
+        *found = FLB_FALSE;
+        return buf;
     }
 
-    flb_ra_key_value_destroy(v);
+    *found = FLB_TRUE;
     return tmp;
 }
 
@@ -690,7 +702,7 @@ int flb_ra_strcmp(struct flb_record_accessor *ra, msgpack_object map,
     struct flb_ra_parser *rp;
 
     rp = mk_list_entry_first(&ra->list, struct flb_ra_parser, _head);
-    return flb_ra_key_strcmp(rp->key->name, map, rp->key->subkeys,
+    return flb_ra_key_strcmp(rp->key, map,
                              rp->key->name, flb_sds_len(rp->key->name));
 }
 
@@ -707,8 +719,7 @@ int flb_ra_regex_match(struct flb_record_accessor *ra, msgpack_object map,
     if (rp == NULL || rp->key == NULL) {
         return -1;
     }
-    return flb_ra_key_regex_match(rp->key->name, map, rp->key->subkeys,
-                                  regex, result);
+    return flb_ra_key_regex_match(rp->key, map, regex, result);
 }
 
 
@@ -744,8 +755,7 @@ int flb_ra_get_kv_pair(struct flb_record_accessor *ra, msgpack_object map,
         return FLB_FALSE;
     }
 
-    return flb_ra_key_value_get(rp->key->name, map, rp->key->subkeys,
-                                start_key, out_key, out_val);
+    return flb_ra_key_value_get(rp->key, map, start_key, out_key, out_val);
 }
 
 struct flb_ra_value *flb_ra_get_value_object(struct flb_record_accessor *ra,
@@ -758,7 +768,7 @@ struct flb_ra_value *flb_ra_get_value_object(struct flb_record_accessor *ra,
         return NULL;
     }
 
-    return flb_ra_key_to_value(rp->key->name, map, rp->key->subkeys);
+    return flb_ra_key_to_value(rp->key, map);
 }
 
 /**
@@ -21,10 +21,17 @@
 #include <fluent-bit/flb_regex.h>
 #include <fluent-bit/flb_log.h>
 #include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_regex_fast.h>
 
 #include <string.h>
 #include <onigmo.h>
 
+/* Results of the 'fast' engine */
+struct fast_region {
+    int num_regs;
+    ptrdiff_t regs[];
+};
+
 static int
 cb_onig_named(const UChar *name, const UChar *name_end,
               int ngroup_num, int *group_nums,
@@ -109,10 +116,68 @@ struct flb_regex *flb_regex_create(const char *pattern)
         flb_free(r);
         return NULL;
     }
+    r->fast = NULL;
+
+    return r;
+}
+
+/*
+ * Same as flb_regex_create(), the pattern is also compiled for the 'fast'
+ * engine if it supports it, 'fast' is NULL otherwise. Onigmo is still used
+ * for the subjects the engine doesn't handle.
+ */
+struct flb_regex *flb_regex_create_fast(const char *pattern)
+{
+    size_t len;
+    struct flb_regex *r;
+
+    r = flb_regex_create(pattern);
+    if (!r) {
+        return NULL;
+    }
+
+    len = strlen(pattern);
+    if (len > 1 && pattern[0] == '/' && pattern[len - 1] == '/') {
+        r->fast = flb_regex_fast_create(pattern + 1, len - 2);
+    }
+    else {
+        r->fast = flb_regex_fast_create(pattern, len);
+    }
 
     return r;
 }
 
+static ssize_t fast_do(struct flb_regex *r, const char *str, size_t slen,
+                       struct flb_regex_search *result)
+{
+    int ret;
+    int num_regs;
+    struct fast_region *region;
+
+    num_regs = r->fast->num_groups + 1;
+    region = flb_malloc(sizeof(struct fast_region) +
+                        sizeof(ptrdiff_t) * num_regs * 2);
+    if (!region) {
+        flb_errno();
+        result->region = NULL;
+        return -1;
+    }
+    region->num_regs = num_regs;
+
+    ret = flb_regex_fast_search(r->fast, str, slen, region->regs);
+    if (ret != FLB_REGEX_FAST_MATCH) {
+        flb_free(region);
+        result->region = NULL;
+        return ret == FLB_REGEX_FAST_FALLBACK ? -2 : -1;
+    }
+
+    result->fast = FLB_TRUE;
+    result->region = region;
+    result->str = str;
+
+    return num_regs - 1;
+}
+
 ssize_t flb_regex_do(struct flb_regex *r, const char *str, size_t slen,
                      struct flb_regex_search *result)
 {
@@ -122,6 +187,14 @@ ssize_t flb_regex_do(struct flb_regex *r, const char *str, size_t slen,
     const char *range;
     OnigRegion *region;
 
+    result->fast = FLB_FALSE;
+    if (r->fast) {
+        ret = fast_do(r, str, slen, result);
+        if (ret != -2) {
+            return ret;
+        }
+    }
+
     region = onig_region_new();
     if (!region) {
         flb_errno();
@@ -168,12 +241,23 @@ int flb_regex_results_get(struct flb_regex_search *result, int i,
                           ptrdiff_t *start, ptrdiff_t *end)
 {
     OnigRegion *region;
+    struct fast_region *fast;
 
-    region = (OnigRegion *) result->region;
-    if (!region) {
+    if (!result->region) {
         return -1;
     }
 
+    if (result->fast) {
+        fast = result->region;
+        if (i >= fast->num_regs) {
+            return -1;
+        }
+        *start = fast->regs[i * 2];
+        *end = fast->regs[i * 2 + 1];
+        return 0;
+    }
+
+    region = (OnigRegion *) result->region;
     if (i >= region->num_regs) {
         return -1;
     }
@@ -186,6 +270,10 @@ int flb_regex_results_get(struct flb_regex_search *result, int i,
 
 void flb_regex_results_release(struct flb_regex_search *result)
 {
+    if (result->fast) {
+        flb_free(result->region);
+        return;
+    }
     onig_region_free(result->region, 1);
 }
 
@@ -193,11 +281,15 @@ int flb_regex_results_size(struct flb_regex_search *result)
 {
     OnigRegion *region;
 
-    region = (OnigRegion *) result->region;
-    if (!region) {
+    if (!result->region) {
         return -1;
     }
 
+    if (result->fast) {
+        return ((struct fast_region *) result->region)->num_regs;
+    }
+
+    region = (OnigRegion *) result->region;
     return region->num_regs;
 }
 
@@ -225,6 +317,31 @@ int flb_regex_match(struct flb_regex *r, unsigned char *str, size_t slen)
 }
 
 
+/* Same as onig_foreach_name() with cb_onig_named(), names come in order */
+static void fast_parse(struct flb_regex_fast *prog,
+                       struct flb_regex_search *s)
+{
+    int i;
+    ptrdiff_t beg;
+    ptrdiff_t end;
+    struct fast_region *region = s->region;
+
+    for (i = 0; i < prog->num_groups; i++) {
+        beg = region->regs[prog->names[i].group * 2];
+        end = region->regs[prog->names[i].group * 2 + 1];
+
+        if (s->cb_match) {
+            s->cb_match(prog->names[i].name,
+                        s->str + (beg >= 0 ? beg : 0), end - beg,
+                        s->data);
+        }
+
+        if (end >= 0) {
+            s->last_pos = end;
+        }
+    }
+}
+
 int flb_regex_parse(struct flb_regex *r, struct flb_regex_search *result,
                     void (*cb_match) (const char *,          /* name  */
                                       const char *, size_t,  /* value */
@@ -237,6 +354,12 @@ int flb_regex_parse(struct flb_regex *r, struct flb_regex_search *result,
     result->cb_match = cb_match;
     result->last_pos = -1;
 
+    if (result->fast) {
+        fast_parse(r->fast, result);
+        flb_free(result->region);
+        return result->last_pos;
+    }
+
     ret = onig_foreach_name(r->regex, cb_onig_named, result);
     onig_region_free(result->region, 1);
 
@@ -249,6 +372,7 @@ int flb_regex_parse(struct flb_regex *r, struct flb_regex_search *result,
 int flb_regex_destroy(struct flb_regex *r)
 {
     onig_free(r->regex);
+    flb_regex_fast_destroy(r->fast);
     flb_free(r);
     return 0;
 }
@@ -0,0 +1,1270 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_str.h>
+#include <fluent-bit/flb_regex_fast.h>
+
+#include <string.h>
+#include <stdint.h>
+
+/* Limits of the patterns handled by the engine */
+#define MAX_REPEAT       1000
+#define MAX_CODE         (64 * 1024)
+
+/* Backtracking entries kept in the stack of the caller */
+#define BT_LOCAL_SIZE    64
+
+enum {
+    NODE_EMPTY = 0,
+    NODE_CHAR,
+    NODE_SET,
+    NODE_BOL,
+    NODE_EOL,
+    NODE_CAT,
+    NODE_ALT,
+    NODE_GROUP,
+    NODE_REPEAT
+};
+
+enum {
+    OP_MATCH = 0,
+    OP_CHAR,        /* x: byte                                      */
+    OP_SET,         /* x: set                                       */
+    OP_BOL,
+    OP_EOL,
+    OP_JMP,         /* x: target                                    */
+    OP_SPLIT,       /* x: preferred target, y: alternative          */
+    OP_SAVE,        /* x: capture slot                              */
+    OP_RUN          /* x: set, repeated 'min' to 'max' (-1) times   */
+};
+
+enum {
+    BT_PC = 0,      /* resume at 'pc', position 'a'                 */
+    BT_SAVE,        /* restore capture slot 'pc' to 'a'             */
+    BT_RUN,         /* greedy run, positions 'a' to 'b' left to try */
+    BT_LAZY         /* lazy run at position 'a', up to 'b'          */
+};
+
+struct flb_regex_fast_inst {
+    int op;
+    int x;
+    int y;
+    int min;
+    int max;
+    int greedy;
+};
+
+struct node {
+    int type;
+    int val;                /* byte, set or group number (0: no capture) */
+    int min;
+    int max;                /* -1: unbounded */
+    int greedy;
+    struct node *left;
+    struct node *right;
+};
+
+struct compiler {
+    const char *p;
+    const char *end;
+    int error;
+    int depth;              /* nesting level of groups */
+
+    int num_nodes;
+    int max_nodes;
+    struct node *nodes;
+
+    int num_groups;
+    int max_names;
+    struct flb_regex_fast_name *names;
+
+    int num_sets;
+    int max_sets;
+    unsigned char (*sets)[256];
+
+    int code_len;
+    int code_size;
+    struct flb_regex_fast_inst *code;
+};
+
+struct bt_entry {
+    int type;
+    int pc;
+    ptrdiff_t a;
+    ptrdiff_t b;
+};
+
+struct bt_stack {
+    int top;
+    int size;
+    struct bt_entry *entries;
+    struct bt_entry local[BT_LOCAL_SIZE];
+};
+
+/*
+ * Pattern parser: it builds a syntax tree of the supported subset, anything
+ * else sets 'error' so the caller keeps using Onigmo.
+ */
+
+static struct node *node_new(struct compiler *c, int type,
+                             struct node *left, struct node *right)
+{
+    struct node *n;
+
+    if (c->num_nodes == c->max_nodes) {
+        c->error = FLB_TRUE;
+        return NULL;
+    }
+
+    n = &c->nodes[c->num_nodes++];
+    n->type = type;
+    n->left = left;
+    n->right = right;
+
+    return n;
+}
+
+static int set_new(struct compiler *c)
+{
+    int size;
+    void *tmp;
+
+    if (c->num_sets == c->max_sets) {
+        size = c->max_sets ? c->max_sets * 2 : 8;
+        tmp = flb_realloc(c->sets, size * sizeof(*c->sets));
+        if (!tmp) {
+            flb_errno();
+            c->error = FLB_TRUE;
+            return -1;
+        }
+        c->sets = tmp;
+        c->max_sets = size;
+    }
+    memset(c->sets[c->num_sets], 0, sizeof(*c->sets));
+
+    return c->num_sets++;
+}
+
+static void set_range(unsigned char *set, int from, int to)
+{
+    int i;
+
+    for (i = from; i <= to; i++) {
+        set[i] = 1;
+    }
+}
+
+static void set_invert(unsigned char *set)
+{
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        set[i] = !set[i];
+    }
+}
+
+/* \d, \s, \w and their negations, ASCII only as in the Ruby syntax */
+static int set_add_type(unsigned char *set, int type)
+{
+    int i;
+    unsigned char tmp[256] = {0};
+
+    switch (type) {
+    case 'd':
+    case 'D':
+        set_range(tmp, '0', '9');
+        break;
+    case 's':
+    case 'S':
+        set_range(tmp, '\t', '\r');
+        tmp[' '] = 1;
+        break;
+    case 'w':
+    case 'W':
+        set_range(tmp, '0', '9');
+        set_range(tmp, 'A', 'Z');
+        set_range(tmp, 'a', 'z');
+        tmp['_'] = 1;
+        break;
+    default:
+        return -1;
+    }
+
+    if (type == 'D' || type == 'S' || type == 'W') {
+        set_invert(tmp);
+    }
+    for (i = 0; i < 256; i++) {
+        set[i] |= tmp[i];
+    }
+
+    return 0;
+}
+
+/* Byte of an escaped character, -1 if it's not a plain character */
+static int escape_char(int ch)
+{
+    switch (ch) {
+    case 't':
+        return '\t';
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 'f':
+        return '\f';
+    case 'v':
+        return '\v';
+    case 'a':
+        return '\a';
+    case 'e':
+        return 0x1b;
+    }
+
+    if ((ch & 0x80) ||
+        (ch >= '0' && ch <= '9') ||
+        (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')) {
+        return -1;
+    }
+
+    return ch;
+}
+
+static int is_name_char(int ch, int first)
+{
+    if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_') {
+        return FLB_TRUE;
+    }
+    if (!first && ch >= '0' && ch <= '9') {
+        return FLB_TRUE;
+    }
+    return FLB_FALSE;
+}
+
+static int is_nullable(struct node *n)
+{
+    switch (n->type) {
+    case NODE_CHAR:
+    case NODE_SET:
+        return FLB_FALSE;
+    case NODE_CAT:
+        return is_nullable(n->left) && is_nullable(n->right);
+    case NODE_ALT:
+        return is_nullable(n->left) || is_nullable(n->right);
+    case NODE_GROUP:
+        return is_nullable(n->left);
+    case NODE_REPEAT:
+        return n->min == 0 || is_nullable(n->left);
+    }
+
+    return FLB_TRUE;
+}
+
+static struct node *parse_alt(struct compiler *c);
+
+/* Character class, the opening bracket is already consumed */
+static struct node *parse_class(struct compiler *c)
+{
+    int lo;
+    int hi;
+    int ch;
+    int set;
+    int negate = FLB_FALSE;
+    struct node *n;
+
+    set = set_new(c);
+    if (set == -1) {
+        return NULL;
+    }
+
+    if (c->p < c->end && *c->p == '^') {
+        negate = FLB_TRUE;
+        c->p++;
+    }
+
+    /* a leading ']' and nested classes or set operations are left to Onigmo */
+    if (c->p < c->end && *c->p == ']') {
+        c->error = FLB_TRUE;
+        return NULL;
+    }
+
+    while (1) {
+        if (c->p >= c->end) {
+            c->error = FLB_TRUE;
+            return NULL;
+        }
+
+        ch = (unsigned char) *c->p;
+        if (ch == ']') {
+            c->p++;
+            break;
+        }
+        else if (ch == '[' || (ch == '&' && c->p + 1 < c->end && c->p[1] == '&')) {
+            c->error = FLB_TRUE;
+            return NULL;
+        }
+
+        c->p++;
+        if (ch == '\\') {
+            if (c->p >= c->end) {
+                c->error = FLB_TRUE;
+                return NULL;
+            }
+            ch = (unsigned char) *c->p++;
+            if (set_add_type(c->sets[set], ch) == 0) {
+                if (c->p + 1 < c->end && *c->p == '-' && c->p[1] != ']') {
+                    c->error = FLB_TRUE;
+                    return NULL;
+                }
+                continue;
+            }
+            lo = escape_char(ch);
+        }
+        else if (ch & 0x80) {
+            lo = -1;
+        }
+        else {
+            lo = ch;
+        }
+
+        if (lo == -1) {
+            c->error = FLB_TRUE;
+            return NULL;
+        }
+
+        /* range */
+        hi = lo;
+        if (c->p + 1 < c->end && *c->p == '-' && c->p[1] != ']') {
+            c->p++;
+            ch = (unsigned char) *c->p++;
+            if (ch == '\\') {
+                if (c->p >= c->end) {
+                    c->error = FLB_TRUE;
+                    return NULL;
+                }
+                hi = escape_char((unsigned char) *c->p++);
+            }
+            else if (ch == '[' || (ch & 0x80)) {
+                hi = -1;
+            }
+            else {
+                hi = ch;
+            }
+
+            if (hi == -1 || hi < lo) {
+                c->error = FLB_TRUE;
+                return NULL;
+            }
+        }
+        set_range(c->sets[set], lo, hi);
+    }
+
+    if (negate) {
+        set_invert(c->sets[set]);
+    }
+
+    n = node_new(c, NODE_SET, NULL, NULL);
+    if (n) {
+        n->val = set;
+    }
+    return n;
+}
+
+/* Group, the opening parenthesis is already consumed */
+static struct node *parse_group(struct compiler *c)
+{
+    int i;
+    int group = 0;
+    const char *name;
+    struct node *n;
+    struct node *child;
+
+    if (c->p < c->end && *c->p == '?') {
+        c->p++;
+        if (c->p < c->end && *c->p == ':') {
+            c->p++;
+        }
+        else if (c->p + 1 < c->end && *c->p == '<' &&
+                 is_name_char((unsigned char) c->p[1], FLB_TRUE)) {
+            name = ++c->p;
+            while (c->p < c->end && is_name_char((unsigned char) *c->p, FLB_FALSE)) {
+                c->p++;
+            }
+            if (c->p >= c->end || *c->p != '>') {
+                c->error = FLB_TRUE;
+                return NULL;
+            }
+
+            /* names defined more than once are left to Onigmo */
+            for (i = 0; i < c->num_groups; i++) {
+                if (strlen(c->names[i].name) == c->p - name &&
+                    strncmp(c->names[i].name, name, c->p - name) == 0) {
+                    c->error = FLB_TRUE;
+                    return NULL;
+                }
+            }
+            if (c->num_groups == c->max_names) {
+                c->error = FLB_TRUE;
+                return NULL;
+            }
+
+            c->names[c->num_groups].name = flb_strndup(name, c->p - name);
+            if (!c->names[c->num_groups].name) {
+                flb_errno();
+                c->error = FLB_TRUE;
+                return NULL;
+            }
+            group = ++c->num_groups;
+            c->names[c->num_groups - 1].group = group;
+            c->p++;
+        }
+        else {
+            /* lookarounds, atomic groups, options... */
+            c->error = FLB_TRUE;
+            return NULL;
+        }
+    }
+
+    /* unnamed groups don't capture when the pattern has named groups */
+    c->depth++;
+    child = parse_alt(c);
+    c->depth--;
+    if (!child) {
+        return NULL;
+    }
+    if (c->p >= c->end || *c->p != ')') {
+        c->error = FLB_TRUE;
+        return NULL;
+    }
+    c->p++;
+
+    n = node_new(c, NODE_GROUP, child, NULL);
+    if (n) {
+        n->val = group;
+    }
+    return n;
+}
+
+static struct node *parse_atom(struct compiler *c)
+{
+    int ch;
+    int set;
+    const char *next;
+    struct node *n;
+
+    ch = (unsigned char) *c->p++;
+    switch (ch) {
+    case '(':
+        return parse_group(c);
+    case '[':
+        return parse_class(c);
+    case '.':
+        set = set_new(c);
+        if (set == -1) {
+            return NULL;
+        }
+        set_range(c->sets[set], 0, 255);
+        c->sets[set]['\n'] = 0;
+        n = node_new(c, NODE_SET, NULL, NULL);
+        if (n) {
+            n->val = set;
+        }
+        return n;
+    case '^':
+        return node_new(c, NODE_BOL, NULL, NULL);
+    case '$':
+        /*
+         * Onigmo's search can miss matches when '$' is followed by other
+         * atoms, only '$' at the end of the pattern or of a top level
+         * branch is handled.
+         */
+        next = c->p;
+        while (next < c->end && *next == ')') {
+            next++;
+        }
+        if (next < c->end && (next != c->p || *next != '|' || c->depth > 0)) {
+            break;
+        }
+        return node_new(c, NODE_EOL, NULL, NULL);
+    case '\\':
+        if (c->p >= c->end) {
+            break;
+        }
+        ch = (unsigned char) *c->p++;
+        set = -1;
+        if (ch == 'd' || ch == 'D' || ch == 's' || ch == 'S' ||
+            ch == 'w' || ch == 'W') {
+            set = set_new(c);
+            if (set == -1) {
+                return NULL;
+            }
+            set_add_type(c->sets[set], ch);
+            n = node_new(c, NODE_SET, NULL, NULL);
+            if (n) {
+                n->val = set;
+            }
+            return n;
+        }
+        ch = escape_char(ch);
+        if (ch == -1) {
+            break;
+        }
+        n = node_new(c, NODE_CHAR, NULL, NULL);
+        if (n) {
+            n->val = ch;
+        }
+        return n;
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+        break;
+    default:
+        if (ch & 0x80) {
+            break;
+        }
+        n = node_new(c, NODE_CHAR, NULL, NULL);
+        if (n) {
+            n->val = ch;
+        }
+        return n;
+    }
+
+    c->error = FLB_TRUE;
+    return NULL;
+}
+
+static int parse_number(struct compiler *c)
+{
+    int num = -1;
+
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+        if (num == -1) {
+            num = 0;
+        }
+        num = num * 10 + (*c->p - '0');
+        if (num > MAX_REPEAT) {
+            return -2;
+        }
+        c->p++;
+    }
+
+    return num;
+}
+
+/* Interval: {n}, {n,}, {,m} or {n,m}, the brace is already consumed */
+static int parse_interval(struct compiler *c, int *min, int *max)
+{
+    *min = parse_number(c);
+    if (*min == -2 || c->p >= c->end) {
+        return -1;
+    }
+
+    if (*c->p == '}') {
+        if (*min == -1) {
+            return -1;
+        }
+        *max = *min;
+    }
+    else if (*c->p == ',') {
+        c->p++;
+        *max = parse_number(c);
+        if (*max == -2 || c->p >= c->end || *c->p != '}') {
+            return -1;
+        }
+        if (*min == -1 && *max == -1) {
+            return -1;
+        }
+        if (*min == -1) {
+            *min = 0;
+        }
+    }
+    else {
+        return -1;
+    }
+    c->p++;
+
+    if (*max != -1 && *max < *min) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static struct node *parse_repeat(struct compiler *c)
+{
+    int ch;
+    int min;
+    int max;
+    int greedy = FLB_TRUE;
+    struct node *n;
+    struct node *atom;
+    struct node *child;
+
+    atom = parse_atom(c);
+    if (!atom || c->p >= c->end) {
+        return atom;
+    }
+
+    ch = *c->p;
+    if (ch != '*' && ch != '+' && ch != '?' && ch != '{') {
+        return atom;
+    }
+    c->p++;
+
+    if (atom->type == NODE_BOL || atom->type == NODE_EOL) {
+        c->error = FLB_TRUE;
+        return NULL;
+    }
+
+    /* Onigmo rewrites nested quantifiers such as (?:a+?)*, leave them */
+    child = atom;
+    while (child->type == NODE_GROUP && child->val == 0) {
+        child = child->left;
+    }
+    if (child->type == NODE_REPEAT) {
+        c->error = FLB_TRUE;
+        return NULL;
+    }
+
+    if (ch == '{') {
+        if (parse_interval(c, &min, &max) == -1) {
+            c->error = FLB_TRUE;
+            return NULL;
+        }
+        /* '?' and '+' after an interval have their own meaning in Ruby */
+        if (c->p < c->end && (*c->p == '?' || *c->p == '+')) {
+            c->error = FLB_TRUE;
+            return NULL;
+        }
+    }
+    else {
+        min = (ch == '+') ? 1 : 0;
+        max = (ch == '?') ? 1 : -1;
+        if (c->p < c->end && *c->p == '?') {
+            greedy = FLB_FALSE;
+            c->p++;
+        }
+        else if (c->p < c->end && *c->p == '+') {
+            /* possessive */
+            c->error = FLB_TRUE;
+            return NULL;
+        }
+    }
+
+    /* nested quantifiers, or loops that can match an empty string */
+    if (c->p < c->end &&
+        (*c->p == '*' || *c->p == '+' || *c->p == '?' || *c->p == '{')) {
+        c->error = FLB_TRUE;
+        return NULL;
+    }
+    if (max == 0 || (max != 1 && is_nullable(atom))) {
+        c->error = FLB_TRUE;
+        return NULL;
+    }
+
+    n = node_new(c, NODE_REPEAT, atom, NULL);
+    if (n) {
+        n->min = min;
+        n->max = max;
+        n->greedy = greedy;
+    }
+    return n;
+}
+
+static struct node *parse_cat(struct compiler *c)
+{
+    struct node *n;
+    struct node *tmp;
+
+    n = node_new(c, NODE_EMPTY, NULL, NULL);
+    while (n && c->p < c->end && *c->p != '|' && *c->p != ')') {
+        tmp = parse_repeat(c);
+        if (!tmp) {
+            return NULL;
+        }
+        if (n->type == NODE_EMPTY) {
+            n = tmp;
+        }
+        else {
+            n = node_new(c, NODE_CAT, n, tmp);
+        }
+    }
+
+    return n;
+}
+
+static struct node *parse_alt(struct compiler *c)
+{
+    struct node *n;
+    struct node *tmp;
+
+    n = parse_cat(c);
+    while (n && c->p < c->end && *c->p == '|') {
+        c->p++;
+        tmp = parse_cat(c);
+        if (!tmp) {
+            return NULL;
+        }
+        n = node_new(c, NODE_ALT, n, tmp);
+    }
+
+    return n;
+}
+
+/* Code generation */
+
+static int emit(struct compiler *c, int op, int x, int y)
+{
+    int size;
+    void *tmp;
+    struct flb_regex_fast_inst *in;
+
+    if (c->code_len == c->code_size) {
+        if (c->code_size >= MAX_CODE) {
+            return -1;
+        }
+        size = c->code_size ? c->code_size * 2 : 64;
+        tmp = flb_realloc(c->code, size * sizeof(struct flb_regex_fast_inst));
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        c->code = tmp;
+        c->code_size = size;
+    }
+
+    in = &c->code[c->code_len];
+    memset(in, 0, sizeof(struct flb_regex_fast_inst));
+    in->op = op;
+    in->x = x;
+    in->y = y;
+
+    return c->code_len++;
+}
+
+static int gen(struct compiler *c, struct node *n);
+
+/* 'body' is taken first by a greedy split, 'skip' by a lazy one */
+static void split_set(struct compiler *c, int pc, int body, int skip,
+                      int greedy)
+{
+    c->code[pc].x = greedy ? body : skip;
+    c->code[pc].y = greedy ? skip : body;
+}
+
+static int gen_repeat(struct compiler *c, struct node *n)
+{
+    int i;
+    int pc;
+    int set;
+    int prev;
+    int next;
+    struct node *child;
+
+    /* a single character class repeated runs in a tight loop */
+    child = n->left;
+    while (child->type == NODE_GROUP && child->val == 0) {
+        child = child->left;
+    }
+    if (child->type == NODE_CHAR || child->type == NODE_SET) {
+        if (child->type == NODE_CHAR) {
+            set = set_new(c);
+            if (set == -1) {
+                return -1;
+            }
+            c->sets[set][child->val] = 1;
+        }
+        else {
+            set = child->val;
+        }
+
+        pc = emit(c, OP_RUN, set, 0);
+        if (pc == -1) {
+            return -1;
+        }
+        c->code[pc].min = n->min;
+        c->code[pc].max = n->max;
+        c->code[pc].greedy = n->greedy;
+        return 0;
+    }
+
+    for (i = 0; i < n->min; i++) {
+        if (gen(c, n->left) == -1) {
+            return -1;
+        }
+    }
+
+    if (n->max == -1) {
+        pc = emit(c, OP_SPLIT, 0, 0);
+        if (pc == -1 || gen(c, n->left) == -1 ||
+            emit(c, OP_JMP, pc, 0) == -1) {
+            return -1;
+        }
+        split_set(c, pc, pc + 1, c->code_len, n->greedy);
+        return 0;
+    }
+
+    /* x{0,3} is x(?:x(?:x)?)?: all the splits skip to the end */
+    prev = -1;
+    for (i = n->min; i < n->max; i++) {
+        pc = emit(c, OP_SPLIT, 0, prev);
+        if (pc == -1 || gen(c, n->left) == -1) {
+            return -1;
+        }
+        prev = pc;
+    }
+    for (pc = prev; pc != -1; pc = next) {
+        next = c->code[pc].y;
+        split_set(c, pc, pc + 1, c->code_len, n->greedy);
+    }
+
+    return 0;
+}
+
+static int gen(struct compiler *c, struct node *n)
+{
+    int pc;
+    int jmp;
+
+    switch (n->type) {
+    case NODE_EMPTY:
+        return 0;
+    case NODE_CHAR:
+        return emit(c, OP_CHAR, n->val, 0) == -1 ? -1 : 0;
+    case NODE_SET:
+        return emit(c, OP_SET, n->val, 0) == -1 ? -1 : 0;
+    case NODE_BOL:
+        return emit(c, OP_BOL, 0, 0) == -1 ? -1 : 0;
+    case NODE_EOL:
+        return emit(c, OP_EOL, 0, 0) == -1 ? -1 : 0;
+    case NODE_CAT:
+        if (gen(c, n->left) == -1) {
+            return -1;
+        }
+        return gen(c, n->right);
+    case NODE_ALT:
+        pc = emit(c, OP_SPLIT, 0, 0);
+        if (pc == -1 || gen(c, n->left) == -1) {
+            return -1;
+        }
+        jmp = emit(c, OP_JMP, 0, 0);
+        if (jmp == -1) {
+            return -1;
+        }
+        c->code[pc].x = pc + 1;
+        c->code[pc].y = c->code_len;
+        if (gen(c, n->right) == -1) {
+            return -1;
+        }
+        c->code[jmp].x = c->code_len;
+        return 0;
+    case NODE_GROUP:
+        if (n->val == 0) {
+            return gen(c, n->left);
+        }
+        if (emit(c, OP_SAVE, n->val * 2, 0) == -1 ||
+            gen(c, n->left) == -1 ||
+            emit(c, OP_SAVE, n->val * 2 + 1, 0) == -1) {
+            return -1;
+        }
+        return 0;
+    case NODE_REPEAT:
+        return gen_repeat(c, n);
+    }
+
+    return -1;
+}
+
+/* Matcher */
+
+static int bt_push(struct bt_stack *st, int type, int pc,
+                   ptrdiff_t a, ptrdiff_t b)
+{
+    int size;
+    struct bt_entry *e;
+    struct bt_entry *tmp;
+
+    if (st->top == st->size) {
+        size = st->size * 2;
+        if (st->entries == st->local) {
+            tmp = flb_malloc(size * sizeof(struct bt_entry));
+            if (tmp) {
+                memcpy(tmp, st->local, sizeof(st->local));
+            }
+        }
+        else {
+            tmp = flb_realloc(st->entries, size * sizeof(struct bt_entry));
+        }
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        st->entries = tmp;
+        st->size = size;
+    }
+
+    e = &st->entries[st->top++];
+    e->type = type;
+    e->pc = pc;
+    e->a = a;
+    e->b = b;
+
+    return 0;
+}
+
+static int match_at(struct flb_regex_fast *prog,
+                    const unsigned char *s, ptrdiff_t len, ptrdiff_t start,
+                    ptrdiff_t *regs, struct bt_stack *st)
+{
+    int pc = 0;
+    ptrdiff_t n;
+    ptrdiff_t lim;
+    ptrdiff_t pos = start;
+    const unsigned char *set;
+    struct bt_entry *e;
+    struct flb_regex_fast_inst *in;
+
+    st->top = 0;
+
+    while (1) {
+        in = &prog->code[pc];
+        switch (in->op) {
+        case OP_CHAR:
+            if (pos < len && s[pos] == in->x) {
+                pos++;
+                pc++;
+                continue;
+            }
+            break;
+        case OP_SET:
+            if (pos < len && prog->sets[in->x][s[pos]]) {
+                pos++;
+                pc++;
+                continue;
+            }
+            break;
+        case OP_BOL:
+            /* as in Onigmo, a trailing newline doesn't start a line */
+            if (pos == 0 || (s[pos - 1] == '\n' && pos < len)) {
+                pc++;
+                continue;
+            }
+            break;
+        case OP_EOL:
+            if (pos == len || s[pos] == '\n') {
+                pc++;
+                continue;
+            }
+            break;
+        case OP_JMP:
+            pc = in->x;
+            continue;
+        case OP_SPLIT:
+            if (bt_push(st, BT_PC, in->y, pos, 0) == -1) {
+                return FLB_REGEX_FAST_ERROR;
+            }
+            pc = in->x;
+            continue;
+        case OP_SAVE:
+            if (bt_push(st, BT_SAVE, in->x, regs[in->x], 0) == -1) {
+                return FLB_REGEX_FAST_ERROR;
+            }
+            regs[in->x] = pos;
+            pc++;
+            continue;
+        case OP_RUN:
+            set = prog->sets[in->x];
+            lim = len - pos;
+            if (in->max >= 0 && in->max < lim) {
+                lim = in->max;
+            }
+            if (lim < in->min) {
+                break;
+            }
+
+            if (in->greedy) {
+                n = 0;
+                while (n < lim && set[s[pos + n]]) {
+                    n++;
+                }
+                if (n < in->min) {
+                    break;
+                }
+                if (n > in->min &&
+                    bt_push(st, BT_RUN, pc + 1, pos + in->min, pos + n) == -1) {
+                    return FLB_REGEX_FAST_ERROR;
+                }
+            }
+            else {
+                n = 0;
+                while (n < in->min && set[s[pos + n]]) {
+                    n++;
+                }
+                if (n < in->min) {
+                    break;
+                }
+                if (lim > n &&
+                    bt_push(st, BT_LAZY, pc + 1, pos + n, pos + lim) == -1) {
+                    return FLB_REGEX_FAST_ERROR;
+                }
+            }
+            pos += n;
+            pc++;
+            continue;
+        case OP_MATCH:
+            regs[0] = start;
+            regs[1] = pos;
+            return FLB_REGEX_FAST_MATCH;
+        }
+
+        /* backtrack */
+        while (1) {
+            if (st->top == 0) {
+                return FLB_REGEX_FAST_MISMATCH;
+            }
+
+            e = &st->entries[st->top - 1];
+            if (e->type == BT_PC) {
+                pc = e->pc;
+                pos = e->a;
+                st->top--;
+                break;
+            }
+            else if (e->type == BT_SAVE) {
+                regs[e->pc] = e->a;
+                st->top--;
+                continue;
+            }
+
+            in = &prog->code[e->pc];
+            if (e->type == BT_RUN) {
+                /*
+                 * Give back one character. When the continuation starts with
+                 * a literal, the positions where it can't match are skipped.
+                 */
+                pos = e->b - 1;
+                if (in->op == OP_CHAR) {
+                    while (pos >= e->a && s[pos] != in->x) {
+                        pos--;
+                    }
+                    if (pos < e->a) {
+                        st->top--;
+                        continue;
+                    }
+                }
+                if (pos == e->a) {
+                    st->top--;
+                }
+                else {
+                    e->b = pos;
+                }
+            }
+            else {
+                /* lazy run: take one more character */
+                pos = e->a;
+                set = prog->sets[prog->code[e->pc - 1].x];
+                if (pos >= e->b || !set[s[pos]]) {
+                    st->top--;
+                    continue;
+                }
+                pos++;
+                if (in->op == OP_CHAR) {
+                    while (pos < e->b && s[pos] != in->x && set[s[pos]]) {
+                        pos++;
+                    }
+                }
+                if (pos >= e->b) {
+                    st->top--;
+                }
+                else {
+                    e->a = pos;
+                }
+            }
+            pc = e->pc;
+            break;
+        }
+    }
+}
+
+static int is_ascii(const unsigned char *s, size_t len)
+{
+    size_t i = 0;
+    uint64_t word;
+
+    for (; i + sizeof(word) <= len; i += sizeof(word)) {
+        memcpy(&word, s + i, sizeof(word));
+        if (word & 0x8080808080808080ULL) {
+            return FLB_FALSE;
+        }
+    }
+    for (; i < len; i++) {
+        if (s[i] & 0x80) {
+            return FLB_FALSE;
+        }
+    }
+
+    return FLB_TRUE;
+}
+
+/*
+ * Search the first match in 'str', same as onig_search() does for the
+ * patterns accepted by flb_regex_fast_create(). 'regs' must have room for
+ * (num_groups + 1) * 2 positions.
+ */
+int flb_regex_fast_search(struct flb_regex_fast *prog,
+                          const char *str, size_t len, ptrdiff_t *regs)
+{
+    int i;
+    int ret = FLB_REGEX_FAST_MISMATCH;
+    ptrdiff_t start = 0;
+    const unsigned char *p;
+    const unsigned char *s = (const unsigned char *) str;
+    struct bt_stack st;
+
+    /* multibyte characters are left to Onigmo */
+    if (!is_ascii(s, len)) {
+        return FLB_REGEX_FAST_FALLBACK;
+    }
+
+    for (i = 0; i < (prog->num_groups + 1) * 2; i++) {
+        regs[i] = -1;
+    }
+
+    st.top = 0;
+    st.size = BT_LOCAL_SIZE;
+    st.entries = st.local;
+
+    while (1) {
+        if (prog->anchor && start > 0 && s[start - 1] != '\n') {
+            p = memchr(s + start, '\n', len - start);
+            if (!p) {
+                break;
+            }
+            start = p - s + 1;
+        }
+        else if (prog->first_char >= 0) {
+            p = memchr(s + start, prog->first_char, len - start);
+            if (!p) {
+                break;
+            }
+            start = p - s;
+        }
+
+        ret = match_at(prog, s, len, start, regs, &st);
+        if (ret != FLB_REGEX_FAST_MISMATCH || start >= len) {
+            break;
+        }
+        start++;
+    }
+
+    if (st.entries != st.local) {
+        flb_free(st.entries);
+    }
+
+    return ret;
+}
+
+void flb_regex_fast_destroy(struct flb_regex_fast *prog)
+{
+    int i;
+
+    if (!prog) {
+        return;
+    }
+
+    if (prog->names) {
+        for (i = 0; i < prog->num_groups; i++) {
+            flb_free(prog->names[i].name);
+        }
+        flb_free(prog->names);
+    }
+    flb_free(prog->code);
+    flb_free(prog->sets);
+    flb_free(prog);
+}
+
+/*
+ * Compile a pattern, it returns NULL when the pattern uses something the
+ * engine doesn't support. The pattern must be valid for Onigmo already.
+ */
+struct flb_regex_fast *flb_regex_fast_create(const char *pattern, size_t len)
+{
+    int pc;
+    struct node *root;
+    struct compiler c = {0};
+    struct flb_regex_fast *prog;
+
+    prog = flb_calloc(1, sizeof(struct flb_regex_fast));
+    if (!prog) {
+        flb_errno();
+        return NULL;
+    }
+
+    c.p = pattern;
+    c.end = pattern + len;
+    c.max_nodes = len * 4 + 4;
+    c.nodes = flb_calloc(c.max_nodes, sizeof(struct node));
+    c.max_names = len / 4 + 1;
+    c.names = flb_calloc(c.max_names, sizeof(struct flb_regex_fast_name));
+    if (!c.nodes || !c.names) {
+        flb_errno();
+        goto error;
+    }
+
+    root = parse_alt(&c);
+    if (!root || c.error || c.p != c.end || c.num_groups == 0) {
+        goto error;
+    }
+
+    if (gen(&c, root) == -1 || emit(&c, OP_MATCH, 0, 0) == -1) {
+        goto error;
+    }
+    flb_free(c.nodes);
+
+    prog->num_groups = c.num_groups;
+    prog->names = c.names;
+    prog->code_len = c.code_len;
+    prog->code = c.code;
+    prog->num_sets = c.num_sets;
+    prog->sets = c.sets;
+
+    /* where a match can start */
+    prog->first_char = -1;
+    for (pc = 0; prog->code[pc].op == OP_SAVE; pc++);
+    if (prog->code[pc].op == OP_BOL) {
+        prog->anchor = FLB_TRUE;
+    }
+    else if (prog->code[pc].op == OP_CHAR) {
+        prog->first_char = prog->code[pc].x;
+    }
+
+    return prog;
+
+ error:
+    prog->num_groups = c.num_groups;
+    prog->names = c.names;
+    prog->code = c.code;
+    prog->sets = c.sets;
+    flb_regex_fast_destroy(prog);
+    flb_free(c.nodes);
+    return NULL;
+}
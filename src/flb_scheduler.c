@@ -17,6 +17,33 @@
  *  limitations under the License.
  */
 
+/*
+ * The hierarchical timing wheel (wheel_* helpers) is derived from
+ * timeout.c by William Ahern, https://25thandclement.com/~william/projects/timeout.c.html
+ * distributed under the following license:
+ *
+ * Copyright (c) 2013, 2014  William Ahern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the
+ * following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_coro.h>
@@ -30,6 +57,13 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef MK_HAVE_TIMERFD_CREATE
+#include <unistd.h>
+#include <sys/timerfd.h>
+#endif
 
 FLB_TLS_DEFINE(struct flb_sched, flb_sched_ctx);
 
@@ -108,123 +142,456 @@ static int random_uniform(int min, int max)
 }
 
 
+/* Monotonic clock in milliseconds, it drives the timing wheel */
+static uint64_t sched_now_ms()
+{
+#ifdef _WIN32
+    return (uint64_t) GetTickCount64();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+#endif
+}
+
+/* Index of the most significant bit set plus one, 'x' must not be zero */
+static inline int wheel_fls(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+
+    _BitScanReverse64(&i, x);
+    return (int) i + 1;
+#else
+    return 64 - __builtin_clzll(x);
+#endif
+}
+
+/* Number of trailing zero bits, 'x' must not be zero */
+static inline int wheel_ctz(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+
+    _BitScanForward64(&i, x);
+    return (int) i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+static inline uint64_t wheel_rotl(uint64_t v, int c)
+{
+    if (!(c &= FLB_SCHED_WHEEL_MASK)) {
+        return v;
+    }
+    return (v << c) | (v >> (FLB_SCHED_WHEEL_SLOTS - c));
+}
+
+static inline uint64_t wheel_rotr(uint64_t v, int c)
+{
+    if (!(c &= FLB_SCHED_WHEEL_MASK)) {
+        return v;
+    }
+    return (v >> c) | (v << (FLB_SCHED_WHEEL_SLOTS - c));
+}
+
+static void wheel_init(struct flb_sched_wheel *wheel, uint64_t now)
+{
+    int i;
+    int j;
+
+    wheel->now = now;
+    for (i = 0; i < FLB_SCHED_WHEEL_LEVELS; i++) {
+        wheel->pending[i] = 0;
+        for (j = 0; j < FLB_SCHED_WHEEL_SLOTS; j++) {
+            mk_list_init(&wheel->slots[i][j]);
+        }
+    }
+    mk_list_init(&wheel->expired);
+}
+
+/* Unlink the timer from the wheel, no-op if it's not scheduled */
+static void wheel_del(struct flb_sched_wheel *wheel,
+                      struct flb_sched_timer *timer)
+{
+    int idx;
+    struct mk_list *list;
+
+    list = timer->wheel_list;
+    if (!list) {
+        return;
+    }
+
+    mk_list_del(&timer->_wheel_head);
+    timer->wheel_list = NULL;
+
+    /* clear the slot bit once it becomes empty */
+    idx = list - &wheel->slots[0][0];
+    if (idx >= 0 && idx < FLB_SCHED_WHEEL_LEVELS * FLB_SCHED_WHEEL_SLOTS &&
+        mk_list_is_empty(list) == 0) {
+        wheel->pending[idx / FLB_SCHED_WHEEL_SLOTS] &=
+            ~(UINT64_C(1) << (idx % FLB_SCHED_WHEEL_SLOTS));
+    }
+}
+
+/*
+ * Place the timer in the wheel. The level is chosen by the distance to
+ * the expiration, the slots of the upper levels are shifted by one so
+ * their timers are cascaded down when the lower level wraps around right
+ * before their expiration.
+ */
+static void wheel_add(struct flb_sched_wheel *wheel,
+                      struct flb_sched_timer *timer, uint64_t expires)
+{
+    int level;
+    int slot;
+    uint64_t rem;
+
+    wheel_del(wheel, timer);
+    timer->expires = expires;
+
+    if (expires > wheel->now) {
+        rem = expires - wheel->now;
+        if (rem > FLB_SCHED_WHEEL_MAX) {
+            rem = FLB_SCHED_WHEEL_MAX;
+        }
+        level = (wheel_fls(rem) - 1) / FLB_SCHED_WHEEL_BITS;
+        slot = FLB_SCHED_WHEEL_MASK &
+               ((expires >> (level * FLB_SCHED_WHEEL_BITS)) - !!level);
+
+        timer->wheel_list = &wheel->slots[level][slot];
+        wheel->pending[level] |= UINT64_C(1) << slot;
+    }
+    else {
+        timer->wheel_list = &wheel->expired;
+    }
+    mk_list_add(&timer->_wheel_head, timer->wheel_list);
+}
+
+/*
+ * Move the wheel to 'now': the timers in the slots passed over are
+ * scheduled again, the ones that reached their expiration end up in the
+ * expired list and the others cascade to a lower level.
+ */
+static void wheel_update(struct flb_sched_wheel *wheel, uint64_t now)
+{
+    int level;
+    int slot;
+    int oslot;
+    int nslot;
+    uint64_t elapsed;
+    uint64_t _elapsed;
+    uint64_t pending;
+    struct mk_list todo;
+    struct mk_list *head;
+    struct flb_sched_timer *timer;
+
+    if (now <= wheel->now) {
+        return;
+    }
+
+    elapsed = now - wheel->now;
+    mk_list_init(&todo);
+
+    for (level = 0; level < FLB_SCHED_WHEEL_LEVELS; level++) {
+        if ((elapsed >> (level * FLB_SCHED_WHEEL_BITS)) > FLB_SCHED_WHEEL_MASK) {
+            /* a full turn of this level */
+            pending = ~UINT64_C(0);
+        }
+        else {
+            /* slots from the last processed one to the current one */
+            _elapsed = FLB_SCHED_WHEEL_MASK &
+                       (elapsed >> (level * FLB_SCHED_WHEEL_BITS));
+            oslot = FLB_SCHED_WHEEL_MASK &
+                    (wheel->now >> (level * FLB_SCHED_WHEEL_BITS));
+            nslot = FLB_SCHED_WHEEL_MASK &
+                    (now >> (level * FLB_SCHED_WHEEL_BITS));
+
+            pending = wheel_rotl((UINT64_C(1) << _elapsed) - 1, oslot);
+            pending |= wheel_rotr(wheel_rotl((UINT64_C(1) << _elapsed) - 1,
+                                             nslot), _elapsed);
+            pending |= UINT64_C(1) << nslot;
+        }
+
+        while (pending & wheel->pending[level]) {
+            slot = wheel_ctz(pending & wheel->pending[level]);
+            mk_list_cat(&wheel->slots[level][slot], &todo);
+            mk_list_init(&wheel->slots[level][slot]);
+            wheel->pending[level] &= ~(UINT64_C(1) << slot);
+        }
+
+        /* the upper level only moves when this one wraps around */
+        if (!(pending & 0x1)) {
+            break;
+        }
+
+        if (elapsed < ((uint64_t) FLB_SCHED_WHEEL_SLOTS <<
+                       (level * FLB_SCHED_WHEEL_BITS))) {
+            elapsed = (uint64_t) FLB_SCHED_WHEEL_SLOTS <<
+                      (level * FLB_SCHED_WHEEL_BITS);
+        }
+    }
+
+    wheel->now = now;
+
+    while (mk_list_is_empty(&todo) != 0) {
+        head = todo.next;
+        timer = mk_list_entry(head, struct flb_sched_timer, _wheel_head);
+        mk_list_del(head);
+        timer->wheel_list = NULL;
+        wheel_add(wheel, timer, timer->expires);
+    }
+}
+
 /*
- * Schedule a request that will be processed within the next
- * FLB_SCHED_REQUEST_FRAME seconds.
+ * Milliseconds until the wheel needs to be updated again: the closest
+ * expiration in the first level or the closest cascade of an upper one.
+ * Returns UINT64_MAX if the wheel is empty.
  */
-static int schedule_request_now(int seconds,
-                                struct flb_sched_timer *timer,
-                                struct flb_sched_request *request,
-                                struct flb_config *config)
+static uint64_t wheel_next(struct flb_sched_wheel *wheel)
+{
+    int level;
+    int slot;
+    uint64_t timeout = UINT64_MAX;
+    uint64_t _timeout;
+    uint64_t relmask = 0;
+
+    if (mk_list_is_empty(&wheel->expired) != 0) {
+        return 0;
+    }
+
+    for (level = 0; level < FLB_SCHED_WHEEL_LEVELS; level++) {
+        if (wheel->pending[level]) {
+            slot = FLB_SCHED_WHEEL_MASK &
+                   (wheel->now >> (level * FLB_SCHED_WHEEL_BITS));
+            _timeout = (uint64_t) (wheel_ctz(wheel_rotr(wheel->pending[level],
+                                                        slot)) + !!level)
+                       << (level * FLB_SCHED_WHEEL_BITS);
+            _timeout -= relmask & wheel->now;
+            if (_timeout < timeout) {
+                timeout = _timeout;
+            }
+        }
+        relmask <<= FLB_SCHED_WHEEL_BITS;
+        relmask |= FLB_SCHED_WHEEL_MASK;
+    }
+
+    return timeout;
+}
+
+/* Arm the frame timer (the only OS timer) to expire at tick 'expires' */
+static int frame_arm(struct flb_sched *sched, uint64_t expires)
 {
-    flb_pipefd_t fd;
+    uint64_t now;
+    uint64_t ms;
     struct mk_event *event;
-    struct flb_sched *sched = config->sched;
+#ifdef MK_HAVE_TIMERFD_CREATE
+    int ret;
+    struct itimerspec its;
+#endif
+
+    /* already armed for an earlier expiration */
+    if (sched->frame_expires != 0 && sched->frame_expires <= expires) {
+        return 0;
+    }
+
+    now = sched_now_ms();
+    ms = (expires > now) ? expires - now : 0;
+    event = &sched->frame->event;
+
+#ifdef MK_HAVE_TIMERFD_CREATE
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (ms % 1000) * 1000000;
+    if (ms == 0) {
+        /* a zero value disarms the timer */
+        its.it_value.tv_nsec = 1;
+    }
+
+    ret = timerfd_settime(event->fd, 0, &its, NULL);
+    if (ret == -1) {
+        flb_errno();
+        return -1;
+    }
+#else
+    /* no re-armable timer on this platform, create a new timeout */
+    if (MK_EVENT_IS_REGISTERED(event)) {
+        mk_event_timeout_destroy(sched->evl, event);
+    }
+
+    event->mask   = MK_EVENT_EMPTY;
+    event->status = MK_EVENT_NONE;
+    if (mk_event_timeout_create(sched->evl, ms / 1000,
+                                (ms % 1000) * 1000000, event) == -1) {
+        flb_error("[sched] cannot do timeout_create()");
+        return -1;
+    }
+    event->type = FLB_ENGINE_EV_SCHED_FRAME;
+    event->priority = FLB_ENGINE_PRIORITY_CB_SCHED;
+#endif
+
+    sched->frame_expires = expires;
+    return 0;
+}
+
+/* Create the frame timer, it's registered in the event loop unarmed */
+static int frame_create(struct flb_sched *sched)
+{
+    struct mk_event *event;
+    struct flb_sched_timer *timer;
+#ifdef MK_HAVE_TIMERFD_CREATE
+    int fd;
+    int ret;
+#endif
+
+    timer = flb_sched_timer_create(sched);
+    if (!timer) {
+        return -1;
+    }
+
+    timer->type = FLB_SCHED_TIMER_FRAME;
+    timer->data = sched;
 
     /* Initialize event */
     event = &timer->event;
     event->mask   = MK_EVENT_EMPTY;
     event->status = MK_EVENT_NONE;
 
-    /* Create a timeout into the main event loop */
-    fd = mk_event_timeout_create(config->evl, seconds, 0, event);
-    event->priority = FLB_ENGINE_PRIORITY_CB_SCHED;
+#ifdef MK_HAVE_TIMERFD_CREATE
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
     if (fd == -1) {
+        flb_errno();
+        flb_sched_timer_destroy(timer);
         return -1;
     }
-    request->fd = fd;
-    timer->timer_fd = fd;
 
-    /*
-     * Note: mk_event_timeout_create() sets a type = MK_EVENT_NOTIFICATION by
-     * default, we need to overwrite this value so we can do a clean check
-     * into the Engine when the event is triggered.
-     */
-    event->type = FLB_ENGINE_EV_SCHED;
-    mk_list_add(&request->_head, &sched->requests);
+    ret = mk_event_add(sched->evl, fd, FLB_ENGINE_EV_SCHED_FRAME,
+                       MK_EVENT_READ, event);
+    if (ret == -1) {
+        close(fd);
+        flb_sched_timer_destroy(timer);
+        return -1;
+    }
+    event->priority = FLB_ENGINE_PRIORITY_CB_SCHED;
+#endif
+
+    sched->frame = timer;
+    sched->frame_expires = 0;
 
     return 0;
 }
 
-/*
- * Enqueue a request that will wait until it expected timeout reach the
- * FLB_SCHED_REQUEST_FRAME interval.
- */
-static int schedule_request_wait(struct flb_sched_request *request,
-                                 struct flb_config *config)
+static void frame_destroy(struct flb_sched *sched)
 {
-    struct flb_sched *sched = config->sched;
+    struct mk_event *event;
 
-    mk_list_add(&request->_head, &sched->requests_wait);
-    return 0;
+    if (!sched->frame) {
+        return;
+    }
+
+    event = &sched->frame->event;
+    if (MK_EVENT_IS_REGISTERED(event)) {
+        mk_event_timeout_destroy(sched->evl, event);
+    }
+
+    mk_list_del(&sched->frame->_head);
+    flb_free(sched->frame);
+    sched->frame = NULL;
 }
 
-/*
- * Iterate requests_wait list looking for candidates to be promoted
- * to the 'requests' list.
- */
-static int schedule_request_promote(struct flb_sched *sched)
+/* Put the timer in the wheel, it expires after 'ms' milliseconds */
+static int sched_timer_add(struct flb_sched *sched,
+                           struct flb_sched_timer *timer, uint64_t ms)
+{
+    uint64_t expires;
+
+    expires = sched_now_ms() + ms;
+    wheel_add(&sched->wheel, timer, expires);
+
+    return frame_arm(sched, expires);
+}
+
+/* Run the expired timers, called when the frame timer fires */
+static void sched_wheel_run(struct flb_sched *sched)
 {
     int ret;
-    int next;
-    int passed;
-    time_t now;
-    struct mk_list *tmp;
+    uint64_t now;
+    uint64_t next;
+    struct mk_list todo;
     struct mk_list *head;
-    struct mk_list failed_requests;
-    struct flb_sched_request *request;
+    struct flb_sched_timer *timer;
+    struct flb_sched_request *req;
+    struct flb_config *config = sched->config;
 
-    now = time(NULL);
-    mk_list_init(&failed_requests);
+    sched->frame_expires = 0;
 
-    mk_list_foreach_safe(head, tmp, &sched->requests_wait) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
+    now = sched_now_ms();
+    wheel_update(&sched->wheel, now);
 
-        /* First check how many seconds have passed since the request creation */
-        passed = (now - request->created);
-        ret = 0;
+    /*
+     * Callbacks can create and destroy timers, the expired ones are moved to
+     * a private list: timers destroyed meanwhile just leave it and the new
+     * ones wait for the next round.
+     */
+    mk_list_init(&todo);
+    if (mk_list_is_empty(&sched->wheel.expired) != 0) {
+        mk_list_cat(&sched->wheel.expired, &todo);
+        mk_list_init(&sched->wheel.expired);
+    }
+    mk_list_foreach(head, &todo) {
+        timer = mk_list_entry(head, struct flb_sched_timer, _wheel_head);
+        timer->wheel_list = &todo;
+    }
 
-        /* If we passed the original time, schedule now for the next second */
-        if (passed > request->timeout) {
-            mk_list_del(&request->_head);
-            ret = schedule_request_now(1, request->timer, request, sched->config);
-            if (ret != 0) {
-                mk_list_add(&request->_head, &failed_requests);
-            }
+    while (mk_list_is_empty(&todo) != 0) {
+        timer = mk_list_entry_first(&todo, struct flb_sched_timer, _wheel_head);
+        mk_list_del(&timer->_wheel_head);
+        timer->wheel_list = NULL;
+
+        if (timer->active == FLB_FALSE) {
+            continue;
         }
-        else if (passed + FLB_SCHED_REQUEST_FRAME >= request->timeout) {
-            /* Check if we should schedule within this frame */
-            mk_list_del(&request->_head);
-            next = labs(passed - request->timeout);
-            ret = schedule_request_now(next, request->timer, request, sched->config);
-            if (ret != 0) {
-                mk_list_add(&request->_head, &failed_requests);
+
+        if (timer->type == FLB_SCHED_TIMER_REQUEST) {
+            /* Map request struct */
+            req = timer->data;
+
+            /* Dispatch 'retry' */
+            ret = flb_engine_dispatch_retry(req->data, config);
+
+            /* Destroy this scheduled request, it's not longer required */
+            if (ret == 0) {
+                flb_sched_request_destroy(req);
             }
         }
-        else {
-            continue;
+        else if (timer->type == FLB_SCHED_TIMER_CB_ONESHOT) {
+            timer->cb(config, timer->data);
+            flb_sched_timer_cb_destroy(timer);
         }
-
-        /*
-         * If the 'request' could not be scheduled, this could only happen due to memory
-         * exhaustion or running out of file descriptors. There is no much we can do
-         * at this time.
-         */
-        if (ret == -1) {
-            flb_error("[sched] a 'retry request' could not be scheduled. the "
-                      "system might be running out of memory or file "
-                      "descriptors. The scheduler will do a retry later.");
+        else if (timer->type == FLB_SCHED_TIMER_CB_PERM) {
+            /* next period, skipping the ones already missed */
+            timer->expires += timer->interval;
+            if (timer->expires <= now) {
+                timer->expires = now + timer->interval;
+            }
+            wheel_add(&sched->wheel, timer, timer->expires);
+            timer->cb(config, timer->data);
         }
     }
 
-    /* For each failed request, re-add them to the wait list */
-    mk_list_foreach_safe(head, tmp, &failed_requests) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
-        mk_list_del(&request->_head);
-        mk_list_add(&request->_head, &sched->requests_wait);
+    next = wheel_next(&sched->wheel);
+    if (next != UINT64_MAX) {
+        frame_arm(sched, sched->wheel.now + next);
     }
-
-    return 0;
+#ifndef MK_HAVE_TIMERFD_CREATE
+    else if (sched->frame_expires == 0 &&
+             MK_EVENT_IS_REGISTERED(&sched->frame->event)) {
+        /* nothing scheduled, stop the periodic timeout */
+        mk_event_timeout_destroy(sched->evl, &sched->frame->event);
+    }
+#endif
 }
 
 static double ipow(double base, int exp)
@@ -266,11 +633,12 @@ int flb_sched_request_create(struct flb_config *config, void *data, int tries)
 {
     int ret;
     int seconds;
+    struct flb_sched *sched = config->sched;
     struct flb_sched_timer *timer;
     struct flb_sched_request *request;
 
     /* Allocate timer context */
-    timer = flb_sched_timer_create(config->sched);
+    timer = flb_sched_timer_create(sched);
     if (!timer) {
         return -1;
     }
@@ -279,13 +647,13 @@ int flb_sched_request_create(struct flb_config *config, void *data, int tries)
     request = flb_malloc(sizeof(struct flb_sched_request));
     if (!request) {
         flb_errno();
+        flb_sched_timer_destroy(timer);
         return -1;
     }
 
     /* Link timer references */
     timer->type = FLB_SCHED_TIMER_REQUEST;
     timer->data = request;
-    timer->event.mask = MK_EVENT_EMPTY;
 
     /* Get suggested wait_time for this request. If shutting down, set to 0. */
     if (config->is_shutting_down) {
@@ -297,26 +665,21 @@ int flb_sched_request_create(struct flb_config *config, void *data, int tries)
     seconds += 1;
 
     /* Populare request */
-    request->fd      = -1;
     request->created = time(NULL);
     request->timeout = seconds;
     request->data    = data;
     request->timer   = timer;
+    mk_list_add(&request->_head, &sched->requests);
 
-    /* Request to be placed into the sched_requests_wait list */
-    if (seconds > FLB_SCHED_REQUEST_FRAME) {
-        schedule_request_wait(request, config);
-    }
-    else {
-        ret = schedule_request_now(seconds, timer, request, config);
-        if (ret == -1) {
-            flb_error("[sched]  'retry request' could not be created. the "
-                      "system might be running out of memory or file "
-                      "descriptors.");
-            flb_sched_timer_destroy(timer);
-            flb_free(request);
-            return -1;
-        }
+    ret = sched_timer_add(sched, timer, (uint64_t) seconds * 1000);
+    if (ret == -1) {
+        flb_error("[sched]  'retry request' could not be created. the "
+                  "system might be running out of memory or file "
+                  "descriptors.");
+        mk_list_del(&request->_head);
+        flb_sched_timer_destroy(timer);
+        flb_free(request);
+        return -1;
     }
 
     return seconds;
@@ -355,25 +718,16 @@ int flb_sched_request_invalidate(struct flb_config *config, void *data)
     struct flb_sched_request *request;
     struct flb_sched *sched;
 
-    sched = config->sched;
-    mk_list_foreach_safe(head, tmp, &sched->requests) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
-        if (request->data == data) {
-            flb_sched_request_destroy(request);
-            return 0;
-        }
-    }
-
     /*
-     *  Clean up retry tasks that are scheduled more than 60s.
-     *  Task might be destroyed when there are still retry
-     *  scheduled but no thread is running for the task.
+     * Task might be destroyed when there are still retry scheduled but
+     * no thread is running for the task.
      *
-     *  We need to drop buffered chunks when the filesystem buffer
-     *  limit is reached. We need to make sure that all requests
-     *  should be destroyed to avoid invoke an invlidated request.
+     * We need to drop buffered chunks when the filesystem buffer
+     * limit is reached. We need to make sure that all requests
+     * should be destroyed to avoid invoke an invlidated request.
      */
-    mk_list_foreach_safe(head, tmp, &sched->requests_wait) {
+    sched = config->sched;
+    mk_list_foreach_safe(head, tmp, &sched->requests) {
         request = mk_list_entry(head, struct flb_sched_request, _head);
         if (request->data == data) {
             flb_sched_request_destroy(request);
@@ -384,49 +738,34 @@ int flb_sched_request_invalidate(struct flb_config *config, void *data)
     return -1;
 }
 
-/* Handle a timeout event set by a previous flb_sched_request_create(...) */
+/* Handle a timeout event of the scheduler frame timer */
 int flb_sched_event_handler(struct flb_config *config, struct mk_event *event)
 {
-    int ret;
-    struct flb_sched *sched;
     struct flb_sched_timer *timer;
-    struct flb_sched_request *req;
+#ifdef MK_HAVE_TIMERFD_CREATE
+    int ret;
+    uint64_t val;
+#endif
 
     timer = (struct flb_sched_timer *) event;
-    if (timer->active == FLB_FALSE) {
+    if (timer->active == FLB_FALSE || timer->type != FLB_SCHED_TIMER_FRAME) {
         return 0;
     }
 
-    if (timer->type == FLB_SCHED_TIMER_REQUEST) {
-        /* Map request struct */
-        req = timer->data;
-        consume_byte(req->fd);
-
-        /* Dispatch 'retry' */
-        ret = flb_engine_dispatch_retry(req->data, config);
-
-        /* Destroy this scheduled request, it's not longer required */
-        if (ret == 0) {
-            flb_sched_request_destroy(req);
-        }
+#ifdef MK_HAVE_TIMERFD_CREATE
+    /*
+     * The timer is non-blocking: re-arming it from a handler that ran
+     * earlier in this loop round resets the expiration counter.
+     */
+    ret = read(event->fd, &val, sizeof(val));
+    if (ret == -1 && errno != EAGAIN) {
+        flb_errno();
     }
-    else if (timer->type == FLB_SCHED_TIMER_FRAME) {
-        sched = timer->data;
-#ifndef __APPLE__
-        consume_byte(sched->frame_fd);
+#elif !defined(__APPLE__)
+    consume_byte(event->fd);
 #endif
-        schedule_request_promote(sched);
-    }
-    else if (timer->type == FLB_SCHED_TIMER_CB_ONESHOT) {
-        consume_byte(timer->timer_fd);
-        flb_sched_timer_cb_disable(timer);
-        timer->cb(config, timer->data);
-        flb_sched_timer_cb_destroy(timer);
-    }
-    else if (timer->type == FLB_SCHED_TIMER_CB_PERM) {
-        consume_byte(timer->timer_fd);
-        timer->cb(config, timer->data);
-    }
+
+    sched_wheel_run(timer->data);
 
     return 0;
 }
@@ -442,10 +781,7 @@ int flb_sched_timer_cb_create(struct flb_sched *sched, int type, int ms,
                               void (*cb)(struct flb_config *, void *),
                               void *data, struct flb_sched_timer **out_timer)
 {
-    int fd;
-    time_t sec;
-    long nsec;
-    struct mk_event *event;
+    int ret;
     struct flb_sched_timer *timer;
 
     if (type != FLB_SCHED_TIMER_CB_ONESHOT && type != FLB_SCHED_TIMER_CB_PERM) {
@@ -453,6 +789,11 @@ int flb_sched_timer_cb_create(struct flb_sched *sched, int type, int ms,
         return -1;
     }
 
+    if (ms < 0) {
+        flb_error("[sched] invalid timer interval %i", ms);
+        return -1;
+    }
+
     timer = flb_sched_timer_create(sched);
     if (!timer) {
         return -1;
@@ -462,32 +803,16 @@ int flb_sched_timer_cb_create(struct flb_sched *sched, int type, int ms,
     timer->data = data;
     timer->cb   = cb;
 
-    /* Initialize event */
-    event = &timer->event;
-    event->mask   = MK_EVENT_EMPTY;
-    event->status = MK_EVENT_NONE;
-
-    /* Convert from milliseconds to seconds and nanoseconds */
-    sec = (ms / 1000);
-    nsec = ((ms % 1000) * 1000000);
+    /* a permanent timer with no interval would run on every round */
+    timer->interval = (ms > 0) ? ms : 1;
 
-    /* Create the frame timer */
-    fd = mk_event_timeout_create(sched->evl, sec, nsec, event);
-    event->priority = FLB_ENGINE_PRIORITY_CB_TIMER;
-    if (fd == -1) {
-        flb_error("[sched] cannot do timeout_create()");
+    ret = sched_timer_add(sched, timer, ms);
+    if (ret == -1) {
+        flb_error("[sched] cannot schedule timer");
         flb_sched_timer_destroy(timer);
         return -1;
     }
 
-    /*
-     * Note: mk_event_timeout_create() sets a type = MK_EVENT_NOTIFICATION by
-     * default, we need to overwrite this value so we can do a clean check
-     * into the Engine when the event is triggered.
-     */
-    event->type = FLB_ENGINE_EV_SCHED;
-    timer->timer_fd = fd;
-
     if (out_timer != NULL) {
         *out_timer = timer;
     }
@@ -498,11 +823,7 @@ int flb_sched_timer_cb_create(struct flb_sched *sched, int type, int ms,
 /* Disable notifications, used before to destroy the context */
 int flb_sched_timer_cb_disable(struct flb_sched_timer *timer)
 {
-    if (timer->timer_fd != -1) {
-        mk_event_timeout_destroy(timer->sched->evl, &timer->event);
-
-        timer->timer_fd = -1;
-    }
+    wheel_del(&timer->sched->wheel, timer);
 
     return 0;
 }
@@ -518,10 +839,8 @@ int flb_sched_timer_cb_destroy(struct flb_sched_timer *timer)
 struct flb_sched *flb_sched_create(struct flb_config *config,
                                    struct mk_event_loop *evl)
 {
-    flb_pipefd_t fd;
-    struct mk_event *event;
+    int ret;
     struct flb_sched *sched;
-    struct flb_sched_timer *timer;
 
     sched = flb_malloc(sizeof(struct flb_sched));
     if (!sched) {
@@ -531,45 +850,21 @@ struct flb_sched *flb_sched_create(struct flb_config *config,
 
     sched->config = config;
     sched->evl = evl;
+    sched->frame = NULL;
 
     /* Initialize lists */
     mk_list_init(&sched->requests);
-    mk_list_init(&sched->requests_wait);
     mk_list_init(&sched->timers);
     mk_list_init(&sched->timers_drop);
 
-    /* Create the frame timer who enqueue 'requests' for future time */
-    timer = flb_sched_timer_create(sched);
-    if (!timer) {
-        flb_free(sched);
-        return NULL;
-    }
-
-    timer->type = FLB_SCHED_TIMER_FRAME;
-    timer->data = sched;
+    /* Timing wheel and the frame timer that drives it */
+    wheel_init(&sched->wheel, sched_now_ms());
 
-    /* Initialize event */
-    event = &timer->event;
-    event->mask   = MK_EVENT_EMPTY;
-    event->status = MK_EVENT_NONE;
-
-    /* Create the frame timer */
-    fd = mk_event_timeout_create(evl, FLB_SCHED_REQUEST_FRAME, 0,
-                                 event);
-    event->priority = FLB_ENGINE_PRIORITY_CB_SCHED;
-    if (fd == -1) {
-        flb_sched_timer_destroy(timer);
+    ret = frame_create(sched);
+    if (ret == -1) {
         flb_free(sched);
         return NULL;
     }
-    sched->frame_fd = fd;
-
-    /*
-     * Note: mk_event_timeout_create() sets a type = MK_EVENT_NOTIFICATION by
-     * default, we need to overwrite this value so we can do a clean check
-     * into the Engine when the event is triggered.
-     */
-    event->type = FLB_ENGINE_EV_SCHED_FRAME;
 
     return sched;
 }
@@ -593,12 +888,8 @@ int flb_sched_destroy(struct flb_sched *sched)
         c++; /* evil counter */
     }
 
-    /* Delete requests on wait list */
-    mk_list_foreach_safe(head, tmp, &sched->requests_wait) {
-        request = mk_list_entry(head, struct flb_sched_request, _head);
-        flb_sched_request_destroy(request);
-        c++; /* evil counter */
-    }
+    /* Delete the frame timer */
+    frame_destroy(sched);
 
     /* Delete timers */
     mk_list_foreach_safe(head, tmp, &sched->timers) {
@@ -631,10 +922,10 @@ struct flb_sched_timer *flb_sched_timer_create(struct flb_sched *sched)
     }
     MK_EVENT_ZERO(&timer->event);
 
-    timer->timer_fd = -1;
     timer->config = sched->config;
     timer->sched = sched;
     timer->data = NULL;
+    timer->wheel_list = NULL;
 
     /* Active timer (not invalidated) */
     timer->active = FLB_TRUE;
@@ -685,11 +976,12 @@ int flb_sched_retry_now(struct flb_config *config,
                         struct flb_task_retry *retry)
 {
     int ret;
+    struct flb_sched *sched = config->sched;
     struct flb_sched_timer *timer;
     struct flb_sched_request *request;
 
     /* Allocate timer context */
-    timer = flb_sched_timer_create(config->sched);
+    timer = flb_sched_timer_create(sched);
     if (!timer) {
         return -1;
     }
@@ -705,20 +997,20 @@ int flb_sched_retry_now(struct flb_config *config,
     /* Link timer references */
     timer->type = FLB_SCHED_TIMER_REQUEST;
     timer->data = request;
-    timer->event.mask = MK_EVENT_EMPTY;
 
     /* Populate request */
-    request->fd      = -1;
     request->created = time(NULL);
     request->timeout = 0;
     request->data    = retry;
     request->timer   = timer;
+    mk_list_add(&request->_head, &sched->requests);
 
-    ret = schedule_request_now(0 /* seconds */, timer, request, config);
+    ret = sched_timer_add(sched, timer, 0);
     if (ret == -1) {
         flb_error("[sched] 'retry-now request' could not be created. the "
                   "system might be running out of memory or file "
                   "descirptors.");
+        mk_list_del(&request->_head);
         flb_sched_timer_destroy(timer);
         flb_free(request);
         return -1;
@@ -24,6 +24,11 @@
 #include <fluent-bit/flb_scheduler.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_http_server.h>
+#include <fluent-bit/flb_compression.h>
+
+#ifdef FLB_HAVE_ZSTD
+#include <fluent-bit/flb_zstd.h>
+#endif
 
 static struct cmt *metrics_context_create(struct flb_storage_metrics *sm)
 {
@@ -472,6 +477,17 @@ static void print_storage_info(struct flb_config *ctx, struct cio_ctx *cio)
     flb_info("[storage] ver=%s, type=%s, sync=%s, checksum=%s, max_chunks_up=%i",
              cio_version(), type, sync, checksum, ctx->storage_max_chunks_up);
 
+    if (cio->options.flags & CIO_GROUP_COMMIT) {
+        flb_info("[storage] group commit window=%ims", ctx->storage_sync_window);
+    }
+
+    if (cio->options.compress_type > 0) {
+        flb_info("[storage] compression=%s, dictionary=%s",
+                 flb_compression_get_name(cio->options.compress_type),
+                 ctx->storage_compression_dict ?
+                 ctx->storage_compression_dict : "none");
+    }
+
     /* Storage input plugin */
     if (ctx->storage_input_plugin) {
         in = (struct flb_input_instance *) ctx->storage_input_plugin;
@@ -591,10 +607,107 @@ static int storage_contexts_create(struct flb_config *config)
     return c;
 }
 
+#ifdef FLB_HAVE_ZSTD
+/*
+ * Chunk I/O callbacks: the content of the locked chunks is compressed when
+ * they are set down and restored when they are brought up again.
+ */
+static size_t storage_compress(void *data, int type,
+                               const void *src, size_t src_size,
+                               void *dst, size_t dst_size)
+{
+    ssize_t ret;
+
+    if (type != FLB_COMPRESSION_ALGORITHM_ZSTD) {
+        return 0;
+    }
+
+    ret = flb_zstd_compress_buffer(data, src, src_size, dst, dst_size);
+    if (ret <= 0) {
+        return 0;
+    }
+
+    return ret;
+}
+
+static int storage_uncompress(void *data, int type,
+                              const void *src, size_t src_size,
+                              void *dst, size_t dst_size)
+{
+    ssize_t ret;
+
+    if (type != FLB_COMPRESSION_ALGORITHM_ZSTD) {
+        flb_error("[storage] unknown chunk compression type %i", type);
+        return -1;
+    }
+
+    ret = flb_zstd_uncompress_buffer(data, src, src_size, dst, dst_size);
+    if (ret != dst_size) {
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+/* Setup the compression of the chunks that are down */
+static int storage_compression_init(struct flb_config *ctx,
+                                    struct cio_options *opts)
+{
+    int type = FLB_COMPRESSION_ALGORITHM_NONE;
+
+    if (ctx->storage_compression) {
+        type = flb_compression_get_algorithm(ctx->storage_compression);
+        if (type != FLB_COMPRESSION_ALGORITHM_NONE &&
+            type != FLB_COMPRESSION_ALGORITHM_ZSTD) {
+            flb_error("[storage] invalid compression '%s'",
+                      ctx->storage_compression);
+            return -1;
+        }
+    }
+
+#ifdef FLB_HAVE_ZSTD
+    if (ctx->storage_compression_dict) {
+        ctx->storage_dict = flb_zstd_dict_load(ctx->storage_compression_dict,
+                                               FLB_ZSTD_DEFAULT_LEVEL);
+        if (!ctx->storage_dict) {
+            return -1;
+        }
+    }
+
+    /* chunks compressed by a previous run can always be loaded */
+    opts->uncompress = storage_uncompress;
+    opts->compress_data = ctx->storage_dict;
+
+    if (type == FLB_COMPRESSION_ALGORITHM_ZSTD) {
+        opts->compress = storage_compress;
+        opts->compress_type = type;
+    }
+#else
+    if (type != FLB_COMPRESSION_ALGORITHM_NONE) {
+        flb_error("[storage] zstd compression is not supported by this build");
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+static void storage_compression_exit(struct flb_config *ctx)
+{
+#ifdef FLB_HAVE_ZSTD
+    if (ctx->storage_dict) {
+        flb_zstd_dict_destroy(ctx->storage_dict);
+        ctx->storage_dict = NULL;
+    }
+#endif
+}
+
 int flb_storage_create(struct flb_config *ctx)
 {
     int ret;
     int flags;
+    int64_t prealloc;
     struct flb_input_instance *in = NULL;
     struct cio_ctx *cio;
     struct cio_options opts = {0};
@@ -616,21 +729,48 @@ int flb_storage_create(struct flb_config *ctx)
         }
     }
 
+    /* group commit for full syncs */
+    if (ctx->storage_sync_window < 0) {
+        flb_error("[storage] invalid sync window %i",
+                  ctx->storage_sync_window);
+        return -1;
+    }
+    else if (ctx->storage_sync_window > 0 && (flags & CIO_FULL_SYNC)) {
+        flags |= CIO_GROUP_COMMIT;
+    }
+
     /* checksum */
     if (ctx->storage_checksum == FLB_TRUE) {
         flags |= CIO_CHECKSUM;
     }
 
+    /* file chunks growth step */
+    if (ctx->storage_prealloc_size) {
+        prealloc = flb_utils_size_to_bytes(ctx->storage_prealloc_size);
+        if (prealloc <= 0) {
+            flb_error("[storage] invalid prealloc size '%s'",
+                      ctx->storage_prealloc_size);
+            return -1;
+        }
+        opts.realloc_size_hint = prealloc;
+    }
+
     /* chunkio options */
     opts.root_path = ctx->storage_path;
     opts.flags = flags;
     opts.log_cb = log_cb;
     opts.log_level = CIO_LOG_INFO;
 
+    /* compression of the chunks that are down */
+    if (storage_compression_init(ctx, &opts) == -1) {
+        return -1;
+    }
+
     /* Create chunkio context */
     cio = cio_create(&opts);
     if (!cio) {
         flb_error("[storage] error initializing storage engine");
+        storage_compression_exit(ctx);
         return -1;
     }
     ctx->cio = cio;
@@ -686,6 +826,25 @@ int flb_storage_create(struct flb_config *ctx)
     return 0;
 }
 
+/*
+ * Timer callback: flush to disk the chunks synced during the last group
+ * commit window.
+ */
+void flb_storage_sync_commit(struct flb_config *ctx, void *data)
+{
+    int ret;
+    (void) data;
+
+    if (!ctx->cio) {
+        return;
+    }
+
+    ret = cio_sync_commit(ctx->cio);
+    if (ret == -1) {
+        flb_error("[storage] group commit failed, it will be retried");
+    }
+}
+
 void flb_storage_destroy(struct flb_config *ctx)
 {
     struct cio_ctx *cio;
@@ -695,6 +854,7 @@ void flb_storage_destroy(struct flb_config *ctx)
     cio = (struct cio_ctx *) ctx->cio;
 
     if (!cio) {
+        storage_compression_exit(ctx);
         return;
     }
 
@@ -707,4 +867,6 @@ void flb_storage_destroy(struct flb_config *ctx)
 
     cio_destroy(cio);
     ctx->cio = NULL;
+
+    storage_compression_exit(ctx);
 }
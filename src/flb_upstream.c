@@ -25,6 +25,7 @@
 #include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_upstream.h>
 #include <fluent-bit/flb_io.h>
+#include <fluent-bit/flb_http2_client.h>
 #include <fluent-bit/tls/flb_tls.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_engine.h>
@@ -98,6 +99,14 @@ struct flb_config_map upstream_net[] = {
      "before it is retired."
     },
 
+    {
+     FLB_CONFIG_MAP_BOOL, "net.http2", "false",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, http2),
+     "Send HTTP requests over HTTP/2 when the server supports it: negotiated "
+     "with ALPN on TLS connections, or assumed on plain connections. The "
+     "requests are multiplexed as streams of a shared connection"
+    },
+
     /* EOF */
     {0}
 };
@@ -485,6 +494,11 @@ static int destroy_conn(struct flb_connection *u_conn)
         return 0;
     }
 
+    if (u_conn->http2_session) {
+        flb_http2_session_destroy(u_conn->http2_session);
+        u_conn->http2_session = NULL;
+    }
+
     mk_list_del(&u_conn->_head);
 
     flb_connection_destroy(u_conn);
@@ -626,6 +640,32 @@ struct flb_connection *flb_upstream_conn_get(struct flb_upstream *u)
 
     conn = NULL;
 
+    /*
+     * HTTP/2 connections in use can take more streams, share them before
+     * looking for an idle connection.
+     */
+    if (u->base.net.http2) {
+        flb_stream_acquire_lock(&u->base, FLB_TRUE);
+        mk_list_foreach(head, &uq->busy_queue) {
+            conn = mk_list_entry(head, struct flb_connection, _head);
+            if (conn->http2_session != NULL &&
+                flb_http2_session_acquire(conn->http2_session) == 0) {
+                break;
+            }
+            conn = NULL;
+        }
+        flb_stream_release_lock(&u->base);
+
+        if (conn != NULL) {
+            conn->ts_assigned = time(NULL);
+            flb_debug("[upstream] HTTP/2 connection #%i to %s:%i has been "
+                      "assigned (shared)",
+                      conn->fd, u->tcp_host, u->tcp_port);
+            flb_connection_reset_io_timeout(conn);
+            return conn;
+        }
+    }
+
     /*
      * If we are in keepalive mode, iterate list of available connections,
      * take a little of time to do some cleanup and assign a connection. If no
@@ -657,6 +697,16 @@ struct flb_connection *flb_upstream_conn_get(struct flb_upstream *u)
                 continue;
             }
 
+            if (conn->http2_session != NULL &&
+                flb_http2_session_acquire(conn->http2_session) == -1) {
+                flb_debug("[upstream] KA connection #%i to %s:%i HTTP/2 "
+                          "session is closed, cleaning up",
+                          conn->fd, u->tcp_host, u->tcp_port);
+                prepare_destroy_conn_safe(conn);
+                conn = NULL;
+                continue;
+            }
+
             /* Connect timeout */
             conn->ts_assigned = time(NULL);
             flb_debug("[upstream] KA connection #%i to %s:%i has been assigned (recycled)",
@@ -713,6 +763,12 @@ int flb_upstream_conn_release(struct flb_connection *conn)
 
     uq = flb_upstream_queue_get(u);
 
+    /* An HTTP/2 connection stays busy while other streams use it */
+    if (conn->http2_session != NULL &&
+        flb_http2_session_release(conn->http2_session) > 0) {
+        return 0;
+    }
+
     /* If this is a valid KA connection just recycle */
     if (u->base.net.keepalive == FLB_TRUE &&
         conn->recycle == FLB_TRUE &&
@@ -628,6 +628,29 @@ static inline void encoded_to_buf(char *out, const char *in, int len)
     }
 }
 
+/*
+ * Lookup table of the bytes that can be copied as-is into a JSON string:
+ * printable ASCII characters except the double quote and the backslash.
+ */
+static const char json_plain_char[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
 /*
  * Write string pointed by 'str' to the destination buffer 'buf'. It's make sure
  * to escape sepecial characters and convert utf-8 byte characters to string
@@ -639,6 +662,7 @@ int flb_utils_write_str(char *buf, int *off, size_t size,
     int i;
     int b;
     int ret;
+    int run;
     int written = 0;
     int required;
     int len;
@@ -662,6 +686,27 @@ int flb_utils_write_str(char *buf, int *off, size_t size,
 
     p = buf + *off;
     for (i = 0; i < str_len; i++) {
+        /* copy in one step the run of bytes that do not need escaping */
+        run = i;
+        while (run < str_len && json_plain_char[(unsigned char) str[run]]) {
+            run++;
+        }
+
+        if (run > i) {
+            len = run - i;
+            if ((available - written) < len + 1) {
+                return FLB_FALSE;
+            }
+            memcpy(p, str + i, len);
+            p += len;
+            written = (p - (buf + *off));
+
+            i = run;
+            if (i >= str_len) {
+                break;
+            }
+        }
+
         if ((available - written) < 2) {
             return FLB_FALSE;
         }
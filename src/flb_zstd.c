@@ -0,0 +1,361 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_file.h>
+#include <fluent-bit/flb_zstd.h>
+
+#include <zstd.h>
+
+/* Limit decompressed length to 100MB, same as gzip */
+#define FLB_ZSTD_MAX_UNCOMPRESSED_SIZE   100000000
+
+static int zstd_compress(ZSTD_CDict *cdict, int level,
+                         void *in_data, size_t in_len,
+                         void **out_data, size_t *out_len)
+{
+    size_t ret;
+    size_t out_size;
+    void *out_buf;
+    ZSTD_CCtx *cctx;
+
+    out_size = ZSTD_compressBound(in_len);
+    out_buf = flb_malloc(out_size);
+    if (!out_buf) {
+        flb_errno();
+        return -1;
+    }
+
+    cctx = ZSTD_createCCtx();
+    if (!cctx) {
+        flb_error("[zstd] cannot create compression context");
+        flb_free(out_buf);
+        return -1;
+    }
+
+    if (cdict) {
+        ret = ZSTD_compress_usingCDict(cctx, out_buf, out_size,
+                                       in_data, in_len, cdict);
+    }
+    else {
+        ret = ZSTD_compressCCtx(cctx, out_buf, out_size,
+                                in_data, in_len, level);
+    }
+    ZSTD_freeCCtx(cctx);
+
+    if (ZSTD_isError(ret)) {
+        flb_error("[zstd] compression failed: %s", ZSTD_getErrorName(ret));
+        flb_free(out_buf);
+        return -1;
+    }
+
+    *out_data = out_buf;
+    *out_len = ret;
+
+    return 0;
+}
+
+/*
+ * Decompress one or more concatenated frames. When the frame header
+ * carries the content size the output buffer is sized at once, otherwise
+ * (streamed frames) it grows as needed up to the maximum size.
+ */
+static int zstd_uncompress(ZSTD_DDict *ddict,
+                           void *in_data, size_t in_len,
+                           void **out_data, size_t *out_len)
+{
+    size_t ret;
+    size_t len = 0;
+    size_t out_size;
+    char *tmp;
+    char *out_buf;
+    unsigned long long content_size;
+    ZSTD_DCtx *dctx;
+    ZSTD_inBuffer in;
+    ZSTD_outBuffer out;
+
+    if (in_len == 0) {
+        flb_error("[zstd] unexpected content length");
+        return -1;
+    }
+
+    content_size = ZSTD_getFrameContentSize(in_data, in_len);
+    if (content_size == ZSTD_CONTENTSIZE_ERROR) {
+        flb_error("[zstd] invalid frame header");
+        return -1;
+    }
+    else if (content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        out_size = ZSTD_DStreamOutSize();
+    }
+    else if (content_size > FLB_ZSTD_MAX_UNCOMPRESSED_SIZE) {
+        flb_error("[zstd] maximum decompression size is 100MB");
+        return -1;
+    }
+    else {
+        /* one extra byte, so an empty frame still gets a buffer */
+        out_size = content_size + 1;
+    }
+
+    out_buf = flb_malloc(out_size);
+    if (!out_buf) {
+        flb_errno();
+        return -1;
+    }
+
+    dctx = ZSTD_createDCtx();
+    if (!dctx) {
+        flb_error("[zstd] cannot create decompression context");
+        flb_free(out_buf);
+        return -1;
+    }
+
+    if (ddict) {
+        ret = ZSTD_DCtx_refDDict(dctx, ddict);
+        if (ZSTD_isError(ret)) {
+            flb_error("[zstd] cannot use dictionary: %s",
+                      ZSTD_getErrorName(ret));
+            goto error;
+        }
+    }
+
+    in.src = in_data;
+    in.size = in_len;
+    in.pos = 0;
+
+    while (1) {
+        out.dst = out_buf + len;
+        out.size = out_size - len;
+        out.pos = 0;
+
+        ret = ZSTD_decompressStream(dctx, &out, &in);
+        if (ZSTD_isError(ret)) {
+            flb_error("[zstd] decompression failed: %s",
+                      ZSTD_getErrorName(ret));
+            goto error;
+        }
+        len += out.pos;
+
+        /* every frame has been decoded and flushed */
+        if (ret == 0 && in.pos == in.size) {
+            break;
+        }
+
+        if (len < out_size) {
+            if (in.pos == in.size) {
+                flb_error("[zstd] truncated frame");
+                goto error;
+            }
+            continue;
+        }
+
+        if (out_size >= FLB_ZSTD_MAX_UNCOMPRESSED_SIZE) {
+            flb_error("[zstd] maximum decompression size is 100MB");
+            goto error;
+        }
+        out_size *= 2;
+        if (out_size > FLB_ZSTD_MAX_UNCOMPRESSED_SIZE) {
+            out_size = FLB_ZSTD_MAX_UNCOMPRESSED_SIZE;
+        }
+        tmp = flb_realloc(out_buf, out_size);
+        if (!tmp) {
+            flb_errno();
+            goto error;
+        }
+        out_buf = tmp;
+    }
+
+    ZSTD_freeDCtx(dctx);
+
+    *out_data = out_buf;
+    *out_len = len;
+
+    return 0;
+
+error:
+    ZSTD_freeDCtx(dctx);
+    flb_free(out_buf);
+    return -1;
+}
+
+int flb_zstd_compress(void *in_data, size_t in_len,
+                      void **out_data, size_t *out_len)
+{
+    return zstd_compress(NULL, FLB_ZSTD_DEFAULT_LEVEL,
+                         in_data, in_len, out_data, out_len);
+}
+
+int flb_zstd_uncompress(void *in_data, size_t in_len,
+                        void **out_data, size_t *out_len)
+{
+    return zstd_uncompress(NULL, in_data, in_len, out_data, out_len);
+}
+
+/*
+ * Create a dictionary from a buffer holding either a trained dictionary
+ * (zstd --train) or raw content. The buffer is copied.
+ */
+struct flb_zstd_dict *flb_zstd_dict_create(void *buf, size_t size, int level)
+{
+    struct flb_zstd_dict *dict;
+
+    if (size == 0) {
+        flb_error("[zstd] empty dictionary");
+        return NULL;
+    }
+
+    dict = flb_calloc(1, sizeof(struct flb_zstd_dict));
+    if (!dict) {
+        flb_errno();
+        return NULL;
+    }
+
+    if (level <= 0) {
+        level = FLB_ZSTD_DEFAULT_LEVEL;
+    }
+    dict->level = level;
+    dict->id = ZSTD_getDictID_fromDict(buf, size);
+
+    dict->cdict = ZSTD_createCDict(buf, size, level);
+    dict->ddict = ZSTD_createDDict(buf, size);
+    if (!dict->cdict || !dict->ddict) {
+        flb_error("[zstd] cannot load dictionary");
+        flb_zstd_dict_destroy(dict);
+        return NULL;
+    }
+
+    return dict;
+}
+
+struct flb_zstd_dict *flb_zstd_dict_load(const char *path, int level)
+{
+    flb_sds_t buf;
+    struct flb_zstd_dict *dict;
+
+    buf = flb_file_read(path);
+    if (!buf) {
+        flb_error("[zstd] cannot read dictionary file %s", path);
+        return NULL;
+    }
+
+    dict = flb_zstd_dict_create(buf, flb_sds_len(buf), level);
+    flb_sds_destroy(buf);
+
+    return dict;
+}
+
+void flb_zstd_dict_destroy(struct flb_zstd_dict *dict)
+{
+    if (!dict) {
+        return;
+    }
+
+    if (dict->cdict) {
+        ZSTD_freeCDict(dict->cdict);
+    }
+    if (dict->ddict) {
+        ZSTD_freeDDict(dict->ddict);
+    }
+    flb_free(dict);
+}
+
+int flb_zstd_compress_dict(struct flb_zstd_dict *dict,
+                           void *in_data, size_t in_len,
+                           void **out_data, size_t *out_len)
+{
+    return zstd_compress(dict->cdict, dict->level,
+                         in_data, in_len, out_data, out_len);
+}
+
+int flb_zstd_uncompress_dict(struct flb_zstd_dict *dict,
+                             void *in_data, size_t in_len,
+                             void **out_data, size_t *out_len)
+{
+    return zstd_uncompress(dict->ddict, in_data, in_len, out_data, out_len);
+}
+
+/*
+ * Compress into a caller provided buffer, 'dict' is optional. Returns the
+ * compressed length, 0 if it does not fit in 'out_size' or -1 on error.
+ */
+ssize_t flb_zstd_compress_buffer(struct flb_zstd_dict *dict,
+                                 const void *in_data, size_t in_len,
+                                 void *out_data, size_t out_size)
+{
+    size_t ret;
+    ZSTD_CCtx *cctx;
+
+    cctx = ZSTD_createCCtx();
+    if (!cctx) {
+        flb_error("[zstd] cannot create compression context");
+        return -1;
+    }
+
+    if (dict) {
+        ret = ZSTD_compress_usingCDict(cctx, out_data, out_size,
+                                       in_data, in_len, dict->cdict);
+    }
+    else {
+        ret = ZSTD_compressCCtx(cctx, out_data, out_size,
+                                in_data, in_len, FLB_ZSTD_DEFAULT_LEVEL);
+    }
+    ZSTD_freeCCtx(cctx);
+
+    if (ZSTD_isError(ret)) {
+        return 0;
+    }
+
+    return ret;
+}
+
+/*
+ * Decompress into a caller provided buffer, 'dict' is optional. Returns the
+ * uncompressed length or -1 on error.
+ */
+ssize_t flb_zstd_uncompress_buffer(struct flb_zstd_dict *dict,
+                                   const void *in_data, size_t in_len,
+                                   void *out_data, size_t out_size)
+{
+    size_t ret;
+    ZSTD_DCtx *dctx;
+
+    dctx = ZSTD_createDCtx();
+    if (!dctx) {
+        flb_error("[zstd] cannot create decompression context");
+        return -1;
+    }
+
+    if (dict) {
+        ret = ZSTD_decompress_usingDDict(dctx, out_data, out_size,
+                                         in_data, in_len, dict->ddict);
+    }
+    else {
+        ret = ZSTD_decompressDCtx(dctx, out_data, out_size, in_data, in_len);
+    }
+    ZSTD_freeDCtx(dctx);
+
+    if (ZSTD_isError(ret)) {
+        flb_error("[zstd] decompression failed: %s", ZSTD_getErrorName(ret));
+        return -1;
+    }
+
+    return ret;
+}
@@ -24,6 +24,7 @@
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_scheduler.h>
+#include <fluent-bit/flb_hash_table.h>
 #include <fluent-bit/multiline/flb_ml.h>
 #include <fluent-bit/multiline/flb_ml_rule.h>
 #include <fluent-bit/multiline/flb_ml_group.h>
@@ -1165,6 +1166,12 @@ int flb_ml_init(struct flb_config *config)
 
 int flb_ml_exit(struct flb_config *config)
 {
+    /* no more lookups: skip the index updates of every destroy */
+    if (config->multiline_parsers_index) {
+        flb_hash_table_destroy(config->multiline_parsers_index);
+        config->multiline_parsers_index = NULL;
+    }
+
     flb_ml_parser_destroy_all(&config->multiline_parsers);
     return 0;
 }
@@ -23,6 +23,74 @@
 #include <fluent-bit/multiline/flb_ml_rule.h>
 #include <fluent-bit/multiline/flb_ml_mode.h>
 #include <fluent-bit/multiline/flb_ml_group.h>
+#include <fluent-bit/flb_hash_table.h>
+
+#include <ctype.h>
+
+/* Longest name indexed in config->multiline_parsers_index */
+#define ML_PARSER_KEY_SIZE  256
+
+/*
+ * Multiline parser names are case insensitive: the index uses the lowercase
+ * name as key. It returns the key length, or -1 if the name is not indexed.
+ */
+static int ml_parser_key(const char *name, char *key)
+{
+    int i;
+
+    if (!name) {
+        return -1;
+    }
+
+    for (i = 0; name[i] != '\0'; i++) {
+        if (i == ML_PARSER_KEY_SIZE - 1) {
+            return -1;
+        }
+        key[i] = tolower((unsigned char) name[i]);
+    }
+    key[i] = '\0';
+
+    return i > 0 ? i : -1;
+}
+
+/* The first registered parser of a name wins, as in a list lookup */
+static int ml_parser_index_add(struct flb_ml_parser *ml_parser)
+{
+    int len;
+    char key[ML_PARSER_KEY_SIZE];
+    struct flb_hash_table *ht = ml_parser->config->multiline_parsers_index;
+
+    len = ml_parser_key(ml_parser->name, key);
+    if (!ht || len == -1 || flb_hash_table_get_ptr(ht, key, len)) {
+        return 0;
+    }
+
+    return flb_hash_table_add(ht, key, len, ml_parser, 0) == -1 ? -1 : 0;
+}
+
+static void ml_parser_index_del(struct flb_ml_parser *ml_parser)
+{
+    int len;
+    char key[ML_PARSER_KEY_SIZE];
+    struct mk_list *head;
+    struct flb_ml_parser *tmp;
+    struct flb_hash_table *ht = ml_parser->config->multiline_parsers_index;
+
+    len = ml_parser_key(ml_parser->name, key);
+    if (!ht || len == -1 || flb_hash_table_get_ptr(ht, key, len) != ml_parser) {
+        return;
+    }
+    flb_hash_table_del(ht, key);
+
+    /* a parser registered later with the same name takes its place */
+    mk_list_foreach(head, &ml_parser->config->multiline_parsers) {
+        tmp = mk_list_entry(head, struct flb_ml_parser, _head);
+        if (tmp != ml_parser && strcasecmp(tmp->name, ml_parser->name) == 0) {
+            flb_hash_table_add(ht, key, len, tmp, 0);
+            break;
+        }
+    }
+}
 
 int flb_ml_parser_init(struct flb_ml_parser *ml_parser)
 {
@@ -105,6 +173,7 @@ struct flb_ml_parser *flb_ml_parser_create(struct flb_config *ctx,
     }
     ml_parser->name = flb_sds_create(name);
     ml_parser->type = type;
+    ml_parser->config = ctx;
 
     if (match_str) {
         ml_parser->match_str = flb_sds_create(match_str);
@@ -127,6 +196,11 @@ struct flb_ml_parser *flb_ml_parser_create(struct flb_config *ctx,
     mk_list_init(&ml_parser->regex_rules);
     mk_list_add(&ml_parser->_head, &ctx->multiline_parsers);
 
+    if (ml_parser_index_add(ml_parser) == -1) {
+        flb_ml_parser_destroy(ml_parser);
+        return NULL;
+    }
+
     if (key_content) {
         ml_parser->key_content = flb_sds_create(key_content);
         if (!ml_parser->key_content) {
@@ -156,9 +230,17 @@ struct flb_ml_parser *flb_ml_parser_create(struct flb_config *ctx,
 
 struct flb_ml_parser *flb_ml_parser_get(struct flb_config *ctx, char *name)
 {
+    int len;
+    char key[ML_PARSER_KEY_SIZE];
     struct mk_list *head;
     struct flb_ml_parser *ml_parser;
 
+    len = ml_parser_key(name, key);
+    if (ctx->multiline_parsers_index && len != -1) {
+        return flb_hash_table_get_ptr(ctx->multiline_parsers_index, key, len);
+    }
+
+    /* names too long for the index, or called after flb_ml_exit() */
     mk_list_foreach(head, &ctx->multiline_parsers) {
         ml_parser = mk_list_entry(head, struct flb_ml_parser, _head);
         if (strcasecmp(ml_parser->name, name) == 0) {
@@ -276,6 +358,8 @@ int flb_ml_parser_destroy(struct flb_ml_parser *ml_parser)
         return 0;
     }
 
+    ml_parser_index_del(ml_parser);
+
     if (ml_parser->name) {
         flb_sds_destroy(ml_parser->name);
     }
@@ -138,6 +138,9 @@ struct flb_ra_key *flb_ra_parser_key_add(struct flb_ra_parser *rp, char *key)
         return NULL;
     }
     k->subkeys = NULL;
+    k->steps_size = 0;
+    k->steps_has_str = FLB_FALSE;
+    k->steps = NULL;
 
     return k;
 }
@@ -180,6 +183,9 @@ struct flb_ra_key *flb_ra_parser_string_add(struct flb_ra_parser *rp,
         return NULL;
     }
     k->subkeys = NULL;
+    k->steps_size = 0;
+    k->steps_has_str = FLB_FALSE;
+    k->steps = NULL;
 
     return k;
 }
@@ -224,6 +230,9 @@ struct flb_ra_parser *flb_ra_parser_string_create(char *str, int len)
         return NULL;
     }
     rp->key->subkeys = NULL;
+    rp->key->steps_size = 0;
+    rp->key->steps_has_str = FLB_FALSE;
+    rp->key->steps = NULL;
     rp->key->name = flb_sds_create_len(str, len);
     if (!rp->key->name) {
         flb_ra_parser_destroy(rp);
@@ -278,6 +287,49 @@ struct flb_ra_parser *flb_ra_parser_tag_part_create(int id)
     return rp;
 }
 
+/* Flatten the subkeys list of a key map into an array of lookup steps */
+static int ra_parser_key_compile(struct flb_ra_key *key)
+{
+    int i = 0;
+    int size;
+    struct mk_list *head;
+    struct flb_ra_step *step;
+    struct flb_ra_subentry *entry;
+
+    if (!key->subkeys) {
+        return 0;
+    }
+
+    size = mk_list_size(key->subkeys);
+    if (size == 0) {
+        return 0;
+    }
+
+    key->steps = flb_calloc(size, sizeof(struct flb_ra_step));
+    if (!key->steps) {
+        flb_errno();
+        return -1;
+    }
+
+    mk_list_foreach(head, key->subkeys) {
+        entry = mk_list_entry(head, struct flb_ra_subentry, _head);
+        step = &key->steps[i++];
+
+        step->type = entry->type;
+        if (entry->type == FLB_RA_PARSER_ARRAY_ID) {
+            step->array_id = entry->array_id;
+        }
+        else {
+            step->str = entry->str;
+            step->len = flb_sds_len(entry->str);
+            key->steps_has_str = FLB_TRUE;
+        }
+    }
+    key->steps_size = size;
+
+    return 0;
+}
+
 struct flb_ra_parser *flb_ra_parser_meta_create(char *str, int len)
 {
     int ret;
@@ -326,6 +378,14 @@ struct flb_ra_parser *flb_ra_parser_meta_create(char *str, int len)
         return NULL;
     }
 
+    if (rp->type == FLB_RA_PARSER_KEYMAP && rp->key) {
+        ret = ra_parser_key_compile(rp->key);
+        if (ret != 0) {
+            flb_ra_parser_destroy(rp);
+            return NULL;
+        }
+    }
+
     return rp;
 }
 
@@ -340,6 +400,9 @@ void flb_ra_parser_destroy(struct flb_ra_parser *rp)
             ra_parser_subentry_destroy_all(key->subkeys);
             flb_free(key->subkeys);
         }
+        if (key->steps) {
+            flb_free(key->steps);
+        }
         flb_free(rp->key);
     }
     if (rp->slist) {
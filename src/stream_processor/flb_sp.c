@@ -472,7 +472,7 @@ struct flb_sp_task *flb_sp_task_create(struct flb_sp *sp, const char *name,
 
     mk_list_init(&task->window.data);
     mk_list_init(&task->window.aggregate_list);
-    rb_tree_new(&task->window.aggregate_tree, flb_sp_groupby_compare);
+    flb_sp_groupby_index_init(&task->window.aggregate_index);
 
     mk_list_init(&task->window.hopping_slot);
 
@@ -489,6 +489,16 @@ struct flb_sp_task *flb_sp_task_create(struct flb_sp *sp, const char *name,
 
         task->window.type = cmd->window.type;
 
+        if (mk_list_size(&cmd->gb_keys) > 0) {
+            task->window.groupby_nums = flb_calloc(mk_list_size(&cmd->gb_keys),
+                                                   sizeof(struct aggregate_num));
+            if (!task->window.groupby_nums) {
+                flb_errno();
+                flb_sp_task_destroy(task);
+                return NULL;
+            }
+        }
+
         /* Register a timer event when task contains aggregation rules */
         if (task->window.type != FLB_SP_WINDOW_DEFAULT) {
             /* Initialize event loop context */
@@ -523,6 +533,12 @@ struct flb_sp_task *flb_sp_task_create(struct flb_sp *sp, const char *name,
                 task->window.advance_by = cmd->window.advance_by;
                 task->window.fd_hop = fd;
                 task->window.first_hop = true;
+
+                task->window.current_slot = flb_sp_hopping_slot_create();
+                if (!task->window.current_slot) {
+                    flb_sp_task_destroy(task);
+                    return NULL;
+                }
             }
         }
     }
@@ -564,6 +580,10 @@ void groupby_nums_destroy(struct aggregate_num *groupby_nums, int size)
 {
     int i;
 
+    if (!groupby_nums) {
+        return;
+    }
+
     for (i = 0; i < size; i++) {
         if (groupby_nums[i].type == FLB_SP_STRING) {
             flb_sds_destroy(groupby_nums[i].string);
@@ -621,8 +641,6 @@ void flb_sp_window_destroy(struct flb_sp_cmd *cmd,
     struct flb_sp_hopping_slot *hs;
     struct mk_list *head;
     struct mk_list *tmp;
-    struct mk_list *head_hs;
-    struct mk_list *tmp_hs;
 
     mk_list_foreach_safe(head, tmp, &window->data) {
         data = mk_list_entry(head, struct flb_sp_window_data, _head);
@@ -639,16 +657,18 @@ void flb_sp_window_destroy(struct flb_sp_cmd *cmd,
 
     mk_list_foreach_safe(head, tmp, &window->hopping_slot) {
         hs = mk_list_entry(head, struct flb_sp_hopping_slot, _head);
-        mk_list_foreach_safe(head_hs, tmp_hs, &hs->aggregate_list) {
-            aggr_node = mk_list_entry(head_hs, struct aggregate_node, _head);
-            mk_list_del(&aggr_node->_head);
-            flb_sp_aggregate_node_destroy(cmd, aggr_node);
-        }
-        rb_tree_destroy(&hs->aggregate_tree);
-        flb_free(hs);
+        mk_list_del(&hs->_head);
+        flb_sp_hopping_slot_destroy(cmd, hs);
+    }
+
+    if (window->current_slot) {
+        flb_sp_hopping_slot_destroy(cmd, window->current_slot);
+        window->current_slot = NULL;
     }
 
-    rb_tree_destroy(&window->aggregate_tree);
+    flb_sp_groupby_index_destroy(&window->aggregate_index);
+    groupby_nums_destroy(window->groupby_nums, mk_list_size(&cmd->gb_keys));
+    window->groupby_nums = NULL;
 }
 
 void flb_sp_task_destroy(struct flb_sp_task *task)
@@ -1219,154 +1239,216 @@ next:
     *out_size = mp_sbuf.size;
 }
 
+/* Copy the GROUP BY values of a record for a new aggregation node */
+static struct aggregate_num *groupby_nums_copy(struct aggregate_num *nums,
+                                               int size)
+{
+    int i;
+    struct aggregate_num *copy;
+
+    copy = flb_calloc(size, sizeof(struct aggregate_num));
+    if (!copy) {
+        flb_errno();
+        return NULL;
+    }
+
+    for (i = 0; i < size; i++) {
+        copy[i] = nums[i];
+        if (nums[i].type == FLB_SP_STRING) {
+            copy[i].string = flb_sds_create_len(nums[i].string,
+                                                flb_sds_len(nums[i].string));
+            if (!copy[i].string) {
+                groupby_nums_destroy(copy, i);
+                return NULL;
+            }
+        }
+    }
+
+    return copy;
+}
+
+/*
+ * Set a GROUP BY value of the record being processed. The window keeps the
+ * values between records so their string buffers are reused.
+ */
+static int groupby_num_set(struct aggregate_num *num, msgpack_object o)
+{
+    int ret;
+    int64_t ival;
+    double dval;
+    flb_sds_t str;
+
+    /* Convert string to number if that is possible */
+    ret = object_to_number(o, &ival, &dval);
+    if (ret == -1 && o.type == MSGPACK_OBJECT_STR) {
+        if (num->type == FLB_SP_STRING) {
+            str = flb_sds_copy(num->string, o.via.str.ptr, o.via.str.size);
+        }
+        else {
+            str = flb_sds_create_len(o.via.str.ptr, o.via.str.size);
+        }
+        if (!str) {
+            return -1;
+        }
+        num->type = FLB_SP_STRING;
+        num->string = str;
+        return 0;
+    }
+
+    if (num->type == FLB_SP_STRING) {
+        flb_sds_destroy(num->string);
+        num->string = NULL;
+    }
+
+    num->type = FLB_SP_NUM_I64;
+    num->i64 = 0;
+
+    if (ret == -1) {
+        if (o.type == MSGPACK_OBJECT_BOOLEAN) {
+            num->i64 = o.via.boolean;
+        }
+    }
+    else if (ret == FLB_STR_INT) {
+        num->i64 = ival;
+    }
+    else if (ret == FLB_STR_FLOAT) {
+        num->type = FLB_SP_NUM_F64;
+        num->f64 = dval;
+    }
+
+    return 0;
+}
+
+/*
+ * Get the aggregation node of a group from the window or a hopping slot,
+ * the node is created on the first record of the group.
+ */
+static struct aggregate_node *aggregate_node_get(struct flb_sp_cmd *cmd,
+                                                 struct flb_sp_groupby_index *index,
+                                                 struct mk_list *list,
+                                                 struct aggregate_num *gb_nums,
+                                                 int gb_entries, uint64_t hash)
+{
+    int map_entries;
+    struct aggregate_node *aggr_node;
+
+    aggr_node = flb_sp_groupby_index_get(index, gb_nums, gb_entries, hash);
+    if (aggr_node) {
+        aggr_node->records++;
+        return aggr_node;
+    }
+
+    /* Number of expected output entries in the map */
+    map_entries = mk_list_size(&cmd->keys);
+
+    aggr_node = flb_calloc(1, sizeof(struct aggregate_node));
+    if (!aggr_node) {
+        flb_errno();
+        return NULL;
+    }
+
+    aggr_node->nums = flb_calloc(1, sizeof(struct aggregate_num) * map_entries);
+    if (!aggr_node->nums) {
+        flb_errno();
+        flb_free(aggr_node);
+        return NULL;
+    }
+    aggr_node->nums_size = map_entries;
+
+    aggr_node->aggregate_data = (struct aggregate_data **)
+        flb_calloc(1, sizeof(struct aggregate_data *) * map_entries);
+    if (!aggr_node->aggregate_data) {
+        flb_errno();
+        flb_free(aggr_node->nums);
+        flb_free(aggr_node);
+        return NULL;
+    }
+
+    if (gb_entries > 0) {
+        aggr_node->groupby_nums = groupby_nums_copy(gb_nums, gb_entries);
+        if (!aggr_node->groupby_nums) {
+            flb_sp_aggregate_node_destroy(cmd, aggr_node);
+            return NULL;
+        }
+        aggr_node->groupby_keys = gb_entries;
+    }
+
+    aggr_node->records = 1;
+    aggr_node->hash = hash;
+
+    if (flb_sp_groupby_index_add(index, aggr_node) == -1) {
+        flb_sp_aggregate_node_destroy(cmd, aggr_node);
+        return NULL;
+    }
+    mk_list_add(&aggr_node->_head, list);
+
+    return aggr_node;
+}
+
 static struct aggregate_node * sp_process_aggregate_data(struct flb_sp_task *task,
                                                          msgpack_object map)
 {
     int i;
-    int ret;
     int map_size;
     int key_id;
-    int map_entries;
     int gb_entries;
     int values_found;
-    int64_t ival;
-    double dval;
+    uint64_t hash;
     struct flb_sp_value *sval;
     struct aggregate_num *gb_nums;
-    struct aggregate_node *aggr_node;
     struct flb_sp_cmd *cmd;
     struct flb_sp_cmd_gb_key *gb_key;
     struct mk_list *head;
-    struct rb_tree_node *rb_result;
     msgpack_object key;
 
-    aggr_node = NULL;
     cmd = task->cmd;
     map_size = map.via.map.size;
     values_found = 0;
 
-    /* Number of expected output entries in the map */
-    map_entries = mk_list_size(&cmd->keys);
     gb_entries = mk_list_size(&cmd->gb_keys);
+    gb_nums = task->window.groupby_nums;
 
-    if (gb_entries > 0) {
-        gb_nums = flb_calloc(1, sizeof(struct aggregate_num) * gb_entries);
-        if (!gb_nums) {
-            return NULL;
-        }
-
-        /* extract GROUP BY values */
-        for (i = 0; i < map_size; i++) { /* extract group-by values */
-            key = map.via.map.ptr[i].key;
-
-            key_id = 0;
-            mk_list_foreach(head, &cmd->gb_keys) {
-                gb_key = mk_list_entry(head, struct flb_sp_cmd_gb_key,
-                                       _head);
-                if (flb_sds_cmp(gb_key->name, key.via.str.ptr,
-                                key.via.str.size) != 0) {
-                    key_id++;
-                    continue;
-                }
-
-                sval = flb_sp_key_to_value(gb_key->name, map, gb_key->subkeys);
-                if (!sval) {
-                    /* If evaluation fails/sub-key doesn't exist */
-                    key_id++;
-                    continue;
-                }
-
-                values_found++;
-
-                /* Convert string to number if that is possible */
-                ret = object_to_number(sval->o, &ival, &dval);
-                if (ret == -1) {
-                    if (sval->o.type == MSGPACK_OBJECT_STR) {
-                        gb_nums[key_id].type = FLB_SP_STRING;
-                        gb_nums[key_id].string =
-                            flb_sds_create_len(sval->o.via.str.ptr,
-                                               sval->o.via.str.size);
-                    }
-                    else if (sval->o.type == MSGPACK_OBJECT_BOOLEAN) {
-                        gb_nums[key_id].type = FLB_SP_NUM_I64;
-                        gb_nums[key_id].i64 = sval->o.via.boolean;
-                    }
-                }
-                else if (ret == FLB_STR_INT) {
-                    gb_nums[key_id].type = FLB_SP_NUM_I64;
-                    gb_nums[key_id].i64 = ival;
-                }
-                else if (ret == FLB_STR_FLOAT) {
-                    gb_nums[key_id].type = FLB_SP_NUM_F64;
-                    gb_nums[key_id].f64 = dval;
-                }
+    /* extract GROUP BY values */
+    for (i = 0; i < map_size && gb_entries > 0; i++) {
+        key = map.via.map.ptr[i].key;
 
+        key_id = 0;
+        mk_list_foreach(head, &cmd->gb_keys) {
+            gb_key = mk_list_entry(head, struct flb_sp_cmd_gb_key,
+                                   _head);
+            if (flb_sds_cmp(gb_key->name, key.via.str.ptr,
+                            key.via.str.size) != 0) {
                 key_id++;
-                flb_sp_key_value_destroy(sval);
+                continue;
             }
-        }
-
-        /* if some GROUP BY keys are not found in the record */
-        if (values_found < gb_entries) {
-            groupby_nums_destroy(gb_nums, gb_entries);
-            return NULL;
-        }
-
-        aggr_node = (struct aggregate_node *) flb_calloc(1, sizeof(struct aggregate_node));
-        if (!aggr_node) {
-            flb_errno();
-            groupby_nums_destroy(gb_nums, gb_entries);
-            return NULL;
-        }
-
-        aggr_node->groupby_keys = gb_entries;
-        aggr_node->groupby_nums = gb_nums;
 
-        rb_tree_find_or_insert(&task->window.aggregate_tree, aggr_node, &aggr_node->_rb_head, &rb_result);
-        if (&aggr_node->_rb_head != rb_result) {
-            /* We don't need aggr_node anymore */
-            flb_sp_aggregate_node_destroy(cmd, aggr_node);
+            sval = flb_sp_key_to_value(gb_key->name, map, gb_key->subkeys);
+            if (!sval) {
+                /* If evaluation fails/sub-key doesn't exist */
+                key_id++;
+                continue;
+            }
 
-            aggr_node = container_of(rb_result, struct aggregate_node, _rb_head);
-            container_of(rb_result, struct aggregate_node, _rb_head)->records++;
-        }
-        else {
-            aggr_node->nums = flb_calloc(1, sizeof(struct aggregate_num) * map_entries);
-            if (!aggr_node->nums) {
-                flb_sp_aggregate_node_destroy(cmd, aggr_node);
-                return NULL;
+            if (groupby_num_set(&gb_nums[key_id], sval->o) == 0) {
+                values_found++;
             }
-            aggr_node->records = 1;
-            aggr_node->nums_size = map_entries;
-            aggr_node->aggregate_data = (struct aggregate_data **) flb_calloc(1, sizeof(struct aggregate_data *) * map_entries);
-            mk_list_add(&aggr_node->_head, &task->window.aggregate_list);
+
+            key_id++;
+            flb_sp_key_value_destroy(sval);
         }
     }
-    else { /* If query doesn't have GROUP BY */
-        if (!mk_list_size(&task->window.aggregate_list)) {
-            aggr_node = flb_calloc(1, sizeof(struct aggregate_node));
-            if (!aggr_node) {
-                flb_errno();
-                return NULL;
-            }
-            aggr_node->nums = flb_calloc(1, sizeof(struct aggregate_num) * map_entries);
-            if (!aggr_node->nums) {
-                flb_sp_aggregate_node_destroy(cmd, aggr_node);
-                return NULL;
-            }
 
-            aggr_node->nums_size = map_entries;
-            aggr_node->records = 1;
-            aggr_node->aggregate_data = (struct aggregate_data **) flb_calloc(1, sizeof(struct aggregate_data *) * map_entries);
-            mk_list_add(&aggr_node->_head, &task->window.aggregate_list);
-        }
-        else {
-            aggr_node = mk_list_entry_first(&task->window.aggregate_list, struct aggregate_node, _head);
-            aggr_node->records++;
-        }
+    /* if some GROUP BY keys are not found in the record */
+    if (values_found < gb_entries) {
+        return NULL;
     }
 
-    return aggr_node;
+    /* without GROUP BY, every record goes to the same node */
+    hash = flb_sp_groupby_hash(gb_nums, gb_entries);
+
+    return aggregate_node_get(cmd, &task->window.aggregate_index,
+                              &task->window.aggregate_list,
+                              gb_nums, gb_entries, hash);
 }
 
 /*
@@ -1400,6 +1482,8 @@ int sp_process_data_aggr(const char *buf_data, size_t buf_size,
     struct flb_sp_value *sval;
     struct flb_exp_val *condition;
     struct aggregate_node *aggr_node;
+    struct aggregate_node *aggr_node_hs;
+    struct flb_sp_hopping_slot *hs;
 
     /* Number of expected output entries in the map */
     off = 0;
@@ -1443,6 +1527,24 @@ int sp_process_data_aggr(const char *buf_data, size_t buf_size,
 
         task->window.records++;
 
+        /*
+         * On hopping windows the record is also accounted in the current
+         * slot, so the slot can be subtracted from the window once it
+         * expires.
+         */
+        aggr_node_hs = NULL;
+        hs = task->window.current_slot;
+        if (hs) {
+            aggr_node_hs = aggregate_node_get(cmd, &hs->aggregate_index,
+                                              &hs->aggregate_list,
+                                              aggr_node->groupby_nums,
+                                              aggr_node->groupby_keys,
+                                              aggr_node->hash);
+            if (aggr_node_hs) {
+                hs->records++;
+            }
+        }
+
         nums = aggr_node->nums;
 
         values_found = 0;
@@ -1509,6 +1611,17 @@ int sp_process_data_aggr(const char *buf_data, size_t buf_size,
                     }
 
                     aggregate_func_add[ckey->aggr_func - 1](aggr_node, ckey, key_id, &tms, ival, dval);
+
+                    if (aggr_node_hs &&
+                        aggregate_func_slot_init[ckey->aggr_func - 1](aggr_node_hs, aggr_node, ckey, key_id) == 0) {
+                        if (dval != 0.0 &&
+                            aggr_node_hs->nums[key_id].type == FLB_SP_NUM_I64) {
+                            aggr_node_hs->nums[key_id].type = FLB_SP_NUM_F64;
+                            aggr_node_hs->nums[key_id].f64 = (double) aggr_node_hs->nums[key_id].i64;
+                        }
+
+                        aggregate_func_add[ckey->aggr_func - 1](aggr_node_hs, ckey, key_id, &tms, ival, dval);
+                    }
                 }
                 else {
                     if (sval->o.type == MSGPACK_OBJECT_BOOLEAN) {
@@ -1793,156 +1906,23 @@ int sp_process_data(const char *tag, int tag_len,
     return records;
 }
 
+/*
+ * Close the slot of the current hop: its records were accounted as they
+ * came in, so it only needs to be queued for flb_sp_window_prune().
+ */
 int sp_process_hopping_slot(const char *tag, int tag_len,
                             struct flb_sp_task *task)
 {
-    int i;
-    int key_id;
-    int map_entries;
-    int gb_entries;
-    struct flb_sp_cmd *cmd = task->cmd;
-    struct mk_list *head;
-    struct mk_list *head_hs;
-    struct aggregate_node *aggr_node;
-    struct aggregate_node *aggr_node_hs;
-    struct aggregate_node *aggr_node_prev;
     struct flb_sp_hopping_slot *hs;
-    struct flb_sp_hopping_slot *hs_;
-    struct rb_tree_node *rb_result;
-    struct flb_sp_cmd_key *ckey;
-    rb_result_t result;
 
-    map_entries = mk_list_size(&cmd->keys);
-    gb_entries = mk_list_size(&cmd->gb_keys);
-
-    /* Initialize a hoping slot */
-    hs = flb_calloc(1, sizeof(struct flb_sp_hopping_slot));
+    /* On error the current slot stays open and covers the next hop too */
+    hs = flb_sp_hopping_slot_create();
     if (!hs) {
-        flb_errno();
         return -1;
     }
 
-    mk_list_init(&hs->aggregate_list);
-    rb_tree_new(&hs->aggregate_tree, flb_sp_groupby_compare);
-
-    /* Loop over aggregation nodes on window */
-    mk_list_foreach(head, &task->window.aggregate_list) {
-        /* Window aggregation node */
-        aggr_node = mk_list_entry(head, struct aggregate_node, _head);
-
-        /* Create a hopping slot aggregation node */
-        aggr_node_hs = flb_calloc(1, sizeof(struct aggregate_node));
-        if (!aggr_node_hs) {
-            flb_errno();
-            flb_free(hs);
-            return -1;
-        }
-
-        aggr_node_hs->nums = malloc(sizeof(struct aggregate_node) * map_entries);
-        if (!aggr_node_hs->nums) {
-            flb_errno();
-            flb_free(hs);
-            flb_free(aggr_node_hs);
-            return -1;
-        }
-
-        memcpy(aggr_node_hs->nums, aggr_node->nums, sizeof(struct aggregate_num) * map_entries);
-        aggr_node_hs->records = aggr_node->records;
-
-        /* Clone aggregate data */
-        key_id = 0;
-        mk_list_foreach(head_hs, &cmd->keys) {
-            ckey = mk_list_entry(head_hs, struct flb_sp_cmd_key, _head);
-
-            if (ckey->aggr_func) {
-                if (!aggr_node_hs->aggregate_data) {
-                    aggr_node_hs->aggregate_data = (struct aggregate_data **)
-                                       flb_calloc(1, sizeof(struct aggregate_data *) * map_entries);
-                    if (!aggr_node_hs->aggregate_data) {
-                        flb_errno();
-                        flb_free(hs);
-                        flb_free(aggr_node_hs->nums);
-                        flb_free(aggr_node_hs);
-                        return -1;
-                    }
-                }
-
-                if (aggregate_func_clone[ckey->aggr_func - 1](aggr_node_hs, aggr_node, ckey, key_id) == -1) {
-                    flb_errno();
-                    flb_free(aggr_node_hs->nums);
-                    flb_free(aggr_node_hs->aggregate_data);
-                    flb_free(aggr_node_hs);
-                    flb_free(hs);
-                    return -1;
-                }
-            }
-
-            key_id++;
-        }
-
-        /* Traverse over previous slots to calculate values/record numbers */
-        mk_list_foreach(head_hs, &task->window.hopping_slot) {
-            hs_ = mk_list_entry(head_hs, struct flb_sp_hopping_slot, _head);
-            result = rb_tree_find(&hs_->aggregate_tree, aggr_node, &rb_result);
-            /* If corresponding aggregation node exists in previous hopping slot,
-             * calculate aggregation values
-             */
-            if (result == RB_OK) {
-                aggr_node_prev = mk_list_entry(rb_result, struct aggregate_node,
-                                               _rb_head);
-                aggr_node_hs->records -= aggr_node_prev->records;
-
-                key_id = 0;
-                ckey = mk_list_entry_first(&cmd->keys, struct flb_sp_cmd_key,
-                                           _head);
-                for (i = 0; i < map_entries; i++) {
-                    if (ckey->aggr_func) {
-                        aggregate_func_remove[ckey->aggr_func - 1](aggr_node_hs, aggr_node_prev, i);
-                    }
-
-                    ckey = mk_list_entry_next(&ckey->_head, struct flb_sp_cmd_key,
-                                              _head, &cmd->keys);
-                }
-            }
-        }
-
-        if (aggr_node_hs->records > 0) {
-            aggr_node_hs->groupby_nums =
-                flb_calloc(1, sizeof(struct aggregate_node) * gb_entries);
-            if (gb_entries > 0 && !aggr_node_hs->groupby_nums) {
-                flb_errno();
-                flb_free(hs);
-                flb_free(aggr_node_hs->nums);
-                flb_free(aggr_node_hs->aggregate_data);
-                flb_free(aggr_node_hs);
-                return -1;
-            }
-
-            if (aggr_node_hs->groupby_nums != NULL) {
-                memcpy(aggr_node_hs->groupby_nums, aggr_node->groupby_nums,
-                       sizeof(struct aggregate_num) * gb_entries);
-            }
-
-            aggr_node_hs->nums_size = aggr_node->nums_size;
-            aggr_node_hs->groupby_keys = aggr_node->groupby_keys;
-
-            rb_tree_insert(&hs->aggregate_tree, aggr_node_hs, &aggr_node_hs->_rb_head);
-            mk_list_add(&aggr_node_hs->_head, &hs->aggregate_list);
-        }
-        else {
-            flb_free(aggr_node_hs->nums);
-            flb_free(aggr_node_hs->aggregate_data);
-            flb_free(aggr_node_hs);
-        }
-    }
-
-    hs->records = task->window.records;
-    mk_list_foreach(head_hs, &task->window.hopping_slot) {
-        hs_ = mk_list_entry(head_hs, struct flb_sp_hopping_slot, _head);
-        hs->records -= hs_->records;
-    }
-
-    mk_list_add(&hs->_head, &task->window.hopping_slot);
+    mk_list_add(&task->window.current_slot->_head, &task->window.hopping_slot);
+    task->window.current_slot = hs;
 
     return 0;
 }
@@ -11,37 +11,37 @@ char aggregate_func_string[AGGREGATE_FUNCTIONS][sizeof("TIMESERIES_FORECAST") +
     "TIMESERIES_FORECAST"
 };
 
-int aggregate_func_clone_nop(struct aggregate_node *aggr_node,
-                              struct aggregate_node *aggr_node_prev,
-                              struct flb_sp_cmd_key *ckey,
-                              int key_id) {
+int aggregate_func_slot_init_nop(struct aggregate_node *aggr_node,
+                                  struct aggregate_node *aggr_node_window,
+                                  struct flb_sp_cmd_key *ckey,
+                                  int key_id) {
     return 0;
 }
 
-int aggregate_func_clone_timeseries_forecast(struct aggregate_node *aggr_node_clone,
-                                              struct aggregate_node *aggr_node,
-                                              struct flb_sp_cmd_key *ckey,
-                                              int key_id) {
-    struct timeseries_forecast *forecast_clone;
+/*
+ * The sums of a hopping slot are subtracted from the ones of the window, so
+ * both must measure the time from the same origin.
+ */
+int aggregate_func_slot_init_timeseries_forecast(struct aggregate_node *aggr_node,
+                                                 struct aggregate_node *aggr_node_window,
+                                                 struct flb_sp_cmd_key *ckey,
+                                                 int key_id) {
     struct timeseries_forecast *forecast;
+    struct timeseries_forecast *forecast_window;
 
-    forecast_clone = (struct timeseries_forecast *) aggr_node_clone->aggregate_data[key_id];
-    if (!forecast_clone) {
-        forecast_clone = (struct timeseries_forecast *) flb_calloc(1, sizeof(struct timeseries_forecast));
-        if (!forecast_clone) {
-          return -1;
-        }
-
-        forecast_clone->future_time = ckey->constant;
-        aggr_node_clone->aggregate_data[key_id] = (struct aggregate_data *) forecast_clone;
+    if (aggr_node->aggregate_data[key_id]) {
+        return 0;
     }
 
-    forecast = (struct timeseries_forecast *) aggr_node->aggregate_data[key_id];
+    forecast = (struct timeseries_forecast *) flb_calloc(1, sizeof(struct timeseries_forecast));
+    if (!forecast) {
+        return -1;
+    }
 
-    forecast_clone->sigma_x = forecast->sigma_x;
-    forecast_clone->sigma_y = forecast->sigma_y;
-    forecast_clone->sigma_xy = forecast->sigma_xy;
-    forecast_clone->sigma_x2 = forecast->sigma_x2;
+    forecast_window = (struct timeseries_forecast *) aggr_node_window->aggregate_data[key_id];
+    forecast->future_time = ckey->constant;
+    forecast->offset = forecast_window->offset;
+    aggr_node->aggregate_data[key_id] = (struct aggregate_data *) forecast;
 
     return 0;
 }
@@ -211,7 +211,13 @@ void aggregate_func_remove_sum(struct aggregate_node *aggr_node,
         aggr_node->nums[key_id].i64 -= aggr_node_prev->nums[key_id].i64;
     }
     else if (aggr_node->nums[key_id].type == FLB_SP_NUM_F64) {
-        aggr_node->nums[key_id].f64 -= aggr_node_prev->nums[key_id].f64;
+        /* the window might have seen a float after the slot was filled */
+        if (aggr_node_prev->nums[key_id].type == FLB_SP_NUM_I64) {
+            aggr_node->nums[key_id].f64 -= (double) aggr_node_prev->nums[key_id].i64;
+        }
+        else {
+            aggr_node->nums[key_id].f64 -= aggr_node_prev->nums[key_id].f64;
+        }
     }
 }
 
@@ -300,6 +306,9 @@ void aggregate_func_remove_timeseries_forecast(struct aggregate_node *aggr_node,
 
     forecast_w = (struct timeseries_forecast *) aggr_node->aggregate_data[key_id];
     forecast_h = (struct timeseries_forecast *) aggr_node_prev->aggregate_data[key_id];
+    if (!forecast_h) {
+        return;
+    }
 
     forecast_w->sigma_x -= forecast_h->sigma_x;
     forecast_w->sigma_y -= forecast_h->sigma_y;
@@ -318,13 +327,13 @@ void aggregate_func_destroy_timeseries_forecast(struct aggregate_node *aggr_node
     flb_free(aggr_node->aggregate_data[key_id]);
 }
 
-aggregate_function_clone aggregate_func_clone[AGGREGATE_FUNCTIONS] = {
-    aggregate_func_clone_nop,
-    aggregate_func_clone_nop,
-    aggregate_func_clone_nop,
-    aggregate_func_clone_nop,
-    aggregate_func_clone_nop,
-    aggregate_func_clone_timeseries_forecast,
+aggregate_function_slot_init aggregate_func_slot_init[AGGREGATE_FUNCTIONS] = {
+    aggregate_func_slot_init_nop,
+    aggregate_func_slot_init_nop,
+    aggregate_func_slot_init_nop,
+    aggregate_func_slot_init_nop,
+    aggregate_func_slot_init_nop,
+    aggregate_func_slot_init_timeseries_forecast,
 };
 
 aggregate_function_add aggregate_func_add[AGGREGATE_FUNCTIONS] = {
@@ -18,65 +18,231 @@
  */
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
+#include <fluent-bit/stream_processor/flb_sp_groupby.h>
 
-int flb_sp_groupby_compare(const void *lhs, const void *rhs)
+#include <cfl/cfl.h>
+
+/* Initial number of buckets of an index */
+#define FLB_SP_GROUPBY_INDEX_SIZE  64
+
+/*
+ * Hash the GROUP BY values of a record. Numbers are hashed by their double
+ * representation so an integer and a float holding the same value, which
+ * belong to the same group, get the same hash.
+ */
+uint64_t flb_sp_groupby_hash(struct aggregate_num *nums, int size)
 {
     int i;
-    int strcmp_result;
-    struct aggregate_node *left = (struct aggregate_node *) lhs;
-    struct aggregate_node *right = (struct aggregate_node *) rhs;
-    struct aggregate_num *lval;
-    struct aggregate_num *rval;
+    double d;
+    uint64_t h;
+    uint64_t hash = 0;
+    struct aggregate_num *num;
 
-    for (i = 0; i < left->groupby_keys; i++) {
-        lval = &left->groupby_nums[i];
-        rval = &right->groupby_nums[i];
+    for (i = 0; i < size; i++) {
+        num = &nums[i];
 
-        /* Convert integer to double if a float value appears on one side */
-        if (lval->type == FLB_SP_NUM_I64 && rval->type == FLB_SP_NUM_F64) {
-            lval->type = FLB_SP_NUM_F64;
-            lval->f64 = (double) lval->i64;
+        if (num->type == FLB_SP_STRING) {
+            h = cfl_hash_64bits(num->string, flb_sds_len(num->string));
         }
-        else if (lval->type == FLB_SP_NUM_F64 && rval->type == FLB_SP_NUM_I64) {
-            rval->type = FLB_SP_NUM_F64;
-            rval->f64 = (double) rval->i64;
+        else {
+            if (num->type == FLB_SP_NUM_I64) {
+                d = (double) num->i64;
+            }
+            else if (num->type == FLB_SP_NUM_F64) {
+                d = num->f64;
+            }
+            else {
+                d = (double) num->boolean;
+            }
+
+            /* -0.0 and 0.0 are the same group */
+            if (d == 0.0) {
+                d = 0.0;
+            }
+            h = cfl_hash_64bits(&d, sizeof(d));
         }
 
-        /* Comparison */
-        if (lval->type == FLB_SP_BOOLEAN && rval->type == FLB_SP_BOOLEAN) {
-            if (lval->boolean != rval->boolean) {
-                return 1;
+        hash ^= h + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    }
+
+    return hash;
+}
+
+static double groupby_num_to_double(struct aggregate_num *num)
+{
+    if (num->type == FLB_SP_NUM_I64) {
+        return (double) num->i64;
+    }
+
+    return num->f64;
+}
+
+/*
+ * Check if the GROUP BY values of an aggregation node are the same as the
+ * ones of a record. Integers and floats are compared as floats.
+ */
+static int groupby_equal(struct aggregate_num *lvals,
+                         struct aggregate_num *rvals, int size)
+{
+    int i;
+    struct aggregate_num *lval;
+    struct aggregate_num *rval;
+
+    for (i = 0; i < size; i++) {
+        lval = &lvals[i];
+        rval = &rvals[i];
+
+        if (lval->type == FLB_SP_STRING || rval->type == FLB_SP_STRING) {
+            if (lval->type != rval->type ||
+                flb_sds_len(lval->string) != flb_sds_len(rval->string) ||
+                memcmp(lval->string, rval->string,
+                       flb_sds_len(lval->string)) != 0) {
+                return FLB_FALSE;
+            }
+        }
+        else if (lval->type == FLB_SP_BOOLEAN || rval->type == FLB_SP_BOOLEAN) {
+            if (lval->type != rval->type || lval->boolean != rval->boolean) {
+                return FLB_FALSE;
             }
         }
         else if (lval->type == FLB_SP_NUM_I64 && rval->type == FLB_SP_NUM_I64) {
-            if (lval->i64 > rval->i64) {
-                return 1;
+            if (lval->i64 != rval->i64) {
+                return FLB_FALSE;
             }
+        }
+        else if (groupby_num_to_double(lval) != groupby_num_to_double(rval)) {
+            return FLB_FALSE;
+        }
+    }
 
-            if (lval->i64 < rval->i64) {
-                return -1;
-            }
+    return FLB_TRUE;
+}
+
+void flb_sp_groupby_index_init(struct flb_sp_groupby_index *index)
+{
+    index->size = 0;
+    index->count = 0;
+    index->table = NULL;
+}
+
+/* Unlink every node, the buckets are kept for the next window */
+void flb_sp_groupby_index_clear(struct flb_sp_groupby_index *index)
+{
+    int i;
+
+    for (i = 0; i < index->size; i++) {
+        mk_list_init(&index->table[i]);
+    }
+    index->count = 0;
+}
+
+void flb_sp_groupby_index_destroy(struct flb_sp_groupby_index *index)
+{
+    flb_free(index->table);
+    flb_sp_groupby_index_init(index);
+}
+
+static int groupby_index_resize(struct flb_sp_groupby_index *index, int size)
+{
+    int i;
+    struct mk_list *table;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct aggregate_node *aggr_node;
+
+    table = flb_malloc(sizeof(struct mk_list) * size);
+    if (!table) {
+        flb_errno();
+        return -1;
+    }
+
+    for (i = 0; i < size; i++) {
+        mk_list_init(&table[i]);
+    }
+
+    for (i = 0; i < index->size; i++) {
+        mk_list_foreach_safe(head, tmp, &index->table[i]) {
+            aggr_node = mk_list_entry(head, struct aggregate_node, _hash_head);
+            mk_list_del(&aggr_node->_hash_head);
+            mk_list_add(&aggr_node->_hash_head,
+                        &table[aggr_node->hash & (size - 1)]);
         }
-        else if (lval->type == FLB_SP_NUM_F64 &&  rval->type == FLB_SP_NUM_F64) {
-            if (lval->f64 > rval->f64) {
-                return 1;
-            }
+    }
 
-            if (lval->f64 < rval->f64) {
-                return -1;
-            }
+    flb_free(index->table);
+    index->table = table;
+    index->size = size;
+
+    return 0;
+}
+
+/*
+ * Lookup the aggregation node of the group defined by the GROUP BY values
+ * 'nums' and their hash. An integer value of the node becomes a float once
+ * the same value is seen as a float, the output then keeps the float type.
+ */
+struct aggregate_node *flb_sp_groupby_index_get(struct flb_sp_groupby_index *index,
+                                                struct aggregate_num *nums,
+                                                int size, uint64_t hash)
+{
+    int i;
+    struct mk_list *head;
+    struct aggregate_node *aggr_node;
+    struct aggregate_num *num;
+
+    if (index->count == 0) {
+        return NULL;
+    }
+
+    mk_list_foreach(head, &index->table[hash & (index->size - 1)]) {
+        aggr_node = mk_list_entry(head, struct aggregate_node, _hash_head);
+        if (aggr_node->hash != hash ||
+            groupby_equal(aggr_node->groupby_nums, nums, size) == FLB_FALSE) {
+            continue;
         }
-        else if (lval->type == FLB_SP_STRING && rval->type == FLB_SP_STRING) {
-            strcmp_result = strcmp((const char *) lval->string, (const char *) rval->string);
-            if (strcmp_result != 0) {
-              return strcmp_result;
+
+        for (i = 0; i < size; i++) {
+            num = &aggr_node->groupby_nums[i];
+            if (num->type == FLB_SP_NUM_I64 && nums[i].type == FLB_SP_NUM_F64) {
+                num->type = FLB_SP_NUM_F64;
+                num->f64 = (double) num->i64;
             }
         }
-        else { /* Sides have different types */
+
+        return aggr_node;
+    }
+
+    return NULL;
+}
+
+int flb_sp_groupby_index_add(struct flb_sp_groupby_index *index,
+                             struct aggregate_node *aggr_node)
+{
+    int ret;
+
+    /* Keep one node per bucket on average */
+    if (index->count >= index->size) {
+        ret = groupby_index_resize(index, index->size > 0 ?
+                                   index->size * 2 :
+                                   FLB_SP_GROUPBY_INDEX_SIZE);
+        if (ret == -1 && index->size == 0) {
             return -1;
         }
     }
 
+    mk_list_add(&aggr_node->_hash_head,
+                &index->table[aggr_node->hash & (index->size - 1)]);
+    index->count++;
+
     return 0;
 }
+
+void flb_sp_groupby_index_del(struct flb_sp_groupby_index *index,
+                              struct aggregate_node *aggr_node)
+{
+    mk_list_del(&aggr_node->_hash_head);
+    index->count--;
+}
@@ -17,23 +17,56 @@
  *  limitations under the License.
  */
 
+#include <fluent-bit/flb_mem.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
 #include <fluent-bit/stream_processor/flb_sp_window.h>
 #include <fluent-bit/stream_processor/flb_sp_parser.h>
 #include <fluent-bit/stream_processor/flb_sp_groupby.h>
 #include <fluent-bit/stream_processor/flb_sp_aggregate_func.h>
 
+struct flb_sp_hopping_slot *flb_sp_hopping_slot_create()
+{
+    struct flb_sp_hopping_slot *hs;
+
+    hs = flb_calloc(1, sizeof(struct flb_sp_hopping_slot));
+    if (!hs) {
+        flb_errno();
+        return NULL;
+    }
+
+    mk_list_init(&hs->aggregate_list);
+    flb_sp_groupby_index_init(&hs->aggregate_index);
+
+    return hs;
+}
+
+/* Destroy a hopping slot, it must be unlinked from the window first */
+void flb_sp_hopping_slot_destroy(struct flb_sp_cmd *cmd,
+                                 struct flb_sp_hopping_slot *hs)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct aggregate_node *aggr_node;
+
+    mk_list_foreach_safe(head, tmp, &hs->aggregate_list) {
+        aggr_node = mk_list_entry(head, struct aggregate_node, _head);
+        mk_list_del(&aggr_node->_head);
+        flb_sp_aggregate_node_destroy(cmd, aggr_node);
+    }
+
+    flb_sp_groupby_index_destroy(&hs->aggregate_index);
+    flb_free(hs);
+}
+
 void flb_sp_window_prune(struct flb_sp_task *task)
 {
     int i;
     int map_entries;
-    rb_result_t result;
     struct aggregate_node *aggr_node;
     struct aggregate_node *aggr_node_hs;
     struct mk_list *tmp;
     struct mk_list *head;
     struct flb_sp_hopping_slot *hs;
-    struct rb_tree_node *rb_result;
     struct flb_sp_cmd_key *ckey;
     struct flb_sp_cmd *cmd = task->cmd;
 
@@ -47,9 +80,8 @@ void flb_sp_window_prune(struct flb_sp_task *task)
                 flb_sp_aggregate_node_destroy(cmd, aggr_node);
             }
 
-            rb_tree_destroy(&task->window.aggregate_tree);
             mk_list_init(&task->window.aggregate_list);
-            rb_tree_new(&task->window.aggregate_tree, flb_sp_groupby_compare);
+            flb_sp_groupby_index_clear(&task->window.aggregate_index);
             task->window.records = 0;
         }
         break;
@@ -58,47 +90,48 @@ void flb_sp_window_prune(struct flb_sp_task *task)
             return;
         }
 
+        /*
+         * The window holds the sum of its slots, subtract the oldest one
+         * group by group.
+         */
+        map_entries = mk_list_size(&cmd->keys);
         hs = mk_list_entry_first(&task->window.hopping_slot,
                                  struct flb_sp_hopping_slot, _head);
-        mk_list_foreach_safe(head, tmp, &task->window.aggregate_list) {
-            aggr_node = mk_list_entry(head, struct aggregate_node, _head);
-            result = rb_tree_find(&hs->aggregate_tree, aggr_node, &rb_result);
-            if (result == RB_OK) {
-                aggr_node_hs = mk_list_entry(rb_result, struct aggregate_node, _rb_head);
-                if (aggr_node_hs->records == aggr_node->records) {
-                    rb_tree_remove(&task->window.aggregate_tree, &aggr_node->_rb_head);
-                    mk_list_del(&aggr_node->_head);
-                    // Destroy aggregation node
-                    flb_sp_aggregate_node_destroy(cmd, aggr_node);
-                }
-                else {
-                    aggr_node->records -= aggr_node_hs->records;
-                    map_entries = mk_list_size(&cmd->keys);
-
-                    ckey = mk_list_entry_first(&cmd->keys,
-                                               struct flb_sp_cmd_key, _head);
-                    for (i = 0; i < map_entries; i++) {
-                        if (ckey->aggr_func) {
-                            aggregate_func_remove[ckey->aggr_func - 1](aggr_node, aggr_node_hs, i);
-                        }
-
-                        ckey = mk_list_entry_next(&ckey->_head, struct flb_sp_cmd_key,
-                                                  _head, &cmd->keys);
-                    }
+        mk_list_foreach(head, &hs->aggregate_list) {
+            aggr_node_hs = mk_list_entry(head, struct aggregate_node, _head);
+            aggr_node = flb_sp_groupby_index_get(&task->window.aggregate_index,
+                                                 aggr_node_hs->groupby_nums,
+                                                 aggr_node_hs->groupby_keys,
+                                                 aggr_node_hs->hash);
+            if (!aggr_node) {
+                continue;
+            }
+
+            if (aggr_node_hs->records == aggr_node->records) {
+                flb_sp_groupby_index_del(&task->window.aggregate_index,
+                                         aggr_node);
+                mk_list_del(&aggr_node->_head);
+                flb_sp_aggregate_node_destroy(cmd, aggr_node);
+                continue;
+            }
+
+            aggr_node->records -= aggr_node_hs->records;
+
+            ckey = mk_list_entry_first(&cmd->keys,
+                                       struct flb_sp_cmd_key, _head);
+            for (i = 0; i < map_entries; i++) {
+                if (ckey->aggr_func) {
+                    aggregate_func_remove[ckey->aggr_func - 1](aggr_node, aggr_node_hs, i);
                 }
+
+                ckey = mk_list_entry_next(&ckey->_head, struct flb_sp_cmd_key,
+                                          _head, &cmd->keys);
             }
         }
         task->window.records -= hs->records;
 
-        /* Destroy hopping slot */
-        mk_list_foreach_safe(head, tmp, &hs->aggregate_list) {
-            aggr_node_hs = mk_list_entry(head, struct aggregate_node, _head);
-            mk_list_del(&aggr_node_hs->_head);
-            flb_sp_aggregate_node_destroy(cmd, aggr_node_hs);
-        }
-        rb_tree_destroy(&hs->aggregate_tree);
         mk_list_del(&hs->_head);
-        flb_free(hs);
+        flb_sp_hopping_slot_destroy(cmd, hs);
 
         break;
     }
@@ -20,6 +20,7 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_http2_client.h>
 
 #include "openssl.c"
 
@@ -379,6 +380,16 @@ retry_write:
     return total;
 }
 
+int flb_tls_session_alpn_get(struct flb_tls_session *session,
+                             char *buf, size_t size)
+{
+    if (session->tls->api->session_alpn_get == NULL) {
+        return -1;
+    }
+
+    return session->tls->api->session_alpn_get(session->ptr, buf, size);
+}
+
 int flb_tls_client_session_create(struct flb_tls *tls,
                                   struct flb_connection *u_conn,
                                   struct flb_coro *co)
@@ -437,6 +448,14 @@ int flb_tls_session_create(struct flb_tls *tls,
 
     connection->tls_session = session;
 
+    /* Offer HTTP/2, the HTTP client checks the outcome */
+    if (connection->type == FLB_UPSTREAM_CONNECTION &&
+        connection->net->http2 &&
+        flb_stream_is_async(connection->stream) &&
+        tls->api->session_alpn_set != NULL) {
+        tls->api->session_alpn_set(session->ptr, FLB_HTTP2_ALPN);
+    }
+
     result = 0;
 
  retry_handshake:
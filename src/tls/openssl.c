@@ -357,6 +357,12 @@ static void *tls_session_create(struct flb_tls *tls,
     session->fd = fd;
     SSL_set_fd(ssl, fd);
 
+    /*
+     * Writes interrupted by WANT_WRITE can be retried from a buffer that was
+     * reallocated meanwhile, e.g: the HTTP/2 output queue.
+     */
+    SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
     /*
      * TLS Debug Levels:
      *
@@ -397,6 +403,43 @@ static int tls_session_destroy(void *session)
     return 0;
 }
 
+/* Set the protocols offered with ALPN, in the wire format (RFC 7301) */
+static int tls_session_alpn_set(void *session, const char *protos)
+{
+    int ret;
+    struct tls_session *ptr = session;
+    struct tls_context *ctx = ptr->parent;
+
+    pthread_mutex_lock(&ctx->mutex);
+    ret = SSL_set_alpn_protos(ptr->ssl, (const unsigned char *) protos,
+                              strlen(protos));
+    pthread_mutex_unlock(&ctx->mutex);
+
+    /* unlike most of the API, SSL_set_alpn_protos() returns 0 on success */
+    return ret == 0 ? 0 : -1;
+}
+
+/* Get the protocol selected by the server, -1 if none */
+static int tls_session_alpn_get(void *session, char *buf, size_t size)
+{
+    int ret = -1;
+    unsigned int len = 0;
+    const unsigned char *proto = NULL;
+    struct tls_session *ptr = session;
+    struct tls_context *ctx = ptr->parent;
+
+    pthread_mutex_lock(&ctx->mutex);
+    SSL_get0_alpn_selected(ptr->ssl, &proto, &len);
+    if (proto != NULL && len > 0 && len < size) {
+        memcpy(buf, proto, len);
+        buf[len] = '\0';
+        ret = 0;
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+
+    return ret;
+}
+
 static int tls_net_read(struct flb_tls_session *session,
                         void *buf, size_t len)
 {
@@ -582,6 +625,8 @@ static struct flb_tls_backend tls_openssl = {
     .context_destroy      = tls_context_destroy,
     .session_create       = tls_session_create,
     .session_destroy      = tls_session_destroy,
+    .session_alpn_set     = tls_session_alpn_set,
+    .session_alpn_get     = tls_session_alpn_get,
     .net_read             = tls_net_read,
     .net_write            = tls_net_write,
     .net_handshake        = tls_net_handshake,
@@ -0,0 +1,166 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_arena.h>
+
+#include <msgpack.h>
+#include <stdint.h>
+
+#include "flb_tests_internal.h"
+
+void test_alloc()
+{
+    int i;
+    char *p;
+    char *prev = NULL;
+    struct flb_arena *arena;
+
+    arena = flb_arena_create(1024);
+    TEST_CHECK(arena != NULL);
+
+    /* allocations are aligned and do not overlap, even across blocks */
+    for (i = 0; i < 200; i++) {
+        p = flb_arena_alloc(arena, 10);
+        TEST_CHECK(p != NULL);
+        TEST_CHECK(((uintptr_t) p % FLB_ARENA_ALIGN) == 0);
+        memset(p, i, 10);
+        if (prev) {
+            TEST_CHECK(prev[9] == (char) (i - 1));
+        }
+        prev = p;
+    }
+
+    /* large allocation gets its own block */
+    p = flb_arena_alloc(arena, 4096);
+    TEST_CHECK(p != NULL);
+    memset(p, 'x', 4096);
+    TEST_CHECK(arena->large != NULL);
+
+    p = flb_arena_calloc(arena, 8, 4);
+    TEST_CHECK(p != NULL && p[0] == 0 && p[31] == 0);
+
+    flb_arena_destroy(arena);
+}
+
+void test_reset()
+{
+    int i;
+    char *first;
+    char *p;
+    struct flb_arena *arena;
+    struct flb_arena_block *head;
+
+    arena = flb_arena_create(1024);
+    first = flb_arena_alloc(arena, 64);
+    head = arena->head;
+
+    for (i = 0; i < 100; i++) {
+        flb_arena_alloc(arena, 100);
+    }
+    flb_arena_alloc(arena, 8192);
+
+    /* blocks are kept and reused, large ones are released */
+    flb_arena_reset(arena);
+    TEST_CHECK(arena->large == NULL);
+    TEST_CHECK(arena->head == head);
+
+    p = flb_arena_alloc(arena, 64);
+    TEST_CHECK(p == first);
+
+    flb_arena_destroy(arena);
+}
+
+void test_mark_rewind()
+{
+    char *a;
+    char *b;
+    struct flb_arena *arena;
+    struct flb_arena_mark mark;
+
+    arena = flb_arena_create(1024);
+    a = flb_arena_strndup(arena, "fluent-bit", 6);
+    TEST_CHECK(strcmp(a, "fluent") == 0);
+
+    flb_arena_mark(arena, &mark);
+    b = flb_arena_alloc(arena, 32);
+    flb_arena_alloc(arena, 900);
+    flb_arena_alloc(arena, 2048);
+    flb_arena_rewind(arena, &mark);
+
+    TEST_CHECK(arena->large == NULL);
+    TEST_CHECK(flb_arena_alloc(arena, 32) == b);
+    TEST_CHECK(strcmp(a, "fluent") == 0);
+
+    flb_arena_destroy(arena);
+}
+
+void test_realloc()
+{
+    int i;
+    char *p;
+    char *q;
+    struct flb_arena *arena;
+
+    arena = flb_arena_create(4096);
+    p = flb_arena_alloc(arena, 16);
+    memcpy(p, "0123456789abcdef", 16);
+
+    /* last allocation grows in place */
+    q = flb_arena_realloc(arena, p, 16, 64);
+    TEST_CHECK(q == p);
+
+    /* not the last one anymore, it's moved */
+    flb_arena_alloc(arena, 16);
+    q = flb_arena_realloc(arena, p, 64, 128);
+    TEST_CHECK(q != p);
+    TEST_CHECK(memcmp(q, "0123456789abcdef", 16) == 0);
+
+    /* grow beyond the block size */
+    for (i = 0; i < 8; i++) {
+        q = flb_arena_realloc(arena, q, 128 << i, 128 << (i + 1));
+        TEST_CHECK(q != NULL);
+    }
+    TEST_CHECK(memcmp(q, "0123456789abcdef", 16) == 0);
+
+    flb_arena_destroy(arena);
+}
+
+void test_buf_msgpack()
+{
+    int i;
+    size_t off = 0;
+    msgpack_packer pck;
+    msgpack_unpacked result;
+    struct flb_arena *arena;
+    struct flb_arena_buf buf;
+
+    arena = flb_arena_create(1024);
+    flb_arena_buf_init(&buf, arena, 16);
+    msgpack_packer_init(&pck, &buf, flb_arena_buf_write);
+
+    msgpack_pack_array(&pck, 1000);
+    for (i = 0; i < 1000; i++) {
+        msgpack_pack_int(&pck, i);
+    }
+
+    msgpack_unpacked_init(&result);
+    TEST_CHECK(msgpack_unpack_next(&result, buf.data, buf.size, &off) ==
+               MSGPACK_UNPACK_SUCCESS);
+    TEST_CHECK(off == buf.size);
+    TEST_CHECK(result.data.type == MSGPACK_OBJECT_ARRAY);
+    TEST_CHECK(result.data.via.array.size == 1000);
+    TEST_CHECK(result.data.via.array.ptr[999].via.u64 == 999);
+    msgpack_unpacked_destroy(&result);
+
+    flb_arena_destroy(arena);
+}
+
+TEST_LIST = {
+    {"alloc", test_alloc},
+    {"reset", test_reset},
+    {"mark_rewind", test_mark_rewind},
+    {"realloc", test_realloc},
+    {"buf_msgpack", test_buf_msgpack},
+    { 0 }
+};
@@ -0,0 +1,387 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit.h>
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_filter.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_output_plugin.h>
+#include <fluent-bit/flb_log_event_decoder.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "flb_tests_internal.h"
+
+#define RECORD    "[1448403340, {\"key\": \"value\"}]"
+
+/*
+ * The test filter blocks its worker until the gate is opened, the work
+ * handed over by the engine piles up in the meantime.
+ */
+struct gate_check {
+    int open;
+    int calls;
+    int events;
+    int last_seq;            /* last 'seq' value seen by the output */
+    int unordered;           /* records delivered out of order      */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static struct gate_check check;
+
+static int cb_gate_init(struct flb_filter_instance *f_ins,
+                        struct flb_config *config, void *data)
+{
+    return 0;
+}
+
+static int cb_gate_filter(const void *data, size_t bytes,
+                          const char *tag, int tag_len,
+                          void **out_buf, size_t *out_size,
+                          struct flb_filter_instance *f_ins,
+                          struct flb_input_instance *i_ins,
+                          void *context,
+                          struct flb_config *config)
+{
+    pthread_mutex_lock(&check.lock);
+    while (!check.open) {
+        pthread_cond_wait(&check.cond, &check.lock);
+    }
+    check.calls++;
+    pthread_mutex_unlock(&check.lock);
+
+    return FLB_FILTER_NOTOUCH;
+}
+
+static int cb_gate_exit(void *data, struct flb_config *config)
+{
+    return 0;
+}
+
+static struct flb_filter_plugin filter_gate_test_plugin = {
+    .name         = "gate_test",
+    .description  = "Filter workers test filter",
+    .cb_init      = cb_gate_init,
+    .cb_filter    = cb_gate_filter,
+    .cb_exit      = cb_gate_exit,
+    .flags        = 0,
+};
+
+static int cb_count_init(struct flb_output_instance *ins,
+                         struct flb_config *config, void *data)
+{
+    return 0;
+}
+
+static void cb_count_flush(struct flb_event_chunk *event_chunk,
+                           struct flb_output_flush *out_flush,
+                           struct flb_input_instance *i_ins,
+                           void *out_context,
+                           struct flb_config *config)
+{
+    int ret;
+    msgpack_object *seq;
+    struct flb_log_event event;
+    struct flb_log_event_decoder dec;
+
+    ret = flb_log_event_decoder_init(&dec, (char *) event_chunk->data,
+                                     event_chunk->size);
+    if (ret != FLB_EVENT_DECODER_SUCCESS) {
+        FLB_OUTPUT_RETURN(FLB_ERROR);
+    }
+
+    pthread_mutex_lock(&check.lock);
+    while (flb_log_event_decoder_next(&dec, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        seq = flb_log_event_decoder_get_value(&dec, &event, "seq", 3);
+        if (seq && seq->type == MSGPACK_OBJECT_POSITIVE_INTEGER) {
+            if ((int) seq->via.u64 != check.last_seq + 1) {
+                check.unordered++;
+            }
+            check.last_seq = seq->via.u64;
+        }
+    }
+    check.events += event_chunk->total_events;
+    pthread_mutex_unlock(&check.lock);
+
+    flb_log_event_decoder_destroy(&dec);
+
+    FLB_OUTPUT_RETURN(FLB_OK);
+}
+
+static int cb_count_exit(void *data, struct flb_config *config)
+{
+    return 0;
+}
+
+static struct flb_output_plugin out_count_test_plugin = {
+    .name         = "count_test",
+    .description  = "Filter workers test output",
+    .cb_init      = cb_count_init,
+    .cb_flush     = cb_count_flush,
+    .cb_exit      = cb_count_exit,
+    .event_type   = FLB_OUTPUT_LOGS,
+    .flags        = 0,
+};
+
+static void check_reset()
+{
+    memset(&check, 0, sizeof(check));
+    pthread_mutex_init(&check.lock, NULL);
+    pthread_cond_init(&check.cond, NULL);
+}
+
+static void gate_open()
+{
+    pthread_mutex_lock(&check.lock);
+    check.open = FLB_TRUE;
+    pthread_cond_broadcast(&check.cond);
+    pthread_mutex_unlock(&check.lock);
+}
+
+static int check_events()
+{
+    int events;
+
+    pthread_mutex_lock(&check.lock);
+    events = check.events;
+    pthread_mutex_unlock(&check.lock);
+
+    return events;
+}
+
+/* Wait up to 'ms' milliseconds for 'events' delivered records */
+static int wait_events(int events, int ms)
+{
+    int i;
+
+    for (i = 0; i < ms / 50; i++) {
+        if (check_events() >= events) {
+            return 0;
+        }
+        flb_time_msleep(50);
+    }
+
+    return -1;
+}
+
+static flb_ctx_t *gate_ctx_create(int *in_ffd, const char *mem_buf_limit)
+{
+    int ret;
+    int f_ffd;
+    int out_ffd;
+    flb_ctx_t *ctx;
+
+    ctx = flb_create();
+    if (!ctx) {
+        return NULL;
+    }
+
+    flb_service_set(ctx,
+                    "flush", "0.2",
+                    "grace", "3",
+                    "log_level", "error",
+                    "filter.workers", "1",
+                    NULL);
+
+    /* register the test plugins in the context */
+    mk_list_add(&filter_gate_test_plugin._head, &ctx->config->filter_plugins);
+    mk_list_add(&out_count_test_plugin._head, &ctx->config->out_plugins);
+
+    *in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(*in_ffd >= 0);
+    flb_input_set(ctx, *in_ffd, "tag", "test", NULL);
+    if (mem_buf_limit) {
+        flb_input_set(ctx, *in_ffd, "mem_buf_limit", mem_buf_limit, NULL);
+    }
+
+    f_ffd = flb_filter(ctx, (char *) "gate_test", NULL);
+    TEST_CHECK(f_ffd >= 0);
+    ret = flb_filter_set(ctx, f_ffd, "match", "*", NULL);
+    TEST_CHECK(ret == 0);
+
+    out_ffd = flb_output(ctx, (char *) "count_test", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd, "match", "*", NULL);
+    TEST_CHECK(ret == 0);
+
+    return ctx;
+}
+
+static void gate_ctx_destroy(flb_ctx_t *ctx)
+{
+    flb_stop(ctx);
+
+    /* the plugins are static, do not let the context release them */
+    mk_list_del(&filter_gate_test_plugin._head);
+    mk_list_del(&out_count_test_plugin._head);
+    flb_destroy(ctx);
+}
+
+/*
+ * More appends than the worker ring buffer can hold: the engine waits for
+ * the worker instead of dropping the records.
+ */
+static void test_saturated_worker_no_drop()
+{
+    int i;
+    int ret;
+    int in_ffd;
+    int pushes = 1100;
+    flb_ctx_t *ctx;
+
+    check_reset();
+
+    ctx = gate_ctx_create(&in_ffd, NULL);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < pushes; i++) {
+        flb_lib_push(ctx, in_ffd, RECORD, sizeof(RECORD) - 1);
+        flb_time_msleep(1);
+    }
+
+    /* the engine waits for room in the ring buffer, let it go on */
+    flb_time_msleep(500);
+    gate_open();
+
+    ret = wait_events(pushes, 10000);
+    TEST_CHECK(ret == 0);
+    TEST_MSG("delivered %i of %i records", check_events(), pushes);
+    TEST_CHECK(check_events() == pushes);
+
+    gate_ctx_destroy(ctx);
+}
+
+/*
+ * A saturated worker neither blocks the engine nor reorders the records:
+ * everything is ingested while the worker is stuck and delivered in order
+ * once it resumes.
+ */
+static void test_saturated_worker_order()
+{
+    int i;
+    int ret;
+    int len;
+    int in_ffd;
+    int pushes = 1500;
+    char record[64];
+    size_t queued = 0;
+    flb_ctx_t *ctx;
+    struct flb_input_instance *ins;
+
+    check_reset();
+
+    ctx = gate_ctx_create(&in_ffd, NULL);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    ins = mk_list_entry_first(&ctx->config->inputs,
+                              struct flb_input_instance, _head);
+
+    for (i = 1; i <= pushes; i++) {
+        len = snprintf(record, sizeof(record),
+                       "[1448403340, {\"seq\": %i}]", i);
+        flb_lib_push(ctx, in_ffd, record, len);
+        flb_time_msleep(1);
+
+        /* the first record is the smallest one, it sets a lower bound */
+        while (i == 1 && ins->mem_filter_size == 0) {
+            flb_time_msleep(10);
+        }
+        if (i == 1) {
+            queued = ins->mem_filter_size * pushes;
+        }
+    }
+
+    /* the engine keeps ingesting: all the records wait for the worker */
+    for (i = 0; i < 100 && ins->mem_filter_size < queued; i++) {
+        flb_time_msleep(50);
+    }
+    TEST_CHECK(ins->mem_filter_size >= queued);
+    TEST_MSG("mem_filter_size=%zu, expected at least %zu",
+             ins->mem_filter_size, queued);
+
+    gate_open();
+
+    ret = wait_events(pushes, 10000);
+    TEST_CHECK(ret == 0);
+    TEST_MSG("delivered %i of %i records", check_events(), pushes);
+
+    pthread_mutex_lock(&check.lock);
+    TEST_CHECK(check.unordered == 0);
+    TEST_MSG("%i records out of order", check.unordered);
+    TEST_CHECK(check.last_seq == pushes);
+    pthread_mutex_unlock(&check.lock);
+
+    gate_ctx_destroy(ctx);
+}
+
+/* Records held by the filter workers count against mem_buf_limit */
+static void test_mem_buf_limit_pending()
+{
+    int i;
+    int ret;
+    int in_ffd;
+    flb_ctx_t *ctx;
+    struct flb_input_instance *ins;
+
+    check_reset();
+
+    ctx = gate_ctx_create(&in_ffd, "1k");
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    ins = mk_list_entry_first(&ctx->config->inputs,
+                              struct flb_input_instance, _head);
+
+    /* ~25 bytes per record, the limit is reached while the gate is closed */
+    for (i = 0; i < 100; i++) {
+        flb_lib_push(ctx, in_ffd, RECORD, sizeof(RECORD) - 1);
+        flb_time_msleep(2);
+    }
+    flb_time_msleep(200);
+
+    TEST_CHECK(ins->mem_filter_size > 0);
+    TEST_MSG("mem_filter_size=%zu", ins->mem_filter_size);
+    TEST_CHECK(ins->mem_buf_status == FLB_INPUT_PAUSED);
+
+    gate_open();
+
+    /* once written back and flushed, the input is resumed */
+    for (i = 0; i < 100; i++) {
+        if (ins->mem_filter_size == 0 &&
+            ins->mem_buf_status == FLB_INPUT_RUNNING) {
+            break;
+        }
+        flb_time_msleep(50);
+    }
+    TEST_CHECK(ins->mem_filter_size == 0);
+    TEST_CHECK(ins->mem_buf_status == FLB_INPUT_RUNNING);
+    TEST_CHECK(check_events() > 0);
+
+    gate_ctx_destroy(ctx);
+}
+
+TEST_LIST = {
+    {"saturated_worker_no_drop", test_saturated_worker_no_drop},
+    {"saturated_worker_order", test_saturated_worker_order},
+    {"mem_buf_limit_pending", test_mem_buf_limit_pending},
+    { 0 }
+};
@@ -0,0 +1,302 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_hpack.h>
+
+#include "flb_tests_internal.h"
+
+#define MAX_HEADERS 16
+
+struct header_list {
+    int n;
+    flb_sds_t names[MAX_HEADERS];
+    flb_sds_t values[MAX_HEADERS];
+};
+
+struct header {
+    const char *name;
+    const char *value;
+};
+
+static int cb_header(void *data, const char *name, size_t name_len,
+                     const char *value, size_t value_len)
+{
+    struct header_list *list = data;
+
+    if (list->n == MAX_HEADERS) {
+        return -1;
+    }
+    list->names[list->n] = flb_sds_create_len(name, name_len);
+    list->values[list->n] = flb_sds_create_len(value, value_len);
+    list->n++;
+
+    return 0;
+}
+
+static void header_list_reset(struct header_list *list)
+{
+    int i;
+
+    for (i = 0; i < list->n; i++) {
+        flb_sds_destroy(list->names[i]);
+        flb_sds_destroy(list->values[i]);
+    }
+    list->n = 0;
+}
+
+static int hex_decode(const char *hex, unsigned char *out)
+{
+    int n = 0;
+    unsigned int b;
+
+    while (*hex) {
+        if (*hex == ' ') {
+            hex++;
+            continue;
+        }
+        sscanf(hex, "%2x", &b);
+        out[n++] = b;
+        hex += 2;
+    }
+
+    return n;
+}
+
+static void check_block(struct flb_hpack_table *table, const char *hex,
+                        struct header *expected, int n)
+{
+    int i;
+    int len;
+    int ret;
+    unsigned char buf[256];
+    struct header_list list = {0};
+
+    len = hex_decode(hex, buf);
+    ret = flb_hpack_decode(table, buf, len, cb_header, &list);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(list.n == n);
+
+    for (i = 0; i < n && i < list.n; i++) {
+        TEST_CHECK(strcmp(list.names[i], expected[i].name) == 0);
+        TEST_CHECK(strcmp(list.values[i], expected[i].value) == 0);
+        TEST_MSG("header %i: %s: %s", i, list.names[i], list.values[i]);
+    }
+    header_list_reset(&list);
+}
+
+/* RFC 7541 C.4: requests with Huffman coding */
+void test_decode_requests()
+{
+    struct flb_hpack_table *table;
+    struct header req1[] = {
+        {":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+        {":authority", "www.example.com"}
+    };
+    struct header req2[] = {
+        {":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+        {":authority", "www.example.com"}, {"cache-control", "no-cache"}
+    };
+    struct header req3[] = {
+        {":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"},
+        {":authority", "www.example.com"}, {"custom-key", "custom-value"}
+    };
+
+    table = flb_hpack_table_create(FLB_HPACK_TABLE_SIZE);
+    TEST_CHECK(table != NULL);
+
+    check_block(table, "828684418cf1e3c2e5f23a6ba0ab90f4ff", req1, 4);
+    TEST_CHECK(table->count == 1 && table->size == 57);
+
+    check_block(table, "828684be5886a8eb10649cbf", req2, 5);
+    TEST_CHECK(table->count == 2 && table->size == 110);
+
+    check_block(table, "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+                req3, 5);
+    TEST_CHECK(table->count == 3 && table->size == 164);
+
+    flb_hpack_table_destroy(table);
+}
+
+/* RFC 7541 C.6: responses with Huffman coding and evictions */
+void test_decode_responses()
+{
+    struct flb_hpack_table *table;
+    struct header res1[] = {
+        {":status", "302"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+        {"location", "https://www.example.com"}
+    };
+    struct header res2[] = {
+        {":status", "307"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+        {"location", "https://www.example.com"}
+    };
+    struct header res3[] = {
+        {":status", "200"}, {"cache-control", "private"},
+        {"date", "Mon, 21 Oct 2013 20:13:22 GMT"},
+        {"location", "https://www.example.com"},
+        {"content-encoding", "gzip"},
+        {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; "
+                       "version=1"}
+    };
+
+    table = flb_hpack_table_create(256);
+    TEST_CHECK(table != NULL);
+
+    check_block(table,
+                "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166"
+                "e082a62d1bff6e919d29ad171863c78f0b97c8e9ae82ae43d3",
+                res1, 4);
+    TEST_CHECK(table->count == 4 && table->size == 222);
+
+    check_block(table, "4883640effc1c0bf", res2, 4);
+    TEST_CHECK(table->count == 4 && table->size == 222);
+
+    check_block(table,
+                "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a83"
+                "9bd9ab77ad94e7821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1"
+                "ab270fb5291f9587316065c003ed4ee5b1063d5007",
+                res3, 6);
+    TEST_CHECK(table->count == 3 && table->size == 215);
+
+    flb_hpack_table_destroy(table);
+}
+
+void test_decode_errors()
+{
+    int len;
+    int ret;
+    unsigned char buf[64];
+    struct header_list list = {0};
+    struct flb_hpack_table *table;
+
+    table = flb_hpack_table_create(FLB_HPACK_TABLE_SIZE);
+    TEST_CHECK(table != NULL);
+
+    /* index 0 and an index out of the tables */
+    len = hex_decode("80", buf);
+    ret = flb_hpack_decode(table, buf, len, cb_header, &list);
+    TEST_CHECK(ret == -1);
+
+    len = hex_decode("be", buf);
+    ret = flb_hpack_decode(table, buf, len, cb_header, &list);
+    TEST_CHECK(ret == -1);
+
+    /* truncated string literal */
+    len = hex_decode("400a637573746f6d", buf);
+    ret = flb_hpack_decode(table, buf, len, cb_header, &list);
+    TEST_CHECK(ret == -1);
+
+    /* table size update above the advertised limit */
+    len = hex_decode("3fe21f", buf);
+    ret = flb_hpack_decode(table, buf, len, cb_header, &list);
+    TEST_CHECK(ret == -1);
+
+    /* Huffman padding longer than 7 bits */
+    len = hex_decode("0082ffff", buf);
+    ret = flb_hpack_decode(table, buf, len, cb_header, &list);
+    TEST_CHECK(ret == -1);
+
+    header_list_reset(&list);
+    flb_hpack_table_destroy(table);
+}
+
+void test_huffman()
+{
+    int i;
+    int ret;
+    flb_sds_t enc;
+    flb_sds_t dec;
+    unsigned char all[256];
+    const char *str = "www.example.com";
+
+    enc = flb_sds_create_size(64);
+    dec = flb_sds_create_size(64);
+
+    ret = flb_hpack_huffman_encode(&enc, (unsigned char *) str, strlen(str));
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_sds_len(enc) == 12);
+    TEST_CHECK(memcmp(enc, "\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff",
+                      12) == 0);
+
+    ret = flb_hpack_huffman_decode(&dec, (unsigned char *) enc,
+                                   flb_sds_len(enc));
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(strcmp(dec, str) == 0);
+
+    /* every symbol */
+    for (i = 0; i < 256; i++) {
+        all[i] = i;
+    }
+    flb_sds_len_set(enc, 0);
+    flb_sds_len_set(dec, 0);
+    ret = flb_hpack_huffman_encode(&enc, all, sizeof(all));
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_sds_len(enc) ==
+               flb_hpack_huffman_encoded_len(all, sizeof(all)));
+    ret = flb_hpack_huffman_decode(&dec, (unsigned char *) enc,
+                                   flb_sds_len(enc));
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_sds_len(dec) == sizeof(all));
+    TEST_CHECK(memcmp(dec, all, sizeof(all)) == 0);
+
+    flb_sds_destroy(enc);
+    flb_sds_destroy(dec);
+}
+
+void test_encode()
+{
+    int i;
+    int ret;
+    flb_sds_t buf;
+    struct header_list list = {0};
+    struct flb_hpack_table *table;
+    struct header headers[] = {
+        {":method", "POST"}, {":scheme", "https"}, {":path", "/loki/api/v1/push"},
+        {":authority", "localhost:3100"}, {"content-type", "application/json"},
+        {"authorization", "Basic Zm9vOmJhcg=="},
+        {"x-custom-header", "custom value"}, {"content-length", "0"}
+    };
+
+    buf = flb_sds_create_size(256);
+    for (i = 0; i < 8; i++) {
+        ret = flb_hpack_encode_header(&buf,
+                                      headers[i].name, strlen(headers[i].name),
+                                      headers[i].value,
+                                      strlen(headers[i].value));
+        TEST_CHECK(ret == 0);
+    }
+
+    /* static table matches are sent as an index */
+    TEST_CHECK((unsigned char) buf[0] == 0x83);
+    TEST_CHECK((unsigned char) buf[1] == 0x87);
+    TEST_CHECK((unsigned char) buf[2] == 0x04);
+
+    table = flb_hpack_table_create(FLB_HPACK_TABLE_SIZE);
+    ret = flb_hpack_decode(table, (unsigned char *) buf, flb_sds_len(buf),
+                           cb_header, &list);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(list.n == 8);
+    for (i = 0; i < 8 && i < list.n; i++) {
+        TEST_CHECK(strcmp(list.names[i], headers[i].name) == 0);
+        TEST_CHECK(strcmp(list.values[i], headers[i].value) == 0);
+    }
+
+    /* the encoder never adds entries to the peer table */
+    TEST_CHECK(table->count == 0);
+
+    header_list_reset(&list);
+    flb_hpack_table_destroy(table);
+    flb_sds_destroy(buf);
+}
+
+TEST_LIST = {
+    {"decode_requests", test_decode_requests},
+    {"decode_responses", test_decode_responses},
+    {"decode_errors", test_decode_errors},
+    {"huffman", test_huffman},
+    {"encode", test_encode},
+    { 0 }
+};
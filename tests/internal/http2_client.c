@@ -0,0 +1,800 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit.h>
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_output_plugin.h>
+
+#include <cfl/cfl.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "flb_tests_internal.h"
+
+#define RECORD          "[1448403340, {\"key\": \"value\"}]"
+#define MAX_INPUTS      4
+
+#define PREFACE_SIZE    24
+#define FRAME_HDR       9
+#define MAX_CONNS       16
+#define MAX_PENDING     64
+#define CONN_BUF_SIZE   (64 * 1024)
+
+/*
+ * Minimal h2c server (prior knowledge): every request gets a ':status 200'
+ * response without body. Its behavior is tuned by each test to check how
+ * the client multiplexes streams and recovers from failures.
+ */
+struct h2_conn {
+    int fd;
+    int id;                         /* accepted connections before it   */
+    int preface;
+    int open;                       /* requests started, not answered   */
+    int requests;
+    int answered;
+    int goaway;                     /* GOAWAY sent, no more answers     */
+    uint64_t ts_pending;
+    int n_pending;
+    uint32_t pending[MAX_PENDING];  /* complete requests to answer      */
+    size_t len;
+    unsigned char buf[CONN_BUF_SIZE];
+};
+
+struct h2_server {
+    int fd;
+    int port;
+    int stop;
+
+    /* behavior */
+    int max_streams;                /* SETTINGS_MAX_CONCURRENT_STREAMS  */
+    int hold;                       /* answer once N requests are ready */
+    int hold_ms;                    /* ... or after this time           */
+    int goaway_after;               /* first connection: GOAWAY after N */
+    int drop_at;                    /* first connection: close it at N  */
+    int flood;                      /* first connection: answer with an
+                                       endless header block              */
+
+    /* results */
+    int goaway_recv;                /* GOAWAY frames sent by the client  */
+    uint32_t goaway_error;          /* error code of the last one        */
+    int connections;
+    int requests;
+    int answered;
+    int max_open;
+
+    struct h2_conn *conns[MAX_CONNS];
+    pthread_mutex_t lock;
+    pthread_t tid;
+};
+
+static struct h2_server server;
+
+/* Requests completed with a 200 response, as seen by the test output */
+static int client_ok;
+static pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms()
+{
+    return cfl_time_now() / 1000000;
+}
+
+static void frame_send(struct h2_conn *hc, int type, int flags, uint32_t id,
+                       const void *payload, size_t len)
+{
+    unsigned char hdr[FRAME_HDR];
+
+    hdr[0] = (len >> 16) & 0xff;
+    hdr[1] = (len >> 8) & 0xff;
+    hdr[2] = len & 0xff;
+    hdr[3] = type;
+    hdr[4] = flags;
+    hdr[5] = (id >> 24) & 0x7f;
+    hdr[6] = (id >> 16) & 0xff;
+    hdr[7] = (id >> 8) & 0xff;
+    hdr[8] = id & 0xff;
+
+    send(hc->fd, hdr, sizeof(hdr), MSG_NOSIGNAL);
+    if (len > 0) {
+        send(hc->fd, payload, len, MSG_NOSIGNAL);
+    }
+}
+
+static void put_u32(unsigned char *p, uint32_t val)
+{
+    p[0] = (val >> 24) & 0xff;
+    p[1] = (val >> 16) & 0xff;
+    p[2] = (val >> 8) & 0xff;
+    p[3] = val & 0xff;
+}
+
+static void conn_close(struct h2_server *srv, int i)
+{
+    close(srv->conns[i]->fd);
+    flb_free(srv->conns[i]);
+    srv->conns[i] = NULL;
+}
+
+static void conn_accept(struct h2_server *srv)
+{
+    int i;
+    int fd;
+    unsigned char settings[6];
+    struct h2_conn *hc;
+
+    fd = accept(srv->fd, NULL, NULL);
+    if (fd == -1) {
+        return;
+    }
+
+    for (i = 0; i < MAX_CONNS; i++) {
+        if (srv->conns[i] == NULL) {
+            break;
+        }
+    }
+    hc = (i < MAX_CONNS) ? flb_calloc(1, sizeof(struct h2_conn)) : NULL;
+    if (!hc) {
+        close(fd);
+        return;
+    }
+    hc->fd = fd;
+
+    pthread_mutex_lock(&srv->lock);
+    hc->id = srv->connections++;
+    pthread_mutex_unlock(&srv->lock);
+    srv->conns[i] = hc;
+
+    if (srv->max_streams > 0) {
+        settings[0] = 0;
+        settings[1] = 0x3;
+        put_u32(settings + 2, srv->max_streams);
+        frame_send(hc, 0x4, 0, 0, settings, sizeof(settings));
+    }
+    else {
+        frame_send(hc, 0x4, 0, 0, NULL, 0);
+    }
+}
+
+/* A request is complete, returns -1 if the connection must be dropped */
+static int request_done(struct h2_server *srv, struct h2_conn *hc,
+                        uint32_t id)
+{
+    pthread_mutex_lock(&srv->lock);
+    srv->requests++;
+    pthread_mutex_unlock(&srv->lock);
+
+    hc->requests++;
+    if (srv->drop_at > 0 && hc->id == 0 && hc->requests >= srv->drop_at) {
+        return -1;
+    }
+
+    if (hc->n_pending < MAX_PENDING) {
+        if (hc->n_pending == 0) {
+            hc->ts_pending = now_ms();
+        }
+        hc->pending[hc->n_pending++] = id;
+    }
+
+    return 0;
+}
+
+static void conn_answer(struct h2_server *srv, struct h2_conn *hc)
+{
+    int i;
+    uint32_t last = 0;
+    unsigned char status = 0x88;     /* indexed ':status 200' */
+    unsigned char goaway[8];
+    static unsigned char flood[16384];
+
+    if (hc->n_pending == 0 || hc->goaway) {
+        return;
+    }
+    if (hc->n_pending < srv->hold &&
+        now_ms() - hc->ts_pending < (uint64_t) srv->hold_ms) {
+        return;
+    }
+
+    /* a header block that never ends: HEADERS and CONTINUATION frames */
+    if (srv->flood && hc->id == 0) {
+        memset(flood, 0x40, sizeof(flood));
+        frame_send(hc, 0x1, 0x1, hc->pending[0], flood, sizeof(flood));
+        for (i = 0; i < 8; i++) {
+            frame_send(hc, 0x9, 0, hc->pending[0], flood, sizeof(flood));
+        }
+        hc->n_pending = 0;
+        hc->goaway = FLB_TRUE;
+        return;
+    }
+
+    for (i = 0; i < hc->n_pending; i++) {
+        frame_send(hc, 0x1, 0x1 | 0x4, hc->pending[i], &status, 1);
+        if (hc->pending[i] > last) {
+            last = hc->pending[i];
+        }
+        hc->open--;
+        hc->answered++;
+
+        pthread_mutex_lock(&srv->lock);
+        srv->answered++;
+        pthread_mutex_unlock(&srv->lock);
+    }
+    hc->n_pending = 0;
+
+    if (srv->goaway_after > 0 && hc->id == 0 &&
+        hc->answered >= srv->goaway_after) {
+        put_u32(goaway, last);
+        put_u32(goaway + 4, 0);
+        frame_send(hc, 0x7, 0, 0, goaway, sizeof(goaway));
+        hc->goaway = FLB_TRUE;
+    }
+}
+
+/* Process the frames received, returns -1 if the connection must close */
+static int conn_process(struct h2_server *srv, struct h2_conn *hc)
+{
+    int type;
+    int flags;
+    size_t off = 0;
+    uint32_t len;
+    uint32_t id;
+    unsigned char wu[4];
+    unsigned char *p;
+
+    if (!hc->preface) {
+        if (hc->len < PREFACE_SIZE) {
+            return 0;
+        }
+        hc->preface = FLB_TRUE;
+        off = PREFACE_SIZE;
+    }
+
+    while (hc->len - off >= FRAME_HDR) {
+        p = hc->buf + off;
+        len = (p[0] << 16) | (p[1] << 8) | p[2];
+        if (hc->len - off < FRAME_HDR + len) {
+            break;
+        }
+        type = p[3];
+        flags = p[4];
+        id = ((p[5] & 0x7f) << 24) | (p[6] << 16) | (p[7] << 8) | p[8];
+        off += FRAME_HDR + len;
+
+        if (type == 0x4 && !(flags & 0x1)) {
+            frame_send(hc, 0x4, 0x1, 0, NULL, 0);
+        }
+        else if (type == 0x1) {
+            hc->open++;
+            pthread_mutex_lock(&srv->lock);
+            if (hc->open > srv->max_open) {
+                srv->max_open = hc->open;
+            }
+            pthread_mutex_unlock(&srv->lock);
+
+            if ((flags & 0x1) && request_done(srv, hc, id) == -1) {
+                return -1;
+            }
+        }
+        else if (type == 0x7 && len >= 8) {
+            pthread_mutex_lock(&srv->lock);
+            srv->goaway_recv++;
+            srv->goaway_error = ((uint32_t) p[FRAME_HDR + 4] << 24) |
+                                (p[FRAME_HDR + 5] << 16) |
+                                (p[FRAME_HDR + 6] << 8) | p[FRAME_HDR + 7];
+            pthread_mutex_unlock(&srv->lock);
+        }
+        else if (type == 0x0) {
+            if (len > 0) {
+                put_u32(wu, len);
+                frame_send(hc, 0x8, 0, 0, wu, sizeof(wu));
+                frame_send(hc, 0x8, 0, id, wu, sizeof(wu));
+            }
+            if ((flags & 0x1) && request_done(srv, hc, id) == -1) {
+                return -1;
+            }
+        }
+    }
+
+    memmove(hc->buf, hc->buf + off, hc->len - off);
+    hc->len -= off;
+
+    return 0;
+}
+
+static void *server_worker(void *data)
+{
+    int i;
+    int n;
+    ssize_t bytes;
+    struct pollfd pfd[MAX_CONNS + 1];
+    struct h2_conn *map[MAX_CONNS + 1];
+    struct h2_conn *hc;
+    struct h2_server *srv = data;
+
+    while (!__atomic_load_n(&srv->stop, __ATOMIC_ACQUIRE)) {
+        n = 0;
+        pfd[n].fd = srv->fd;
+        pfd[n].events = POLLIN;
+        map[n++] = NULL;
+        for (i = 0; i < MAX_CONNS; i++) {
+            if (srv->conns[i]) {
+                pfd[n].fd = srv->conns[i]->fd;
+                pfd[n].events = POLLIN;
+                map[n++] = srv->conns[i];
+            }
+        }
+
+        if (poll(pfd, n, 20) > 0) {
+            if (pfd[0].revents & POLLIN) {
+                conn_accept(srv);
+            }
+            for (i = 1; i < n; i++) {
+                if (!(pfd[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    continue;
+                }
+                hc = map[i];
+                bytes = recv(hc->fd, hc->buf + hc->len,
+                             CONN_BUF_SIZE - hc->len, 0);
+                if (bytes > 0) {
+                    hc->len += bytes;
+                    bytes = conn_process(srv, hc);
+                }
+                else {
+                    bytes = -1;
+                }
+                if (bytes == -1) {
+                    hc->fd = -hc->fd - 1;
+                }
+            }
+        }
+
+        for (i = 0; i < MAX_CONNS; i++) {
+            hc = srv->conns[i];
+            if (!hc) {
+                continue;
+            }
+            if (hc->fd < 0) {
+                hc->fd = -hc->fd - 1;
+                conn_close(srv, i);
+                continue;
+            }
+            conn_answer(srv, hc);
+        }
+    }
+
+    for (i = 0; i < MAX_CONNS; i++) {
+        if (srv->conns[i]) {
+            conn_close(srv, i);
+        }
+    }
+
+    return NULL;
+}
+
+static int server_start(struct h2_server *srv)
+{
+    int on = 1;
+    socklen_t len;
+    struct sockaddr_in addr;
+
+    srv->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv->fd == -1) {
+        return -1;
+    }
+    setsockopt(srv->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    len = sizeof(addr);
+    if (bind(srv->fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+        listen(srv->fd, 16) == -1 ||
+        getsockname(srv->fd, (struct sockaddr *) &addr, &len) == -1) {
+        close(srv->fd);
+        return -1;
+    }
+    srv->port = ntohs(addr.sin_port);
+
+    pthread_mutex_init(&srv->lock, NULL);
+    if (pthread_create(&srv->tid, NULL, server_worker, srv) != 0) {
+        close(srv->fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void server_stop(struct h2_server *srv)
+{
+    __atomic_store_n(&srv->stop, FLB_TRUE, __ATOMIC_RELEASE);
+    pthread_join(srv->tid, NULL);
+    close(srv->fd);
+}
+
+static int server_get(int *value)
+{
+    int ret;
+
+    pthread_mutex_lock(&server.lock);
+    ret = *value;
+    pthread_mutex_unlock(&server.lock);
+
+    return ret;
+}
+
+/* Test output: POST the chunk with net.http2 to the test server */
+struct h2_out_ctx {
+    struct flb_upstream *u;
+};
+
+static int cb_h2_init(struct flb_output_instance *ins,
+                      struct flb_config *config, void *data)
+{
+    struct h2_out_ctx *ctx;
+
+    ctx = flb_calloc(1, sizeof(struct h2_out_ctx));
+    if (!ctx) {
+        return -1;
+    }
+
+    /* load the net.* properties */
+    if (flb_output_config_map_set(ins, ctx) == -1) {
+        flb_free(ctx);
+        return -1;
+    }
+
+    ctx->u = flb_upstream_create(config, "127.0.0.1", server.port,
+                                 FLB_IO_TCP, NULL);
+    if (!ctx->u) {
+        flb_free(ctx);
+        return -1;
+    }
+    flb_output_upstream_set(ctx->u, ins);
+
+    /* keep the HTTP/2 connection between the flush rounds */
+    flb_stream_enable_keepalive(&ctx->u->base);
+    flb_output_set_context(ins, ctx);
+
+    return 0;
+}
+
+static void cb_h2_flush(struct flb_event_chunk *event_chunk,
+                        struct flb_output_flush *out_flush,
+                        struct flb_input_instance *i_ins,
+                        void *out_context,
+                        struct flb_config *config)
+{
+    int ret;
+    size_t b_sent;
+    struct flb_connection *conn;
+    struct flb_http_client *c;
+    struct h2_out_ctx *ctx = out_context;
+
+    conn = flb_upstream_conn_get(ctx->u);
+    if (!conn) {
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    c = flb_http_client(conn, FLB_HTTP_POST, "/",
+                        event_chunk->data, event_chunk->size,
+                        "127.0.0.1", server.port, NULL, 0);
+    if (!c) {
+        flb_upstream_conn_release(conn);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    ret = flb_http_do(c, &b_sent);
+    if (ret == 0 && c->resp.status == 200) {
+        pthread_mutex_lock(&client_lock);
+        client_ok++;
+        pthread_mutex_unlock(&client_lock);
+        ret = FLB_OK;
+    }
+    else {
+        ret = FLB_RETRY;
+    }
+
+    flb_http_client_destroy(c);
+    flb_upstream_conn_release(conn);
+
+    FLB_OUTPUT_RETURN(ret);
+}
+
+static int cb_h2_exit(void *data, struct flb_config *config)
+{
+    struct h2_out_ctx *ctx = data;
+
+    if (ctx) {
+        flb_upstream_destroy(ctx->u);
+        flb_free(ctx);
+    }
+
+    return 0;
+}
+
+static struct flb_output_plugin out_h2_test_plugin = {
+    .name         = "h2_test",
+    .description  = "HTTP/2 client test output",
+    .cb_init      = cb_h2_init,
+    .cb_flush     = cb_h2_flush,
+    .cb_exit      = cb_h2_exit,
+    .event_type   = FLB_OUTPUT_LOGS,
+    .flags        = FLB_OUTPUT_NET,
+};
+
+static int client_get_ok()
+{
+    int ret;
+
+    pthread_mutex_lock(&client_lock);
+    ret = client_ok;
+    pthread_mutex_unlock(&client_lock);
+
+    return ret;
+}
+
+/* Wait up to 'ms' milliseconds for 'n' successful requests */
+static int wait_ok(int n, int ms)
+{
+    int i;
+
+    for (i = 0; i < ms / 50; i++) {
+        if (client_get_ok() >= n) {
+            return 0;
+        }
+        flb_time_msleep(50);
+    }
+
+    return -1;
+}
+
+/* Start the server with the given behavior and a context sending to it */
+static flb_ctx_t *h2_ctx_create(int *in_ffd)
+{
+    int i;
+    int ret;
+    int out_ffd;
+    char tag[16];
+    flb_ctx_t *ctx;
+
+    client_ok = 0;
+
+    ret = server_start(&server);
+    if (!TEST_CHECK(ret == 0)) {
+        return NULL;
+    }
+
+    ctx = flb_create();
+    if (!ctx) {
+        server_stop(&server);
+        return NULL;
+    }
+
+    flb_service_set(ctx,
+                    "flush", "0.2",
+                    "grace", "2",
+                    "log_level", "error",
+                    "scheduler.base", "1",
+                    "scheduler.cap", "1",
+                    NULL);
+
+    /* register the test output in the context plugins */
+    mk_list_add(&out_h2_test_plugin._head, &ctx->config->out_plugins);
+
+    for (i = 0; i < MAX_INPUTS; i++) {
+        snprintf(tag, sizeof(tag), "in%i", i);
+        in_ffd[i] = flb_input(ctx, (char *) "lib", NULL);
+        TEST_CHECK(in_ffd[i] >= 0);
+        flb_input_set(ctx, in_ffd[i], "tag", tag, NULL);
+    }
+
+    out_ffd = flb_output(ctx, (char *) "h2_test", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd,
+                         "match", "*",
+                         "net.http2", "on",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    return ctx;
+}
+
+static void h2_ctx_destroy(flb_ctx_t *ctx)
+{
+    flb_stop(ctx);
+
+    /* the plugin is static, do not let the context release it */
+    mk_list_del(&out_h2_test_plugin._head);
+    flb_destroy(ctx);
+
+    server_stop(&server);
+}
+
+/* One request first: the next ones can share its HTTP/2 connection */
+static void push_warmup(flb_ctx_t *ctx, int *in_ffd)
+{
+    flb_lib_push(ctx, in_ffd[0], RECORD, sizeof(RECORD) - 1);
+    TEST_CHECK(wait_ok(1, 3000) == 0);
+}
+
+static void push_all(flb_ctx_t *ctx, int *in_ffd)
+{
+    int i;
+
+    for (i = 0; i < MAX_INPUTS; i++) {
+        flb_lib_push(ctx, in_ffd[i], RECORD, sizeof(RECORD) - 1);
+    }
+}
+
+/* Concurrent flushes are streams of the same connection */
+static void test_concurrent_streams()
+{
+    int in_ffd[MAX_INPUTS];
+    flb_ctx_t *ctx;
+
+    memset(&server, 0, sizeof(server));
+    server.hold = MAX_INPUTS;
+    server.hold_ms = 3000;
+
+    ctx = h2_ctx_create(in_ffd);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    server.hold = 1;
+    push_warmup(ctx, in_ffd);
+
+    /* the server answers once the four requests are in flight together */
+    server.hold = MAX_INPUTS;
+    push_all(ctx, in_ffd);
+
+    TEST_CHECK(wait_ok(1 + MAX_INPUTS, 5000) == 0);
+    TEST_CHECK(server_get(&server.max_open) == MAX_INPUTS);
+    TEST_MSG("max open streams=%i", server_get(&server.max_open));
+    TEST_CHECK(server_get(&server.connections) == 1);
+    TEST_MSG("connections=%i", server_get(&server.connections));
+
+    h2_ctx_destroy(ctx);
+}
+
+/* SETTINGS_MAX_CONCURRENT_STREAMS is honored, other connections are opened */
+static void test_stream_limit()
+{
+    int in_ffd[MAX_INPUTS];
+    flb_ctx_t *ctx;
+
+    memset(&server, 0, sizeof(server));
+    server.max_streams = 2;
+    server.hold = 1;
+    server.hold_ms = 0;
+
+    ctx = h2_ctx_create(in_ffd);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    push_warmup(ctx, in_ffd);
+
+    server.hold = MAX_INPUTS;
+    server.hold_ms = 500;
+    push_all(ctx, in_ffd);
+
+    TEST_CHECK(wait_ok(1 + MAX_INPUTS, 5000) == 0);
+    TEST_CHECK(server_get(&server.max_open) <= 2);
+    TEST_MSG("max open streams=%i", server_get(&server.max_open));
+    TEST_CHECK(server_get(&server.connections) >= 2);
+    TEST_CHECK(server_get(&server.answered) == 1 + MAX_INPUTS);
+
+    h2_ctx_destroy(ctx);
+}
+
+/* After GOAWAY the connection is not used for new requests */
+static void test_goaway()
+{
+    int in_ffd[MAX_INPUTS];
+    flb_ctx_t *ctx;
+
+    memset(&server, 0, sizeof(server));
+    server.hold = 1;
+    server.goaway_after = 1;
+
+    ctx = h2_ctx_create(in_ffd);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    push_warmup(ctx, in_ffd);
+    flb_time_msleep(200);
+
+    push_all(ctx, in_ffd);
+
+    TEST_CHECK(wait_ok(1 + MAX_INPUTS, 8000) == 0);
+    TEST_MSG("ok=%i", client_get_ok());
+    TEST_CHECK(server_get(&server.connections) >= 2);
+    TEST_CHECK(server_get(&server.answered) == 1 + MAX_INPUTS);
+
+    h2_ctx_destroy(ctx);
+}
+
+/* A connection lost with streams in flight: they fail and are retried */
+static void test_connection_loss()
+{
+    int in_ffd[MAX_INPUTS];
+    flb_ctx_t *ctx;
+
+    memset(&server, 0, sizeof(server));
+    server.hold = 1;
+    server.drop_at = 3;
+
+    ctx = h2_ctx_create(in_ffd);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    push_warmup(ctx, in_ffd);
+
+    /* the connection is closed with the new requests unanswered */
+    server.hold = MAX_INPUTS;
+    server.hold_ms = 3000;
+    push_all(ctx, in_ffd);
+
+    /* every stream failed, the retries go through a new connection */
+    TEST_CHECK(wait_ok(1 + MAX_INPUTS, 10000) == 0);
+    TEST_MSG("ok=%i", client_get_ok());
+    TEST_CHECK(server_get(&server.connections) >= 2);
+    TEST_CHECK(server_get(&server.answered) == 1 + MAX_INPUTS);
+
+    h2_ctx_destroy(ctx);
+}
+
+/*
+ * A header block larger than our SETTINGS_MAX_HEADER_LIST_SIZE fails the
+ * connection with GOAWAY(ENHANCE_YOUR_CALM), the request is retried on a
+ * new one.
+ */
+static void test_header_block_limit()
+{
+    int in_ffd[MAX_INPUTS];
+    flb_ctx_t *ctx;
+
+    memset(&server, 0, sizeof(server));
+    server.hold = 1;
+    server.flood = FLB_TRUE;
+
+    ctx = h2_ctx_create(in_ffd);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    flb_lib_push(ctx, in_ffd[0], RECORD, sizeof(RECORD) - 1);
+
+    TEST_CHECK(wait_ok(1, 8000) == 0);
+    TEST_CHECK(server_get(&server.goaway_recv) >= 1);
+    pthread_mutex_lock(&server.lock);
+    TEST_CHECK(server.goaway_error == 0xb);
+    TEST_MSG("GOAWAY error=%u", server.goaway_error);
+    pthread_mutex_unlock(&server.lock);
+    TEST_CHECK(server_get(&server.connections) >= 2);
+
+    h2_ctx_destroy(ctx);
+}
+
+TEST_LIST = {
+    {"concurrent_streams", test_concurrent_streams},
+    {"stream_limit", test_stream_limit},
+    {"goaway", test_goaway},
+    {"connection_loss", test_connection_loss},
+    {"header_block_limit", test_header_block_limit},
+    { 0 }
+};
@@ -0,0 +1,367 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_log_event_decoder.h>
+#include <msgpack.h>
+
+#include "flb_tests_internal.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define APACHE_10K    FLB_TESTS_DATA_PATH "/data/mp/apache_10k.mp"
+
+static void pack_str(msgpack_packer *pck, char *str)
+{
+    int len;
+
+    len = strlen(str);
+    msgpack_pack_str(pck, len);
+    msgpack_pack_str_body(pck, str, len);
+}
+
+static void pack_record(msgpack_packer *pck, struct flb_time *tm, int fmt,
+                        int id)
+{
+    msgpack_pack_array(pck, 2);
+    flb_time_append_to_msgpack(tm, pck, fmt);
+    msgpack_pack_map(pck, 3);
+    pack_str(pck, "log");
+    pack_str(pck, "GET /api/v1/orders?id=1234 HTTP/1.1 200 512");
+    pack_str(pck, "nested");
+    msgpack_pack_map(pck, 1);
+    pack_str(pck, "log");
+    msgpack_pack_int(pck, -1);
+    pack_str(pck, "id");
+    msgpack_pack_int(pck, id);
+}
+
+void test_iterate()
+{
+    int ret;
+    int count = 0;
+    size_t off = 0;
+    msgpack_object *obj;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+    msgpack_unpacked result;
+    struct flb_time tm;
+    struct flb_log_event event;
+    struct flb_log_event_decoder dec;
+    int fmts[] = {
+        FLB_TIME_ETFMT_INT,
+        FLB_TIME_ETFMT_V1_FIXEXT,
+        FLB_TIME_ETFMT_V1_EXT
+    };
+
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+
+    tm.tm.tv_sec = 1668000000;
+    tm.tm.tv_nsec = 123456789;
+    pack_record(&pck, &tm, fmts[0], 0);
+    pack_record(&pck, &tm, fmts[1], 1);
+    pack_record(&pck, &tm, fmts[2], 2);
+
+    ret = flb_log_event_decoder_init(&dec, sbuf.data, sbuf.size);
+    TEST_CHECK(ret == 0);
+
+    msgpack_unpacked_init(&result);
+    while (flb_log_event_decoder_next(&dec, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        /* the raw record must match the boundaries found by msgpack */
+        ret = msgpack_unpack_next(&result, sbuf.data, sbuf.size, &off);
+        TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+        TEST_CHECK(event.raw + event.raw_size == sbuf.data + off);
+
+        TEST_CHECK(event.timestamp.tm.tv_sec == tm.tm.tv_sec);
+        if (count == 0) {
+            TEST_CHECK(event.timestamp.tm.tv_nsec == 0);
+        }
+        else {
+            TEST_CHECK(event.timestamp.tm.tv_nsec == tm.tm.tv_nsec);
+        }
+        TEST_CHECK(event.body_entries == 3);
+        TEST_CHECK(event.body == NULL);
+
+        /* lookup over the raw body: nested keys must not match */
+        obj = flb_log_event_decoder_get_value(&dec, &event, "id", 2);
+        TEST_CHECK(obj != NULL && obj->type == MSGPACK_OBJECT_POSITIVE_INTEGER);
+        TEST_CHECK(obj != NULL && obj->via.u64 == count);
+
+        obj = flb_log_event_decoder_get_value(&dec, &event, "log", 3);
+        TEST_CHECK(obj != NULL && obj->type == MSGPACK_OBJECT_STR);
+
+        obj = flb_log_event_decoder_get_value(&dec, &event, "missing", 7);
+        TEST_CHECK(obj == NULL);
+
+        /* materialized body */
+        obj = flb_log_event_decoder_get_body(&dec, &event);
+        TEST_CHECK(obj != NULL);
+        TEST_CHECK(msgpack_object_equal(*obj,
+                                        result.data.via.array.ptr[1]));
+        TEST_CHECK(flb_log_event_decoder_get_body(&dec, &event) == obj);
+
+        obj = flb_log_event_decoder_get_value(&dec, &event, "id", 2);
+        TEST_CHECK(obj != NULL && obj->via.u64 == count);
+        count++;
+    }
+    TEST_CHECK(count == 3);
+    TEST_CHECK(flb_log_event_decoder_next(&dec, &event) ==
+               FLB_EVENT_DECODER_END);
+
+    msgpack_unpacked_destroy(&result);
+    flb_log_event_decoder_destroy(&dec);
+    msgpack_sbuffer_destroy(&sbuf);
+}
+
+void test_invalid()
+{
+    int ret;
+    int count = 0;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+    struct flb_time tm;
+    struct flb_log_event event;
+    struct flb_log_event_decoder dec;
+
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+
+    flb_time_get(&tm);
+
+    /* not a record */
+    pack_str(&pck, "hello");
+
+    /* body is not a map */
+    msgpack_pack_array(&pck, 2);
+    flb_time_append_to_msgpack(&tm, &pck, 0);
+    msgpack_pack_array(&pck, 1);
+    msgpack_pack_nil(&pck);
+
+    /* bad timestamp */
+    msgpack_pack_array(&pck, 2);
+    pack_str(&pck, "now");
+    msgpack_pack_map(&pck, 0);
+
+    pack_record(&pck, &tm, 0, 10);
+
+    ret = flb_log_event_decoder_init(&dec, sbuf.data, sbuf.size);
+    TEST_CHECK(ret == 0);
+    while (flb_log_event_decoder_next(&dec, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        /* the three objects before the record are counted as skipped */
+        TEST_CHECK(dec.skipped == 3);
+        count++;
+    }
+    TEST_CHECK(count == 1);
+    TEST_CHECK(dec.skipped == 3);
+    flb_log_event_decoder_destroy(&dec);
+
+    /* truncated record */
+    ret = flb_log_event_decoder_init(&dec, sbuf.data, sbuf.size - 1);
+    TEST_CHECK(ret == 0);
+    while ((ret = flb_log_event_decoder_next(&dec, &event)) ==
+           FLB_EVENT_DECODER_SUCCESS);
+    TEST_CHECK(ret == FLB_EVENT_DECODER_ERROR);
+    flb_log_event_decoder_destroy(&dec);
+
+    msgpack_sbuffer_destroy(&sbuf);
+}
+
+void test_duplicate_keys()
+{
+    int ret;
+    msgpack_object *obj;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+    struct flb_time tm;
+    struct flb_log_event event;
+    struct flb_log_event_decoder dec;
+
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+
+    flb_time_get(&tm);
+    msgpack_pack_array(&pck, 2);
+    flb_time_append_to_msgpack(&tm, &pck, 0);
+    msgpack_pack_map(&pck, 3);
+    pack_str(&pck, "id");
+    msgpack_pack_int(&pck, 1);
+    pack_str(&pck, "log");
+    pack_str(&pck, "first");
+    pack_str(&pck, "id");
+    msgpack_pack_int(&pck, 2);
+
+    ret = flb_log_event_decoder_init(&dec, sbuf.data, sbuf.size);
+    TEST_CHECK(ret == 0);
+    ret = flb_log_event_decoder_next(&dec, &event);
+    TEST_CHECK(ret == FLB_EVENT_DECODER_SUCCESS);
+
+    /* the last entry wins, as with the record accessor */
+    obj = flb_log_event_decoder_get_value(&dec, &event, "id", 2);
+    TEST_CHECK(obj != NULL && obj->via.u64 == 2);
+
+    flb_log_event_decoder_get_body(&dec, &event);
+    obj = flb_log_event_decoder_get_value(&dec, &event, "id", 2);
+    TEST_CHECK(obj != NULL && obj->via.u64 == 2);
+
+    flb_log_event_decoder_destroy(&dec);
+    msgpack_sbuffer_destroy(&sbuf);
+}
+
+void test_apache_10k()
+{
+    int ret;
+    int count = 0;
+    char *data;
+    size_t len;
+    size_t off = 0;
+    struct stat st;
+    msgpack_object *obj;
+    msgpack_unpacked result;
+    struct flb_log_event event;
+    struct flb_log_event_decoder dec;
+
+    ret = stat(APACHE_10K, &st);
+    if (ret == -1) {
+        exit(1);
+    }
+    len = st.st_size;
+
+    data = mk_file_to_buffer(APACHE_10K);
+    TEST_CHECK(data != NULL);
+
+    ret = flb_log_event_decoder_init(&dec, data, len);
+    TEST_CHECK(ret == 0);
+
+    msgpack_unpacked_init(&result);
+    while (flb_log_event_decoder_next(&dec, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        msgpack_unpack_next(&result, data, len, &off);
+        TEST_CHECK(event.raw + event.raw_size == data + off);
+
+        obj = flb_log_event_decoder_get_body(&dec, &event);
+        TEST_CHECK(obj != NULL &&
+                   msgpack_object_equal(*obj, result.data.via.array.ptr[1]));
+        count++;
+    }
+    TEST_CHECK(count == 10000);
+
+    msgpack_unpacked_destroy(&result);
+    flb_log_event_decoder_destroy(&dec);
+    flb_free(data);
+}
+
+static double elapsed(struct flb_time *t1)
+{
+    struct flb_time t2;
+
+    flb_time_get(&t2);
+    return flb_time_to_double(&t2) - flb_time_to_double(t1);
+}
+
+/* Compare the decoder against the msgpack_unpack_next() loop used before */
+void test_bench()
+{
+    int i;
+    int records = 100000;
+    size_t off;
+    size_t hits;
+    msgpack_object *obj;
+    msgpack_object map;
+    msgpack_object *p;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+    msgpack_unpacked result;
+    struct flb_time tm;
+    struct flb_time t1;
+    struct flb_log_event event;
+    struct flb_log_event_decoder dec;
+
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+
+    flb_time_get(&tm);
+    for (i = 0; i < records; i++) {
+        pack_record(&pck, &tm, 0, i);
+    }
+
+    /* unpack every record, the pattern used by the plugins */
+    hits = 0;
+    off = 0;
+    flb_time_get(&t1);
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, sbuf.data, sbuf.size, &off) ==
+           MSGPACK_UNPACK_SUCCESS) {
+        flb_time_pop_from_msgpack(&tm, &result, &p);
+        map = result.data.via.array.ptr[1];
+        for (i = 0; i < map.via.map.size; i++) {
+            if (map.via.map.ptr[i].key.via.str.size == 2) {
+                hits++;
+            }
+        }
+    }
+    msgpack_unpacked_destroy(&result);
+    printf("\n[log event decoder] msgpack_unpack_next : %.4fs",
+           elapsed(&t1));
+    TEST_CHECK(hits == records);
+
+    /* iterate records and timestamps only */
+    hits = 0;
+    flb_time_get(&t1);
+    flb_log_event_decoder_init(&dec, sbuf.data, sbuf.size);
+    while (flb_log_event_decoder_next(&dec, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        hits++;
+    }
+    flb_log_event_decoder_destroy(&dec);
+    printf("\n[log event decoder] decoder next        : %.4fs",
+           elapsed(&t1));
+    TEST_CHECK(hits == records);
+
+    /* single key lookup */
+    hits = 0;
+    flb_time_get(&t1);
+    flb_log_event_decoder_init(&dec, sbuf.data, sbuf.size);
+    while (flb_log_event_decoder_next(&dec, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        obj = flb_log_event_decoder_get_value(&dec, &event, "id", 2);
+        if (obj) {
+            hits++;
+        }
+    }
+    flb_log_event_decoder_destroy(&dec);
+    printf("\n[log event decoder] decoder get_value   : %.4fs",
+           elapsed(&t1));
+    TEST_CHECK(hits == records);
+
+    /* full body */
+    hits = 0;
+    flb_time_get(&t1);
+    flb_log_event_decoder_init(&dec, sbuf.data, sbuf.size);
+    while (flb_log_event_decoder_next(&dec, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        obj = flb_log_event_decoder_get_body(&dec, &event);
+        if (obj) {
+            hits++;
+        }
+    }
+    flb_log_event_decoder_destroy(&dec);
+    printf("\n[log event decoder] decoder get_body    : %.4fs\n",
+           elapsed(&t1));
+    TEST_CHECK(hits == records);
+
+    msgpack_sbuffer_destroy(&sbuf);
+}
+
+TEST_LIST = {
+    {"iterate"   , test_iterate},
+    {"invalid"   , test_invalid},
+    {"duplicate_keys", test_duplicate_keys},
+    {"apache_10k", test_apache_10k},
+    {"bench"     , test_bench},
+    { 0 }
+};
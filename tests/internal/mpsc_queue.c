@@ -0,0 +1,330 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_engine_macros.h>
+#include <fluent-bit/flb_mpsc_queue.h>
+
+#include <monkey/mk_core.h>
+
+#include <pthread.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "flb_tests_internal.h"
+
+#define N_PRODUCERS      8
+#define N_ITEMS          200000   /* per producer */
+#define N_LATENCY_ITEMS  2000     /* per producer */
+#define QUEUE_SIZE       4096
+
+struct item {
+    int producer;
+    uint64_t seq;
+    uint64_t ts;                  /* enqueue time (ns) */
+};
+
+struct producer {
+    int id;
+    int n;
+    int interval_us;              /* wait between pushes */
+    uint64_t full;                /* times the queue was full */
+    struct item *items;
+    struct flb_mpsc_queue *q;
+    pthread_t tid;
+};
+
+static int wakeups;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cb_wakeup(void *data)
+{
+    struct mk_event *event = data;
+    struct flb_mpsc_queue *q = event->data;
+
+    flb_mpsc_queue_signal_reset(q);
+    wakeups++;
+    return 0;
+}
+
+static void *producer_worker(void *data)
+{
+    int i;
+    struct item *it;
+    struct producer *p = data;
+
+    for (i = 0; i < p->n; i++) {
+        it = &p->items[i];
+        it->producer = p->id;
+        it->seq = i;
+        it->ts = now_ns();
+        while (flb_mpsc_queue_push(p->q, it) == -1) {
+            p->full++;
+            sched_yield();
+        }
+        if (p->interval_us > 0) {
+            usleep(p->interval_us);
+        }
+    }
+
+    return NULL;
+}
+
+/* Single thread: FIFO order, full queue and wrap around */
+void test_basic()
+{
+    int i;
+    int ret;
+    int values[16];
+    void *ptr;
+    struct flb_mpsc_queue *q;
+
+    /* the size is rounded up to a power of two */
+    q = flb_mpsc_queue_create(6);
+    TEST_CHECK(q != NULL);
+    TEST_CHECK(q->mask == 7);
+
+    ret = flb_mpsc_queue_pop(q, &ptr);
+    TEST_CHECK(ret == -1);
+
+    for (i = 0; i < 8; i++) {
+        ret = flb_mpsc_queue_push(q, &values[i]);
+        TEST_CHECK(ret == 0);
+    }
+    ret = flb_mpsc_queue_push(q, &values[8]);
+    TEST_CHECK(ret == -1);
+
+    for (i = 0; i < 8; i++) {
+        ret = flb_mpsc_queue_pop(q, &ptr);
+        TEST_CHECK(ret == 0 && ptr == &values[i]);
+    }
+    ret = flb_mpsc_queue_pop(q, &ptr);
+    TEST_CHECK(ret == -1);
+
+    /* cycle many times over the cells */
+    for (i = 0; i < 1000; i++) {
+        ret = flb_mpsc_queue_push(q, &values[i % 16]);
+        TEST_CHECK(ret == 0);
+        ret = flb_mpsc_queue_push(q, &values[(i + 1) % 16]);
+        TEST_CHECK(ret == 0);
+        ret = flb_mpsc_queue_pop(q, &ptr);
+        TEST_CHECK(ret == 0 && ptr == &values[i % 16]);
+        ret = flb_mpsc_queue_pop(q, &ptr);
+        TEST_CHECK(ret == 0 && ptr == &values[(i + 1) % 16]);
+    }
+
+    flb_mpsc_queue_destroy(q);
+}
+
+/* Only the first push after a reset signals the consumer */
+void test_signal_coalescing()
+{
+    int i;
+    int ret;
+    int n_events;
+    int values[4];
+    void *ptr;
+    struct mk_event *event;
+    struct mk_event_loop *evl;
+    struct flb_mpsc_queue *q;
+
+    evl = mk_event_loop_create(16);
+    TEST_CHECK(evl != NULL);
+
+    q = flb_mpsc_queue_create(16);
+    TEST_CHECK(q != NULL);
+
+    ret = flb_mpsc_queue_add_event_loop(q, evl, cb_wakeup, q);
+    TEST_CHECK(ret == 0);
+
+    n_events = mk_event_wait_2(evl, 0);
+    TEST_CHECK(n_events == 0);
+
+    for (i = 0; i < 4; i++) {
+        ret = flb_mpsc_queue_push(q, &values[i]);
+        TEST_CHECK(ret == 0);
+    }
+    TEST_CHECK(q->signaled == FLB_TRUE);
+
+    wakeups = 0;
+    n_events = mk_event_wait_2(evl, 0);
+    TEST_CHECK(n_events == 1);
+    mk_event_foreach(event, evl) {
+        TEST_CHECK(event->type == FLB_ENGINE_EV_CUSTOM);
+        event->handler(event);
+    }
+    TEST_CHECK(wakeups == 1);
+    TEST_CHECK(q->signaled == FLB_FALSE);
+
+    /* the channel was consumed */
+    n_events = mk_event_wait_2(evl, 0);
+    TEST_CHECK(n_events == 0);
+
+    for (i = 0; i < 4; i++) {
+        ret = flb_mpsc_queue_pop(q, &ptr);
+        TEST_CHECK(ret == 0 && ptr == &values[i]);
+    }
+
+    /* a new push signals again */
+    ret = flb_mpsc_queue_push(q, &values[0]);
+    TEST_CHECK(ret == 0);
+    n_events = mk_event_wait_2(evl, 0);
+    TEST_CHECK(n_events == 1);
+
+    flb_mpsc_queue_destroy(q);
+    mk_event_loop_destroy(evl);
+}
+
+/*
+ * Run the producers against a consumer blocked on the event loop. Checks
+ * that every item is received once and in order for each producer, and
+ * reports the throughput and the enqueue to dequeue latency.
+ */
+static void run_producers(int n_items, int interval_us, int *out_wakeups,
+                          uint64_t *out_elapsed, uint64_t *lat, uint64_t *full)
+{
+    int i;
+    int ret;
+    int ok = FLB_TRUE;
+    int received = 0;
+    uint64_t t;
+    uint64_t next[N_PRODUCERS] = {0};
+    void *ptr;
+    struct item *it;
+    struct mk_event *event;
+    struct mk_event_loop *evl;
+    struct flb_mpsc_queue *q;
+    struct producer p[N_PRODUCERS];
+
+    evl = mk_event_loop_create(16);
+    TEST_CHECK(evl != NULL);
+
+    q = flb_mpsc_queue_create(QUEUE_SIZE);
+    TEST_CHECK(q != NULL);
+
+    ret = flb_mpsc_queue_add_event_loop(q, evl, cb_wakeup, q);
+    TEST_CHECK(ret == 0);
+
+    wakeups = 0;
+    *full = 0;
+    t = now_ns();
+    for (i = 0; i < N_PRODUCERS; i++) {
+        p[i].id = i;
+        p[i].n = n_items;
+        p[i].interval_us = interval_us;
+        p[i].full = 0;
+        p[i].q = q;
+        p[i].items = flb_calloc(n_items, sizeof(struct item));
+        TEST_CHECK(p[i].items != NULL);
+        pthread_create(&p[i].tid, NULL, producer_worker, &p[i]);
+    }
+
+    while (received < N_PRODUCERS * n_items) {
+        mk_event_wait_2(evl, 1000);
+        mk_event_foreach(event, evl) {
+            event->handler(event);
+        }
+
+        while (flb_mpsc_queue_pop(q, &ptr) == 0) {
+            it = ptr;
+            lat[received] = now_ns() - it->ts;
+            if (it->seq != next[it->producer]) {
+                ok = FLB_FALSE;
+            }
+            next[it->producer] = it->seq + 1;
+            received++;
+        }
+    }
+    *out_elapsed = now_ns() - t;
+    *out_wakeups = wakeups;
+
+    TEST_CHECK(ok == FLB_TRUE);
+    TEST_CHECK(flb_mpsc_queue_pop(q, &ptr) == -1);
+
+    for (i = 0; i < N_PRODUCERS; i++) {
+        pthread_join(p[i].tid, NULL);
+        TEST_CHECK(next[i] == n_items);
+        *full += p[i].full;
+        flb_free(p[i].items);
+    }
+
+    flb_mpsc_queue_destroy(q);
+    mk_event_loop_destroy(evl);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Saturate the queue from 8 threads */
+void test_producers_throughput()
+{
+    int n_wakeups;
+    uint64_t full;
+    uint64_t elapsed;
+    uint64_t *lat;
+
+    lat = flb_malloc(sizeof(uint64_t) * N_PRODUCERS * N_ITEMS);
+    TEST_CHECK(lat != NULL);
+
+    run_producers(N_ITEMS, 0, &n_wakeups, &elapsed, lat, &full);
+
+    TEST_CHECK(n_wakeups <= N_PRODUCERS * N_ITEMS);
+    printf("\n[mpsc queue] %i producers, %i items: %.2f M items/s, "
+           "%i wakeups, %" PRIu64 " full retries\n",
+           N_PRODUCERS, N_PRODUCERS * N_ITEMS,
+           ((double) N_PRODUCERS * N_ITEMS) / ((double) elapsed / 1000.0),
+           n_wakeups, full);
+
+    flb_free(lat);
+}
+
+/* Low rate producers: the consumer must be woken up for every burst */
+void test_producers_latency()
+{
+    int n;
+    int n_wakeups;
+    uint64_t i;
+    uint64_t full;
+    uint64_t sum = 0;
+    uint64_t elapsed;
+    uint64_t *lat;
+
+    n = N_PRODUCERS * N_LATENCY_ITEMS;
+    lat = flb_malloc(sizeof(uint64_t) * n);
+    TEST_CHECK(lat != NULL);
+
+    run_producers(N_LATENCY_ITEMS, 100, &n_wakeups, &elapsed, lat, &full);
+
+    for (i = 0; i < n; i++) {
+        sum += lat[i];
+    }
+    qsort(lat, n, sizeof(uint64_t), cmp_u64);
+
+    printf("\n[mpsc queue] %i producers, %i items: latency avg=%" PRIu64 "us "
+           "p50=%" PRIu64 "us p99=%" PRIu64 "us max=%" PRIu64 "us, "
+           "%i wakeups\n",
+           N_PRODUCERS, n, sum / n / 1000, lat[n / 2] / 1000,
+           lat[(n * 99) / 100] / 1000, lat[n - 1] / 1000, n_wakeups);
+
+    flb_free(lat);
+}
+
+TEST_LIST = {
+    {"basic", test_basic},
+    {"signal_coalescing", test_signal_coalescing},
+    {"producers_throughput", test_producers_throughput},
+    {"producers_latency", test_producers_latency},
+    { 0 }
+};
@@ -1452,6 +1452,65 @@ static void test_issue_5504()
 #endif
 }
 
+/* Lookups by name go through the registry index */
+static void test_parser_lookup()
+{
+    int i;
+    char name[32];
+    struct flb_config *config;
+    struct flb_ml_parser *mlp;
+    struct flb_ml_parser *mlp_dup;
+    struct flb_ml_parser *mlp_long;
+    char long_name[300];
+
+    config = flb_config_init();
+
+    /* built-in parsers, names are case insensitive */
+    mlp = flb_ml_parser_get(config, "docker");
+    TEST_CHECK(mlp != NULL);
+    TEST_CHECK(flb_ml_parser_get(config, "DOCKER") == mlp);
+    TEST_CHECK(flb_ml_parser_get(config, "undefined") == NULL);
+
+    for (i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name) - 1, "Parser_%i", i);
+        mlp = flb_ml_parser_create(config, name, FLB_ML_ENDSWITH, "\\",
+                                   FLB_FALSE, 1000, NULL, NULL, NULL,
+                                   NULL, NULL);
+        TEST_CHECK(mlp != NULL);
+    }
+    for (i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name) - 1, "parser_%i", i);
+        mlp = flb_ml_parser_get(config, name);
+        TEST_CHECK(mlp != NULL && strcasecmp(mlp->name, name) == 0);
+    }
+
+    /* the first registered parser of a name is returned */
+    mlp = flb_ml_parser_get(config, "parser_1");
+    mlp_dup = flb_ml_parser_create(config, "PARSER_1", FLB_ML_ENDSWITH, "\\",
+                                   FLB_FALSE, 1000, NULL, NULL, NULL,
+                                   NULL, NULL);
+    TEST_CHECK(mlp_dup != NULL);
+    TEST_CHECK(flb_ml_parser_get(config, "parser_1") == mlp);
+
+    /* ...until it's destroyed */
+    flb_ml_parser_destroy(mlp);
+    TEST_CHECK(flb_ml_parser_get(config, "parser_1") == mlp_dup);
+    flb_ml_parser_destroy(mlp_dup);
+    TEST_CHECK(flb_ml_parser_get(config, "parser_1") == NULL);
+
+    /* names longer than the index keys */
+    memset(long_name, 'a', sizeof(long_name) - 1);
+    long_name[sizeof(long_name) - 1] = '\0';
+    mlp_long = flb_ml_parser_create(config, long_name, FLB_ML_ENDSWITH, "\\",
+                                    FLB_FALSE, 1000, NULL, NULL, NULL,
+                                    NULL, NULL);
+    TEST_CHECK(mlp_long != NULL);
+    long_name[0] = 'A';
+    TEST_CHECK(flb_ml_parser_get(config, long_name) == mlp_long);
+
+    flb_config_exit(config);
+}
+
 TEST_LIST = {
     /* Normal features tests */
     { "parser_docker",  test_parser_docker},
@@ -1463,6 +1522,7 @@ TEST_LIST = {
     { "parser_go",      test_parser_go},
     { "container_mix",  test_container_mix},
     { "endswith",       test_endswith},
+    { "parser_lookup",  test_parser_lookup},
 
     /* Issues reported on Github */
     { "issue_3817_1"  , test_issue_3817_1},
@@ -7,8 +7,10 @@
 #include <fluent-bit/flb_network.h>
 #include <fluent-bit/flb_socket.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_io.h>
 
 #include <time.h>
+#include <sys/wait.h>
 #include "flb_tests_internal.h"
 
 #define TEST_HOSTv4           "127.0.0.1"
@@ -149,8 +151,85 @@ void test_ipv6_client_server()
     test_client_server(FLB_TRUE);
 }
 
+/* Vectored write of many small fragments and a large one */
+void test_fd_writev()
+{
+    int i;
+    int ret;
+    int fds[2];
+    size_t len = 0;
+    size_t total = 0;
+    size_t out_len = 0;
+    ssize_t bytes;
+    char small[] = "0123456789";
+    char *large;
+    char *buf;
+    struct mk_iovec iov[2048];
+    int iovcnt = sizeof(iov) / sizeof(struct mk_iovec);
+
+    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    TEST_CHECK(ret == 0);
+
+    large = flb_malloc(65536);
+    TEST_CHECK(large != NULL);
+    memset(large, 'x', 65536);
+
+    for (i = 0; i < iovcnt - 1; i++) {
+        iov[i].iov_base = small;
+        iov[i].iov_len = (i % 3 == 0) ? 0 : sizeof(small) - 1;
+        len += iov[i].iov_len;
+    }
+    iov[i].iov_base = large;
+    iov[i].iov_len = 65536;
+    len += 65536;
+
+    buf = flb_malloc(len);
+    TEST_CHECK(buf != NULL);
+
+    /* the peer drains the socket while the writer is blocked */
+    if (fork() == 0) {
+        close(fds[1]);
+        while (read(fds[0], buf, len) > 0);
+        _exit(0);
+    }
+    close(fds[0]);
+
+    ret = flb_io_fd_writev(fds[1], iov, iovcnt, &out_len);
+    TEST_CHECK(ret == len);
+    TEST_CHECK(out_len == len);
+
+    /* the vector is left untouched */
+    TEST_CHECK(iov[iovcnt - 1].iov_base == large);
+    TEST_CHECK(iov[iovcnt - 1].iov_len == 65536);
+
+    close(fds[1]);
+    wait(NULL);
+
+    /* check the content on a new pair, small enough for the socket buffer */
+    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_io_fd_writev(fds[1], iov, 4, &out_len);
+    TEST_CHECK(ret == 20);
+    while (total < 20) {
+        bytes = read(fds[0], buf + total, len - total);
+        if (bytes <= 0) {
+            break;
+        }
+        total += bytes;
+    }
+    TEST_CHECK(total == 20);
+    TEST_CHECK(memcmp(buf, "01234567890123456789", 20) == 0);
+
+    close(fds[0]);
+    close(fds[1]);
+    flb_free(buf);
+    flb_free(large);
+}
+
 TEST_LIST = {
     { "ipv4_client_server", test_ipv4_client_server},
     { "ipv6_client_server", test_ipv6_client_server},
+    { "fd_writev", test_fd_writev},
     { 0 }
 };
@@ -0,0 +1,405 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit.h>
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_output_plugin.h>
+#include <fluent-bit/flb_output_batch.h>
+
+#include <cfl/cfl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "flb_tests_internal.h"
+
+#define RECORD  "[1448403340, {\"key\": \"value\"}]"
+#define MAX_CALLS  64
+
+/* Flush callback results, the test output replies FLB_RETRY 'retries' times */
+struct batch_check {
+    int retries;
+    int calls;
+    int events[MAX_CALLS];
+    int ok_events;
+    pthread_mutex_t lock;
+};
+
+static struct batch_check check;
+
+static int cb_batch_init(struct flb_output_instance *ins,
+                         struct flb_config *config, void *data)
+{
+    return 0;
+}
+
+static void cb_batch_flush(struct flb_event_chunk *event_chunk,
+                           struct flb_output_flush *out_flush,
+                           struct flb_input_instance *i_ins,
+                           void *out_context,
+                           struct flb_config *config)
+{
+    int ret;
+
+    pthread_mutex_lock(&check.lock);
+    if (check.calls < MAX_CALLS) {
+        check.events[check.calls] = event_chunk->total_events;
+    }
+    check.calls++;
+
+    if (check.retries > 0) {
+        check.retries--;
+        ret = FLB_RETRY;
+    }
+    else {
+        check.ok_events += event_chunk->total_events;
+        ret = FLB_OK;
+    }
+    pthread_mutex_unlock(&check.lock);
+
+    FLB_OUTPUT_RETURN(ret);
+}
+
+static int cb_batch_exit(void *data, struct flb_config *config)
+{
+    return 0;
+}
+
+static struct flb_output_plugin out_batch_test_plugin = {
+    .name         = "batch_test",
+    .description  = "Batching test output",
+    .cb_init      = cb_batch_init,
+    .cb_flush     = cb_batch_flush,
+    .cb_exit      = cb_batch_exit,
+    .event_type   = FLB_OUTPUT_LOGS,
+    .flags        = 0,
+};
+
+static void check_reset(int retries)
+{
+    memset(&check, 0, sizeof(check));
+    pthread_mutex_init(&check.lock, NULL);
+    check.retries = retries;
+}
+
+static int check_get(int *calls, int *first_events)
+{
+    int ok_events;
+
+    pthread_mutex_lock(&check.lock);
+    ok_events = check.ok_events;
+    if (calls) {
+        *calls = check.calls;
+    }
+    if (first_events) {
+        *first_events = check.calls > 0 ? check.events[0] : 0;
+    }
+    pthread_mutex_unlock(&check.lock);
+
+    return ok_events;
+}
+
+/* Wait up to 'ms' milliseconds for 'events' records delivered with FLB_OK */
+static int wait_ok_events(int events, int ms)
+{
+    int i;
+
+    for (i = 0; i < ms / 100; i++) {
+        if (check_get(NULL, NULL) >= events) {
+            return 0;
+        }
+        flb_time_msleep(100);
+    }
+
+    return -1;
+}
+
+/* A NULL 'max_wait' keeps the default, it depends on the flush interval */
+static flb_ctx_t *batch_ctx_create(const char *flush, const char *max_wait,
+                                   int *in_ffd)
+{
+    int ret;
+    int out_ffd;
+    flb_ctx_t *ctx;
+
+    ctx = flb_create();
+    if (!ctx) {
+        return NULL;
+    }
+
+    flb_service_set(ctx,
+                    "flush", flush,
+                    "grace", "2",
+                    "log_level", "error",
+                    "scheduler.base", "1",
+                    "scheduler.cap", "1",
+                    NULL);
+
+    /* register the test output in the context plugins */
+    mk_list_add(&out_batch_test_plugin._head, &ctx->config->out_plugins);
+
+    *in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(*in_ffd >= 0);
+    flb_input_set(ctx, *in_ffd, "tag", "test", NULL);
+
+    out_ffd = flb_output(ctx, (char *) "batch_test", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd,
+                         "match", "test",
+                         "batch", "on",
+                         NULL);
+    TEST_CHECK(ret == 0);
+    if (max_wait) {
+        ret = flb_output_set(ctx, out_ffd, "batch.max_wait", max_wait, NULL);
+        TEST_CHECK(ret == 0);
+    }
+
+    return ctx;
+}
+
+static void batch_ctx_destroy(flb_ctx_t *ctx)
+{
+    flb_stop(ctx);
+
+    /* the plugin is static, do not let the context release it */
+    mk_list_del(&out_batch_test_plugin._head);
+    flb_destroy(ctx);
+}
+
+/*
+ * Small chunks dispatched in different rounds are merged in one flush, a
+ * FLB_RETRY reply is reported to every task and each one is retried alone.
+ */
+static void test_batch_compose_and_retry()
+{
+    int i;
+    int ret;
+    int calls;
+    int first;
+    int in_ffd;
+    flb_ctx_t *ctx;
+
+    check_reset(1);
+
+    ctx = batch_ctx_create("0.2", "2s", &in_ffd);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    /* every record lands in its own chunk, dispatched in its own round */
+    for (i = 0; i < 4; i++) {
+        flb_lib_push(ctx, in_ffd, RECORD, sizeof(RECORD) - 1);
+        flb_time_msleep(250);
+    }
+
+    /* the batch is still open: nothing was delivered before max_wait */
+    check_get(&calls, NULL);
+    TEST_CHECK(calls == 0);
+    TEST_MSG("calls=%i before the batch deadline", calls);
+
+    ret = wait_ok_events(4, 8000);
+    TEST_CHECK(ret == 0);
+
+    check_get(&calls, &first);
+
+    /* one flush for the batch, then one retry per task */
+    TEST_CHECK(first == 4);
+    TEST_MSG("first flush got %i records, expected 4", first);
+    TEST_CHECK(calls == 5);
+    TEST_MSG("calls=%i, expected 5", calls);
+    TEST_CHECK(check_get(NULL, NULL) == 4);
+
+    batch_ctx_destroy(ctx);
+}
+
+/*
+ * Default flush interval and max_wait: a batch spans two dispatch rounds.
+ * Records are ingested every 250ms, so a round holds 4 of them at most.
+ */
+static void test_batch_default_max_wait()
+{
+    int i;
+    int ret;
+    int calls;
+    int first;
+    int in_ffd;
+    flb_ctx_t *ctx;
+
+    check_reset(0);
+
+    ctx = batch_ctx_create("1", NULL, &in_ffd);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < 10; i++) {
+        flb_lib_push(ctx, in_ffd, RECORD, sizeof(RECORD) - 1);
+        flb_time_msleep(250);
+    }
+
+    ret = wait_ok_events(10, 5000);
+    TEST_CHECK(ret == 0);
+
+    check_get(&calls, &first);
+    TEST_CHECK(first > 4);
+    TEST_MSG("first flush got %i records, expected more than one round",
+             first);
+    TEST_CHECK(calls <= 3);
+    TEST_MSG("calls=%i for 10 records", calls);
+
+    batch_ctx_destroy(ctx);
+}
+
+/* Open batches are delivered when the engine stops, before their deadline */
+static void test_batch_flush_on_stop()
+{
+    int ret;
+    int calls;
+    int first;
+    int in_ffd;
+    flb_ctx_t *ctx;
+
+    check_reset(0);
+
+    ctx = batch_ctx_create("0.2", "60s", &in_ffd);
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    flb_lib_push(ctx, in_ffd, RECORD, sizeof(RECORD) - 1);
+    flb_time_msleep(400);
+    flb_lib_push(ctx, in_ffd, RECORD, sizeof(RECORD) - 1);
+    flb_time_msleep(400);
+
+    check_get(&calls, NULL);
+    TEST_CHECK(calls == 0);
+
+    flb_stop(ctx);
+
+    check_get(&calls, &first);
+    TEST_CHECK(calls == 1);
+    TEST_CHECK(first == 2);
+    TEST_MSG("calls=%i first=%i, expected a single flush of 2 records",
+             calls, first);
+    TEST_CHECK(check_get(NULL, NULL) == 2);
+
+    mk_list_del(&out_batch_test_plugin._head);
+    flb_destroy(ctx);
+}
+
+/* Invalid batching times are rejected */
+static void test_batch_properties()
+{
+    int in_ffd;
+    int out_ffd;
+    flb_ctx_t *ctx;
+    struct flb_output_instance *ins;
+
+    ctx = flb_create();
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    out_ffd = flb_output(ctx, (char *) "null", NULL);
+    TEST_CHECK(out_ffd >= 0);
+
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "batch.latency_target", "0", NULL) == -1);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "batch.latency_target", "-5", NULL) == -1);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "batch.latency_target", "fast", NULL) == -1);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "batch.latency_target", "10x", NULL) == -1);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "batch.max_wait", "0s", NULL) == -1);
+
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "batch.latency_target", "250", NULL) == 0);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "batch.max_wait", "2s", NULL) == 0);
+
+    ins = mk_list_entry_first(&ctx->config->outputs,
+                              struct flb_output_instance, _head);
+    TEST_CHECK(ins->batch_latency_target == 250);
+    TEST_CHECK(ins->batch_max_wait == 2000);
+
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "batch.latency_target", "1500ms", NULL) == 0);
+    TEST_CHECK(ins->batch_latency_target == 1500);
+
+    flb_destroy(ctx);
+}
+
+/* AIMD: additive increase on fast full batches, halved otherwise */
+static void test_batch_feedback()
+{
+    struct flb_output_instance ins;
+    struct flb_output_batch batch;
+
+    memset(&ins, 0, sizeof(ins));
+    memset(&batch, 0, sizeof(batch));
+
+    ins.log_level = FLB_LOG_OFF;
+    ins.batch_min_size = 1000;
+    ins.batch_max_size = 4000;
+    ins.batch_latency_target = 60000;
+    ins.batch_target = 1000;
+
+    /* fast and full: grows by min_size */
+    batch.ts_start = cfl_time_now();
+    batch.size = 1000;
+    flb_output_batch_feedback(&ins, &batch, FLB_OK);
+    TEST_CHECK(ins.batch_target == 2000);
+
+    /* a batch under half of the target does not prove anything */
+    batch.size = 900;
+    flb_output_batch_feedback(&ins, &batch, FLB_OK);
+    TEST_CHECK(ins.batch_target == 2000);
+
+    /* growth is capped by max_size */
+    batch.size = 2000;
+    flb_output_batch_feedback(&ins, &batch, FLB_OK);
+    flb_output_batch_feedback(&ins, &batch, FLB_OK);
+    flb_output_batch_feedback(&ins, &batch, FLB_OK);
+    TEST_CHECK(ins.batch_target == 4000);
+
+    /* retries and errors halve it */
+    flb_output_batch_feedback(&ins, &batch, FLB_RETRY);
+    TEST_CHECK(ins.batch_target == 2000);
+    flb_output_batch_feedback(&ins, &batch, FLB_ERROR);
+    TEST_CHECK(ins.batch_target == 1000);
+
+    /* never below min_size */
+    flb_output_batch_feedback(&ins, &batch, FLB_ERROR);
+    TEST_CHECK(ins.batch_target == 1000);
+
+    /* a slow response counts as a failure */
+    ins.batch_target = 4000;
+    ins.batch_latency_target = 1;
+    batch.size = 4000;
+    batch.ts_start = cfl_time_now() - 50000000;
+    flb_output_batch_feedback(&ins, &batch, FLB_OK);
+    TEST_CHECK(ins.batch_target == 2000);
+}
+
+TEST_LIST = {
+    {"batch_feedback", test_batch_feedback},
+    {"batch_properties", test_batch_properties},
+    {"batch_compose_and_retry", test_batch_compose_and_retry},
+    {"batch_default_max_wait", test_batch_default_max_wait},
+    {"batch_flush_on_stop", test_batch_flush_on_stop},
+    { 0 }
+};
@@ -0,0 +1,356 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit.h>
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_output_plugin.h>
+#include <fluent-bit/flb_output_thread.h>
+#include <fluent-bit/flb_thread_pool.h>
+
+#include <cfl/cfl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "flb_tests_internal.h"
+
+#define RECORD       "[1448403340, {\"key\": \"value\"}]"
+#define MAX_INPUTS   8
+#define MAX_FLUSHES  256
+#define SLOW_TAG     "slow"
+#define SLOW_MS      1500
+
+/* What every flush callback saw */
+struct flush_record {
+    char tag[16];
+    int worker;
+    int events;
+    uint64_t end_ms;
+};
+
+struct flush_check {
+    int count;
+    int events;
+    struct flush_record flushes[MAX_FLUSHES];
+    pthread_mutex_t lock;
+};
+
+static struct flush_check check;
+static int flush_sleep_ms;
+
+static uint64_t now_ms()
+{
+    return cfl_time_now() / 1000000;
+}
+
+static int cb_worker_init(struct flb_output_instance *ins,
+                          struct flb_config *config, void *data)
+{
+    return 0;
+}
+
+static void cb_worker_flush(struct flb_event_chunk *event_chunk,
+                            struct flb_output_flush *out_flush,
+                            struct flb_input_instance *i_ins,
+                            void *out_context,
+                            struct flb_config *config)
+{
+    struct flush_record *r;
+    struct flb_out_thread_instance *th_ins;
+
+    /* the callback blocks its worker, queued tasks wait for it */
+    if (strcmp(event_chunk->tag, SLOW_TAG) == 0) {
+        flb_time_msleep(SLOW_MS);
+    }
+    else if (flush_sleep_ms > 0) {
+        flb_time_msleep(flush_sleep_ms);
+    }
+
+    th_ins = flb_output_thread_instance_get();
+
+    pthread_mutex_lock(&check.lock);
+    if (check.count < MAX_FLUSHES) {
+        r = &check.flushes[check.count];
+        strncpy(r->tag, event_chunk->tag, sizeof(r->tag) - 1);
+        r->worker = th_ins ? th_ins->th->id : -1;
+        r->events = event_chunk->total_events;
+        r->end_ms = now_ms();
+    }
+    check.count++;
+    check.events += event_chunk->total_events;
+    pthread_mutex_unlock(&check.lock);
+
+    FLB_OUTPUT_RETURN(FLB_OK);
+}
+
+static int cb_worker_exit(void *data, struct flb_config *config)
+{
+    return 0;
+}
+
+static struct flb_output_plugin out_worker_test_plugin = {
+    .name         = "worker_test",
+    .description  = "Output workers test output",
+    .cb_init      = cb_worker_init,
+    .cb_flush     = cb_worker_flush,
+    .cb_exit      = cb_worker_exit,
+    .event_type   = FLB_OUTPUT_LOGS,
+    .flags        = 0,
+};
+
+static void check_reset(int sleep_ms)
+{
+    memset(&check, 0, sizeof(check));
+    pthread_mutex_init(&check.lock, NULL);
+    flush_sleep_ms = sleep_ms;
+}
+
+static int check_events()
+{
+    int events;
+
+    pthread_mutex_lock(&check.lock);
+    events = check.events;
+    pthread_mutex_unlock(&check.lock);
+
+    return events;
+}
+
+/* Wait up to 'ms' milliseconds for 'events' delivered records */
+static int wait_events(int events, int ms)
+{
+    int i;
+
+    for (i = 0; i < ms / 50; i++) {
+        if (check_events() >= events) {
+            return 0;
+        }
+        flb_time_msleep(50);
+    }
+
+    return -1;
+}
+
+/*
+ * Create a context with 'n_inputs' lib inputs, tagged "slow" for the first
+ * one if 'slow' is set and "in<N>" otherwise, routed to the test output.
+ */
+static flb_ctx_t *workers_ctx_create(int n_inputs, int slow, int *in_ffd,
+                                     const char *workers,
+                                     const char *dispatch,
+                                     const char *steal)
+{
+    int i;
+    int ret;
+    int out_ffd;
+    char tag[16];
+    flb_ctx_t *ctx;
+
+    ctx = flb_create();
+    if (!ctx) {
+        return NULL;
+    }
+
+    flb_service_set(ctx,
+                    "flush", "0.2",
+                    "grace", "3",
+                    "log_level", "error",
+                    NULL);
+
+    /* register the test output in the context plugins */
+    mk_list_add(&out_worker_test_plugin._head, &ctx->config->out_plugins);
+
+    for (i = 0; i < n_inputs; i++) {
+        if (i == 0 && slow) {
+            snprintf(tag, sizeof(tag), SLOW_TAG);
+        }
+        else {
+            snprintf(tag, sizeof(tag), "in%i", i);
+        }
+        in_ffd[i] = flb_input(ctx, (char *) "lib", NULL);
+        TEST_CHECK(in_ffd[i] >= 0);
+        flb_input_set(ctx, in_ffd[i], "tag", tag, NULL);
+    }
+
+    out_ffd = flb_output(ctx, (char *) "worker_test", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    ret = flb_output_set(ctx, out_ffd,
+                         "match", "*",
+                         "workers", workers,
+                         "workers.dispatch", dispatch,
+                         "workers.steal", steal,
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    return ctx;
+}
+
+static void workers_ctx_destroy(flb_ctx_t *ctx)
+{
+    flb_stop(ctx);
+
+    /* the plugin is static, do not let the context release it */
+    mk_list_del(&out_worker_test_plugin._head);
+    flb_destroy(ctx);
+}
+
+/* Tasks of the same round go to different idle workers */
+static void test_least_loaded_spread()
+{
+    int i;
+    int j;
+    int ret;
+    int distinct = 0;
+    int in_ffd[MAX_INPUTS];
+    flb_ctx_t *ctx;
+
+    check_reset(300);
+
+    ctx = workers_ctx_create(4, FLB_FALSE, in_ffd, "4", "least_loaded", "off");
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < 4; i++) {
+        flb_lib_push(ctx, in_ffd[i], RECORD, sizeof(RECORD) - 1);
+    }
+
+    ret = wait_events(4, 5000);
+    TEST_CHECK(ret == 0);
+
+    /* every worker got one of the four tasks */
+    TEST_CHECK(check.count == 4);
+    for (i = 0; i < check.count && i < MAX_FLUSHES; i++) {
+        for (j = 0; j < i; j++) {
+            if (check.flushes[j].worker == check.flushes[i].worker) {
+                break;
+            }
+        }
+        if (j == i) {
+            distinct++;
+        }
+    }
+    TEST_CHECK(distinct == 4);
+    TEST_MSG("tasks ran on %i distinct workers, expected 4", distinct);
+
+    workers_ctx_destroy(ctx);
+}
+
+/*
+ * A worker blocked by a slow flush keeps the tasks queued behind it, the idle
+ * worker steals them while the running task stays with its owner and every
+ * task is delivered once.
+ */
+static void test_steal_queued_tasks()
+{
+    int i;
+    int j;
+    int ret;
+    int seen;
+    int slow = -1;
+    uint64_t slow_end = 0;
+    int in_ffd[MAX_INPUTS];
+    char tag[16];
+    flb_ctx_t *ctx;
+    struct flush_record *r;
+
+    check_reset(0);
+
+    ctx = workers_ctx_create(5, FLB_TRUE, in_ffd, "2", "round_robin", "on");
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    /* the slow task takes one worker */
+    flb_lib_push(ctx, in_ffd[0], RECORD, sizeof(RECORD) - 1);
+    flb_time_msleep(400);
+
+    /* round robin queues half of these behind the slow task */
+    for (i = 1; i < 5; i++) {
+        flb_lib_push(ctx, in_ffd[i], RECORD, sizeof(RECORD) - 1);
+    }
+
+    ret = wait_events(5, SLOW_MS + 3000);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(check.count == 5);
+
+    for (i = 0; i < check.count && i < MAX_FLUSHES; i++) {
+        if (strcmp(check.flushes[i].tag, SLOW_TAG) == 0) {
+            slow = check.flushes[i].worker;
+            slow_end = check.flushes[i].end_ms;
+        }
+    }
+    TEST_CHECK(slow != -1);
+
+    /* each task once, the fast ones finished on the other worker first */
+    for (i = 1; i < 5; i++) {
+        snprintf(tag, sizeof(tag), "in%i", i);
+        seen = 0;
+        for (j = 0; j < check.count && j < MAX_FLUSHES; j++) {
+            r = &check.flushes[j];
+            if (strcmp(r->tag, tag) != 0) {
+                continue;
+            }
+            seen++;
+            TEST_CHECK(r->worker != slow);
+            TEST_CHECK(r->end_ms < slow_end);
+            TEST_MSG("%s ran on worker #%i, slow task on #%i", tag,
+                     r->worker, slow);
+        }
+        TEST_CHECK(seen == 1);
+        TEST_MSG("%s delivered %i times", tag, seen);
+    }
+
+    workers_ctx_destroy(ctx);
+}
+
+/* Many small rounds over all the workers: no task waits for a lost wakeup */
+static void test_no_lost_wakeup()
+{
+    int i;
+    int j;
+    int ret;
+    int rounds = 20;
+    int in_ffd[MAX_INPUTS];
+    flb_ctx_t *ctx;
+
+    check_reset(0);
+
+    ctx = workers_ctx_create(MAX_INPUTS, FLB_FALSE, in_ffd,
+                             "4", "least_loaded", "on");
+    if (!TEST_CHECK(ctx != NULL)) {
+        return;
+    }
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < rounds; i++) {
+        for (j = 0; j < MAX_INPUTS; j++) {
+            flb_lib_push(ctx, in_ffd[j], RECORD, sizeof(RECORD) - 1);
+        }
+        flb_time_msleep(30);
+    }
+
+    /* tasks are only dispatched on a flush, a lost wakeup stalls forever */
+    ret = wait_events(rounds * MAX_INPUTS, 5000);
+    TEST_CHECK(ret == 0);
+    TEST_MSG("delivered %i of %i records", check_events(),
+             rounds * MAX_INPUTS);
+
+    workers_ctx_destroy(ctx);
+}
+
+TEST_LIST = {
+    {"least_loaded_spread", test_least_loaded_spread},
+    {"steal_queued_tasks", test_steal_queued_tasks},
+    {"no_lost_wakeup", test_no_lost_wakeup},
+    { 0 }
+};
@@ -830,6 +830,277 @@ void test_json_pack_bug5336()
     }
 }
 
+/*
+ * Pack a JSON buffer through the jsmn tokenizer path: a state that already
+ * consumed input is resumed by the tokenizer instead of the direct packer,
+ * so prime it with the leading whitespace of the buffer.
+ */
+static int pack_json_tokenizer(const char *js, size_t len,
+                               char **out_buf, int *out_size)
+{
+    int ret;
+    struct flb_pack_state state;
+
+    if (len == 0 || js[0] != ' ') {
+        return -1;
+    }
+
+    flb_pack_state_init(&state);
+    ret = flb_json_tokenise(js, 1, &state);
+    if (ret != 0) {
+        flb_pack_state_reset(&state);
+        return -1;
+    }
+
+    ret = flb_pack_json_state(js, len, out_buf, out_size, &state);
+    flb_pack_state_reset(&state);
+    return ret;
+}
+
+/* Direct packer and jsmn tokenizer must generate the same msgpack bytes */
+void test_json_pack_direct()
+{
+    int i;
+    int n;
+    int ret;
+    int root_type;
+    int legacy_size;
+    char *legacy_buf;
+    char *out_buf;
+    size_t out_size;
+    flb_sds_t big;
+    int sizes[] = {14, 15, 16, 65534, 65535, 70000};
+    char *samples[] = {
+        " {\"key\": \"value\", \"int\": 10, \"neg\": -5, \"flt\": 1.25}",
+        " [1, 2.5, 1e-3, 1e5, true, false, null, \"s\", [], {}]",
+        " {\"log\": \"a \\\"quoted\\\" \\\\ \\/ \\b\\f\\n\\r\\t string\"}",
+        " {\"u\": \"\\u00e1\\u00e9 \\u2764 caf\xc3\xa9\"}",
+        " {\"a\": {\"b\": {\"c\": [{\"d\": [1, [2, [3]]]}]}}}",
+        " {\"a\": 1}\n{\"b\": 2}\n[3]\n",
+        " \t\r\n{ \"k\" : [ 1 , 2 ] , \"x\" : { } }  ",
+        NULL
+    };
+
+    for (i = 0; samples[i] != NULL; i++) {
+        ret = flb_pack_json(samples[i], strlen(samples[i]),
+                            &out_buf, &out_size, &root_type);
+        TEST_CHECK(ret == 0);
+
+        ret = pack_json_tokenizer(samples[i], strlen(samples[i]),
+                                  &legacy_buf, &legacy_size);
+        TEST_CHECK(ret == 0);
+        if (!TEST_CHECK(out_size == legacy_size &&
+                        memcmp(out_buf, legacy_buf, out_size) == 0)) {
+            TEST_MSG("sample %i generated a different msgpack buffer", i);
+        }
+        flb_free(out_buf);
+        flb_free(legacy_buf);
+    }
+
+    /* containers that need map16 and array16/array32 headers */
+    for (n = 0; n < (int) (sizeof(sizes) / sizeof(int)); n++) {
+        big = flb_sds_create(" [{");
+        for (i = 0; i < 17; i++) {
+            flb_sds_printf(&big, "%s\"k%i\": %i", i ? "," : "", i, i);
+        }
+        flb_sds_cat_safe(&big, "}", 1);
+        for (i = 0; i < sizes[n]; i++) {
+            flb_sds_cat_safe(&big, ",1", 2);
+        }
+        flb_sds_cat_safe(&big, "]", 1);
+
+        ret = flb_pack_json(big, flb_sds_len(big),
+                            &out_buf, &out_size, &root_type);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(root_type == FLB_PACK_JSON_ARRAY);
+
+        ret = pack_json_tokenizer(big, flb_sds_len(big),
+                                  &legacy_buf, &legacy_size);
+        TEST_CHECK(ret == 0);
+        if (!TEST_CHECK(out_size == legacy_size &&
+                        memcmp(out_buf, legacy_buf, out_size) == 0)) {
+            TEST_MSG("array of %i entries generated a different buffer",
+                     sizes[n] + 1);
+        }
+        flb_free(out_buf);
+        flb_free(legacy_buf);
+        flb_sds_destroy(big);
+    }
+}
+
+/* Incomplete and invalid messages keep the previous return codes */
+void test_json_pack_direct_partial()
+{
+    int ret;
+    int root_type;
+    int out_size;
+    char *out_buf;
+    size_t size;
+    char *json;
+    struct flb_pack_state state;
+
+    /* a complete record followed by an incomplete one */
+    json = "{\"a\": 1}{\"b\": \"in";
+    flb_pack_state_init(&state);
+    ret = flb_pack_json_state(json, strlen(json), &out_buf, &out_size, &state);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(state.last_byte == 8);
+    if (ret == 0) {
+        flb_free(out_buf);
+    }
+    flb_pack_state_reset(&state);
+
+    /* incomplete message */
+    json = "{\"a\": [1, 2";
+    flb_pack_state_init(&state);
+    ret = flb_pack_json_state(json, strlen(json), &out_buf, &out_size, &state);
+    TEST_CHECK(ret == FLB_ERR_JSON_PART);
+    flb_pack_state_reset(&state);
+
+    ret = flb_pack_json(json, strlen(json), &out_buf, &size, &root_type);
+    TEST_CHECK(ret == -1);
+
+    /* invalid message */
+    json = "{\"a\": [1, 2}";
+    flb_pack_state_init(&state);
+    ret = flb_pack_json_state(json, strlen(json), &out_buf, &out_size, &state);
+    TEST_CHECK(ret == FLB_ERR_JSON_INVAL);
+    flb_pack_state_reset(&state);
+}
+
+/* Compare the direct packer and the tokenizer on container log lines */
+void test_json_pack_direct_bench()
+{
+    int i;
+    int ret;
+    int root_type;
+    int lines = 2000;
+    int rounds = 10;
+    int legacy_size;
+    char *legacy_buf;
+    char *out_buf;
+    size_t out_size;
+    double direct;
+    double legacy;
+    flb_sds_t buf;
+    struct flb_time t1;
+    struct flb_time t2;
+
+    buf = flb_sds_create(" ");
+    for (i = 0; i < lines; i++) {
+        flb_sds_printf(&buf,
+                       "{\"log\":\"2022-11-07T10:%02i:%02i.%06iZ INFO "
+                       "[http-nio-8080-exec-%i] c.e.api.OrderController : "
+                       "order id=%i processed in %i ms \\\"status\\\":\\\"ok\\\"\\n\","
+                       "\"stream\":\"stdout\","
+                       "\"time\":\"2022-11-07T10:%02i:%02i.%09iZ\","
+                       "\"kubernetes\":{\"pod_name\":\"orders-7d9c8b6f4-x2x9q\","
+                       "\"namespace_name\":\"shop\",\"container_name\":\"orders\","
+                       "\"labels\":{\"app\":\"orders\",\"tier\":\"backend\"}},"
+                       "\"latency\":%i.%i,\"retry\":false}\n",
+                       i % 60, i % 60, i, i % 16, i, i % 100,
+                       i % 60, i % 60, i, i % 100, i % 10);
+    }
+
+    flb_time_get(&t1);
+    for (i = 0; i < rounds; i++) {
+        ret = flb_pack_json(buf, flb_sds_len(buf),
+                            &out_buf, &out_size, &root_type);
+        TEST_CHECK(ret == 0);
+        flb_free(out_buf);
+    }
+    flb_time_get(&t2);
+    direct = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    flb_time_get(&t1);
+    for (i = 0; i < rounds; i++) {
+        ret = pack_json_tokenizer(buf, flb_sds_len(buf),
+                                  &legacy_buf, &legacy_size);
+        TEST_CHECK(ret == 0);
+        flb_free(legacy_buf);
+    }
+    flb_time_get(&t2);
+    legacy = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    printf("\n[json pack] %i records x %i rounds (%zu bytes): "
+           "direct=%.4fs tokenizer=%.4fs\n",
+           lines, rounds, flb_sds_len(buf), direct, legacy);
+
+    flb_sds_destroy(buf);
+}
+
+/* Convert a multi-MB chunk of records to JSON in the supported formats */
+void test_msgpack_to_json_bench()
+{
+    int i;
+    int f;
+    int records = 20000;
+    double elapsed;
+    flb_sds_t json;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    struct flb_time tm;
+    struct flb_time t1;
+    struct flb_time t2;
+    char log[] = "10.1.2.3 - - [07/Nov/2022:10:30:00 +0000] \"GET /api/v1/orders"
+                 "?id=1234 HTTP/1.1\" 200 512 \"-\" \"Mozilla/5.0 (X11; Linux "
+                 "x86_64) \\\"curl\\\"\"\n\tcaf\xc3\xa9";
+    int formats[] = {
+        FLB_PACK_JSON_FORMAT_JSON,
+        FLB_PACK_JSON_FORMAT_LINES,
+        FLB_PACK_JSON_FORMAT_STREAM
+    };
+    char *names[] = {"json", "json_lines", "json_stream"};
+    flb_sds_t date_key;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    for (i = 0; i < records; i++) {
+        flb_time_get(&tm);
+        msgpack_pack_array(&mp_pck, 2);
+        flb_time_append_to_msgpack(&tm, &mp_pck, 0);
+        msgpack_pack_map(&mp_pck, 4);
+        msgpack_pack_str(&mp_pck, 3);
+        msgpack_pack_str_body(&mp_pck, "log", 3);
+        msgpack_pack_str(&mp_pck, sizeof(log) - 1);
+        msgpack_pack_str_body(&mp_pck, log, sizeof(log) - 1);
+        msgpack_pack_str(&mp_pck, 6);
+        msgpack_pack_str_body(&mp_pck, "stream", 6);
+        msgpack_pack_str(&mp_pck, 6);
+        msgpack_pack_str_body(&mp_pck, "stdout", 6);
+        msgpack_pack_str(&mp_pck, 5);
+        msgpack_pack_str_body(&mp_pck, "bytes", 5);
+        msgpack_pack_int64(&mp_pck, i);
+        msgpack_pack_str(&mp_pck, 7);
+        msgpack_pack_str_body(&mp_pck, "latency", 7);
+        msgpack_pack_double(&mp_pck, i / 3.0);
+    }
+
+    date_key = flb_sds_create("date");
+    for (f = 0; f < 3; f++) {
+        flb_time_get(&t1);
+        json = flb_pack_msgpack_to_json_format(mp_sbuf.data, mp_sbuf.size,
+                                               formats[f],
+                                               FLB_PACK_JSON_DATE_ISO8601,
+                                               date_key);
+        flb_time_get(&t2);
+        TEST_CHECK(json != NULL);
+        if (!json) {
+            continue;
+        }
+        elapsed = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+        printf("\n[msgpack to json] %-11s: %zu bytes msgpack -> %zu bytes "
+               "JSON in %.4fs", names[f], mp_sbuf.size, flb_sds_len(json),
+               elapsed);
+        flb_sds_destroy(json);
+    }
+    printf("\n");
+
+    flb_sds_destroy(date_key);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+}
+
 TEST_LIST = {
     /* JSON maps iteration */
     { "json_pack"          , test_json_pack },
@@ -842,6 +1113,10 @@ TEST_LIST = {
     { "json_pack_bug1278"  , test_json_pack_bug1278},
     { "json_pack_nan"      , test_json_pack_nan},
     { "json_pack_bug5336"  , test_json_pack_bug5336},
+    { "json_pack_direct"   , test_json_pack_direct},
+    { "json_pack_direct_partial", test_json_pack_direct_partial},
+    { "json_pack_direct_bench"  , test_json_pack_direct_bench},
+    { "msgpack_to_json_bench"   , test_msgpack_to_json_bench},
 
     /* Mixed bytes, check JSON encoding */
     { "utf8_to_json", test_utf8_to_json},
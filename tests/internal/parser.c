@@ -6,6 +6,8 @@
 #include <fluent-bit/flb_error.h>
 #include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_sds.h>
+#include <fluent-bit/multiline/flb_ml.h>
+#include <fluent-bit/multiline/flb_ml_parser.h>
 
 #include <time.h>
 #include <string.h>
@@ -518,9 +520,374 @@ void test_mysql_unquoted()
 }
 
 
+/* Time formats of the common parsers (conf/parsers.conf) */
+struct time_format {
+    char *name;
+    char *time_fmt;
+    char *sample;       /* printf format: day, hour, min, sec, fraction */
+};
+
+struct time_format time_formats[] = {
+    {"apache",         "%d/%b/%Y:%H:%M:%S %z",    "%02i/Jul/2017:%02i:%02i:%02i +0530"},
+    {"nginx",          "%d/%b/%Y:%H:%M:%S %z",    "%02i/Jul/2017:%02i:%02i:%02i -07:00"},
+    {"docker",         "%Y-%m-%dT%H:%M:%S.%L",    "2017-07-%02iT%02i:%02i:%02i.%09iZ"},
+    {"syslog-rfc5424", "%Y-%m-%dT%H:%M:%S.%L%z",  "2017-07-%02iT%02i:%02i:%02i.%06i+02:00"},
+    {"syslog-rfc3164", "%b %d %H:%M:%S",          "Jul %2i %02i:%02i:%02i"},
+    {"generic_N_TZ",   "%m/%d/%Y %H:%M:%S.%L %z", "07/%02i/2017 %02i:%02i:%02i.%i +0200"},
+    {"apache_error",   "%a %b %d %H:%M:%S.%L %Y", "Mon Jul %02i %02i:%02i:%02i.%i 2017"},
+};
+
+static struct flb_parser *time_parser_create(struct time_format *f,
+                                             struct flb_config *config)
+{
+    return flb_parser_create(f->name, "regex", "^(?<time>.*)$", FLB_TRUE,
+                             f->time_fmt, "time", NULL, FLB_TRUE, FLB_FALSE,
+                             NULL, 0, NULL, config);
+}
+
+static int time_sample(struct time_format *f, int i, char *buf, size_t size)
+{
+    /* a new second every 64 records */
+    int sec = i / 64;
+    int frac = ((i * 7919) % 1000000) + 1;
+
+    return snprintf(buf, size, f->sample, 1 + (sec / 86400) % 28,
+                    (sec / 3600) % 24, (sec / 60) % 60, sec % 60, frac);
+}
+
+/* Lookup without the compiled format and without the cache */
+static int time_lookup_generic(struct flb_parser *p, char *str, int len,
+                               time_t now, time_t *epoch, double *ns)
+{
+    int ret;
+    struct flb_parser_time_op *ops;
+    struct flb_parser_time_op *frac_ops;
+    struct flb_parser_time_cache *cache;
+
+    ops = p->time_ops;
+    frac_ops = p->time_frac_ops;
+    cache = p->time_cache;
+    p->time_ops = NULL;
+    p->time_frac_ops = NULL;
+    p->time_cache = NULL;
+
+    ret = flb_parser_time_lookup_epoch(str, len, now, p, epoch, ns);
+
+    p->time_ops = ops;
+    p->time_frac_ops = frac_ops;
+    p->time_cache = cache;
+
+    return ret;
+}
+
+/* The compiled formats and the cache must match flb_strptime() */
+void test_parser_time_lookup_cache()
+{
+    int i;
+    int j;
+    int len;
+    int ret;
+    int ret_generic;
+    double ns;
+    double ns_generic;
+    char buf[64];
+    time_t now;
+    time_t epoch;
+    time_t epoch_generic;
+    struct flb_parser *p;
+    struct flb_config *config;
+    struct time_format *f;
+    char *extra[] = {
+        "Jul  4 01:02:03", "jul 04 01:02:03", "July 4 01:02:03",
+        "2017-07-04T01:02:03.5", "2017-07-04T01:02:03.123456789Z",
+        "2017-07-04T01:02:03.1-0130", "2017-07-04T01:02:03.1 -01",
+        "2017-07-04T01:02:03.1+01:3", "2017-07-04T01:02:03.1UTC",
+        "2017-07-04T1:2:3.1", "2017-7-4T01:02:03.1", "2017-07-04T01:02:60.1",
+        "04/Jul/2017:01:02:03 +0000", "04/JUL/2017:01:02:03 Z",
+        "4/Jul/2017:01:02:03 -1200", "04/Jul/2017:24:02:03 +0000",
+        "04/Jul/2017:01:02:03", "32/Jul/2017:01:02:03 +0000", ""
+    };
+
+    config = flb_config_init();
+    now = time(NULL);
+
+    for (i = 0; i < sizeof(time_formats) / sizeof(struct time_format); i++) {
+        f = &time_formats[i];
+        p = time_parser_create(f, config);
+        TEST_CHECK(p != NULL);
+        if (!p) {
+            continue;
+        }
+
+        for (j = 0; j < 64 * 200; j += 13) {
+            len = time_sample(f, j, buf, sizeof(buf));
+
+            ret = flb_parser_time_lookup_epoch(buf, len, now, p, &epoch, &ns);
+            ret_generic = time_lookup_generic(p, buf, len, now,
+                                              &epoch_generic, &ns_generic);
+            TEST_CHECK(ret == 0 && ret == ret_generic);
+            TEST_CHECK(epoch == epoch_generic && ns == ns_generic);
+            TEST_MSG("parser=%s time='%s' epoch=%li/%li ns=%f/%f",
+                     f->name, buf, (long) epoch, (long) epoch_generic,
+                     ns, ns_generic);
+        }
+
+        /* corner cases, twice to go through the cache */
+        for (j = 0; j < sizeof(extra) / sizeof(char *) * 2; j++) {
+            len = strlen(extra[j / 2]);
+            memcpy(buf, extra[j / 2], len);
+
+            epoch = epoch_generic = 0;
+            ret = flb_parser_time_lookup_epoch(buf, len, now, p, &epoch, &ns);
+            ret_generic = time_lookup_generic(p, buf, len, now,
+                                              &epoch_generic, &ns_generic);
+            TEST_CHECK(ret == ret_generic);
+            TEST_CHECK(epoch == epoch_generic && ns == ns_generic);
+            TEST_MSG("parser=%s time='%.*s' epoch=%li/%li ns=%f/%f",
+                     f->name, len, buf, (long) epoch, (long) epoch_generic,
+                     ns, ns_generic);
+        }
+    }
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+/* Time lookup of the common formats, with and without the fast paths */
+void test_parser_time_lookup_bench()
+{
+    int i;
+    int j;
+    int n;
+    int len;
+    int records = 200000;
+    double ns;
+    double fast;
+    double generic;
+    char buf[64];
+    char *samples;
+    time_t now;
+    time_t epoch;
+    struct flb_time t1;
+    struct flb_time t2;
+    struct flb_parser *p;
+    struct flb_config *config;
+    struct time_format *f;
+
+    config = flb_config_init();
+    now = time(NULL);
+
+    samples = flb_malloc(records * sizeof(buf));
+    TEST_CHECK(samples != NULL);
+    if (!samples) {
+        flb_config_exit(config);
+        return;
+    }
+
+    printf("\n");
+    for (i = 0; i < sizeof(time_formats) / sizeof(struct time_format); i++) {
+        f = &time_formats[i];
+        p = time_parser_create(f, config);
+        TEST_CHECK(p != NULL);
+        if (!p) {
+            continue;
+        }
+
+        for (j = 0; j < records; j++) {
+            time_sample(f, j, samples + j * sizeof(buf), sizeof(buf));
+        }
+
+        n = 0;
+        flb_time_get(&t1);
+        for (j = 0; j < records; j++) {
+            len = strlen(samples + j * sizeof(buf));
+            n += time_lookup_generic(p, samples + j * sizeof(buf), len, now,
+                                     &epoch, &ns);
+        }
+        flb_time_get(&t2);
+        generic = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+        flb_time_get(&t1);
+        for (j = 0; j < records; j++) {
+            len = strlen(samples + j * sizeof(buf));
+            n += flb_parser_time_lookup_epoch(samples + j * sizeof(buf), len,
+                                              now, p, &epoch, &ns);
+        }
+        flb_time_get(&t2);
+        fast = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+        TEST_CHECK(n == 0);
+
+        printf("[time lookup] %-15s %i records: strptime=%.4fs "
+               "cached=%.4fs (%.1fx)\n", f->name, records, generic, fast,
+               generic / fast);
+    }
+
+    flb_free(samples);
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+/* Registry of parsers: lookups by name, duplicates and removals */
+void test_parser_registry()
+{
+    int i;
+    char name[32];
+    struct flb_parser *p;
+    struct flb_config *config;
+
+    config = flb_config_init();
+
+    for (i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name) - 1, "parser_%i", i);
+        p = flb_parser_create(name, "json", NULL, FLB_TRUE, NULL, NULL, NULL,
+                              FLB_FALSE, FLB_FALSE, NULL, 0, NULL, config);
+        TEST_CHECK(p != NULL);
+    }
+
+    for (i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name) - 1, "parser_%i", i);
+        p = flb_parser_get(name, config);
+        TEST_CHECK(p != NULL && strcmp(p->name, name) == 0);
+    }
+    TEST_CHECK(flb_parser_get("parser_1000", config) == NULL);
+    TEST_CHECK(flb_parser_get("PARSER_1", config) == NULL);
+
+    /* names are unique */
+    p = flb_parser_create("parser_1", "json", NULL, FLB_TRUE, NULL, NULL,
+                          NULL, FLB_FALSE, FLB_FALSE, NULL, 0, NULL, config);
+    TEST_CHECK(p == NULL);
+
+    /* a failed creation doesn't leave the name registered */
+    p = flb_parser_create("invalid", "regex", "(?<a>", FLB_TRUE, NULL, NULL,
+                          NULL, FLB_FALSE, FLB_FALSE, NULL, 0, NULL, config);
+    TEST_CHECK(p == NULL);
+    TEST_CHECK(flb_parser_get("invalid", config) == NULL);
+
+    /* a destroyed parser is unregistered */
+    p = flb_parser_get("parser_1", config);
+    flb_parser_destroy(p);
+    TEST_CHECK(flb_parser_get("parser_1", config) == NULL);
+    p = flb_parser_create("parser_1", "json", NULL, FLB_TRUE, NULL, NULL,
+                          NULL, FLB_FALSE, FLB_FALSE, NULL, 0, NULL, config);
+    TEST_CHECK(p != NULL && flb_parser_get("parser_1", config) == p);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+/* Lookup by walking the list, as done before the registry index */
+static struct flb_parser *parser_get_linear(const char *name,
+                                            struct flb_config *config)
+{
+    struct mk_list *head;
+    struct flb_parser *parser;
+
+    mk_list_foreach(head, &config->parsers) {
+        parser = mk_list_entry(head, struct flb_parser, _head);
+        if (strcmp(parser->name, name) == 0) {
+            return parser;
+        }
+    }
+
+    return NULL;
+}
+
+/* Startup with 1000 parsers and multiline parsers, then name lookups */
+void test_parser_registry_bench()
+{
+    int i;
+    int j;
+    int n = 1000;
+    int rounds = 100;
+    int found = 0;
+    char name[32];
+    double create;
+    double create_ml;
+    double linear;
+    double indexed;
+    double indexed_ml;
+    struct flb_time t1;
+    struct flb_time t2;
+    struct flb_parser *p;
+    struct flb_ml_parser *mlp;
+    struct flb_config *config;
+
+    config = flb_config_init();
+
+    flb_time_get(&t1);
+    for (i = 0; i < n; i++) {
+        snprintf(name, sizeof(name) - 1, "apache_%i", i);
+        p = flb_parser_create(name, "regex",
+                              "^(?<host>[^ ]*) [^ ]* (?<user>[^ ]*) "
+                              "\\[(?<time>[^\\]]*)\\] \"(?<method>\\S+)"
+                              "(?: +(?<path>[^ ]*) +\\S*)?\" (?<code>[^ ]*) "
+                              "(?<size>[^ ]*)$", FLB_TRUE,
+                              "%d/%b/%Y:%H:%M:%S %z", "time", NULL,
+                              FLB_FALSE, FLB_FALSE, NULL, 0, NULL, config);
+        TEST_CHECK(p != NULL);
+    }
+    flb_time_get(&t2);
+    create = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    flb_time_get(&t1);
+    for (i = 0; i < n; i++) {
+        snprintf(name, sizeof(name) - 1, "multiline_%i", i);
+        mlp = flb_ml_parser_create(config, name, FLB_ML_ENDSWITH, "\\",
+                                   FLB_FALSE, 1000, NULL, NULL, NULL,
+                                   NULL, NULL);
+        TEST_CHECK(mlp != NULL);
+    }
+    flb_time_get(&t2);
+    create_ml = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    flb_time_get(&t1);
+    for (j = 0; j < rounds; j++) {
+        for (i = 0; i < n; i++) {
+            snprintf(name, sizeof(name) - 1, "apache_%i", i);
+            found += (parser_get_linear(name, config) != NULL);
+        }
+    }
+    flb_time_get(&t2);
+    linear = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    flb_time_get(&t1);
+    for (j = 0; j < rounds; j++) {
+        for (i = 0; i < n; i++) {
+            snprintf(name, sizeof(name) - 1, "apache_%i", i);
+            found += (flb_parser_get(name, config) != NULL);
+        }
+    }
+    flb_time_get(&t2);
+    indexed = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    flb_time_get(&t1);
+    for (j = 0; j < rounds; j++) {
+        for (i = 0; i < n; i++) {
+            snprintf(name, sizeof(name) - 1, "multiline_%i", i);
+            found += (flb_ml_parser_get(config, name) != NULL);
+        }
+    }
+    flb_time_get(&t2);
+    indexed_ml = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+    TEST_CHECK(found == n * rounds * 3);
+
+    printf("\n[parser registry] create %i parsers=%.4fs "
+           "multiline parsers=%.4fs\n", n, create, create_ml);
+    printf("[parser registry] %i lookups: linear=%.4fs indexed=%.4fs "
+           "(%.1fx) multiline=%.4fs\n", n * rounds, linear, indexed,
+           linear / indexed, indexed_ml);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
 TEST_LIST = {
     { "tzone_offset", test_parser_tzone_offset},
     { "time_lookup", test_parser_time_lookup},
+    { "time_lookup_cache", test_parser_time_lookup_cache},
+    { "time_lookup_bench", test_parser_time_lookup_bench},
+    { "registry", test_parser_registry},
+    { "registry_bench", test_parser_registry_bench},
     { "json_time_lookup", test_json_parser_time_lookup},
     { "regex_time_lookup", test_regex_parser_time_lookup},
     { "mysql_unquoted" , test_mysql_unquoted },
@@ -0,0 +1,723 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2022 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_config_format.h>
+#include <fluent-bit/flb_parser.h>
+#include <fluent-bit/flb_parser_decoder.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_unescape.h>
+#include <msgpack.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include "flb_tests_internal.h"
+
+static int msgpack_strncmp(char* str, size_t str_len, msgpack_object obj)
+{
+    int ret = -1;
+
+    if (str == NULL) {
+        flb_error("str is NULL");
+        return -1;
+    }
+
+    switch (obj.type)  {
+    case MSGPACK_OBJECT_STR:
+        if (obj.via.str.size != str_len) {
+            return -1;
+        }
+        ret = strncmp(str, obj.via.str.ptr, str_len);
+        break;
+    case MSGPACK_OBJECT_POSITIVE_INTEGER:
+        {
+            unsigned long val = strtoul(str, NULL, 10);
+            if (val == (unsigned long)obj.via.u64) {
+                ret = 0;
+            }
+        }
+        break;
+    case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+        {
+            long long val = strtoll(str, NULL, 10);
+            if (val == (unsigned long)obj.via.i64) {
+                ret = 0;
+            }
+        }
+        break;
+    case MSGPACK_OBJECT_FLOAT32:
+    case MSGPACK_OBJECT_FLOAT64:
+        {
+            double val = strtod(str, NULL);
+            if (fabs(val - obj.via.f64) < DBL_EPSILON) {
+                ret = 0;
+            }
+        }
+        break;
+    case MSGPACK_OBJECT_BOOLEAN:
+        if (obj.via.boolean) {
+            if (str_len != 4 /*true*/) {
+                return -1;
+            }
+            ret = strncasecmp(str, "true", 4);
+        }
+        else {
+            if (str_len != 5 /*false*/) {
+                return -1;
+            }
+            ret = strncasecmp(str, "false", 5);
+        }
+        break;
+    default:
+        flb_error("not supported");
+    }
+
+    return ret;
+}
+
+struct str_list {
+    size_t size;
+    char **lists;
+};
+
+static int compare_msgpack(void *msgpack_data, size_t msgpack_size, struct str_list *l)
+{
+    msgpack_unpacked result;
+    msgpack_object obj;
+    size_t off = 0;
+    int map_size;
+    int i_map;
+    int i_list;
+    int num = 0;
+
+    if (!TEST_CHECK(msgpack_data != NULL)) {
+        TEST_MSG("msgpack_data is NULL");
+        return -1;
+    }
+    else if (!TEST_CHECK(msgpack_size > 0)) {
+        TEST_MSG("msgpack_size is 0");
+        return -1;
+    }
+
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, msgpack_data, msgpack_size, &off) == MSGPACK_UNPACK_SUCCESS) {
+        obj = result.data;
+        /*
+        msgpack_object_print(stdout, obj);
+        */
+        if (!TEST_CHECK(obj.type == MSGPACK_OBJECT_MAP)) {
+            TEST_MSG("map error. type = %d", obj.type);
+            continue;
+        }
+        map_size = obj.via.map.size;
+        for (i_map=0; i_map<map_size; i_map++) {
+            if (!TEST_CHECK(obj.via.map.ptr[i_map].key.type == MSGPACK_OBJECT_STR)) {
+                TEST_MSG("key is not string. type =%d", obj.via.map.ptr[i_map].key.type);
+                continue;
+            }
+            for (i_list=0; i_list< l->size/2; i_list++)  {
+                if (msgpack_strncmp(l->lists[i_list*2], strlen(l->lists[i_list*2]),
+                                    obj.via.map.ptr[i_map].key) == 0 &&
+                    msgpack_strncmp(l->lists[i_list*2+1], strlen(l->lists[i_list*2+1]),
+                                    obj.via.map.ptr[i_map].val) == 0) {
+                    num++;
+                }
+            }
+        }
+    }
+    msgpack_unpacked_destroy(&result);
+    if (!TEST_CHECK(num == l->size/2)) {
+        msgpack_object_print(stdout, obj);
+        putchar('\n');
+        TEST_MSG("compare failed. matched_num=%d expect=%lu", num, l->size/2);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Create a logfmt parser, 'types' is released by flb_parser_destroy() */
+static struct flb_parser *logfmt_parser_create(struct flb_config *config,
+                                               char *time_fmt, int time_keep,
+                                               struct flb_parser_types *types,
+                                               int types_len)
+{
+    return flb_parser_create("logfmt", "logfmt", NULL, FLB_FALSE,
+                             time_fmt, time_fmt ? "time" : NULL, NULL,
+                             time_keep, FLB_FALSE,
+                             types, types_len, NULL, config);
+}
+
+static void check_logfmt(char *input, struct str_list *expected)
+{
+    int ret;
+    void *out_buf = NULL;
+    size_t out_size = 0;
+    struct flb_time out_time;
+    struct flb_parser *parser;
+    struct flb_config *config;
+
+    config = flb_config_init();
+    if (!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        exit(1);
+    }
+
+    parser = logfmt_parser_create(config, NULL, FLB_FALSE, NULL, 0);
+    if (!TEST_CHECK(parser != NULL)) {
+        TEST_MSG("flb_parser_create failed");
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    ret = flb_parser_do(parser, input, strlen(input), &out_buf, &out_size,
+                        &out_time);
+    if (!TEST_CHECK(ret != -1)) {
+        TEST_MSG("flb_parser_do failed. input=%s", input);
+        flb_parser_destroy(parser);
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    ret = compare_msgpack(out_buf, out_size, expected);
+    if (!TEST_CHECK(ret == 0)) {
+        TEST_MSG("compare failed. input=%s", input);
+    }
+
+    flb_free(out_buf);
+    flb_parser_destroy(parser);
+    flb_config_exit(config);
+}
+
+void test_basic()
+{
+    char *input = "str=text int=100 double=1.23 bool=true";
+    char *expected_strs[] = {"str", "text", "int", "100", "double","1.23", "bool", "true"};
+    struct str_list expected = {
+                                .size = sizeof(expected_strs)/sizeof(char*),
+                                .lists = &expected_strs[0],
+    };
+
+    check_logfmt(input, &expected);
+}
+
+void test_values()
+{
+    /* quoted, empty and missing values, garbage between the pairs */
+    char *input = "msg=\"hello world\" empty=\"\" novalue= flag "
+                  "  path=/api/v1?x=1 ==  \"junk\" url=\"a=b c\"";
+    char *expected_strs[] = {"msg", "hello world", "empty", "",
+                             "novalue", "true", "flag", "true",
+                             "path", "/api/v1?x", "1", "true",
+                             "junk", "true", "url", "a=b c"};
+    struct str_list expected = {
+                                .size = sizeof(expected_strs)/sizeof(char*),
+                                .lists = &expected_strs[0],
+    };
+
+    check_logfmt(input, &expected);
+}
+
+void test_escape()
+{
+    char *input = "msg=\"say \\\"hi\\\" to C:\\\\tmp\" "
+                  "long_key_with_an_escaped_value=\"0123456789abcdef\\\"x\"";
+    char *expected_strs[] = {"msg", "say \"hi\" to C:\\tmp",
+                             "long_key_with_an_escaped_value",
+                             "0123456789abcdef\"x"};
+    struct str_list expected = {
+                                .size = sizeof(expected_strs)/sizeof(char*),
+                                .lists = &expected_strs[0],
+    };
+
+    check_logfmt(input, &expected);
+}
+
+void test_time_key()
+{
+    struct flb_parser *parser = NULL;
+    struct flb_config *config = NULL;
+    int ret = 0;
+    char *input = "str=text int=100 double=1.23 bool=true time=2022-10-31T12:00:01.123";
+    void *out_buf = NULL;
+    size_t out_size = 0;
+    struct flb_time out_time;
+    char *expected_strs[] = {"str", "text", "int", "100", "double","1.23", "bool", "true"};
+    struct str_list expected = {
+                                .size = sizeof(expected_strs)/sizeof(char*),
+                                .lists = &expected_strs[0],
+    };
+
+    out_time.tm.tv_sec = 0;
+    out_time.tm.tv_nsec = 0;
+
+    config = flb_config_init();
+    if(!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        exit(1);
+    }
+
+    parser = logfmt_parser_create(config, "%Y-%m-%dT%H:%M:%S.%L", FLB_FALSE,
+                                  NULL, 0);
+    if (!TEST_CHECK(parser != NULL)) {
+        TEST_MSG("flb_parser_create failed");
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    ret = flb_parser_do(parser, input, strlen(input), &out_buf, &out_size, &out_time);
+    if (!TEST_CHECK(ret != -1)) {
+        TEST_MSG("flb_parser_do failed");
+        flb_parser_destroy(parser);
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    ret = compare_msgpack(out_buf, out_size, &expected);
+    if (!TEST_CHECK(ret == 0)) {
+        TEST_MSG("compare failed");
+    }
+
+    if (!TEST_CHECK(out_time.tm.tv_sec == 1667217601 && out_time.tm.tv_nsec == 123000000)) {
+        TEST_MSG("timestamp error. sec  Got=%ld Expect=1667217601", out_time.tm.tv_sec);
+        TEST_MSG("timestamp error. nsec Got=%ld Expect=123000000", out_time.tm.tv_nsec);
+    }
+
+    flb_free(out_buf);
+    flb_parser_destroy(parser);
+    flb_config_exit(config);
+}
+
+void test_time_keep()
+{
+    struct flb_parser *parser = NULL;
+    struct flb_config *config = NULL;
+    int ret = 0;
+    char *input = "str=text int=100 time=\"2022-10-31T12:00:01.123\"";
+    void *out_buf = NULL;
+    size_t out_size = 0;
+    struct flb_time out_time;
+    char *expected_strs[] = {"str", "text", "int", "100", "time", "2022-10-31T12:00:01.123"};
+    struct str_list expected = {
+                                .size = sizeof(expected_strs)/sizeof(char*),
+                                .lists = &expected_strs[0],
+    };
+
+    out_time.tm.tv_sec = 0;
+    out_time.tm.tv_nsec = 0;
+
+    config = flb_config_init();
+    if(!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        exit(1);
+    }
+
+    parser = logfmt_parser_create(config, "%Y-%m-%dT%H:%M:%S.%L", FLB_TRUE,
+                                  NULL, 0);
+    if (!TEST_CHECK(parser != NULL)) {
+        TEST_MSG("flb_parser_create failed");
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    ret = flb_parser_do(parser, input, strlen(input), &out_buf, &out_size, &out_time);
+    if (!TEST_CHECK(ret != -1)) {
+        TEST_MSG("flb_parser_do failed");
+        flb_parser_destroy(parser);
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    ret = compare_msgpack(out_buf, out_size, &expected);
+    if (!TEST_CHECK(ret == 0)) {
+        TEST_MSG("compare failed");
+    }
+
+    if (!TEST_CHECK(out_time.tm.tv_sec == 1667217601 && out_time.tm.tv_nsec == 123000000)) {
+        TEST_MSG("timestamp error. sec  Got=%ld Expect=1667217601", out_time.tm.tv_sec);
+        TEST_MSG("timestamp error. nsec Got=%ld Expect=123000000", out_time.tm.tv_nsec);
+    }
+
+    flb_free(out_buf);
+    flb_parser_destroy(parser);
+    flb_config_exit(config);
+}
+
+void test_types()
+{
+    struct flb_parser *parser = NULL;
+    struct flb_config *config = NULL;
+    int ret = 0;
+    char *input = "str=text int=100 double=1.23 bool=true";
+    struct flb_parser_types *types = NULL;
+    void *out_buf = NULL;
+    size_t out_size = 0;
+    struct flb_time out_time;
+    char *expected_strs[] = {"str", "text", "int", "256" /*= 0x100 */, "double","1.23", "bool", "true"};
+    struct str_list expected = {
+                                .size = sizeof(expected_strs)/sizeof(char*),
+                                .lists = &expected_strs[0],
+    };
+
+    config = flb_config_init();
+    if(!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        exit(1);
+    }
+
+    types = flb_malloc(sizeof(struct flb_parser_types));
+    if (!TEST_CHECK(types != NULL)) {
+        TEST_MSG("flb_malloc failed");
+        flb_config_exit(config);
+        exit(1);
+    }
+    types->key = flb_strdup("int");
+    if (!TEST_CHECK(types->key != NULL)) {
+        TEST_MSG("flb_strdup failed");
+        flb_free(types);
+        flb_config_exit(config);
+        exit(1);
+    }
+    types->key_len = 3;
+    types->type = FLB_PARSER_TYPE_HEX;
+
+    parser = logfmt_parser_create(config, NULL, FLB_FALSE, types, 1);
+    if (!TEST_CHECK(parser != NULL)) {
+        TEST_MSG("flb_parser_create failed");
+        flb_free(types->key);
+        flb_free(types);
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    ret = flb_parser_do(parser, input, strlen(input), &out_buf, &out_size, &out_time);
+    if (!TEST_CHECK(ret != -1)) {
+        TEST_MSG("flb_parser_do failed");
+        flb_parser_destroy(parser);
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    ret = compare_msgpack(out_buf, out_size, &expected);
+    if (!TEST_CHECK(ret == 0)) {
+        TEST_MSG("compare failed");
+    }
+
+    flb_free(out_buf);
+    flb_parser_destroy(parser);
+    flb_config_exit(config);
+}
+
+/*
+ * Byte by byte logfmt scanner, as the parser did before the delimiters were
+ * located with vector compares. It's the reference for the parser output
+ * and the baseline of the benchmark. With 'pck' set to NULL it only counts
+ * the pairs.
+ */
+static int logfmt_ref_scan(const char *in_buf, size_t in_size,
+                           msgpack_packer *pck, size_t *count)
+{
+    int out_len;
+    char *out_str;
+    const unsigned char *key;
+    const unsigned char *value = NULL;
+    size_t key_len;
+    size_t value_len;
+    int value_str;
+    int value_escape;
+    const unsigned char *c = (const unsigned char *) in_buf;
+    const unsigned char *end = c + in_size;
+
+#define IDENT(b) ((b) > ' ' && (b) != '=' && (b) != '"')
+
+    while (c < end) {
+        while (c < end && !IDENT(*c)) {
+            c++;
+        }
+        if (c == end) {
+            break;
+        }
+
+        key = c;
+        while (c < end && IDENT(*c)) {
+            c++;
+        }
+        key_len = c - key;
+
+        value_len = 0;
+        value_str = FLB_FALSE;
+        value_escape = FLB_FALSE;
+        if (c < end && *c == '=') {
+            c++;
+            if (c < end && *c == '"') {
+                c++;
+                value = c;
+                value_str = FLB_TRUE;
+                while (c < end && *c != '"') {
+                    if (*c == '\\') {
+                        value_escape = FLB_TRUE;
+                        c++;
+                        if (c == end) {
+                            break;
+                        }
+                    }
+                    c++;
+                }
+                value_len = c - value;
+                if (c < end) {
+                    c++;
+                }
+            }
+            else if (c < end) {
+                value = c;
+                while (c < end && IDENT(*c)) {
+                    c++;
+                }
+                value_len = c - value;
+            }
+        }
+
+        if (!pck) {
+            (*count)++;
+        }
+        else {
+            msgpack_pack_str(pck, key_len);
+            msgpack_pack_str_body(pck, (const char *) key, key_len);
+            if (value_len == 0 && value_str) {
+                msgpack_pack_str(pck, 0);
+            }
+            else if (value_len == 0) {
+                msgpack_pack_true(pck);
+            }
+            else if (value_escape) {
+                out_str = flb_malloc(value_len + 1);
+                out_str[0] = 0;
+                flb_unescape_string_utf8((const char *) value, value_len,
+                                         out_str);
+                out_len = strlen(out_str);
+                msgpack_pack_str(pck, out_len);
+                msgpack_pack_str_body(pck, out_str, out_len);
+                flb_free(out_str);
+            }
+            else {
+                msgpack_pack_str(pck, value_len);
+                msgpack_pack_str_body(pck, (const char *) value, value_len);
+            }
+        }
+
+        if (c == end) {
+            break;
+        }
+        if (*c == '\r') {
+            c++;
+            if (c < end && *c == '\n') {
+                c++;
+            }
+            break;
+        }
+        if (*c == '\n') {
+            c++;
+            break;
+        }
+    }
+
+#undef IDENT
+
+    return (const char *) c - in_buf;
+}
+
+static int logfmt_ref_do(const char *in_buf, size_t in_size,
+                         msgpack_sbuffer *sbuf)
+{
+    size_t count = 0;
+    msgpack_packer pck;
+
+    msgpack_sbuffer_init(sbuf);
+    logfmt_ref_scan(in_buf, in_size, NULL, &count);
+    if (count == 0) {
+        return -1;
+    }
+
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+    msgpack_pack_map(&pck, count);
+
+    return logfmt_ref_scan(in_buf, in_size, &pck, NULL);
+}
+
+static void check_scan(struct flb_parser *parser, char *buf, size_t len)
+{
+    int ret;
+    int ret_ref;
+    void *out_buf = NULL;
+    size_t out_size = 0;
+    msgpack_sbuffer ref;
+    struct flb_time out_time;
+
+    ret = flb_parser_do(parser, buf, len, &out_buf, &out_size, &out_time);
+    ret_ref = logfmt_ref_do(buf, len, &ref);
+
+    if (!TEST_CHECK(ret == ret_ref)) {
+        TEST_MSG("parser returned %i, expected %i", ret, ret_ref);
+    }
+    else if (ret != -1) {
+        if (!TEST_CHECK(out_size == ref.size &&
+                        memcmp(out_buf, ref.data, out_size) == 0)) {
+            TEST_MSG("output differs from the reference");
+        }
+    }
+
+    flb_free(out_buf);
+    msgpack_sbuffer_destroy(&ref);
+}
+
+/* Random lines made of delimiters, compared with the reference scanner */
+void test_scan()
+{
+    int i;
+    int r;
+    size_t len;
+    char buf[2048];
+    struct flb_parser *parser;
+    struct flb_config *config;
+    /* weighted towards the bytes the scanner stops at */
+    static const char alphabet[] = "aaaaaaaaaaaabbbbcdxyz0129._/:-    ===\"\"\"\\\\"
+                                   "\t\n\r\x01\x7f\x80\xc3\xa9\xff";
+
+    config = flb_config_init();
+    if (!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        exit(1);
+    }
+
+    parser = logfmt_parser_create(config, NULL, FLB_FALSE, NULL, 0);
+    if (!TEST_CHECK(parser != NULL)) {
+        TEST_MSG("flb_parser_create failed");
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    /* more pairs than the parser locates on the stack */
+    len = 0;
+    for (i = 0; i < 100; i++) {
+        len += snprintf(buf + len, sizeof(buf) - len, "k%i=\"v %i\" ", i, i);
+    }
+    check_scan(parser, buf, len);
+
+    srand(1);
+    for (r = 0; r < 20000; r++) {
+        len = rand() % sizeof(buf);
+        for (i = 0; i < len; i++) {
+            /* long runs of ident bytes once in a while */
+            if (r % 3 == 0 && rand() % 4 != 0) {
+                buf[i] = 'k';
+            }
+            else {
+                buf[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+            }
+        }
+
+        check_scan(parser, buf, len);
+    }
+
+    flb_parser_destroy(parser);
+    flb_config_exit(config);
+}
+
+/* Lines emitted by the Go services, parsed with both scanners */
+void test_bench()
+{
+    int i;
+    int ret;
+    int records = 200000;
+    size_t len;
+    double parser_time;
+    double ref_time;
+    char *line;
+    void *out_buf;
+    size_t out_size;
+    msgpack_sbuffer ref;
+    struct flb_time t1;
+    struct flb_time t2;
+    struct flb_time out_time;
+    struct flb_parser *parser;
+    struct flb_config *config;
+
+    line = "ts=2022-11-07T10:21:33.381415Z level=info caller=http/server.go:312 "
+           "msg=\"request completed\" method=GET "
+           "path=/api/v1/orders/8f14e45fceea167a5a36dedd4bea2543 status=200 "
+           "duration=12.331ms bytes=5123 remote_addr=10.12.0.17:53618 "
+           "user_agent=\"Go-http-client/1.1\" "
+           "trace_id=4bf92f3577b34da6a3ce929d0e0e4736\n";
+    len = strlen(line);
+
+    config = flb_config_init();
+    if (!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        exit(1);
+    }
+
+    parser = logfmt_parser_create(config, NULL, FLB_FALSE, NULL, 0);
+    if (!TEST_CHECK(parser != NULL)) {
+        TEST_MSG("flb_parser_create failed");
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    flb_time_get(&t1);
+    for (i = 0; i < records; i++) {
+        ret = flb_parser_do(parser, line, len, &out_buf, &out_size, &out_time);
+        if (!TEST_CHECK(ret == len)) {
+            break;
+        }
+        flb_free(out_buf);
+    }
+    flb_time_get(&t2);
+    parser_time = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    flb_time_get(&t1);
+    for (i = 0; i < records; i++) {
+        ret = logfmt_ref_do(line, len, &ref);
+        if (!TEST_CHECK(ret == len)) {
+            break;
+        }
+        msgpack_sbuffer_destroy(&ref);
+    }
+    flb_time_get(&t2);
+    ref_time = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    printf("\n[logfmt] %i records (%zu bytes): parser=%.4fs (%.0f MB/s) "
+           "byte scanner=%.4fs (%.0f MB/s)\n", records, len,
+           parser_time, (records * len) / parser_time / 1e6,
+           ref_time, (records * len) / ref_time / 1e6);
+
+    flb_parser_destroy(parser);
+    flb_config_exit(config);
+}
+
+TEST_LIST = {
+    { "basic", test_basic},
+    { "values", test_values},
+    { "escape", test_escape},
+    { "time_key", test_time_key},
+    { "time_keep", test_time_keep},
+    { "types", test_types},
+    { "scan", test_scan},
+    { "bench", test_bench},
+    { 0 }
+};
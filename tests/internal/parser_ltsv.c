@@ -22,9 +22,12 @@
 #include <fluent-bit/flb_config_format.h>
 #include <fluent-bit/flb_parser.h>
 #include <fluent-bit/flb_parser_decoder.h>
+#include <fluent-bit/flb_time.h>
 #include <msgpack.h>
 #include <float.h>
 #include <math.h>
+#include <ctype.h>
+#include <stdlib.h>
 #include "flb_tests_internal.h"
 
 static int msgpack_strncmp(char* str, size_t str_len, msgpack_object obj)
@@ -475,6 +478,256 @@ void test_decode_field_json()
     flb_config_exit(config);
 }
 
+/*
+ * Byte by byte LTSV scanner, as the parser did before the field delimiters
+ * were located with vector compares. It's the reference for the parser
+ * output and the baseline of the benchmark. With 'pck' set to NULL it only
+ * counts the fields.
+ */
+static int ltsv_ref_scan(const char *in_buf, size_t in_size,
+                         msgpack_packer *pck, size_t *count)
+{
+    const unsigned char *label;
+    const unsigned char *field;
+    size_t label_len;
+    size_t field_len;
+    const unsigned char *c = (const unsigned char *) in_buf;
+    const unsigned char *end = c + in_size;
+
+#define LABEL(b) (isalnum(b) || (b) == '_' || (b) == '.' || (b) == '-')
+#define FIELD(b) ((b) != '\0' && (b) != '\t' && (b) != '\n' && (b) != '\r')
+
+    while (c < end) {
+        label = c;
+        while (c < end && LABEL(*c)) {
+            c++;
+        }
+        label_len = c - label;
+        if (c == end || *c != ':') {
+            break;
+        }
+        c++;
+
+        field = c;
+        while (c < end && FIELD(*c)) {
+            c++;
+        }
+        field_len = c - field;
+
+        if (label_len > 0) {
+            if (!pck) {
+                (*count)++;
+            }
+            else {
+                msgpack_pack_str(pck, label_len);
+                msgpack_pack_str_body(pck, (const char *) label, label_len);
+                msgpack_pack_str(pck, field_len);
+                msgpack_pack_str_body(pck, (const char *) field, field_len);
+            }
+        }
+
+        if (c < end && *c == '\t') {
+            c++;
+        }
+        if (c == end) {
+            break;
+        }
+        if (*c == '\r') {
+            c++;
+            if (c < end && *c == '\n') {
+                c++;
+            }
+            break;
+        }
+        if (*c == '\n') {
+            c++;
+            break;
+        }
+    }
+
+#undef LABEL
+#undef FIELD
+
+    return (const char *) c - in_buf;
+}
+
+static int ltsv_ref_do(const char *in_buf, size_t in_size,
+                       msgpack_sbuffer *sbuf)
+{
+    size_t count = 0;
+    msgpack_packer pck;
+
+    msgpack_sbuffer_init(sbuf);
+    ltsv_ref_scan(in_buf, in_size, NULL, &count);
+    if (count == 0) {
+        return -1;
+    }
+
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+    msgpack_pack_map(&pck, count);
+
+    return ltsv_ref_scan(in_buf, in_size, &pck, NULL);
+}
+
+static struct flb_parser *ltsv_parser_create(struct flb_config *config)
+{
+    return flb_parser_create("ltsv", "ltsv", NULL, FLB_FALSE, NULL, NULL, NULL,
+                             FLB_FALSE, FLB_FALSE,
+                             NULL, 0, NULL, config);
+}
+
+static void check_scan(struct flb_parser *parser, char *buf, size_t len)
+{
+    int ret;
+    int ret_ref;
+    void *out_buf = NULL;
+    size_t out_size = 0;
+    msgpack_sbuffer ref;
+    struct flb_time out_time;
+
+    ret = flb_parser_do(parser, buf, len, &out_buf, &out_size, &out_time);
+    ret_ref = ltsv_ref_do(buf, len, &ref);
+
+    if (!TEST_CHECK(ret == ret_ref)) {
+        TEST_MSG("parser returned %i, expected %i", ret, ret_ref);
+    }
+    else if (ret != -1) {
+        if (!TEST_CHECK(out_size == ref.size &&
+                        memcmp(out_buf, ref.data, out_size) == 0)) {
+            TEST_MSG("output differs from the reference");
+        }
+    }
+
+    flb_free(out_buf);
+    msgpack_sbuffer_destroy(&ref);
+}
+
+/* Random records made of delimiters, compared with the reference scanner */
+void test_scan()
+{
+    int i;
+    int r;
+    size_t len;
+    char buf[2048];
+    struct flb_parser *parser;
+    struct flb_config *config;
+    /* weighted towards the bytes the scanner stops at */
+    static const char alphabet[] = "aaaaaaaaaaaabbbbcdxyz0129._- =\"\\::::\t\t\t"
+                                   "\n\r\x01\x0b\x0c\x0e\x7f\x80\xc3\xa9\xff";
+
+    config = flb_config_init();
+    if (!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        exit(1);
+    }
+
+    parser = ltsv_parser_create(config);
+    if (!TEST_CHECK(parser != NULL)) {
+        TEST_MSG("flb_parser_create failed");
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    /* more pairs than the parser locates on the stack */
+    len = 0;
+    for (i = 0; i < 100; i++) {
+        len += snprintf(buf + len, sizeof(buf) - len, "k%i:v%i\t", i, i);
+    }
+    check_scan(parser, buf, len);
+
+    srand(1);
+    for (r = 0; r < 20000; r++) {
+        len = rand() % sizeof(buf);
+        for (i = 0; i < len; i++) {
+            /* NUL bytes and long field values once in a while */
+            if (rand() % 80 == 0) {
+                buf[i] = '\0';
+            }
+            else if (r % 3 == 0 && rand() % 8 != 0) {
+                buf[i] = 'v';
+            }
+            else {
+                buf[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+            }
+        }
+
+        check_scan(parser, buf, len);
+    }
+
+    flb_parser_destroy(parser);
+    flb_config_exit(config);
+}
+
+/* Access log records, parsed with both scanners */
+void test_bench()
+{
+    int i;
+    int ret;
+    int records = 200000;
+    size_t len;
+    double parser_time;
+    double ref_time;
+    char *line;
+    void *out_buf;
+    size_t out_size;
+    msgpack_sbuffer ref;
+    struct flb_time t1;
+    struct flb_time t2;
+    struct flb_time out_time;
+    struct flb_parser *parser;
+    struct flb_config *config;
+
+    line = "time:[07/Nov/2022:10:21:33 +0000]\thost:10.12.0.17\t"
+           "forwardedfor:-\treq:GET /api/v1/orders/8f14e45fceea167a5a36dedd4bea2543"
+           "?page=2&sort=desc HTTP/1.1\tstatus:200\tsize:5123\t"
+           "referer:https://shop.example.com/orders\t"
+           "ua:Mozilla/5.0 (X11; Linux x86_64; rv:106.0) Gecko/20100101 "
+           "Firefox/106.0\treqtime:0.012\tupstream_time:0.011\n";
+    len = strlen(line);
+
+    config = flb_config_init();
+    if (!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        exit(1);
+    }
+
+    parser = ltsv_parser_create(config);
+    if (!TEST_CHECK(parser != NULL)) {
+        TEST_MSG("flb_parser_create failed");
+        flb_config_exit(config);
+        exit(1);
+    }
+
+    flb_time_get(&t1);
+    for (i = 0; i < records; i++) {
+        ret = flb_parser_do(parser, line, len, &out_buf, &out_size, &out_time);
+        if (!TEST_CHECK(ret == len)) {
+            break;
+        }
+        flb_free(out_buf);
+    }
+    flb_time_get(&t2);
+    parser_time = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    flb_time_get(&t1);
+    for (i = 0; i < records; i++) {
+        ret = ltsv_ref_do(line, len, &ref);
+        if (!TEST_CHECK(ret == len)) {
+            break;
+        }
+        msgpack_sbuffer_destroy(&ref);
+    }
+    flb_time_get(&t2);
+    ref_time = flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+    printf("\n[ltsv] %i records (%zu bytes): parser=%.4fs (%.0f MB/s) "
+           "byte scanner=%.4fs (%.0f MB/s)\n", records, len,
+           parser_time, (records * len) / parser_time / 1e6,
+           ref_time, (records * len) / ref_time / 1e6);
+
+    flb_parser_destroy(parser);
+    flb_config_exit(config);
+}
 
 TEST_LIST = {
     { "basic", test_basic},
@@ -482,5 +735,7 @@ TEST_LIST = {
     { "time_keep", test_time_keep},
     { "types", test_types},
     { "decode_field_json", test_decode_field_json},
+    { "scan", test_scan},
+    { "bench", test_bench},
     { 0 }
 };
@@ -22,6 +22,8 @@
 #include <fluent-bit/flb_config_format.h>
 #include <fluent-bit/flb_parser.h>
 #include <fluent-bit/flb_parser_decoder.h>
+#include <fluent-bit/flb_regex.h>
+#include <fluent-bit/flb_time.h>
 #include <msgpack.h>
 #include <float.h>
 #include <math.h>
@@ -481,11 +483,239 @@ void test_decode_field_json()
 }
 
 
+#define STOCK_PARSERS FLB_TESTS_DATA_PATH "/../../conf/parsers.conf"
+
+/* Stock regex parsers of conf/parsers.conf and sample lines */
+struct stock_sample {
+    char *parser;
+    char *line;
+};
+
+static struct stock_sample stock_samples[] = {
+    {"apache",
+     "192.168.2.20 - - [28/Jul/2006:10:27:10 -0300] "
+     "\"GET /cgi-bin/try/ HTTP/1.0\" 200 3395"},
+    {"apache",
+     "10.0.0.1 - frank [10/Oct/2000:13:55:36 -0700] "
+     "\"GET /apache_pb.gif HTTP/1.0\" 200 2326 "
+     "\"http://www.example.com/start.html\" "
+     "\"Mozilla/4.08 [en] (Win98; I ;Nav)\""},
+    {"apache2",
+     "10.0.0.1 - frank [10/Oct/2000:13:55:36 -0700] "
+     "\"GET /apache_pb.gif HTTP/1.0\" 200 2326 "
+     "\"http://www.example.com/start.html\" "
+     "\"Mozilla/4.08 [en] (Win98; I ;Nav)\""},
+    {"apache_error",
+     "[Wed Oct 11 14:32:52 2000] [error] [pid 1234] "
+     "[client 127.0.0.1] client denied by server configuration: "
+     "/export/home/live/ap/htdocs/test"},
+    {"nginx",
+     "172.17.0.1 - - [09/Dec/2022:10:12:02 +0000] "
+     "\"GET /index.html HTTP/1.1\" 200 615 \"-\" "
+     "\"curl/7.79.1\""},
+    {"nginx",
+     "172.17.0.1 - - [09/Dec/2022:10:12:02 +0000] "
+     "\"GET /caf\xc3\xa9 HTTP/1.1\" 404 153 \"-\" \"curl/7.79.1\""},
+    {"k8s-nginx-ingress",
+     "10.244.0.1 - user [09/Dec/2022:10:12:02 +0000] "
+     "\"GET /api HTTP/1.1\" 200 42 \"-\" \"curl/7.79.1\" 83 0.004 "
+     "[default-api-80] [] 10.244.0.7:8080 42 0.004 200 "
+     "0e4f5e4c7d0f5d3a2b1c"},
+    {"docker-daemon",
+     "time=\"2022-12-09T10:12:02.123456789Z\" level=info "
+     "msg=\"Loading containers: done.\""},
+    {"syslog-rfc5424",
+     "<165>1 2022-12-09T10:12:02.003Z mymachine.example.com evntslog "
+     "1234 ID47 [exampleSDID@32473 iut=\"3\"] An application event"},
+    {"syslog-rfc3164-local",
+     "<13>Dec  9 10:12:02 sshd[1234]: Accepted publickey for root"},
+    {"syslog-rfc3164",
+     "<34>Dec  9 10:12:02 mymachine su: 'su root' failed on /dev/pts/8"},
+    {"mongodb",
+     "2022-12-09T10:12:02.123+0000 I NETWORK  [conn12] "
+     "end connection 127.0.0.1:52934 (1 connection now open) 12ms"},
+    {"envoy",
+     "[2022-12-09T10:12:02.123Z] \"GET /status HTTP/1.1\" 200 - 0 58 3 2 "
+     "\"-\" \"curl/7.79.1\" \"4b7c0a3e-1f4d-4b0b-8d6e-6d3e1f0c9a2b\" "
+     "\"example.com\" \"10.0.0.5:8080\""},
+    {"cri",
+     "2022-12-09T10:12:02.123456789+00:00 stdout F "
+     "Listening on port 8080"},
+    {"kube-custom",
+     "kube.var.log.containers.app-7d9f8c-x2x4z_default_app-"
+     "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef.log"},
+};
+
+#define STOCK_SAMPLES (sizeof(stock_samples) / sizeof(struct stock_sample))
+
+static struct flb_config *stock_parsers_load()
+{
+    int ret;
+    struct flb_config *config;
+
+    config = flb_config_init();
+    if (!TEST_CHECK(config != NULL)) {
+        TEST_MSG("flb_config_init failed");
+        return NULL;
+    }
+
+    ret = flb_parser_conf_file(STOCK_PARSERS, config);
+    if (!TEST_CHECK(ret == 0)) {
+        TEST_MSG("cannot load %s", STOCK_PARSERS);
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    return config;
+}
+
+/* Both regex engines must give the same records for the stock parsers */
+void test_regex_engine()
+{
+    int i;
+    int ret;
+    int ret_fast;
+    char *line;
+    void *out_buf;
+    void *out_buf_fast;
+    size_t out_size;
+    size_t out_size_fast;
+    struct flb_time out_time;
+    struct flb_time out_time_fast;
+    struct flb_parser *parser;
+    struct flb_config *config;
+
+    config = stock_parsers_load();
+    if (!config) {
+        return;
+    }
+
+    for (i = 0; i < STOCK_SAMPLES; i++) {
+        parser = flb_parser_get(stock_samples[i].parser, config);
+        if (!TEST_CHECK(parser != NULL)) {
+            TEST_MSG("parser %s not found", stock_samples[i].parser);
+            continue;
+        }
+        line = stock_samples[i].line;
+
+        ret = flb_parser_regex_engine(parser, "onigmo");
+        TEST_CHECK(ret == 0 && parser->regex->fast == NULL);
+
+        out_buf = NULL;
+        out_size = 0;
+        flb_time_zero(&out_time);
+        ret = flb_parser_do(parser, line, strlen(line),
+                            &out_buf, &out_size, &out_time);
+
+        ret_fast = flb_parser_regex_engine(parser, "fast");
+        if (!TEST_CHECK(ret_fast == 0 && parser->regex->fast != NULL)) {
+            TEST_MSG("parser %s not handled by the 'fast' engine",
+                     parser->name);
+        }
+
+        out_buf_fast = NULL;
+        out_size_fast = 0;
+        flb_time_zero(&out_time_fast);
+        ret_fast = flb_parser_do(parser, line, strlen(line),
+                                 &out_buf_fast, &out_size_fast,
+                                 &out_time_fast);
+
+        TEST_CHECK(ret != -1);
+        TEST_CHECK(ret == ret_fast);
+        TEST_CHECK(out_size == out_size_fast);
+        if (out_size == out_size_fast && out_size > 0) {
+            TEST_CHECK(memcmp(out_buf, out_buf_fast, out_size) == 0);
+        }
+        TEST_CHECK(flb_time_equal(&out_time, &out_time_fast));
+        TEST_MSG("parser=%s line='%s'", parser->name, line);
+
+        flb_free(out_buf);
+        flb_free(out_buf_fast);
+    }
+
+    /* unknown engines are rejected */
+    parser = flb_parser_get("apache", config);
+    if (TEST_CHECK(parser != NULL)) {
+        TEST_CHECK(flb_parser_regex_engine(parser, "pcre") == -1);
+    }
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+static double regex_engine_run(struct flb_parser *parser, char *line,
+                               int records)
+{
+    int i;
+    int ret;
+    size_t len;
+    void *out_buf;
+    size_t out_size;
+    struct flb_time t1;
+    struct flb_time t2;
+    struct flb_time out_time;
+
+    len = strlen(line);
+
+    flb_time_get(&t1);
+    for (i = 0; i < records; i++) {
+        flb_time_zero(&out_time);
+        ret = flb_parser_do(parser, line, len, &out_buf, &out_size, &out_time);
+        if (ret == -1) {
+            return -1;
+        }
+        flb_free(out_buf);
+    }
+    flb_time_get(&t2);
+
+    return flb_time_to_double(&t2) - flb_time_to_double(&t1);
+}
+
+/* Stock parsers with Onigmo and with the 'fast' engine */
+void test_regex_engine_bench()
+{
+    int i;
+    int records = 100000;
+    double onigmo;
+    double fast;
+    struct flb_parser *parser;
+    struct flb_config *config;
+
+    config = stock_parsers_load();
+    if (!config) {
+        return;
+    }
+
+    printf("\n");
+    for (i = 0; i < STOCK_SAMPLES; i++) {
+        parser = flb_parser_get(stock_samples[i].parser, config);
+        if (!TEST_CHECK(parser != NULL)) {
+            continue;
+        }
+
+        flb_parser_regex_engine(parser, "onigmo");
+        onigmo = regex_engine_run(parser, stock_samples[i].line, records);
+
+        flb_parser_regex_engine(parser, "fast");
+        fast = regex_engine_run(parser, stock_samples[i].line, records);
+
+        TEST_CHECK(onigmo > 0 && fast > 0);
+        printf("[regex engine] %-22s %i records: onigmo=%.4fs "
+               "fast=%.4fs (%.1fx)\n", parser->name, records, onigmo, fast,
+               onigmo / fast);
+    }
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
 TEST_LIST = {
     { "basic", test_basic},
     { "time_key", test_time_key},
     { "time_keep", test_time_keep},
     { "types", test_types},
     { "decode_field_json", test_decode_field_json},
+    { "regex_engine", test_regex_engine},
+    { "regex_engine_bench", test_regex_engine_bench},
     { 0 }
 };
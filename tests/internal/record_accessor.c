@@ -950,6 +950,49 @@ void cb_key_order_lookup()
     flb_free(out_buf);
 }
 
+void cb_translate_types()
+{
+    int len;
+    int ret;
+    int type;
+    char *out_buf;
+    size_t out_size;
+    char *json;
+
+    /* Sample JSON message */
+    json = "{\"str\": \"abc\", \"int\": -10, \"float\": 1.5, "
+             "\"bool\": false, \"nil\": null, \"arr\": [1, 2], "
+             "\"map\": {\"a\": {\"b\": [\"x\", {\"c\": 7}]}}, "
+             "\"scalar\": \"s\"}";
+
+    /* Convert to msgpack */
+    len = strlen(json);
+    ret = flb_pack_json(json, len, &out_buf, &out_size, &type);
+    TEST_CHECK(ret == 0);
+    if (ret == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    /* check the string representation of every type */
+    order_lookup_check(out_buf, out_size, "$str"  , "abc");
+    order_lookup_check(out_buf, out_size, "$int"  , "-10");
+    order_lookup_check(out_buf, out_size, "$float", "1.500000");
+    order_lookup_check(out_buf, out_size, "$bool" , "false");
+    order_lookup_check(out_buf, out_size, "$nil"  , "null");
+    order_lookup_check(out_buf, out_size, "$arr"  , "");
+    order_lookup_check(out_buf, out_size, "$map['a']['b'][0]", "x");
+    order_lookup_check(out_buf, out_size, "$map['a']['b'][1]['c']", "7");
+    order_lookup_check(out_buf, out_size, "$map['a']['b'][1]",
+                       "{\"c\":7}");
+    order_lookup_check(out_buf, out_size, "$map['a']['x']", "");
+    order_lookup_check(out_buf, out_size, "$map['a']['b'][5]", "");
+
+    /* subkeys over a scalar value resolve to the value itself */
+    order_lookup_check(out_buf, out_size, "$scalar['x']", "s");
+
+    flb_free(out_buf);
+}
+
 void cb_issue_4917()
 {
     int len;
@@ -1646,6 +1689,7 @@ TEST_LIST = {
     { "array_id"        , cb_array_id},
     { "get_kv_pair"     , cb_get_kv_pair},
     { "key_order_lookup", cb_key_order_lookup},
+    { "translate_types" , cb_translate_types},
     { "update_key_val", cb_update_key_val},
     { "update_key", cb_update_key},
     { "update_val", cb_update_val},
@@ -0,0 +1,284 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_engine_macros.h>
+#include <fluent-bit/flb_scheduler.h>
+#include <fluent-bit/flb_time.h>
+
+#include <inttypes.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#endif
+
+#include "flb_tests_internal.h"
+
+#define N_REQUESTS   100000
+
+struct timer_check {
+    int ms;                          /* requested timeout      */
+    int fired;                       /* number of expirations  */
+    int order;                       /* expiration order       */
+    uint64_t fired_ms;               /* elapsed at expiration  */
+    struct flb_sched_timer *timer;
+    struct timer_check *cancel;      /* timer to cancel on expiration */
+};
+
+static int fired_count;
+static uint64_t start_ms;
+
+static uint64_t now_ms()
+{
+    struct flb_time tm;
+
+    flb_time_get(&tm);
+    return flb_time_to_millisec(&tm);
+}
+
+static void cb_timer(struct flb_config *config, void *data)
+{
+    struct timer_check *tc = data;
+
+    tc->fired++;
+    tc->order = fired_count++;
+    tc->fired_ms = now_ms() - start_ms;
+
+    if (tc->cancel) {
+        flb_sched_timer_cb_destroy(tc->cancel->timer);
+        tc->cancel->timer = NULL;
+    }
+}
+
+/* Run the event loop during 'ms' milliseconds */
+static void run_loop(struct flb_config *config, int ms)
+{
+    uint64_t end;
+    struct mk_event *event;
+
+    end = now_ms() + ms;
+    while (now_ms() < end) {
+        mk_event_wait_2(config->evl, 10);
+        mk_event_foreach(event, config->evl) {
+            if (event->type & FLB_ENGINE_EV_SCHED) {
+                flb_sched_event_handler(config, event);
+            }
+        }
+        flb_sched_timer_cleanup(config->sched);
+    }
+}
+
+static struct flb_config *sched_config_create()
+{
+    struct flb_config *config;
+
+    config = flb_config_init();
+    if (!config) {
+        return NULL;
+    }
+
+    config->evl = mk_event_loop_create(256);
+    if (!config->evl) {
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    config->sched = flb_sched_create(config, config->evl);
+    if (!config->sched) {
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    return config;
+}
+
+#ifdef __linux__
+static int count_fds()
+{
+    int n = 0;
+    DIR *dir;
+
+    dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return -1;
+    }
+    while (readdir(dir) != NULL) {
+        n++;
+    }
+    closedir(dir);
+
+    return n;
+}
+#endif
+
+/* One-shot timers expire in order, after their timeout, on any level */
+void test_timer_oneshot_order()
+{
+    int i;
+    int ret;
+    int n;
+    int ms[] = {0, 3, 1, 70, 15, 200, 65, 130, 64, 5, 300, 5};
+    struct timer_check *tc;
+    struct flb_sched *sched;
+    struct flb_config *config;
+
+    config = sched_config_create();
+    TEST_CHECK(config != NULL);
+    sched = config->sched;
+
+    n = sizeof(ms) / sizeof(int);
+    tc = flb_calloc(n, sizeof(struct timer_check));
+    TEST_CHECK(tc != NULL);
+
+    fired_count = 0;
+    start_ms = now_ms();
+    for (i = 0; i < n; i++) {
+        tc[i].ms = ms[i];
+        ret = flb_sched_timer_cb_create(config->sched,
+                                        FLB_SCHED_TIMER_CB_ONESHOT,
+                                        ms[i], cb_timer, &tc[i],
+                                        &tc[i].timer);
+        TEST_CHECK(ret == 0);
+    }
+
+    run_loop(config, 400);
+
+    TEST_CHECK(fired_count == n);
+    for (i = 0; i < n; i++) {
+        TEST_CHECK(tc[i].fired == 1);
+        if (!TEST_CHECK(tc[i].fired_ms + 1 >= tc[i].ms)) {
+            TEST_MSG("timer %i ms expired after %" PRIu64 " ms",
+                     tc[i].ms, tc[i].fired_ms);
+        }
+    }
+
+    /* the expiration order follows the timeouts */
+    for (i = 0; i < n; i++) {
+        for (ret = 0; ret < n; ret++) {
+            if (tc[i].ms + 5 <= tc[ret].ms) {
+                TEST_CHECK(tc[i].order < tc[ret].order);
+            }
+        }
+    }
+
+    /* one-shot timers are released after their expiration */
+    TEST_CHECK(mk_list_size(&sched->timers) == 1);
+
+    flb_free(tc);
+    flb_config_exit(config);
+}
+
+/* Permanent timers keep expiring, a timer cancelled by another one does not */
+void test_timer_perm_and_cancel()
+{
+    int ret;
+    struct timer_check perm = {0};
+    struct timer_check canceller = {0};
+    struct timer_check cancelled = {0};
+    struct flb_config *config;
+
+    config = sched_config_create();
+    TEST_CHECK(config != NULL);
+
+    fired_count = 0;
+    start_ms = now_ms();
+
+    ret = flb_sched_timer_cb_create(config->sched, FLB_SCHED_TIMER_CB_PERM,
+                                    20, cb_timer, &perm, &perm.timer);
+    TEST_CHECK(ret == 0);
+
+    canceller.cancel = &cancelled;
+    ret = flb_sched_timer_cb_create(config->sched, FLB_SCHED_TIMER_CB_ONESHOT,
+                                    30, cb_timer, &canceller,
+                                    &canceller.timer);
+    TEST_CHECK(ret == 0);
+    ret = flb_sched_timer_cb_create(config->sched, FLB_SCHED_TIMER_CB_ONESHOT,
+                                    90, cb_timer, &cancelled,
+                                    &cancelled.timer);
+    TEST_CHECK(ret == 0);
+
+    run_loop(config, 210);
+
+    if (!TEST_CHECK(perm.fired >= 6 && perm.fired <= 12)) {
+        TEST_MSG("permanent timer expired %i times", perm.fired);
+    }
+    TEST_CHECK(canceller.fired == 1);
+    TEST_CHECK(cancelled.fired == 0);
+    TEST_CHECK(cancelled.timer == NULL);
+
+    /* disable it, it must not expire again */
+    flb_sched_timer_cb_disable(perm.timer);
+    ret = perm.fired;
+    run_loop(config, 50);
+    TEST_CHECK(perm.fired == ret);
+
+    flb_config_exit(config);
+}
+
+/*
+ * Queue a large number of retry requests: they share the scheduler timer,
+ * no file descriptor is created per request.
+ */
+void test_requests_stress()
+{
+    int i;
+    int ret;
+    int fds = 0;
+    uint64_t t;
+    struct flb_sched *sched;
+    struct flb_config *config;
+
+    config = sched_config_create();
+    TEST_CHECK(config != NULL);
+    sched = config->sched;
+
+#ifdef __linux__
+    fds = count_fds();
+#endif
+
+    t = now_ms();
+    for (i = 0; i < N_REQUESTS; i++) {
+        /* the data is never dereferenced, the requests do not expire */
+        ret = flb_sched_request_create(config, (void *) (uintptr_t) (i + 1),
+                                       i % 10);
+        if (!TEST_CHECK(ret >= 1 && ret <= FLB_SCHED_CAP + 1)) {
+            TEST_MSG("request %i: invalid wait time %i", i, ret);
+            break;
+        }
+    }
+    TEST_MSG("%i requests created in %" PRIu64 " ms", N_REQUESTS, now_ms() - t);
+
+    TEST_CHECK(mk_list_size(&sched->requests) == N_REQUESTS);
+
+#ifdef __linux__
+    TEST_CHECK(count_fds() == fds);
+#endif
+
+    /* invalidate a few of them */
+    for (i = 0; i < 100; i++) {
+        ret = flb_sched_request_invalidate(config,
+                                           (void *) (uintptr_t) (i * 997 + 1));
+        TEST_CHECK(ret == 0);
+    }
+    TEST_CHECK(mk_list_size(&sched->requests) == N_REQUESTS - 100);
+    TEST_CHECK(flb_sched_timer_cleanup(sched) == 100);
+
+    /* nothing is due yet, the loop must not run any request */
+    run_loop(config, 20);
+    TEST_CHECK(mk_list_size(&sched->requests) == N_REQUESTS - 100);
+
+    /* the frame timer is released too */
+    ret = flb_sched_destroy(sched);
+    TEST_CHECK(ret == (N_REQUESTS - 100) * 2);
+    config->sched = NULL;
+
+    flb_config_exit(config);
+}
+
+TEST_LIST = {
+    {"timer_oneshot_order", test_timer_oneshot_order},
+    {"timer_perm_and_cancel", test_timer_perm_and_cancel},
+    {"requests_stress", test_requests_stress},
+    { 0 }
+};
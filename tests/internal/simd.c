@@ -0,0 +1,223 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_simd.h>
+
+#include <stdlib.h>
+
+#include "flb_tests_internal.h"
+
+/* Naive reference for flb_simd_find_all() */
+static size_t find_all_ref(const char *p, size_t len, char c,
+                           size_t *pos, size_t max)
+{
+    size_t i;
+    size_t n = 0;
+
+    for (i = 0; i < len && n < max; i++) {
+        if (p[i] == c) {
+            pos[n++] = i;
+        }
+    }
+    return n;
+}
+
+static void check_find_all(const char *buf, size_t len, size_t max)
+{
+    size_t i;
+    size_t n;
+    size_t n_ref;
+    size_t off = 0;
+    size_t *pos;
+    size_t *pos_ref;
+
+    pos = flb_calloc(max, sizeof(size_t));
+    pos_ref = flb_calloc(max, sizeof(size_t));
+    TEST_CHECK(pos != NULL && pos_ref != NULL);
+
+    /* consume the whole buffer in batches of 'max' offsets */
+    while (off <= len) {
+        n = flb_simd_find_all(buf + off, len - off, '\n', pos, max);
+        n_ref = find_all_ref(buf + off, len - off, '\n', pos_ref, max);
+        if (!TEST_CHECK(n == n_ref)) {
+            TEST_MSG("len=%zu max=%zu off=%zu: got %zu offsets, expected %zu",
+                     len, max, off, n, n_ref);
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (!TEST_CHECK(pos[i] == pos_ref[i])) {
+                TEST_MSG("len=%zu max=%zu off=%zu: offset #%zu is %zu, "
+                         "expected %zu", len, max, off, i, pos[i], pos_ref[i]);
+                break;
+            }
+        }
+        if (n < max) {
+            break;
+        }
+        off += pos[n - 1] + 1;
+    }
+
+    flb_free(pos);
+    flb_free(pos_ref);
+}
+
+void test_find_all()
+{
+    int r;
+    size_t i;
+    size_t len;
+    size_t max;
+    char *buf;
+
+    buf = flb_malloc(4096);
+    TEST_CHECK(buf != NULL);
+
+    /* empty and new line only buffers */
+    check_find_all("", 0, 4);
+    check_find_all("\n", 1, 4);
+    check_find_all("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n", 18, 4);
+    check_find_all("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n", 18, 32);
+
+    /* random buffers with sparse and dense new lines */
+    srand(1);
+    for (r = 0; r < 2000; r++) {
+        len = rand() % 4096;
+        for (i = 0; i < len; i++) {
+            if (rand() % ((r % 2) ? 3 : 80) == 0) {
+                buf[i] = '\n';
+            }
+            else {
+                buf[i] = 'a' + (rand() % 26);
+            }
+        }
+        max = 1 + (rand() % 64);
+        check_find_all(buf, len, max);
+    }
+
+    flb_free(buf);
+}
+
+void test_find_any2()
+{
+    int r;
+    size_t i;
+    size_t j;
+    size_t len;
+    char buf[256];
+    const char *p;
+    const char *ref;
+
+    srand(4);
+    for (r = 0; r < 5000; r++) {
+        len = rand() % sizeof(buf);
+        for (i = 0; i < len; i++) {
+            buf[i] = 'a' + (rand() % 26);
+        }
+        if (len > 0 && rand() % 4 != 0) {
+            j = rand() % len;
+            buf[j] = "\"\\"[rand() % 2];
+        }
+
+        ref = NULL;
+        for (i = 0; i < len; i++) {
+            if (buf[i] == '"' || buf[i] == '\\') {
+                ref = buf + i;
+                break;
+            }
+        }
+
+        p = flb_simd_find_any2(buf, len, '"', '\\');
+        if (!TEST_CHECK(p == ref)) {
+            TEST_MSG("len=%zu: got offset %ld, expected %ld", len,
+                     p ? (long) (p - buf) : -1L,
+                     ref ? (long) (ref - buf) : -1L);
+        }
+    }
+}
+
+void test_find_any3()
+{
+    int r;
+    size_t i;
+    size_t j;
+    size_t len;
+    char buf[256];
+    const char *p;
+    const char *ref;
+
+    srand(2);
+    for (r = 0; r < 5000; r++) {
+        len = rand() % sizeof(buf);
+        for (i = 0; i < len; i++) {
+            buf[i] = 'a' + (rand() % 26);
+        }
+        if (len > 0 && rand() % 4 != 0) {
+            j = rand() % len;
+            buf[j] = "\"\\x"[rand() % 3];
+        }
+
+        ref = NULL;
+        for (i = 0; i < len; i++) {
+            if (buf[i] == '"' || buf[i] == '\\' || buf[i] == 'x') {
+                ref = buf + i;
+                break;
+            }
+        }
+
+        p = flb_simd_find_any3(buf, len, '"', '\\', 'x');
+        if (!TEST_CHECK(p == ref)) {
+            TEST_MSG("len=%zu: got offset %ld, expected %ld", len,
+                     p ? (long) (p - buf) : -1L,
+                     ref ? (long) (ref - buf) : -1L);
+        }
+    }
+}
+
+void test_find_delim()
+{
+    int r;
+    size_t i;
+    size_t j;
+    size_t len;
+    char buf[256];
+    const char *p;
+    const char *ref;
+
+    srand(3);
+    for (r = 0; r < 5000; r++) {
+        len = rand() % sizeof(buf);
+        for (i = 0; i < len; i++) {
+            /* bytes around the limit and with the high bit set */
+            buf[i] = "abz!~\x7f\x80\xc3\xff"[rand() % 9];
+        }
+        if (len > 0 && rand() % 4 != 0) {
+            j = rand() % len;
+            buf[j] = " \t\0=\""[rand() % 5];
+        }
+
+        ref = NULL;
+        for (i = 0; i < len; i++) {
+            if ((unsigned char) buf[i] <= ' ' || buf[i] == '=' ||
+                buf[i] == '"') {
+                ref = buf + i;
+                break;
+            }
+        }
+
+        p = flb_simd_find_delim(buf, len, ' ', '=', '"');
+        if (!TEST_CHECK(p == ref)) {
+            TEST_MSG("len=%zu: got offset %ld, expected %ld", len,
+                     p ? (long) (p - buf) : -1L,
+                     ref ? (long) (ref - buf) : -1L);
+        }
+    }
+}
+
+TEST_LIST = {
+    {"find_all", test_find_all},
+    {"find_any2", test_find_any2},
+    {"find_any3", test_find_any3},
+    {"find_delim", test_find_delim},
+    { 0 }
+};
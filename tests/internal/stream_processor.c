@@ -35,6 +35,7 @@
 #include "include/sp_window.h"
 #include "include/sp_snapshot.h"
 
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #ifdef _WIN32
@@ -744,11 +745,236 @@ static void test_snapshot()
 #endif
 }
 
+#define BENCH_GROUPS   5000
+#define BENCH_RECORDS  20000   /* records ingested every second */
+#define BENCH_SECONDS  20
+
+/*
+ * Pack the records of the second 't' of the GROUP BY benchmark. Every second
+ * feeds a different subset of the groups with a different distribution, the
+ * expected COUNT(*) and SUM() of each group are stored in 'counts' and
+ * 'sums'.
+ */
+static void groupby_bench_records(int t, struct sp_buffer *out_buf,
+                                  int64_t *counts, int64_t *sums)
+{
+    int i;
+    int len;
+    int group;
+    int64_t val;
+    char host[32];
+    struct flb_time tm;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    flb_time_set(&tm, 1000 + t, 0);
+    for (i = 0; i < BENCH_RECORDS; i++) {
+        group = (i * 7 + t * 131) % (BENCH_GROUPS - t * 50);
+        val = (i % 13) + t;
+        counts[group]++;
+        sums[group] += val;
+
+        len = snprintf(host, sizeof(host), "host-%i", group);
+
+        msgpack_pack_array(&mp_pck, 2);
+        flb_time_append_to_msgpack(&tm, &mp_pck, 0);
+        msgpack_pack_map(&mp_pck, 2);
+        msgpack_pack_str(&mp_pck, 4);
+        msgpack_pack_str_body(&mp_pck, "host", 4);
+        msgpack_pack_str(&mp_pck, len);
+        msgpack_pack_str_body(&mp_pck, host, len);
+        msgpack_pack_str(&mp_pck, 3);
+        msgpack_pack_str_body(&mp_pck, "val", 3);
+        msgpack_pack_int64(&mp_pck, val);
+    }
+
+    out_buf->buffer = mp_sbuf.data;
+    out_buf->size = mp_sbuf.size;
+}
+
+/*
+ * Compare the results of a window covering the seconds [from, to] with the
+ * expected values of every group.
+ */
+static void groupby_bench_check(struct sp_buffer *out_buf,
+                                int64_t *counts, int64_t *sums,
+                                int from, int to)
+{
+    int t;
+    int group;
+    int groups = 0;
+    int expected = 0;
+    size_t off = 0;
+    int64_t count;
+    int64_t sum;
+    msgpack_object map;
+    msgpack_unpacked result;
+
+    for (group = 0; group < BENCH_GROUPS; group++) {
+        for (t = from; t <= to; t++) {
+            if (counts[t * BENCH_GROUPS + group] > 0) {
+                expected++;
+                break;
+            }
+        }
+    }
+
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, out_buf->buffer, out_buf->size,
+                               &off) == MP_UOK) {
+        map = result.data.via.array.ptr[1];
+        group = atoi(map.via.map.ptr[0].val.via.str.ptr + 5);
+
+        count = 0;
+        sum = 0;
+        for (t = from; t <= to; t++) {
+            count += counts[t * BENCH_GROUPS + group];
+            sum += sums[t * BENCH_GROUPS + group];
+        }
+
+        if (!TEST_CHECK(map.via.map.ptr[1].val.via.i64 == count &&
+                        map.via.map.ptr[2].val.via.i64 == sum)) {
+            TEST_MSG("seconds %i-%i, host-%i: COUNT=%" PRId64 " SUM=%" PRId64
+                     ", expected %" PRId64 " and %" PRId64, from, to, group,
+                     map.via.map.ptr[1].val.via.i64,
+                     map.via.map.ptr[2].val.via.i64, count, sum);
+            break;
+        }
+        groups++;
+    }
+    msgpack_unpacked_destroy(&result);
+
+    TEST_CHECK(groups == expected);
+    TEST_MSG("seconds %i-%i: %i groups, expected %i", from, to, groups,
+             expected);
+}
+
+/*
+ * Ingest BENCH_SECONDS seconds of records through a GROUP BY window query,
+ * firing the hop and window events the engine timers would fire. Returns
+ * the time spent in the stream processor.
+ */
+static double groupby_bench_run(struct flb_sp *sp, const char *name,
+                                const char *query, int size, int hop,
+                                struct sp_buffer *data_buf,
+                                int64_t *counts, int64_t *sums)
+{
+    int t;
+    double elapsed = 0;
+    struct sp_buffer out_buf;
+    struct flb_time t1;
+    struct flb_time t2;
+    struct flb_sp_task *task;
+
+    task = flb_sp_task_create(sp, name, query);
+    if (!TEST_CHECK(task != NULL)) {
+        return 0;
+    }
+
+    for (t = 0; t < BENCH_SECONDS; t++) {
+        out_buf.buffer = NULL;
+        out_buf.size = 0;
+
+        flb_time_get(&t1);
+        sp_process_data_aggr(data_buf[t].buffer, data_buf[t].size,
+                             "samples", strlen("samples"), task, sp);
+        if (hop > 0) {
+            sp_process_hopping_slot("samples", strlen("samples"), task);
+        }
+
+        /* Window event */
+        if ((hop == 0 && (t + 1) % size == 0) ||
+            (hop > 0 && t + 1 >= size && (t + 1 - size) % hop == 0)) {
+            package_results("samples", strlen("samples"),
+                            &out_buf.buffer, &out_buf.size, task);
+            flb_sp_window_prune(task);
+        }
+        flb_time_get(&t2);
+        elapsed += flb_time_to_double(&t2) - flb_time_to_double(&t1);
+
+        if (out_buf.buffer) {
+            groupby_bench_check(&out_buf, counts, sums, t - size + 1, t);
+            flb_free(out_buf.buffer);
+        }
+    }
+
+    flb_sp_task_destroy(task);
+    return elapsed;
+}
+
+static void test_groupby_bench()
+{
+    int t;
+    double elapsed;
+    int64_t *counts;
+    int64_t *sums;
+    struct sp_buffer data_buf[BENCH_SECONDS];
+    struct flb_config *config;
+    struct flb_sp *sp;
+
+    config = flb_calloc(1, sizeof(struct flb_config));
+    if (!config) {
+        flb_errno();
+        return;
+    }
+    mk_list_init(&config->inputs);
+    mk_list_init(&config->stream_processor_tasks);
+    config->evl = mk_event_loop_create(256);
+
+    sp = flb_sp_create(config);
+    if (!TEST_CHECK(sp != NULL)) {
+        mk_event_loop_destroy(config->evl);
+        flb_free(config);
+        return;
+    }
+
+    counts = flb_calloc(BENCH_SECONDS * BENCH_GROUPS, sizeof(int64_t));
+    sums = flb_calloc(BENCH_SECONDS * BENCH_GROUPS, sizeof(int64_t));
+    TEST_CHECK(counts != NULL && sums != NULL);
+
+    for (t = 0; t < BENCH_SECONDS; t++) {
+        groupby_bench_records(t, &data_buf[t], counts + t * BENCH_GROUPS,
+                              sums + t * BENCH_GROUPS);
+    }
+
+    elapsed = groupby_bench_run(sp, "groupby_tumbling",
+                                "SELECT host, COUNT(*) AS n, SUM(val) AS total "
+                                "FROM STREAM:FLB WINDOW TUMBLING (5 SECOND) "
+                                "GROUP BY host;",
+                                5, 0, data_buf, counts, sums);
+    printf("\n[sp] tumbling window: %i groups, %i records in %.4fs "
+           "(%.0f records/s)\n", BENCH_GROUPS, BENCH_SECONDS * BENCH_RECORDS,
+           elapsed, BENCH_SECONDS * BENCH_RECORDS / elapsed);
+
+    elapsed = groupby_bench_run(sp, "groupby_hopping",
+                                "SELECT host, COUNT(*) AS n, SUM(val) AS total "
+                                "FROM STREAM:FLB WINDOW HOPPING (10 SECOND, "
+                                "ADVANCE BY 1 SECOND) GROUP BY host;",
+                                10, 1, data_buf, counts, sums);
+    printf("[sp] hopping window: %i groups, %i records in %.4fs "
+           "(%.0f records/s)\n", BENCH_GROUPS, BENCH_SECONDS * BENCH_RECORDS,
+           elapsed, BENCH_SECONDS * BENCH_RECORDS / elapsed);
+
+    for (t = 0; t < BENCH_SECONDS; t++) {
+        flb_free(data_buf[t].buffer);
+    }
+    flb_free(counts);
+    flb_free(sums);
+
+    flb_sp_destroy(sp);
+    mk_event_loop_destroy(config->evl);
+    flb_free(config);
+}
+
 TEST_LIST = {
     { "invalid_queries", invalid_queries},
     { "select_keys",     test_select_keys},
     { "select_subkeys",  test_select_subkeys},
     { "window",          test_window},
     { "snapshot",        test_snapshot},
+    { "groupby_bench",   test_groupby_bench},
     { NULL }
 };
@@ -0,0 +1,189 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_zstd.h>
+#include <fluent-bit/flb_compression.h>
+
+#include "flb_tests_internal.h"
+
+/* Sample data */
+char *morpheus = "This is your last chance. After this, there is no "
+    "turning back. You take the blue pill - the story ends, you wake up in "
+    "your bed and believe whatever you want to believe. You take the red pill,"
+    "you stay in Wonderland and I show you how deep the rabbit-hole goes.";
+
+void test_compress()
+{
+    int ret;
+    int sample_len;
+    char *in_data = morpheus;
+    size_t in_len;
+    void *str;
+    size_t len;
+
+    sample_len = strlen(morpheus);
+    in_len = sample_len;
+    ret = flb_zstd_compress(in_data, in_len, &str, &len);
+    TEST_CHECK(ret == 0);
+
+    in_data = str;
+    in_len = len;
+
+    ret = flb_zstd_uncompress(in_data, in_len, &str, &len);
+    TEST_CHECK(ret == 0);
+
+    TEST_CHECK(sample_len == len);
+    ret = memcmp(morpheus, str, sample_len);
+    TEST_CHECK(ret == 0);
+
+    flb_free(in_data);
+    flb_free(str);
+}
+
+/* Concatenated frames are decoded as a single payload */
+void test_concatenated_frames()
+{
+    int i;
+    int ret;
+    char *buf;
+    char *in_data;
+    size_t in_len;
+    size_t sample_len;
+    size_t total = 0;
+    void *str;
+    size_t len;
+
+    sample_len = strlen(morpheus);
+    buf = flb_malloc(sample_len * 64);
+    TEST_CHECK(buf != NULL);
+
+    in_data = NULL;
+    in_len = 0;
+    for (i = 0; i < 4; i++) {
+        ret = flb_zstd_compress(morpheus, sample_len, &str, &len);
+        TEST_CHECK(ret == 0);
+
+        in_data = flb_realloc(in_data, in_len + len);
+        TEST_CHECK(in_data != NULL);
+        memcpy(in_data + in_len, str, len);
+        in_len += len;
+        flb_free(str);
+
+        memcpy(buf + total, morpheus, sample_len);
+        total += sample_len;
+    }
+
+    ret = flb_zstd_uncompress(in_data, in_len, &str, &len);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(len == total);
+    TEST_CHECK(memcmp(buf, str, total) == 0);
+    flb_free(str);
+
+    /* a truncated payload must fail */
+    ret = flb_zstd_uncompress(in_data, in_len - 3, &str, &len);
+    TEST_CHECK(ret == -1);
+
+    /* invalid data */
+    ret = flb_zstd_uncompress(morpheus, sample_len, &str, &len);
+    TEST_CHECK(ret == -1);
+
+    flb_free(in_data);
+    flb_free(buf);
+}
+
+void test_dictionary()
+{
+    int ret;
+    char *msg = "{\"log\": \"you take the red pill\", \"stream\": \"stdout\"}";
+    void *plain;
+    size_t plain_len;
+    void *out;
+    size_t out_len;
+    void *str;
+    size_t len;
+    struct flb_zstd_dict *dict;
+
+    dict = flb_zstd_dict_create(morpheus, strlen(morpheus), 0);
+    TEST_CHECK(dict != NULL);
+    TEST_CHECK(dict->level == FLB_ZSTD_DEFAULT_LEVEL);
+
+    ret = flb_zstd_compress(msg, strlen(msg), &plain, &plain_len);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_zstd_compress_dict(dict, msg, strlen(msg), &out, &out_len);
+    TEST_CHECK(ret == 0);
+
+    /* the dictionary content is referenced instead of being repeated */
+    TEST_CHECK(out_len < plain_len);
+
+    ret = flb_zstd_uncompress_dict(dict, out, out_len, &str, &len);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(len == strlen(msg));
+    TEST_CHECK(memcmp(msg, str, len) == 0);
+    flb_free(str);
+
+    /* the dictionary can also decode frames compressed without it */
+    ret = flb_zstd_uncompress_dict(dict, plain, plain_len, &str, &len);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(len == strlen(msg));
+    flb_free(str);
+
+    flb_free(plain);
+    flb_free(out);
+    flb_zstd_dict_destroy(dict);
+
+    /* missing dictionary file */
+    dict = flb_zstd_dict_load("/nonexistent/zstd.dict", 0);
+    TEST_CHECK(dict == NULL);
+}
+
+void test_compression_interface()
+{
+    int i;
+    int ret;
+    int algorithm;
+    char *names[] = {"gzip", "zstd"};
+    void *out;
+    size_t out_len;
+    void *str;
+    size_t len;
+
+    TEST_CHECK(flb_compression_get_algorithm("none") ==
+               FLB_COMPRESSION_ALGORITHM_NONE);
+    TEST_CHECK(flb_compression_get_algorithm("ZSTD") ==
+               FLB_COMPRESSION_ALGORITHM_ZSTD);
+    TEST_CHECK(flb_compression_get_algorithm_len("gzip, deflate", 4) ==
+               FLB_COMPRESSION_ALGORITHM_GZIP);
+    TEST_CHECK(flb_compression_get_algorithm("br") == -1);
+
+    for (i = 0; i < 2; i++) {
+        algorithm = flb_compression_get_algorithm(names[i]);
+        TEST_CHECK(algorithm > 0);
+        TEST_CHECK(strcmp(flb_compression_get_name(algorithm), names[i]) == 0);
+
+        ret = flb_compression_compress(algorithm, morpheus, strlen(morpheus),
+                                       &out, &out_len);
+        TEST_CHECK(ret == 0);
+
+        ret = flb_compression_uncompress(algorithm, out, out_len, &str, &len);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(len == strlen(morpheus));
+        TEST_CHECK(memcmp(morpheus, str, len) == 0);
+
+        flb_free(out);
+        flb_free(str);
+    }
+
+    ret = flb_compression_compress(FLB_COMPRESSION_ALGORITHM_NONE,
+                                   morpheus, strlen(morpheus), &out, &out_len);
+    TEST_CHECK(ret == -1);
+}
+
+TEST_LIST = {
+    {"compress", test_compress},
+    {"concatenated_frames", test_concatenated_frames},
+    {"dictionary", test_dictionary},
+    {"compression_interface", test_compression_interface},
+    { 0 }
+};
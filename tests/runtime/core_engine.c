@@ -19,6 +19,7 @@
  */
 
 #include <fluent-bit.h>
+#include <fluent-bit/flb_time.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -29,10 +30,12 @@
 
 /* Test functions*/
 void flb_test_engine_wildcard(void);
+void flb_test_engine_filter_workers(void);
 
 /* Test list */
 TEST_LIST = {
     {"wildcard",    flb_test_engine_wildcard },
+    {"filter_workers", flb_test_engine_filter_workers },
     {NULL, NULL}
 };
 
@@ -165,3 +168,114 @@ void flb_test_engine_wildcard(void)
         i++;
     }
 }
+
+/* Filter workers: records must be filtered and keep their order per Tag */
+#define FILTER_WORKERS_RECORDS 500
+
+struct filter_workers_result {
+    pthread_mutex_t lock;
+    int records;
+    int filtered;
+    int last_id[2];
+    int unordered;
+};
+
+static int callback_filter_workers(void *data, size_t size, void *cb_data)
+{
+    int id;
+    int idx;
+    char *p;
+    struct filter_workers_result *res = cb_data;
+
+    /* the lib output delivers one JSON record per call */
+    pthread_mutex_lock(&res->lock);
+    res->records++;
+    if (strstr(data, "\"filtered\":\"yes\"")) {
+        res->filtered++;
+    }
+
+    idx = strstr(data, "\"src\":\"b\"") ? 1 : 0;
+    p = strstr(data, "\"id\":");
+    if (p) {
+        id = atoi(p + 5);
+        if (id <= res->last_id[idx]) {
+            res->unordered++;
+        }
+        res->last_id[idx] = id;
+    }
+    pthread_mutex_unlock(&res->lock);
+
+    flb_lib_free(data);
+    return 0;
+}
+
+void flb_test_engine_filter_workers(void)
+{
+    int i;
+    int ret;
+    int in_a;
+    int in_b;
+    int out_ffd;
+    int filter_ffd;
+    char buf[128];
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+    struct filter_workers_result res;
+
+    memset(&res, 0, sizeof(res));
+    pthread_mutex_init(&res.lock, NULL);
+    res.last_id[0] = -1;
+    res.last_id[1] = -1;
+
+    cb.cb   = callback_filter_workers;
+    cb.data = &res;
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "0.5", "Grace", "1",
+                    "filter.workers", "2", NULL);
+
+    in_a = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_a >= 0);
+    flb_input_set(ctx, in_a, "tag", "test.a", NULL);
+
+    in_b = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_b >= 0);
+    flb_input_set(ctx, in_b, "tag", "test.b", NULL);
+
+    filter_ffd = flb_filter(ctx, (char *) "record_modifier", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd,
+                         "match", "test.*",
+                         "record", "filtered yes",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "test.*", "format", "json", NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < FILTER_WORKERS_RECORDS; i++) {
+        snprintf(buf, sizeof(buf) - 1, "[%d, {\"src\":\"a\",\"id\":%d}]", i, i);
+        flb_lib_push(ctx, in_a, buf, strlen(buf));
+
+        snprintf(buf, sizeof(buf) - 1, "[%d, {\"src\":\"b\",\"id\":%d}]", i, i);
+        flb_lib_push(ctx, in_b, buf, strlen(buf));
+    }
+
+    flb_time_msleep(2000);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+
+    pthread_mutex_lock(&res.lock);
+    if (!TEST_CHECK(res.records == FILTER_WORKERS_RECORDS * 2)) {
+        TEST_MSG("expected %d records, got %d",
+                 FILTER_WORKERS_RECORDS * 2, res.records);
+    }
+    TEST_CHECK(res.filtered == res.records);
+    TEST_CHECK(res.unordered == 0);
+    pthread_mutex_unlock(&res.lock);
+}
@@ -4,6 +4,9 @@
 #include <fluent-bit/flb_time.h>
 #include "flb_tests_runtime.h"
 
+/* Include the plugin header to test the literal extraction directly */
+#include "../../plugins/filter_grep/grep_prefilter.h"
+
 /* Test data */
 
 /* Test functions */
@@ -375,6 +378,193 @@ void flb_test_issue_5209(void)
     flb_destroy(ctx);
 }
 
+/*
+ * Several rules on the same key: the value is looked up once and the rules
+ * with a required literal are only evaluated if the literal is present.
+ */
+void flb_test_filter_grep_same_key(void)
+{
+    int i;
+    int ret;
+    int bytes;
+    char p[512];
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int out_ffd;
+    int filter_ffd;
+    int got;
+    int n_loop = 256;
+    int not_used = 0;
+    struct flb_lib_out_cb cb_data;
+
+    /* Prepare output callback with expected result */
+    cb_data.cb = cb_count_msgpack;
+    cb_data.data = &not_used;
+
+    ctx = flb_create();
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "test", NULL);
+
+    filter_ffd = flb_filter(ctx, (char *) "grep", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd, "match", "*", NULL);
+    TEST_CHECK(ret == 0);
+    ret = flb_filter_set(ctx, filter_ffd, "Exclude", "log deprecated", NULL);
+    TEST_CHECK(ret == 0);
+    ret = flb_filter_set(ctx, filter_ffd, "Exclude", "log ^Using (old|legacy) API call", NULL);
+    TEST_CHECK(ret == 0);
+    ret = flb_filter_set(ctx, filter_ffd, "Exclude", "log colou?r", NULL);
+    TEST_CHECK(ret == 0);
+    ret = flb_filter_set(ctx, filter_ffd, "Exclude", "log v1\\.2", NULL);
+    TEST_CHECK(ret == 0);
+    ret = flb_filter_set(ctx, filter_ffd, "Exclude", "log cafés?", NULL);
+    TEST_CHECK(ret == 0);
+
+    clear_output_num();
+
+    ret = flb_start(ctx);
+    if(!TEST_CHECK(ret == 0)) {
+        TEST_MSG("flb_start failed");
+        exit(EXIT_FAILURE);
+    }
+
+    /*
+     * Ingest 8 records per loop, 3 of them are kept: the one without 'log',
+     * 'Using option' and 'v1x2'. A prefilter literal that is not really
+     * required by its rule would keep 'color', 'v1.2' or 'café' too.
+     */
+    for (i = 0; i < n_loop; i++) {
+        memset(p, '\0', sizeof(p));
+        snprintf(p, sizeof(p), "[%d, {\"val\": \"%d\",\"END_KEY\": \"JSON_END\"}]", i, (i * i));
+        bytes = flb_lib_push(ctx, in_ffd, p, strlen(p));
+        TEST_CHECK(bytes == strlen(p));
+
+        memset(p, '\0', sizeof(p));
+        snprintf(p, sizeof(p), "[%d, {\"val\": \"%d\",\"log\": \"Using deprecated option\"}]", i, (i * i));
+        bytes = flb_lib_push(ctx, in_ffd, p, strlen(p));
+        TEST_CHECK(bytes == strlen(p));
+
+        memset(p, '\0', sizeof(p));
+        snprintf(p, sizeof(p), "[%d, {\"val\": \"%d\",\"log\": \"Using legacy API call\"}]", i, (i * i));
+        bytes = flb_lib_push(ctx, in_ffd, p, strlen(p));
+        TEST_CHECK(bytes == strlen(p));
+
+        memset(p, '\0', sizeof(p));
+        snprintf(p, sizeof(p), "[%d, {\"val\": \"%d\",\"log\": \"Using option\"}]", i, (i * i));
+        bytes = flb_lib_push(ctx, in_ffd, p, strlen(p));
+        TEST_CHECK(bytes == strlen(p));
+
+        memset(p, '\0', sizeof(p));
+        snprintf(p, sizeof(p), "[%d, {\"val\": \"%d\",\"log\": \"Using color option\"}]", i, (i * i));
+        bytes = flb_lib_push(ctx, in_ffd, p, strlen(p));
+        TEST_CHECK(bytes == strlen(p));
+
+        memset(p, '\0', sizeof(p));
+        snprintf(p, sizeof(p), "[%d, {\"val\": \"%d\",\"log\": \"Using v1.2 option\"}]", i, (i * i));
+        bytes = flb_lib_push(ctx, in_ffd, p, strlen(p));
+        TEST_CHECK(bytes == strlen(p));
+
+        memset(p, '\0', sizeof(p));
+        snprintf(p, sizeof(p), "[%d, {\"val\": \"%d\",\"log\": \"Using v1x2 option\"}]", i, (i * i));
+        bytes = flb_lib_push(ctx, in_ffd, p, strlen(p));
+        TEST_CHECK(bytes == strlen(p));
+
+        memset(p, '\0', sizeof(p));
+        snprintf(p, sizeof(p), "[%d, {\"val\": \"%d\",\"log\": \"Using café option\"}]", i, (i * i));
+        bytes = flb_lib_push(ctx, in_ffd, p, strlen(p));
+        TEST_CHECK(bytes == strlen(p));
+    }
+
+    flb_time_msleep(1500); /* waiting flush */
+
+    got = get_output_num();
+    if (!TEST_CHECK(got == n_loop * 3)) {
+        TEST_MSG("expect: %d got: %d", n_loop * 3, got);
+    }
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
+/*
+ * Longest literal every match of a pattern must contain. A literal that is
+ * not really required makes the filter skip matching records.
+ */
+void flb_test_filter_grep_prefilter_literal(void)
+{
+    int i;
+    flb_sds_t lit;
+    struct {
+        const char *pattern;
+        const char *literal;    /* NULL: no prefilter */
+    } cases[] = {
+        /* plain and anchored literals */
+        {"deprecated",                   "deprecated"},
+        {"^Using option$",               "Using option"},
+        {"/slash delimited/",            "slash delimited"},
+
+        /* optional and repeated atoms end the run */
+        {"colou?r",                      "colo"},
+        {"ab*cdef",                      "cdef"},
+        {"abc+def",                      "abc"},
+        {"abcd{2,3}xy",                  "abc"},
+        {"abc+?de",                      "ab"},
+        {"abc.*de",                      "abc"},
+
+        /* alternation and inline options disable the prefilter */
+        {"foo|bar",                      NULL},
+        {"foo(?i)bar",                   NULL},
+        {"^Using (old|legacy) API call", " API call"},
+        {"(?:foo|bar)bazz",              "bazz"},
+
+        /* character classes and types */
+        {"[abc]def",                     "def"},
+        {"x[a-z]+yzw",                   "yzw"},
+        {"[]a]bcd",                      NULL},
+        {"\\d+ errors",                  " errors"},
+        {"\\bword\\b",                   "word"},
+
+        /* escaped metacharacters are literals */
+        {"v1\\.2",                       "v1.2"},
+        {"a\\*b\\+c\\?",                 "a*b+c?"},
+        {"\\(x\\)\\[y\\]",               "(x)[y]"},
+        {"foo\\.?bar",                   "foo"},
+        {"\\x41BC",                      NULL},
+
+        /* UTF-8: an optional character drops all of its bytes */
+        {"café",                         "café"},
+        {"cafés?",                       "café"},
+        {"naïé?ve",                      "naï"},
+        {"日本語",                       "日本語"},
+
+        {NULL, NULL}
+    };
+
+    for (i = 0; cases[i].pattern; i++) {
+        lit = grep_prefilter_literal(cases[i].pattern);
+        if (cases[i].literal == NULL) {
+            TEST_CHECK(lit == NULL);
+            TEST_MSG("pattern '%s': expected no literal, got '%s'",
+                     cases[i].pattern, lit ? lit : "");
+        }
+        else {
+            TEST_CHECK(lit != NULL && strcmp(lit, cases[i].literal) == 0);
+            TEST_MSG("pattern '%s': expected '%s', got '%s'",
+                     cases[i].pattern, cases[i].literal,
+                     lit ? lit : "(null)");
+        }
+        if (lit) {
+            flb_sds_destroy(lit);
+        }
+    }
+}
+
 /* Test list */
 TEST_LIST = {
     {"regex",   flb_test_filter_grep_regex   },
@@ -383,5 +573,7 @@ TEST_LIST = {
     {"multi_exclude", flb_test_filter_grep_multi_exclude },
     {"unknown_property", flb_test_filter_grep_unknown_property },
     {"issue_5209", flb_test_issue_5209 },
+    {"same_key", flb_test_filter_grep_same_key },
+    {"prefilter_literal", flb_test_filter_grep_prefilter_literal },
     {NULL, NULL}
 };
@@ -8,6 +8,12 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <unistd.h>
 #ifdef _WIN32
     #define TIME_EPSILON_MS 30
@@ -990,6 +996,459 @@ static void flb_test_systemd_logs()
 }
 #endif
 
+/*
+ * Watch mode: a mock API server answers the pods list, the watch streams
+ * and the per pod requests. The watch streams never send anything unless
+ * 'event_on_rewatch' is set, then every stream but the first one starts
+ * with an ADDED event for pod-b.
+ */
+#define WATCH_DOCKER_ID  "0123456789abcdef0123456789abcdef" \
+                         "0123456789abcdef0123456789abcdef"
+#define WATCH_TAG(pod)   "kube." pod "_default_app-" WATCH_DOCKER_ID ".log"
+#define WATCH_RECORD     "[1448403340, {\"log\": \"hello\"}]"
+
+#define WATCH_POD(name, app)                                              \
+    "{\"kind\":\"Pod\",\"metadata\":{\"name\":\"" name "\","              \
+    "\"namespace\":\"default\",\"resourceVersion\":\"10\","               \
+    "\"labels\":{\"app\":\"" app "\"}},\"spec\":{\"nodeName\":\"node-1\"}}"
+
+#define WATCH_LIST                                                        \
+    "{\"kind\":\"PodList\",\"metadata\":{\"resourceVersion\":\"10\"},"    \
+    "\"items\":[" WATCH_POD("pod-a", "a") "]}"
+
+#define WATCH_EVENT_B                                                     \
+    "{\"type\":\"ADDED\",\"object\":" WATCH_POD("pod-b", "b") "}\n"
+
+struct watch_server {
+    int fd;
+    int port;
+    int stop;
+    int active;
+    int event_on_rewatch;
+    int lists;
+    int watches;
+    int gets;
+    pthread_t tid;
+    pthread_mutex_t lock;
+};
+
+struct watch_result {
+    int pod_a;
+    int pod_b;
+    pthread_mutex_t lock;
+};
+
+static struct watch_server watch_srv;
+static struct watch_result watch_res;
+
+static int watch_server_get(int *counter)
+{
+    int val;
+
+    pthread_mutex_lock(&watch_srv.lock);
+    val = *counter;
+    pthread_mutex_unlock(&watch_srv.lock);
+
+    return val;
+}
+
+static void watch_server_reply(int fd, const char *status, const char *body)
+{
+    char buf[2048];
+    int len;
+
+    len = snprintf(buf, sizeof(buf),
+                   "HTTP/1.1 %s\r\n"
+                   "Content-Type: application/json\r\n"
+                   "Content-Length: %zu\r\n"
+                   "Connection: close\r\n\r\n%s",
+                   status, strlen(body), body);
+    send(fd, buf, len, MSG_NOSIGNAL);
+}
+
+/* Hold a watch stream open until the client leaves or the test ends */
+static void watch_server_stream(int fd, int watch)
+{
+    int ret;
+    char buf[512];
+    const char *hdr = "HTTP/1.1 200 OK\r\n"
+                      "Content-Type: application/json\r\n"
+                      "Transfer-Encoding: chunked\r\n\r\n";
+    struct pollfd pfd;
+
+    send(fd, hdr, strlen(hdr), MSG_NOSIGNAL);
+
+    if (watch_srv.event_on_rewatch && watch > 1) {
+        ret = snprintf(buf, sizeof(buf), "%zx\r\n%s\r\n",
+                       strlen(WATCH_EVENT_B), WATCH_EVENT_B);
+        send(fd, buf, ret, MSG_NOSIGNAL);
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!watch_server_get(&watch_srv.stop)) {
+        ret = poll(&pfd, 1, 100);
+        if (ret > 0 && recv(fd, buf, sizeof(buf), 0) <= 0) {
+            break;
+        }
+    }
+}
+
+static void *watch_server_conn(void *data)
+{
+    int fd = (int) (intptr_t) data;
+    int watch;
+    ssize_t n;
+    size_t len = 0;
+    char buf[4096];
+
+    while (len < sizeof(buf) - 1) {
+        n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0) {
+            goto exit;
+        }
+        len += n;
+        buf[len] = '\0';
+        if (strstr(buf, "\r\n\r\n")) {
+            break;
+        }
+    }
+
+    if (strncmp(buf, "GET /api/v1/pods?watch=1", 24) == 0) {
+        pthread_mutex_lock(&watch_srv.lock);
+        watch = ++watch_srv.watches;
+        pthread_mutex_unlock(&watch_srv.lock);
+
+        watch_server_stream(fd, watch);
+    }
+    else if (strncmp(buf, "GET /api/v1/pods", 16) == 0) {
+        pthread_mutex_lock(&watch_srv.lock);
+        watch_srv.lists++;
+        pthread_mutex_unlock(&watch_srv.lock);
+
+        watch_server_reply(fd, "200 OK", WATCH_LIST);
+    }
+    else if (strncmp(buf, "GET /api/v1/namespaces/default/pods/pod-b ",
+                     42) == 0) {
+        pthread_mutex_lock(&watch_srv.lock);
+        watch_srv.gets++;
+        pthread_mutex_unlock(&watch_srv.lock);
+
+        watch_server_reply(fd, "200 OK", WATCH_POD("pod-b", "b"));
+    }
+    else {
+        watch_server_reply(fd, "404 Not Found", "{}");
+    }
+
+exit:
+    close(fd);
+
+    pthread_mutex_lock(&watch_srv.lock);
+    watch_srv.active--;
+    pthread_mutex_unlock(&watch_srv.lock);
+
+    return NULL;
+}
+
+static void *watch_server_run(void *data)
+{
+    int fd;
+    pthread_t tid;
+    struct pollfd pfd;
+
+    pfd.fd = watch_srv.fd;
+    pfd.events = POLLIN;
+
+    while (!watch_server_get(&watch_srv.stop)) {
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        fd = accept(watch_srv.fd, NULL, NULL);
+        if (fd == -1) {
+            continue;
+        }
+
+        pthread_mutex_lock(&watch_srv.lock);
+        watch_srv.active++;
+        pthread_mutex_unlock(&watch_srv.lock);
+
+        if (pthread_create(&tid, NULL, watch_server_conn,
+                           (void *) (intptr_t) fd) != 0) {
+            close(fd);
+            pthread_mutex_lock(&watch_srv.lock);
+            watch_srv.active--;
+            pthread_mutex_unlock(&watch_srv.lock);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+
+    return NULL;
+}
+
+static int watch_server_start(int event_on_rewatch)
+{
+    int on = 1;
+    socklen_t len;
+    struct sockaddr_in addr;
+
+    memset(&watch_srv, 0, sizeof(watch_srv));
+    pthread_mutex_init(&watch_srv.lock, NULL);
+    watch_srv.event_on_rewatch = event_on_rewatch;
+
+    watch_srv.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (watch_srv.fd == -1) {
+        return -1;
+    }
+    setsockopt(watch_srv.fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    /* any free port */
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(addr);
+    if (bind(watch_srv.fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+        listen(watch_srv.fd, 16) == -1 ||
+        getsockname(watch_srv.fd, (struct sockaddr *) &addr, &len) == -1) {
+        close(watch_srv.fd);
+        return -1;
+    }
+    watch_srv.port = ntohs(addr.sin_port);
+
+    if (pthread_create(&watch_srv.tid, NULL, watch_server_run, NULL) != 0) {
+        close(watch_srv.fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void watch_server_stop()
+{
+    pthread_mutex_lock(&watch_srv.lock);
+    watch_srv.stop = FLB_TRUE;
+    pthread_mutex_unlock(&watch_srv.lock);
+
+    pthread_join(watch_srv.tid, NULL);
+
+    /* the streams notice the stop flag within 100ms */
+    while (watch_server_get(&watch_srv.active) > 0) {
+        flb_time_msleep(50);
+    }
+    close(watch_srv.fd);
+}
+
+/* Wait up to 'ms' milliseconds for the counter to reach 'val' */
+static int watch_wait(int *counter, int val, int ms)
+{
+    int i;
+
+    for (i = 0; i < ms / 50; i++) {
+        if (watch_server_get(counter) >= val) {
+            return 0;
+        }
+        flb_time_msleep(50);
+    }
+
+    return -1;
+}
+
+static int cb_watch_result(void *record, size_t size, void *data)
+{
+    pthread_mutex_lock(&watch_res.lock);
+    if (strstr(record, "\"pod_name\":\"pod-a\"") &&
+        strstr(record, "\"labels\":{\"app\":\"a\"}")) {
+        watch_res.pod_a++;
+    }
+    else if (strstr(record, "\"pod_name\":\"pod-b\"") &&
+             strstr(record, "\"labels\":{\"app\":\"b\"}")) {
+        watch_res.pod_b++;
+    }
+    pthread_mutex_unlock(&watch_res.lock);
+
+    if (size > 0) {
+        flb_free(record);
+    }
+    return 0;
+}
+
+/* Wait up to 'ms' milliseconds for the enriched records */
+static int watch_wait_result(int pod_a, int pod_b, int ms)
+{
+    int i;
+    int ret = -1;
+
+    for (i = 0; i < ms / 50 && ret == -1; i++) {
+        pthread_mutex_lock(&watch_res.lock);
+        if (watch_res.pod_a >= pod_a && watch_res.pod_b >= pod_b) {
+            ret = 0;
+        }
+        pthread_mutex_unlock(&watch_res.lock);
+
+        if (ret == -1) {
+            flb_time_msleep(50);
+        }
+    }
+
+    return ret;
+}
+
+static flb_ctx_t *watch_ctx_create(int *in_ffd, const char *resync,
+                                   struct flb_lib_out_cb *cb_data)
+{
+    int ret;
+    int f_ffd;
+    int out_ffd;
+    char url[64];
+    flb_ctx_t *ctx;
+
+    memset(&watch_res, 0, sizeof(watch_res));
+    pthread_mutex_init(&watch_res.lock, NULL);
+
+    ctx = flb_create();
+    if (!ctx) {
+        return NULL;
+    }
+    flb_service_set(ctx,
+                    "Flush", "0.2",
+                    "Grace", "1",
+                    "Log_Level", "error",
+                    NULL);
+
+    in_ffd[0] = flb_input(ctx, "lib", NULL);
+    TEST_CHECK(in_ffd[0] >= 0);
+    flb_input_set(ctx, in_ffd[0], "Tag", WATCH_TAG("pod-a"), NULL);
+    in_ffd[1] = flb_input(ctx, "lib", NULL);
+    TEST_CHECK(in_ffd[1] >= 0);
+    flb_input_set(ctx, in_ffd[1], "Tag", WATCH_TAG("pod-b"), NULL);
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%i", watch_srv.port);
+    f_ffd = flb_filter(ctx, "kubernetes", NULL);
+    TEST_CHECK(f_ffd >= 0);
+    ret = flb_filter_set(ctx, f_ffd,
+                         "Match", "kube.*",
+                         "Kube_Url", url,
+                         "Kube_Tag_Prefix", "kube.",
+                         "Kube_Meta_Watch", "On",
+                         "Kube_Meta_Watch_Timeout", "1s",
+                         "Kube_Meta_Watch_Resync", resync,
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    cb_data->cb = cb_watch_result;
+    cb_data->data = NULL;
+    out_ffd = flb_output(ctx, "lib", (void *) cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd,
+                   "Match", "kube.*",
+                   "format", "json",
+                   NULL);
+
+    return ctx;
+}
+
+/* After the list, a pod missing from the store is requested by itself */
+static void flb_test_watch_store_miss()
+{
+    int ret;
+    int in_ffd[2];
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb_data;
+
+    ret = watch_server_start(FLB_FALSE);
+    if (!TEST_CHECK(ret == 0)) {
+        return;
+    }
+
+    ctx = watch_ctx_create(in_ffd, "0", &cb_data);
+    TEST_CHECK(flb_start(ctx) == 0);
+
+    /* the store is synced once the list is loaded */
+    TEST_CHECK(watch_wait(&watch_srv.watches, 1, 5000) == 0);
+
+    flb_lib_push(ctx, in_ffd[0], WATCH_RECORD, sizeof(WATCH_RECORD) - 1);
+    flb_lib_push(ctx, in_ffd[1], WATCH_RECORD, sizeof(WATCH_RECORD) - 1);
+
+    ret = watch_wait_result(1, 1, 5000);
+    TEST_CHECK(ret == 0);
+    TEST_MSG("pod-a=%i pod-b=%i enriched records",
+             watch_res.pod_a, watch_res.pod_b);
+
+    /* pod-a came from the store, pod-b from its own request */
+    TEST_CHECK(watch_server_get(&watch_srv.gets) == 1);
+    TEST_MSG("gets=%i, expected 1", watch_server_get(&watch_srv.gets));
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    watch_server_stop();
+}
+
+/*
+ * A stream that never sends anything is dropped and watched again from the
+ * last resource version, the events of the new stream land in the store.
+ */
+static void flb_test_watch_silent_stream()
+{
+    int ret;
+    int in_ffd[2];
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb_data;
+
+    ret = watch_server_start(FLB_TRUE);
+    if (!TEST_CHECK(ret == 0)) {
+        return;
+    }
+
+    ctx = watch_ctx_create(in_ffd, "0", &cb_data);
+    TEST_CHECK(flb_start(ctx) == 0);
+
+    /* the io timeout is twice the 1s watch timeout */
+    ret = watch_wait(&watch_srv.watches, 2, 8000);
+    TEST_CHECK(ret == 0);
+    TEST_MSG("watches=%i, expected 2", watch_server_get(&watch_srv.watches));
+    flb_time_msleep(300);
+
+    flb_lib_push(ctx, in_ffd[1], WATCH_RECORD, sizeof(WATCH_RECORD) - 1);
+
+    ret = watch_wait_result(0, 1, 5000);
+    TEST_CHECK(ret == 0);
+
+    /* served from the store: no request for the pod and no new list */
+    TEST_CHECK(watch_server_get(&watch_srv.gets) == 0);
+    TEST_CHECK(watch_server_get(&watch_srv.lists) == 1);
+    TEST_MSG("gets=%i lists=%i", watch_server_get(&watch_srv.gets),
+             watch_server_get(&watch_srv.lists));
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    watch_server_stop();
+}
+
+/* The pods are listed again every kube_meta_watch_resync */
+static void flb_test_watch_resync()
+{
+    int ret;
+    int in_ffd[2];
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb_data;
+
+    ret = watch_server_start(FLB_FALSE);
+    if (!TEST_CHECK(ret == 0)) {
+        return;
+    }
+
+    ctx = watch_ctx_create(in_ffd, "1s", &cb_data);
+    TEST_CHECK(flb_start(ctx) == 0);
+
+    ret = watch_wait(&watch_srv.lists, 2, 8000);
+    TEST_CHECK(ret == 0);
+    TEST_MSG("lists=%i, expected 2", watch_server_get(&watch_srv.lists));
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    watch_server_stop();
+}
+
 TEST_LIST = {
     {"kube_core_base", flb_test_core_base},
     {"kube_core_no_meta", flb_test_core_no_meta},
@@ -1083,5 +1542,8 @@ TEST_LIST = {
 #ifdef FLB_HAVE_SYSTEMD
     {"kube_systemd_logs", flb_test_systemd_logs},
 #endif
+    {"kube_watch_store_miss", flb_test_watch_store_miss},
+    {"kube_watch_silent_stream", flb_test_watch_silent_stream},
+    {"kube_watch_resync", flb_test_watch_resync},
     {NULL, NULL}
 };
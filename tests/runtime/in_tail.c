@@ -1549,6 +1549,122 @@ void flb_test_db()
 #endif /* FLB_HAVE_SQLDB */
 
 /* Test list */
+#ifdef FLB_HAVE_IO_URING
+/*
+ * Tail a large set of small files that keep growing, 'io_uring' is the
+ * value of the option of the same name. Returns the number of milliseconds
+ * it took to get all the appended records, or -1 on timeout.
+ */
+static int64_t tail_many_files(char *io_uring, int files, int rounds)
+{
+    int i;
+    int r;
+    int ret;
+    int num;
+    int expected;
+    char buf[64];
+    char **paths;
+    size_t len;
+    ssize_t w_byte;
+    int64_t elapsed = -1;
+    struct flb_time t_start;
+    struct flb_time t_end;
+    struct flb_time t_diff;
+    struct flb_lib_out_cb cb_data;
+    struct test_tail_ctx *ctx;
+
+    paths = flb_calloc(files, sizeof(char *));
+    if (!TEST_CHECK(paths != NULL)) {
+        return -1;
+    }
+    for (i = 0; i < files; i++) {
+        paths[i] = flb_malloc(32);
+        snprintf(paths[i], 32, "io_uring_%d.log", i);
+    }
+
+    clear_output_num();
+
+    cb_data.cb = cb_count_msgpack;
+    cb_data.data = NULL;
+
+    ctx = test_tail_ctx_create(&cb_data, paths, files, FLB_TRUE);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "path", "io_uring_*.log",
+                        "read_from_head", "true",
+                        "io_uring", io_uring,
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* let the plugin discover the files */
+    flb_time_msleep(1000);
+
+    expected = files * rounds;
+    flb_time_get(&t_start);
+
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < files; i++) {
+            len = snprintf(buf, sizeof(buf), "round=%d file=%d" NEW_LINE, r, i);
+            w_byte = write(ctx->fds[i], buf, len);
+            if (!TEST_CHECK(w_byte == len)) {
+                TEST_MSG("write failed ret=%ld", w_byte);
+            }
+        }
+        flb_time_msleep(20);
+    }
+
+    /* wait for the records, up to 10 seconds */
+    for (i = 0; i < 1000; i++) {
+        num = get_output_num();
+        if (num >= expected) {
+            flb_time_get(&t_end);
+            flb_time_diff(&t_end, &t_start, &t_diff);
+            elapsed = flb_time_to_nanosec(&t_diff) / 1000000;
+            break;
+        }
+        flb_time_msleep(10);
+    }
+
+    num = get_output_num();
+    if (!TEST_CHECK(num == expected)) {
+        TEST_MSG("io_uring=%s got %i records, expected %i",
+                 io_uring, num, expected);
+    }
+
+    test_tail_ctx_destroy(ctx);
+
+    for (i = 0; i < files; i++) {
+        flb_free(paths[i]);
+    }
+    flb_free(paths);
+
+    return elapsed;
+}
+
+void flb_test_io_uring_many_files()
+{
+    int files = 500;
+    int rounds = 20;
+    int64_t t_read;
+    int64_t t_uring;
+
+    t_read = tail_many_files("false", files, rounds);
+    t_uring = tail_many_files("true", files, rounds);
+
+    TEST_CHECK(t_read >= 0 && t_uring >= 0);
+    printf("\n%i files x %i rounds: read(2)=%"PRId64"ms io_uring=%"PRId64"ms\n",
+           files, rounds, t_read, t_uring);
+}
+#endif /* FLB_HAVE_IO_URING */
+
 TEST_LIST = {
     {"issue_3943", flb_test_in_tail_issue_3943},
     /* Properties */
@@ -1572,6 +1688,10 @@ TEST_LIST = {
     {"db", flb_test_db},
 #endif
 
+#ifdef FLB_HAVE_IO_URING
+    {"io_uring_many_files", flb_test_io_uring_many_files},
+#endif
+
 #ifdef in_tail
     {"in_tail_dockermode",                          flb_test_in_tail_dockermode},
     {"in_tail_dockermode_splitted_line",            flb_test_in_tail_dockermode_splitted_line},